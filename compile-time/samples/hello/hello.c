@@ -5,26 +5,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-/* ====================================================================== */
-
-/* Declarations of the stubs. */
-void *
-vmalloc(unsigned long size);
-
-void 
-vfree(void *addr);
 
-int 
-alloc_chrdev_region(dev_t *dev, unsigned baseminor, unsigned count,
-		    const char *name);
-void 
-unregister_chrdev_region(dev_t from, unsigned count);
-
-void *
-__kmalloc(size_t size, unsigned int flags);
-
-void 
-kfree(void *addr);
+#include "stubs.h"
 /* ====================================================================== */
 
 typedef enum {
@@ -111,7 +93,7 @@ kmalloc(size_t size, unsigned int flags)
 static void *
 kzalloc(size_t size, unsigned int flags)
 {
-	return __kmalloc(size, flags | 0x4000);
+	return __kmalloc(size, flags | MY_GFP_ZERO);
 }
 
 static int
@@ -174,6 +156,47 @@ other_func(const char *p, int x, unsigned long u, struct my_struct1 s,
 	return x + (int)u + (int)s.b;
 }
 
+/* Memory accesses the shadow memory checker should report: an 
+ * out-of-bounds read, a read of the uninitialized data, and some correct 
+ * accesses that should not be reported. */
+static int
+buggy_func(void)
+{
+	struct my_struct1 *s;
+	char *buf;
+	int ret = 0;
+	
+	buf = kmalloc(13, 0x8afe);
+	if (!buf) {
+		printf("kmalloc() failed!\n");
+		return -1;
+	}
+	memset(buf, 'a', 13);
+	ret += buf[12];
+	ret += buf[13]; /* 1 byte out of bounds */
+	kfree(buf);
+	
+	s = kmalloc(sizeof(*s), 0x8afe);
+	if (!s) {
+		printf("kmalloc() failed!\n");
+		return -1;
+	}
+	s->a = 1;
+	ret += (int)s->a;
+	ret += (int)s->b; /* s->b has not been set */
+	kfree(s);
+	
+	s = kzalloc(sizeof(*s), 0x8afe);
+	if (!s) {
+		printf("kzalloc() failed!\n");
+		return -1;
+	}
+	ret += (int)s->c; /* OK, zeroed by kzalloc() */
+	kfree(s);
+	
+	return ret;
+}
+
 static void
 argless_func(void)
 {
@@ -191,6 +214,11 @@ main(int argc, char *argv[])
 	args[0] = 4;
 	args[1] = (unsigned long)pp;
 	
+	if (argc > 4) {
+		printf("buggy_func() returned %d\n", buggy_func());
+		return 0;
+	}
+	
 	if (argc > 2) {
 		struct my_struct1 s;
 		int ret;
@@ -2,8 +2,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <sys/types.h>
 #include <unistd.h>
+
+#include "shadow.h"
+#include "stubs.h"
 /* ====================================================================== */
 
 void *
@@ -86,6 +90,41 @@ my_func_dummy_exit(struct my_struct *p)
 }
 /* ====================================================================== */
 
+/* Shadow memory for the blocks allocated by the tracked functions (see
+ * shadow.h).
+ *
+ * The allocators here are based on malloc(), so the slack malloc() gives 
+ * in addition to the requested size is marked as a redzone. The size field
+ * of the header of the malloc chunk, right before the block, is a redzone
+ * too: it never belongs to the other blocks.
+ * 
+ * [NB] When the block is freed, it is no longer tracked: the memory may 
+ * then be reused by the allocations we know nothing about. */
+
+static void
+shadow_alloc(void *addr, unsigned long size, int initialized)
+{
+	if (shadow_mark_allocated(addr, size, malloc_usable_size(addr), 
+				  initialized) != 0 ||
+	    shadow_mark_redzone((char *)addr - SHADOW_GRANULE_SIZE, 
+				SHADOW_GRANULE_SIZE) != 0) {
+		printf(
+		"[DBG] Not enough memory for the shadow, %p is not tracked.\n",
+			addr);
+	}
+}
+
+static void
+shadow_free(void *addr)
+{
+	if (addr == NULL)
+		return;
+	
+	shadow_clear((char *)addr - SHADOW_GRANULE_SIZE, 
+		     malloc_usable_size(addr) + SHADOW_GRANULE_SIZE);
+}
+/* ====================================================================== */
+
 /* Handling of memory reads and writes. 
  *
  * pc - address of the instruction somewhere near the place where the event
@@ -106,71 +145,91 @@ report_memory_event(void *pc, void *addr, unsigned int size, int is_write,
 void
 my_func_read1(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 1, 0, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 1, 0, pc);
+	report_memory_event(pc, addr, 1, 0, ls);
 }
 
 void
 my_func_read2(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 2, 0, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 2, 0, pc);
+	report_memory_event(pc, addr, 2, 0, ls);
 }
 
 void
 my_func_read4(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 4, 0, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 4, 0, pc);
+	report_memory_event(pc, addr, 4, 0, ls);
 }
 
 void
 my_func_read8(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 8, 0, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 8, 0, pc);
+	report_memory_event(pc, addr, 8, 0, ls);
 }
 
 void
 my_func_read16(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 16, 0, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 16, 0, pc);
+	report_memory_event(pc, addr, 16, 0, ls);
 }
 
 void
 my_func_write1(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 1, 1, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 1, 1, pc);
+	report_memory_event(pc, addr, 1, 1, ls);
 }
 
 void
 my_func_write2(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 2, 1, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 2, 1, pc);
+	report_memory_event(pc, addr, 2, 1, ls);
 }
 
 void
 my_func_write4(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 4, 1, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 4, 1, pc);
+	report_memory_event(pc, addr, 4, 1, ls);
 }
 
 void
 my_func_write8(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 8, 1, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 8, 1, pc);
+	report_memory_event(pc, addr, 8, 1, ls);
 }
 
 void
 my_func_write16(void *addr, struct my_struct *ls)
 {
-	report_memory_event(
-		(void *)__builtin_return_address(0), addr, 16, 1, ls);
+	void *pc = (void *)__builtin_return_address(0);
+
+	shadow_check_access(addr, 16, 1, pc);
+	report_memory_event(pc, addr, 16, 1, ls);
 }
 /* ====================================================================== */
 
@@ -209,6 +268,9 @@ my_func_vmalloc_post(void *ret, struct my_struct *ls)
 	 * to use. */
 	printf("[DBG] post handler: vmalloc(%lu) returned %p.\n", 
 		ls->data[0], ret);
+	
+	if (ret != NULL)
+		shadow_alloc(ret, ls->data[0], 0);
 }
 
 /* Handlers for void vfree(void *addr) */
@@ -217,6 +279,7 @@ my_func_vfree_pre(void *addr, struct my_struct *ls)
 {
 	printf("[DBG] pre handler: vfree(%p)\n", addr);
 	ls->data[0] = (unsigned long)addr;
+	shadow_free(addr);
 }
 
 void
@@ -288,6 +351,10 @@ my_func_strlen_post(unsigned long ret, struct my_struct *ls)
 {
 	printf("[DBG] post handler: strlen(%s) = %lu\n",
 		(const char *)ls->data[0], (unsigned long)ret);	
+	
+	/* strlen() has read the string including the terminating 0. */
+	shadow_check_range((const char *)ls->data[0], ret + 1, 0,
+			   __builtin_return_address(0));
 }
 
 /* Handlers for void *memcpy(void *dest, const void *src, size_t count) */
@@ -297,6 +364,12 @@ my_func_memcpy_pre(void *dest, const void *src, unsigned long count,
 {
 	printf("[DBG] pre handler: memcpy(%p, %p, %lu)\n",
 		dest, src, count);
+	
+	/* [NB] The data are copied with their "initialized" state lost: the
+	 * destination becomes initialized. */
+	shadow_check_range(src, count, 0, __builtin_return_address(0));
+	shadow_check_range(dest, count, 1, __builtin_return_address(0));
+	
 	ls->data[0] = (unsigned long)dest;
 	ls->data[1] = (unsigned long)src;
 	ls->data[2] = count;
@@ -319,6 +392,7 @@ my_func_memset_pre(void *s, int c, unsigned long count,
 {
 	printf("[DBG] pre handler: memset(%p, %d, %lu)\n",
 		s, c, count);
+	shadow_check_range(s, count, 1, __builtin_return_address(0));
 	ls->data[0] = (unsigned long)s;
 	ls->data[1] = (unsigned long)c;
 	ls->data[2] = count;
@@ -383,6 +457,7 @@ my_func_kfree_pre(void *addr, struct my_struct *ls)
 {
 	printf("[DBG] pre handler: kfree(%p)\n", addr);
 	ls->data[0] = (unsigned long)addr;
+	shadow_free(addr);
 }
 
 void
@@ -425,6 +500,8 @@ my_func_call_pvoid_ulong_post(void *ret, struct my_struct *ls)
 	if (ls->callee == (void *)vmalloc) {
 		printf("[DBG] after indirect call to vmalloc(%lu), ret=%p\n",
 			ls->data[0], ret);
+		if (ret != NULL)
+			shadow_alloc(ret, ls->data[0], 0);
 	}
 	else {
 		printf(
@@ -499,6 +576,11 @@ my_func___kmalloc_repl(size_t size, unsigned int flags,
 	printf(
 "[DBG] Replacement for __kmalloc(%zu, %x) - after the call (ret = %p).\n",
 		size, flags, ret);
+	
+	/* Both kmalloc() and kzalloc() come here, so the shadow is set here 
+	 * rather than in their post handlers. */
+	if (ret != NULL)
+		shadow_alloc(ret, size, flags & MY_GFP_ZERO);
 	return ret;
 }
 /* ====================================================================== */
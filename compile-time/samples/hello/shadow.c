@@ -0,0 +1,261 @@
+/* Shadow memory: validity of the tracked memory with 8-byte granularity.
+ * See shadow.h for the description.
+ *
+ * gcc -c -o shadow.o shadow.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "shadow.h"
+/* ====================================================================== */
+
+/* The top level of the table of the shadow chunks. The tables and the
+ * chunks are published with release semantics and are never freed, so
+ * shadow_lookup() needs no locks. */
+struct shadow_table *shadow_dir[SHADOW_DIR_SIZE];
+
+/* Serializes the allocation of the tables and the chunks. */
+static pthread_mutex_t shadow_alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long error_count;
+/* ====================================================================== */
+
+/* Returns the shadow chunk covering 'addr', allocates it (and the table
+ * for it) if needed. Returns NULL if 'addr' is not supported or there is
+ * not enough memory. */
+static unsigned char *
+shadow_get_chunk(uintptr_t addr)
+{
+	struct shadow_table **ptable;
+	unsigned char **pchunk;
+	unsigned char *chunk = NULL;
+
+	if (addr >> 48)
+		return NULL;
+
+	chunk = shadow_lookup((const void *)addr);
+	if (chunk != NULL)
+		return chunk - ((addr >> SHADOW_GRANULE_SHIFT) &
+				(SHADOW_CHUNK_SIZE - 1));
+
+	ptable = &shadow_dir[addr >> SHADOW_TABLE_ADDR_SHIFT];
+	pthread_mutex_lock(&shadow_alloc_lock);
+	if (*ptable == NULL) {
+		struct shadow_table *table = calloc(1, sizeof(*table));
+		if (table == NULL)
+			goto out;
+		__atomic_store_n(ptable, table, __ATOMIC_RELEASE);
+	}
+
+	pchunk = &(*ptable)->chunks[(addr >> SHADOW_CHUNK_ADDR_SHIFT) &
+				    ((1UL << SHADOW_TABLE_SHIFT) - 1)];
+	chunk = *pchunk;
+	if (chunk == NULL) {
+		/* Zeroed, that is, SHADOW_UNTRACKED. */
+		chunk = calloc(SHADOW_CHUNK_SIZE, 1);
+		if (chunk == NULL)
+			goto out;
+		__atomic_store_n(pchunk, chunk, __ATOMIC_RELEASE);
+	}
+out:
+	pthread_mutex_unlock(&shadow_alloc_lock);
+	return chunk;
+}
+
+/* Sets the shadow bytes for the granules in [start, end) to 'value'.
+ * 'start' and 'end' must be aligned on SHADOW_GRANULE_SIZE.
+ *
+ * If 'value' is SHADOW_UNTRACKED, the chunks are not allocated: there is
+ * nothing to clear if they do not exist. */
+static int
+shadow_fill(uintptr_t start, uintptr_t end, unsigned char value)
+{
+	const uintptr_t chunk_mem_size = 1UL << SHADOW_CHUNK_ADDR_SHIFT;
+
+	while (start < end) {
+		uintptr_t next = (start | (chunk_mem_size - 1)) + 1;
+		unsigned char *shadow;
+
+		if (next > end)
+			next = end;
+
+		if (value == SHADOW_UNTRACKED) {
+			shadow = shadow_lookup((const void *)start);
+		}
+		else {
+			shadow = shadow_get_chunk(start);
+			if (shadow == NULL)
+				return -ENOMEM;
+			shadow += (start >> SHADOW_GRANULE_SHIFT) &
+				(SHADOW_CHUNK_SIZE - 1);
+		}
+
+		if (shadow != NULL) {
+			memset(shadow, value,
+			       (next - start) >> SHADOW_GRANULE_SHIFT);
+		}
+		start = next;
+	}
+	return 0;
+}
+
+static inline uintptr_t
+granule_round_down(uintptr_t addr)
+{
+	return addr & ~(SHADOW_GRANULE_SIZE - 1);
+}
+
+static inline uintptr_t
+granule_round_up(uintptr_t addr)
+{
+	return granule_round_down(addr + SHADOW_GRANULE_SIZE - 1);
+}
+/* ====================================================================== */
+
+static void
+report_error(const char *what, uintptr_t addr, size_t size, int is_write,
+	     uintptr_t bad_addr, void *pc)
+{
+	++error_count;
+	printf(
+"[SHADOW] %s: %s at %p: accessed %zu byte(s) starting from %p, "
+"the first bad byte is at %p.\n",
+		what, (is_write ? "write" : "read"), pc, size,
+		(void *)addr, (void *)bad_addr);
+}
+
+/* Checks the granules of the area one by one. If 'check_init' is 0, the
+ * reads of the uninitialized memory are not reported.
+ *
+ * Only the first out-of-bounds byte and the first uninitialized granule
+ * are reported. The uninitialized granules are marked as initialized
+ * after the report, to avoid the flood of reports about the same data. */
+static int
+shadow_check_granules(uintptr_t addr, size_t size, int is_write,
+		      int check_init, void *pc)
+{
+	uintptr_t end = addr + size;
+	uintptr_t granule;
+	uintptr_t bad_addr = 0;
+	uintptr_t uninit_addr = 0;
+	int found_bad = 0;
+	int found_uninit = 0;
+
+	for (granule = granule_round_down(addr); granule < end;
+	     granule += SHADOW_GRANULE_SIZE) {
+		unsigned char *shadow = shadow_lookup((const void *)granule);
+		unsigned char value;
+		uintptr_t from;
+		uintptr_t to;
+		uintptr_t valid_end;
+
+		if (shadow == NULL || *shadow == SHADOW_UNTRACKED)
+			continue;
+
+		value = *shadow;
+		from = (granule < addr ? addr : granule);
+		to = (end - granule < SHADOW_GRANULE_SIZE ?
+			end : granule + SHADOW_GRANULE_SIZE);
+
+		valid_end = granule;
+		if (value != SHADOW_REDZONE)
+			valid_end += (value & (SHADOW_UNINIT - 1));
+
+		if (to > valid_end) {
+			if (!found_bad) {
+				found_bad = 1;
+				bad_addr = (from > valid_end ? from : valid_end);
+			}
+			continue;
+		}
+
+		if (!(value & SHADOW_UNINIT))
+			continue;
+
+		if (!is_write && check_init && !found_uninit) {
+			found_uninit = 1;
+			uninit_addr = from;
+		}
+		if (is_write || check_init)
+			*shadow = value & ~SHADOW_UNINIT;
+	}
+
+	if (found_bad) {
+		report_error("out-of-bounds access", addr, size, is_write,
+			     bad_addr, pc);
+	}
+	if (found_uninit) {
+		report_error("uninitialized memory", addr, size, is_write,
+			     uninit_addr, pc);
+	}
+	return found_bad || found_uninit;
+}
+
+void
+shadow_check_slow(const void *addr, unsigned int size, int is_write,
+		  void *pc)
+{
+	shadow_check_granules((uintptr_t)addr, size, is_write, 1, pc);
+}
+
+int
+shadow_check_range(const void *addr, size_t size, int is_write, void *pc)
+{
+	if (size == 0)
+		return 0;
+	return shadow_check_granules((uintptr_t)addr, size, is_write, 0, pc);
+}
+/* ====================================================================== */
+
+int
+shadow_mark_allocated(const void *addr, size_t size, size_t usable,
+		      int initialized)
+{
+	uintptr_t start = (uintptr_t)addr;
+	uintptr_t full_end = start + (size & ~(SHADOW_GRANULE_SIZE - 1));
+	unsigned char state = (initialized ? 0 : SHADOW_UNINIT);
+	int ret;
+
+	if (usable < size)
+		usable = size;
+
+	ret = shadow_fill(start, full_end, SHADOW_ADDRESSABLE | state);
+	if (ret)
+		return ret;
+
+	if (size & (SHADOW_GRANULE_SIZE - 1)) {
+		ret = shadow_fill(full_end, full_end + SHADOW_GRANULE_SIZE,
+			(size & (SHADOW_GRANULE_SIZE - 1)) | state);
+		if (ret)
+			return ret;
+	}
+
+	return shadow_fill(granule_round_up(start + size),
+			   granule_round_up(start + usable), SHADOW_REDZONE);
+}
+
+int
+shadow_mark_redzone(const void *addr, size_t size)
+{
+	return shadow_fill(granule_round_down((uintptr_t)addr),
+			   granule_round_up((uintptr_t)addr + size),
+			   SHADOW_REDZONE);
+}
+
+void
+shadow_clear(const void *addr, size_t size)
+{
+	shadow_fill(granule_round_down((uintptr_t)addr),
+		    granule_round_up((uintptr_t)addr + size),
+		    SHADOW_UNTRACKED);
+}
+
+unsigned long
+shadow_get_error_count(void)
+{
+	return error_count;
+}
+/* ====================================================================== */
@@ -0,0 +1,149 @@
+/* Shadow memory: validity of the tracked memory with 8-byte granularity.
+ *
+ * Each 8-byte granule of the memory (aligned on 8 bytes) has one shadow
+ * byte. The allocation handlers mark the allocated blocks and the redzones
+ * around them, the handlers of memory reads and writes check the accessed
+ * bytes against the shadow.
+ *
+ * The memory nobody has marked (stack, global data, the memory allocated
+ * by the functions we do not track) is not checked at all.
+ *
+ * gcc -c -o shadow.o shadow.c */
+
+#ifndef SHADOW_H_1633_INCLUDED
+#define SHADOW_H_1633_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+/* ====================================================================== */
+
+#define SHADOW_GRANULE_SHIFT 3
+#define SHADOW_GRANULE_SIZE (1UL << SHADOW_GRANULE_SHIFT)
+
+/* Values of the shadow bytes.
+ *
+ * 0x01 - 0x08: the first N bytes of the granule are addressable, the rest
+ * (if any) are not. SHADOW_UNINIT can be set in addition to that if the
+ * granule has not been written to since it was allocated.
+ *
+ * [NB] The state "initialized" is tracked for the granule as a whole, so
+ * a write to a part of the granule makes all of it initialized. */
+#define SHADOW_UNTRACKED	0x00
+#define SHADOW_ADDRESSABLE	0x08
+#define SHADOW_UNINIT		0x10
+#define SHADOW_REDZONE		0xfa
+
+/* The shadow is kept in chunks, each chunk covers
+ * (SHADOW_CHUNK_SIZE << SHADOW_GRANULE_SHIFT) bytes of the memory.
+ * The chunks are looked up via the two-level table, like the page tables,
+ * and are allocated when a block in the range they cover is marked.
+ * 48-bit addresses are supported. */
+#define SHADOW_CHUNK_SHIFT	13
+#define SHADOW_CHUNK_SIZE	(1UL << SHADOW_CHUNK_SHIFT)
+#define SHADOW_TABLE_SHIFT	16
+
+#define SHADOW_CHUNK_ADDR_SHIFT	(SHADOW_CHUNK_SHIFT + SHADOW_GRANULE_SHIFT)
+#define SHADOW_TABLE_ADDR_SHIFT	(SHADOW_CHUNK_ADDR_SHIFT + SHADOW_TABLE_SHIFT)
+#define SHADOW_DIR_SIZE		(1UL << (48 - SHADOW_TABLE_ADDR_SHIFT))
+
+struct shadow_table {
+	unsigned char *chunks[1UL << SHADOW_TABLE_SHIFT];
+};
+
+extern struct shadow_table *shadow_dir[SHADOW_DIR_SIZE];
+/* ====================================================================== */
+
+/* Returns the shadow byte for the granule 'addr' belongs to or NULL if
+ * no memory near 'addr' is tracked. Does not take any locks. */
+static inline unsigned char *
+shadow_lookup(const void *addr)
+{
+	uintptr_t a = (uintptr_t)addr;
+	struct shadow_table *table;
+	unsigned char *chunk;
+
+	if (a >> 48)
+		return NULL;
+
+	table = __atomic_load_n(&shadow_dir[a >> SHADOW_TABLE_ADDR_SHIFT],
+				__ATOMIC_ACQUIRE);
+	if (table == NULL)
+		return NULL;
+
+	chunk = __atomic_load_n(&table->chunks[
+			(a >> SHADOW_CHUNK_ADDR_SHIFT) &
+			((1UL << SHADOW_TABLE_SHIFT) - 1)],
+		__ATOMIC_ACQUIRE);
+	if (chunk == NULL)
+		return NULL;
+
+	return &chunk[(a >> SHADOW_GRANULE_SHIFT) & (SHADOW_CHUNK_SIZE - 1)];
+}
+
+/* Checks the access that shadow_check_access() could not decide on
+ * quickly, reports the errors. For writes, marks the accessed granules as
+ * initialized. */
+void
+shadow_check_slow(const void *addr, unsigned int size, int is_write,
+		  void *pc);
+
+/* Checks the access of 'size' bytes (size <= 16) at 'addr'. 'pc' is the
+ * address of the instruction to be reported in case of an error.
+ *
+ * The common case, an access to the initialized addressable memory that
+ * does not cross the boundary of a granule, as well as the access to the
+ * memory that is not tracked, is handled here, without a call. */
+static inline void
+shadow_check_access(const void *addr, unsigned int size, int is_write,
+		    void *pc)
+{
+	unsigned char *shadow = shadow_lookup(addr);
+
+	if (shadow == NULL)
+		return;
+
+	if (((uintptr_t)addr & (SHADOW_GRANULE_SIZE - 1)) + size <=
+		SHADOW_GRANULE_SIZE) {
+		if (*shadow == SHADOW_ADDRESSABLE ||
+		    *shadow == SHADOW_UNTRACKED)
+			return;
+	}
+	shadow_check_slow(addr, size, is_write, pc);
+}
+
+/* Checks the access to the memory area of an arbitrary size, e.g. by
+ * memset() or memcpy(). If 'is_write' is 0, only the addressability is
+ * checked. Returns 0 if no errors have been found, non-zero otherwise.
+ * For writes, marks the area as initialized. */
+int
+shadow_check_range(const void *addr, size_t size, int is_write, void *pc);
+/* ====================================================================== */
+
+/* Marks the block of 'size' bytes allocated at 'addr' as addressable and
+ * initialized (if 'initialized' is non-zero) or not. The area from the end
+ * of the block up to 'addr + usable' (the slack the allocator gives in
+ * addition) is marked as a redzone.
+ *
+ * 'addr' must be aligned on SHADOW_GRANULE_SIZE.
+ *
+ * Returns 0 if successful, -ENOMEM if the shadow could not be allocated.*/
+int
+shadow_mark_allocated(const void *addr, size_t size, size_t usable,
+		      int initialized);
+
+/* Marks the area as a redzone: any access to it will be reported.
+ * The area is extended to the granule boundaries.
+ * Returns 0 if successful, -ENOMEM if the shadow could not be allocated. */
+int
+shadow_mark_redzone(const void *addr, size_t size);
+
+/* Stops tracking the area (e.g. when the block is freed), extending it to
+ * the granule boundaries. */
+void
+shadow_clear(const void *addr, size_t size);
+
+/* Returns the number of errors reported so far. */
+unsigned long
+shadow_get_error_count(void);
+/* ====================================================================== */
+#endif /*SHADOW_H_1633_INCLUDED*/
@@ -0,0 +1,187 @@
+/* Check of the shadow memory and of the handlers that maintain and check
+ * it. The handlers are called directly, the way the code instrumented by
+ * the plugin calls them, so the plugin is not needed here.
+ *
+ * The "[SHADOW]" reports are compared with shadow_test.expected by
+ * "make check" (see Makefile). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shadow.h"
+#include "stubs.h"
+/* ====================================================================== */
+
+/* The handlers from my_funcs.c. */
+struct my_struct;
+
+struct my_struct *
+my_func_dummy_entry(void *func, unsigned int nargs, void **args);
+
+void
+my_func_dummy_exit(struct my_struct *p);
+
+void
+my_func_read1(void *addr, struct my_struct *ls);
+
+void
+my_func_read8(void *addr, struct my_struct *ls);
+
+void
+my_func_read16(void *addr, struct my_struct *ls);
+
+void
+my_func_write8(void *addr, struct my_struct *ls);
+
+void *
+my_func___kmalloc_repl(size_t size, unsigned int flags,
+		       struct my_struct *ls);
+
+void
+my_func_kfree_pre(void *addr, struct my_struct *ls);
+
+void
+my_func_memset_pre(void *s, int c, unsigned long count,
+		   struct my_struct *ls);
+/* ====================================================================== */
+
+struct my_struct1 {
+	unsigned long a;
+	unsigned long b;
+	unsigned long c;
+	void *p;
+};
+
+static int failed;
+
+/* Checks that exactly 'expected' errors have been reported since
+ * 'start'. */
+static void
+check_errors(unsigned long start, unsigned long expected, const char *what)
+{
+	unsigned long count = shadow_get_error_count() - start;
+
+	printf("%s: %lu error(s)\n", what, count);
+	if (count != expected) {
+		printf("FAIL: %lu error(s) expected\n", expected);
+		++failed;
+	}
+}
+
+/* Out-of-bounds accesses to a 13-byte block, by 1 byte as well as by
+ * wider reads and by memset(). */
+static void
+test_bounds(struct my_struct *ls)
+{
+	char buf_stack[16];
+	unsigned long start;
+	char *buf;
+
+	buf = my_func___kmalloc_repl(13, 0x8afe, ls);
+	if (buf == NULL) {
+		printf("FAIL: __kmalloc() failed\n");
+		++failed;
+		return;
+	}
+	my_func_memset_pre(buf, 'a', 13, ls);
+	memset(buf, 'a', 13);
+
+	start = shadow_get_error_count();
+	my_func_read1(buf + 12, ls);
+	check_errors(start, 0, "last byte of the block");
+
+	start = shadow_get_error_count();
+	my_func_read1(buf + 13, ls);
+	check_errors(start, 1, "1 byte past the end");
+
+	start = shadow_get_error_count();
+	my_func_read8(buf + 8, ls);
+	check_errors(start, 1, "8 bytes across the end");
+
+	start = shadow_get_error_count();
+	my_func_read1(buf - 1, ls);
+	check_errors(start, 1, "1 byte before the start");
+
+	start = shadow_get_error_count();
+	my_func_memset_pre(buf, 0, 14, ls);
+	check_errors(start, 1, "memset() 1 byte past the end");
+
+	my_func_kfree_pre(buf, ls);
+	kfree(buf);
+
+	/* The memory that is not tracked is not checked. */
+	start = shadow_get_error_count();
+	my_func_read1(buf_stack, ls);
+	check_errors(start, 0, "stack");
+}
+
+/* Reads of the uninitialized memory, reported once per granule. */
+static void
+test_uninit(struct my_struct *ls)
+{
+	struct my_struct1 *s;
+	unsigned long start;
+
+	s = my_func___kmalloc_repl(sizeof(*s), 0x8afe, ls);
+	if (s == NULL) {
+		printf("FAIL: __kmalloc() failed\n");
+		++failed;
+		return;
+	}
+
+	start = shadow_get_error_count();
+	my_func_write8(&s->a, ls);
+	s->a = 1;
+	my_func_read8(&s->a, ls);
+	check_errors(start, 0, "written field");
+
+	start = shadow_get_error_count();
+	my_func_read8(&s->b, ls);
+	my_func_read8(&s->b, ls);
+	check_errors(start, 1, "uninitialized field, read twice");
+
+	start = shadow_get_error_count();
+	my_func_read16(&s->c, ls);
+	check_errors(start, 1, "uninitialized fields, 16-byte read");
+
+	my_func_kfree_pre(s, ls);
+	kfree(s);
+
+	s = my_func___kmalloc_repl(sizeof(*s), 0x8afe | MY_GFP_ZERO, ls);
+	if (s == NULL) {
+		printf("FAIL: __kmalloc() failed\n");
+		++failed;
+		return;
+	}
+
+	start = shadow_get_error_count();
+	my_func_read8(&s->c, ls);
+	my_func_read16(&s->b, ls);
+	check_errors(start, 0, "zeroed block");
+	if (s->c != 0) {
+		printf("FAIL: the block is not zeroed\n");
+		++failed;
+	}
+
+	my_func_kfree_pre(s, ls);
+	kfree(s);
+}
+
+int
+main(void)
+{
+	struct my_struct *ls = my_func_dummy_entry((void *)main, 0, NULL);
+
+	test_bounds(ls);
+	test_uninit(ls);
+	my_func_dummy_exit(ls);
+
+	printf("Total: %lu error(s) reported.\n", shadow_get_error_count());
+	if (failed) {
+		printf("%d check(s) failed.\n", failed);
+		return 1;
+	}
+	printf("All checks passed.\n");
+	return 0;
+}
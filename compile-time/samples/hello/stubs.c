@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "stubs.h"
+
 void *
 vmalloc(unsigned long size)
 {
@@ -41,6 +43,8 @@ void *
 __kmalloc(size_t size, unsigned int flags)
 {
 	printf("[STUB] __kmalloc(%lu, %x)\n", (unsigned long)size, flags);
+	if (flags & MY_GFP_ZERO)
+		return calloc(1, size);
 	return malloc(size);
 }
 
@@ -0,0 +1,34 @@
+/* Declarations of the stubs imitating the external functions (stubs.c).
+ *
+ * gcc -c -o stubs.o stubs.c */
+
+#ifndef STUBS_H_1108_INCLUDED
+#define STUBS_H_1108_INCLUDED
+
+#include <stddef.h>
+#include <sys/types.h>
+/* ====================================================================== */
+
+/* kzalloc() in hello.c adds this flag when it calls __kmalloc(), the stub
+ * then returns zeroed memory and the handler marks it initialized. */
+#define MY_GFP_ZERO 0x4000
+
+void *
+vmalloc(unsigned long size);
+
+void 
+vfree(void *addr);
+
+int 
+alloc_chrdev_region(dev_t *dev, unsigned baseminor, unsigned count,
+		    const char *name);
+void 
+unregister_chrdev_region(dev_t from, unsigned count);
+
+void *
+__kmalloc(size_t size, unsigned int flags);
+
+void 
+kfree(void *addr);
+/* ====================================================================== */
+#endif /*STUBS_H_1108_INCLUDED*/
@@ -1,4 +1,4 @@
-/* klc_output.h
+/* klc_output.c
  * Helpers for data output.
  * This provides additional abstraction that allows to output data from 
  * the payload module without directly using printk, trace-related stuff
@@ -19,14 +19,17 @@
  ======================================================================== */
 
 #include <linux/kernel.h>
+#include <linux/version.h>
 #include <linux/string.h>
 #include <linux/errno.h>
 #include <linux/slab.h>
+#include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/debugfs.h>
-#include <asm/uaccess.h>
+#include <linux/seq_file.h>
 
 #include "klc_output.h"
+#include "klc_report_format.h"
 
 /* ================================================================ */
 /* A directory for output files in debugfs. */
@@ -35,250 +38,475 @@ struct dentry *dir_klc = NULL;
 /* The files in debugfs where the output will go. */
 struct dentry *file_leaks = NULL;
 struct dentry *file_bad_frees = NULL;
+struct dentry *file_leaks_bin = NULL;
+struct dentry *file_bad_frees_bin = NULL;
 struct dentry *file_stats = NULL;
 
 /* ================================================================ */
-/* Output buffer that accumulates strings sent to it by klc_print_string().
- * The buffer grows automatically when necessary.
- * The operations with each such buffer (klc_output_buffer_*(), etc.) 
- * should be performed with the corresponding mutex locked (see 'lock' 
- * field in the structure). 
- *
- * The caller must also ensure that no other operations with a buffer can
- * occur during the creation and descruction of the buffer.
+/* The records the reports are made of. 
+ * All the data below are protected by 'report_mutex'.
+ */
+DEFINE_MUTEX(report_mutex);
+
+/* The groups of possible leaks (struct klc_stack, linked via 'group_list'
+ * field) and the spurious deallocation events (struct klc_memblock_info,
+ * linked via 'list' field).
  */
-struct klc_output_buffer
+static LIST_HEAD(report_leaks);
+static LIST_HEAD(report_bad_frees);
+
+/* The data for "info" file */
+static struct klc_report_info
 {
-    /* the buffer itself */
-    char *buf; 
+    int has_target;
+    char name[MODULE_NAME_LEN];
+    void *module_init;
+    void *module_core;
     
-    /* the size of the buffer */
-    size_t size; 
-    
-    /* length of the data stored (excluding the terminating '\0')*/
-    size_t data_len; 
-    
-    /* the mutex to guard access to the buffer */
-    struct mutex *lock; 
-};
-
-/* Default size of the buffer. */
-#define KLC_OUTPUT_BUFFER_SIZE 1000
+    int has_totals;
+    u64 total_allocs;
+    u64 total_leaks;
+    u64 total_bad_frees;
+} report_info;
 
-/* The mutexes to guard access to the buffers. */
-DEFINE_MUTEX(ob_leaks_mutex);
-DEFINE_MUTEX(ob_bad_frees_mutex);
-DEFINE_MUTEX(ob_other_mutex);
+/* Incremented each time the records are cleared, so that the iterators 
+ * know their positions are no longer valid. */
+static unsigned long report_generation = 0;
 
-/* Output buffers for each type of output resource. */
-struct klc_output_buffer ob_leaks = {
-    .buf = NULL,
-    .size = 0,
-    .data_len = 0,
-    .lock = &ob_leaks_mutex
+/* ================================================================ */
+/* Iterators over the reports.
+ * 
+ * Position 0 is the beginning of the report (SEQ_START_TOKEN), positions
+ * 1, 2, ... - the elements of the report. In the report about possible 
+ * leaks, the elements are the headers of the groups (mbi == NULL) and
+ * the leaks in each group. In the report about unallocated frees, each 
+ * element is a deallocation event.
+ *
+ * The iterator remembers its current position, so reading the report 
+ * sequentially takes linear time even though seq_file calls start() 
+ * with the next position for each read() request. The previous position
+ * is remembered too, because seq_file calls start() with it again if 
+ * the last element did not fit into the buffer.
+ */
+struct klc_report_cursor
+{
+    loff_t pos;
+    struct klc_stack *group;
+    struct klc_memblock_info *mbi;
 };
 
-struct klc_output_buffer ob_bad_frees = {
-    .buf = NULL,
-    .size = 0,
-    .data_len = 0,
-    .lock = &ob_bad_frees_mutex
+struct klc_report_iter
+{
+    unsigned long generation;
+    struct klc_report_cursor cur;
+    struct klc_report_cursor prev;
 };
 
-struct klc_output_buffer ob_other = {
-    .buf = NULL,
-    .size = 0,
-    .data_len = 0,
-    .lock = &ob_other_mutex
-};
+static void
+klc_iter_rewind(struct klc_report_iter *iter)
+{
+    iter->generation = report_generation;
+    memset(&iter->cur, 0, sizeof(iter->cur));
+    iter->prev = iter->cur;
+    return;
+}
 
-/* ================================================================ */
-/* Initializes the buffer: allocates memory, etc.
- * Returns 0 on success, a negative error code on failure.
- */
+/* Moves the cursor to the next element of the report about possible 
+ * leaks. Returns 0 if there are no more elements, nonzero otherwise. */
 static int
-klc_output_buffer_init(struct klc_output_buffer *ob)
+klc_leaks_cursor_next(struct klc_report_cursor *cur)
 {
-    BUG_ON(ob == NULL);
+    struct list_head *next;
+    
+    if (cur->group == NULL) {
+        if (list_empty(&report_leaks))
+            return 0;
+        cur->group = list_entry(report_leaks.next, struct klc_stack, 
+            group_list);
+        cur->mbi = NULL;
+        ++cur->pos;
+        return 1;
+    }
+    
+    next = (cur->mbi == NULL) ? 
+        cur->group->leaks.next : 
+        cur->mbi->list.next;
+    if (next != &cur->group->leaks) {
+        cur->mbi = list_entry(next, struct klc_memblock_info, list);
+    } else if (cur->group->group_list.next != &report_leaks) {
+        cur->group = list_entry(cur->group->group_list.next, 
+            struct klc_stack, group_list);
+        cur->mbi = NULL;
+    } else {
+        return 0;
+    }
+    ++cur->pos;
+    return 1;
+}
 
-    ob->buf = (char *)kmalloc(KLC_OUTPUT_BUFFER_SIZE, GFP_KERNEL);
-    if (ob->buf == NULL)
-        return -ENOMEM;
+/* Same as klc_leaks_cursor_next() but for the report about unallocated
+ * frees. */
+static int
+klc_bad_frees_cursor_next(struct klc_report_cursor *cur)
+{
+    struct list_head *next;
     
-    ob->buf[0] = 0;
-    ob->size = KLC_OUTPUT_BUFFER_SIZE;
-    ob->data_len = 0;
+    next = (cur->mbi == NULL) ? 
+        report_bad_frees.next : 
+        cur->mbi->list.next;
+    if (next == &report_bad_frees)
+        return 0;
     
-    return 0;
+    cur->mbi = list_entry(next, struct klc_memblock_info, list);
+    ++cur->pos;
+    return 1;
+}
+
+/* Common parts of the seq_file operations. 'cursor_next' is one of 
+ * klc_*_cursor_next() functions above. 
+ * 
+ * 'report_mutex' is locked in start() and unlocked in stop(). seq_file
+ * calls stop() even if start() returns NULL. */
+static void *
+klc_report_start(struct seq_file *m, loff_t *pos, 
+    int (*cursor_next)(struct klc_report_cursor *))
+{
+    struct klc_report_iter *iter = (struct klc_report_iter *)m->private;
+    
+    mutex_lock(&report_mutex);
+    
+    if (iter->generation != report_generation || *pos < iter->prev.pos)
+        klc_iter_rewind(iter);
+    else if (*pos < iter->cur.pos)
+        iter->cur = iter->prev;
+    
+    while (iter->cur.pos < *pos) {
+        iter->prev = iter->cur;
+        if (!cursor_next(&iter->cur))
+            return NULL;
+    }
+    return (iter->cur.pos == 0) ? SEQ_START_TOKEN : iter;
+}
+
+static void *
+klc_report_next(struct seq_file *m, void *v, loff_t *pos,
+    int (*cursor_next)(struct klc_report_cursor *))
+{
+    struct klc_report_iter *iter = (struct klc_report_iter *)m->private;
+    
+    iter->prev = iter->cur;
+    if (!cursor_next(&iter->cur)) {
+        ++*pos;
+        return NULL;
+    }
+    *pos = iter->cur.pos;
+    return iter;
 }
 
-/* Destroys the buffer: releases the memory pointed to by 'ob->buf', etc.
- */
 static void
-klc_output_buffer_destroy(struct klc_output_buffer *ob)
+klc_report_stop(struct seq_file *m, void *v)
+{
+    mutex_unlock(&report_mutex);
+    return;
+}
+
+static void *
+klc_leaks_start(struct seq_file *m, loff_t *pos)
+{
+    return klc_report_start(m, pos, klc_leaks_cursor_next);
+}
+
+static void *
+klc_leaks_next(struct seq_file *m, void *v, loff_t *pos)
 {
-    BUG_ON(ob == NULL);
+    return klc_report_next(m, v, pos, klc_leaks_cursor_next);
+}
+
+static void *
+klc_bad_frees_start(struct seq_file *m, loff_t *pos)
+{
+    return klc_report_start(m, pos, klc_bad_frees_cursor_next);
+}
+
+static void *
+klc_bad_frees_next(struct seq_file *m, void *v, loff_t *pos)
+{
+    return klc_report_next(m, v, pos, klc_bad_frees_cursor_next);
+}
+/* ================================================================ */
+
+/* Text reports */
+static const char *klc_separator = "----------------------------------------";
+
+/* Outputs the stack trace resolved by klc_resolve_stack(). If there was 
+ * not enough memory to resolve it, only the raw addresses are output. */
+static void
+klc_show_stack(struct seq_file *m, const struct klc_stack *stack)
+{
+    unsigned int i;
     
-    ob->data_len = 0;
-    ob->size = 0;
-    kfree(ob->buf);
+    if (stack == NULL || stack->num_entries == 0) {
+        seq_puts(m, "(stack trace is not available)\n");
+        return;
+    }
+    
+    if (stack->symbols != NULL) {
+        seq_puts(m, stack->symbols);
+        return;
+    }
+    
+    for (i = 0; i < stack->num_entries; ++i)
+        seq_printf(m, "[<%p>]\n", (void *)stack->entries[i]);
     return;
 }
 
-/* Enlarges the buffer to make it at least 'new_size' bytes in size.
- * If 'new_size' is less than or equal to 'ob->size', the function does 
- * nothing.
- * If there is not enough memory, the function outputs an error to 
- * the system log, leaves the buffer intact and returns -ENOMEM.
- * 0 is returned in case of success.
- */
 static int
-klc_output_buffer_resize(struct klc_output_buffer *ob, size_t new_size)
+klc_leaks_show(struct seq_file *m, void *v)
 {
-    size_t size;
-    void *p;
-    BUG_ON(ob == NULL);
+    struct klc_report_iter *iter = (struct klc_report_iter *)v;
+    struct klc_memblock_info *mbi;
     
-    if (ob->size >= new_size)
+    if (v == SEQ_START_TOKEN)
         return 0;
     
-    size = ob->size;
-    do {
-         size *= 2;
-    } while (size < new_size);
-    
-    p = krealloc(ob->buf, size, GFP_KERNEL);
-    if (p == NULL) {
-    /* [NB] If krealloc fails to allocate memory, it should leave the buffer
-     * intact, so its previous contents could still be used.
-     */
-        printk(KERN_ERR "[kedr_leak_check] klc_output_buffer_resize: "
-            "not enough memory to resize the output buffer to %zu bytes\n",
-            size);
-        return -ENOMEM;
+    mbi = iter->cur.mbi;
+    if (mbi == NULL) {
+        seq_printf(m, "Possible leaks: %lu, total size: %llu; "
+            "stack trace of the allocations:\n",
+            iter->cur.group->num_leaks,
+            (unsigned long long)iter->cur.group->leaked_bytes);
+        klc_show_stack(m, iter->cur.group);
+        return 0;
     }
     
-    ob->buf = p;
-    ob->size = size;
+    seq_printf(m, "Block at 0x%p, size: %zu\n", mbi->block, mbi->size);
+    if (mbi->list.next == &iter->cur.group->leaks)
+        seq_printf(m, "%s\n", klc_separator);
+    return 0;
+}
+
+static int
+klc_bad_frees_show(struct seq_file *m, void *v)
+{
+    struct klc_report_iter *iter = (struct klc_report_iter *)v;
+    
+    if (v == SEQ_START_TOKEN)
+        return 0;
     
+    seq_printf(m, "Block at 0x%p; stack trace of the deallocation:\n",
+        iter->cur.mbi->block);
+    klc_show_stack(m, iter->cur.mbi->stack);
+    seq_printf(m, "%s\n", klc_separator);
     return 0;
 }
 
-/* Appends the specified string to the buffer, enlarging the latter if 
- * necessary with klc_output_buffer_resize().
- */
+/* Binary reports, see klc_report_format.h */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 35)
+/* seq_write() is not available in these kernels. */
+static int
+seq_write(struct seq_file *m, const void *data, size_t len)
+{
+    if (m->count + len < m->size) {
+        memcpy(m->buf + m->count, data, len);
+        m->count += len;
+        return 0;
+    }
+    m->count = m->size; /* overflow, seq_file will retry with more space */
+    return -1;
+}
+#endif
+
 static void
-klc_output_buffer_append(struct klc_output_buffer *ob, const char *s)
+klc_write_header(struct klc_record_header *header, enum klc_record_type type,
+    size_t size)
 {
-    size_t len;
-    int ret;
-    
-    BUG_ON(ob == NULL);
-    BUG_ON(ob->buf[ob->data_len] != 0);
-    BUG_ON(s == NULL);
+    header->type = (__u32)type;
+    header->size = (__u32)size;
+    return;
+}
+
+static void
+klc_write_stack_entries(struct seq_file *m, const struct klc_stack *stack)
+{
+    unsigned int i;
     
-    len = strlen(s);
-    if (len == 0)   /* nothing to do */
+    if (stack == NULL)
         return;
     
-    /* make sure the buffer is large enough */
-    ret = klc_output_buffer_resize(ob, ob->data_len + len + 1);
-    if (ret != 0)
-        return; /* the error has already been reported */
+    for (i = 0; i < stack->num_entries; ++i) {
+        __u64 entry = (__u64)stack->entries[i];
+        seq_write(m, &entry, sizeof(entry));
+    }
+    return;
+}
+
+static unsigned int
+klc_stack_num_entries(const struct klc_stack *stack)
+{
+    return (stack != NULL) ? stack->num_entries : 0;
+}
+
+static void
+klc_write_file_record(struct seq_file *m)
+{
+    struct klc_record_file rec;
     
-    strncpy(&(ob->buf[ob->data_len]), s, len + 1);
-    ob->data_len += len;
+    klc_write_header(&rec.header, KLC_RECORD_FILE, sizeof(rec));
+    rec.magic = KLC_REPORT_MAGIC;
+    rec.version = KLC_REPORT_VERSION;
+    seq_write(m, &rec, sizeof(rec));
     return;
 }
+
+static int
+klc_leaks_show_bin(struct seq_file *m, void *v)
+{
+    struct klc_report_iter *iter = (struct klc_report_iter *)v;
+    
+    if (v == SEQ_START_TOKEN) {
+        klc_write_file_record(m);
+        return 0;
+    }
+    
+    if (iter->cur.mbi == NULL) {
+        struct klc_record_leak_group rec;
+        unsigned int num_entries = klc_stack_num_entries(iter->cur.group);
+        
+        klc_write_header(&rec.header, KLC_RECORD_LEAK_GROUP, 
+            sizeof(rec) + num_entries * sizeof(__u64));
+        rec.num_leaks = (__u64)iter->cur.group->num_leaks;
+        rec.total_size = (__u64)iter->cur.group->leaked_bytes;
+        rec.num_entries = num_entries;
+        rec.reserved = 0;
+        seq_write(m, &rec, sizeof(rec));
+        klc_write_stack_entries(m, iter->cur.group);
+    } else {
+        struct klc_record_leak rec;
+        
+        klc_write_header(&rec.header, KLC_RECORD_LEAK, sizeof(rec));
+        rec.block = (__u64)(unsigned long)iter->cur.mbi->block;
+        rec.size = (__u64)iter->cur.mbi->size;
+        seq_write(m, &rec, sizeof(rec));
+    }
+    return 0;
+}
+
+static int
+klc_bad_frees_show_bin(struct seq_file *m, void *v)
+{
+    struct klc_report_iter *iter = (struct klc_report_iter *)v;
+    struct klc_record_bad_free rec;
+    unsigned int num_entries;
+    
+    if (v == SEQ_START_TOKEN) {
+        klc_write_file_record(m);
+        return 0;
+    }
+    
+    num_entries = klc_stack_num_entries(iter->cur.mbi->stack);
+    klc_write_header(&rec.header, KLC_RECORD_BAD_FREE, 
+        sizeof(rec) + num_entries * sizeof(__u64));
+    rec.block = (__u64)(unsigned long)iter->cur.mbi->block;
+    rec.num_entries = num_entries;
+    rec.reserved = 0;
+    seq_write(m, &rec, sizeof(rec));
+    klc_write_stack_entries(m, iter->cur.mbi->stack);
+    return 0;
+}
+
+/* "info" file is small, it is output at once. */
+static int
+klc_info_show(struct seq_file *m, void *v)
+{
+    mutex_lock(&report_mutex);
+    if (report_info.has_target) {
+        seq_printf(m, "Target module: \"%s\", "
+            "init area at 0x%p, core area at 0x%p\n",
+            report_info.name, 
+            report_info.module_init, report_info.module_core);
+    }
+    if (report_info.has_totals) {
+        seq_printf(m, "Memory allocations: %llu\n", 
+            (unsigned long long)report_info.total_allocs);
+        seq_printf(m, "Possible leaks: %llu\n", 
+            (unsigned long long)report_info.total_leaks);
+        seq_printf(m, "Unallocated frees: %llu\n", 
+            (unsigned long long)report_info.total_bad_frees);
+    }
+    mutex_unlock(&report_mutex);
+    return 0;
+}
 /* ================================================================ */
 
+static const struct seq_operations seq_ops_leaks = {
+    .start  = klc_leaks_start,
+    .next   = klc_leaks_next,
+    .stop   = klc_report_stop,
+    .show   = klc_leaks_show
+};
+
+static const struct seq_operations seq_ops_leaks_bin = {
+    .start  = klc_leaks_start,
+    .next   = klc_leaks_next,
+    .stop   = klc_report_stop,
+    .show   = klc_leaks_show_bin
+};
+
+static const struct seq_operations seq_ops_bad_frees = {
+    .start  = klc_bad_frees_start,
+    .next   = klc_bad_frees_next,
+    .stop   = klc_report_stop,
+    .show   = klc_bad_frees_show
+};
+
+static const struct seq_operations seq_ops_bad_frees_bin = {
+    .start  = klc_bad_frees_start,
+    .next   = klc_bad_frees_next,
+    .stop   = klc_report_stop,
+    .show   = klc_bad_frees_show_bin
+};
+
 /* A convenience macro to define variable of type struct file_operations
- * for a read only file in debugfs associated with the specified output
- * buffer.
+ * for a read only file in debugfs that outputs the report using the 
+ * specified seq_operations.
  * 
  * __fops - the name of the variable
- * __ob - pointer to the output buffer (struct klc_output_buffer *)
+ * __seq_ops - pointer to the seq_operations (struct seq_operations *)
  */
-#define KLC_DEFINE_FOPS_RO(__fops, __ob)                                \
+#define KLC_DEFINE_FOPS_RO(__fops, __seq_ops)                           \
 static int __fops ## _open(struct inode *inode, struct file *filp)      \
 {                                                                       \
-    BUILD_BUG_ON(sizeof(*(__ob)) != sizeof(struct klc_output_buffer));  \
-    filp->private_data = (void *)(__ob);                                \
-    return nonseekable_open(inode, filp);                               \
+    return seq_open_private(filp, (__seq_ops),                          \
+        sizeof(struct klc_report_iter));                                \
 }                                                                       \
 static const struct file_operations __fops = {                          \
     .owner      = THIS_MODULE,                                          \
     .open       = __fops ## _open,                                      \
-    .release    = klc_release_common,                                   \
-    .read       = klc_read_common,                                      \
+    .release    = seq_release_private,                                  \
+    .read       = seq_read,                                             \
+    .llseek     = seq_lseek,                                            \
 };
 
-/* Helpers for file operations common to all read-only files in this 
- * example. */
-static int 
-klc_release_common(struct inode *inode, struct file *filp)
-{
-    filp->private_data = NULL;
-    /* nothing more to do: open() did not allocate any resources */
-    return 0;
-}
+/* Definitions of file_operations structures for the files in debugfs.
+ */
+KLC_DEFINE_FOPS_RO(fops_leaks_ro, &seq_ops_leaks);
+KLC_DEFINE_FOPS_RO(fops_leaks_bin_ro, &seq_ops_leaks_bin);
+KLC_DEFINE_FOPS_RO(fops_bad_frees_ro, &seq_ops_bad_frees);
+KLC_DEFINE_FOPS_RO(fops_bad_frees_bin_ro, &seq_ops_bad_frees_bin);
 
-static ssize_t 
-klc_read_common(struct file *filp, char __user *buf, size_t count,
-    loff_t *f_pos)
+static int
+klc_info_open(struct inode *inode, struct file *filp)
 {
-    ssize_t ret = 0;
-    size_t data_len;
-    loff_t pos = *f_pos;
-    struct klc_output_buffer *ob = 
-        (struct klc_output_buffer *)filp->private_data;
-        
-    if (ob == NULL) 
-        return -EINVAL;
-    
-    if (mutex_lock_killable(ob->lock) != 0)
-	{
-        printk(KERN_WARNING "[kedr_leak_check] klc_read_common: "
-            "got a signal while trying to acquire a mutex.\n");
-		return -EINTR;
-	}
-    
-    data_len = ob->data_len;
-    
-    /* Reading outside of the data buffer is not allowed */
-    if ((pos < 0) || (pos > data_len)) {
-        ret = -EINVAL;
-        goto out;
-    }
-    
-    /* EOF reached or 0 bytes requested */
-    if ((count == 0) || (pos == data_len)) {
-        ret = 0; 
-        goto out;
-    }
-    
-    if (pos + count > data_len) 
-        count = data_len - pos;
-    if (copy_to_user(buf, &(ob->buf[pos]), count) != 0) {
-        ret = -EFAULT;
-        goto out;
-    }
-
-    mutex_unlock(ob->lock);
-    
-    *f_pos += count;
-    return count;
-    
-out:
-    mutex_unlock(ob->lock);
-    return ret;
+    return single_open(filp, klc_info_show, NULL);
 }
 
-/* Definitions of file_operations structures for the files in debugfs.
- */
-KLC_DEFINE_FOPS_RO(fops_leaks_ro, &ob_leaks);
-KLC_DEFINE_FOPS_RO(fops_bad_frees_ro, &ob_bad_frees);
-KLC_DEFINE_FOPS_RO(fops_stats_ro, &ob_other);
+static const struct file_operations fops_stats_ro = {
+    .owner      = THIS_MODULE,
+    .open       = klc_info_open,
+    .release    = single_release,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+};
 /* ================================================================ */
 
 static void
@@ -286,6 +514,8 @@ klc_remove_debugfs_files(void)
 {
     if (file_leaks      != NULL) debugfs_remove(file_leaks);
     if (file_bad_frees  != NULL) debugfs_remove(file_bad_frees);
+    if (file_leaks_bin  != NULL) debugfs_remove(file_leaks_bin);
+    if (file_bad_frees_bin != NULL) debugfs_remove(file_bad_frees_bin);
     if (file_stats      != NULL) debugfs_remove(file_stats);
     return;
 }
@@ -306,6 +536,16 @@ klc_create_debugfs_files(void)
     if (file_bad_frees == NULL) 
         goto fail;
     
+    file_leaks_bin = debugfs_create_file("possible_leaks_bin", S_IRUGO,
+        dir_klc, NULL, &fops_leaks_bin_ro);
+    if (file_leaks_bin == NULL) 
+        goto fail;
+    
+    file_bad_frees_bin = debugfs_create_file("unallocated_frees_bin", 
+        S_IRUGO, dir_klc, NULL, &fops_bad_frees_bin_ro);
+    if (file_bad_frees_bin == NULL) 
+        goto fail;
+    
     file_stats = debugfs_create_file("info", S_IRUGO,
         dir_klc, NULL, &fops_stats_ro);
     if (file_stats == NULL) 
@@ -322,49 +562,13 @@ fail:
 }
 
 /* ================================================================ */
-void
-klc_print_string(enum klc_output_type output_type, const char *s)
-{
-    struct klc_output_buffer *ob = NULL;
-    
-    BUG_ON(s == NULL);
-
-    switch (output_type) {
-    case KLC_UNFREED_ALLOC:
-        ob = &ob_leaks;
-        break;
-    case KLC_UNALLOCATED_FREE: 
-        ob = &ob_bad_frees;
-        break;
-    case KLC_OTHER:
-        ob = &ob_other;
-        break;
-    default:
-        printk(KERN_WARNING "[kedr_leak_check] unknown output type: %d\n", 
-            (int)output_type);
-        return;
-    }
-    BUG_ON(ob->buf == NULL); 
-    
-    if (mutex_lock_killable(ob->lock) != 0)
-	{
-        printk(KERN_WARNING "[kedr_leak_check] klc_print_string: "
-            "got a signal while trying to acquire a mutex.\n");
-		return;
-	}
-    
-    klc_output_buffer_append(ob, s);
-    klc_output_buffer_append(ob, "\n");
-
-    mutex_unlock(ob->lock);
-    return;
-}
-
-void
-klc_print_stack_trace(enum klc_output_type output_type, 
-    unsigned long *stack_entries, unsigned int num_entries)
+/* Resolves the stack trace to text (see 'symbols' field of struct 
+ * klc_stack). If there is not enough memory, the stack trace is left
+ * unresolved. */
+static void
+klc_resolve_stack(struct klc_stack *stack)
 {
-    static const char* fmt = "[<%p>] %pS";
+    static const char* fmt = "[<%p>] %pS\n";
     
     /* This is just to pass a buffer of known size to the first call
      * to snprintf() to determine the length of the string to which
@@ -372,159 +576,91 @@ klc_print_stack_trace(enum klc_output_type output_type,
      */
     char one_char[1];
     char *buf = NULL;
-    int len;
+    size_t len = 0;
+    size_t pos = 0;
     unsigned int i;
     
-    BUG_ON(stack_entries == NULL);
-    
-    if (num_entries == 0)
+    if (stack == NULL || stack->num_entries == 0 || stack->symbols != NULL)
         return;
     
-    for (i = 0; i < num_entries; ++i) {
-        len = snprintf(&one_char[0], 1, fmt, 
-            (void *)stack_entries[i], (void *)stack_entries[i]);
-        buf = (char*)kmalloc(len + 1, GFP_KERNEL);
-        if (buf != NULL) {
-            snprintf(buf, len + 1, fmt, 
-                (void *)stack_entries[i], (void *)stack_entries[i]);
-            klc_print_string(output_type, buf);
-            kfree(buf);
-        } else { 
-            printk(KERN_ERR "[kedr_leak_check] klc_print_stack_trace: "
-                "not enough memory to prepare a message of size %d\n",
-                len);
-        }
+    for (i = 0; i < stack->num_entries; ++i) {
+        len += snprintf(&one_char[0], 1, fmt, 
+            (void *)stack->entries[i], (void *)stack->entries[i]);
     }
-    return;    
-}
-
-void
-klc_print_target_module_info(struct module *target_module)
-{
-    static const char* fmt = 
-"Target module: \"%s\", init area at 0x%p, core area at 0x%p";
     
-    char one_char[1];
-    char *buf = NULL;
-    int len;
-    const char *name;
-    
-    BUG_ON(target_module == NULL);
-    name = module_name(target_module);
-    
-    len = snprintf(&one_char[0], 1, fmt, name, 
-        target_module->module_init, target_module->module_core);
     buf = (char*)kmalloc(len + 1, GFP_KERNEL);
     if (buf == NULL) {
-        printk(KERN_ERR "[kedr_leak_check] klc_print_target_module_info: "
-            "not enough memory to prepare a message of size %d\n",
+        printk(KERN_ERR "[kedr_leak_check] klc_resolve_stack: "
+            "not enough memory to prepare a message of size %zu\n",
             len);
+        return;
+    }
+    
+    for (i = 0; i < stack->num_entries; ++i) {
+        pos += snprintf(&buf[pos], len + 1 - pos, fmt, 
+            (void *)stack->entries[i], (void *)stack->entries[i]);
     }
-    snprintf(buf, len + 1, fmt, name, 
-        target_module->module_init, target_module->module_core);
-    klc_print_string(KLC_OTHER, buf);
-    kfree(buf);
+    stack->symbols = buf;
     return;
 }
 
-void 
-klc_print_alloc_info(struct klc_memblock_info *alloc_info)
+void
+klc_print_target_module_info(struct module *target_module)
 {
-    static const char* fmt = 
-        "Block at 0x%p, size: %zu; stack trace of the allocation:";
-    
-    char one_char[1];
-    char *buf = NULL;
-    int len;
-    
-    BUG_ON(alloc_info == NULL);
-    
-    len = snprintf(&one_char[0], 1, fmt, alloc_info->block, 
-        alloc_info->size);
-    buf = (char*)kmalloc(len + 1, GFP_KERNEL);
-    if (buf == NULL) {
-        printk(KERN_ERR "[kedr_leak_check] klc_print_alloc_info: "
-            "not enough memory to prepare a message of size %d\n",
-            len);
-    }
-    snprintf(buf, len + 1, fmt, alloc_info->block, alloc_info->size);
-    klc_print_string(KLC_UNFREED_ALLOC, buf);
-    kfree(buf);
-    
-    klc_print_stack_trace(KLC_UNFREED_ALLOC, 
-        &(alloc_info->stack_entries[0]), alloc_info->num_entries);
+    BUG_ON(target_module == NULL);
     
-    klc_print_string(KLC_UNFREED_ALLOC, 
-        "----------------------------------------"); /* separator */
+    mutex_lock(&report_mutex);
+    strlcpy(&report_info.name[0], module_name(target_module), 
+        sizeof(report_info.name));
+    report_info.module_init = target_module->module_init;
+    report_info.module_core = target_module->module_core;
+    report_info.has_target = 1;
+    mutex_unlock(&report_mutex);
     return;
 }
 
-void 
-klc_print_dealloc_info(struct klc_memblock_info *dealloc_info)
+void
+klc_print_leak_groups(struct list_head *groups)
 {
-    static const char* fmt = 
-        "Block at 0x%p; stack trace of the deallocation:";
+    struct klc_stack *stack = NULL;
     
-    char one_char[1];
-    char *buf = NULL;
-    int len;
- 
-    BUG_ON(dealloc_info == NULL);
-    
-    len = snprintf(&one_char[0], 1, fmt, dealloc_info->block);
-    buf = (char*)kmalloc(len + 1, GFP_KERNEL);
-    if (buf == NULL) {
-        printk(KERN_ERR "[kedr_leak_check] klc_print_dealloc_info: "
-            "not enough memory to prepare a message of size %d\n",
-            len);
-    }
-    snprintf(buf, len + 1, fmt, dealloc_info->block);
-    klc_print_string(KLC_UNALLOCATED_FREE, buf);
-    kfree(buf);
+    BUG_ON(groups == NULL);
     
-    klc_print_stack_trace(KLC_UNALLOCATED_FREE, 
-        &(dealloc_info->stack_entries[0]), dealloc_info->num_entries);
+    /* The groups are not in the report yet, so no lock is needed here */
+    list_for_each_entry(stack, groups, group_list)
+        klc_resolve_stack(stack);
     
-    klc_print_string(KLC_UNALLOCATED_FREE, 
-        "----------------------------------------"); /* separator */
+    mutex_lock(&report_mutex);
+    list_splice_tail_init(groups, &report_leaks);
+    mutex_unlock(&report_mutex);
     return;
 }
 
-/* A helper function to print an unsigned 64-bit value using the specified
- * format. The format must contain "%llu", "%llx" or the like.
- */
-static void 
-klc_print_u64(enum klc_output_type output_type, u64 data, const char *fmt)
+void
+klc_print_bad_frees(struct list_head *bad_frees)
 {
-    char one_char[1];
-    char *buf = NULL;
-    int len;
+    struct klc_memblock_info *mbi = NULL;
     
-    BUG_ON(fmt == NULL);
+    BUG_ON(bad_frees == NULL);
     
-    len = snprintf(&one_char[0], 1, fmt, data);
-    buf = (char*)kmalloc(len + 1, GFP_KERNEL);
-    if (buf == NULL) {
-        printk(KERN_ERR "[kedr_leak_check] klc_print_u64: "
-            "not enough memory to prepare a message of size %d\n",
-            len);
-    }
-    snprintf(buf, len + 1, fmt, data);
-    klc_print_string(output_type, buf);
-    kfree(buf);
+    list_for_each_entry(mbi, bad_frees, list)
+        klc_resolve_stack((struct klc_stack *)mbi->stack);
     
-    return;    
+    mutex_lock(&report_mutex);
+    list_splice_tail_init(bad_frees, &report_bad_frees);
+    mutex_unlock(&report_mutex);
+    return;
 }
 
 void
 klc_print_totals(u64 total_allocs, u64 total_leaks, u64 total_bad_frees)
 {
-    klc_print_u64(KLC_OTHER, total_allocs, 
-        "Memory allocations: %llu");
-    klc_print_u64(KLC_OTHER, total_leaks,
-        "Possible leaks: %llu");
-    klc_print_u64(KLC_OTHER, total_bad_frees,
-        "Unallocated frees: %llu");
+    mutex_lock(&report_mutex);
+    report_info.total_allocs = total_allocs;
+    report_info.total_leaks = total_leaks;
+    report_info.total_bad_frees = total_bad_frees;
+    report_info.has_totals = 1;
+    mutex_unlock(&report_mutex);
     return;
 }
 /* ================================================================ */
@@ -534,33 +670,18 @@ klc_output_init(void)
 {
     int ret = 0;
     
-    /* Create output buffers */
-    ret = klc_output_buffer_init(&ob_leaks);
-    if (ret != 0)
-        goto fail_ob;
-    
-    ret = klc_output_buffer_init(&ob_bad_frees);
-    if (ret != 0)
-        goto fail_ob;
-    
-    ret = klc_output_buffer_init(&ob_other);
-    if (ret != 0)
-        goto fail_ob;
-    
     /* Create a directory in debugfs */
     dir_klc = debugfs_create_dir("kedr_leak_check", NULL);
     if (IS_ERR(dir_klc)) {
         printk(KERN_ERR "[kedr_leak_check] debugfs is not supported\n");
         dir_klc = NULL;
-        ret = -ENODEV;
-        goto fail_ob;
+        return -ENODEV;
     }
     
     if (dir_klc == NULL) {
         printk(KERN_ERR "[kedr_leak_check] "
             "failed to create a directory in debugfs\n");
-        ret = -EINVAL;
-        goto fail_ob;
+        return -EINVAL;
     }
     
     /* Create output files */
@@ -571,31 +692,41 @@ klc_output_init(void)
     return 0;
 
 fail_files:
-    klc_remove_debugfs_files();
     debugfs_remove(dir_klc);
-    
-fail_ob:
-    klc_output_buffer_destroy(&ob_leaks);
-    klc_output_buffer_destroy(&ob_bad_frees);
-    klc_output_buffer_destroy(&ob_other);
+    dir_klc = NULL;
     return ret;
 }
 
 void
 klc_output_clear(void)
 {
-    /* "Clear" the data without actually releasing memory. 
-     * No need for locking as the caller ensures that no output may 
-     * interfere.
-     */
-    ob_leaks.data_len = 0;
-    ob_leaks.buf[0] = 0;
+    struct klc_stack *stack = NULL;
+    struct klc_stack *tmp_stack = NULL;
+    struct klc_memblock_info *mbi = NULL;
+    struct klc_memblock_info *tmp = NULL;
+    
+    /* The user may be reading the files at the moment. */
+    mutex_lock(&report_mutex);
+    
+    list_for_each_entry_safe(stack, tmp_stack, &report_leaks, group_list) {
+        list_for_each_entry_safe(mbi, tmp, &stack->leaks, list) {
+            list_del(&mbi->list);
+            klc_memblock_info_destroy(mbi);
+        }
+        list_del_init(&stack->group_list);
+        stack->num_leaks = 0;
+        stack->leaked_bytes = 0;
+    }
+    
+    list_for_each_entry_safe(mbi, tmp, &report_bad_frees, list) {
+        list_del(&mbi->list);
+        klc_memblock_info_destroy(mbi);
+    }
     
-    ob_bad_frees.data_len = 0;
-    ob_bad_frees.buf[0] = 0;
+    memset(&report_info, 0, sizeof(report_info));
+    ++report_generation;
     
-    ob_other.data_len = 0;
-    ob_other.buf[0] = 0;
+    mutex_unlock(&report_mutex);
     return;
 }
 
@@ -606,9 +737,7 @@ klc_output_fini(void)
     if (dir_klc != NULL) 
         debugfs_remove(dir_klc);
     
-    klc_output_buffer_destroy(&ob_leaks);
-    klc_output_buffer_destroy(&ob_bad_frees);
-    klc_output_buffer_destroy(&ob_other);
+    klc_output_clear();
     return;
 }
 /* ================================================================ */
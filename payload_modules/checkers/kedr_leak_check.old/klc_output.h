@@ -15,7 +15,8 @@
 
 /* The caller must ensure that no output via klc_print_* functions takes
  * place when klc_output_init(), klc_output_clear() or klc_output_fini()
- * are running.
+ * are running. Reading of the output files by the user may take place at
+ * any time.
  */
 
 /* Initializes output subsystem (creates files in debugfs if necessary,
@@ -29,7 +30,7 @@ klc_output_init(void);
 
 /* Clears the output data. For example, it may clear the contents of the 
  * files that stored information for the previous analysis session for 
- * the target module.
+ * the target module. The records kept for the reports are destroyed.
  *
  * This function should usually be called from on_target_load() handler
  * or the like to clear old data.
@@ -45,43 +46,16 @@ klc_output_clear(void);
 void
 klc_output_fini(void);
 
-/* Types of information that can be output.
- * The point is, different types of information can be output to different
- * places or distinguished in some other way.
- */
-enum klc_output_type {
-    /* possible leaks */
-    KLC_UNFREED_ALLOC,
-    
-    /* bad frees */
-    KLC_UNALLOCATED_FREE,
-    
-    /* other info: parameters of the target module, totals, ... */
-    KLC_OTHER
-};
-
-/* Outputs a string pointed to by 's' taking type of this information into.
- * account ('output_type').
- * The implementation defines where the string will be output and how 
- * different kinds of information will be distinguished.
- * This function is a basic block for the functions that output particular
- * data structures.
+/* The reports are not built in memory as text. The output subsystem keeps
+ * the records passed to klc_print_*() functions and formats them only
+ * when the user reads the corresponding file. So the size of a report is
+ * limited by the place where the user saves it rather than by the kernel
+ * memory.
  *
- * A newline will be added at the end automatically.
- *
- * This function cannot be used in atomic context.
- */
-void
-klc_print_string(enum klc_output_type output_type, const char *s);
-
-/* Outputs first 'num_entries' elements of 'stack_entries' array as a stack
- * trace. 
- * 
- * This function cannot be used in atomic context.
+ * The records are kept until klc_output_clear() or klc_output_fini() is
+ * called. The klc_memblock_info structures are destroyed then, so the
+ * storage of these structures must still be alive at that moment.
  */
-void
-klc_print_stack_trace(enum klc_output_type output_type, 
-    unsigned long *stack_entries, unsigned int num_entries);
 
 /* Output information about the target module.
  *
@@ -90,16 +64,28 @@ klc_print_stack_trace(enum klc_output_type output_type,
 void
 klc_print_target_module_info(struct module *target_module);
 
-/* Helpers to output klc_memblock_info structures corresponding to 
- * suspicious memory allocation and deallocation events.
+/* Moves the groups of possible leaks to the report. 'groups' is a list of
+ * klc_stack structures linked via 'group_list' field, each with the list 
+ * of possible leaks with that stack trace (see klc_flush_allocs()). 
+ * The list is empty after the call.
+ *
+ * The stack traces are resolved to symbols here, because the target 
+ * module may already be unloaded when the report is read. The rest is
+ * formatted later.
  *
  * Cannot be used in atomic context.
  */
-void 
-klc_print_alloc_info(struct klc_memblock_info *alloc_info);
+void
+klc_print_leak_groups(struct list_head *groups);
 
-void 
-klc_print_dealloc_info(struct klc_memblock_info *dealloc_info);
+/* Moves the klc_memblock_info structures corresponding to spurious 
+ * deallocation events (the list 'bad_frees' linked via 'list' field) to
+ * the report. The list is empty after the call. 
+ *
+ * Cannot be used in atomic context.
+ */
+void
+klc_print_bad_frees(struct list_head *bad_frees);
 
 /* Output statistics about the analysis session of the target module:
  * total number of memory allocations, potential memory leaks and 
@@ -0,0 +1,80 @@
+/* klc_report_format.h
+ * Format of the binary reports ("possible_leaks_bin" and
+ * "unallocated_frees_bin" files).
+ *
+ * A report is a sequence of records. Each record starts with
+ * struct klc_record_header, 'size' is the size of the whole record in
+ * bytes, including the header and the stack trace entries if any.
+ * The tools should skip the records of unknown types.
+ *
+ * The first record of a report is always KLC_RECORD_FILE. In the report
+ * about possible leaks, each KLC_RECORD_LEAK_GROUP record is followed by
+ * the KLC_RECORD_LEAK records for the leaks in that group.
+ *
+ * The values are in the byte order of the machine the report was made on.
+ * The stack traces contain raw call addresses, the tools can resolve them
+ * using /proc/kallsyms and the addresses of the areas of the target module
+ * from the "info" file.
+ *
+ * This header can be used by user-space tools as well.
+ */
+
+#ifndef KLC_REPORT_FORMAT_H_1544_INCLUDED
+#define KLC_REPORT_FORMAT_H_1544_INCLUDED
+
+#include <linux/types.h>
+
+#define KLC_REPORT_MAGIC    0x524c434bU /* "KLCR" */
+#define KLC_REPORT_VERSION  1
+
+enum klc_record_type {
+    KLC_RECORD_FILE         = 1,
+    KLC_RECORD_LEAK_GROUP   = 2,
+    KLC_RECORD_LEAK         = 3,
+    KLC_RECORD_BAD_FREE     = 4
+};
+
+struct klc_record_header
+{
+    __u32 type;
+    __u32 size;
+};
+
+struct klc_record_file
+{
+    struct klc_record_header header;
+    __u32 magic;
+    __u32 version;
+};
+
+/* 'num_entries' stack trace entries follow the structure. If the stack
+ * trace is not available, 'num_entries' is 0. */
+struct klc_record_leak_group
+{
+    struct klc_record_header header;
+    __u64 num_leaks;
+    __u64 total_size;
+    __u32 num_entries;
+    __u32 reserved;
+    /* __u64 entries[num_entries]; */
+};
+
+struct klc_record_leak
+{
+    struct klc_record_header header;
+    __u64 block;
+    __u64 size;
+};
+
+/* 'num_entries' stack trace entries follow the structure, as for
+ * struct klc_record_leak_group. */
+struct klc_record_bad_free
+{
+    struct klc_record_header header;
+    __u64 block;
+    __u32 num_entries;
+    __u32 reserved;
+    /* __u64 entries[num_entries]; */
+};
+
+#endif /* KLC_REPORT_FORMAT_H_1544_INCLUDED */
@@ -0,0 +1,139 @@
+/* klc_stack_depot.c
+ * Storage of the stack traces of allocation and deallocation events.
+ *
+ * The depot is a hash table with a fixed number of buckets. The stack
+ * traces are only added to it while the target module works and are
+ * removed all at once after that, so the lookups need no lock: a new
+ * stack trace is published in the bucket with hlist_add_head_rcu() and
+ * the readers use rcu_dereference(). Additions are serialized with
+ * a spinlock; the bucket is searched again under that lock, so each
+ * trace is stored only once.
+ */
+
+/* ========================================================================
+ * Copyright (C) 2010, Institute for System Programming
+ *                     of the Russian Academy of Sciences (ISPRAS)
+ * Authors:
+ *      Eugene A. Shatokhin <spectre@ispras.ru>
+ *      Andrey V. Tsyvarev  <tsyvarev@ispras.ru>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ ======================================================================== */
+
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "klc_stack_depot.h"
+
+/* Number of buckets in the depot (log2) */
+#define KLC_DEPOT_BUCKETS_ORDER 12
+#define KLC_DEPOT_BUCKETS (1 << KLC_DEPOT_BUCKETS_ORDER)
+
+static struct hlist_head depot_buckets[KLC_DEPOT_BUCKETS];
+
+/* A spinlock to serialize additions to the depot. */
+static DEFINE_SPINLOCK(spinlock_depot);
+/* ================================================================ */
+
+static unsigned long
+klc_stack_hash(const unsigned long *entries, unsigned int num_entries)
+{
+    unsigned long hash = num_entries;
+    unsigned int i;
+
+    for (i = 0; i < num_entries; ++i)
+        hash = (hash ^ entries[i]) * KLC_HASH_MULTIPLIER;
+    return hash;
+}
+
+static inline struct hlist_head *
+klc_stack_bucket(unsigned long hash)
+{
+    return &depot_buckets[hash >> (BITS_PER_LONG - KLC_DEPOT_BUCKETS_ORDER)];
+}
+
+/* Looks for the stack trace in the bucket.
+ * Can be called without the lock, see the comment at the beginning.
+ */
+static struct klc_stack *
+klc_stack_find(struct hlist_head *bucket, unsigned long hash,
+    const unsigned long *entries, unsigned int num_entries)
+{
+    struct hlist_node *node;
+
+    for (node = rcu_dereference(bucket->first); node != NULL;
+        node = rcu_dereference(node->next)) {
+        struct klc_stack *stack = hlist_entry(node, struct klc_stack, hlist);
+        if (stack->hash == hash && stack->num_entries == num_entries &&
+            memcmp(stack->entries, entries,
+                num_entries * sizeof(unsigned long)) == 0)
+            return stack;
+    }
+    return NULL;
+}
+
+const struct klc_stack *
+klc_stack_depot_save(const unsigned long *entries, unsigned int num_entries)
+{
+    unsigned long irq_flags;
+    unsigned long hash = klc_stack_hash(entries, num_entries);
+    struct hlist_head *bucket = klc_stack_bucket(hash);
+    struct klc_stack *stack;
+
+    rcu_read_lock();
+    stack = klc_stack_find(bucket, hash, entries, num_entries);
+    rcu_read_unlock();
+    if (stack != NULL)
+        return stack;
+
+    spin_lock_irqsave(&spinlock_depot, irq_flags);
+    stack = klc_stack_find(bucket, hash, entries, num_entries);
+    if (stack == NULL) {
+        stack = kmalloc(sizeof(struct klc_stack) +
+            num_entries * sizeof(unsigned long), GFP_ATOMIC);
+        if (stack != NULL) {
+            stack->hash = hash;
+            INIT_LIST_HEAD(&stack->leaks);
+            INIT_LIST_HEAD(&stack->group_list);
+            stack->num_leaks = 0;
+            stack->leaked_bytes = 0;
+            stack->symbols = NULL;
+            stack->num_entries = num_entries;
+            memcpy(stack->entries, entries,
+                num_entries * sizeof(unsigned long));
+            hlist_add_head_rcu(&stack->hlist, bucket);
+        }
+    }
+    spin_unlock_irqrestore(&spinlock_depot, irq_flags);
+
+    if (stack == NULL) {
+        printk(KERN_ERR "[kedr_leak_check] klc_stack_depot_save: "
+            "not enough memory to store a stack trace\n");
+    }
+    return stack;
+}
+
+void
+klc_stack_depot_clear(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < KLC_DEPOT_BUCKETS; ++i) {
+        while (!hlist_empty(&depot_buckets[i])) {
+            struct klc_stack *stack = hlist_entry(depot_buckets[i].first,
+                struct klc_stack, hlist);
+            hlist_del(&stack->hlist);
+            kfree(stack->symbols);
+            kfree(stack);
+        }
+    }
+    return;
+}
+/* ================================================================ */
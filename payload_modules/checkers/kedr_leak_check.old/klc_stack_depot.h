@@ -0,0 +1,65 @@
+/* klc_stack_depot.h
+ * Storage of the stack traces of allocation and deallocation events.
+ *
+ * Many memory blocks are usually allocated from the same places in the
+ * code, so the stack traces are interned: each distinct trace is stored
+ * only once and the klc_memblock_info structures refer to it.
+ */
+
+#ifndef KLC_STACK_DEPOT_H_1207_INCLUDED
+#define KLC_STACK_DEPOT_H_1207_INCLUDED
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+
+/* Multiplier for Fibonacci hashing of addresses. */
+#if BITS_PER_LONG == 64
+#define KLC_HASH_MULTIPLIER 0x9e3779b97f4a7c15UL
+#else
+#define KLC_HASH_MULTIPLIER 0x9e3779b9UL
+#endif
+
+/* An interned stack trace.
+ * It is never changed after it has been added to the depot, except for
+ * the fields used to report the possible leaks.
+ */
+struct klc_stack
+{
+    struct hlist_node hlist;
+    unsigned long hash;
+
+    /* Fields used to report the possible leaks (see klc_flush_allocs()
+     * and klc_output.c):
+     * 'leaks' - the list of possible leaks with this stack trace,
+     * 'group_list' - the list of stack traces that have possible leaks,
+     * 'symbols' - the stack trace resolved to text, one entry per line,
+     * NULL if it has not been resolved.
+     */
+    struct list_head leaks;
+    struct list_head group_list;
+    unsigned long num_leaks;
+    u64 leaked_bytes;
+    char *symbols;
+
+    unsigned int num_entries;
+    unsigned long entries[0];
+};
+
+/* Returns the interned stack trace with the given entries, adding it to
+ * the depot if necessary.
+ * Returns NULL if there is not enough memory.
+ *
+ * This function can be used in atomic context.
+ */
+const struct klc_stack *
+klc_stack_depot_save(const unsigned long *entries, unsigned int num_entries);
+
+/* Removes all the stack traces from the depot and destroys them.
+ *
+ * The caller must ensure that no structure refers to these stack traces
+ * any more and that klc_stack_depot_save() is not running.
+ */
+void
+klc_stack_depot_clear(void);
+
+#endif /* KLC_STACK_DEPOT_H_1207_INCLUDED */
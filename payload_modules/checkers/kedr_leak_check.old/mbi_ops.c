@@ -21,46 +21,222 @@
 #include <linux/kernel.h>
 #include <linux/spinlock.h>
 #include <linux/list.h>
+#include <linux/cache.h>
+#include <linux/slab.h>
+#include <linux/errno.h>
 
 #include "mbi_ops.h"
 #include "klc_output.h"
 
-/* A spinlock to serialize access to the storage of klc_memblock_info
- * structures.
+/* The storage of allocation events is a hash table keyed by the address
+ * of the memory block. The table is split into KLC_NUM_SHARDS shards, 
+ * each with its own spinlock and its own array of buckets, so the 
+ * allocations and deallocations on different CPUs rarely contend for 
+ * the same lock. 
+ * 
+ * The top bits of the hash of the address select the shard, the next 
+ * ones select the bucket in that shard. The array of buckets of a shard
+ * grows when the shard becomes too loaded. As this happens in atomic 
+ * context, the new array is allocated with GFP_ATOMIC; if that fails, 
+ * the shard simply keeps its old array (with longer chains).
  */
-DEFINE_SPINLOCK(spinlock_mbi_storage);
+#define KLC_SHARDS_ORDER 6
+#define KLC_NUM_SHARDS (1 << KLC_SHARDS_ORDER)
 
-/* The list of klc_memblock_info structures corresponding to memory 
- * allocation events.
- * Order of elements: LIFO.
- */
-LIST_HEAD(alloc_list);
+/* Initial and maximum number of buckets in a shard (log2) */
+#define KLC_BUCKETS_ORDER_MIN 6
+#define KLC_BUCKETS_ORDER_MAX 16
+
+/* A shard grows when it contains more than this many items per bucket 
+ * on average. */
+#define KLC_MAX_LOAD 2
+
+struct klc_alloc_shard
+{
+    spinlock_t lock;
+    
+    /* (1 << order) buckets */
+    struct hlist_head *buckets;
+    unsigned int order;
+    
+    /* Number of items in the shard */
+    unsigned long count;
+    
+    /* Statistics for the allocations stored in this shard */
+    u64 total_allocs;
+    u64 total_leaks;
+} ____cacheline_aligned_in_smp;
+
+static struct klc_alloc_shard alloc_shards[KLC_NUM_SHARDS];
+
+/* A spinlock to serialize access to the list of deallocation events. */
+static DEFINE_SPINLOCK(spinlock_bad_free);
 
 /* The list of klc_memblock_info structures corresponding to memory 
  * deallocation events (only "unallocated frees" are stored).
  * Order of elements: LIFO.
  */
-LIST_HEAD(bad_free_list);
+static LIST_HEAD(bad_free_list);
+
+/* Statistics: total number of unallocated frees. The numbers of 
+ * allocations and possible leaks are stored in the shards. 
+ */
+static u64 total_bad_frees = 0;
 
-/* Statistics: total number of memory allocations, possible leaks and
- * unallocated frees.
+/* The group for possible leaks without a stack trace (if there was not
+ * enough memory to store it).
  */
-u64 total_allocs = 0;
-u64 total_leaks = 0;
-u64 total_bad_frees = 0;
+static struct klc_stack no_stack = {
+    .leaks = LIST_HEAD_INIT(no_stack.leaks),
+    .group_list = LIST_HEAD_INIT(no_stack.group_list),
+    .num_entries = 0
+};
 /* ================================================================ */
 
+/* Fibonacci hashing: the top bits of the product are well mixed even 
+ * though the addresses of the blocks are aligned. */
+static inline unsigned long
+klc_block_hash(const void *block)
+{
+    return (unsigned long)block * KLC_HASH_MULTIPLIER;
+}
+
+static inline struct klc_alloc_shard *
+klc_shard_for_hash(unsigned long hash)
+{
+    return &alloc_shards[hash >> (BITS_PER_LONG - KLC_SHARDS_ORDER)];
+}
+
+static inline struct hlist_head *
+klc_bucket_for_hash(struct hlist_head *buckets, unsigned int order, 
+    unsigned long hash)
+{
+    /* The bits below those that select the shard */
+    return &buckets[(hash << KLC_SHARDS_ORDER) >> (BITS_PER_LONG - order)];
+}
+
+static struct hlist_head *
+klc_buckets_create(unsigned int order, gfp_t flags)
+{
+    struct hlist_head *buckets;
+    unsigned int i;
+    
+    buckets = kmalloc(sizeof(struct hlist_head) << order, flags);
+    if (buckets == NULL)
+        return NULL;
+    
+    for (i = 0; i < (1U << order); ++i)
+        INIT_HLIST_HEAD(&buckets[i]);
+    return buckets;
+}
+
+/* Doubles the number of buckets in the shard. 
+ * Should be called with the lock of the shard held. */
+static void
+klc_shard_grow(struct klc_alloc_shard *shard)
+{
+    struct hlist_head *buckets;
+    unsigned int order = shard->order + 1;
+    unsigned int i;
+    
+    buckets = klc_buckets_create(order, GFP_ATOMIC | __GFP_NOWARN);
+    if (buckets == NULL)
+        return;
+    
+    for (i = 0; i < (1U << shard->order); ++i) {
+        struct hlist_head *old_bucket = &shard->buckets[i];
+        while (!hlist_empty(old_bucket)) {
+            struct klc_memblock_info *mbi = hlist_entry(old_bucket->first,
+                struct klc_memblock_info, hlist);
+            hlist_del(&mbi->hlist);
+            hlist_add_head(&mbi->hlist, klc_bucket_for_hash(buckets, 
+                order, klc_block_hash(mbi->block)));
+        }
+    }
+    kfree(shard->buckets);
+    shard->buckets = buckets;
+    shard->order = order;
+    return;
+}
+
+int
+klc_storage_init(void)
+{
+    unsigned int i;
+    int ret;
+    
+    ret = klc_mbi_pool_init();
+    if (ret != 0)
+        return ret;
+    
+    for (i = 0; i < KLC_NUM_SHARDS; ++i) {
+        struct klc_alloc_shard *shard = &alloc_shards[i];
+        
+        spin_lock_init(&shard->lock);
+        shard->order = KLC_BUCKETS_ORDER_MIN;
+        shard->buckets = klc_buckets_create(shard->order, GFP_KERNEL);
+        if (shard->buckets == NULL) {
+            klc_storage_fini();
+            return -ENOMEM;
+        }
+        shard->count = 0;
+        shard->total_allocs = 0;
+        shard->total_leaks = 0;
+    }
+    return 0;
+}
+
+void
+klc_storage_fini(void)
+{
+    unsigned int i;
+    
+    /* Free the remaining items, if any, without reporting them */
+    for (i = 0; i < KLC_NUM_SHARDS; ++i) {
+        struct klc_alloc_shard *shard = &alloc_shards[i];
+        unsigned int j;
+        
+        if (shard->buckets == NULL)
+            continue;
+        
+        for (j = 0; j < (1U << shard->order); ++j) {
+            while (!hlist_empty(&shard->buckets[j])) {
+                struct klc_memblock_info *mbi = hlist_entry(
+                    shard->buckets[j].first, struct klc_memblock_info, 
+                    hlist);
+                hlist_del(&mbi->hlist);
+                klc_memblock_info_destroy(mbi);
+            }
+        }
+        kfree(shard->buckets);
+        shard->buckets = NULL;
+    }
+    klc_mbi_pool_fini();
+    klc_stack_depot_clear();
+    return;
+}
+
 void
 klc_add_alloc_impl(struct klc_memblock_info *alloc_info)
 {
     unsigned long irq_flags;
+    unsigned long hash;
+    struct klc_alloc_shard *shard;
     BUG_ON(alloc_info == NULL);
+    
+    hash = klc_block_hash(alloc_info->block);
+    shard = klc_shard_for_hash(hash);
 
-    spin_lock_irqsave(&spinlock_mbi_storage, irq_flags);
-    list_add(&alloc_info->list, &alloc_list);
-    ++total_allocs;
-    ++total_leaks;
-    spin_unlock_irqrestore(&spinlock_mbi_storage, irq_flags);
+    spin_lock_irqsave(&shard->lock, irq_flags);
+    hlist_add_head(&alloc_info->hlist, 
+        klc_bucket_for_hash(shard->buckets, shard->order, hash));
+    ++shard->count;
+    ++shard->total_allocs;
+    ++shard->total_leaks;
+    if (shard->count > ((unsigned long)KLC_MAX_LOAD << shard->order) && 
+        shard->order < KLC_BUCKETS_ORDER_MAX)
+        klc_shard_grow(shard);
+    spin_unlock_irqrestore(&shard->lock, irq_flags);
     return;    
 }
 
@@ -70,10 +246,10 @@ klc_add_bad_free_impl(struct klc_memblock_info *dealloc_info)
     unsigned long irq_flags;
     BUG_ON(dealloc_info == NULL);
 
-    spin_lock_irqsave(&spinlock_mbi_storage, irq_flags);
+    spin_lock_irqsave(&spinlock_bad_free, irq_flags);
     list_add(&dealloc_info->list, &bad_free_list);
     ++total_bad_frees;
-    spin_unlock_irqrestore(&spinlock_mbi_storage, irq_flags);
+    spin_unlock_irqrestore(&spinlock_bad_free, irq_flags);
     return;    
 }
 
@@ -81,64 +257,105 @@ int
 klc_find_and_remove_alloc(const void *block)
 {
     unsigned long irq_flags;
-    int ret = 0;
+    unsigned long hash;
+    struct klc_alloc_shard *shard;
+    struct hlist_node *node;
     struct klc_memblock_info *mbi = NULL;
-    struct klc_memblock_info *tmp = NULL;
     
     WARN_ON(block == NULL);
     
-    spin_lock_irqsave(&spinlock_mbi_storage, irq_flags);
-    list_for_each_entry_safe(mbi, tmp, &alloc_list, list) {
+    hash = klc_block_hash(block);
+    shard = klc_shard_for_hash(hash);
+    
+    spin_lock_irqsave(&shard->lock, irq_flags);
+    node = klc_bucket_for_hash(shard->buckets, shard->order, hash)->first;
+    for (; node != NULL; node = node->next) {
+        mbi = hlist_entry(node, struct klc_memblock_info, hlist);
         if (mbi->block == block) {
-            ret = 1;
-            list_del(&mbi->list);
-            klc_memblock_info_destroy(mbi);
-            --total_leaks;
+            hlist_del(&mbi->hlist);
+            --shard->count;
+            --shard->total_leaks;
+            break;
         }
     }
-    spin_unlock_irqrestore(&spinlock_mbi_storage, irq_flags);
-    return ret;    
+    spin_unlock_irqrestore(&shard->lock, irq_flags);
+    
+    if (node == NULL)
+        return 0;
+    
+    klc_memblock_info_destroy(mbi);
+    return 1;
+}
+
+/* Adds the possible leak to the group for its stack trace. */
+static void
+klc_group_leak(struct klc_memblock_info *mbi, struct list_head *groups)
+{
+    /* Only the fields for grouping are changed here */
+    struct klc_stack *stack = (mbi->stack != NULL) ? 
+        (struct klc_stack *)mbi->stack : &no_stack;
+    
+    if (stack->num_leaks == 0)
+        list_add_tail(&stack->group_list, groups);
+    list_add_tail(&mbi->list, &stack->leaks);
+    ++stack->num_leaks;
+    stack->leaked_bytes += mbi->size;
+    return;
 }
 
 void
 klc_flush_allocs(void)
 {
-    struct klc_memblock_info *mbi = NULL;
-    struct klc_memblock_info *tmp = NULL;
+    LIST_HEAD(groups);
+    unsigned int i;
     
-    list_for_each_entry_safe(mbi, tmp, &alloc_list, list) {
-        klc_print_alloc_info(mbi);
-        list_del(&mbi->list);
-        klc_memblock_info_destroy(mbi);
+    /* Group the possible leaks by their stack traces... */
+    for (i = 0; i < KLC_NUM_SHARDS; ++i) {
+        struct klc_alloc_shard *shard = &alloc_shards[i];
+        unsigned int j;
+        
+        for (j = 0; j < (1U << shard->order); ++j) {
+            while (!hlist_empty(&shard->buckets[j])) {
+                struct klc_memblock_info *mbi = hlist_entry(
+                    shard->buckets[j].first, struct klc_memblock_info, 
+                    hlist);
+                hlist_del(&mbi->hlist);
+                klc_group_leak(mbi, &groups);
+            }
+        }
+        shard->count = 0;
     }
+    
+    /* ...and pass the groups to the report. */
+    klc_print_leak_groups(&groups);
     return;
 }
 
 void
 klc_flush_deallocs(void)
 {
-    struct klc_memblock_info *mbi = NULL;
-    struct klc_memblock_info *tmp = NULL;
-    
-    list_for_each_entry_safe(mbi, tmp, &bad_free_list, list) {
-        klc_print_dealloc_info(mbi);
-        list_del(&mbi->list);
-        klc_memblock_info_destroy(mbi);
-    }
+    klc_print_bad_frees(&bad_free_list);
     return;
 }
 
 void
 klc_flush_stats(void)
 {
-    klc_print_totals(total_allocs, total_leaks, total_bad_frees);
-
+    u64 total_allocs = 0;
+    u64 total_leaks = 0;
+    unsigned int i;
+    
     /* No need to protect these counters here as this function is called
      * from on_target_unload handler when no replacement function can
      * interfere.
      */
-    total_allocs = 0;
-    total_leaks = 0;
+    for (i = 0; i < KLC_NUM_SHARDS; ++i) {
+        total_allocs += alloc_shards[i].total_allocs;
+        total_leaks += alloc_shards[i].total_leaks;
+        alloc_shards[i].total_allocs = 0;
+        alloc_shards[i].total_leaks = 0;
+    }
+    klc_print_totals(total_allocs, total_leaks, total_bad_frees);
     total_bad_frees = 0;
     return;
 }
@@ -11,6 +11,21 @@
 
 #include "memblock_info.h"
 
+/* Initializes the storage. 
+ * Returns 0 on success, negative error code on failure.
+ * Should be called from the module's initialization function, before
+ * the replacement functions may be called.
+ */
+int
+klc_storage_init(void);
+
+/* Destroys the storage and the items remaining in it (without outputting
+ * the information about them).
+ * Should be called from the module's cleanup function.
+ */
+void
+klc_storage_fini(void);
+
 /* Adds the structure pointed to by 'alloc_info' to the list of 
  * "allocation events".
  *
@@ -67,14 +82,18 @@ klc_add_bad_free_impl(struct klc_memblock_info *dealloc_info);
  * (no need to store it any longer) and returns nonzero.
  * Otherwise, the function returns 0 and leaves the storage unchanged.
  *
+ * If there are several such items (a deallocation of the block was 
+ * missed), only one of them is removed, the others remain possible leaks.
+ *
  * 'block' must not be NULL.
  */
 int
 klc_find_and_remove_alloc(const void *block);
 
 /* Outputs the information about the allocation events currently present 
- * in the storage, detetes the corresponding entries from the storage and
- * then destroys them.
+ * in the storage: groups them by the stack trace and moves them from 
+ * the storage to the report (see klc_print_leak_groups()). The output 
+ * subsystem destroys them when the report is cleared.
  * The storage should be empty as a result.
  * 
  * As the output routines this function uses cannot be called in atomic 
@@ -0,0 +1,237 @@
+/* mbi_pool.c
+ * Pool of klc_memblock_info structures.
+ *
+ * The structures are allocated in chunks that are released only when
+ * the pool is destroyed. Free structures are kept in the global list and
+ * in the per-CPU caches. The cache of the current CPU is accessed with
+ * interrupts disabled, the global list - under a spinlock. The structures
+ * move between them in batches of KLC_POOL_BATCH items.
+ */
+
+/* ========================================================================
+ * Copyright (C) 2010, Institute for System Programming
+ *                     of the Russian Academy of Sciences (ISPRAS)
+ * Authors:
+ *      Eugene A. Shatokhin <spectre@ispras.ru>
+ *      Andrey V. Tsyvarev  <tsyvarev@ispras.ru>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ ======================================================================== */
+
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/irqflags.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+
+#include "memblock_info.h"
+#include "mbi_pool.h"
+
+/* Number of structures moved between the per-CPU cache and the global
+ * list at once. The cache holds at most 2 * KLC_POOL_BATCH structures.
+ */
+#define KLC_POOL_BATCH 32
+
+/* Size of a chunk of structures, in bytes */
+#define KLC_POOL_CHUNK_SIZE 4096
+
+/* Number of structures to preallocate */
+#define KLC_POOL_PREALLOC 4096
+
+/* A free structure */
+struct klc_pool_item
+{
+    struct klc_pool_item *next;
+};
+
+/* A chunk; the structures follow the header */
+struct klc_pool_chunk
+{
+    struct klc_pool_chunk *next;
+};
+
+#define KLC_POOL_CHUNK_ITEMS \
+    ((KLC_POOL_CHUNK_SIZE - sizeof(struct klc_pool_chunk)) / \
+        sizeof(struct klc_memblock_info))
+
+struct klc_pool_cache
+{
+    struct klc_pool_item *items;
+    unsigned int count;
+};
+
+static DEFINE_PER_CPU(struct klc_pool_cache, pool_caches);
+
+/* A spinlock to protect the global list and the list of chunks. */
+static DEFINE_SPINLOCK(spinlock_pool);
+
+static struct klc_pool_item *pool_items = NULL;
+static unsigned long pool_count = 0;
+static struct klc_pool_chunk *pool_chunks = NULL;
+/* ================================================================ */
+
+/* Allocates a chunk and adds its structures to the global list.
+ * Should be called with 'spinlock_pool' held (except during the 
+ * initialization).
+ */
+static int
+klc_pool_add_chunk(gfp_t flags)
+{
+    struct klc_pool_chunk *chunk;
+    struct klc_memblock_info *mbi;
+    unsigned int i;
+
+    BUILD_BUG_ON(sizeof(struct klc_memblock_info) <
+        sizeof(struct klc_pool_item));
+
+    chunk = kmalloc(KLC_POOL_CHUNK_SIZE, flags);
+    if (chunk == NULL)
+        return -ENOMEM;
+
+    chunk->next = pool_chunks;
+    pool_chunks = chunk;
+
+    mbi = (struct klc_memblock_info *)(chunk + 1);
+    for (i = 0; i < KLC_POOL_CHUNK_ITEMS; ++i) {
+        struct klc_pool_item *item = (struct klc_pool_item *)&mbi[i];
+        item->next = pool_items;
+        pool_items = item;
+    }
+    pool_count += KLC_POOL_CHUNK_ITEMS;
+    return 0;
+}
+
+/* Moves a batch of structures from the global list to the cache.
+ * Should be called with interrupts disabled.
+ */
+static void
+klc_pool_refill(struct klc_pool_cache *cache)
+{
+    unsigned int i;
+
+    spin_lock(&spinlock_pool);
+    if (pool_items == NULL)
+        klc_pool_add_chunk(GFP_ATOMIC | __GFP_NOWARN);
+
+    for (i = 0; i < KLC_POOL_BATCH && pool_items != NULL; ++i) {
+        struct klc_pool_item *item = pool_items;
+        pool_items = item->next;
+        --pool_count;
+
+        item->next = cache->items;
+        cache->items = item;
+        ++cache->count;
+    }
+    spin_unlock(&spinlock_pool);
+    return;
+}
+
+/* Moves a batch of structures from the cache to the global list.
+ * Should be called with interrupts disabled.
+ */
+static void
+klc_pool_drain(struct klc_pool_cache *cache)
+{
+    unsigned int i;
+
+    spin_lock(&spinlock_pool);
+    for (i = 0; i < KLC_POOL_BATCH && cache->items != NULL; ++i) {
+        struct klc_pool_item *item = cache->items;
+        cache->items = item->next;
+        --cache->count;
+
+        item->next = pool_items;
+        pool_items = item;
+        ++pool_count;
+    }
+    spin_unlock(&spinlock_pool);
+    return;
+}
+
+int
+klc_mbi_pool_init(void)
+{
+    int ret = 0;
+
+    /* Nobody else uses the pool yet, so the lock is not needed */
+    while (pool_count < KLC_POOL_PREALLOC) {
+        ret = klc_pool_add_chunk(GFP_KERNEL);
+        if (ret != 0) {
+            klc_mbi_pool_fini();
+            break;
+        }
+    }
+    return ret;
+}
+
+void
+klc_mbi_pool_fini(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct klc_pool_cache *cache = &per_cpu(pool_caches, cpu);
+        cache->items = NULL;
+        cache->count = 0;
+    }
+
+    while (pool_chunks != NULL) {
+        struct klc_pool_chunk *chunk = pool_chunks;
+        pool_chunks = chunk->next;
+        kfree(chunk);
+    }
+    pool_items = NULL;
+    pool_count = 0;
+    return;
+}
+
+struct klc_memblock_info *
+klc_mbi_alloc(void)
+{
+    unsigned long irq_flags;
+    struct klc_pool_cache *cache;
+    struct klc_pool_item *item;
+
+    local_irq_save(irq_flags);
+    cache = &__get_cpu_var(pool_caches);
+    if (cache->items == NULL)
+        klc_pool_refill(cache);
+
+    item = cache->items;
+    if (item != NULL) {
+        cache->items = item->next;
+        --cache->count;
+    }
+    local_irq_restore(irq_flags);
+
+    if (item == NULL)
+        return NULL;
+    memset(item, 0, sizeof(struct klc_memblock_info));
+    return (struct klc_memblock_info *)item;
+}
+
+void
+klc_mbi_free(struct klc_memblock_info *mbi)
+{
+    unsigned long irq_flags;
+    struct klc_pool_cache *cache;
+    struct klc_pool_item *item = (struct klc_pool_item *)mbi;
+
+    if (mbi == NULL)
+        return;
+
+    local_irq_save(irq_flags);
+    cache = &__get_cpu_var(pool_caches);
+    item->next = cache->items;
+    cache->items = item;
+    ++cache->count;
+    if (cache->count > 2 * KLC_POOL_BATCH)
+        klc_pool_drain(cache);
+    local_irq_restore(irq_flags);
+    return;
+}
+/* ================================================================ */
@@ -0,0 +1,43 @@
+/* mbi_pool.h
+ * Pool of klc_memblock_info structures.
+ *
+ * A structure is created for each allocation made by the target module,
+ * so getting it from the general-purpose allocator would double the
+ * allocator traffic. The pool preallocates the structures in chunks and
+ * keeps a small cache of free structures for each CPU, so most requests
+ * are served without any lock.
+ */
+
+#ifndef MBI_POOL_H_1425_INCLUDED
+#define MBI_POOL_H_1425_INCLUDED
+
+struct klc_memblock_info;
+
+/* Initializes the pool and preallocates some structures.
+ * Returns 0 on success, negative error code on failure.
+ */
+int
+klc_mbi_pool_init(void);
+
+/* Destroys the pool and all the structures in it. The caller must
+ * ensure no structure from the pool is in use any more.
+ */
+void
+klc_mbi_pool_fini(void);
+
+/* Returns a zeroed structure from the pool or NULL if there is not
+ * enough memory.
+ *
+ * This function can be used in atomic context.
+ */
+struct klc_memblock_info *
+klc_mbi_alloc(void);
+
+/* Returns the structure to the pool. No-op if 'mbi' is NULL.
+ *
+ * This function can be used in atomic context.
+ */
+void
+klc_mbi_free(struct klc_memblock_info *mbi);
+
+#endif /* MBI_POOL_H_1425_INCLUDED */
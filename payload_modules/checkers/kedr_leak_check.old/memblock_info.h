@@ -9,21 +9,27 @@
 #define MEMBLOCK_INFO_H_1734_INCLUDED
 
 #include <linux/list.h>
-#include <linux/slab.h>
 
 #include "kedr_stack_trace.h"
+#include "klc_stack_depot.h"
+#include "mbi_pool.h"
 
 /* This structure contains data about a block of memory:
  * the pointer to that block ('block') and a portion of the call stack for
  * the appropriate call to an allocation or deallocation function 
- * ('stack_entries' array containing 'num_entries' meaningful elements).
+ * ('stack', interned in the stack depot, NULL if there was not enough 
+ * memory to store it).
  * 
- * The instances of this structure are to be stored in a linked list, hence
- * 'list' field here.
+ * The instances of this structure are to be stored in a linked list 
+ * ('list' field) or in a bucket of the hash table ('hlist' field); 
+ * an instance is never in both at the same time.
  */
 struct klc_memblock_info
 {
-    struct list_head list;
+    union {
+        struct list_head list;
+        struct hlist_node hlist;
+    };
     
     /* Pointer to the memory block and the size of that block.
      * 'size' is (size_t)(-1) if the block was freed rather than allocated
@@ -32,8 +38,7 @@ struct klc_memblock_info
     size_t size;
     
     /* Call stack */
-    unsigned int num_entries;
-    unsigned long stack_entries[KEDR_MAX_FRAMES];
+    const struct klc_stack *stack;
 };
 
 /* Helpers to create and destroy 'klc_memblock_info' structures. */
@@ -45,24 +50,25 @@ struct klc_memblock_info
  * block (should be -1 in case of free). These values will be stored 
  * in the corresponding fields of the structure.
  * A portion of call stack with depth no greater than 'max_stack_depth_'
- * will also be stored.
+ * will also be stored (in the stack depot).
  * 'list' field will be initialized.
  *
- * This macro can be used in atomic context too (it uses GFP_ATOMIC flag 
- * when it allocates memory).
+ * This macro can be used in atomic context too (the structure is taken
+ * from the pool, see mbi_pool.h).
  */
 #define klc_memblock_info_create(block_, size_, max_stack_depth_)  \
 ({                                                                  \
     struct klc_memblock_info *ptr;                                 \
-    ptr = (struct klc_memblock_info *)kzalloc(                     \
-        sizeof(struct klc_memblock_info),                          \
-        GFP_ATOMIC);                                                \
+    unsigned long entries_[KEDR_MAX_FRAMES];                        \
+    unsigned int num_entries_;                                      \
+    ptr = klc_mbi_alloc();                                          \
     if (ptr != NULL) {                                              \
         ptr->block = (block_);                                      \
         ptr->size  = (size_);                                       \
-        kedr_save_stack_trace(&(ptr->stack_entries[0]),             \
-            (max_stack_depth_),                                     \
-            &ptr->num_entries);                                     \
+        kedr_save_stack_trace(&entries_[0], (max_stack_depth_),     \
+            &num_entries_);                                         \
+        ptr->stack = klc_stack_depot_save(&entries_[0],             \
+            num_entries_);                                          \
         INIT_LIST_HEAD(&ptr->list);                                 \
     }                                                               \
     ptr;                                                            \
@@ -82,6 +88,6 @@ struct klc_memblock_info
  * [NB] Before destroying the structure, make sure you have removed it
  * from the list if it was there.
  */
-#define klc_memblock_info_destroy(ptr) kfree(ptr)
+#define klc_memblock_info_destroy(ptr) klc_mbi_free(ptr)
 
 #endif /* MEMBLOCK_INFO_H_1734_INCLUDED */
@@ -79,7 +79,10 @@ target_load_callback(struct module *target_module)
 {
     BUG_ON(target_module == NULL);
     
+    /* Destroy the records of the previous session first: they refer to
+     * the stack traces in the depot. */
     klc_output_clear();
+    klc_stack_depot_clear();
     klc_print_target_module_info(target_module);
     return;
 }
@@ -599,6 +602,7 @@ payload_cleanup_module(void)
 {
     kedr_payload_unregister(&payload);
     klc_output_fini();
+    klc_storage_fini();
     
     KEDR_MSG("[kedr_leak_check] Cleanup complete\n");
     return;
@@ -624,10 +628,16 @@ payload_init_module(void)
         return -EINVAL;
     }
     
-    ret = klc_output_init();
+    ret = klc_storage_init();
     if (ret != 0)
         return ret;
     
+    /* The reports keep klc_memblock_info structures, so the output 
+     * subsystem is created after the storage and destroyed before it. */
+    ret = klc_output_init();
+    if (ret != 0)
+        goto fail_output;
+    
     ret = kedr_payload_register(&payload);
     if (ret != 0) 
         goto fail_reg;
@@ -636,6 +646,8 @@ payload_init_module(void)
 
 fail_reg:
     klc_output_fini();
+fail_output:
+    klc_storage_fini();
     return ret;
 }
 
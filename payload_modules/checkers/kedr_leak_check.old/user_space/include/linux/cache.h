@@ -0,0 +1,11 @@
+/* cache.h
+ * Cache line alignment for user space.
+ */
+
+#ifndef KLC_USER_CACHE_H_INCLUDED
+#define KLC_USER_CACHE_H_INCLUDED
+
+#define L1_CACHE_BYTES 64
+#define ____cacheline_aligned_in_smp __attribute__((__aligned__(L1_CACHE_BYTES)))
+
+#endif /* KLC_USER_CACHE_H_INCLUDED */
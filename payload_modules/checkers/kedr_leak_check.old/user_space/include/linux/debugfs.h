@@ -0,0 +1,35 @@
+/* debugfs.h
+ * User-space debugfs: the files are only remembered, so that the tests 
+ * can find and "open" them (see seq_file_user.c).
+ */
+
+#ifndef KLC_USER_DEBUGFS_H_INCLUDED
+#define KLC_USER_DEBUGFS_H_INCLUDED
+
+#include <linux/fs.h>
+
+#define IS_ERR(ptr_) ((unsigned long)(ptr_) >= (unsigned long)-4095)
+
+struct dentry {
+    const char *name;
+    struct dentry *parent;
+    void *data;
+    const struct file_operations *fops;
+    struct dentry *next;
+};
+
+struct dentry *
+debugfs_create_dir(const char *name, struct dentry *parent);
+
+struct dentry *
+debugfs_create_file(const char *name, mode_t mode, struct dentry *parent,
+    void *data, const struct file_operations *fops);
+
+void
+debugfs_remove(struct dentry *dentry);
+
+/* Not in the kernel API: returns the file with the given name or NULL. */
+struct dentry *
+debugfs_user_lookup(const char *name);
+
+#endif /* KLC_USER_DEBUGFS_H_INCLUDED */
@@ -0,0 +1,32 @@
+/* fs.h
+ * The parts of the file structures used by seq_file and debugfs, for 
+ * user space.
+ */
+
+#ifndef KLC_USER_FS_H_INCLUDED
+#define KLC_USER_FS_H_INCLUDED
+
+#include <sys/types.h>
+
+#include <linux/module.h>
+
+#define S_IRUGO 0444
+
+struct inode {
+    void *i_private;
+};
+
+struct file {
+    loff_t f_pos;
+    void *private_data;
+};
+
+struct file_operations {
+    struct module *owner;
+    int (*open)(struct inode *, struct file *);
+    int (*release)(struct inode *, struct file *);
+    ssize_t (*read)(struct file *, char *, size_t, loff_t *);
+    loff_t (*llseek)(struct file *, loff_t, int);
+};
+
+#endif /* KLC_USER_FS_H_INCLUDED */
@@ -0,0 +1,11 @@
+/* irqflags.h
+ * There are no interrupts in user space, so these are no-ops.
+ */
+
+#ifndef KLC_USER_IRQFLAGS_H_INCLUDED
+#define KLC_USER_IRQFLAGS_H_INCLUDED
+
+#define local_irq_save(flags_) do { (flags_) = 0; } while (0)
+#define local_irq_restore(flags_) do { (void)(flags_); } while (0)
+
+#endif /* KLC_USER_IRQFLAGS_H_INCLUDED */
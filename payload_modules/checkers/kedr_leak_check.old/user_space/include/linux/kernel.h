@@ -0,0 +1,49 @@
+/* kernel.h
+ * Minimal user-space replacement of <linux/kernel.h> for building 
+ * mbi_ops.c as an ordinary program (see ../../Makefile).
+ */
+
+#ifndef KLC_USER_KERNEL_H_INCLUDED
+#define KLC_USER_KERNEL_H_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+typedef uint64_t u64;
+typedef uint32_t u32;
+
+#define BITS_PER_LONG (CHAR_BIT * __SIZEOF_LONG__)
+
+#define KERN_ERR     ""
+#define KERN_WARNING ""
+#define KERN_INFO    ""
+
+#define printk printf
+
+#define BUG_ON(cond_)                                               \
+do {                                                                \
+    if (cond_) {                                                    \
+        fprintf(stderr, "BUG at %s:%d\n", __FILE__, __LINE__);      \
+        abort();                                                    \
+    }                                                               \
+} while (0)
+
+#define WARN_ON(cond_)                                              \
+({                                                                  \
+    int ret_ = !!(cond_);                                           \
+    if (ret_)                                                       \
+        fprintf(stderr, "WARNING at %s:%d\n", __FILE__, __LINE__);  \
+    ret_;                                                           \
+})
+
+#define BUILD_BUG_ON(cond_) ((void)sizeof(char[1 - 2 * !!(cond_)]))
+
+#define container_of(ptr_, type_, member_) \
+    ((type_ *)((char *)(ptr_) - offsetof(type_, member_)))
+
+#define ARRAY_SIZE(arr_) (sizeof(arr_) / sizeof((arr_)[0]))
+
+#endif /* KLC_USER_KERNEL_H_INCLUDED */
@@ -0,0 +1,136 @@
+/* list.h
+ * The subset of <linux/list.h> used by kedr_leak_check, for user space.
+ */
+
+#ifndef KLC_USER_LIST_H_INCLUDED
+#define KLC_USER_LIST_H_INCLUDED
+
+#include <linux/kernel.h>
+
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name_) { &(name_), &(name_) }
+#define LIST_HEAD(name_) struct list_head name_ = LIST_HEAD_INIT(name_)
+
+static inline void
+INIT_LIST_HEAD(struct list_head *list)
+{
+    list->next = list;
+    list->prev = list;
+}
+
+static inline void
+list_add(struct list_head *item, struct list_head *head)
+{
+    item->next = head->next;
+    item->prev = head;
+    head->next->prev = item;
+    head->next = item;
+}
+
+static inline void
+list_add_tail(struct list_head *item, struct list_head *head)
+{
+    item->next = head;
+    item->prev = head->prev;
+    head->prev->next = item;
+    head->prev = item;
+}
+
+static inline void
+list_del(struct list_head *item)
+{
+    item->prev->next = item->next;
+    item->next->prev = item->prev;
+    item->next = NULL;
+    item->prev = NULL;
+}
+
+static inline void
+list_del_init(struct list_head *item)
+{
+    item->prev->next = item->next;
+    item->next->prev = item->prev;
+    INIT_LIST_HEAD(item);
+}
+
+static inline int
+list_empty(const struct list_head *head)
+{
+    return head->next == head;
+}
+
+/* Moves the items of 'list' to the end of 'head', 'list' becomes empty. */
+static inline void
+list_splice_tail_init(struct list_head *list, struct list_head *head)
+{
+    if (list_empty(list))
+        return;
+    
+    list->next->prev = head->prev;
+    head->prev->next = list->next;
+    list->prev->next = head;
+    head->prev = list->prev;
+    INIT_LIST_HEAD(list);
+}
+
+#define list_entry(ptr_, type_, member_) container_of(ptr_, type_, member_)
+
+#define list_for_each_entry(pos_, head_, member_)                        \
+    for (pos_ = list_entry((head_)->next, typeof(*pos_), member_);          \
+        &pos_->member_ != (head_);                                          \
+        pos_ = list_entry(pos_->member_.next, typeof(*pos_), member_))
+
+#define list_for_each_entry_safe(pos_, n_, head_, member_)                  \
+    for (pos_ = list_entry((head_)->next, typeof(*pos_), member_),          \
+        n_ = list_entry(pos_->member_.next, typeof(*pos_), member_);        \
+        &pos_->member_ != (head_);                                          \
+        pos_ = n_, n_ = list_entry(n_->member_.next, typeof(*n_), member_))
+
+struct hlist_head {
+    struct hlist_node *first;
+};
+
+struct hlist_node {
+    struct hlist_node *next, **pprev;
+};
+
+#define HLIST_HEAD_INIT { NULL }
+
+static inline void
+INIT_HLIST_HEAD(struct hlist_head *head)
+{
+    head->first = NULL;
+}
+
+static inline int
+hlist_empty(const struct hlist_head *head)
+{
+    return head->first == NULL;
+}
+
+static inline void
+hlist_add_head(struct hlist_node *node, struct hlist_head *head)
+{
+    node->next = head->first;
+    if (head->first != NULL)
+        head->first->pprev = &node->next;
+    head->first = node;
+    node->pprev = &head->first;
+}
+
+static inline void
+hlist_del(struct hlist_node *node)
+{
+    *node->pprev = node->next;
+    if (node->next != NULL)
+        node->next->pprev = node->pprev;
+    node->next = NULL;
+    node->pprev = NULL;
+}
+
+#define hlist_entry(ptr_, type_, member_) container_of(ptr_, type_, member_)
+
+#endif /* KLC_USER_LIST_H_INCLUDED */
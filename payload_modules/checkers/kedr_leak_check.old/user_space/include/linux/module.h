@@ -0,0 +1,22 @@
+/* module.h
+ * The part of 'struct module' used by kedr_leak_check, for user space.
+ */
+
+#ifndef KLC_USER_MODULE_H_INCLUDED
+#define KLC_USER_MODULE_H_INCLUDED
+
+#include <linux/kernel.h>
+
+#define MODULE_NAME_LEN 56
+
+struct module {
+    char name[MODULE_NAME_LEN];
+    void *module_init;
+    void *module_core;
+};
+
+#define module_name(mod_) ((mod_)->name)
+
+#define THIS_MODULE ((struct module *)NULL)
+
+#endif /* KLC_USER_MODULE_H_INCLUDED */
@@ -0,0 +1,35 @@
+/* mutex.h
+ * Kernel mutexes mapped to the mutexes of pthreads.
+ */
+
+#ifndef KLC_USER_MUTEX_H_INCLUDED
+#define KLC_USER_MUTEX_H_INCLUDED
+
+#include <pthread.h>
+
+struct mutex {
+    pthread_mutex_t m;
+};
+
+#define DEFINE_MUTEX(name_) \
+    struct mutex name_ = { PTHREAD_MUTEX_INITIALIZER }
+
+static inline void
+mutex_init(struct mutex *lock)
+{
+    pthread_mutex_init(&lock->m, NULL);
+}
+
+static inline void
+mutex_lock(struct mutex *lock)
+{
+    pthread_mutex_lock(&lock->m);
+}
+
+static inline void
+mutex_unlock(struct mutex *lock)
+{
+    pthread_mutex_unlock(&lock->m);
+}
+
+#endif /* KLC_USER_MUTEX_H_INCLUDED */
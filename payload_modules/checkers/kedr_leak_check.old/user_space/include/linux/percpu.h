@@ -0,0 +1,19 @@
+/* percpu.h
+ * Per-CPU variables for user space: each thread plays the role of a CPU
+ * that never migrates, so a per-CPU variable is a thread-local one.
+ *
+ * Only the variable of the calling thread is accessible, so 
+ * for_each_possible_cpu() visits just that one.
+ */
+
+#ifndef KLC_USER_PERCPU_H_INCLUDED
+#define KLC_USER_PERCPU_H_INCLUDED
+
+#define DEFINE_PER_CPU(type_, name_) __thread type_ name_
+
+#define __get_cpu_var(var_) (var_)
+#define per_cpu(var_, cpu_) (*((void)(cpu_), &(var_)))
+
+#define for_each_possible_cpu(cpu_) for ((cpu_) = 0; (cpu_) < 1; ++(cpu_))
+
+#endif /* KLC_USER_PERCPU_H_INCLUDED */
@@ -0,0 +1,23 @@
+/* rculist.h
+ * RCU-safe list operations for user space.
+ */
+
+#ifndef KLC_USER_RCULIST_H_INCLUDED
+#define KLC_USER_RCULIST_H_INCLUDED
+
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+
+static inline void
+hlist_add_head_rcu(struct hlist_node *node, struct hlist_head *head)
+{
+    struct hlist_node *first = head->first;
+    
+    node->next = first;
+    node->pprev = &head->first;
+    if (first != NULL)
+        first->pprev = &node->next;
+    rcu_assign_pointer(head->first, node);
+}
+
+#endif /* KLC_USER_RCULIST_H_INCLUDED */
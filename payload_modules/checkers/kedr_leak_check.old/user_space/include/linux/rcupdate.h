@@ -0,0 +1,16 @@
+/* rcupdate.h
+ * The part of RCU API used by kedr_leak_check, for user space. 
+ * The objects are never freed while they may be read, so only the 
+ * ordering of publication and reading is provided.
+ */
+
+#ifndef KLC_USER_RCUPDATE_H_INCLUDED
+#define KLC_USER_RCUPDATE_H_INCLUDED
+
+#define rcu_read_lock() do { } while (0)
+#define rcu_read_unlock() do { } while (0)
+
+#define rcu_dereference(p_) __atomic_load_n(&(p_), __ATOMIC_ACQUIRE)
+#define rcu_assign_pointer(p_, v_) __atomic_store_n(&(p_), (v_), __ATOMIC_RELEASE)
+
+#endif /* KLC_USER_RCUPDATE_H_INCLUDED */
@@ -0,0 +1,67 @@
+/* seq_file.h
+ * seq_file interface for user space, see seq_file_user.c.
+ */
+
+#ifndef KLC_USER_SEQ_FILE_H_INCLUDED
+#define KLC_USER_SEQ_FILE_H_INCLUDED
+
+#include <linux/fs.h>
+#include <linux/mutex.h>
+
+#define SEQ_START_TOKEN ((void *)1)
+
+struct seq_operations;
+
+struct seq_file {
+    char *buf;
+    size_t size;
+    size_t from;
+    size_t count;
+    loff_t index;
+    loff_t read_pos;
+    struct mutex lock;
+    const struct seq_operations *op;
+    void *private;
+};
+
+struct seq_operations {
+    void *(*start)(struct seq_file *m, loff_t *pos);
+    void (*stop)(struct seq_file *m, void *v);
+    void *(*next)(struct seq_file *m, void *v, loff_t *pos);
+    int (*show)(struct seq_file *m, void *v);
+};
+
+int
+seq_open(struct file *file, const struct seq_operations *op);
+
+int
+seq_open_private(struct file *file, const struct seq_operations *op,
+    int psize);
+
+int
+seq_release(struct inode *inode, struct file *file);
+
+int
+seq_release_private(struct inode *inode, struct file *file);
+
+ssize_t
+seq_read(struct file *file, char *buf, size_t size, loff_t *ppos);
+
+loff_t
+seq_lseek(struct file *file, loff_t offset, int origin);
+
+int
+seq_printf(struct seq_file *m, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+int
+seq_puts(struct seq_file *m, const char *s);
+
+int
+single_open(struct file *file, int (*show)(struct seq_file *, void *),
+    void *data);
+
+int
+single_release(struct inode *inode, struct file *file);
+
+#endif /* KLC_USER_SEQ_FILE_H_INCLUDED */
@@ -0,0 +1,36 @@
+/* slab.h
+ * Kernel memory allocation functions mapped to malloc() and free().
+ */
+
+#ifndef KLC_USER_SLAB_H_INCLUDED
+#define KLC_USER_SLAB_H_INCLUDED
+
+#include <stdlib.h>
+
+typedef unsigned int gfp_t;
+
+#define GFP_KERNEL   0x01U
+#define GFP_ATOMIC   0x02U
+#define __GFP_NOWARN 0x04U
+
+static inline void *
+kmalloc(size_t size, gfp_t flags)
+{
+    (void)flags;
+    return malloc(size);
+}
+
+static inline void *
+kzalloc(size_t size, gfp_t flags)
+{
+    (void)flags;
+    return calloc(1, size);
+}
+
+static inline void
+kfree(const void *ptr)
+{
+    free((void *)ptr);
+}
+
+#endif /* KLC_USER_SLAB_H_INCLUDED */
@@ -0,0 +1,56 @@
+/* spinlock.h
+ * User-space spinlocks with the interface of <linux/spinlock.h>.
+ * Interrupts do not exist here, so the "irqsave" variants only take 
+ * the lock.
+ */
+
+#ifndef KLC_USER_SPINLOCK_H_INCLUDED
+#define KLC_USER_SPINLOCK_H_INCLUDED
+
+#include <sched.h>
+
+typedef struct {
+    int locked;
+} spinlock_t;
+
+#define __SPIN_LOCK_UNLOCKED(name_) { 0 }
+#define DEFINE_SPINLOCK(name_) spinlock_t name_ = __SPIN_LOCK_UNLOCKED(name_)
+
+/* Number of spins before the thread yields the CPU: unlike in the kernel,
+ * the owner of the lock may be preempted. */
+#define KLC_USER_SPINS 1000
+
+static inline void
+spin_lock_init(spinlock_t *lock)
+{
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELAXED);
+}
+
+static inline void
+spin_lock(spinlock_t *lock)
+{
+    unsigned int spins = 0;
+    
+    while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED)) {
+            if (++spins == KLC_USER_SPINS) {
+                spins = 0;
+                sched_yield();
+            }
+        }
+    }
+}
+
+static inline void
+spin_unlock(spinlock_t *lock)
+{
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+#define spin_lock_irqsave(lock_, flags_) \
+    do { (flags_) = 0; spin_lock(lock_); } while (0)
+
+#define spin_unlock_irqrestore(lock_, flags_) \
+    do { (void)(flags_); spin_unlock(lock_); } while (0)
+
+#endif /* KLC_USER_SPINLOCK_H_INCLUDED */
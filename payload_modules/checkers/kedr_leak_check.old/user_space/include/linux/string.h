@@ -0,0 +1,26 @@
+/* string.h
+ * String functions for user space.
+ */
+
+#ifndef KLC_USER_STRING_H_INCLUDED
+#define KLC_USER_STRING_H_INCLUDED
+
+#include <string.h>
+
+/* Older C libraries have no strlcpy(), so the kernel one is used. */
+static inline size_t
+klc_user_strlcpy(char *dest, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    
+    if (size != 0) {
+        size_t n = (len >= size) ? size - 1 : len;
+        memcpy(dest, src, n);
+        dest[n] = '\0';
+    }
+    return len;
+}
+
+#define strlcpy klc_user_strlcpy
+
+#endif /* KLC_USER_STRING_H_INCLUDED */
@@ -0,0 +1,12 @@
+/* version.h
+ * The kernel version the user-space build imitates. Before 2.6.35, 
+ * klc_output.c defines its own seq_write().
+ */
+
+#ifndef KLC_USER_VERSION_H_INCLUDED
+#define KLC_USER_VERSION_H_INCLUDED
+
+#define KERNEL_VERSION(a_, b_, c_) (((a_) << 16) + ((b_) << 8) + (c_))
+#define LINUX_VERSION_CODE KERNEL_VERSION(2, 6, 32)
+
+#endif /* KLC_USER_VERSION_H_INCLUDED */
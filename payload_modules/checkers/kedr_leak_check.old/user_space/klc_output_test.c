@@ -0,0 +1,619 @@
+/* klc_output_test.c
+ * Check of the iterators over the reports of kedr_leak_check
+ * (klc_output.c), built in user space with seq_read() that works as in
+ * the kernel (seq_file_user.c).
+ *
+ * The reports are read with read() requests of different sizes, so that
+ * seq_file calls start() again at the positions the iterator has
+ * remembered: after the buffer overflows (some stack traces do not fit
+ * into a page), when an element is copied to the user in parts and
+ * between the requests. The reports are also read after seeks forward
+ * and backward and after the records have been cleared while a file is
+ * open. The result must be the same as the report built by the test
+ * itself.
+ *
+ * Usage: klc_output_test
+ */
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "klc_output.h"
+#include "klc_report_format.h"
+
+/* Number of the groups of leaks and of the unallocated frees */
+#define TEST_NUM_GROUPS 40
+#define TEST_NUM_BAD_FREES 30
+
+/* The stack trace of this group is longer than a page */
+#define TEST_BIG_GROUP 7
+
+static const char *test_separator = "----------------------------------------";
+
+static unsigned long errors = 0;
+
+#define CHECK(cond_, ...)                                           \
+do {                                                                \
+    if (!(cond_)) {                                                 \
+        printf("FAIL: " __VA_ARGS__);                               \
+        printf("\n");                                               \
+        ++errors;                                                   \
+    }                                                               \
+} while (0)
+
+/* ================================================================ */
+/* Growing buffer for the expected and the actual contents of a file. */
+struct test_buf
+{
+    char *data;
+    size_t len;
+    size_t capacity;
+};
+
+static void
+test_buf_append(struct test_buf *b, const void *data, size_t len)
+{
+    if (b->len + len > b->capacity) {
+        b->capacity = (b->len + len) * 2;
+        b->data = realloc(b->data, b->capacity);
+        BUG_ON(b->data == NULL);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void
+test_buf_printf(struct test_buf *b, const char *fmt, ...)
+{
+    char line[256];
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    BUG_ON(len < 0 || (size_t)len >= sizeof(line));
+    test_buf_append(b, line, len);
+}
+
+static void
+test_buf_free(struct test_buf *b)
+{
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+/* ================================================================ */
+/* The records of the reports. The test owns the stack traces, the
+ * records of the blocks are passed to klc_output.c. */
+
+static struct klc_stack *
+test_stack_create(unsigned int id, unsigned int num_entries,
+    unsigned int num_lines)
+{
+    struct klc_stack *stack;
+    struct test_buf symbols = { NULL, 0, 0 };
+    unsigned int i;
+
+    stack = calloc(1, sizeof(*stack) +
+        num_entries * sizeof(stack->entries[0]));
+    BUG_ON(stack == NULL);
+    INIT_LIST_HEAD(&stack->leaks);
+    INIT_LIST_HEAD(&stack->group_list);
+    stack->num_entries = num_entries;
+    for (i = 0; i < num_entries; ++i)
+        stack->entries[i] = 0xa0000000UL + id * 0x100 + i;
+
+    /* The resolved stack trace is set here, klc_output.c keeps it. */
+    if (num_entries != 0) {
+        for (i = 0; i < num_lines; ++i) {
+            test_buf_printf(&symbols, "[<%08lx>] test_func_%u+0x%x/0x200"
+                " [target]\n", 0xa0000000UL + id * 0x100 + i, id, i);
+        }
+        test_buf_append(&symbols, "", 1);
+        stack->symbols = symbols.data;
+    }
+    return stack;
+}
+
+static void
+test_stack_destroy(struct klc_stack *stack)
+{
+    free(stack->symbols);
+    free(stack);
+}
+
+static struct klc_memblock_info *
+test_mbi_create(const void *block, size_t size,
+    const struct klc_stack *stack)
+{
+    struct klc_memblock_info *mbi = klc_mbi_alloc();
+
+    BUG_ON(mbi == NULL);
+    mbi->block = block;
+    mbi->size = size;
+    mbi->stack = stack;
+    INIT_LIST_HEAD(&mbi->list);
+    return mbi;
+}
+
+static struct klc_stack *groups[TEST_NUM_GROUPS];
+static struct klc_stack *bad_free_stacks[4];
+static struct module target;
+
+/* Passes the leaks in 'num_groups' groups, the unallocated frees and
+ * the information about the target to klc_output.c. 'seed' makes the
+ * reports differ. */
+static void
+test_make_reports(unsigned int num_groups, unsigned int seed)
+{
+    LIST_HEAD(leaks);
+    LIST_HEAD(bad_frees);
+    unsigned int i;
+    unsigned int k;
+
+    for (i = 0; i < num_groups; ++i) {
+        struct klc_stack *stack = groups[i];
+        unsigned int num_leaks = 1 + (i + seed) % 5;
+
+        for (k = 0; k < num_leaks; ++k) {
+            size_t size = 16 + k + seed;
+            struct klc_memblock_info *mbi = test_mbi_create(
+                (const void *)(0x100000UL + i * 0x1000 + k * 0x40),
+                size, stack);
+            list_add_tail(&mbi->list, &stack->leaks);
+            ++stack->num_leaks;
+            stack->leaked_bytes += size;
+        }
+        list_add_tail(&stack->group_list, &leaks);
+    }
+    klc_print_leak_groups(&leaks);
+
+    for (i = 0; i < TEST_NUM_BAD_FREES + seed; ++i) {
+        struct klc_memblock_info *mbi = test_mbi_create(
+            (const void *)(0x200000UL + i * 0x80), (size_t)(-1),
+            (i % 5 == 4) ? NULL : bad_free_stacks[i % 4]);
+        list_add_tail(&mbi->list, &bad_frees);
+    }
+    klc_print_bad_frees(&bad_frees);
+
+    snprintf(target.name, sizeof(target.name), "target_%u", seed);
+    target.module_init = (void *)(0xb0000000UL + seed);
+    target.module_core = (void *)(0xb0100000UL + seed);
+    klc_print_target_module_info(&target);
+    klc_print_totals(1000 + seed, 100 + seed, TEST_NUM_BAD_FREES + seed);
+}
+/* ================================================================ */
+/* The reports as they should be. */
+
+static void
+expect_stack_text(struct test_buf *b, const struct klc_stack *stack)
+{
+    if (stack == NULL || stack->num_entries == 0) {
+        test_buf_printf(b, "(stack trace is not available)\n");
+        return;
+    }
+    test_buf_append(b, stack->symbols, strlen(stack->symbols));
+}
+
+static void
+expect_stack_entries(struct test_buf *b, const struct klc_stack *stack)
+{
+    unsigned int i;
+
+    if (stack == NULL)
+        return;
+    for (i = 0; i < stack->num_entries; ++i) {
+        __u64 entry = (__u64)stack->entries[i];
+        test_buf_append(b, &entry, sizeof(entry));
+    }
+}
+
+static unsigned int
+expect_num_entries(const struct klc_stack *stack)
+{
+    return (stack != NULL) ? stack->num_entries : 0;
+}
+
+static void
+expect_file_record(struct test_buf *b)
+{
+    struct klc_record_file rec;
+
+    rec.header.type = KLC_RECORD_FILE;
+    rec.header.size = sizeof(rec);
+    rec.magic = KLC_REPORT_MAGIC;
+    rec.version = KLC_REPORT_VERSION;
+    test_buf_append(b, &rec, sizeof(rec));
+}
+
+/* Offsets of the elements of the text report about possible leaks in
+ * the order of their positions; the element at position 0 is empty. */
+#define TEST_MAX_ELEMENTS (1 + TEST_NUM_GROUPS * 6)
+static size_t leaks_elements[TEST_MAX_ELEMENTS];
+static unsigned int leaks_num_elements;
+
+static void
+expect_leaks(struct test_buf *text, struct test_buf *bin,
+    unsigned int num_groups)
+{
+    unsigned int i;
+
+    leaks_num_elements = 0;
+    leaks_elements[leaks_num_elements++] = text->len;
+
+    expect_file_record(bin);
+    for (i = 0; i < num_groups; ++i) {
+        const struct klc_stack *stack = groups[i];
+        struct klc_record_leak_group grec;
+        struct klc_memblock_info *mbi;
+
+        BUG_ON(leaks_num_elements >= TEST_MAX_ELEMENTS);
+        leaks_elements[leaks_num_elements++] = text->len;
+        test_buf_printf(text, "Possible leaks: %lu, total size: %llu; "
+            "stack trace of the allocations:\n", stack->num_leaks,
+            (unsigned long long)stack->leaked_bytes);
+        expect_stack_text(text, stack);
+
+        memset(&grec, 0, sizeof(grec));
+        grec.header.type = KLC_RECORD_LEAK_GROUP;
+        grec.header.size = sizeof(grec) +
+            expect_num_entries(stack) * sizeof(__u64);
+        grec.num_leaks = stack->num_leaks;
+        grec.total_size = stack->leaked_bytes;
+        grec.num_entries = expect_num_entries(stack);
+        test_buf_append(bin, &grec, sizeof(grec));
+        expect_stack_entries(bin, stack);
+
+        list_for_each_entry(mbi, &stack->leaks, list) {
+            struct klc_record_leak rec;
+
+            BUG_ON(leaks_num_elements >= TEST_MAX_ELEMENTS);
+            leaks_elements[leaks_num_elements++] = text->len;
+            test_buf_printf(text, "Block at 0x%p, size: %zu\n",
+                mbi->block, mbi->size);
+
+            rec.header.type = KLC_RECORD_LEAK;
+            rec.header.size = sizeof(rec);
+            rec.block = (__u64)(unsigned long)mbi->block;
+            rec.size = mbi->size;
+            test_buf_append(bin, &rec, sizeof(rec));
+        }
+        test_buf_printf(text, "%s\n", test_separator);
+    }
+}
+
+static void
+expect_bad_frees(struct test_buf *text, struct test_buf *bin,
+    unsigned int seed)
+{
+    unsigned int i;
+
+    expect_file_record(bin);
+    for (i = 0; i < TEST_NUM_BAD_FREES + seed; ++i) {
+        const void *block = (const void *)(0x200000UL + i * 0x80);
+        const struct klc_stack *stack =
+            (i % 5 == 4) ? NULL : bad_free_stacks[i % 4];
+        struct klc_record_bad_free rec;
+
+        test_buf_printf(text,
+            "Block at 0x%p; stack trace of the deallocation:\n", block);
+        expect_stack_text(text, stack);
+        test_buf_printf(text, "%s\n", test_separator);
+
+        memset(&rec, 0, sizeof(rec));
+        rec.header.type = KLC_RECORD_BAD_FREE;
+        rec.header.size = sizeof(rec) +
+            expect_num_entries(stack) * sizeof(__u64);
+        rec.block = (__u64)(unsigned long)block;
+        rec.num_entries = expect_num_entries(stack);
+        test_buf_append(bin, &rec, sizeof(rec));
+        expect_stack_entries(bin, stack);
+    }
+}
+
+static void
+expect_info(struct test_buf *text, unsigned int seed)
+{
+    test_buf_printf(text, "Target module: \"%s\", "
+        "init area at 0x%p, core area at 0x%p\n",
+        target.name, target.module_init, target.module_core);
+    test_buf_printf(text, "Memory allocations: %llu\n",
+        (unsigned long long)(1000 + seed));
+    test_buf_printf(text, "Possible leaks: %llu\n",
+        (unsigned long long)(100 + seed));
+    test_buf_printf(text, "Unallocated frees: %llu\n",
+        (unsigned long long)(TEST_NUM_BAD_FREES + seed));
+}
+/* ================================================================ */
+/* Reading of the files. */
+
+struct test_file
+{
+    const struct file_operations *fops;
+    struct inode inode;
+    struct file file;
+};
+
+static void
+test_open(struct test_file *f, const char *name)
+{
+    struct dentry *dentry = debugfs_user_lookup(name);
+
+    BUG_ON(dentry == NULL || dentry->fops == NULL);
+    f->fops = dentry->fops;
+    f->inode.i_private = dentry->data;
+    memset(&f->file, 0, sizeof(f->file));
+    BUG_ON(f->fops->open(&f->inode, &f->file) != 0);
+}
+
+static void
+test_close(struct test_file *f)
+{
+    f->fops->release(&f->inode, &f->file);
+}
+
+/* Reads at most 'limit' bytes with the requests of 'chunk' bytes and
+ * appends them to 'b'. Stops at the end of file. */
+static void
+test_read(struct test_file *f, size_t chunk, size_t limit,
+    struct test_buf *b)
+{
+    char *buf = malloc(chunk);
+    size_t done = 0;
+
+    BUG_ON(buf == NULL);
+    while (done < limit) {
+        size_t n = (limit - done < chunk) ? limit - done : chunk;
+        ssize_t ret = f->fops->read(&f->file, buf, n, &f->file.f_pos);
+
+        BUG_ON(ret < 0);
+        if (ret == 0)
+            break;
+        test_buf_append(b, buf, ret);
+        done += ret;
+    }
+    free(buf);
+}
+
+static void
+test_check_content(const char *name, const char *what,
+    const struct test_buf *actual, const struct test_buf *expected,
+    size_t offset)
+{
+    size_t len = expected->len - offset;
+    size_t i;
+
+    if (actual->len == len &&
+        (len == 0 || memcmp(actual->data, expected->data + offset, len) == 0))
+        return;
+
+    for (i = 0; i < len && i < actual->len; ++i) {
+        if (actual->data[i] != expected->data[offset + i])
+            break;
+    }
+    CHECK(0, "%s, %s: %zu bytes read instead of %zu, "
+        "the first difference is at %zu", name, what, actual->len, len,
+        offset + i);
+}
+
+static const size_t test_chunks[] = {
+    1, 7, 64, 1000, 4095, 4096, 4097, 100000
+};
+
+/* The whole file is read with the requests of different sizes. */
+static void
+test_file_chunks(const char *name, const struct test_buf *expected)
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(test_chunks); ++i) {
+        struct test_file f;
+        struct test_buf actual = { NULL, 0, 0 };
+        char what[64];
+
+        test_open(&f, name);
+        test_read(&f, test_chunks[i], (size_t)-1, &actual);
+        test_close(&f);
+
+        snprintf(what, sizeof(what), "requests of %zu bytes",
+            test_chunks[i]);
+        test_check_content(name, what, &actual, expected, 0);
+        test_buf_free(&actual);
+    }
+}
+
+/* The file is read from the given offsets, reached by seeking forward
+ * from the beginning and backward after a part of the file is read. */
+static void
+test_file_seeks(const char *name, const struct test_buf *expected)
+{
+    size_t offsets[] = {
+        0, 1, 100, 4096, expected->len / 3, expected->len / 2,
+        expected->len - 1, expected->len
+    };
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(offsets); ++i) {
+        struct test_file f;
+        struct test_buf actual = { NULL, 0, 0 };
+        char what[64];
+        size_t offset = offsets[i];
+
+        if (offset > expected->len)
+            continue;
+
+        test_open(&f, name);
+        CHECK(f.fops->llseek(&f.file, offset, SEEK_SET) == (loff_t)offset,
+            "%s: cannot seek to %zu", name, offset);
+        test_read(&f, 777, (size_t)-1, &actual);
+        snprintf(what, sizeof(what), "after seek to %zu", offset);
+        test_check_content(name, what, &actual, expected, offset);
+        test_buf_free(&actual);
+
+        /* Read the rest of the file, then seek back. */
+        CHECK(f.fops->llseek(&f.file, offset, SEEK_SET) == (loff_t)offset,
+            "%s: cannot seek back to %zu", name, offset);
+        test_read(&f, 333, (size_t)-1, &actual);
+        snprintf(what, sizeof(what), "after seek back to %zu", offset);
+        test_check_content(name, what, &actual, expected, offset);
+        test_buf_free(&actual);
+        test_close(&f);
+    }
+}
+
+/* All the reports are read in different ways and compared with the
+ * expected ones. */
+static void
+test_all_files(unsigned int num_groups, unsigned int seed)
+{
+    struct test_buf leaks = { NULL, 0, 0 };
+    struct test_buf leaks_bin = { NULL, 0, 0 };
+    struct test_buf bad_frees = { NULL, 0, 0 };
+    struct test_buf bad_frees_bin = { NULL, 0, 0 };
+    struct test_buf info = { NULL, 0, 0 };
+
+    expect_leaks(&leaks, &leaks_bin, num_groups);
+    expect_bad_frees(&bad_frees, &bad_frees_bin, seed);
+    expect_info(&info, seed);
+
+    test_file_chunks("possible_leaks", &leaks);
+    test_file_chunks("possible_leaks_bin", &leaks_bin);
+    test_file_chunks("unallocated_frees", &bad_frees);
+    test_file_chunks("unallocated_frees_bin", &bad_frees_bin);
+    test_file_chunks("info", &info);
+
+    test_file_seeks("possible_leaks", &leaks);
+    test_file_seeks("possible_leaks_bin", &leaks_bin);
+    test_file_seeks("unallocated_frees", &bad_frees);
+    test_file_seeks("unallocated_frees_bin", &bad_frees_bin);
+
+    test_buf_free(&leaks);
+    test_buf_free(&leaks_bin);
+    test_buf_free(&bad_frees);
+    test_buf_free(&bad_frees_bin);
+    test_buf_free(&info);
+}
+
+/* The records are cleared and replaced while the file is being read.
+ * The iterator must notice that and continue from the same position in
+ * the new records rather than follow the freed ones. The data already
+ * in the buffer of seq_file is output first. */
+static void
+test_clear_while_reading(void)
+{
+    struct test_buf old = { NULL, 0, 0 };
+    struct test_buf expected = { NULL, 0, 0 };
+    struct test_buf unused = { NULL, 0, 0 };
+    struct test_buf actual = { NULL, 0, 0 };
+    struct test_file f;
+    struct seq_file *m;
+    size_t pending;
+    loff_t index;
+
+    expect_leaks(&old, &unused, TEST_NUM_GROUPS);
+    test_buf_free(&unused);
+
+    test_open(&f, "possible_leaks");
+    test_read(&f, 1000, 5000, &actual);
+    CHECK(actual.len == 5000, "possible_leaks: cannot read 5000 bytes");
+    test_buf_free(&actual);
+
+    /* Rest of the element, which has not been copied to the user yet,
+     * and the position of the next one */
+    m = (struct seq_file *)f.file.private_data;
+    pending = m->count;
+    index = m->index + ((pending != 0) ? 1 : 0);
+
+    klc_output_clear();
+    test_make_reports(TEST_NUM_GROUPS / 4, 1);
+
+    test_buf_append(&expected, old.data + 5000, pending);
+    expect_leaks(&expected, &unused, TEST_NUM_GROUPS / 4);
+    if (index < leaks_num_elements) {
+        size_t start = leaks_elements[index];
+        memmove(expected.data + pending, expected.data + start,
+            expected.len - start);
+        expected.len -= start - pending;
+    } else {
+        expected.len = pending;
+    }
+
+    test_read(&f, 1000, (size_t)-1, &actual);
+    test_check_content("possible_leaks", "after the records are cleared",
+        &actual, &expected, 0);
+    test_close(&f);
+
+    test_buf_free(&old);
+    test_buf_free(&actual);
+    test_buf_free(&expected);
+    test_buf_free(&unused);
+}
+
+/* Empty reports contain nothing but the file record in binary form. */
+static void
+test_empty_reports(void)
+{
+    struct test_buf empty = { NULL, 0, 0 };
+    struct test_buf file_record = { NULL, 0, 0 };
+
+    expect_file_record(&file_record);
+    test_file_chunks("possible_leaks", &empty);
+    test_file_chunks("possible_leaks_bin", &file_record);
+    test_file_chunks("unallocated_frees", &empty);
+    test_file_chunks("unallocated_frees_bin", &file_record);
+    test_file_chunks("info", &empty);
+    test_buf_free(&file_record);
+}
+/* ================================================================ */
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int i;
+
+    if (klc_mbi_pool_init() != 0 || klc_output_init() != 0) {
+        fprintf(stderr, "Failed to initialize the output\n");
+        return 1;
+    }
+
+    for (i = 0; i < TEST_NUM_GROUPS; ++i) {
+        if (i == TEST_BIG_GROUP)
+            groups[i] = test_stack_create(i, 16, 300);
+        else if (i % 10 == 3)
+            groups[i] = test_stack_create(i, 0, 0);
+        else
+            groups[i] = test_stack_create(i, 1 + i % 4, 1 + i % 4);
+    }
+    for (i = 0; i < ARRAY_SIZE(bad_free_stacks); ++i) {
+        bad_free_stacks[i] = test_stack_create(
+            TEST_NUM_GROUPS + i, 2 + i, 2 + i);
+    }
+
+    test_empty_reports();
+
+    test_make_reports(TEST_NUM_GROUPS, 0);
+    test_all_files(TEST_NUM_GROUPS, 0);
+
+    test_clear_while_reading();
+    test_all_files(TEST_NUM_GROUPS / 4, 1);
+
+    klc_output_fini();
+    klc_mbi_pool_fini();
+    for (i = 0; i < TEST_NUM_GROUPS; ++i)
+        test_stack_destroy(groups[i]);
+    for (i = 0; i < ARRAY_SIZE(bad_free_stacks); ++i)
+        test_stack_destroy(bad_free_stacks[i]);
+
+    if (errors != 0) {
+        printf("%lu checks failed.\n", errors);
+        return 1;
+    }
+    printf("All checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,90 @@
+/* klc_stubs.c
+ * User-space replacements for klc_output.c and kedr_stack_trace.c.
+ */
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+
+#include "kedr_stack_trace.h"
+#include "klc_output.h"
+#include "klc_stubs.h"
+
+unsigned long klc_stub_unfreed_allocs = 0;
+unsigned long klc_stub_leak_groups = 0;
+unsigned long klc_stub_unallocated_frees = 0;
+
+__thread unsigned long klc_stub_stack_tag = 0;
+
+u64 klc_stub_total_allocs = 0;
+u64 klc_stub_total_leaks = 0;
+u64 klc_stub_total_bad_frees = 0;
+
+void
+kedr_save_stack_trace_impl(unsigned long *entries, unsigned int max_entries,
+    unsigned int *nr_entries,
+    unsigned long first_entry)
+{
+    BUG_ON(max_entries == 0);
+    entries[0] = first_entry;
+    *nr_entries = 1;
+    if (max_entries > 1) {
+        entries[1] = klc_stub_stack_tag;
+        *nr_entries = 2;
+    }
+}
+
+/* The stubs check and count the records and then destroy them, as 
+ * klc_output_clear() would do. */
+void
+klc_print_leak_groups(struct list_head *groups)
+{
+    struct klc_stack *stack;
+    struct klc_stack *tmp_stack;
+    
+    list_for_each_entry_safe(stack, tmp_stack, groups, group_list) {
+        struct klc_memblock_info *mbi;
+        struct klc_memblock_info *tmp;
+        unsigned long num_leaks = 0;
+        u64 leaked_bytes = 0;
+        
+        list_for_each_entry_safe(mbi, tmp, &stack->leaks, list) {
+            BUG_ON(mbi->stack != stack);
+            BUG_ON(mbi->size == (size_t)(-1));
+            ++num_leaks;
+            leaked_bytes += mbi->size;
+            list_del(&mbi->list);
+            klc_memblock_info_destroy(mbi);
+        }
+        BUG_ON(num_leaks != stack->num_leaks || 
+            leaked_bytes != stack->leaked_bytes);
+        klc_stub_unfreed_allocs += num_leaks;
+        ++klc_stub_leak_groups;
+        
+        list_del_init(&stack->group_list);
+        stack->num_leaks = 0;
+        stack->leaked_bytes = 0;
+    }
+}
+
+void
+klc_print_bad_frees(struct list_head *bad_frees)
+{
+    struct klc_memblock_info *mbi;
+    struct klc_memblock_info *tmp;
+    
+    list_for_each_entry_safe(mbi, tmp, bad_frees, list) {
+        BUG_ON(mbi->size != (size_t)(-1));
+        ++klc_stub_unallocated_frees;
+        list_del(&mbi->list);
+        klc_memblock_info_destroy(mbi);
+    }
+}
+
+void
+klc_print_totals(u64 total_allocs, u64 total_leaks, u64 total_bad_frees)
+{
+    klc_stub_total_allocs = total_allocs;
+    klc_stub_total_leaks = total_leaks;
+    klc_stub_total_bad_frees = total_bad_frees;
+}
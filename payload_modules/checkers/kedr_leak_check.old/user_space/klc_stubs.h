@@ -0,0 +1,28 @@
+/* klc_stubs.h
+ * User-space replacements for the output and stack trace facilities of 
+ * kedr_leak_check. Instead of printing the reports, they count them, so 
+ * that the tests can check the results.
+ */
+
+#ifndef KLC_STUBS_H_INCLUDED
+#define KLC_STUBS_H_INCLUDED
+
+#include <linux/kernel.h>
+
+/* Number of reported possible leaks, their groups (by stack trace) and
+ * unallocated frees */
+extern unsigned long klc_stub_unfreed_allocs;
+extern unsigned long klc_stub_leak_groups;
+extern unsigned long klc_stub_unallocated_frees;
+
+/* If stack traces of depth 2 or more are requested, the second entry is 
+ * this value of the calling thread. So the tests may produce different 
+ * stack traces from the same place. */
+extern __thread unsigned long klc_stub_stack_tag;
+
+/* The values passed to the last call to klc_print_totals() */
+extern u64 klc_stub_total_allocs;
+extern u64 klc_stub_total_leaks;
+extern u64 klc_stub_total_bad_frees;
+
+#endif /* KLC_STUBS_H_INCLUDED */
@@ -0,0 +1,222 @@
+/* mbi_stress.c
+ * Multi-threaded stress test and benchmark for the storage of 
+ * allocation events (mbi_ops.c), built in user space.
+ *
+ * Each thread keeps its own set of live blocks. After the blocks are
+ * "allocated", each iteration "frees" a random live block, which must be
+ * found in the storage, and "allocates" a new one instead. Once in a 
+ * while a block that has never been allocated is freed, which must not be
+ * found. The allocations are made with STRESS_NUM_STACKS different
+ * stack traces. At the end, the reports and the totals are checked.
+ *
+ * Usage: mbi_stress [-t threads] [-l live_blocks] [-n iterations]
+ *   -t - number of threads (default: 4),
+ *   -l - total number of live blocks (default: 100000),
+ *   -n - number of iterations per thread (default: 1000000).
+ */
+
+#include <linux/kernel.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mbi_ops.h"
+#include "klc_stubs.h"
+
+/* Each BAD_FREE_PERIOD-th iteration also frees an unallocated block */
+#define BAD_FREE_PERIOD 1024
+
+/* The stubs store the call site and klc_stub_stack_tag as the stack */
+#define STRESS_STACK_DEPTH 2
+
+/* Number of different stack traces for the allocations */
+#define STRESS_NUM_STACKS 16
+
+struct stress_thread
+{
+    pthread_t thread;
+    unsigned int index;
+    
+    const void **blocks;
+    unsigned long num_blocks;
+    unsigned long iterations;
+    
+    /* The next block address to use */
+    unsigned long next_block;
+    
+    unsigned long bad_frees;
+    unsigned long errors;
+};
+
+static pthread_barrier_t start_barrier;
+
+/* Unique fake addresses: the thread index in the upper bits */
+static const void *
+stress_new_block(struct stress_thread *st)
+{
+    st->next_block += 16;
+    return (const void *)(((unsigned long)(st->index + 1) << 40) | 
+        st->next_block);
+}
+
+static void *
+stress_thread_func(void *data)
+{
+    struct stress_thread *st = data;
+    unsigned long seed = 0x2545f4914f6cdd1dUL * (st->index + 1);
+    unsigned long i;
+    
+    for (i = 0; i < st->num_blocks; ++i) {
+        klc_stub_stack_tag = i % STRESS_NUM_STACKS;
+        st->blocks[i] = stress_new_block(st);
+        klc_add_alloc(st->blocks[i], 32, STRESS_STACK_DEPTH);
+    }
+    
+    pthread_barrier_wait(&start_barrier);
+    
+    for (i = 0; i < st->iterations; ++i) {
+        unsigned long slot;
+        
+        /* xorshift */
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        slot = seed % st->num_blocks;
+        
+        if (!klc_find_and_remove_alloc(st->blocks[slot]))
+            ++st->errors;
+        st->blocks[slot] = stress_new_block(st);
+        klc_stub_stack_tag = i % STRESS_NUM_STACKS;
+        klc_add_alloc(st->blocks[slot], 32, STRESS_STACK_DEPTH);
+        
+        if (i % BAD_FREE_PERIOD == 0) {
+            const void *block = stress_new_block(st);
+            if (klc_find_and_remove_alloc(block))
+                ++st->errors;
+            klc_add_bad_free(block, STRESS_STACK_DEPTH);
+            ++st->bad_frees;
+        }
+    }
+    return NULL;
+}
+
+static double
+stress_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int num_threads = 4;
+    unsigned long live_blocks = 100000;
+    unsigned long iterations = 1000000;
+    unsigned long errors = 0, bad_frees = 0, live = 0;
+    u64 expected_allocs = 0;
+    struct stress_thread *threads;
+    unsigned int i;
+    double start, elapsed;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "t:l:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            num_threads = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            live_blocks = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            iterations = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, 
+        "Usage: %s [-t threads] [-l live_blocks] [-n iterations]\n", 
+                argv[0]);
+            return 2;
+        }
+    }
+    if (num_threads == 0 || num_threads > 1024 || 
+        live_blocks < num_threads) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 2;
+    }
+    
+    if (klc_storage_init() != 0) {
+        fprintf(stderr, "Failed to initialize the storage\n");
+        return 1;
+    }
+    
+    threads = calloc(num_threads, sizeof(*threads));
+    BUG_ON(threads == NULL);
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+    for (i = 0; i < num_threads; ++i) {
+        struct stress_thread *st = &threads[i];
+        st->index = i;
+        st->num_blocks = live_blocks / num_threads;
+        st->iterations = iterations;
+        st->blocks = calloc(st->num_blocks, sizeof(*st->blocks));
+        BUG_ON(st->blocks == NULL);
+        if (pthread_create(&st->thread, NULL, stress_thread_func, st) != 0) {
+            fprintf(stderr, "Failed to create a thread\n");
+            return 1;
+        }
+    }
+    
+    pthread_barrier_wait(&start_barrier);
+    start = stress_time();
+    for (i = 0; i < num_threads; ++i)
+        pthread_join(threads[i].thread, NULL);
+    elapsed = stress_time() - start;
+    
+    for (i = 0; i < num_threads; ++i) {
+        errors += threads[i].errors;
+        bad_frees += threads[i].bad_frees;
+        live += threads[i].num_blocks;
+        expected_allocs += threads[i].num_blocks + threads[i].iterations;
+        free(threads[i].blocks);
+    }
+    
+    printf("%u threads, %lu live blocks: %.0f free/alloc pairs per second\n",
+        num_threads, live, 
+        (double)iterations * num_threads / elapsed);
+    
+    klc_flush_allocs();
+    klc_flush_deallocs();
+    klc_flush_stats();
+    klc_storage_fini();
+    
+    if (errors != 0)
+        fprintf(stderr, "%lu lookups gave wrong results\n", errors);
+    if (klc_stub_unfreed_allocs != live || klc_stub_total_leaks != live)
+        fprintf(stderr, "Expected %lu possible leaks, reported %lu, "
+            "total %llu\n", live, klc_stub_unfreed_allocs, 
+            (unsigned long long)klc_stub_total_leaks);
+    if (klc_stub_unallocated_frees != bad_frees || 
+        klc_stub_total_bad_frees != bad_frees)
+        fprintf(stderr, "Expected %lu unallocated frees, reported %lu, "
+            "total %llu\n", bad_frees, klc_stub_unallocated_frees,
+            (unsigned long long)klc_stub_total_bad_frees);
+    /* Two call sites of klc_add_alloc() */
+    if (klc_stub_leak_groups > 2 * STRESS_NUM_STACKS)
+        fprintf(stderr, "Expected at most %d groups of leaks, "
+            "reported %lu\n", 2 * STRESS_NUM_STACKS, klc_stub_leak_groups);
+    if (klc_stub_total_allocs != expected_allocs)
+        fprintf(stderr, "Expected %llu allocations, total %llu\n",
+            (unsigned long long)expected_allocs, 
+            (unsigned long long)klc_stub_total_allocs);
+    
+    if (errors != 0 || klc_stub_unfreed_allocs != live || 
+        klc_stub_total_leaks != live || 
+        klc_stub_unallocated_frees != bad_frees ||
+        klc_stub_total_bad_frees != bad_frees || 
+        klc_stub_leak_groups > 2 * STRESS_NUM_STACKS || 
+        klc_stub_total_allocs != expected_allocs)
+        return 1;
+    return 0;
+}
@@ -0,0 +1,435 @@
+/* seq_file_user.c
+ * seq_file and debugfs for user space.
+ *
+ * seq_read() and seq_lseek() follow fs/seq_file.c of the kernel 2.6.32,
+ * so the iterators see the same sequence of start()/next()/stop() calls
+ * as in the kernel: start() is called again with the position of the
+ * element that did not fit into the buffer (the buffer is then doubled)
+ * or that was not copied to the user completely, and the file is
+ * traversed from the beginning on seek.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <stdarg.h>
+
+#define PAGE_SIZE 4096
+
+/* ================================================================ */
+int
+seq_open(struct file *file, const struct seq_operations *op)
+{
+    struct seq_file *p = kzalloc(sizeof(*p), GFP_KERNEL);
+
+    if (p == NULL)
+        return -ENOMEM;
+    mutex_init(&p->lock);
+    p->op = op;
+    file->private_data = p;
+    file->f_pos = 0;
+    return 0;
+}
+
+int
+seq_open_private(struct file *file, const struct seq_operations *op,
+    int psize)
+{
+    void *private = kzalloc(psize, GFP_KERNEL);
+    int ret;
+
+    if (private == NULL)
+        return -ENOMEM;
+    ret = seq_open(file, op);
+    if (ret != 0) {
+        kfree(private);
+        return ret;
+    }
+    ((struct seq_file *)file->private_data)->private = private;
+    return 0;
+}
+
+int
+seq_release(struct inode *inode, struct file *file)
+{
+    struct seq_file *m = file->private_data;
+
+    kfree(m->buf);
+    kfree(m);
+    return 0;
+}
+
+int
+seq_release_private(struct inode *inode, struct file *file)
+{
+    struct seq_file *m = file->private_data;
+
+    kfree(m->private);
+    return seq_release(inode, file);
+}
+
+/* Fills the buffer up to the element containing 'offset' and skips the
+ * data before 'offset'. Returns -EAGAIN if the buffer has been enlarged
+ * and the traversal should be repeated. */
+static int
+traverse(struct seq_file *m, loff_t offset)
+{
+    loff_t pos = 0;
+    loff_t index = 0;
+    int error = 0;
+    void *p;
+
+    m->count = m->from = 0;
+    if (offset == 0) {
+        m->index = index;
+        return 0;
+    }
+    if (m->buf == NULL) {
+        m->buf = kmalloc(m->size = PAGE_SIZE, GFP_KERNEL);
+        if (m->buf == NULL)
+            return -ENOMEM;
+    }
+    p = m->op->start(m, &index);
+    while (p != NULL) {
+        error = m->op->show(m, p);
+        if (error < 0)
+            break;
+        if (error != 0) {
+            error = 0;
+            m->count = 0;
+        }
+        if (m->count == m->size)
+            goto overflow;
+        if (pos + (loff_t)m->count > offset) {
+            m->from = offset - pos;
+            m->count -= m->from;
+            m->index = index;
+            break;
+        }
+        pos += m->count;
+        m->count = 0;
+        if (pos == offset) {
+            index++;
+            m->index = index;
+            break;
+        }
+        p = m->op->next(m, p, &index);
+    }
+    m->op->stop(m, p);
+    m->index = index;
+    return error;
+
+overflow:
+    m->op->stop(m, p);
+    kfree(m->buf);
+    m->buf = kmalloc(m->size <<= 1, GFP_KERNEL);
+    return (m->buf == NULL) ? -ENOMEM : -EAGAIN;
+}
+
+ssize_t
+seq_read(struct file *file, char *buf, size_t size, loff_t *ppos)
+{
+    struct seq_file *m = file->private_data;
+    size_t copied = 0;
+    loff_t pos;
+    size_t n;
+    void *p;
+    int err = 0;
+
+    mutex_lock(&m->lock);
+
+    /* Don't assume *ppos is where we left it */
+    if (*ppos != m->read_pos) {
+        m->read_pos = *ppos;
+        while ((err = traverse(m, *ppos)) == -EAGAIN)
+            ;
+        if (err != 0) {
+            m->read_pos = 0;
+            m->index = 0;
+            m->count = 0;
+            goto done;
+        }
+    }
+
+    if (m->buf == NULL) {
+        m->buf = kmalloc(m->size = PAGE_SIZE, GFP_KERNEL);
+        if (m->buf == NULL)
+            goto enomem;
+    }
+    /* If not empty - flush it first */
+    if (m->count != 0) {
+        n = (m->count < size) ? m->count : size;
+        memcpy(buf, m->buf + m->from, n);
+        m->count -= n;
+        m->from += n;
+        size -= n;
+        buf += n;
+        copied += n;
+        if (m->count == 0)
+            m->index++;
+        if (size == 0)
+            goto done;
+    }
+    /* We need at least one record in buffer */
+    pos = m->index;
+    p = m->op->start(m, &pos);
+    while (1) {
+        err = 0;
+        if (p == NULL)
+            break;
+        err = m->op->show(m, p);
+        if (err < 0)
+            break;
+        if (err != 0)
+            m->count = 0;
+        if (m->count == 0) {
+            p = m->op->next(m, p, &pos);
+            m->index = pos;
+            continue;
+        }
+        if (m->count < m->size)
+            goto fill;
+        m->op->stop(m, p);
+        kfree(m->buf);
+        m->buf = kmalloc(m->size <<= 1, GFP_KERNEL);
+        if (m->buf == NULL)
+            goto enomem;
+        m->count = 0;
+        pos = m->index;
+        p = m->op->start(m, &pos);
+    }
+    m->op->stop(m, p);
+    m->count = 0;
+    goto done;
+
+fill:
+    /* They want more? Let's try to get some more */
+    while (m->count < size) {
+        size_t offs = m->count;
+        loff_t next = pos;
+
+        p = m->op->next(m, p, &next);
+        if (p == NULL) {
+            err = 0;
+            break;
+        }
+        err = m->op->show(m, p);
+        if (m->count == m->size || err != 0) {
+            m->count = offs;
+            if (err <= 0)
+                break;
+        }
+        pos = next;
+    }
+    m->op->stop(m, p);
+    n = (m->count < size) ? m->count : size;
+    memcpy(buf, m->buf, n);
+    copied += n;
+    m->count -= n;
+    if (m->count != 0)
+        m->from = n;
+    else
+        pos++;
+    m->index = pos;
+
+done:
+    if (copied == 0) {
+        copied = err;
+    } else {
+        *ppos += copied;
+        m->read_pos += copied;
+    }
+    mutex_unlock(&m->lock);
+    return copied;
+
+enomem:
+    err = -ENOMEM;
+    goto done;
+}
+
+loff_t
+seq_lseek(struct file *file, loff_t offset, int origin)
+{
+    struct seq_file *m = file->private_data;
+    loff_t retval = -EINVAL;
+
+    mutex_lock(&m->lock);
+    if (origin == SEEK_CUR)
+        offset += file->f_pos;
+    if (origin == SEEK_SET || origin == SEEK_CUR) {
+        if (offset >= 0) {
+            if (offset != m->read_pos) {
+                while ((retval = traverse(m, offset)) == -EAGAIN)
+                    ;
+                if (retval != 0) {
+                    /* With extreme prejudice... */
+                    file->f_pos = 0;
+                    m->read_pos = 0;
+                    m->index = 0;
+                    m->count = 0;
+                } else {
+                    m->read_pos = offset;
+                    retval = file->f_pos = offset;
+                }
+            } else {
+                retval = file->f_pos = offset;
+            }
+        }
+    }
+    mutex_unlock(&m->lock);
+    return retval;
+}
+
+int
+seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+    va_list args;
+    int len;
+
+    if (m->count < m->size) {
+        va_start(args, fmt);
+        len = vsnprintf(m->buf + m->count, m->size - m->count, fmt, args);
+        va_end(args);
+        if (len >= 0 && (size_t)len < m->size - m->count) {
+            m->count += len;
+            return 0;
+        }
+    }
+    m->count = m->size;
+    return -1;
+}
+
+int
+seq_puts(struct seq_file *m, const char *s)
+{
+    size_t len = strlen(s);
+
+    if (m->count + len < m->size) {
+        memcpy(m->buf + m->count, s, len);
+        m->count += len;
+        return 0;
+    }
+    m->count = m->size;
+    return -1;
+}
+/* ================================================================ */
+
+/* single_open(): the whole file is output by one show() call. */
+static void *
+single_start(struct seq_file *m, loff_t *pos)
+{
+    return (*pos == 0) ? SEQ_START_TOKEN : NULL;
+}
+
+static void *
+single_next(struct seq_file *m, void *v, loff_t *pos)
+{
+    ++*pos;
+    return NULL;
+}
+
+static void
+single_stop(struct seq_file *m, void *v)
+{
+}
+
+/* The operations are allocated for each file because 'show' differs. */
+int
+single_open(struct file *file, int (*show)(struct seq_file *, void *),
+    void *data)
+{
+    struct seq_operations *op = kmalloc(sizeof(*op), GFP_KERNEL);
+    int ret;
+
+    if (op == NULL)
+        return -ENOMEM;
+    op->start = single_start;
+    op->next = single_next;
+    op->stop = single_stop;
+    op->show = show;
+    ret = seq_open(file, op);
+    if (ret != 0) {
+        kfree(op);
+        return ret;
+    }
+    ((struct seq_file *)file->private_data)->private = data;
+    return 0;
+}
+
+int
+single_release(struct inode *inode, struct file *file)
+{
+    const struct seq_operations *op =
+        ((struct seq_file *)file->private_data)->op;
+    int ret = seq_release(inode, file);
+
+    kfree(op);
+    return ret;
+}
+/* ================================================================ */
+
+/* All the files and directories created so far. */
+static struct dentry *debugfs_entries = NULL;
+
+static struct dentry *
+debugfs_create(const char *name, struct dentry *parent, void *data,
+    const struct file_operations *fops)
+{
+    struct dentry *dentry = kzalloc(sizeof(*dentry), GFP_KERNEL);
+
+    if (dentry == NULL)
+        return NULL;
+    dentry->name = name;
+    dentry->parent = parent;
+    dentry->data = data;
+    dentry->fops = fops;
+    dentry->next = debugfs_entries;
+    debugfs_entries = dentry;
+    return dentry;
+}
+
+struct dentry *
+debugfs_create_dir(const char *name, struct dentry *parent)
+{
+    return debugfs_create(name, parent, NULL, NULL);
+}
+
+struct dentry *
+debugfs_create_file(const char *name, mode_t mode, struct dentry *parent,
+    void *data, const struct file_operations *fops)
+{
+    return debugfs_create(name, parent, data, fops);
+}
+
+void
+debugfs_remove(struct dentry *dentry)
+{
+    struct dentry **pnext;
+
+    for (pnext = &debugfs_entries; *pnext != NULL;
+        pnext = &(*pnext)->next) {
+        if (*pnext == dentry) {
+            *pnext = dentry->next;
+            kfree(dentry);
+            return;
+        }
+    }
+}
+
+struct dentry *
+debugfs_user_lookup(const char *name)
+{
+    struct dentry *dentry;
+
+    for (dentry = debugfs_entries; dentry != NULL; dentry = dentry->next) {
+        if (strcmp(dentry->name, name) == 0)
+            return dentry;
+    }
+    return NULL;
+}
+/* ================================================================ */
@@ -0,0 +1,170 @@
+// A simple benchmark for MiST Engine.
+//
+// The data file is "scaled": the groups of values it contains are repeated
+// until the requested number of blocks is reached. The resulting document
+// is then generated several times and the time spent is reported.
+
+#include <sys/time.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstddef>
+#include <cstdlib>
+
+#include "ValueLoader.h"
+#include "TemplateLoader.h"
+#include "Generator.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////
+// Common data
+const string appName = "mist_gen_bench";
+
+// Default number of blocks in the generated document
+const size_t defaultBlocks = 10000;
+
+// Default number of times the document is generated
+const size_t defaultRuns = 5;
+
+///////////////////////////////////////////////////////////////////////
+// Output information about the usage of the tool
+static void
+usage();
+
+// Current time in seconds
+static double
+currentTime();
+
+// Repeat the groups of values (except the global one, #0) until there are
+// 'nblocks' of them. The names of the functions are made unique.
+static void
+scaleGroups(const CValueLoader::ValueGroups & src, size_t nblocks,
+    CValueLoader::ValueGroups & dest);
+
+///////////////////////////////////////////////////////////////////////
+int
+main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage();
+        return EXIT_SUCCESS;
+    }
+    string templatePath = argv[1];
+    string dataFile = argv[2];
+    size_t nblocks = (argc > 3) ? (size_t)atol(argv[3]) : defaultBlocks;
+    size_t nruns = (argc > 4) ? (size_t)atol(argv[4]) : defaultRuns;
+
+    if (nblocks == 0 || nruns == 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        CValueLoader valueLoader;
+        valueLoader.loadValues(dataFile);
+
+        CTemplateLoader templateLoader;
+        templateLoader.loadValues(templatePath);
+
+        CValueLoader::ValueGroups groups;
+        scaleGroups(valueLoader.getValueGroups(), nblocks, groups);
+
+        double best = 0.0;
+        double total = 0.0;
+        size_t length = 0;
+
+        for (size_t i = 0; i < nruns; ++i) {
+            string document;
+            CGenerator generator;
+
+            double start = currentTime();
+            generator.generateDocument(groups,
+                templateLoader.getDocumentGroup(),
+                templateLoader.getBlockGroup(),
+                document);
+            double elapsed = currentTime() - start;
+
+            if (i == 0 || elapsed < best) {
+                best = elapsed;
+            }
+            total += elapsed;
+            length = document.length();
+        }
+
+        cout << "blocks: " << nblocks
+             << ", document size: " << length << " bytes" << endl;
+        cout << fixed << setprecision(3)
+             << "runs: " << nruns
+             << ", best: " << best << " s"
+             << ", average: " << total / nruns << " s" << endl;
+    }
+    catch (bad_alloc& e) {
+        cerr << "Error: not enough memory" << endl;
+        return EXIT_FAILURE;
+    }
+    catch (CValueLoader::CLoadingError& e) {
+        cerr << "Failed to load " << dataFile << ": " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    catch (CTemplateLoader::CLoadingError& e) {
+        cerr << "Failed to load templates from " << templatePath
+             << ": " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << "Error: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////
+static void
+usage()
+{
+    cout << "Usage: " << appName << " "
+         << "<template directory> "
+         << "<data file> "
+         << "[<number of blocks> [<number of runs>]]" << endl;
+    cout << "Default number of blocks is " << defaultBlocks
+         << ", default number of runs is " << defaultRuns << "." << endl;
+    return;
+}
+
+static double
+currentTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void
+scaleGroups(const CValueLoader::ValueGroups & src, size_t nblocks,
+    CValueLoader::ValueGroups & dest)
+{
+    if (src.size() < 2) {
+        throw runtime_error("the data file contains no groups");
+    }
+
+    dest.clear();
+    dest.reserve(nblocks + 1);
+    dest.push_back(src.at(0));
+
+    for (size_t i = 0; i < nblocks; ++i) {
+        ValueList group = src.at(1 + i % (src.size() - 1));
+
+        ostringstream suffix;
+        suffix << "_" << i;
+        for (ValueList::iterator v = group.begin(); v != group.end(); ++v) {
+            if (v->name == "function.name") {
+                v->value += suffix.str();
+            }
+        }
+        dest.push_back(group);
+    }
+    return;
+}
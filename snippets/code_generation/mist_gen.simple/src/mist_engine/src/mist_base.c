@@ -122,8 +122,44 @@ struct CMistTemplate_
     /// 0 otherwise.
     /// This is to avoid evaluation of the template when it is not necessary.
     int is_evaluated;
+    
+    /// Nonzero if the values of the template have been set or cleared 
+    /// explicitly since it was evaluated last time, 0 otherwise.
+    int is_modified;
+    
+    /// The values the template had when it was evaluated last time. They are
+    /// saved here when the values are cleared for the first time after the
+    /// evaluation and are used to check if the values have actually changed.
+    CGrowingArray old_vals;
+    
+    /// Number of the evaluation of the group (see 'generation' field of
+    /// CMistTemplateGroup) during which the values of the template were 
+    /// changed last time.
+    unsigned long changed_at;
+    
+    /// Number of the evaluation of the group during which the template was 
+    /// evaluated last time, 0 if it has never been evaluated.
+    /// If none of the templates this one depends on has changed since then,
+    /// its values are still valid and need not be constructed again.
+    unsigned long computed_at;
 };
 
+/// A growable character buffer. The values of the templates are constructed
+/// here during the evaluation, so there is no need to compute their lengths
+/// in advance.
+typedef struct CMistBuffer_
+{
+    /// The characters, NULL if nothing has been allocated yet.
+    char* data;
+    
+    /// Number of characters currently stored in the buffer.
+    size_t len;
+    
+    /// Number of characters the buffer can hold (not counting 
+    /// the terminating 0).
+    size_t cap;
+} CMistBuffer;
+
 /// A structure representing a group of templates. Placeholders are common
 /// only within such a group.
 /// Each template in the group must have a unique name.
@@ -134,6 +170,21 @@ struct CMistTemplateGroup_
 	
 	/// A pointer to the main (top-level) template.
 	CMistTemplate* main;
+	
+	/// Hash table of the templates contained in 'tpl' (open addressing, 
+	/// linear probing), used to lookup templates by name. The number of 
+	/// slots is a power of 2 greater than twice the number of templates, 
+	/// the unused slots are NULL.
+	CMistTemplate** index;
+	size_t index_size;
+	
+	/// The buffer used when evaluating the templates of the group.
+	CMistBuffer buf;
+	
+	/// Number of the current (or the last) evaluation of the group. 
+	/// The values of the templates are constructed again during an 
+	/// evaluation only if something they depend on has changed.
+	unsigned long generation;
 };
 
 /// Token types (see CMistToken below).
@@ -174,6 +225,12 @@ typedef struct CMistToken_
 // Private variables
 ///////////////////////////////////////////////////////////////////////////
 
+// Initial capacity of the buffer used for evaluation
+#define MIST_BUFFER_MIN_CAPACITY 256
+
+// Minimal number of slots in the hash table of templates
+#define MIST_INDEX_MIN_SIZE 16
+
 // Whitespace chars
 static const char wspace[] = " \t\n\r";
 static size_t sz_wspace = sizeof(wspace) / sizeof(wspace[0]) - 1;
@@ -246,27 +303,24 @@ mist_placeholder_create(const char* name, const char* separator);
 static void
 mist_placeholder_destroy(CMistPlaceholder* ph);
 
-/// Return the the number of characters in the value(s) in this placeholder 
-/// after the evaluation of the templates and possibly joining.
+/// Append the value #i of the placeholder to the buffer. If there are 
+/// less than i + 1 values, the last one is appended. If the placeholder has 
+/// 'join' directive, all its values are appended with the separator in 
+/// between instead.
+/// If there are no values in 'ph', the function does nothing as if there were
+/// an empty string there.
 /// The template referred to by this placeholder must be evaluated before
 /// calling this function.
-static size_t
-mist_placeholder_max_length(CMistPlaceholder* ph);
-
-/// Join the values corresponding to the placeholder with appropriate separator
-/// in between and place the result to the specified buffer 'buf'. The buffer
-/// must provide enough space to contain the resulting character sequence.
-/// Symbol '\0' may not be appended to the sequence.
-/// The function returns a pointer to the position in the buffer right after
-/// the last written character.
-/// Don't call this function for placeholders with type other than MPH_JOIN.
-static char* 
-mist_placeholder_join_values(const CMistPlaceholder* ph, char* buf);
-
-/// Evaluate the template(s) referenced by this placeholder. 
+/// Returns nonzero if successful, 0 if there is not enough memory.
+static int
+mist_placeholder_append_value(const CMistPlaceholder* ph, size_t i, 
+    CMistBuffer* buf);
+
+/// Evaluate the template(s) referenced by this placeholder during 
+/// the current evaluation of the group 'mtg'.
 /// The resulting values are stored as the values of 'ph->tpl'.
 static EMistErrorCode
-mist_placeholder_evaluate(CMistPlaceholder* ph);
+mist_placeholder_evaluate(CMistPlaceholder* ph, CMistTemplateGroup* mtg);
 
 ///////////////////////////////////////////////////////////////////////////
 // CMistTemplate
@@ -284,7 +338,8 @@ static void
 mist_template_destroy(CMistTemplate* mt);
 
 /// Clear the colection of values stored in the template and set is_evaluated 
-/// flag to 0. 
+/// flag to 0. If this is the first change of the values since the last
+/// evaluation, the old values are kept in 'old_vals'.
 /// The arrays of placeholders and string chunks remain unchanged.
 static void 
 mist_template_clear_values(CMistTemplate* mt);
@@ -313,10 +368,15 @@ mist_template_from_string(CMistTemplate** pmt, const char* name,
 static int
 mist_template_compare(const void* lhs, const void* rhs);
 
-/// Construct the value(s) of the template. All placeholders it contains
-/// should already have been connected to appropriate templates.
+/// Construct the value(s) of the template during the current evaluation of
+/// the group 'mtg'. All placeholders it contains should already have been 
+/// connected to appropriate templates.
+/// The values are constructed again only if the template has never been
+/// evaluated or some of the templates it depends on have changed since 
+/// then. Each value is constructed in the buffer of the group in a single 
+/// pass and then copied to the template.
 static EMistErrorCode
-mist_template_evaluate(CMistTemplate* mt);
+mist_template_evaluate(CMistTemplate* mt, CMistTemplateGroup* mtg);
 
 /// Return the number of values that the template will have after it is
 /// evaluated. All referenced templates must be evaluated before calling
@@ -324,11 +384,6 @@ mist_template_evaluate(CMistTemplate* mt);
 static size_t
 mist_template_num_values(CMistTemplate* mt);
 
-/// Return the number of characters that the longest of the values of the 
-/// template will have after evaluation.
-static size_t
-mist_template_max_length(CMistTemplate* mt);
-
 /// Break the string 'src' into a sequence of tokens ("lexical analysis"),
 /// return the sequence as an array of CMistToken* pointers.
 /// The function returns a pointer to this array if successful, NULL otherwise.
@@ -499,22 +554,35 @@ mist_token_destroy(CMistToken* token);
 ///////////////////////////////////////////////////////////////////////////
 // Other functions
 
-/// Copy 'str' to each of 'nvals' strings contained in 'pos' and add appropriate
-/// offsets to the elements of 'pos' for them to point right after the copied strings.
+/// Append 'len' characters from 'str' to the buffer enlarging it if 
+/// necessary. The characters in the buffer are always followed by '\0'.
+/// Returns nonzero if successful, 0 if there is not enough memory.
 /// [NB] This function is used by mist_template_evaluate().
-static void
-mist_copy_string(char** pos, size_t nvals, const char* str);
+static int
+mist_buffer_append(CMistBuffer* buf, const char* str, size_t len);
 
-/// Copy values of 'ph' to the appropriate strings contained in 'pos' (there are
-/// 'nvals' strings there) taking join into account and add appropriate
-/// offsets to the elements of 'pos' for them to point right after the copied strings.
-/// If there are less than 'nvals' values in 'ph' (but not zero), the last one is
-/// copied to the remaining strings.
-/// If there are no values in 'ph', the function does nothing as if there were
-/// an empty string there.
-/// [NB] This function is used by mist_template_evaluate().
+/// Free the strings contained in the array and make it empty.
 static void
-mist_copy_placeholder_values(char** pos, size_t nvals, const CMistPlaceholder* ph);
+mist_free_values(CGrowingArray* vals);
+
+/// Return nonzero if the arrays contain the same strings in the same order,
+/// 0 otherwise.
+static int
+mist_values_equal(const CGrowingArray* lhs, const CGrowingArray* rhs);
+
+/// Return a hash value for the name of a template (FNV-1a).
+static size_t
+mist_name_hash(const char* name);
+
+/// (Re)build the hash table of the templates contained in the group.
+static EMistErrorCode
+mist_tg_build_index(CMistTemplateGroup* mtg);
+
+/// Return the template with the given name from the group or NULL if there is
+/// no such template. The hash table must have been built before calling this
+/// function.
+static CMistTemplate*
+mist_tg_find_template(const CMistTemplateGroup* mtg, const char* name);
 
 #ifndef NDEBUG
 /// Return nonzero if [beg, end) is a valid range (neither 'beg' nor 'end' are
@@ -694,7 +762,20 @@ mist_template_create(const char* name)
         return NULL;
     }
     
+    if (grar_create(&(mt->old_vals)) == 0)    
+    {
+        grar_destroy(&(mt->ph));
+        grar_destroy(&(mt->sch));
+        grar_destroy(&(mt->vals));
+        free(mt->name);
+        free(mt);
+        return NULL;
+    }
+    
     mt->is_evaluated = 0;
+    mt->is_modified = 0;
+    mt->changed_at = 0;
+    mt->computed_at = 0;
     
     return mt;
 }
@@ -708,6 +789,7 @@ mist_template_destroy(CMistTemplate* mt)
     free(mt->name);
     
     grar_destroy_with_elements(&mt->vals, NULL, NULL);
+    grar_destroy_with_elements(&mt->old_vals, NULL, NULL);
     grar_destroy_with_elements(&mt->sch, NULL, NULL);
     grar_destroy_with_elements(&mt->ph, mist_placeholder_dtor, NULL);
     
@@ -721,14 +803,18 @@ mist_template_clear_values(CMistTemplate* mt)
 {
     assert(mt != NULL);
     
-    // free the values first then clear the array
-    size_t sz = grar_get_size(&(mt->vals));
-    char** strings = grar_get_c_array(&(mt->vals), char*);
-    for (size_t i = 0; i < sz; ++i)
+    if (!mt->is_modified)
     {
-        free(strings[i]);
+        // keep the values from the last evaluation to compare them with 
+        // the new ones later
+        assert(grar_get_size(&(mt->old_vals)) == 0);
+        grar_swap(&(mt->vals), &(mt->old_vals));
+        mt->is_modified = 1;
+    }
+    else
+    {
+        mist_free_values(&(mt->vals));
     }
-    grar_clear(&(mt->vals));
     
     mt->is_evaluated = 0;
     return;
@@ -752,6 +838,7 @@ mist_template_add_value(CMistTemplate* mt, const char* val)
         return MIST_OUT_OF_MEMORY;
     }
     
+    mt->is_modified = 1;
     return MIST_OK;
 }
 
@@ -1791,21 +1878,13 @@ mist_tg_connect_templates_for_template(CMistTemplateGroup* mtg, CMistTemplate* t
     assert(mtg != NULL);
     assert(tpl != NULL);
     
-    // a fake template - only to search for the templates with particular names
-    CMistTemplate comp;
-    CMistTemplate* pcomp = &comp;
-    
     size_t nph = grar_get_size(&(tpl->ph));
     CMistPlaceholder** phs = grar_get_c_array(&(tpl->ph), CMistPlaceholder*);
     
     for (size_t p = 0; p < nph; ++p) // for each placeholder in the template ...
     {
-        comp.name = phs[p]->name;
-        int ind = grar_find(&(mtg->tpl), &pcomp, mist_template_compare);
-        assert(ind != -1); // the template must have been present
-        
-        CMistTemplate* tpl = grar_get_element(&(mtg->tpl), CMistTemplate*, ind);
-        assert(tpl != NULL);
+        CMistTemplate* tpl = mist_tg_find_template(mtg, phs[p]->name);
+        assert(tpl != NULL); // the template must have been present
         
         if (phs[p]->type == MPH_COND)
         {
@@ -1830,9 +1909,10 @@ mist_tg_connect_templates_for_template(CMistTemplateGroup* mtg, CMistTemplate* t
 }
 
 static EMistErrorCode
-mist_template_evaluate(CMistTemplate* mt)
+mist_template_evaluate(CMistTemplate* mt, CMistTemplateGroup* mtg)
 {
     assert(mt != NULL);
+    assert(mtg != NULL);
     
     if (mt->is_evaluated)
     {
@@ -1860,6 +1940,17 @@ mist_template_evaluate(CMistTemplate* mt)
             }
         }
         
+        // The values may have been cleared and then set to the same ones, 
+        // the attribute is not considered changed in this case.
+        if (mt->computed_at == 0 || 
+            (mt->is_modified && !mist_values_equal(&(mt->vals), &(mt->old_vals))))
+        {
+            mt->changed_at = mtg->generation;
+        }
+        mist_free_values(&(mt->old_vals));
+        
+        mt->is_modified = 0;
+        mt->computed_at = mtg->generation;
         mt->is_evaluated = 1;
         return MIST_OK;
     }
@@ -1869,361 +1960,353 @@ mist_template_evaluate(CMistTemplate* mt)
     CMistPlaceholder** phs = grar_get_c_array(&(mt->ph), CMistPlaceholder*);
     assert(phs != NULL);
     
-    // clear old values
-    mist_template_clear_values(mt);
-
     // set 'evaluated' flag here to prevent infinite recursion below
     mt->is_evaluated = 1;
     
-    // the 1st pass: evaluate the placeholders (without joining values for now)
+    // evaluate the placeholders (without joining values for now) and check 
+    // if any of them has changed since the template was evaluated last time
+    int is_changed = (mt->computed_at == 0 || mt->is_modified);
     for (size_t p = 0; p < nph; ++p)
     {
         assert(phs[p] != NULL);
-        EMistErrorCode ec = mist_placeholder_evaluate(phs[p]);
+        EMistErrorCode ec = mist_placeholder_evaluate(phs[p], mtg);
         if (ec != MIST_OK)
         {
             return ec;
         }
+        
+        assert(phs[p]->tpl != NULL);
+        if (phs[p]->tpl->changed_at > mt->computed_at)
+        {
+            is_changed = 1;
+        }
     }
     
-    // find the number of values to be constructed and maximum length of a value
-    size_t nvals = mist_template_num_values(mt);
-    size_t max_len = mist_template_max_length(mt);
-    assert(nvals != 0);
-    
-    // create an array to store current positions in the values
-    char** pos = (char**)malloc(nvals * sizeof(char*));
-    if (pos == NULL)
+    if (!is_changed)
     {
-        return MIST_OUT_OF_MEMORY;
+        // the current values are still valid
+        mt->computed_at = mtg->generation;
+        return MIST_OK;
     }
     
+    // find the number of values to be constructed
+    size_t nvals = mist_template_num_values(mt);
+    assert(nvals != 0);
+    
     // a temporary storage for the values being created
     CGrowingArray tga;
     if (!grar_create(&tga))
     {
-        free(pos);
         return MIST_OUT_OF_MEMORY;
     }
     
-    // allocate memory for the values
+    CMistBuffer* buf = &(mtg->buf);
+    const char** schs = grar_get_c_array(&(mt->sch), const char*);
+    
+    // construct the values one by one: string chunk #0 (it must always exist),
+    // then the values of the placeholders and the remaining string chunks
     for (size_t i = 0; i < nvals; ++i)
     {
-        char* buf = (char*)malloc(max_len + 1);
-        if (buf == NULL)
+        buf->len = 0;
+        int ok = mist_buffer_append(buf, schs[0], strlen(schs[0]));
+        for (size_t p = 0; ok && p < nph; ++p)
         {
-            free(pos);
-            return MIST_OUT_OF_MEMORY;
+            ok = mist_placeholder_append_value(phs[p], i, buf) &&
+                mist_buffer_append(buf, schs[p + 1], strlen(schs[p + 1]));
         }
         
-        if (grar_add_element(&tga, buf) == 0)
+        char* val = NULL;
+        if (ok)
+        {
+            val = (char*)malloc(buf->len + 1);
+        }
+        
+        if (val == NULL)
         {
-            free(buf);
-            free(pos);
             grar_destroy_with_elements(&tga, NULL, NULL);
             return MIST_OUT_OF_MEMORY;
         }
+        memcpy(val, buf->data, buf->len + 1);
         
-        pos[i] = buf;
-    }
-    
-    // the 2nd pass: construct the values
-    const char** schs = grar_get_c_array(&(mt->sch), const char*);
-    
-    // first, append string chunk #0 (it must always exist)
-    mist_copy_string(pos, nvals, schs[0]);
-    
-    // append remaining string chunks and values of placeholders
-    for (size_t i = 0; i < nph; ++i)
-    {
-        mist_copy_placeholder_values(pos, nvals, phs[i]);
-        mist_copy_string(pos, nvals, schs[i + 1]);
-    }
-    
-    // append terminating 0s
-    for (size_t i = 0; i < nvals; ++i)
-    {
-        *(pos[i]) = '\0';
+        if (grar_add_element(&tga, val) == 0)
+        {
+            free(val);
+            grar_destroy_with_elements(&tga, NULL, NULL);
+            return MIST_OUT_OF_MEMORY;
+        }
     }
 
     // It is only now when mt->vals is updated, otherwise something bad would have
-    // happened above (where mist_copy_placeholder_values() is called) in case
+    // happened above (where mist_placeholder_append_value() is called) in case
     // of recursion in the templates.
-    grar_swap(&(mt->vals), &tga);
-    assert(grar_get_size(&tga) == 0);
+    // If the values turn out to be the same as before, the templates that 
+    // depend on this one need not be evaluated again.
+    if (mt->computed_at == 0 || mt->is_modified || 
+        !mist_values_equal(&(mt->vals), &tga))
+    {
+        grar_swap(&(mt->vals), &tga);
+        mt->changed_at = mtg->generation;
+    }
+    
+    grar_destroy_with_elements(&tga, NULL, NULL);
+    mist_free_values(&(mt->old_vals));
     
-    free(pos);
-    grar_destroy(&tga);
+    mt->is_modified = 0;
+    mt->computed_at = mtg->generation;
     return MIST_OK;
 }
 
 static EMistErrorCode
-mist_placeholder_evaluate(CMistPlaceholder* ph)
+mist_placeholder_evaluate(CMistPlaceholder* ph, CMistTemplateGroup* mtg)
 {
     assert(ph != NULL);
+    assert(mtg != NULL);
     assert(ph->tpl != NULL);
     
+    if (ph->type != MPH_COND)
+    {
+        // not a conditional, evaluate as usual
+        return mist_template_evaluate(ph->tpl, mtg);
+    }
+    
     // This template will contain the results of evaluation
     CMistTemplate* mt = ph->tpl;
     EMistErrorCode ec = MIST_OK;
     
-    if (ph->type == MPH_COND)
+    assert(ph->tpl_cond != NULL);
+    assert(ph->tpl_then != NULL);
+    assert(ph->tpl_else != NULL);
+    
+    // The branches are owned by the placeholder rather than by the group, 
+    // so the group does not reset their flags before evaluation.
+    ph->tpl_then->is_evaluated = 0;
+    ph->tpl_else->is_evaluated = 0;
+    
+    // evaluate the condition first
+    ec = mist_template_evaluate(ph->tpl_cond, mtg);
+    if (ec != MIST_OK)
     {
-        assert(ph->tpl_cond != NULL);
-        assert(ph->tpl_then != NULL);
-        assert(ph->tpl_else != NULL);
-        
-        mist_template_clear_values(mt);        
-        assert(grar_get_size(&(mt->vals)) == 0);
-        
-        mist_template_clear_values(ph->tpl_then);        
-        assert(grar_get_size(&(ph->tpl_then->vals)) == 0);
-        
-        mist_template_clear_values(ph->tpl_else);        
-        assert(grar_get_size(&(ph->tpl_else->vals)) == 0);
+        return ec;
+    }
+            
+    CGrowingArray* cond = &(ph->tpl_cond->vals);
+    assert(cond != NULL);
+    
+    // 'cond' now contains the values of the conditional expression
+    size_t c = 0; // index of the condition to be checked
+    size_t ncond = grar_get_size(cond);
+    assert(ncond >= 1);
+    
+    // the results must be constructed again if the condition or any of
+    // the chosen branches have changed
+    int is_changed = (mt->computed_at == 0 || 
+        ph->tpl_cond->changed_at > mt->computed_at);
+    
+    // a temporary storage for the values being created
+    CGrowingArray tga;
+    if (!grar_create(&tga))
+    {
+        return MIST_OUT_OF_MEMORY;
+    }
+    
+    if (ph->is_concat)
+    {
+        // check if the condition has at least one non-empty value
+        // and evaluate the corresponding branch
+        int cexpr = 0; 
+        for (c = 0; c < ncond; ++c)
+        {
+            assert(grar_get_element(cond, const char*, c) != NULL);
+            cexpr = (*grar_get_element(cond, const char*, c) != '\0');
+            
+            if (cexpr)
+            {
+                break;
+            }
+        }
         
-        // evaluate the condition first
-        ec = mist_template_evaluate(ph->tpl_cond);
+        CMistTemplate* branch = (cexpr) ? ph->tpl_then : ph->tpl_else;
+        ec = mist_template_evaluate(branch, mtg);
         if (ec != MIST_OK)
         {
+            grar_destroy(&tga);
             return ec;
         }
-                
-        CGrowingArray* cond = &(ph->tpl_cond->vals);
-        assert(cond != NULL);
-
-        // 'cond' now contains the values of the conditional expression
-        size_t c = 0; // index of the condition to be checked
-        size_t ncond = grar_get_size(cond);
-        assert(ncond >= 1);
         
-        if (ph->is_concat)
+        if (!is_changed && branch->changed_at <= mt->computed_at)
         {
-            // check if the condition has at least one non-empty value
-            // and evaluate the corresponding branch
-            int cexpr = 0; 
-            for (c = 0; c < ncond; ++c)
+            // the current values are still valid
+            grar_destroy(&tga);
+            mt->computed_at = mtg->generation;
+            mt->is_evaluated = 1;
+            return MIST_OK;
+        }
+        
+        size_t nvals = grar_get_size(&(branch->vals));
+        assert(nvals >= 1);
+        
+        // the resulting values are the same as in the chosen branch
+        for (size_t elem = 0; elem < nvals; ++elem)
+        {
+            assert(grar_get_element(&(branch->vals), const char*, elem) != NULL);
+            char* to_add = (char*)strdup(grar_get_element(&(branch->vals), const char*, elem));
+            if (to_add == NULL || 
+                grar_add_element(&tga, to_add) == 0)
             {
-                assert(grar_get_element(cond, const char*, c) != NULL);
-                cexpr = (*grar_get_element(cond, const char*, c) != '\0');
-                
-                if (cexpr)
-                {
-                    break;
-                }
+                free(to_add);
+                ec = MIST_OUT_OF_MEMORY;
+                break;
             }
-            
+        }
+    }
+    else // not a concat-expression
+    {   
+        // the 1st pass: determine which branches to evaluate
+        // and how many values they have
+        int cexpr = 0;
+        size_t ntotal = ncond;  // number of values to process (upper bound)
+        for (c = 0; c < ncond; ++c)
+        {
+            assert(grar_get_element(cond, const char*, c) != NULL);
+            cexpr = (*grar_get_element(cond, const char*, c) != '\0');
             CMistTemplate* branch = (cexpr) ? ph->tpl_then : ph->tpl_else;
-            ec = mist_template_evaluate(branch);
+            
+            // evaluate the selected branch (no-op if it has already been evaluated)
+            ec = mist_template_evaluate(branch, mtg);
             if (ec != MIST_OK)
             {
+                grar_destroy(&tga);
                 return ec;
             }
             
+            if (branch->changed_at > mt->computed_at)
+            {
+                is_changed = 1;
+            }
+            
+            size_t nvals = grar_get_size(&(branch->vals));
+            if (nvals > ntotal)
+            {
+                ntotal = nvals;
+            }
+        }
+        assert(ntotal >= 1);
+        
+        if (!is_changed)
+        {
+            // the current values are still valid
+            grar_destroy(&tga);
+            mt->computed_at = mtg->generation;
+            mt->is_evaluated = 1;
+            return MIST_OK;
+        }
+        
+        // the 2nd pass: determine the values of the conditional construct
+        assert(grar_get_element(cond, const char*, 0) != NULL);
+        cexpr = (*grar_get_element(cond, const char*, 0) != '\0');
+        
+        c = 0; // again, start with the first condition
+        for (size_t i = 0; i < ntotal; ++i) 
+        {
+            // select appropriate branch
+            CMistTemplate* branch = (cexpr) ? ph->tpl_then : ph->tpl_else;
+            assert(branch->is_evaluated);
+            
             size_t nvals = grar_get_size(&(branch->vals));
             assert(nvals >= 1);
             
-            // the resulting values are the same as in the chosen branch
-            for (size_t elem = 0; elem < nvals; ++elem)
+            // If there are no more values left in the chosen branch, use 
+            // the last one. There must be at least one value in the branch.
+            size_t elem = (i < nvals) ? i : (nvals - 1);
+            
+            // Copy the value #elem to the array of results
+            assert(grar_get_element(&(branch->vals), const char*, elem) != NULL);
+            char* to_add = (char*)strdup(grar_get_element(
+                &(branch->vals), const char*, elem));
+            if (to_add == NULL || 
+                grar_add_element(&tga, to_add) == 0)
             {
-                assert(grar_get_element(&(branch->vals), const char*, elem) != NULL);
-                char* to_add = (char*)strdup(grar_get_element(&(branch->vals), const char*, elem));
-                if (to_add == NULL || 
-                    grar_add_element(&(mt->vals), to_add) == 0)
-                {
-                    free(to_add);
-                    ec = MIST_OUT_OF_MEMORY;
-                    break;
-                }
+                free(to_add);
+                ec = MIST_OUT_OF_MEMORY;
+                break;
             }
-        }
-        else // not a concat-expression
-        {   
-            // the 1st pass: determine which branches to evaluate
-            // and how many values they have
-            int cexpr = 0;
-            size_t ntotal = ncond;  // number of values to process (upper bound)
-            for (c = 0; c < ncond; ++c)
+            
+            // if we have run out of conditions, we'll use the last one until the end
+            if (c + 1 < ncond)
             {
+                ++c;
                 assert(grar_get_element(cond, const char*, c) != NULL);
                 cexpr = (*grar_get_element(cond, const char*, c) != '\0');
-                CMistTemplate* branch = (cexpr) ? ph->tpl_then : ph->tpl_else;
-                
-                // evaluate the selected branch (no-op if it has already been evaluated)
-                ec = mist_template_evaluate(branch);
-                if (ec != MIST_OK)
-                {
-                    return ec;
-                }
-                
-                size_t nvals = grar_get_size(&(branch->vals));
-                if (nvals > ntotal)
-                {
-                    ntotal = nvals;
-                }
             }
-            assert(ntotal >= 1);
-            
-            // the 2nd pass: determine the values of the conditional construct
-            assert(grar_get_element(cond, const char*, 0) != NULL);
-            cexpr = (*grar_get_element(cond, const char*, 0) != '\0');
-            
-            c = 0; // again, start with the first condition
-            for (size_t i = 0; i < ntotal; ++i) 
-            {
-                // select appropriate branch
-                CMistTemplate* branch = (cexpr) ? ph->tpl_then : ph->tpl_else;
-                assert(branch->is_evaluated);
-                
-                size_t nvals = grar_get_size(&(branch->vals));
-                assert(nvals >= 1);
-                
-                // If there are no more values left in the chosen branch, use 
-                // the last one. There must be at least one value in the branch.
-                size_t elem = (i < nvals) ? i : (nvals - 1);
-                
-                // Copy the value #elem to the array of results
-                assert(grar_get_element(&(branch->vals), const char*, elem) != NULL);
-                char* to_add = (char*)strdup(grar_get_element(
-                    &(branch->vals), const char*, elem));
-                if (to_add == NULL || 
-                    grar_add_element(&(mt->vals), to_add) == 0)
-                {
-                    free(to_add);
-                    ec = MIST_OUT_OF_MEMORY;
-                    break;
-                }
-                
-                // if we have run out of conditions, we'll use the last one until the end
-                if (c + 1 < ncond)
-                {
-                    ++c;
-                    assert(grar_get_element(cond, const char*, c) != NULL);
-                    cexpr = (*grar_get_element(cond, const char*, c) != '\0');
-                }
-            } // end for
-        } // end if (ph->is_concat) ...
-        
-        if (ec == MIST_OK)
+        } // end for
+    } // end if (ph->is_concat) ...
+    
+    if (ec == MIST_OK)
+    {
+        if (mt->computed_at == 0 || !mist_values_equal(&(mt->vals), &tga))
         {
-            mt->is_evaluated = 1;
+            grar_swap(&(mt->vals), &tga);
+            mt->changed_at = mtg->generation;
         }
-    }
-    else // not a conditional, evaluate as usual
-    {
-        ec = mist_template_evaluate(mt);
+        mt->computed_at = mtg->generation;
+        mt->is_evaluated = 1;
     }
     
+    grar_destroy_with_elements(&tga, NULL, NULL);
     return ec;
 }
 
-static size_t
-mist_placeholder_max_length(CMistPlaceholder* ph)
+static int
+mist_placeholder_append_value(const CMistPlaceholder* ph, size_t i, 
+    CMistBuffer* buf)
 {
     assert(ph != NULL);
     assert(ph->tpl != NULL);
     assert(ph->tpl->is_evaluated);
+    assert(buf != NULL);
     
     size_t nvals = grar_get_size(&(ph->tpl->vals));
     if (nvals == 0)
     {
         // if there are no values, it is OK, just nothing to do here
-        return 0;
+        return 1;
     }
     
-    size_t len = 0;
-    if (ph->type == MPH_JOIN)
+    const char** vals = grar_get_c_array(&(ph->tpl->vals), const char*);
+    
+    if (ph->type != MPH_JOIN)
     {
-        assert(ph->sep != NULL);
+        // If there are no more values left, use the last one.
+        size_t elem = (i < nvals) ? i : (nvals - 1);
+        assert(vals[elem] != NULL);
         
-        // there will be join - compute the length of the resulting string
-        len = grar_string_total_length(&(ph->tpl->vals)) + (nvals - 1) * strlen(ph->sep);
-    }
-    else
-    {
-        // no join, so get the length of the longest value
-        const char** vals = grar_get_c_array(&(ph->tpl->vals), const char*);
-        for (size_t i = 0; i < nvals; ++i)
-        {
-            assert(vals[i] != NULL);
-            size_t cur_len = strlen(vals[i]);
-            
-            if (len < cur_len)
-            {
-                len = cur_len;
-            }
-        } // end for i
+        return mist_buffer_append(buf, vals[elem], strlen(vals[elem]));
     }
     
-    return len; 
-}
-
-static char* 
-mist_placeholder_join_values(const CMistPlaceholder* ph, char* buf)
-{
-    assert(ph != NULL);
-    assert(ph->tpl != NULL);
-    assert(ph->type == MPH_JOIN);
     assert(ph->sep != NULL);
-    assert(buf != NULL);
     assert(ph->is_concat == 0);
     
-    size_t nvals = grar_get_size(&(ph->tpl->vals));
-    if (nvals == 0)
-    {
-        // there are no values, nothing to do here
-        return buf;
-    }
-    
-    // there is at least one value
-    const char** vals = grar_get_c_array(&(ph->tpl->vals), const char*);
-    assert(vals[0] != NULL);
     size_t sep_len = strlen(ph->sep);
     
-    size_t len = strlen(vals[0]);
-    if (len != 0)
+    assert(vals[0] != NULL);
+    if (!mist_buffer_append(buf, vals[0], strlen(vals[0])))
     {
-        strncpy(buf, vals[0], len);
-        buf += len;
+        return 0;
     }
     
-    for (size_t i = 1; i < nvals; ++i)
+    for (size_t k = 1; k < nvals; ++k)
     {
-        assert(vals[i] != NULL);
-        len = strlen(vals[i]);
+        assert(vals[k] != NULL);
         
         // append separator and then the next value
-        if (sep_len != 0)
+        if (!mist_buffer_append(buf, ph->sep, sep_len) ||
+            !mist_buffer_append(buf, vals[k], strlen(vals[k])))
         {
-            strncpy(buf, ph->sep, sep_len);
-            buf += sep_len;
-        }
-        
-        if (len != 0)
-        {
-            strncpy(buf, vals[i], len);
-            buf += len;
+            return 0;
         }
     }
     
-    return buf; 
-}
-
-static size_t
-mist_template_max_length(CMistTemplate* mt)
-{
-    assert(mt != NULL);
-    
-    size_t len = grar_string_total_length(&(mt->sch));
-    size_t nph = grar_get_size(&(mt->ph));
-    CMistPlaceholder** phs = grar_get_c_array(&(mt->ph), CMistPlaceholder*);
-    
-    for (size_t i = 0; i < nph; ++i)
-    {
-        assert(phs[i] != NULL);
-        len += mist_placeholder_max_length(phs[i]);
-    }
-    return len; 
+    return 1; 
 }
 
 static size_t
@@ -2257,90 +2340,156 @@ mist_template_num_values(CMistTemplate* mt)
     return num; 
 }
 
-static void
-mist_copy_string(char** pos, size_t nvals, const char* str)
+static int
+mist_buffer_append(CMistBuffer* buf, const char* str, size_t len)
 {
-    assert(pos != NULL);
-    assert(nvals != 0);
+    assert(buf != NULL);
     assert(str != NULL);
     
-    size_t len = strlen(str);
-    if (len > 0)
+    if (buf->data == NULL || buf->len + len > buf->cap)
     {
-        for (size_t i = 0; i < nvals; ++i)
+        size_t new_cap = (buf->cap != 0) ? buf->cap : MIST_BUFFER_MIN_CAPACITY;
+        while (new_cap < buf->len + len)
         {
-            assert(pos[i] != NULL);
-            strncpy(pos[i], str, len);
-            pos[i] += len;
+            new_cap *= 2;
         }
+        
+        char* new_data = (char*)realloc(buf->data, new_cap + 1);
+        if (new_data == NULL)
+        {
+            return 0;
+        }
+        buf->data = new_data;
+        buf->cap = new_cap;
     }
-    return;
+    
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    
+    return 1;
 }
 
 static void
-mist_copy_placeholder_values(char** pos, size_t nvals, const CMistPlaceholder* ph)
+mist_free_values(CGrowingArray* vals)
 {
-    assert(pos != NULL);
-    assert(nvals != 0);
-    assert(ph != NULL);
-    assert(ph->tpl != NULL);
+    assert(vals != NULL);
     
-    size_t pvals = grar_get_size(&(ph->tpl->vals));
-    if (pvals == 0)
+    size_t sz = grar_get_size(vals);
+    char** strings = grar_get_c_array(vals, char*);
+    for (size_t i = 0; i < sz; ++i)
     {
-        return;
+        free(strings[i]);
     }
+    grar_clear(vals);
     
-    if (ph->type == MPH_JOIN)
+    return;
+}
+
+static int
+mist_values_equal(const CGrowingArray* lhs, const CGrowingArray* rhs)
+{
+    assert(lhs != NULL);
+    assert(rhs != NULL);
+    
+    size_t sz = grar_get_size(lhs);
+    if (sz != grar_get_size(rhs))
     {
-        assert(pos[0] != NULL);
+        return 0;
+    }
+    
+    const char** lvals = grar_get_c_array(lhs, const char*);
+    const char** rvals = grar_get_c_array(rhs, const char*);
+    for (size_t i = 0; i < sz; ++i)
+    {
+        assert(lvals[i] != NULL);
+        assert(rvals[i] != NULL);
         
-        char* tpos = mist_placeholder_join_values(ph, pos[0]);
-        size_t len = tpos - pos[0];
-        if (len > 0)
+        if (strcmp(lvals[i], rvals[i]) != 0)
         {
-            for (size_t i = 1; i < nvals; ++i)
-            {
-                assert(pos[i] != NULL);
-                strncpy(pos[i], pos[0], len);
-                pos[i] += len;
-            }
+            return 0;
         }
-        pos[0] = tpos;
     }
-    else // no join
+    
+    return 1;
+}
+
+static size_t
+mist_name_hash(const char* name)
+{
+    assert(name != NULL);
+    
+    unsigned int h = 2166136261u;
+    for (; *name != '\0'; ++name)
+    {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    
+    return (size_t)h;
+}
+
+static EMistErrorCode
+mist_tg_build_index(CMistTemplateGroup* mtg)
+{
+    assert(mtg != NULL);
+    
+    size_t num = grar_get_size(&(mtg->tpl));
+    CMistTemplate** tpl = grar_get_c_array(&(mtg->tpl), CMistTemplate*);
+    
+    // keep the load factor below 1/2
+    size_t size = MIST_INDEX_MIN_SIZE;
+    while (size < 2 * num)
+    {
+        size *= 2;
+    }
+    
+    CMistTemplate** index = (CMistTemplate**)calloc(size, sizeof(CMistTemplate*));
+    if (index == NULL)
+    {
+        return MIST_OUT_OF_MEMORY;
+    }
+    
+    for (size_t i = 0; i < num; ++i)
     {
-        assert(nvals >= pvals);
-        const char** vals = grar_get_c_array(&(ph->tpl->vals), const char*);
+        assert(tpl[i] != NULL);
         
-        size_t i;
-        size_t len = 0;
-        for (i = 0; i < pvals; ++i)
+        size_t pos = mist_name_hash(tpl[i]->name) & (size - 1);
+        while (index[pos] != NULL)
         {
-            assert(pos[i] != NULL);
-            assert(vals[i] != NULL);
-            
-            len = strlen(vals[i]);
-            if (len > 0)
-            {
-                strncpy(pos[i], vals[i], len);
-                pos[i] += len;
-            }
+            pos = (pos + 1) & (size - 1);
         }
-        
-        // use the last value for the remaining strings
-        if (len > 0)
+        index[pos] = tpl[i];
+    }
+    
+    free(mtg->index);
+    mtg->index = index;
+    mtg->index_size = size;
+    
+    return MIST_OK;
+}
+
+static CMistTemplate*
+mist_tg_find_template(const CMistTemplateGroup* mtg, const char* name)
+{
+    assert(mtg != NULL);
+    assert(mtg->index != NULL);
+    assert(name != NULL);
+    
+    size_t mask = mtg->index_size - 1;
+    size_t pos = mist_name_hash(name) & mask;
+    
+    // there is always at least one unused slot, so the search will stop
+    while (mtg->index[pos] != NULL)
+    {
+        if (strcmp(mtg->index[pos]->name, name) == 0)
         {
-            for (; i < nvals; ++i)
-            {
-                assert(pos[i] != NULL);
-                strncpy(pos[i], vals[pvals - 1], len);
-                pos[i] += len;
-            }
+            return mtg->index[pos];
         }
+        pos = (pos + 1) & mask;
     }
     
-    return;
+    return NULL;
 }
 
 static EMistErrorCode
@@ -2795,6 +2944,13 @@ mist_tg_create_impl(const char* name_main,
         free(tg);
         return NULL;
     }
+    tg->main = NULL;
+    tg->index = NULL;
+    tg->index_size = 0;
+    tg->buf.data = NULL;
+    tg->buf.len = 0;
+    tg->buf.cap = 0;
+    tg->generation = 0;
     // If something wrong happens below, we can call mist_tg_destroy_impl 
     // to clean up because all the members of 'tg' are now initialized.
     
@@ -2861,18 +3017,16 @@ mist_tg_create_impl(const char* name_main,
     
     grar_sort(&(tg->tpl), mist_template_compare);
     
-    // Lookup the main template
-    CMistTemplate comp;
-    CMistTemplate* pcomp = &comp;
-    comp.name = (char*)strdup(name_main);
-    if (comp.name == NULL)
+    ec = mist_tg_build_index(tg);
+    if (ec != MIST_OK)
     {
         mist_tg_destroy_impl(tg);
         return NULL;
     }
     
-    int ind = grar_find(&(tg->tpl), &pcomp, mist_template_compare);
-    if (ind < 0)
+    // Lookup the main template
+    tg->main = mist_tg_find_template(tg, name_main);
+    if (tg->main == NULL)
     {
         // the template with name 'name_main' is missing
         *error_descr = (char*)malloc(strlen(errNoMainTemplate) + strlen(name_main) + 1);
@@ -2883,14 +3037,9 @@ mist_tg_create_impl(const char* name_main,
         
         // *bad_index will remain (-1).
         
-        free(comp.name);
         mist_tg_destroy_impl(tg);
         return NULL;
     }
-    free(comp.name);
-    
-    tg->main = grar_get_element(&(tg->tpl), CMistTemplate*, ind);
-    assert(tg->main != NULL);
     
     // Make placeholder-template connections
     mist_tg_connect_templates(tg);
@@ -2966,6 +3115,8 @@ mist_tg_destroy_impl(CMistTemplateGroup* mtg)
 {
     assert(mtg != NULL);
     grar_destroy_with_elements(&(mtg->tpl), mist_template_dtor, NULL);
+    free(mtg->index);
+    free(mtg->buf.data);
     free(mtg);
     return;
 }
@@ -2979,22 +3130,9 @@ mist_tg_add_value_impl(CMistTemplateGroup* mtg, const char* name, const char* va
     assert(val != NULL);
     
     // Lookup the template first
-    CMistTemplate comp;
-    CMistTemplate* pcomp = &comp;
-    comp.name = (char*)strdup(name);
-    if (comp.name == NULL)
+    CMistTemplate* tp = mist_tg_find_template(mtg, name);
+    if (tp != NULL) // found the template with name 'name'
     {
-        return MIST_OUT_OF_MEMORY;
-    }
-    
-    int ind = grar_find(&(mtg->tpl), &pcomp, mist_template_compare);
-    free(comp.name);
-    
-    if (ind != -1) // found the template with name 'name'
-    {
-        CMistTemplate* tp = grar_get_element(&(mtg->tpl), CMistTemplate*, ind);
-        assert(tp != NULL);
-        
         EMistErrorCode ec = mist_template_add_value(tp, val);
         return ec;
     }
@@ -3011,6 +3149,10 @@ mist_tg_evaluate_impl(CMistTemplateGroup* mtg)
     assert(grar_get_size(&(mtg->tpl)) != 0);
     assert(mtg->main != NULL);
     
+    // Start a new evaluation. The templates that have not changed since the
+    // previous one will keep their values.
+    ++mtg->generation;
+    
     // Clear 'evaluated' flag for each template before evaluating them
     size_t n = grar_get_size(&(mtg->tpl));
     CMistTemplate** tpl = grar_get_c_array(&(mtg->tpl), CMistTemplate*);
@@ -3021,7 +3163,7 @@ mist_tg_evaluate_impl(CMistTemplateGroup* mtg)
     }
         
     // Evaluate the templates
-    EMistErrorCode ec = mist_template_evaluate(mtg->main);
+    EMistErrorCode ec = mist_template_evaluate(mtg->main, mtg);
     if (ec != MIST_OK)
     {
         return NULL;
@@ -3042,7 +3184,14 @@ mist_tg_clear_values_impl(CMistTemplateGroup* mtg)
     for (size_t i = 0; i < n; ++i)
     {
         assert(tpl[i] != NULL);
-        mist_template_clear_values(tpl[i]);
+        
+        // The values of the templates other than attributes are constructed
+        // during evaluation anyway. They are kept to be reused if nothing 
+        // they depend on changes.
+        if (grar_get_size(&(tpl[i]->sch)) == 0 || tpl[i]->is_modified)
+        {
+            mist_template_clear_values(tpl[i]);
+        }
         tpl[i]->is_evaluated = 0;
     }
     
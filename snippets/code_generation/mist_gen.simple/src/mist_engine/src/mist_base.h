@@ -198,13 +198,14 @@ mist_tg_set_values_impl(CMistTemplateGroup* mtg, CStringMap* sm);
 /// case of failure (typically, if there is not enough memory).
 /// The array and the strings contained in it are owned by the group and 
 /// must not be freed by the caller.
+/// Only the templates affected by the changes of the values since the 
+/// previous evaluation are constructed again.
 CGrowingArray*
 mist_tg_evaluate_impl(CMistTemplateGroup* mtg);
 
-/// Clear the values of each template contained in the group (including
-/// attributes but excluding special templates for "then" and "else" branches
-/// as well as the result of the conditionals: these are NOT contained in the 
-/// group, and their values will be cleared separately before evaluation). 
+/// Clear the values of each attribute contained in the group. The values of
+/// other templates are reconstructed during evaluation if needed, so they
+/// are kept to be reused.
 /// Use this function to 'reset' the group before setting new values for the
 /// attributes in it.
 void
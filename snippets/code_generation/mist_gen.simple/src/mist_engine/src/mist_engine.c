@@ -220,25 +220,21 @@ mist_tg_set_values(CMistTGroup* mtg,
     assert(mtg != NULL);
     assert(attrs != NULL);
     
-    CStringMap* sm = smap_create();
-    if (sm == NULL)
-    {
-        return MIST_OUT_OF_MEMORY;
-    }
-    
+    // The values are added to the templates directly, in order, without 
+    // copying them to a string map first.
     for (size_t i = 0; i < num; ++i)
     {
-        if (!smap_add_element(sm, attrs[i].name, attrs[i].val))
+        assert(attrs[i].name != NULL);
+        assert(attrs[i].val != NULL);
+        
+        EMistErrorCode ec = mist_tg_add_value_impl(mtg, attrs[i].name, attrs[i].val);
+        if (ec != MIST_OK)
         {
-            smap_destroy(sm);
-            return MIST_OUT_OF_MEMORY;
+            return ec;
         }
     }
     
-    EMistErrorCode ec = mist_tg_set_values_impl(mtg, sm);
-    smap_destroy(sm);
-    
-    return ec;
+    return MIST_OK;
 }
 
 EMistErrorCode
@@ -227,26 +227,94 @@ static struct calc_essence*
 calc_essence_3op_create(enum calc_essence_type type,
     struct calc_essence* op1, struct calc_essence* op2, struct calc_essence* op3);
 
-//Auxiliary structure, joined all data needed for evaluating expression
-struct evaluate_data
+// Free(possibly, recursively) all resources, used by essence.
+static void calc_essence_free(struct calc_essence* essence);
+
+/*
+ * The tree of essences is used only while parsing. After that the expression
+ * is compiled into a flat array of instructions for a stack machine, which
+ * is executed by kedr_calc_evaluate() in a loop without recursion.
+ *
+ * The value on the top of the stack is kept in a local variable
+ * (the accumulator), the rest of the stack is an array on the stack of
+ * kedr_calc_evaluate().
+ */
+
+// Binary operations which are evaluated in the same way as in C.
+#define CALC_BINARY_OPERATIONS(OP) \
+    OP(multiply, *) \
+    OP(divide, /) \
+    OP(rest, %) \
+    OP(plus, +) \
+    OP(minus, -) \
+    OP(left_shift, <<) \
+    OP(right_shift, >>) \
+    OP(less, <) \
+    OP(greater, >) \
+    OP(less_equal, <=) \
+    OP(greater_equal, >=) \
+    OP(equal, ==) \
+    OP(inequal, !=) \
+    OP(binary_and, &) \
+    OP(binary_xor, ^) \
+    OP(binary_or, |)
+
+enum calc_opcode
 {
-    const kedr_calc_int_t* var_values;
-    const struct kedr_calc_weak_var* weak_vars;
+    calc_op_end, // stop, result is in the accumulator
+
+    calc_op_value, // push 'arg'
+    calc_op_variable, // push value of the variable with index 'arg'
+    calc_op_weak_variable, // compute weak variable with index 'arg' and push its value
+
+    calc_op_unary_minus,
+    calc_op_binary_not,
+    calc_op_logical_not,
+    calc_op_bool, // convert top of the stack to 0 or 1
+
+    /*
+     * For each binary operation there are 2 opcodes:
+     * calc_op_<op> takes both operands from the stack,
+     * calc_op_<op>_value takes the first operand from the stack
+     * and uses 'arg' as the second one.
+     */
+#define CALC_BINARY_OPCODES(name, sign) calc_op_##name, calc_op_##name##_value,
+    CALC_BINARY_OPERATIONS(CALC_BINARY_OPCODES)
+#undef CALC_BINARY_OPCODES
+
+    calc_op_jump, // go to instruction with index 'arg'
+    calc_op_jump_if_zero, // pop value and go to 'arg' if it is 0 ('?:')
+    calc_op_and_jump, // if top of the stack is 0, go to 'arg', otherwise pop it ('&&')
+    calc_op_or_jump, // if top of the stack is not 0, replace it with 1 and go to 'arg', otherwise pop it ('||')
 };
 
-// Evaluate(possibly, recursively) essence, using given values of variables and weak_variables computation functions
-static kedr_calc_int_t calc_essence_evaluate(const struct calc_essence* essence, const struct evaluate_data* evaluate_data);
-// Free(possibly, recursively) all resources, used by essence.
-static void calc_essence_free(struct calc_essence* essence);
+struct calc_insn
+{
+    enum calc_opcode opcode;
+    kedr_calc_int_t arg;
+};
+
+// Maximum depth of the stack used in evaluating the expression.
+#define CALC_STACK_SIZE 32
 
 //Object which used at evaluate stage.
 struct kedr_calc
 {
-    //reference to the top-most essence
-    struct calc_essence* top_essence;
     //'weak' variables
     const struct kedr_calc_weak_var* weak_vars;
+    //instructions, the last one is calc_op_end
+    struct calc_insn code[];
 };
+
+/*
+ * Compile expression, represented by the tree of essences.
+ *
+ * Return compiled expression or NULL on error.
+ */
+static struct kedr_calc*
+calc_compile(const struct calc_essence* top_essence,
+    const struct kedr_calc_weak_var* weak_vars);
+
 //Type of tokens, used in parsing process
 enum token_type
 {
@@ -405,7 +473,8 @@ kedr_calc_parse(const char* expr,
     int var_n, const char* const* var_names,
     int weak_vars_n, const struct kedr_calc_weak_var* weak_vars)
 {
-    struct kedr_calc* calc = NULL;
+    struct kedr_calc* calc;
+    struct calc_essence* top_essence;
     struct parse_data parse_data;
 
     parse_data.expr = expr;
@@ -422,28 +491,22 @@ kedr_calc_parse(const char* expr,
     
     parse_data.current_token_type = token_type_start;
     //value and index undefined - shouln't be used with current token_type
-    calc = kmalloc(sizeof(*calc), GFP_KERNEL);
-    if(calc == NULL)
-    {
-        print_error0("Cannot allocate kedr_calc_t object.");
-        return NULL;
-    }
-    calc->top_essence = parse_data_parse(&parse_data, priority_min);
-    if(calc->top_essence == NULL)
+    top_essence = parse_data_parse(&parse_data, priority_min);
+    if(top_essence == NULL)
     {
-        kfree(calc);
         return NULL;//error already been traced in parse_data_parse()
     }
     if(parse_data.current_token_type != token_type_eof)
     {
         print_error("Unexpected symbol of type %d after expression.",
             (int)parse_data.current_token_type);
-        calc_essence_free(calc->top_essence);
-        kfree(calc);
+        calc_essence_free(top_essence);
         return NULL;
     }
-    calc->weak_vars = weak_vars;
-    
+    // The tree is not needed after compilation
+    calc = calc_compile(top_essence, weak_vars);
+    calc_essence_free(top_essence);
+
     return calc;
 }
 
@@ -452,15 +515,88 @@ kedr_calc_parse(const char* expr,
  *
  * 'var_values' is array of variables values in the same order,
  * as 'var_names' array, passed into kedr_calc_parse() function.
+ *
+ * Weak variables are computed only if the instructions using them are
+ * reached, e.g. 'rnd100' is not computed in 'times > 5 && rnd100 < 10'
+ * while 'times' is not greater than 5.
  */
 
 kedr_calc_int_t kedr_calc_evaluate(const kedr_calc_t* calc, const kedr_calc_int_t* var_values)
 {
-    struct evaluate_data evaluate_data;
-    evaluate_data.var_values = var_values;
-    evaluate_data.weak_vars = calc->weak_vars;
-    //
-    return calc_essence_evaluate(calc->top_essence, &evaluate_data);
+    kedr_calc_int_t stack[CALC_STACK_SIZE];
+    int sp = 0;
+    kedr_calc_int_t acc = 0;
+    const struct calc_insn* insn = calc->code;
+
+    for(;; insn++)
+    {
+        switch(insn->opcode)
+        {
+        case calc_op_end:
+            return acc;
+
+        case calc_op_value:
+            stack[sp++] = acc;
+            acc = insn->arg;
+            break;
+        case calc_op_variable:
+            stack[sp++] = acc;
+            acc = var_values[insn->arg];
+            break;
+        case calc_op_weak_variable:
+            stack[sp++] = acc;
+            acc = calc->weak_vars[insn->arg].compute();
+            break;
+
+        case calc_op_unary_minus:
+            acc = -acc;
+            break;
+        case calc_op_binary_not:
+            acc = ~acc;
+            break;
+        case calc_op_logical_not:
+            acc = !acc;
+            break;
+        case calc_op_bool:
+            acc = !!acc;
+            break;
+
+#define CALC_BINARY_EVALUATE(name, sign) \
+        case calc_op_##name: \
+            acc = stack[--sp] sign acc; \
+            break; \
+        case calc_op_##name##_value: \
+            acc = acc sign insn->arg; \
+            break;
+        CALC_BINARY_OPERATIONS(CALC_BINARY_EVALUATE)
+#undef CALC_BINARY_EVALUATE
+
+        // 'insn' is incremented after the jump, so the target is decremented
+        case calc_op_jump:
+            insn = calc->code + insn->arg - 1;
+            break;
+        case calc_op_jump_if_zero:
+            if(acc == 0) insn = calc->code + insn->arg - 1;
+            acc = stack[--sp];
+            break;
+        case calc_op_and_jump:
+            if(acc == 0) insn = calc->code + insn->arg - 1;
+            else acc = stack[--sp];
+            break;
+        case calc_op_or_jump:
+            if(acc != 0)
+            {
+                acc = 1;
+                insn = calc->code + insn->arg - 1;
+            }
+            else acc = stack[--sp];
+            break;
+        default:
+            print_error("Unknown opcode: %d.", insn->opcode);
+            BUG();
+            return 0;
+        }
+    }
 }
 
 /*
@@ -469,7 +605,6 @@ kedr_calc_int_t kedr_calc_evaluate(const kedr_calc_t* calc, const kedr_calc_int_
 
 void kedr_calc_delete(kedr_calc_t* calc)
 {
-    calc_essence_free(calc->top_essence);
     kfree(calc);
 }
 
@@ -611,91 +746,272 @@ calc_essence_3op_create(enum calc_essence_type type,
     result->op3 = op3;
     return (struct calc_essence*)result;
 }
-//
-static kedr_calc_int_t 
-calc_essence_evaluate(const struct calc_essence* essence, const struct evaluate_data* evaluate_data)
+/*
+ * Determine whether essence is evaluated to the constant value
+ * (constant folding).
+ *
+ * If it is, return not 0 and set 'value' to the value of the essence.
+ * Otherwise return 0.
+ *
+ * Division by constant 0 is not folded, so it is performed at the
+ * evaluation stage as before.
+ */
+static int
+calc_essence_is_const(const struct calc_essence* essence, kedr_calc_int_t* value)
 {
+    kedr_calc_int_t v1, v2;
     switch(essence->type)
     {
     case calc_essence_type_value:
-        return ((struct calc_essence_val*)essence)->value;
+        *value = ((const struct calc_essence_val*)essence)->value;
+        return 1;
     case calc_essence_type_variable:
-        return evaluate_data->var_values[((struct calc_essence_var*)essence)->index];
     case calc_essence_type_weak_variable:
-        return evaluate_data->weak_vars[((struct calc_essence_weak_var*)essence)->index].compute();
-// Helper macro for calculate value of operand for one-operand essence
-#define OP1_1 (calc_essence_evaluate(((struct calc_essence_1op*)(essence))->op, evaluate_data))
+        return 0;
+// Helper macro for determine value of operand for one-operand essence
+#define OP1_CONST(v) calc_essence_is_const(((const struct calc_essence_1op*)essence)->op, &v)
     case calc_essence_type_unary_plus:
-        return OP1_1;
+        if(!OP1_CONST(v1)) return 0;
+        *value = v1;
+        return 1;
     case calc_essence_type_unary_minus:
-        return -OP1_1;
-
+        if(!OP1_CONST(v1)) return 0;
+        *value = -v1;
+        return 1;
     case calc_essence_type_binary_not:
-        return ~OP1_1;
+        if(!OP1_CONST(v1)) return 0;
+        *value = ~v1;
+        return 1;
     case calc_essence_type_logical_not:
-        return !OP1_1;
-#undef OP1_1
+        if(!OP1_CONST(v1)) return 0;
+        *value = !v1;
+        return 1;
+#undef OP1_CONST
 // Same for two-operand essence
-#define OP2_1 (calc_essence_evaluate(((struct calc_essence_2op*)(essence))->op1, evaluate_data))
-#define OP2_2 (calc_essence_evaluate(((struct calc_essence_2op*)(essence))->op2, evaluate_data))
-    case calc_essence_type_multiply:
-        return OP2_1 * OP2_2;
-    case calc_essence_type_divide:
-        return OP2_1 / OP2_2;
-    case calc_essence_type_rest:
-        return OP2_1 % OP2_2;
+#define OP2_CONST(op, v) calc_essence_is_const(((const struct calc_essence_2op*)essence)->op, &v)
+#define CALC_BINARY_FOLD(name, sign) \
+    case calc_essence_type_##name: \
+        if(!OP2_CONST(op1, v1) || !OP2_CONST(op2, v2)) return 0; \
+        if((v2 == 0) && ((essence->type == calc_essence_type_divide) \
+            || (essence->type == calc_essence_type_rest))) return 0; \
+        *value = v1 sign v2; \
+        return 1;
+    CALC_BINARY_OPERATIONS(CALC_BINARY_FOLD)
+#undef CALC_BINARY_FOLD
+    // Second operand is not needed if first one determines the result
+    case calc_essence_type_logical_and:
+        if(!OP2_CONST(op1, v1)) return 0;
+        if(!v1) {*value = 0; return 1;}
+        if(!OP2_CONST(op2, v2)) return 0;
+        *value = !!v2;
+        return 1;
+    case calc_essence_type_logical_or:
+        if(!OP2_CONST(op1, v1)) return 0;
+        if(v1) {*value = 1; return 1;}
+        if(!OP2_CONST(op2, v2)) return 0;
+        *value = !!v2;
+        return 1;
+#undef OP2_CONST
+    case calc_essence_type_cond:
+    {
+        const struct calc_essence_3op* essence3 = (const struct calc_essence_3op*)essence;
+        if(!calc_essence_is_const(essence3->op1, &v1)) return 0;
+        return calc_essence_is_const(v1 ? essence3->op2 : essence3->op3, value);
+    }
+    default:
+        print_error("Unknown type of essence: %d.", essence->type);
+        BUG();
+        return 0;
+    }
+}
 
-    case calc_essence_type_plus:
-        return OP2_1 + OP2_2;
-    case calc_essence_type_minus:
-        return OP2_1 - OP2_2;
+//State of the compilation
+struct calc_compile_data
+{
+    //array of instructions; if NULL, instructions are only counted
+    struct calc_insn* code;
+    //index of the next instruction
+    int pos;
+    //current and maximum depth of the stack
+    int depth;
+    int max_depth;
+};
 
-    case calc_essence_type_left_shift:
-        return OP2_1 << OP2_2;
-    case calc_essence_type_right_shift:
-        return OP2_1 >> OP2_2;
+//Add instruction and return its index.
+static int
+calc_compile_emit(struct calc_compile_data* data,
+    enum calc_opcode opcode, kedr_calc_int_t arg, int stack_change)
+{
+    if(data->code != NULL)
+    {
+        data->code[data->pos].opcode = opcode;
+        data->code[data->pos].arg = arg;
+    }
+    data->depth += stack_change;
+    if(data->depth > data->max_depth)
+        data->max_depth = data->depth;
+    return data->pos++;
+}
 
-    case calc_essence_type_less:
-        return OP2_1 < OP2_2;
-    case calc_essence_type_greater:
-        return OP2_1 > OP2_2;
-    case calc_essence_type_less_equal:
-        return OP2_1 <= OP2_2;
-    case calc_essence_type_greater_equal:
-        return OP2_1 >= OP2_2;
+//Set target of the jump instruction to the next instruction.
+static void
+calc_compile_set_jump(struct calc_compile_data* data, int jump_pos)
+{
+    if(data->code != NULL)
+        data->code[jump_pos].arg = data->pos;
+}
 
-    case calc_essence_type_equal:
-        return OP2_1 == OP2_2;
-    case calc_essence_type_inequal:
-        return OP2_1 != OP2_2;
+/*
+ * Emit instructions which push value of the essence onto the stack.
+ *
+ * Used recursively.
+ */
+static void
+calc_compile_essence(struct calc_compile_data* data,
+    const struct calc_essence* essence)
+{
+    kedr_calc_int_t value;
+    enum calc_opcode opcode;
+    int jump_pos, jump_end_pos;
 
-    case calc_essence_type_binary_and:
-        return OP2_1 & OP2_2;
-    case calc_essence_type_binary_xor:
-        return OP2_1 ^ OP2_2;
-    case calc_essence_type_binary_or:
-        return OP2_1 | OP2_2;
+    if(calc_essence_is_const(essence, &value))
+    {
+        calc_compile_emit(data, calc_op_value, value, 1);
+        return;
+    }
+
+    switch(essence->type)
+    {
+    case calc_essence_type_variable:
+        calc_compile_emit(data, calc_op_variable,
+            ((const struct calc_essence_var*)essence)->index, 1);
+        return;
+    case calc_essence_type_weak_variable:
+        calc_compile_emit(data, calc_op_weak_variable,
+            ((const struct calc_essence_weak_var*)essence)->index, 1);
+        return;
+
+    case calc_essence_type_unary_plus:
+        calc_compile_essence(data, ((const struct calc_essence_1op*)essence)->op);
+        return;
+    case calc_essence_type_unary_minus:
+    case calc_essence_type_binary_not:
+    case calc_essence_type_logical_not:
+        calc_compile_essence(data, ((const struct calc_essence_1op*)essence)->op);
+        calc_compile_emit(data,
+            essence->type == calc_essence_type_unary_minus ? calc_op_unary_minus :
+            essence->type == calc_essence_type_binary_not ? calc_op_binary_not :
+            calc_op_logical_not,
+            0, 0);
+        return;
+
+#define CALC_BINARY_COMPILE(name, sign) \
+    case calc_essence_type_##name: \
+        opcode = calc_op_##name; \
+        break;
+    CALC_BINARY_OPERATIONS(CALC_BINARY_COMPILE)
+#undef CALC_BINARY_COMPILE
 
     case calc_essence_type_logical_and:
-        return OP2_1 && OP2_2;
     case calc_essence_type_logical_or:
-        return OP2_1 || OP2_2;
-#undef OP2_1
-#undef OP2_2
-// Same for three-operand essence
-#define OP3_1 (calc_essence_evaluate(((struct calc_essence_3op*)(essence))->op1, evaluate_data))
-#define OP3_2 (calc_essence_evaluate(((struct calc_essence_3op*)(essence))->op2, evaluate_data))
-#define OP3_3 (calc_essence_evaluate(((struct calc_essence_3op*)(essence))->op3, evaluate_data))
+    {
+        const struct calc_essence_2op* essence2 = (const struct calc_essence_2op*)essence;
+        // Constant first operand which determines the result is processed
+        // by calc_essence_is_const(), any other one may be omitted.
+        if(!calc_essence_is_const(essence2->op1, &value))
+        {
+            calc_compile_essence(data, essence2->op1);
+            jump_pos = calc_compile_emit(data,
+                essence->type == calc_essence_type_logical_and
+                    ? calc_op_and_jump : calc_op_or_jump,
+                0, -1);
+        }
+        else
+        {
+            jump_pos = -1;
+        }
+        calc_compile_essence(data, essence2->op2);
+        calc_compile_emit(data, calc_op_bool, 0, 0);
+        if(jump_pos != -1)
+            calc_compile_set_jump(data, jump_pos);
+        return;
+    }
     case calc_essence_type_cond:
-        return OP3_1 ? OP3_2 : OP3_3;
-#undef OP3_1
-#undef OP3_2
-#undef OP3_3
+    {
+        const struct calc_essence_3op* essence3 = (const struct calc_essence_3op*)essence;
+        // Only the chosen branch is compiled for constant condition
+        if(calc_essence_is_const(essence3->op1, &value))
+        {
+            calc_compile_essence(data, value ? essence3->op2 : essence3->op3);
+            return;
+        }
+        calc_compile_essence(data, essence3->op1);
+        jump_pos = calc_compile_emit(data, calc_op_jump_if_zero, 0, -1);
+        calc_compile_essence(data, essence3->op2);
+        // Only one of the branches is executed
+        jump_end_pos = calc_compile_emit(data, calc_op_jump, 0, -1);
+        calc_compile_set_jump(data, jump_pos);
+        calc_compile_essence(data, essence3->op3);
+        calc_compile_set_jump(data, jump_end_pos);
+        return;
+    }
     default:
         print_error("Unknown type of essence: %d.", essence->type);
         BUG();
-        return 0;
+        return;
+    }
+    // Binary operation, 'opcode' is set
+    {
+        const struct calc_essence_2op* essence2 = (const struct calc_essence_2op*)essence;
+        calc_compile_essence(data, essence2->op1);
+        if(calc_essence_is_const(essence2->op2, &value))
+        {
+            calc_compile_emit(data, opcode + 1 /* calc_op_<op>_value */, value, 0);
+        }
+        else
+        {
+            calc_compile_essence(data, essence2->op2);
+            calc_compile_emit(data, opcode, 0, -1);
+        }
+    }
+}
+
+static struct kedr_calc*
+calc_compile(const struct calc_essence* top_essence,
+    const struct kedr_calc_weak_var* weak_vars)
+{
+    struct kedr_calc* calc;
+    struct calc_compile_data data;
+
+    // Determine number of instructions and depth of the stack
+    data.code = NULL;
+    data.pos = 0;
+    data.depth = 0;
+    data.max_depth = 0;
+    calc_compile_essence(&data, top_essence);
+    calc_compile_emit(&data, calc_op_end, 0, 0);
+
+    if(data.max_depth > CALC_STACK_SIZE)
+    {
+        print_error("Expression is too complex: it requires stack of depth %d, "
+            "but only %d is supported.", data.max_depth, CALC_STACK_SIZE);
+        return NULL;
     }
+
+    calc = kmalloc(sizeof(*calc) + data.pos * sizeof(struct calc_insn), GFP_KERNEL);
+    if(calc == NULL)
+    {
+        print_error0("Cannot allocate kedr_calc_t object.");
+        return NULL;
+    }
+    calc->weak_vars = weak_vars;
+
+    data.code = calc->code;
+    data.pos = 0;
+    calc_compile_essence(&data, top_essence);
+    calc_compile_emit(&data, calc_op_end, 0, 0);
+
+    return calc;
 }
 
 static void
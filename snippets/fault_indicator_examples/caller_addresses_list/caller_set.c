@@ -0,0 +1,286 @@
+// Implementation of the set of caller addresses.
+
+/* ========================================================================
+ * Copyright (C) 2012, KEDR development team
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ ======================================================================== */
+
+#include "caller_set.h"
+
+#include <linux/kernel.h> /* pr_err, simple_strtoul */
+#include <linux/module.h> /* find_module */
+#include <linux/mutex.h>
+#include <linux/slab.h> /* kmalloc & kfree */
+#include <linux/vmalloc.h>
+#include <linux/mm.h> /* is_vmalloc_addr */
+#include <linux/string.h>
+#include <linux/ctype.h>
+#include <linux/sort.h>
+#include <linux/err.h>
+
+#define print_error(str, ...) pr_err("%s: " str, __func__, __VA_ARGS__)
+
+//Range of addresses, 'last' is included into the range.
+struct caller_range
+{
+    unsigned long first;
+    unsigned long last;
+};
+
+struct caller_set
+{
+    //number of ranges
+    size_t n;
+    //sorted by 'first', do not overlap and do not adjoin each other
+    struct caller_range ranges[];
+};
+
+//Large sets are allocated with vmalloc().
+static struct caller_set*
+caller_set_alloc(size_t n)
+{
+    size_t size = sizeof(struct caller_set) + n * sizeof(struct caller_range);
+    return size > PAGE_SIZE ? vmalloc(size) : kmalloc(size, GFP_KERNEL);
+}
+
+void
+caller_set_destroy(struct caller_set* set)
+{
+    if(set == NULL) return;
+    if(is_vmalloc_addr(set))
+        vfree(set);
+    else
+        kfree(set);
+}
+
+static int
+is_delimiter(char ch)
+{
+    return isspace(ch) || (ch == ',');
+}
+
+//Return number of elements in the string.
+static size_t
+count_elements(const char* str)
+{
+    size_t n = 0;
+    while(*str != '\0')
+    {
+        if(is_delimiter(*str))
+        {
+            str++;
+            continue;
+        }
+        n++;
+        while((*str != '\0') && !is_delimiter(*str)) str++;
+    }
+    return n;
+}
+
+//Set range to the code area of the module.
+static int
+parse_module_range(const char* name, size_t name_len,
+    struct caller_range* range)
+{
+    char module_name[MODULE_NAME_LEN];
+    struct module* m;
+    int is_init = 0;
+    void* area = NULL;
+    unsigned long area_size = 0;
+    const char* colon = memchr(name, ':', name_len);
+
+    if(colon != NULL)
+    {
+        size_t suffix_len = name_len - (colon - name) - 1;
+        if((suffix_len != 4) || strncmp(colon + 1, "init", 4))
+        {
+            print_error("Unknown area '%.*s' of the module, only 'init' is supported.",
+                (int)suffix_len, colon + 1);
+            return -EINVAL;
+        }
+        is_init = 1;
+        name_len = colon - name;
+    }
+    if(name_len >= MODULE_NAME_LEN)
+    {
+        print_error("Module name '%.*s' is too long.", (int)name_len, name);
+        return -EINVAL;
+    }
+    memcpy(module_name, name, name_len);
+    module_name[name_len] = '\0';
+
+    mutex_lock(&module_mutex);
+    m = find_module(module_name);
+    if(m != NULL)
+    {
+        area = is_init ? m->module_init : m->module_core;
+        area_size = is_init ? m->init_text_size : m->core_text_size;
+    }
+    mutex_unlock(&module_mutex);
+
+    if(m == NULL)
+    {
+        print_error("Module '%s' is not loaded.", module_name);
+        return -ENOENT;
+    }
+    if((area == NULL) || (area_size == 0))
+    {
+        print_error("Module '%s' has no %s code area.", module_name,
+            is_init ? "init" : "core");
+        return -ENOENT;
+    }
+    range->first = (unsigned long)area;
+    range->last = range->first + area_size - 1;
+    return 0;
+}
+
+//Set range to the addresses in the element.
+static int
+parse_element(const char* elem, size_t elem_len, struct caller_range* range)
+{
+    char* end;
+    const char* elem_end = elem + elem_len;
+
+    if(!isdigit(elem[0]))
+        return parse_module_range(elem, elem_len, range);
+
+    range->first = simple_strtoul(elem, &end, 16);
+    range->last = range->first;
+    if(end == elem_end) return 0;
+    if(*end == '-')
+    {
+        const char* last = end + 1;
+        if((last != elem_end) && isxdigit(*last))
+        {
+            range->last = simple_strtoul(last, &end, 16);
+            if((end == elem_end) && (range->last >= range->first)) return 0;
+        }
+    }
+    print_error("Incorrect address or range of addresses: '%.*s'.",
+        (int)elem_len, elem);
+    return -EINVAL;
+}
+
+static int
+caller_range_cmp(const void* a, const void* b)
+{
+    const struct caller_range* range_a = a;
+    const struct caller_range* range_b = b;
+    if(range_a->first < range_b->first) return -1;
+    return range_a->first > range_b->first;
+}
+
+//Sort the ranges and merge the overlapping and adjacent ones.
+static void
+caller_set_normalize(struct caller_set* set)
+{
+    size_t i, n = 0;
+
+    sort(set->ranges, set->n, sizeof(set->ranges[0]), caller_range_cmp, NULL);
+
+    for(i = 1; i < set->n; i++)
+    {
+        struct caller_range* current_range = &set->ranges[n];
+        const struct caller_range* range = &set->ranges[i];
+        if((current_range->last == ULONG_MAX)
+            || (range->first <= current_range->last + 1))
+        {
+            if(range->last > current_range->last)
+                current_range->last = range->last;
+        }
+        else
+        {
+            set->ranges[++n] = *range;
+        }
+    }
+    set->n = n + 1;
+}
+
+struct caller_set*
+caller_set_create(const char* str)
+{
+    struct caller_set* set;
+    size_t n = count_elements(str);
+
+    if(n == 0) return NULL;
+
+    set = caller_set_alloc(n);
+    if(set == NULL)
+    {
+        print_error("Cannot allocate set of %zu addresses.", n);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    set->n = 0;
+    while(*str != '\0')
+    {
+        const char* elem;
+        int result;
+        if(is_delimiter(*str))
+        {
+            str++;
+            continue;
+        }
+        elem = str;
+        while((*str != '\0') && !is_delimiter(*str)) str++;
+
+        result = parse_element(elem, str - elem, &set->ranges[set->n]);
+        if(result)
+        {
+            caller_set_destroy(set);
+            return ERR_PTR(result);
+        }
+        set->n++;
+    }
+
+    caller_set_normalize(set);
+    return set;
+}
+
+int
+caller_set_contains(const struct caller_set* set, const void* address)
+{
+    unsigned long addr = (unsigned long)address;
+    size_t low = 0, high = set->n;
+
+    while(low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        const struct caller_range* range = &set->ranges[middle];
+        if(addr < range->first)
+            high = middle;
+        else if(addr > range->last)
+            low = middle + 1;
+        else
+            return 1;
+    }
+    return 0;
+}
+
+size_t
+caller_set_print(char* buf, size_t size, const struct caller_set* set)
+{
+    size_t i;
+    size_t bytes_written = 0;
+#define write_f(fmt, ...) do {\
+    size_t local_size = snprintf(buf, size, fmt, __VA_ARGS__); \
+    bytes_written += local_size; \
+    if(buf) buf += (local_size < size) ? local_size : size; \
+    size = size > local_size ? size - local_size : 0; \
+    } while(0)
+
+    for(i = 0; i < set->n; i++)
+    {
+        const struct caller_range* range = &set->ranges[i];
+        const char* delimiter = i ? "\n" : "";
+        if(range->first == range->last)
+            write_f("%s0x%lx", delimiter, range->first);
+        else
+            write_f("%s0x%lx-0x%lx", delimiter, range->first, range->last);
+    }
+#undef write_f
+    return bytes_written;
+}
@@ -0,0 +1,69 @@
+/*
+ * Set of caller addresses, for which fault simulation is allowed.
+ *
+ * The set is built once from the string written to the control file and
+ * is not changed after that. It is kept as a sorted array of
+ * non-overlapping address ranges, so checking whether an address belongs
+ * to the set takes O(log n) time and doesn't require any locks.
+ * Replacing the set at run time is up to the user (e.g. via RCU).
+ */
+
+/* ========================================================================
+ * Copyright (C) 2012, KEDR development team
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ ======================================================================== */
+
+#ifndef CALLER_SET_H
+#define CALLER_SET_H
+
+#include <linux/types.h> /* size_t */
+
+struct caller_set;
+
+/*
+ * Create set of addresses from its string representation.
+ *
+ * The string contains elements, separated by spaces, newlines or commas.
+ * Each element is one of:
+ *
+ *   <address>           - single address (hexadecimal; '0x' may be omitted
+ *                         only if the address starts with a digit),
+ *   <first>-<last>      - addresses from <first> to <last> inclusive,
+ *   <module>            - addresses in the "core" code area of the module,
+ *   <module>:init       - addresses in the "init" code area of the module.
+ *
+ * Module names are resolved when the set is created, so the module should
+ * be loaded at that moment.
+ *
+ * Return the set created or ERR_PTR() on error. If the string contains no
+ * elements, return NULL, which means "no restriction" for the indicator.
+ */
+struct caller_set*
+caller_set_create(const char* str);
+
+/*
+ * Destroy the set. NULL is allowed.
+ */
+void
+caller_set_destroy(struct caller_set* set);
+
+/*
+ * Return not 0 if the address belongs to the set, 0 otherwise.
+ *
+ * May be called in atomic context.
+ */
+int
+caller_set_contains(const struct caller_set* set, const void* address);
+
+/*
+ * Print the set into the buffer in snprintf()-style, one range per line,
+ * in the format accepted by caller_set_create(). Return number of
+ * characters which would be written if the buffer were large enough.
+ */
+size_t
+caller_set_print(char* buf, size_t size, const struct caller_set* set);
+
+#endif /* CALLER_SET_H */
@@ -288,6 +288,98 @@ indicator.file.set =>>
 	return result ? -EINVAL : 0;
 <<
 
+###############  Caller set ####################
+indicator.state.name = caller_set
+indicator.state.type = struct caller_set*
+
+indicator.state.name = caller_set_mutex
+indicator.state.type = struct mutex
+
+# Declarations for caller set
+global =>>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/err.h> /* IS_ERR, PTR_ERR */
+
+#include "caller_set.h"
+<<
+
+# Simulate for caller_set
+indicator.simulate.name = caller_set
+indicator.simulate.first = yes
+indicator.simulate.code =>>
+	struct caller_set* set;
+	int may_simulate = 1;
+
+	rcu_read_lock();
+	set = rcu_dereference(state(caller_set));
+	if(set && !caller_set_contains(set, caller_address))
+		may_simulate = 0;
+	rcu_read_unlock();
+
+	if(!may_simulate) simulate_never();
+	return 0;
+<<
+
+# Initialize for caller_set
+indicator.init.name = caller_set
+indicator.init.code =>>
+	state(caller_set) = NULL;
+	mutex_init(&state(caller_set_mutex));
+	return 0;
+<<
+
+# Destroy for caller_set
+indicator.destroy.name = caller_set
+indicator.destroy.code =>>
+	caller_set_destroy(state(caller_set));
+<<
+
+# Control file for caller_set
+
+indicator.file.name = caller_set
+indicator.file.fs_name = caller_set
+indicator.file.get =>>
+	struct caller_set* set;
+	char* str;
+	size_t str_len;
+
+	// Set cannot be replaced while mutex is held
+	mutex_lock(&state(caller_set_mutex));
+	set = state(caller_set);
+	str_len = set ? caller_set_print(NULL, 0, set) : 0;
+	str = kmalloc(str_len + 1, GFP_KERNEL);
+	if(str)
+	{
+		if(set) caller_set_print(str, str_len + 1, set);
+		str[str_len] = '\0';
+	}
+	else
+	{
+		pr_err("Cannot allocate string for caller set.\n");
+	}
+	mutex_unlock(&state(caller_set_mutex));
+
+	return str;
+<<
+indicator.file.set =>>
+	struct caller_set* new_set;
+	struct caller_set* old_set;
+
+	new_set = caller_set_create(str);
+	if(IS_ERR(new_set)) return PTR_ERR(new_set);
+
+	mutex_lock(&state(caller_set_mutex));
+	old_set = state(caller_set);
+	rcu_assign_pointer(state(caller_set), new_set);
+	mutex_unlock(&state(caller_set_mutex));
+
+	// Wait until simulate() stops using old set
+	synchronize_rcu();
+	caller_set_destroy(old_set);
+	return 0;
+<<
+
 ###############  Expression and times ####################
 
 # Declarations for the expression
@@ -0,0 +1,403 @@
+/*
+ * Test and benchmark of the expression evaluator (calculator.c),
+ * built in user space.
+ *
+ * First, the results of the expressions are checked: against the known
+ * values, against the same expressions with the variables replaced by
+ * their values (so they are folded into constants at parse stage), and
+ * the weak variables are checked to be computed only when needed.
+ *
+ * Then the expressions typical for the indicator are evaluated in a loop
+ * and the number of evaluations per second is output for each of them.
+ *
+ * Usage: calc_bench [-n iterations]
+ *   -n - number of evaluations of each expression in the benchmark
+ *        (default: 10000000).
+ */
+
+#include <kedr/calculator/calculator.h>
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct kedr_calc_const constants[] = {
+    { .name = "GFP_ATOMIC", .value = 0x20 },
+    { .name = "GFP_KERNEL", .value = 0xd0 },
+    { .name = "PAGE_SIZE", .value = 4096 },
+};
+
+static struct kedr_calc_const_vec all_constants[] = {
+    { .n_elems = ARRAY_SIZE(constants), .elems = constants }
+};
+
+// Same variables as the indicator with 'size' and 'flags' parameters has
+static const char* var_names[] = {
+    "times",
+    "pid",
+    "caller_address",
+    "size",
+    "flags",
+};
+
+enum { var_times, var_pid, var_caller_address, var_size, var_flags };
+
+static long weak_calls;
+static kedr_calc_int_t in_init_value;
+static unsigned long rnd_state = 1;
+
+static kedr_calc_int_t in_init_weak_var_compute(void)
+{
+    weak_calls++;
+    return in_init_value;
+}
+
+static kedr_calc_int_t rnd_next(void)
+{
+    rnd_state = rnd_state * 1103515245UL + 12345UL;
+    return (rnd_state >> 16) & 0x7fff;
+}
+
+static kedr_calc_int_t rnd100_weak_var_compute(void)
+{
+    weak_calls++;
+    return rnd_next() % 100;
+}
+
+static kedr_calc_int_t rnd10000_weak_var_compute(void)
+{
+    weak_calls++;
+    return rnd_next() % 10000;
+}
+
+static const struct kedr_calc_weak_var weak_vars[] = {
+    { .name = "in_init", .compute = in_init_weak_var_compute },
+    { .name = "rnd100", .compute = rnd100_weak_var_compute },
+    { .name = "rnd10000", .compute = rnd10000_weak_var_compute },
+};
+
+static kedr_calc_t* parse(const char* expr)
+{
+    return kedr_calc_parse(expr,
+        ARRAY_SIZE(all_constants), all_constants,
+        ARRAY_SIZE(var_names), var_names,
+        ARRAY_SIZE(weak_vars), weak_vars);
+}
+
+static int errors = 0;
+
+/////////////////////////// Checks ///////////////////////////////////
+
+struct value_test
+{
+    const char* expr;
+    kedr_calc_int_t times;
+    kedr_calc_int_t in_init;
+    kedr_calc_int_t result;
+    // number of weak variables which should be computed
+    long weak_calls;
+};
+
+static const struct value_test value_tests[] = {
+    { "0", 0, 0, 0, 0 },
+    { "1 + 2 * 3 - 4 / 2 % 3", 0, 0, 5, 0 },
+    { "-(3 - 5) * ~0 + !0 + +7", 0, 0, 6, 0 },
+    { "1 << 4 >> 2 | 0x30 ^ 0x0F & 6", 0, 0, 0x36, 0 },
+    { "2 < 3 = 1 != 0 >= 1 <= 1 > 0", 0, 0, 0, 0 },
+    { "2 < 3 = (1 != 0) >= 1", 0, 0, 1, 0 },
+    { "PAGE_SIZE / 2 + GFP_KERNEL", 0, 0, 2048 + 0xd0, 0 },
+    { "times * 2 + 1", 5, 0, 11, 0 },
+    { "times - 10 - 5", 5, 0, -10, 0 },
+    { "100 / times", 7, 0, 14, 0 },
+    { "times % 3 = 1", 7, 0, 1, 0 },
+    { "times && 5", 3, 0, 1, 0 },
+    { "times || 0", 0, 0, 0, 0 },
+    { "1 && times", 7, 0, 1, 0 },
+    { "0 || times", 0, 0, 0, 0 },
+    { "0 && times", 7, 0, 0, 0 },
+    { "2 || times", 0, 0, 1, 0 },
+    { "times ? 10 : 20", 1, 0, 10, 0 },
+    { "times ? 10 : 20", 0, 0, 20, 0 },
+    { "times ? times > 1 ? 3 : 4 : 5", 2, 0, 3, 0 },
+    { "times ? times > 1 ? 3 : 4 : 5", 1, 0, 4, 0 },
+    { "times ? times > 1 ? 3 : 4 : 5", 0, 0, 5, 0 },
+    { "1 ? times : in_init", 9, 1, 9, 0 },
+    { "0 ? in_init : times + 1", 9, 1, 10, 0 },
+    // weak variables
+    { "in_init", 0, 42, 42, 1 },
+    { "in_init + in_init", 0, 3, 6, 2 },
+    { "times > 5 && in_init", 3, 1, 0, 0 },
+    { "times > 5 && in_init", 6, 1, 1, 1 },
+    { "times < 5 || in_init", 3, 0, 1, 0 },
+    { "times < 5 || in_init", 6, 0, 0, 1 },
+    { "times ? in_init : 7", 0, 3, 7, 0 },
+    { "times ? 7 : in_init", 0, 3, 3, 1 },
+    { "in_init && times > 2 || times = 1", 1, 0, 1, 1 },
+    { "!in_init && (times > 2 || in_init)", 3, 0, 1, 1 },
+    { "!in_init && (times > 2 || in_init)", 1, 0, 0, 2 },
+};
+
+static void check_values(void)
+{
+    size_t i;
+    for(i = 0; i < ARRAY_SIZE(value_tests); i++)
+    {
+        const struct value_test* test = &value_tests[i];
+        kedr_calc_int_t vars[ARRAY_SIZE(var_names)] = { 0 };
+        kedr_calc_int_t result;
+        kedr_calc_t* calc = parse(test->expr);
+        if(calc == NULL)
+        {
+            printf("FAIL: cannot parse '%s'\n", test->expr);
+            errors++;
+            continue;
+        }
+        vars[var_times] = test->times;
+        in_init_value = test->in_init;
+        weak_calls = 0;
+        result = kedr_calc_evaluate(calc, vars);
+        if(result != test->result || weak_calls != test->weak_calls)
+        {
+            printf("FAIL: '%s' with times = %ld, in_init = %ld: "
+                "result is %ld (expected %ld), %ld weak variables computed (expected %ld)\n",
+                test->expr, test->times, test->in_init,
+                result, test->result, weak_calls, test->weak_calls);
+            errors++;
+        }
+        kedr_calc_delete(calc);
+    }
+}
+
+static const char* invalid_exprs[] = {
+    "",
+    "1 +",
+    "(1 + 2",
+    "1 + 2)",
+    "unknown_name",
+    "times times",
+    // too deep for the stack of the evaluator
+    "times+(times+(times+(times+(times+(times+(times+(times+(times+(times+"
+    "(times+(times+(times+(times+(times+(times+(times+(times+(times+(times+"
+    "(times+(times+(times+(times+(times+(times+(times+(times+(times+(times+"
+    "(times+(times+times)))))))))))))))))))))))))))))))",
+};
+
+static void check_invalid(void)
+{
+    size_t i;
+    for(i = 0; i < ARRAY_SIZE(invalid_exprs); i++)
+    {
+        kedr_calc_t* calc = parse(invalid_exprs[i]);
+        if(calc != NULL)
+        {
+            printf("FAIL: invalid expression '%s' is accepted\n", invalid_exprs[i]);
+            kedr_calc_delete(calc);
+            errors++;
+        }
+    }
+}
+
+/*
+ * Random expressions over 'times', 'pid' and 'size'. Division and shifts
+ * are not used, so any values of the variables are correct.
+ */
+
+static const char* random_binary_ops[] = {
+    "+", "-", "*", "<", ">", "<=", ">=", "=", "!=", "&", "^", "|", "&&", "||"
+};
+
+static const char* random_unary_ops[] = { "-", "~", "!", "+" };
+
+// Append random expression to both 'expr' and 'expr_values'
+static void random_expr(char* expr, char* expr_values,
+    const kedr_calc_int_t* vars, int depth)
+{
+    int kind = (depth <= 0) ? (int)(rnd_next() % 2) : (int)(rnd_next() % 6);
+    char buf[32];
+    switch(kind)
+    {
+    case 0:
+        sprintf(buf, "%d", (int)(rnd_next() % 20));
+        strcat(expr, buf);
+        strcat(expr_values, buf);
+        break;
+    case 1:
+    {
+        static const int var_indexes[] = { var_times, var_pid, var_size };
+        int var = var_indexes[rnd_next() % ARRAY_SIZE(var_indexes)];
+        strcat(expr, var_names[var]);
+        sprintf(buf, "(%ld)", vars[var]);
+        strcat(expr_values, buf);
+        break;
+    }
+    case 2:
+        strcat(expr, random_unary_ops[rnd_next() % ARRAY_SIZE(random_unary_ops)]);
+        strcat(expr_values, expr + strlen(expr) - 1);
+        strcat(expr, "(");
+        strcat(expr_values, "(");
+        random_expr(expr, expr_values, vars, depth - 1);
+        strcat(expr, ")");
+        strcat(expr_values, ")");
+        break;
+    case 3:
+        strcat(expr, "(");
+        strcat(expr_values, "(");
+        random_expr(expr, expr_values, vars, depth - 1);
+        strcat(expr, ") ? (");
+        strcat(expr_values, ") ? (");
+        random_expr(expr, expr_values, vars, depth - 1);
+        strcat(expr, ") : (");
+        strcat(expr_values, ") : (");
+        random_expr(expr, expr_values, vars, depth - 1);
+        strcat(expr, ")");
+        strcat(expr_values, ")");
+        break;
+    default:
+    {
+        const char* op = random_binary_ops[rnd_next() % ARRAY_SIZE(random_binary_ops)];
+        strcat(expr, "(");
+        strcat(expr_values, "(");
+        random_expr(expr, expr_values, vars, depth - 1);
+        strcat(expr, ") ");
+        strcat(expr_values, ") ");
+        strcat(expr, op);
+        strcat(expr_values, op);
+        strcat(expr, " (");
+        strcat(expr_values, " (");
+        random_expr(expr, expr_values, vars, depth - 1);
+        strcat(expr, ")");
+        strcat(expr_values, ")");
+        break;
+    }
+    }
+}
+
+static void check_folding(void)
+{
+    static char expr[1 << 16], expr_values[1 << 17];
+    int i;
+    for(i = 0; i < 2000; i++)
+    {
+        kedr_calc_int_t vars[ARRAY_SIZE(var_names)] = { 0 };
+        kedr_calc_t *calc, *calc_values;
+        kedr_calc_int_t result, result_values;
+
+        vars[var_times] = (kedr_calc_int_t)(rnd_next() % 20) - 5;
+        vars[var_pid] = (kedr_calc_int_t)(rnd_next() % 20) - 5;
+        vars[var_size] = (kedr_calc_int_t)(rnd_next() % 20) - 5;
+
+        expr[0] = '\0';
+        expr_values[0] = '\0';
+        random_expr(expr, expr_values, vars, 5);
+
+        calc = parse(expr);
+        calc_values = parse(expr_values);
+        if(calc == NULL || calc_values == NULL)
+        {
+            printf("FAIL: cannot parse '%s' or '%s'\n", expr, expr_values);
+            errors++;
+        }
+        else
+        {
+            result = kedr_calc_evaluate(calc, vars);
+            result_values = kedr_calc_evaluate(calc_values, vars);
+            if(result != result_values)
+            {
+                printf("FAIL: '%s' is %ld, but '%s' is %ld\n",
+                    expr, result, expr_values, result_values);
+                errors++;
+            }
+        }
+        if(calc) kedr_calc_delete(calc);
+        if(calc_values) kedr_calc_delete(calc_values);
+    }
+}
+
+/////////////////////////// Benchmark ////////////////////////////////
+
+static const char* bench_exprs[] = {
+    "0",
+    "times > 100",
+    "in_init && rnd100 < 10",
+    "!in_init && times % 10 = 0",
+    "size > PAGE_SIZE / 2 && (flags & GFP_ATOMIC) = 0",
+    "caller_address = 0x12345678 && times >= 3 && times <= 7",
+    "pid = 1234 ? rnd10000 < 5 : size > 1 << 16 || times = 1",
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void benchmark(long n_iterations)
+{
+    size_t i;
+    for(i = 0; i < ARRAY_SIZE(bench_exprs); i++)
+    {
+        kedr_calc_int_t vars[ARRAY_SIZE(var_names)];
+        kedr_calc_int_t sum = 0;
+        double start, elapsed;
+        long n;
+        kedr_calc_t* calc = parse(bench_exprs[i]);
+        if(calc == NULL)
+        {
+            printf("FAIL: cannot parse '%s'\n", bench_exprs[i]);
+            errors++;
+            continue;
+        }
+        vars[var_pid] = 1000;
+        vars[var_caller_address] = 0x12345678;
+        vars[var_flags] = 0xd0;
+        in_init_value = 0;
+
+        start = now();
+        for(n = 0; n < n_iterations; n++)
+        {
+            vars[var_times] = n;
+            vars[var_size] = n & 0xffff;
+            sum += kedr_calc_evaluate(calc, vars);
+        }
+        elapsed = now() - start;
+
+        printf("%-60s %12.0f evaluations/s (%ld true)\n",
+            bench_exprs[i], elapsed > 0 ? n_iterations / elapsed : 0.0, (long)sum);
+        kedr_calc_delete(calc);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    long n_iterations = 10000000;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            n_iterations = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n iterations]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // Errors in the invalid expressions are expected
+    fprintf(stderr, "Parse errors below are expected:\n");
+    check_invalid();
+    check_values();
+    check_folding();
+    if(errors)
+    {
+        printf("%d checks failed.\n", errors);
+        return 1;
+    }
+    printf("All checks passed.\n");
+
+    benchmark(n_iterations);
+    return errors ? 1 : 0;
+}
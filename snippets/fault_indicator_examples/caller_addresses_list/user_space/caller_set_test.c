@@ -0,0 +1,351 @@
+/*
+ * Test and benchmark of the set of caller addresses (caller_set.c),
+ * built in user space.
+ *
+ * First, the sets are created from the strings in all supported formats
+ * and the membership of addresses is checked, including the addresses
+ * near the bounds of the ranges.
+ *
+ * Then the number of lookups per second is output for the sets of
+ * different size, along with the same for the linear scan of the array
+ * of addresses, which is how a single address or a list of them is
+ * usually checked.
+ *
+ * Usage: caller_set_test [-n lookups]
+ *   -n - number of lookups for each size of the set (default: 10000000).
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/err.h>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "caller_set.h"
+
+DEFINE_MUTEX(module_mutex);
+
+static char target_core[0x300];
+static char target_init[0x100];
+
+static struct module modules[] = {
+    {
+        .name = "target",
+        .module_init = target_init,
+        .module_core = target_core,
+        .init_text_size = 0x80,
+        .core_text_size = 0x200,
+    },
+    {
+        .name = "target_without_init",
+        .module_core = target_core,
+        .core_text_size = 0x10,
+    },
+};
+
+struct module* find_module(const char* name)
+{
+    size_t i;
+    for(i = 0; i < ARRAY_SIZE(modules); i++)
+    {
+        if(strcmp(modules[i].name, name) == 0) return &modules[i];
+    }
+    return NULL;
+}
+
+static int errors = 0;
+
+static unsigned long rnd_state = 1;
+
+static unsigned long rnd_next(void)
+{
+    rnd_state = rnd_state * 1103515245UL + 12345UL;
+    return (rnd_state >> 16) & 0x7fff;
+}
+
+/////////////////////////// Checks ///////////////////////////////////
+
+static void check_contains(const char* str, const struct caller_set* set,
+    unsigned long address, int expected)
+{
+    if(!!caller_set_contains(set, (void*)address) != expected)
+    {
+        printf("FAIL: address 0x%lx %s be in the set '%s'\n",
+            address, expected ? "should" : "shouldn't", str);
+        errors++;
+    }
+}
+
+static void check_print(const char* str, const struct caller_set* set,
+    const char* expected)
+{
+    char buf[256];
+    size_t len = caller_set_print(NULL, 0, set);
+    if(len >= sizeof(buf) || caller_set_print(buf, sizeof(buf), set) != len
+        || strcmp(buf, expected))
+    {
+        printf("FAIL: set '%s' is printed as '%s' (expected '%s')\n",
+            str, len < sizeof(buf) ? buf : "<too long>", expected);
+        errors++;
+    }
+    // Truncated output should be terminated
+    if(len > 4)
+    {
+        caller_set_print(buf, 4, set);
+        if(strncmp(buf, expected, 3) || buf[3] != '\0')
+        {
+            printf("FAIL: truncated output of the set '%s' is incorrect\n", str);
+            errors++;
+        }
+    }
+}
+
+static struct caller_set* create(const char* str)
+{
+    struct caller_set* set = caller_set_create(str);
+    if(IS_ERR(set) || set == NULL)
+    {
+        printf("FAIL: cannot create set from '%s'\n", str);
+        errors++;
+        return NULL;
+    }
+    return set;
+}
+
+static void check_addresses(void)
+{
+    const char* str = "0x100 30,0x20\n0x1f 200-2ff 0x250-0x400 401";
+    struct caller_set* set = create(str);
+    if(set == NULL) return;
+
+    check_contains(str, set, 0x100, 1);
+    check_contains(str, set, 0xff, 0);
+    check_contains(str, set, 0x101, 0);
+    check_contains(str, set, 0x1e, 0);
+    check_contains(str, set, 0x1f, 1);
+    check_contains(str, set, 0x20, 1);
+    check_contains(str, set, 0x21, 0);
+    check_contains(str, set, 0x30, 1);
+    check_contains(str, set, 0x1ff, 0);
+    check_contains(str, set, 0x200, 1);
+    check_contains(str, set, 0x333, 1);
+    check_contains(str, set, 0x401, 1);
+    check_contains(str, set, 0x402, 0);
+    check_contains(str, set, 0, 0);
+    check_contains(str, set, ULONG_MAX, 0);
+    // Adjacent and overlapping ranges are merged
+    check_print(str, set, "0x1f-0x20\n0x30\n0x100\n0x200-0x401");
+
+    caller_set_destroy(set);
+}
+
+static void check_bounds(void)
+{
+    const char* str = "0 0xffffffffffffffff 0x10-0x10 0xfffffffffffffff0-0xfffffffffffffffe";
+    struct caller_set* set;
+
+    if(sizeof(unsigned long) != 8) return;
+
+    set = create(str);
+    if(set == NULL) return;
+
+    check_contains(str, set, 0, 1);
+    check_contains(str, set, 1, 0);
+    check_contains(str, set, 0x10, 1);
+    check_contains(str, set, 0xffffffffffffffefUL, 0);
+    check_contains(str, set, 0xfffffffffffffff0UL, 1);
+    check_contains(str, set, ULONG_MAX, 1);
+    check_print(str, set, "0x0\n0x10\n0xfffffffffffffff0-0xffffffffffffffff");
+
+    caller_set_destroy(set);
+}
+
+static void check_modules(void)
+{
+    const char* str = "target target:init";
+    unsigned long core = (unsigned long)target_core;
+    unsigned long init = (unsigned long)target_init;
+    struct caller_set* set = create(str);
+    if(set == NULL) return;
+
+    check_contains(str, set, core, 1);
+    check_contains(str, set, core + 0x1ff, 1);
+    check_contains(str, set, core + 0x200, 0);
+    check_contains(str, set, init, 1);
+    check_contains(str, set, init + 0x7f, 1);
+    check_contains(str, set, init + 0x80, 0);
+
+    caller_set_destroy(set);
+}
+
+static const char* invalid_strs[] = {
+    "0x10-",
+    "0x10-0x5",
+    "0x10-xyz",
+    "12z",
+    "0x10 -20",
+    "unknown_module",
+    "target:exit",
+    "target_without_init:init",
+};
+
+static void check_invalid(void)
+{
+    size_t i;
+    struct caller_set* set;
+
+    for(i = 0; i < ARRAY_SIZE(invalid_strs); i++)
+    {
+        set = caller_set_create(invalid_strs[i]);
+        if(!IS_ERR(set))
+        {
+            printf("FAIL: invalid string '%s' is accepted\n", invalid_strs[i]);
+            caller_set_destroy(set);
+            errors++;
+        }
+    }
+
+    set = caller_set_create(" \n, ");
+    if(set != NULL)
+    {
+        printf("FAIL: string without elements should result in NULL\n");
+        if(!IS_ERR(set)) caller_set_destroy(set);
+        errors++;
+    }
+}
+
+/////////////////////////// Benchmark ////////////////////////////////
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Return number of addresses found, so the loops are not optimized out.
+static long lookup_linear(const unsigned long* addresses, size_t n,
+    const unsigned long* lookups, long n_lookups)
+{
+    long i, found = 0;
+    for(i = 0; i < n_lookups; i++)
+    {
+        size_t j;
+        for(j = 0; j < n; j++)
+        {
+            if(addresses[j] == lookups[i & 1023])
+            {
+                found++;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+static long lookup_set(const struct caller_set* set,
+    const unsigned long* lookups, long n_lookups)
+{
+    long i, found = 0;
+    for(i = 0; i < n_lookups; i++)
+        found += caller_set_contains(set, (void*)lookups[i & 1023]);
+    return found;
+}
+
+static void benchmark(long n_lookups)
+{
+    static const size_t sizes[] = { 1, 16, 256, 4096 };
+    static unsigned long lookups[1024];
+    size_t i, j;
+
+    for(i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        size_t n = sizes[i];
+        unsigned long* addresses = malloc(n * sizeof(*addresses));
+        char* str = malloc(n * 20 + 1);
+        char* pos = str;
+        struct caller_set* set;
+        double start, time_linear, time_set;
+        long found_linear, found_set;
+        // Linear scan is slow, so less lookups are made for it
+        long n_lookups_linear = n_lookups / (n > 16 ? n / 16 : 1);
+
+        for(j = 0; j < n; j++)
+        {
+            addresses[j] = 0xffffffffa0000000UL + (rnd_next() << 8) + rnd_next();
+            pos += sprintf(pos, "0x%lx\n", addresses[j]);
+        }
+        // Half of the lookups are for the addresses in the set
+        for(j = 0; j < ARRAY_SIZE(lookups); j++)
+        {
+            lookups[j] = (j & 1) ? addresses[rnd_next() % n]
+                : 0xffffffffa0000000UL + (rnd_next() << 8) + rnd_next();
+        }
+
+        set = create(str);
+        if(set == NULL) return;
+
+        for(j = 0; j < ARRAY_SIZE(lookups); j++)
+        {
+            if(caller_set_contains(set, (void*)lookups[j])
+                != lookup_linear(addresses, n, &lookups[j], 1))
+            {
+                printf("FAIL: set and linear scan disagree about 0x%lx\n", lookups[j]);
+                errors++;
+            }
+        }
+
+        start = now();
+        found_linear = lookup_linear(addresses, n, lookups, n_lookups_linear);
+        time_linear = now() - start;
+
+        start = now();
+        found_set = lookup_set(set, lookups, n_lookups);
+        time_set = now() - start;
+
+        printf("%5zu addresses: %12.0f lookups/s in the set, %12.0f lookups/s with linear scan"
+            " (%ld and %ld found)\n",
+            n, time_set > 0 ? n_lookups / time_set : 0.0,
+            time_linear > 0 ? n_lookups_linear / time_linear : 0.0,
+            found_set, found_linear);
+
+        caller_set_destroy(set);
+        free(str);
+        free(addresses);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    long n_lookups = 10000000;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            n_lookups = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n lookups]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    fprintf(stderr, "Errors below are expected:\n");
+    check_invalid();
+    check_addresses();
+    check_bounds();
+    check_modules();
+    if(errors)
+    {
+        printf("%d checks failed.\n", errors);
+        return 1;
+    }
+    printf("All checks passed.\n");
+
+    benchmark(n_lookups);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Interface of the expression evaluator, as it is provided by KEDR
+ * (<kedr/calculator/calculator.h>), for the user-space build.
+ */
+
+#ifndef CALC_USER_CALCULATOR_H
+#define CALC_USER_CALCULATOR_H
+
+#include <linux/kernel.h>
+
+typedef long kedr_calc_int_t;
+
+// Named constant
+struct kedr_calc_const
+{
+    const char* name;
+    kedr_calc_int_t value;
+};
+
+// Array of constants
+struct kedr_calc_const_vec
+{
+    int n_elems;
+    const struct kedr_calc_const* elems;
+};
+
+// Variable which value is computed only when it is needed
+struct kedr_calc_weak_var
+{
+    const char* name;
+    kedr_calc_int_t (*compute)(void);
+};
+
+typedef struct kedr_calc kedr_calc_t;
+
+kedr_calc_t*
+kedr_calc_parse(const char* expr,
+    int const_vec_n, const struct kedr_calc_const_vec* const_vec,
+    int var_n, const char* const* var_names,
+    int weak_vars_n, const struct kedr_calc_weak_var* weak_vars);
+
+kedr_calc_int_t
+kedr_calc_evaluate(const kedr_calc_t* calc, const kedr_calc_int_t* var_values);
+
+void
+kedr_calc_delete(kedr_calc_t* calc);
+
+#endif /* CALC_USER_CALCULATOR_H */
@@ -0,0 +1,10 @@
+/*
+ * Character classes from the C library.
+ */
+
+#ifndef CALC_USER_CTYPE_H
+#define CALC_USER_CTYPE_H
+
+#include <ctype.h>
+
+#endif /* CALC_USER_CTYPE_H */
@@ -0,0 +1,27 @@
+/*
+ * Error codes encoded in pointers.
+ */
+
+#ifndef CALC_USER_ERR_H
+#define CALC_USER_ERR_H
+
+#include <errno.h>
+
+#define MAX_ERRNO 4095
+
+static inline void* ERR_PTR(long error)
+{
+    return (void*)error;
+}
+
+static inline long PTR_ERR(const void* ptr)
+{
+    return (long)ptr;
+}
+
+static inline long IS_ERR(const void* ptr)
+{
+    return (unsigned long)ptr >= (unsigned long)-MAX_ERRNO;
+}
+
+#endif /* CALC_USER_ERR_H */
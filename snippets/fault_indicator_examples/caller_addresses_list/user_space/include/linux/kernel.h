@@ -0,0 +1,43 @@
+/*
+ * Minimal user-space replacement of <linux/kernel.h> for building
+ * the calculator and the caller set as an ordinary program.
+ */
+
+#ifndef CALC_USER_KERNEL_H
+#define CALC_USER_KERNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h> /* ULONG_MAX */
+
+#define pr_err(fmt, ...) fprintf(stderr, fmt "\n", __VA_ARGS__)
+// Debug output is disabled, as in the kernel without DEBUG defined
+#define pr_debug(fmt, ...) do {} while(0)
+
+#define BUG()                                                   \
+do {                                                            \
+    fprintf(stderr, "BUG at %s:%d\n", __FILE__, __LINE__);      \
+    abort();                                                    \
+} while(0)
+
+#define BUG_ON(cond)                                            \
+do {                                                            \
+    if(cond)                                                    \
+        BUG();                                                  \
+} while(0)
+
+#define WARN_ON(cond)                                           \
+({                                                              \
+    int cond_ = !!(cond);                                       \
+    if(cond_)                                                   \
+        fprintf(stderr, "WARNING at %s:%d\n", __FILE__, __LINE__); \
+    cond_;                                                      \
+})
+
+#define simple_strtoul strtoul
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#endif /* CALC_USER_KERNEL_H */
@@ -0,0 +1,27 @@
+/*
+ * Fields of struct module used to determine code areas of the modules.
+ * find_module() is provided by the test program.
+ */
+
+#ifndef CALC_USER_MODULE_H
+#define CALC_USER_MODULE_H
+
+#include <linux/mutex.h>
+
+#define MODULE_NAME_LEN 60
+
+struct module
+{
+    char name[MODULE_NAME_LEN];
+
+    void* module_init;
+    void* module_core;
+    unsigned int init_text_size;
+    unsigned int core_text_size;
+};
+
+extern struct mutex module_mutex;
+
+struct module* find_module(const char* name);
+
+#endif /* CALC_USER_MODULE_H */
@@ -0,0 +1,32 @@
+/*
+ * Kernel mutexes mapped to pthread mutexes.
+ */
+
+#ifndef CALC_USER_MUTEX_H
+#define CALC_USER_MUTEX_H
+
+#include <pthread.h>
+
+struct mutex
+{
+    pthread_mutex_t m;
+};
+
+#define DEFINE_MUTEX(name) struct mutex name = { PTHREAD_MUTEX_INITIALIZER }
+
+static inline void mutex_init(struct mutex* mutex)
+{
+    pthread_mutex_init(&mutex->m, NULL);
+}
+
+static inline void mutex_lock(struct mutex* mutex)
+{
+    pthread_mutex_lock(&mutex->m);
+}
+
+static inline void mutex_unlock(struct mutex* mutex)
+{
+    pthread_mutex_unlock(&mutex->m);
+}
+
+#endif /* CALC_USER_MUTEX_H */
@@ -0,0 +1,11 @@
+/*
+ * <linux/types.h> from the system headers, with size_t.
+ */
+
+#ifndef CALC_USER_TYPES_H
+#define CALC_USER_TYPES_H
+
+#include <stddef.h>
+#include_next <linux/types.h>
+
+#endif /* CALC_USER_TYPES_H */
@@ -0,0 +1,20 @@
+/*
+ * vmalloc() and vfree() mapped to malloc() and free().
+ */
+
+#ifndef CALC_USER_VMALLOC_H
+#define CALC_USER_VMALLOC_H
+
+#include <stdlib.h>
+
+static inline void* vmalloc(unsigned long size)
+{
+    return malloc(size);
+}
+
+static inline void vfree(const void* p)
+{
+    free((void*)p);
+}
+
+#endif /* CALC_USER_VMALLOC_H */
@@ -89,6 +89,11 @@ void kedr_fsim_point_unregister(struct kedr_simulation_point* point);
  * 
  * Format of 'user_data' should correspond to the format string
  * used when point was registered.
+ *
+ * This function takes no locks and may be called in atomic context,
+ * concurrently with kedr_fsim_set_indicator(). The indicator function
+ * is called inside RCU read-side critical section, so it should not
+ * sleep.
  */
 
 int kedr_fsim_simulate(struct kedr_simulation_point* point,
@@ -114,8 +119,13 @@ int kedr_fsim_simulate(struct kedr_simulation_point* point,
  * If indicator format string do not correspond to format string of
  * simulation point, return 1.
  * 
+ * If there is not enough memory, return -ENOMEM.
+ * 
  * Otherwise set given indicator as current indicator,
  * used by point, and return 0.
+ *
+ * The previous indicator is destroyed after all kedr_fsim_simulate()
+ * calls that could use it have finished, so this function may sleep.
  */
 
 int kedr_fsim_set_indicator(const char* point_name,
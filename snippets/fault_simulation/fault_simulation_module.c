@@ -2,6 +2,12 @@
 #include <linux/slab.h>		/* kmalloc() */
 
 #include <linux/list.h>		/* list functions */
+#include <linux/string.h>	/* strcmp() */
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/dcache.h>	/* full_name_hash() */
+#include <linux/hash.h>		/* hash_32() */
+#include <linux/errno.h>
 
 #include <linux/module.h>
 
@@ -12,7 +18,13 @@ MODULE_LICENSE("GPL");
 #include "fault_simulation.h"
 
 /*
- * Information about indicator, that needed for correct work of simulate
+ * Information about indicator, that needed for correct work of simulate.
+ *
+ * The structure is never changed after it has been published in
+ * the simulation point, except 'module_gone'. Setting another indicator
+ * replaces the pointer, and the old structure is destroyed when no
+ * kedr_fsim_simulate() may use it any more (see
+ * fsim_set_indicator_internal()).
  */
 
 struct fault_indicator_info
@@ -21,26 +33,43 @@ struct fault_indicator_info
 	struct module* m;
 	void* indicator_state;
 	kedr_fsim_destroy_indicator_state destroy;
+	// point, for which indicator is set
+	struct kedr_simulation_point* point;
+	// Set when module 'm' is unloaded, 'fi' is not called after that.
+	int module_gone;
 };
 
 struct kedr_simulation_point
 {
-	struct list_head list;
+	struct hlist_node hlist;
 	
 	const char* name;
 	//string, described format of 'user_data' parameter,
 	//taken by simulate function
 	const char* format_string;
 	
-	struct fault_indicator_info current_indicator;
+	// NULL if no indicator is set.
+	// Readers use rcu_dereference(), writers - xchg().
+	struct fault_indicator_info* current_indicator;
 };
-// List of simulation points.
-LIST_HEAD(sim_points);
+
+// Hash table of simulation points, keyed by name.
+#define FSIM_HASH_BITS 6
+#define FSIM_HASH_SIZE (1 << FSIM_HASH_BITS)
+static struct hlist_head sim_points[FSIM_HASH_SIZE];
+
+// Protects 'sim_points' and serializes setting of indicators.
+// kedr_fsim_simulate() does not take it.
+static DEFINE_MUTEX(fsim_mutex);
 
 // Auxiliary functions
 
+// Return bucket in 'sim_points' for the point with given name.
+static struct hlist_head* fsim_point_bucket(const char* name);
+
 // Return simulation point with given name or NULL.
-struct kedr_simulation_point* fsim_lookup_point(const char* name);
+// Should be called with 'fsim_mutex' locked.
+static struct kedr_simulation_point* fsim_lookup_point(const char* name);
 
 /*
  *  Verify, whether data, which format is described in
@@ -53,24 +82,33 @@ struct kedr_simulation_point* fsim_lookup_point(const char* name);
 static int
 is_data_format_compatible(	const char* point_format_string,
 							const char* indicator_format_string);
-// Same as kedr_fsim_set_indicator but use point itself instead of its name
+// Same as kedr_fsim_set_indicator but use point itself instead of its name.
+// Should be called with 'fsim_mutex' locked.
 static int fsim_set_indicator_internal(struct kedr_simulation_point* point,
 	kedr_fsim_fault_indicator fi, const char* format_string,
 	struct module* m,
 	void* indicator_state, kedr_fsim_destroy_indicator_state destroy);
 
+// Wait while indicator may be used by kedr_fsim_simulate(),
+// then destroy it.
+static void fsim_indicator_release(struct fault_indicator_info* indicator);
+
 // Unset indicator.
 // Called when module, provided that indicator, is unloaded
 static void unset_indicator_callback(struct module* m,
-	struct fault_indicator_info* current_indicator);
+	struct fault_indicator_info* indicator);
 
 static void
 fsim_cleanup_module(void)
 {
-	while(!list_empty(&sim_points))
+	int i;
+	for(i = 0; i < FSIM_HASH_SIZE; i++)
 	{
-		kedr_fsim_point_unregister(list_entry(
-			sim_points.next, struct kedr_simulation_point, list));
+		while(!hlist_empty(&sim_points[i]))
+		{
+			kedr_fsim_point_unregister(hlist_entry(
+				sim_points[i].first, struct kedr_simulation_point, hlist));
+		}
 	}
 	module_weak_ref_destroy();
 }
@@ -108,19 +146,22 @@ kedr_fsim_point_register(const char* point_name,
 {
 	struct kedr_simulation_point* new_point;
 
-	if(fsim_lookup_point(point_name)) return NULL;
-	
 	new_point = kmalloc(sizeof(*new_point), GFP_KERNEL);
+	if(new_point == NULL) return NULL;
 	
 	new_point->name = point_name;
 	new_point->format_string = format_string;
+	new_point->current_indicator = NULL;
 	
-	new_point->current_indicator.fi = NULL;
-	new_point->current_indicator.m = NULL;
-	new_point->current_indicator.indicator_state = NULL;
-	new_point->current_indicator.destroy = NULL;
-	
-	list_add_tail(&new_point->list, &sim_points);
+	mutex_lock(&fsim_mutex);
+	if(fsim_lookup_point(point_name))
+	{
+		mutex_unlock(&fsim_mutex);
+		kfree(new_point);
+		return NULL;
+	}
+	hlist_add_head(&new_point->hlist, fsim_point_bucket(point_name));
+	mutex_unlock(&fsim_mutex);
 	return new_point;
 }
 EXPORT_SYMBOL(kedr_fsim_point_register);
@@ -134,11 +175,13 @@ EXPORT_SYMBOL(kedr_fsim_point_register);
 
 void kedr_fsim_point_unregister(struct kedr_simulation_point* point)
 {
+	mutex_lock(&fsim_mutex);
 	fsim_set_indicator_internal(point, NULL, NULL, NULL, NULL, NULL);
-	list_del(&point->list);
+	hlist_del(&point->hlist);
+	mutex_unlock(&fsim_mutex);
 	
 	kfree(point);
-	
+
 }
 EXPORT_SYMBOL(kedr_fsim_point_unregister);
 
@@ -148,16 +191,26 @@ EXPORT_SYMBOL(kedr_fsim_point_unregister);
  * 
  * Format of 'user_data' should correspond to the format string
  * used when point was registered.
+ *
+ * This function takes no locks and may be called in atomic context,
+ * concurrently with kedr_fsim_set_indicator(). The indicator function
+ * is called inside RCU read-side critical section, so it should not
+ * sleep.
  */
 
 int kedr_fsim_simulate(struct kedr_simulation_point* point,
 	void* user_data)
 {
-	return point->current_indicator.fi 
-			? point->current_indicator.fi(
-				point->current_indicator.indicator_state,
-				user_data)
-			: 0;
+	int result = 0;
+	struct fault_indicator_info* indicator;
+	
+	rcu_read_lock();
+	indicator = rcu_dereference(point->current_indicator);
+	if(indicator && indicator->fi && !ACCESS_ONCE(indicator->module_gone))
+		result = indicator->fi(indicator->indicator_state, user_data);
+	rcu_read_unlock();
+	
+	return result;
 }
 EXPORT_SYMBOL(kedr_fsim_simulate);
 
@@ -181,8 +234,13 @@ EXPORT_SYMBOL(kedr_fsim_simulate);
  * If indicator format string do not correspond to format string of
  * simulation point, return 1.
  * 
+ * If there is not enough memory, return -ENOMEM.
+ * 
  * Otherwise set given indicator as current indicator,
  * used by point, and return 0.
+ *
+ * The previous indicator is destroyed after all kedr_fsim_simulate()
+ * calls that could use it have finished, so this function may sleep.
  */
 
 int kedr_fsim_set_indicator(const char* point_name,
@@ -190,12 +248,19 @@ int kedr_fsim_set_indicator(const char* point_name,
 	struct module* m,
 	void* indicator_state, kedr_fsim_destroy_indicator_state destroy)
 {
-	struct kedr_simulation_point* point = fsim_lookup_point(point_name);
+	int result;
+	struct kedr_simulation_point* point;
 	
-	if(point == NULL) return -1;
-
-	return fsim_set_indicator_internal(point, fi, format_string,
-		m, indicator_state, destroy);
+	mutex_lock(&fsim_mutex);
+	point = fsim_lookup_point(point_name);
+	if(point == NULL)
+		result = -1;
+	else
+		result = fsim_set_indicator_internal(point, fi, format_string,
+			m, indicator_state, destroy);
+	mutex_unlock(&fsim_mutex);
+	
+	return result;
 }
 EXPORT_SYMBOL(kedr_fsim_set_indicator);
 
@@ -227,48 +292,115 @@ fsim_set_indicator_internal(struct kedr_simulation_point* point,
 	struct module* m,
 	void* indicator_state, kedr_fsim_destroy_indicator_state destroy)
 {
-	struct fault_indicator_info* current_indicator =
-		&point->current_indicator;
+	struct fault_indicator_info* new_indicator = NULL;
+	struct fault_indicator_info* old_indicator;
+	
 	if(!is_data_format_compatible(point->format_string,
 								format_string))
 	{
 		return 1;
 	}
 	
-	if(current_indicator->destroy)
-		current_indicator->destroy(current_indicator->indicator_state);
-	if(current_indicator->m)
-		module_weak_unref(current_indicator->m, 
-			(destroy_notify)unset_indicator_callback, current_indicator);
+	if(fi)
+	{
+		new_indicator = kmalloc(sizeof(*new_indicator), GFP_KERNEL);
+		if(new_indicator == NULL) return -ENOMEM;
+		
+		new_indicator->fi = fi;
+		new_indicator->m = m;
+		new_indicator->indicator_state = indicator_state;
+		new_indicator->destroy = destroy;
+		new_indicator->point = point;
+		new_indicator->module_gone = 0;
+		
+		if(m)
+			module_weak_ref(m, 
+				(destroy_notify)unset_indicator_callback, new_indicator);
+	}
+	else if(destroy)
+	{
+		// Nobody will use the state, destroy it at once.
+		destroy(indicator_state);
+	}
 	
-	current_indicator->fi = fi;
-	current_indicator->m = m;
-	current_indicator->indicator_state = indicator_state;
-	current_indicator->destroy = destroy;
-
-	if(m)
-		module_weak_ref(m, 
-			(destroy_notify)unset_indicator_callback, current_indicator);
+	// xchg() orders initialization of the new indicator before its
+	// publication, as rcu_assign_pointer() does.
+	// The one who removes the indicator from the point frees it:
+	// unset_indicator_callback() may try to do the same.
+	old_indicator = xchg(&point->current_indicator, new_indicator);
+	if(old_indicator)
+	{
+		if(old_indicator->m)
+		{
+			// The module of the old indicator may be unloading now.
+			// unset_indicator_callback() destroys the state either here
+			// or from the unload notification, in both cases while
+			// the module is still in memory.
+			module_weak_unref_notify(old_indicator->m, 
+				(destroy_notify)unset_indicator_callback, old_indicator);
+			kfree(old_indicator);
+		}
+		else
+			fsim_indicator_release(old_indicator);
+	}
 	return 0;
 }
 
+static void fsim_indicator_release(struct fault_indicator_info* indicator)
+{
+	// Wait until all kedr_fsim_simulate() calls that could see
+	// the indicator have finished.
+	synchronize_rcu();
+	
+	if(indicator->destroy)
+		indicator->destroy(indicator->indicator_state);
+	kfree(indicator);
+}
+
+/*
+ * Called with the lock of module_weak_ref held, while the code of module
+ * 'm' is still in memory: when 'm' is unloaded or from
+ * fsim_set_indicator_internal() for the indicator it has removed from
+ * the point. After return, neither 'fi' nor 'destroy' of the indicator
+ * may be called.
+ */
 static void unset_indicator_callback(struct module* m,
-	struct fault_indicator_info* current_indicator)
+	struct fault_indicator_info* indicator)
+{
+	struct kedr_simulation_point* point = indicator->point;
+	
+	// kedr_fsim_simulate() calls started after synchronize_rcu()
+	// will see the flag, even if the indicator is still in the point
+	// (it may be published after this callback).
+	ACCESS_ONCE(indicator->module_gone) = 1;
+	
+	if(cmpxchg(&point->current_indicator, indicator, NULL) == indicator)
+	{
+		// Nobody else may access the indicator now.
+		fsim_indicator_release(indicator);
+		return;
+	}
+	
+	// Another indicator has been set, or this one is not published yet.
+	// fsim_set_indicator_internal() will free the indicator,
+	// but the state should be destroyed now.
+	synchronize_rcu();
+	if(indicator->destroy)
+		indicator->destroy(indicator->indicator_state);
+}
+
+static struct hlist_head* fsim_point_bucket(const char* name)
 {
-	if(current_indicator->destroy)
-		current_indicator->destroy(current_indicator->indicator_state);
-
-	current_indicator->fi = NULL;
-	current_indicator->m = NULL;
-	current_indicator->indicator_state = NULL;
-	current_indicator->destroy = NULL;
-	//Because it is result on module unloaded, doesn't perform weak_unref
+	unsigned int hash = full_name_hash((const unsigned char*)name,
+		strlen(name));
+	return &sim_points[hash_32(hash, FSIM_HASH_BITS)];
 }
 
-struct kedr_simulation_point* fsim_lookup_point(const char* name)
+static struct kedr_simulation_point* fsim_lookup_point(const char* name)
 {
 	struct kedr_simulation_point* point;
-	list_for_each_entry(point, &sim_points, list)
+	struct hlist_node* node;
+	hlist_for_each_entry(point, node, fsim_point_bucket(name), hlist)
 	{
 		if(strcmp(name, point->name) == 0) return point;
 	}
@@ -1,6 +1,8 @@
 #include "module_weak_ref.h"
 
 #include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
 
 struct destroy_data
 {
@@ -17,8 +19,15 @@ struct module_weak_ref_data
 };
 
 LIST_HEAD(module_weak_ref_list);
+// Protects 'module_weak_ref_list'.
+// It is held while 'destroy' functions are called.
+static DEFINE_MUTEX(module_weak_ref_mutex);
 // Auxiliary functions
 static struct module_weak_ref_data* get_module_node(struct module* m);
+// Cancel sheduling, return 0 if 'destroy' has already been called.
+// Should be called with 'module_weak_ref_mutex' locked.
+static int module_weak_unref_locked(struct module* m,
+	destroy_notify destroy, void* user_data);
 
 // Called when some module is unloading.
 static int 
@@ -49,7 +58,10 @@ void module_weak_ref(struct module* m,
 	destroy_notify destroy, void* user_data)
 {
 	struct destroy_data* ddata;
-	struct module_weak_ref_data* mdata = get_module_node(m);
+	struct module_weak_ref_data* mdata;
+	
+	mutex_lock(&module_weak_ref_mutex);
+	mdata = get_module_node(m);
 	if(mdata == NULL)
 	{
 		mdata = kmalloc(sizeof(*mdata), GFP_KERNEL);
@@ -61,21 +73,44 @@ void module_weak_ref(struct module* m,
 	ddata->destroy = destroy;
 	ddata->user_data = user_data;
 	list_add_tail(&ddata->list, &mdata->destroy_data);
+	mutex_unlock(&module_weak_ref_mutex);
 }
 // Cancel sheduling.
 void module_weak_unref(struct module* m,
 	destroy_notify destroy, void* user_data)
+{
+	mutex_lock(&module_weak_ref_mutex);
+	module_weak_unref_locked(m, destroy, user_data);
+	mutex_unlock(&module_weak_ref_mutex);
+}
+// Cancel sheduling and call 'destroy' now.
+void module_weak_unref_notify(struct module* m,
+	destroy_notify destroy, void* user_data)
+{
+	mutex_lock(&module_weak_ref_mutex);
+	if(module_weak_unref_locked(m, destroy, user_data))
+		destroy(m, user_data);
+	mutex_unlock(&module_weak_ref_mutex);
+}
+
+static int module_weak_unref_locked(struct module* m,
+	destroy_notify destroy, void* user_data)
 {
 	struct destroy_data* ddata;
-	struct module_weak_ref_data* mdata = get_module_node(m);
+	struct module_weak_ref_data* mdata;
+	int found = 0;
+	
+	mdata = get_module_node(m);
+	// 'destroy' may have already been called, if module is unloading
+	if(mdata == NULL) return 0;
 	
-	BUG_ON(mdata == NULL);
 	list_for_each_entry(ddata, &mdata->destroy_data, list)
 	{
 		if(ddata->destroy == destroy && ddata->user_data == user_data)
 		{
 			list_del(&ddata->list);
 			kfree(ddata);
+			found = 1;
 			break;
 		}
 	}
@@ -84,6 +119,7 @@ void module_weak_unref(struct module* m,
 		list_del(&mdata->list);
 		kfree(mdata);
 	}
+	return found;
 }
 
 static struct module_weak_ref_data* get_module_node(struct module* m)
@@ -104,8 +140,13 @@ detector_modules_unload(struct notifier_block *nb,
 	struct destroy_data* ddata, *tmp;
 	//If module is not unloading do nothing
 	if(mod_state != MODULE_STATE_GOING) return 0;
+	mutex_lock(&module_weak_ref_mutex);
 	mdata = get_module_node(vmod);
-	if(mdata == NULL) return 0;
+	if(mdata == NULL)
+	{
+		mutex_unlock(&module_weak_ref_mutex);
+		return 0;
+	}
 	
 	list_for_each_entry_safe(ddata, tmp, &mdata->destroy_data, list)
 	{
@@ -115,5 +156,6 @@ detector_modules_unload(struct notifier_block *nb,
 	}
 	list_del(&mdata->list);
 	kfree(mdata);
+	mutex_unlock(&module_weak_ref_mutex);
 	return 0;
 }
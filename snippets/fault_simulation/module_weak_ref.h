@@ -18,11 +18,20 @@ int module_weak_ref_init(void);
 // Should be called when the functionality will no longer be used.
 void module_weak_ref_destroy(void);
 // Shedule 'destroy' function to call when module is unloaded.
+// 'destroy' is called with the internal lock held, so it should not
+// call module_weak_ref() or module_weak_unref().
 void module_weak_ref(struct module* m,
 	destroy_notify destroy, void* user_data);
 // Cancel sheduling.
+// If 'destroy' has already been called, do nothing.
+// When returns, 'destroy' is not running for this 'user_data'.
 void module_weak_unref(struct module* m,
 	destroy_notify destroy, void* user_data);
+// Cancel sheduling and call 'destroy' now, with the internal lock held,
+// so module 'm' cannot be unloaded until it returns.
+// If 'destroy' has already been called, do nothing.
+void module_weak_unref_notify(struct module* m,
+	destroy_notify destroy, void* user_data);
 
 
 
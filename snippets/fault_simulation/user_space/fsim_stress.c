@@ -0,0 +1,282 @@
+/*
+ * Concurrent stress test of the fault simulation module, built in user
+ * space.
+ *
+ * Reader threads call kedr_fsim_simulate() for a few points in a loop.
+ * Writer threads set new indicators for these points, clear them and
+ * "unload" the modules that provided them, while another thread
+ * registers and unregisters points with other names. Each indicator
+ * checks that its state has not been destroyed yet; the destroy
+ * function poisons the state before freeing it. Both check also that
+ * the module which provided the indicator has not been "unloaded" since
+ * the indicator was set: neither may run after the unload notification
+ * has returned.
+ *
+ * Usage: fsim_stress [-r readers] [-n iterations]
+ *   -r - number of reader threads (default: 4),
+ *   -n - number of iterations per writer thread (default: 20000).
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fault_simulation.h"
+
+int fsim_user_init(void);
+void fsim_user_exit(void);
+
+#define STRESS_NUM_POINTS 4
+#define STRESS_NUM_WRITERS 2
+#define STRESS_NUM_MODULES 8
+
+#define STATE_ALIVE 0x600dUL
+#define STATE_DEAD 0xdeadUL
+
+// A module providing indicators. Setting an indicator and unloading
+// the module are not performed at the same time, as in the kernel.
+struct stress_module
+{
+	struct module m;
+	pthread_rwlock_t lock;
+	// Incremented after each unload notification has returned.
+	unsigned long unloads;
+};
+
+struct indicator_state
+{
+	unsigned long magic;
+	unsigned long value;
+	struct stress_module* module;
+	// 'unloads' of the module when the indicator was set.
+	unsigned long generation;
+};
+
+static const char* point_names[STRESS_NUM_POINTS] = {
+	"kmalloc", "kmem_cache_alloc", "vmalloc", "alloc_pages"
+};
+static struct kedr_simulation_point* points[STRESS_NUM_POINTS];
+
+static struct stress_module modules[STRESS_NUM_MODULES];
+
+static int stop_readers = 0;
+static unsigned long errors = 0;
+static unsigned long states_created = 0;
+static unsigned long states_destroyed = 0;
+
+// Whether the module providing the indicator has been unloaded since
+// the indicator was set.
+static int module_unloaded(struct indicator_state* s)
+{
+	return __atomic_load_n(&s->module->unloads, __ATOMIC_SEQ_CST)
+		!= s->generation;
+}
+
+static int indicator(void* state, void* user_data)
+{
+	struct indicator_state* s = state;
+	if(__atomic_load_n(&s->magic, __ATOMIC_RELAXED) != STATE_ALIVE
+		|| module_unloaded(s))
+		__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+	return (int)(s->value & 1);
+}
+
+static void destroy_state(void* state)
+{
+	struct indicator_state* s = state;
+	if(s->magic != STATE_ALIVE || module_unloaded(s))
+		__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+	s->magic = STATE_DEAD;
+	__atomic_add_fetch(&states_destroyed, 1, __ATOMIC_RELAXED);
+	free(s);
+}
+
+static void* reader_thread(void* arg)
+{
+	unsigned long* calls = arg;
+	size_t size = 0;
+	unsigned int i = 0;
+	
+	while(!__atomic_load_n(&stop_readers, __ATOMIC_RELAXED))
+	{
+		kedr_fsim_simulate(points[i % STRESS_NUM_POINTS], &size);
+		++i;
+	}
+	*calls = i;
+	return NULL;
+}
+
+struct writer
+{
+	pthread_t thread;
+	unsigned int index;
+	unsigned long iterations;
+};
+
+static void* writer_thread(void* arg)
+{
+	struct writer* w = arg;
+	unsigned int seed = w->index + 1;
+	unsigned long i;
+	
+	for(i = 0; i < w->iterations; i++)
+	{
+		unsigned int point = rand_r(&seed) % STRESS_NUM_POINTS;
+		struct stress_module* m =
+			&modules[rand_r(&seed) % STRESS_NUM_MODULES];
+		struct indicator_state* s;
+		
+		switch(rand_r(&seed) % 8)
+		{
+		case 0:
+			// Clear the indicator.
+			kedr_fsim_set_indicator(point_names[point], NULL, NULL,
+				NULL, NULL, NULL);
+			break;
+		case 1:
+			// The module providing indicators is unloading.
+			pthread_rwlock_wrlock(&m->lock);
+			fsim_user_unload_module(&m->m);
+			__atomic_add_fetch(&m->unloads, 1, __ATOMIC_SEQ_CST);
+			pthread_rwlock_unlock(&m->lock);
+			break;
+		default:
+			pthread_rwlock_rdlock(&m->lock);
+			s = malloc(sizeof(*s));
+			s->magic = STATE_ALIVE;
+			s->value = i;
+			s->module = m;
+			s->generation = __atomic_load_n(&m->unloads, __ATOMIC_SEQ_CST);
+			__atomic_add_fetch(&states_created, 1, __ATOMIC_RELAXED);
+			if(kedr_fsim_set_indicator(point_names[point], indicator,
+				"size_t", &m->m, s, destroy_state) != 0)
+			{
+				__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+				destroy_state(s);
+			}
+			pthread_rwlock_unlock(&m->lock);
+		}
+	}
+	return NULL;
+}
+
+// Registers and unregisters the points with other names, checking that
+// a name cannot be registered twice.
+static void* register_thread(void* arg)
+{
+	unsigned long iterations = *(unsigned long*)arg;
+	unsigned long i;
+	char names[16][16];
+	
+	for(i = 0; i < 16; i++)
+		snprintf(names[i], sizeof(names[i]), "point%lu", i);
+	
+	for(i = 0; i < iterations; i++)
+	{
+		const char* name = names[i % 16];
+		struct kedr_simulation_point* p =
+			kedr_fsim_point_register(name, "size_t");
+		if(p == NULL
+			|| kedr_fsim_point_register(name, "size_t") != NULL
+			|| kedr_fsim_point_register(point_names[i % STRESS_NUM_POINTS],
+				"size_t") != NULL)
+		{
+			__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+		}
+		if(p) kedr_fsim_point_unregister(p);
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int num_readers = 4;
+	unsigned long iterations = 20000;
+	pthread_t* readers;
+	unsigned long* calls;
+	struct writer writers[STRESS_NUM_WRITERS];
+	pthread_t reg;
+	unsigned long total_calls = 0;
+	struct timespec start, end;
+	double seconds;
+	unsigned int i;
+	int opt;
+	
+	while((opt = getopt(argc, argv, "r:n:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'r': num_readers = strtoul(optarg, NULL, 0); break;
+		case 'n': iterations = strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "Usage: %s [-r readers] [-n iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	
+	for(i = 0; i < STRESS_NUM_MODULES; i++)
+		pthread_rwlock_init(&modules[i].lock, NULL);
+	
+	if(fsim_user_init() != 0) return 1;
+	for(i = 0; i < STRESS_NUM_POINTS; i++)
+	{
+		points[i] = kedr_fsim_point_register(point_names[i], "size_t");
+		if(points[i] == NULL) return 1;
+	}
+	
+	readers = calloc(num_readers, sizeof(*readers));
+	calls = calloc(num_readers, sizeof(*calls));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < num_readers; i++)
+		pthread_create(&readers[i], NULL, reader_thread, &calls[i]);
+	for(i = 0; i < STRESS_NUM_WRITERS; i++)
+	{
+		writers[i].index = i;
+		writers[i].iterations = iterations;
+		pthread_create(&writers[i].thread, NULL, writer_thread, &writers[i]);
+	}
+	pthread_create(&reg, NULL, register_thread, &iterations);
+	
+	for(i = 0; i < STRESS_NUM_WRITERS; i++)
+		pthread_join(writers[i].thread, NULL);
+	pthread_join(reg, NULL);
+	__atomic_store_n(&stop_readers, 1, __ATOMIC_RELAXED);
+	for(i = 0; i < num_readers; i++)
+	{
+		pthread_join(readers[i], NULL);
+		total_calls += calls[i];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (end.tv_sec - start.tv_sec) + 
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	
+	// Unregistering the points destroys the remaining indicators.
+	for(i = 0; i < STRESS_NUM_POINTS; i++)
+		kedr_fsim_point_unregister(points[i]);
+	fsim_user_exit();
+	
+	if(states_created != states_destroyed)
+	{
+		fprintf(stderr, "%lu indicator states created, %lu destroyed\n",
+			states_created, states_destroyed);
+		errors++;
+	}
+	
+	printf("%u readers, %u writers: %lu simulate calls in %.2f s, "
+		"%lu indicators set\n", num_readers, STRESS_NUM_WRITERS,
+		total_calls, seconds, states_created);
+	free(readers);
+	free(calls);
+	
+	if(errors != 0)
+	{
+		fprintf(stderr, "FAILED: %lu errors\n", errors);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * User-space implementation of RCU and module notifiers
+ * for the model of the fault simulation module.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/rcupdate.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+__thread struct rcu_user_reader* rcu_user_self = NULL;
+
+// The readers are never removed, so synchronize_rcu() may walk the list
+// without a lock.
+static struct rcu_user_reader* rcu_user_readers = NULL;
+static pthread_mutex_t rcu_user_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct rcu_user_reader* rcu_user_register(void)
+{
+	struct rcu_user_reader* r = calloc(1, sizeof(*r));
+	BUG_ON(r == NULL);
+	
+	pthread_mutex_lock(&rcu_user_mutex);
+	r->next = rcu_user_readers;
+	__atomic_store_n(&rcu_user_readers, r, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&rcu_user_mutex);
+	
+	rcu_user_self = r;
+	return r;
+}
+
+void synchronize_rcu(void)
+{
+	struct rcu_user_reader* r;
+	
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for(r = __atomic_load_n(&rcu_user_readers, __ATOMIC_ACQUIRE);
+		r != NULL; r = r->next)
+	{
+		unsigned long ctr = __atomic_load_n(&r->ctr, __ATOMIC_SEQ_CST);
+		if((ctr & 1) == 0) continue;
+		while(__atomic_load_n(&r->ctr, __ATOMIC_SEQ_CST) == ctr)
+			sched_yield();
+	}
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+// Only one notifier (of module_weak_ref) is used.
+static struct notifier_block* module_nb = NULL;
+
+int register_module_notifier(struct notifier_block* nb)
+{
+	BUG_ON(module_nb != NULL);
+	module_nb = nb;
+	return 0;
+}
+
+int unregister_module_notifier(struct notifier_block* nb)
+{
+	BUG_ON(module_nb != nb);
+	module_nb = NULL;
+	return 0;
+}
+
+void fsim_user_unload_module(struct module* m)
+{
+	if(module_nb)
+		module_nb->notifier_call(module_nb, MODULE_STATE_GOING, m);
+}
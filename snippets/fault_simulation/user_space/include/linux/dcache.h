@@ -0,0 +1,23 @@
+/*
+ * full_name_hash() for user space, same as in the kernel.
+ */
+
+#ifndef FSIM_USER_DCACHE_H
+#define FSIM_USER_DCACHE_H
+
+static inline unsigned long partial_name_hash(unsigned long c,
+	unsigned long prevhash)
+{
+	return (prevhash + (c << 4) + (c >> 4)) * 11;
+}
+
+static inline unsigned int full_name_hash(const unsigned char* name,
+	unsigned int len)
+{
+	unsigned long hash = 0;
+	while(len--)
+		hash = partial_name_hash(*name++, hash);
+	return (unsigned int)hash;
+}
+
+#endif /* FSIM_USER_DCACHE_H */
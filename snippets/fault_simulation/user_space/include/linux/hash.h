@@ -0,0 +1,16 @@
+/*
+ * hash_32() for user space, same as in the kernel.
+ */
+
+#ifndef FSIM_USER_HASH_H
+#define FSIM_USER_HASH_H
+
+#define GOLDEN_RATIO_PRIME_32 0x9e370001UL
+
+static inline unsigned int hash_32(unsigned int val, unsigned int bits)
+{
+	unsigned int hash = val * GOLDEN_RATIO_PRIME_32;
+	return hash >> (32 - bits);
+}
+
+#endif /* FSIM_USER_HASH_H */
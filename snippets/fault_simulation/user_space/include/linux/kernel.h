@@ -0,0 +1,43 @@
+/*
+ * Minimal user-space replacement of <linux/kernel.h> for building
+ * the fault simulation module as an ordinary program.
+ */
+
+#ifndef FSIM_USER_KERNEL_H
+#define FSIM_USER_KERNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#define KERN_ERR	""
+#define KERN_WARNING	""
+#define KERN_INFO	""
+
+#define printk printf
+
+#define BUG_ON(cond)							\
+do {									\
+	if(cond)							\
+	{								\
+		fprintf(stderr, "BUG at %s:%d\n", __FILE__, __LINE__);	\
+		abort();						\
+	}								\
+} while(0)
+
+#define container_of(ptr, type, member) \
+	((type*)((char*)(ptr) - offsetof(type, member)))
+
+#define ACCESS_ONCE(x) (*(volatile __typeof__(x)*)&(x))
+
+// Both are full memory barriers, as in the kernel.
+#define xchg(ptr, v) __atomic_exchange_n((ptr), (v), __ATOMIC_SEQ_CST)
+#define cmpxchg(ptr, old, v)						\
+({									\
+	__typeof__(*(ptr)) old_ = (old);				\
+	__atomic_compare_exchange_n((ptr), &old_, (v), 0,		\
+		__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);			\
+	old_;								\
+})
+
+#endif /* FSIM_USER_KERNEL_H */
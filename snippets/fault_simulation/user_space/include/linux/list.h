@@ -0,0 +1,98 @@
+/*
+ * The part of <linux/list.h> used by the fault simulation module,
+ * for user space.
+ */
+
+#ifndef FSIM_USER_LIST_H
+#define FSIM_USER_LIST_H
+
+#include <linux/kernel.h>
+
+struct list_head
+{
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+#define LIST_HEAD(name) struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head* list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void list_add_tail(struct list_head* item,
+	struct list_head* head)
+{
+	item->prev = head->prev;
+	item->next = head;
+	head->prev->next = item;
+	head->prev = item;
+}
+
+static inline void list_del(struct list_head* item)
+{
+	item->prev->next = item->next;
+	item->next->prev = item->prev;
+	item->next = item->prev = NULL;
+}
+
+static inline int list_empty(const struct list_head* head)
+{
+	return head->next == head;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define list_for_each_entry(pos, head, member)				\
+	for(pos = list_entry((head)->next, __typeof__(*pos), member);	\
+		&pos->member != (head);					\
+		pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+#define list_for_each_entry_safe(pos, n, head, member)			\
+	for(pos = list_entry((head)->next, __typeof__(*pos), member),	\
+		n = list_entry(pos->member.next, __typeof__(*pos), member); \
+		&pos->member != (head);					\
+		pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+struct hlist_head
+{
+	struct hlist_node* first;
+};
+
+struct hlist_node
+{
+	struct hlist_node *next, **pprev;
+};
+
+static inline int hlist_empty(const struct hlist_head* h)
+{
+	return h->first == NULL;
+}
+
+static inline void hlist_add_head(struct hlist_node* n,
+	struct hlist_head* h)
+{
+	n->next = h->first;
+	if(h->first) h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+static inline void hlist_del(struct hlist_node* n)
+{
+	*n->pprev = n->next;
+	if(n->next) n->next->pprev = n->pprev;
+	n->next = NULL;
+	n->pprev = NULL;
+}
+
+#define hlist_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define hlist_for_each_entry(tpos, pos, head, member)			\
+	for(pos = (head)->first;					\
+		pos && ((tpos = hlist_entry(pos, __typeof__(*tpos), member)), 1); \
+		pos = pos->next)
+
+#endif /* FSIM_USER_LIST_H */
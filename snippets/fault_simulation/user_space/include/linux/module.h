@@ -0,0 +1,43 @@
+/*
+ * The part of <linux/module.h> used by the fault simulation module,
+ * for user space. Modules are plain structures here, and the test
+ * "unloads" a module with fsim_user_unload_module().
+ */
+
+#ifndef FSIM_USER_MODULE_H
+#define FSIM_USER_MODULE_H
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+
+struct module
+{
+	const char* name;
+};
+
+#define MODULE_AUTHOR(s)
+#define MODULE_LICENSE(s)
+#define EXPORT_SYMBOL(sym)
+#define __init
+
+// Module init and exit functions become fsim_user_init()/exit().
+#define module_init(fn) int fsim_user_init(void) { return fn(); }
+#define module_exit(fn) void fsim_user_exit(void) { fn(); }
+
+#define MODULE_STATE_GOING 2
+
+struct notifier_block
+{
+	int (*notifier_call)(struct notifier_block* nb,
+		unsigned long action, void* data);
+	struct notifier_block* next;
+	int priority;
+};
+
+int register_module_notifier(struct notifier_block* nb);
+int unregister_module_notifier(struct notifier_block* nb);
+
+// Call the module notifier as if module 'm' was unloading.
+void fsim_user_unload_module(struct module* m);
+
+#endif /* FSIM_USER_MODULE_H */
@@ -0,0 +1,20 @@
+/*
+ * Kernel mutexes mapped to pthread mutexes.
+ */
+
+#ifndef FSIM_USER_MUTEX_H
+#define FSIM_USER_MUTEX_H
+
+#include <pthread.h>
+
+struct mutex
+{
+	pthread_mutex_t m;
+};
+
+#define DEFINE_MUTEX(name) struct mutex name = { PTHREAD_MUTEX_INITIALIZER }
+
+#define mutex_lock(lock) pthread_mutex_lock(&(lock)->m)
+#define mutex_unlock(lock) pthread_mutex_unlock(&(lock)->m)
+
+#endif /* FSIM_USER_MUTEX_H */
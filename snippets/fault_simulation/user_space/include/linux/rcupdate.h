@@ -0,0 +1,43 @@
+/*
+ * RCU for user space: readers are registered on their first
+ * rcu_read_lock(), synchronize_rcu() waits until each reader that was
+ * inside a read-side critical section leaves it. This is enough to test
+ * that old data are not destroyed while readers may use them.
+ */
+
+#ifndef FSIM_USER_RCUPDATE_H
+#define FSIM_USER_RCUPDATE_H
+
+struct rcu_user_reader
+{
+	// Odd when the thread is inside read-side critical section.
+	unsigned long ctr;
+	unsigned int nesting;
+	struct rcu_user_reader* next;
+};
+
+extern __thread struct rcu_user_reader* rcu_user_self;
+
+struct rcu_user_reader* rcu_user_register(void);
+
+static inline void rcu_read_lock(void)
+{
+	struct rcu_user_reader* r = rcu_user_self;
+	if(r == NULL) r = rcu_user_register();
+	if(r->nesting++ == 0)
+		__atomic_fetch_add(&r->ctr, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void rcu_read_unlock(void)
+{
+	struct rcu_user_reader* r = rcu_user_self;
+	if(--r->nesting == 0)
+		__atomic_fetch_add(&r->ctr, 1, __ATOMIC_SEQ_CST);
+}
+
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+void synchronize_rcu(void);
+
+#endif /* FSIM_USER_RCUPDATE_H */
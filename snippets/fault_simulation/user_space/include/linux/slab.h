@@ -0,0 +1,25 @@
+/*
+ * Kernel memory allocation functions mapped to malloc() and free().
+ */
+
+#ifndef FSIM_USER_SLAB_H
+#define FSIM_USER_SLAB_H
+
+#include <stdlib.h>
+
+typedef unsigned int gfp_t;
+
+#define GFP_KERNEL 0x01U
+
+static inline void* kmalloc(size_t size, gfp_t flags)
+{
+	(void)flags;
+	return malloc(size);
+}
+
+static inline void kfree(const void* p)
+{
+	free((void*)p);
+}
+
+#endif /* FSIM_USER_SLAB_H */
@@ -0,0 +1,10 @@
+/*
+ * String functions for user space.
+ */
+
+#ifndef FSIM_USER_STRING_H
+#define FSIM_USER_STRING_H
+
+#include <string.h>
+
+#endif /* FSIM_USER_STRING_H */
@@ -5,6 +5,10 @@
 
 /*
  * Define map between keys and values, both of type void*.
+ *
+ * Map is a hash table, which is grown incrementally: when it becomes
+ * too loaded, elements are moved into the larger table a few buckets
+ * at a time by subsequent add and delete operations. Lookup uses RCU.
  */
 
 typedef struct data_map* data_map_t;
@@ -14,7 +18,8 @@ typedef struct data_map* data_map_t;
  * elements.
  * 
  * NOTE: elem_number do not restrict number of elements in the map.
- * It only affect on the perfomance of the lookup functions.
+ * It only affect on the initial size of the hash table, which grows
+ * automatically when more elements are added.
  * 
  * On error return NULL.
  */
@@ -32,6 +37,9 @@ int data_map_add(data_map_t map, void* key, void* data);
  * Return data corresponding to key.
  * 
  * If key wasn't registered, return ERR_PTR(-EINVAL).
+ * 
+ * Doesn't take locks (uses RCU), so may be called in any context,
+ * concurrently with other operations on the map.
  */
 void* data_map_get(data_map_t map, void* key);
 
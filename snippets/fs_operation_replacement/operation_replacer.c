@@ -198,6 +198,20 @@ struct operation_replacer
 	struct operation_replacer_data* data;
   	// Contains information about operations replacements for particuar object.
     data_map_t data_map;
+    /*
+     * Replaced copies of the operations structures ('replace_pointer'
+     * replacer only, NULL for other types).
+     *
+     * Every copy is mapped both from the original operations pointer
+     * and from the pointer to the copy itself, so copy is shared by all
+     * objects with the same original operations and the original ones
+     * may be found by current operations of the object.
+     *
+     * Copies are freed only when target is unloaded.
+     */
+    data_map_t ops_cache;
+    // Serialize creation of the copies (lookup in 'ops_cache' is lock-free).
+    struct mutex ops_cache_m;
 
 };
 
@@ -216,6 +230,9 @@ ops_from_key_replace_pointer(void* key)
 
 /*
  * Data structure for 'replace_pointer' type of replacer.
+ *
+ * It is a replaced copy of the operations, which is shared by all keys
+ * with the same original operations (see 'ops_cache').
  */
 
 struct operation_data_replace_pointer
@@ -309,6 +326,8 @@ operation_replacer_create_common(size_t elem_num, size_t ops_size)
 
     replacer->data = NULL;
 	mutex_init(&replacer->m);
+	replacer->ops_cache = NULL;
+	mutex_init(&replacer->ops_cache_m);
 	
 	replacer->ops_size = ops_size;
 	
@@ -324,6 +343,18 @@ operation_replacer operation_replacer_create(size_t elem_num,
 
 	replacer->type = operation_replacer_type_replace_pointer;
 
+	/*
+	 * Number of different operations structures is small, so start
+	 * from the small map - it grows when needed.
+	 */
+	replacer->ops_cache = data_map_create(8);
+	if(replacer->ops_cache == NULL)
+	{
+		pr_err("operation_replacer_create: Cannot create cache of operations for replacer.");
+		operation_replacer_destroy(replacer);
+		return NULL;
+	}
+
 	return replacer;
 }
 
@@ -346,13 +377,16 @@ operation_replacer operation_replacer_create_at_place(size_t elem_num,
 
 struct undeleted_key_callback_data
 {
+	operation_replacer replacer;
 	void (*callback)(void* key);
 };
 static void free_data(void* data, void* key, void* user_data)
 {
 	struct undeleted_key_callback_data* user_data_real = user_data;
-	kfree(data);
-	if(user_data_real && user_data_real->callback)
+	// Data of 'replace_pointer' replacer is owned by the cache.
+	if(user_data_real->replacer->type != operation_replacer_type_replace_pointer)
+		kfree(data);
+	if(user_data_real->callback)
 		user_data_real->callback(key);
 }
 
@@ -386,13 +420,100 @@ void operation_replacer_destroy(operation_replacer replacer)
 	kfree(replacer->total_mask);
 
 	mutex_destroy(&replacer->m);
-	// Map should be empty at this stage.
+	// Maps should be empty at this stage.
 	data_map_destroy(replacer->data_map);
+	if(replacer->ops_cache)
+		data_map_destroy(replacer->ops_cache);
+	mutex_destroy(&replacer->ops_cache_m);
 	kfree(replacer);
 }
 
 /*
- * Fill 'data' and perform operations replacement for given key.
+ * Return replaced copy of the operations 'ops' from the cache,
+ * creating it if needed.
+ * ("replace_pointer" replacer.)
+ *
+ * If 'ops' are already the replaced copy, return this copy.
+ *
+ * On error return ERR_PTR().
+ */
+
+static struct operation_data_replace_pointer*
+operation_cache_get_replace_pointer(operation_replacer replacer,
+	const void* ops,
+	const void* repl,
+	const void* mask)
+{
+	struct operation_data_replace_pointer* data;
+	void* const* op_mask;
+	size_t ops_size = replacer->ops_size;
+	int result;
+
+	// Common case - copy already exists.
+	data = data_map_get(replacer->ops_cache, (void*)ops);
+	if(!IS_ERR(data)) return data;
+
+	mutex_lock(&replacer->ops_cache_m);
+	// Copy may be created while we wait for the mutex.
+	data = data_map_get(replacer->ops_cache, (void*)ops);
+	if(!IS_ERR(data)) goto out;
+
+	data = kmalloc(operation_data_replace_pointer_size(ops_size), GFP_KERNEL);
+	if(data == NULL)
+	{
+		pr_err("operation_cache_get_replace_pointer: Cannot allocate replaced operations.");
+		data = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+
+	data->ops_orig = ops;
+	memcpy(data->ops, data->ops_orig, ops_size);
+
+	FOR_EACH_OPERATION_IN_MASK(op_mask, mask, ops_size)
+	{
+		*corresponded_op(data->ops, mask, op_mask) =
+			*corresponded_op_const(repl, mask, op_mask);
+	}
+
+	/*
+	 * Copy is not visible for others until it is mapped from
+	 * the original operations, so it may be freed on error.
+	 */
+	result = data_map_add(replacer->ops_cache, data->ops, data);
+	if(result) goto err_add;
+	result = data_map_add(replacer->ops_cache, (void*)data->ops_orig, data);
+	if(result)
+	{
+		data_map_delete(replacer->ops_cache, data->ops);
+		goto err_add;
+	}
+out:
+	mutex_unlock(&replacer->ops_cache_m);
+	return data;
+
+err_add:
+	pr_err("operation_cache_get_replace_pointer: Cannot add replaced operations to the cache.");
+	kfree(data);
+	data = ERR_PTR(result);
+	goto out;
+}
+
+/*
+ * Callback for data_map_delete_all for the cache of the operations.
+ *
+ * Every copy is mapped twice, free it only once - when it is met
+ * as a key (copy may be already freed at the other call).
+ */
+
+static void free_ops_cache_data(void* data, void* key, void* user_data)
+{
+	struct operation_data_replace_pointer* data_real = data;
+	if(key == (void*)data_real->ops)
+		kfree(data_real);
+}
+
+/*
+ * Perform operations replacement for given key according to the data.
  * ("replace_pointer" replacer.)
  */
 
@@ -403,17 +524,7 @@ static int operation_replace_replace_pointer(void* data,
 	size_t ops_size)
 {
 	struct operation_data_replace_pointer* data_real = data;
-    void* const* op_mask;
-    
-	data_real->ops_orig = *ops_from_key_replace_pointer(key);
-	
-	memcpy(data_real->ops, data_real->ops_orig, ops_size);
-    
-	FOR_EACH_OPERATION_IN_MASK(op_mask, mask, ops_size)
-    {
-        *corresponded_op(data_real->ops, mask, op_mask) =
-            *corresponded_op_const(repl, mask, op_mask);
-    }
+
 	*ops_from_key_replace_pointer(key) = data_real->ops;
 	return 0;
 }
@@ -462,6 +573,9 @@ static int operation_restore_replace_pointer(void* data,
 /*
  * Update operations replacement for the key according to the data.
  * ("replace_pointer" replacer.)
+ *
+ * Return 1 if operations was changed to the ones, which are not
+ * corresponded to the data, so other data should be used for the key.
  */
 
 static int operation_replacement_update_replace_pointer(void* data,
@@ -486,9 +600,7 @@ static int operation_replacement_update_replace_pointer(void* data,
 	else
 	{
 		// Operations was set to some value.
-        // Simply forgot replace operation.
-		return operation_replace_replace_pointer(data, key,
-			repl, mask, ops_size);
+		return 1;
 	}
 }
 
@@ -588,11 +700,42 @@ static int operation_replacement_update_at_place(void* data,
 }
 
 
+/*
+ * Return data for replace operations for given key.
+ *
+ * For 'replace_pointer' replacer data is shared, for 'at_place' replacer
+ * it is allocated and should be freed with operation_data_free().
+ */
+
+static void* operation_data_get(operation_replacer replacer,
+	void* key, const void* repl, const void* mask)
+{
+	void* data;
+	switch(replacer->type)
+	{
+	case operation_replacer_type_replace_pointer:
+		return operation_cache_get_replace_pointer(replacer,
+			*ops_from_key_replace_pointer(key), repl, mask);
+	case operation_replacer_type_at_place:
+		data = kmalloc(operation_data_at_place_size(replacer->ops_size),
+			GFP_KERNEL);
+		return data ? data : ERR_PTR(-ENOMEM);
+	default:
+		pr_err("operation_data_get: Invalid replacer type: %d", replacer->type);
+		BUG();
+	}
+}
+
+static void operation_data_free(operation_replacer replacer, void* data)
+{
+	if(replacer->type != operation_replacer_type_replace_pointer)
+		kfree(data);
+}
+
 int operation_replace(operation_replacer replacer,
 	void* key)
 {
 	int result;
-	size_t data_size;
 	void* data;
 	
 	const void *repl, *mask;
@@ -608,28 +751,16 @@ int operation_replace(operation_replacer replacer,
 		return -ENOMEM;
 	}
 	
-	switch(replacer->type)
-	{
-	case operation_replacer_type_replace_pointer:
-		data_size = operation_data_replace_pointer_size(replacer->ops_size);
-		break;
-	case operation_replacer_type_at_place:
-		data_size = operation_data_at_place_size(replacer->ops_size);
-		break;
-	default:
-		pr_err("operation_replace: Invalid replacer type: %d", replacer->type);
-		BUG();
-	}
-	data = kmalloc(data_size, GFP_KERNEL);
-	if(data == NULL)
+	repl = replacer_data->ops_repl_total;
+	mask = replacer_data->ops_mask_total;
+
+	data = operation_data_get(replacer, key, repl, mask);
+	if(IS_ERR(data))
 	{
 		pr_err("operation_replace: Cannot allocate data for replace operations.");
-		return -ENOMEM;
+		return PTR_ERR(data);
 	}
 
-	repl = replacer_data->ops_repl_total;
-	mask = replacer_data->ops_mask_total;
-
 	switch(replacer->type)
 	{
 	case operation_replacer_type_replace_pointer:
@@ -645,7 +776,7 @@ int operation_replace(operation_replacer replacer,
 	}
 	if(result)
 	{
-		kfree(data);
+		operation_data_free(replacer, data);
 		pr_err("operation_replace: Fail to perform operations replacement.");
 		return result;
 	}
@@ -667,7 +798,7 @@ int operation_replace(operation_replacer replacer,
 		default:
 			BUG();
 		}
-		kfree(data);
+		operation_data_free(replacer, data);
 		return result;
 	}
 	return 0;
@@ -729,7 +860,7 @@ int operation_restore(operation_replacer replacer,
 	if(result) return result;
 	
 	data_map_delete(replacer->data_map, key);
-	kfree(data);
+	operation_data_free(replacer, data);
 	
 	return 0;
 }
@@ -767,7 +898,7 @@ int operation_replacement_clean(operation_replacer replacer,
 	BUG_ON(data == NULL);
 	//without restoring the operations
 	data_map_delete(replacer->data_map, key);
-	kfree(data);
+	operation_data_free(replacer, data);
 	
 	return 0;
 }
@@ -820,7 +951,10 @@ int operation_replacement_update(operation_replacer replacer,
 	{
 		//delete key->data mapping for invalide data
 		data_map_delete(replacer->data_map, key);
-		kfree(data);
+		operation_data_free(replacer, data);
+		// Replace operations which was set outside of replacer.
+		if(result == 1)
+			return operation_replace(replacer, key);
 		return result;
 	}
 
@@ -1148,8 +1282,12 @@ void operation_target_unload_callback(operation_replacer replacer,
 	}
 
 	// For case if some replacement wasn't been restored.
+	undeleted_key_data.replacer = replacer;
 	undeleted_key_data.callback = undeleted_key;
 	data_map_delete_all(replacer->data_map, free_data, &undeleted_key_data);
+	// Replaced operations are not used by the keys now.
+	if(replacer->ops_cache)
+		data_map_delete_all(replacer->ops_cache, free_ops_cache_data, NULL);
 
 
 	/*
@@ -1315,6 +1453,21 @@ void* operation_get_orig(operation_replacer replacer, int operation_offset,
     BUG_ON(get_op_at_offset(replacer->data->ops_mask_total,
         operation_offset) == NULL);
 
+	if(replacer->type == operation_replacer_type_replace_pointer)
+	{
+		/*
+		 * Fast path: operations of the key are the replaced copy,
+		 * so original operations are found in the (small) cache
+		 * without lookup for the key.
+		 */
+		const void* ops = ACCESS_ONCE(*ops_from_key_replace_pointer(key));
+		struct operation_data_replace_pointer* data_real =
+			data_map_get(replacer->ops_cache, (void*)ops);
+		if(!IS_ERR(data_real) && (data_real->ops == ops))
+			return get_op_at_offset(data_real->ops_orig, operation_offset);
+		// Operations was changed, use ones recorded for the key.
+	}
+
     data = data_map_get(replacer->data_map, key);
 	
 	/*
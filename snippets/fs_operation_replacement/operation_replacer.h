@@ -103,6 +103,10 @@ void operation_replacer_destroy(operation_replacer replacer);
  * Replace operations.
  * For replacer by pointer key should be pointer to the pointer to the operations,
  * for replacer at place key should be pointer to operations.
+ *
+ * Replacer by pointer creates only one replaced copy for every distinct
+ * operations structure, which is shared by all keys with these operations
+ * and is freed when target is unloaded.
  */
 
 int operation_replace(operation_replacer replacer,
@@ -212,6 +216,10 @@ int operation_payload_unregister(operation_replacer replacer,
  * Return operation wich was replaced with new one.
  * 
  * Intended to call from the replacement operation.
+ *
+ * Doesn't take any locks. For replacer by pointer, original operation
+ * is found by the current operations of the key, if they are the
+ * replaced ones.
  */
 
 void* operation_get_orig(operation_replacer replacer,
@@ -1,52 +1,238 @@
 #include "data_map.h"
 
+#include <linux/kernel.h>
 #include <linux/list.h> /* hash table organization */
-#include <linux/hash.h> /* hash function for pointers */
 #include <linux/slab.h> /* kmalloc */
 #include <linux/spinlock.h> /* spinlock */
+#include <linux/rcupdate.h> /* lock-free lookup */
 
 /*temporary*/
 #ifndef DEBUG
 #define DEBUG 
 #endif
 
+/*
+ * Number of buckets of the old table, which are moved into the new one
+ * on every write operation while table is growing.
+ */
+#define DATA_MAP_REHASH_STEP 4
+
+/*
+ * Every element has two nodes, one for each of the two tables, which
+ * exist while the map is growing. So an element may be moved into
+ * the new table without being removed from the old one, which is still
+ * used by the readers.
+ */
 struct data_map_element
 {
-	struct hlist_node node;
+	struct hlist_node node[2];
 	void* key;
 	void* data;
+	struct rcu_head rcu;
 };
 
-struct data_map
+struct data_map_table
 {
-	struct hlist_head* hash_table;
 	//only 2^n sizes will be used
 	int size_bits;
-	//protect from concurrent read and writes of the table
+	//index of the element's node, used for link element into this table
+	int node_idx;
+	//for free table after readers stop to use it
+	struct rcu_head rcu;
+	struct data_map* map;
+	struct hlist_head buckets[];
+};
+
+struct data_map
+{
+	//table used for lookup, contains all elements
+	struct data_map_table* table;
+	/*
+	 * Table, into which elements are moved while map is growing, or NULL.
+	 *
+	 * Elements from first 'rehash_pos' buckets of the current table
+	 * are already in it.
+	 */
+	struct data_map_table* new_table;
+	int rehash_pos;
+	/*
+	 * Not 0 while previous table may be used by the readers.
+	 * Until that new growing cannot be started, because it would reuse
+	 * the same nodes of the elements.
+	 */
+	int old_table_busy;
+	size_t n_elems;
+	//protect from concurrent writes, readers use RCU
 	spinlock_t lock;
 };
 
+static struct data_map_element*
+data_map_element_from_node(struct hlist_node* node, int node_idx)
+{
+	return container_of(node - node_idx, struct data_map_element, node[0]);
+}
+
+static struct data_map_table* data_map_table_alloc(int size_bits, gfp_t flags)
+{
+	int i;
+	struct data_map_table* table = kmalloc(sizeof(*table)
+		+ sizeof(table->buckets[0]) * (1 << size_bits), flags);
+	if(table == NULL) return NULL;
+
+	for(i = 0; i < (1 << size_bits); i++)
+		INIT_HLIST_HEAD(&table->buckets[i]);
+	table->size_bits = size_bits;
+	table->node_idx = 0;
+	return table;
+}
+
+/*
+ * Hash function for pointers.
+ *
+ * hash_ptr() gives only a few distinct values for aligned pointers on
+ * 64-bit systems, so multiplicative hashing with golden ratio is used.
+ */
+#if BITS_PER_LONG == 64
+#define DATA_MAP_GOLDEN_RATIO 0x9e3779b97f4a7c15UL
+#else
+#define DATA_MAP_GOLDEN_RATIO 0x9e3779b9UL
+#endif
+
+static unsigned long data_map_hash(void* key, int size_bits)
+{
+	return ((unsigned long)key * DATA_MAP_GOLDEN_RATIO)
+		>> (BITS_PER_LONG - size_bits);
+}
+
+static struct hlist_head*
+data_map_table_bucket(struct data_map_table* table, void* key)
+{
+	return &table->buckets[data_map_hash(key, table->size_bits)];
+}
+
+//Should be executed under lock or in rcu read-side section
+static struct data_map_element*
+data_map_table_find(struct data_map_table* table, void* key)
+{
+	struct hlist_node* node;
+	for(node = rcu_dereference(data_map_table_bucket(table, key)->first);
+		node != NULL;
+		node = rcu_dereference(node->next))
+	{
+		struct data_map_element* elem =
+			data_map_element_from_node(node, table->node_idx);
+		if(elem->key == key) return elem;
+	}
+	return NULL;
+}
+
+//Whether element is already in the new table(should be executed under lock)
+static int data_map_is_moved(data_map_t map, void* key)
+{
+	return (map->new_table != NULL)
+		&& (data_map_hash(key, map->table->size_bits) < map->rehash_pos);
+}
+
+static void data_map_table_free_rcu(struct rcu_head* head)
+{
+	unsigned long flags;
+	struct data_map_table* table =
+		container_of(head, struct data_map_table, rcu);
+	data_map_t map = table->map;
+
+	kfree(table);
+
+	spin_lock_irqsave(&map->lock, flags);
+	map->old_table_busy = 0;
+	spin_unlock_irqrestore(&map->lock, flags);
+}
+
+static void data_map_element_free_rcu(struct rcu_head* head)
+{
+	kfree(container_of(head, struct data_map_element, rcu));
+}
+
+/*
+ * Move next buckets of the current table into the new one, and make
+ * the new table current when all buckets are moved.
+ *
+ * Should be executed under lock.
+ */
+static void data_map_rehash_step(data_map_t map)
+{
+	int i;
+	struct data_map_table* table = map->table;
+	struct data_map_table* new_table = map->new_table;
+
+	if(new_table == NULL) return;
+
+	for(i = 0; (i < DATA_MAP_REHASH_STEP)
+		&& (map->rehash_pos < (1 << table->size_bits)); i++)
+	{
+		struct hlist_node* node;
+		hlist_for_each(node, &table->buckets[map->rehash_pos])
+		{
+			struct data_map_element* elem =
+				data_map_element_from_node(node, table->node_idx);
+			hlist_add_head_rcu(&elem->node[new_table->node_idx],
+				data_map_table_bucket(new_table, elem->key));
+		}
+		map->rehash_pos++;
+	}
+	if(map->rehash_pos < (1 << table->size_bits)) return;
+
+	rcu_assign_pointer(map->table, new_table);
+	map->new_table = NULL;
+	map->old_table_busy = 1;
+	call_rcu(&table->rcu, data_map_table_free_rcu);
+}
+
+//Return size_bits of the table suitable for given number of elements.
+static int data_map_size_bits(size_t elem_number)
+{
+	size_t hash_size;
+	int size_bits;
+
+	if(elem_number == 0) elem_number = 1;
+	//elem_number should be no greater then 70% from hash size
+	hash_size = (elem_number * 10 - 1)/ 7 + 1; 
+
+	for(size_bits = 0, --hash_size; hash_size != 0; size_bits++)
+		hash_size >>= 1;
+
+	//size_bits shouldn't be 0(otherwise hash function return incorrect result)
+	if(size_bits <= 0)
+		size_bits = 1;
+	return size_bits;
+}
+
+/*
+ * Whether table should be grown for add one more element.
+ *
+ * Elements number should be no greater then 70% from hash size.
+ */
+static int data_map_need_grow(data_map_t map)
+{
+	return (map->new_table == NULL) && !map->old_table_busy
+		&& ((map->n_elems + 1) * 10 > (size_t)(1 << map->table->size_bits) * 7);
+}
+
 /*
  * Create map which is expected to work with 'elem_number' number of
  * elements.
  * 
  * NOTE: elem_number do not restrict number of elements in the map.
- * It only affect on the perfomance of the lookup functions.
+ * It only affect on the initial size of the hash table, which grows
+ * automatically when more elements are added.
  * 
  * On error return NULL.
  */
 
 data_map_t data_map_create(size_t elem_number)
 {
-	size_t hash_size;
-	int size_bits;
-	struct hlist_head* table;
-	int i;
+	struct data_map_table* table;
 	data_map_t map;
 	
-	//elem_number should be no greater then 70% from hash size
-	hash_size = (elem_number * 10 - 1)/ 7 + 1; 
-	
 	map = kmalloc(sizeof(*map), GFP_KERNEL);
 	
 	if(map == NULL)
@@ -54,25 +240,21 @@ data_map_t data_map_create(size_t elem_number)
 		pr_err("data_map_create: Cannot allocate data map.");
 		return NULL;
 	}
-	for(size_bits = 0, --hash_size; hash_size != 0; size_bits++)
-		hash_size >>= 1;
-
-	//size_bits shouldn't be 0(otherwise hash_ptr return incorrect result)
-	if(size_bits <= 0)
-		size_bits = 1;
 		
-	table = kmalloc(sizeof(*table) * (1 << size_bits), GFP_KERNEL);
+	table = data_map_table_alloc(data_map_size_bits(elem_number), GFP_KERNEL);
 	if(table == NULL)
 	{
 		pr_err("data_map_create: Cannot allocate table for operation replacer.");
 		kfree(map);
 		return NULL;
 	}
-	for(i = 0; i < (1 << size_bits); i++)
-		INIT_HLIST_HEAD(&table[i]);
+	table->map = map;
 
-	map->hash_table = table;
-	map->size_bits = size_bits;
+	map->table = table;
+	map->new_table = NULL;
+	map->rehash_pos = 0;
+	map->old_table_busy = 0;
+	map->n_elems = 0;
 	spin_lock_init(&map->lock);
 
 	return map;
@@ -89,7 +271,9 @@ int data_map_add(data_map_t map, void* key, void* data)
 	unsigned long flags;
 	int error = 0;
 	struct data_map_element* new_elem;
-	int hash = hash_ptr(key, map->size_bits);
+	struct data_map_table* new_table = NULL;
+	int size_bits;
+
 	new_elem = kmalloc(sizeof(*new_elem), GFP_KERNEL);
 	if(new_elem == NULL)
 	{
@@ -97,30 +281,64 @@ int data_map_add(data_map_t map, void* key, void* data)
 		return -ENOMEM;
 	}
 	//Base initialization of new replacement element
-	INIT_HLIST_NODE(&new_elem->node);
+	INIT_HLIST_NODE(&new_elem->node[0]);
+	INIT_HLIST_NODE(&new_elem->node[1]);
 	new_elem->key = key;
 	new_elem->data = data;
+
+	/*
+	 * Allocate table for growing outside of the lock.
+	 * Failure to allocate is not an error: map only becomes slower.
+	 */
+	spin_lock_irqsave(&map->lock, flags);
+	if(data_map_need_grow(map))
+	{
+		/*
+		 * Growing may be delayed by the readers of the previous table,
+		 * so map may be loaded more than usual here.
+		 */
+		size_bits = data_map_size_bits(map->n_elems + 1);
+		if(size_bits <= map->table->size_bits)
+			size_bits = map->table->size_bits + 1;
+	}
+	else
+		size_bits = 0;
+	spin_unlock_irqrestore(&map->lock, flags);
+	if(size_bits)
+		new_table = data_map_table_alloc(size_bits, GFP_KERNEL);
+
 	//Insert new replacement element into hash table
 	spin_lock_irqsave(&map->lock, flags);
 #ifdef DEBUG
+	if(data_map_table_find(map->table, key) != NULL)
 	{
-		struct data_map_element* elem;
-		struct hlist_node* tmp;
-		hlist_for_each_entry(elem, tmp, &map->hash_table[hash], node)
-		{
-			if(elem->key == key)
-			{
-				pr_err("data_map_add: Attempt to add element with already used key.");
-				error = -EINVAL;
-				kfree(new_elem);
-				goto out;
-			}
-		}
+		pr_err("data_map_add: Attempt to add element with already used key.");
+		error = -EINVAL;
+		kfree(new_elem);
+		goto out;
 	}
 #endif
-	hlist_add_head(&new_elem->node, &map->hash_table[hash]);
+	hlist_add_head_rcu(&new_elem->node[map->table->node_idx],
+		data_map_table_bucket(map->table, key));
+	if(data_map_is_moved(map, key))
+		hlist_add_head_rcu(&new_elem->node[map->new_table->node_idx],
+			data_map_table_bucket(map->new_table, key));
+	map->n_elems++;
+
+	if((new_table != NULL) && data_map_need_grow(map)
+		&& (new_table->size_bits > map->table->size_bits))
+	{
+		new_table->node_idx = !map->table->node_idx;
+		new_table->map = map;
+		map->new_table = new_table;
+		map->rehash_pos = 0;
+		new_table = NULL;
+	}
+	data_map_rehash_step(map);
 out:	
 	spin_unlock_irqrestore(&map->lock, flags);
+	//Table is not needed(e.g., another add has started growing)
+	kfree(new_table);
 	return error;
 }
 
@@ -128,31 +346,21 @@ out:
  * Return data corresponding to key.
  * 
  * If key wasn't registered, return ERR_PTR(-EINVAL).
+ *
+ * Doesn't take locks, so may be called concurrently with changing
+ * of the map.
  */
 
 void* data_map_get(data_map_t map, void* key)
 {
-	unsigned long flags;
-
 	struct data_map_element* elem;
-	struct hlist_node* tmp;
-
 	void* result;
-	int hash = hash_ptr(key, map->size_bits);
 
-	result = ERR_PTR(-EINVAL);
-	
-	spin_lock_irqsave(&map->lock, flags);
-	hlist_for_each_entry(elem, tmp, &map->hash_table[hash], node)
-	{
-		if(elem->key == key)
-		{
-			result = elem->data;
-			goto out;
-		}
-	}
-out:
-	spin_unlock_irqrestore(&map->lock, flags);
+	rcu_read_lock();
+	elem = data_map_table_find(rcu_dereference(map->table), key);
+	result = elem ? elem->data : ERR_PTR(-EINVAL);
+	rcu_read_unlock();
+
 	return result;
 }
 
@@ -165,26 +373,24 @@ out:
 void* data_map_delete(data_map_t map, void* key)
 {
 	unsigned long flags;
-
 	struct data_map_element* elem;
-	struct hlist_node* tmp;
-
 	void* result;
-	int hash = hash_ptr(key, map->size_bits);
-
-	result = ERR_PTR(-EINVAL);
 
 	spin_lock_irqsave(&map->lock, flags);
-	hlist_for_each_entry(elem, tmp, &map->hash_table[hash], node)
+	elem = data_map_table_find(map->table, key);
+	if(elem == NULL)
 	{
-		if(elem->key == key)
-		{
-			result = elem->data;
-			hlist_del(&elem->node);
-			kfree(elem);
-			goto out;
-		}
+		result = ERR_PTR(-EINVAL);
+		goto out;
 	}
+	result = elem->data;
+	hlist_del_rcu(&elem->node[map->table->node_idx]);
+	if(data_map_is_moved(map, key))
+		hlist_del_rcu(&elem->node[map->new_table->node_idx]);
+	map->n_elems--;
+	call_rcu(&elem->rcu, data_map_element_free_rcu);
+
+	data_map_rehash_step(map);
 out:
 	spin_unlock_irqrestore(&map->lock, flags);
 	return result;
@@ -206,19 +412,26 @@ void data_map_delete_all(data_map_t map,
 	//Currently without lock.
 	//(Function should be used without concurrency with adding/removing keys).
 	int i;
-	for(i = 0; i < (1 << map->size_bits); i++)
+	struct data_map_table* table = map->table;
+
+	// New table is never used by readers before growing is finished
+	kfree(map->new_table);
+	map->new_table = NULL;
+
+	for(i = 0; i < (1 << table->size_bits); i++)
 	{
-		struct hlist_head* entry = &map->hash_table[i];
+		struct hlist_head* entry = &table->buckets[i];
 		while(entry->first)
 		{
-			struct data_map_element* elem = hlist_entry(entry->first,
-				struct data_map_element, node);
-			hlist_del(&elem->node);
+			struct data_map_element* elem = data_map_element_from_node(
+				entry->first, table->node_idx);
+			hlist_del_rcu(&elem->node[table->node_idx]);
 			if(free_data)
 				free_data(elem->data, elem->key, user_data);
-			kfree(elem);
+			call_rcu(&elem->rcu, data_map_element_free_rcu);
 		}
 	}
+	map->n_elems = 0;
 }
 
 /*
@@ -230,19 +443,24 @@ void data_map_destroy(data_map_t map)
 {
 	int i;
 	int was_elems = 0;
-	for(i = 0; i < (1 << map->size_bits); i++)
+	struct data_map_table* table = map->table;
+
+	kfree(map->new_table);
+	for(i = 0; i < (1 << table->size_bits); i++)
 	{
-		struct hlist_head* entry = &map->hash_table[i];
+		struct hlist_head* entry = &table->buckets[i];
 		while(entry->first)
 		{
-			struct data_map_element* elem = hlist_entry(entry->first,
-				struct data_map_element, node);
-			hlist_del(&elem->node);
-			kfree(elem);
+			struct data_map_element* elem = data_map_element_from_node(
+				entry->first, table->node_idx);
+			hlist_del_rcu(&elem->node[table->node_idx]);
+			call_rcu(&elem->rcu, data_map_element_free_rcu);
 			was_elems = 1;
 		}
 	}
 	if(was_elems) pr_warning("data_map_destroy: Destroying non-empty map.");
-	kfree(map->hash_table);
+	//Wait for freeing of the elements and the old table
+	rcu_barrier();
+	kfree(table);
 	kfree(map);
-}
\ No newline at end of file
+}
@@ -0,0 +1,273 @@
+/*
+ * Test and benchmark of the data map (data_map.c), built in user space.
+ *
+ * First, the operations of the map are checked for a number of keys,
+ * which makes the map grow many times from the smallest size.
+ *
+ * Then reader threads look up the keys, which are always in the map,
+ * while the writer thread adds and deletes other keys, so the map grows
+ * concurrently with the lookups. Every lookup should find the key with
+ * the correct data. The number of lookups and of writes per second is
+ * output.
+ *
+ * Usage: data_map_test [-r readers] [-t seconds] [-n keys]
+ *   -r - number of reader threads (default: 4);
+ *   -t - duration of the concurrent test (default: 2);
+ *   -n - number of keys looked up by the readers (default: 1024).
+ */
+
+#include <linux/kernel.h>
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "data_map.h"
+
+static int errors = 0;
+
+// Keys look like pointers to the structures.
+static void* key_of(unsigned long i)
+{
+	return (void*)(0xffff880000000000UL + i * 64);
+}
+
+static void* data_of(unsigned long i)
+{
+	return (void*)(i + 1);
+}
+
+/////////////////////////// Checks ///////////////////////////////////
+
+static unsigned long deleted_count;
+
+static void free_data(void* data, void* key, void* user_data)
+{
+	if(key != key_of((unsigned long)data - 1))
+	{
+		printf("FAIL: data_map_delete_all() passes data %p for key %p\n",
+			data, key);
+		errors++;
+	}
+	deleted_count++;
+}
+
+static void check_operations(void)
+{
+	const unsigned long n = 100000;
+	unsigned long i;
+	data_map_t map = data_map_create(1);
+	BUG_ON(map == NULL);
+
+	for(i = 0; i < n; i++)
+	{
+		if(data_map_add(map, key_of(i), data_of(i)))
+		{
+			printf("FAIL: cannot add key %lu\n", i);
+			errors++;
+		}
+	}
+	if(data_map_add(map, key_of(0), data_of(0)) != -EINVAL)
+	{
+		printf("FAIL: key is added twice\n");
+		errors++;
+	}
+
+	for(i = 0; i < n; i++)
+	{
+		if(data_map_get(map, key_of(i)) != data_of(i))
+		{
+			printf("FAIL: incorrect data for key %lu\n", i);
+			errors++;
+		}
+	}
+	if(!IS_ERR(data_map_get(map, key_of(n))))
+	{
+		printf("FAIL: data for the key which is not in the map\n");
+		errors++;
+	}
+
+	for(i = 0; i < n; i += 2)
+	{
+		if(data_map_delete(map, key_of(i)) != data_of(i))
+		{
+			printf("FAIL: incorrect data for deleted key %lu\n", i);
+			errors++;
+		}
+	}
+	for(i = 0; i < n; i++)
+	{
+		void* data = data_map_get(map, key_of(i));
+		if((i % 2) ? (data != data_of(i)) : !IS_ERR(data))
+		{
+			printf("FAIL: incorrect data for key %lu after deletion\n", i);
+			errors++;
+		}
+	}
+	if(!IS_ERR(data_map_delete(map, key_of(0))))
+	{
+		printf("FAIL: key is deleted twice\n");
+		errors++;
+	}
+
+	deleted_count = 0;
+	data_map_delete_all(map, free_data, NULL);
+	if(deleted_count != n / 2)
+	{
+		printf("FAIL: %lu keys are deleted by data_map_delete_all() instead of %lu\n",
+			deleted_count, n / 2);
+		errors++;
+	}
+	// Map is usable after data_map_delete_all()
+	if(data_map_add(map, key_of(0), data_of(0))
+		|| (data_map_delete(map, key_of(0)) != data_of(0)))
+	{
+		printf("FAIL: map is not usable after data_map_delete_all()\n");
+		errors++;
+	}
+	data_map_destroy(map);
+}
+
+/////////////////////////// Concurrent test //////////////////////////
+
+static data_map_t map;
+static unsigned long n_keys = 1024;
+static volatile int stop = 0;
+
+struct reader_stat
+{
+	unsigned long lookups;
+	unsigned long failures;
+};
+
+static void* reader_thread(void* arg)
+{
+	struct reader_stat* stat = arg;
+	unsigned long i = (unsigned long)stat * 7;
+
+	while(!stop)
+	{
+		int j;
+		for(j = 0; j < 1000; j++, i++)
+		{
+			unsigned long k = i % n_keys;
+			if(data_map_get(map, key_of(k)) != data_of(k))
+				stat->failures++;
+		}
+		stat->lookups += 1000;
+	}
+	return NULL;
+}
+
+static unsigned long writes = 0;
+
+// Add keys after the readers' ones and delete them, over and over.
+static void* writer_thread(void* arg)
+{
+	const unsigned long n = 1UL << 18;
+
+	while(!stop)
+	{
+		unsigned long i;
+		for(i = 0; (i < n) && !stop; i++, writes++)
+			BUG_ON(data_map_add(map, key_of(n_keys + i), data_of(n_keys + i)));
+		while((i > 0) && !stop)
+		{
+			i--;
+			BUG_ON(data_map_delete(map, key_of(n_keys + i)) != data_of(n_keys + i));
+			writes++;
+		}
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void check_concurrent(int n_readers, int seconds)
+{
+	pthread_t* readers = calloc(n_readers, sizeof(*readers));
+	struct reader_stat* stats = calloc(n_readers, sizeof(*stats));
+	pthread_t writer;
+	unsigned long i, lookups = 0, failures = 0;
+	double start, time;
+
+	map = data_map_create(1);
+	BUG_ON(map == NULL);
+	for(i = 0; i < n_keys; i++)
+		BUG_ON(data_map_add(map, key_of(i), data_of(i)));
+
+	start = now();
+	for(i = 0; i < n_readers; i++)
+		BUG_ON(pthread_create(&readers[i], NULL, reader_thread, &stats[i]));
+	BUG_ON(pthread_create(&writer, NULL, writer_thread, NULL));
+
+	sleep(seconds);
+	stop = 1;
+	time = now() - start;
+
+	pthread_join(writer, NULL);
+	for(i = 0; i < n_readers; i++)
+	{
+		pthread_join(readers[i], NULL);
+		lookups += stats[i].lookups;
+		failures += stats[i].failures;
+	}
+
+	if(failures)
+	{
+		printf("FAIL: %lu of %lu lookups haven't found the key\n",
+			failures, lookups);
+		errors++;
+	}
+	printf("%d readers: %12.0f lookups/s (%10.0f per reader), writer: %10.0f writes/s\n",
+		n_readers, lookups / time, lookups / time / n_readers, writes / time);
+
+	data_map_delete_all(map, NULL, NULL);
+	data_map_destroy(map);
+	free(stats);
+	free(readers);
+}
+
+int main(int argc, char** argv)
+{
+	int n_readers = 4;
+	int seconds = 2;
+	int opt;
+
+	while((opt = getopt(argc, argv, "r:t:n:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'r':
+			n_readers = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'n':
+			n_keys = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-r readers] [-t seconds] [-n keys]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	fprintf(stderr, "Errors below are expected:\n");
+	check_operations();
+	if(errors)
+	{
+		printf("%d checks failed.\n", errors);
+		return 1;
+	}
+	printf("All checks passed.\n");
+
+	check_concurrent(n_readers, seconds);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Minimal user-space replacement of <linux/kernel.h> for building
+ * the data map and the operation replacer as an ordinary program.
+ */
+
+#ifndef DATA_MAP_USER_KERNEL_H
+#define DATA_MAP_USER_KERNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#define pr_err(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define pr_warning(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define pr_info(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+
+#define BUG_ON(cond)							\
+do {									\
+	if(cond)							\
+	{								\
+		fprintf(stderr, "BUG at %s:%d\n", __FILE__, __LINE__);	\
+		abort();						\
+	}								\
+} while(0)
+
+#define BUG() BUG_ON(1)
+
+#define ACCESS_ONCE(x) (*(volatile typeof(x)*)&(x))
+
+#define container_of(ptr, type, member) \
+	((type*)((char*)(ptr) - offsetof(type, member)))
+
+#define BITS_PER_LONG __LONG_WIDTH__
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+// <linux/err.h> is included indirectly in the kernel
+#define MAX_ERRNO 4095
+#define ERR_PTR(error) ((void*)(long)(error))
+#define PTR_ERR(ptr) ((long)(ptr))
+#define IS_ERR(ptr) ((unsigned long)(ptr) >= (unsigned long)-MAX_ERRNO)
+
+#endif /* DATA_MAP_USER_KERNEL_H */
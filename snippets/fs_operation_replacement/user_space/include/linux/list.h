@@ -0,0 +1,112 @@
+/*
+ * The parts of <linux/list.h> used by the data map and the operation
+ * replacer, for user space.
+ */
+
+#ifndef DATA_MAP_USER_LIST_H
+#define DATA_MAP_USER_LIST_H
+
+#include <linux/kernel.h>
+
+struct hlist_head
+{
+	struct hlist_node* first;
+};
+
+struct hlist_node
+{
+	struct hlist_node *next, **pprev;
+};
+
+#define INIT_HLIST_HEAD(ptr) ((ptr)->first = NULL)
+
+static inline void INIT_HLIST_NODE(struct hlist_node* h)
+{
+	h->next = NULL;
+	h->pprev = NULL;
+}
+
+static inline void hlist_add_head_rcu(struct hlist_node* n,
+	struct hlist_head* h)
+{
+	struct hlist_node* first = h->first;
+	n->next = first;
+	n->pprev = &h->first;
+	if(first) first->pprev = &n->next;
+	__atomic_store_n(&h->first, n, __ATOMIC_RELEASE);
+}
+
+// 'next' is kept, so the readers which are at 'n' may continue.
+static inline void hlist_del_rcu(struct hlist_node* n)
+{
+	struct hlist_node* next = n->next;
+	__atomic_store_n(n->pprev, next, __ATOMIC_RELEASE);
+	if(next) next->pprev = n->pprev;
+	n->pprev = NULL;
+}
+
+#define hlist_for_each(pos, head) \
+	for(pos = (head)->first; pos; pos = pos->next)
+
+struct list_head
+{
+	struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head* list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void __list_add(struct list_head* n,
+	struct list_head* prev, struct list_head* next)
+{
+	next->prev = n;
+	n->next = next;
+	n->prev = prev;
+	prev->next = n;
+}
+
+static inline void list_add(struct list_head* n, struct list_head* head)
+{
+	__list_add(n, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head* n, struct list_head* head)
+{
+	__list_add(n, head->prev, head);
+}
+
+static inline void list_del(struct list_head* entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+	entry->next = NULL;
+	entry->prev = NULL;
+}
+
+static inline int list_empty(const struct list_head* head)
+{
+	return head->next == head;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define list_first_entry(ptr, type, member) \
+	list_entry((ptr)->next, type, member)
+
+#define list_for_each(pos, head) \
+	for(pos = (head)->next; pos != (head); pos = pos->next)
+
+#define list_for_each_entry(pos, head, member) \
+	for(pos = list_entry((head)->next, typeof(*pos), member); \
+		&pos->member != (head); \
+		pos = list_entry(pos->member.next, typeof(*pos), member))
+
+#define list_for_each_entry_reverse(pos, head, member) \
+	for(pos = list_entry((head)->prev, typeof(*pos), member); \
+		&pos->member != (head); \
+		pos = list_entry(pos->member.prev, typeof(*pos), member))
+
+#endif /* DATA_MAP_USER_LIST_H */
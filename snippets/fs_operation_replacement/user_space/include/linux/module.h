@@ -0,0 +1,31 @@
+/*
+ * Modules for user space: module is only a name, it cannot be unloaded.
+ *
+ * Atomic operations are included with <linux/module.h> in the kernel.
+ */
+
+#ifndef DATA_MAP_USER_MODULE_H
+#define DATA_MAP_USER_MODULE_H
+
+#include <linux/kernel.h>
+
+struct module
+{
+	const char* name;
+};
+
+#define module_name(m) ((m) ? (m)->name : "kernel")
+#define try_module_get(m) 1
+#define module_put(m) do {} while(0)
+
+typedef struct
+{
+	int counter;
+} atomic_t;
+
+#define atomic_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_SEQ_CST)
+#define atomic_set(v, i) __atomic_store_n(&(v)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic_inc_return(v) __atomic_add_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_return(v) __atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+
+#endif /* DATA_MAP_USER_MODULE_H */
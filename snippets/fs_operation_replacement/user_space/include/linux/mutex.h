@@ -0,0 +1,22 @@
+/*
+ * Mutexes for user space. Signals are not delivered to the waiters,
+ * so mutex_lock_killable() always succeeds.
+ */
+
+#ifndef DATA_MAP_USER_MUTEX_H
+#define DATA_MAP_USER_MUTEX_H
+
+#include <pthread.h>
+
+struct mutex
+{
+	pthread_mutex_t m;
+};
+
+#define mutex_init(mutex) pthread_mutex_init(&(mutex)->m, NULL)
+#define mutex_destroy(mutex) pthread_mutex_destroy(&(mutex)->m)
+#define mutex_lock(mutex) pthread_mutex_lock(&(mutex)->m)
+#define mutex_lock_killable(mutex) (pthread_mutex_lock(&(mutex)->m), 0)
+#define mutex_unlock(mutex) pthread_mutex_unlock(&(mutex)->m)
+
+#endif /* DATA_MAP_USER_MUTEX_H */
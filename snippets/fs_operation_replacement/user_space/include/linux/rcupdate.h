@@ -0,0 +1,53 @@
+/*
+ * RCU for user space: readers are registered on their first
+ * rcu_read_lock(), synchronize_rcu() waits until each reader that was
+ * inside a read-side critical section leaves it.
+ *
+ * Callbacks of call_rcu() are executed by a separate thread after
+ * the grace period, rcu_barrier() waits until all of them are executed.
+ */
+
+#ifndef DATA_MAP_USER_RCUPDATE_H
+#define DATA_MAP_USER_RCUPDATE_H
+
+struct rcu_user_reader
+{
+	// Odd when the thread is inside read-side critical section.
+	unsigned long ctr;
+	unsigned int nesting;
+	struct rcu_user_reader* next;
+};
+
+extern __thread struct rcu_user_reader* rcu_user_self;
+
+struct rcu_user_reader* rcu_user_register(void);
+
+static inline void rcu_read_lock(void)
+{
+	struct rcu_user_reader* r = rcu_user_self;
+	if(r == NULL) r = rcu_user_register();
+	if(r->nesting++ == 0)
+		__atomic_fetch_add(&r->ctr, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void rcu_read_unlock(void)
+{
+	struct rcu_user_reader* r = rcu_user_self;
+	if(--r->nesting == 0)
+		__atomic_fetch_add(&r->ctr, 1, __ATOMIC_SEQ_CST);
+}
+
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+struct rcu_head
+{
+	struct rcu_head* next;
+	void (*func)(struct rcu_head* head);
+};
+
+void synchronize_rcu(void);
+void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head));
+void rcu_barrier(void);
+
+#endif /* DATA_MAP_USER_RCUPDATE_H */
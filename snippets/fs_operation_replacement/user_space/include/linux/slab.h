@@ -0,0 +1,12 @@
+#ifndef DATA_MAP_USER_SLAB_H
+#define DATA_MAP_USER_SLAB_H
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+
+#define GFP_KERNEL 0
+
+#define kmalloc(size, flags) malloc(size)
+#define kfree(addr) free(addr)
+
+#endif /* DATA_MAP_USER_SLAB_H */
@@ -0,0 +1,8 @@
+#ifndef DATA_MAP_USER_TYPES_H
+#define DATA_MAP_USER_TYPES_H
+
+#include <stddef.h>
+
+typedef unsigned int gfp_t;
+
+#endif /* DATA_MAP_USER_TYPES_H */
@@ -0,0 +1,284 @@
+/*
+ * Test and benchmark of the operation replacer (operation_replacer.c),
+ * built in user space.
+ *
+ * Objects have pointers to the operations, as inodes and files do,
+ * and the replacer of 'replace_pointer' type replaces one of the
+ * operations. It is checked that objects with the same operations
+ * share the replaced copy, original operations are called from the
+ * replacement one, and that restoring and updating of the replacement
+ * work.
+ *
+ * Then reader threads call replaced operation of many objects, which
+ * calls original one via operation_get_orig(). The number of calls per
+ * second is output.
+ *
+ * Usage: operation_replacer_test [-r readers] [-t seconds] [-n objects]
+ *   -r - number of reader threads (default: 4);
+ *   -t - duration of the benchmark (default: 2);
+ *   -n - number of objects (default: 10000).
+ */
+
+#include <linux/kernel.h>
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "operation_replacer.h"
+
+static int errors = 0;
+
+struct test_operations
+{
+	int (*open)(void* obj);
+	int (*release)(void* obj);
+};
+
+struct test_object
+{
+	const struct test_operations* ops;
+	int n_opens;
+};
+
+static int open_a(void* obj)
+{
+	((struct test_object*)obj)->n_opens++;
+	return 1;
+}
+
+static int open_b(void* obj)
+{
+	((struct test_object*)obj)->n_opens++;
+	return 2;
+}
+
+static int release_orig(void* obj)
+{
+	return 0;
+}
+
+static const struct test_operations ops_a = { open_a, release_orig };
+static const struct test_operations ops_b = { open_b, release_orig };
+
+/////////////////////////// Payload //////////////////////////////////
+
+static operation_replacer replacer;
+
+static int open_repl(void* obj)
+{
+	struct test_object* object = obj;
+	int (*open_orig)(void* obj) = operation_get_orig(replacer,
+		offsetof(struct test_operations, open), &object->ops);
+
+	return open_orig(obj) + 10;
+}
+
+static struct test_operations payload_repl = { .open = open_repl };
+static struct test_operations payload_mask = { .open = REPLACEMENT_MASK };
+
+static struct operation_payload payload =
+{
+	.repl = &payload_repl,
+	.mask = &payload_mask,
+};
+
+static void undeleted_key(void* key)
+{
+	printf("FAIL: key %p is not deleted before target unloading\n", key);
+	errors++;
+}
+
+/////////////////////////// Checks ///////////////////////////////////
+
+#define CHECK(cond, fmt, ...)					\
+do {								\
+	if(!(cond))						\
+	{							\
+		printf("FAIL: " fmt "\n", ##__VA_ARGS__);	\
+		errors++;					\
+	}							\
+} while(0)
+
+static void check_operations(void)
+{
+	struct test_object objs[4] =
+	{
+		{ &ops_a, 0 }, { &ops_a, 0 }, { &ops_b, 0 }, { &ops_a, 0 }
+	};
+	const struct test_operations* repl_a;
+	int i;
+
+	for(i = 0; i < 3; i++)
+		CHECK(operation_replace(replacer, &objs[i].ops) == 0,
+			"cannot replace operations for object %d", i);
+
+	repl_a = objs[0].ops;
+	CHECK(repl_a != &ops_a, "operations are not replaced");
+	CHECK(objs[1].ops == repl_a,
+		"objects with the same operations don't share replaced ones");
+	CHECK(objs[2].ops != repl_a,
+		"objects with different operations share replaced ones");
+	CHECK(repl_a->release == release_orig,
+		"not replaced operation is changed");
+
+	CHECK(objs[0].ops->open(&objs[0]) == 11, "replaced operation for ops_a");
+	CHECK(objs[2].ops->open(&objs[2]) == 12, "replaced operation for ops_b");
+	CHECK((objs[0].n_opens == 1) && (objs[2].n_opens == 1),
+		"original operations are not called");
+
+	// Replacement of already replaced operations doesn't replace them again.
+	objs[3].ops = repl_a;
+	CHECK(operation_replace(replacer, &objs[3].ops) == 0,
+		"cannot replace already replaced operations");
+	CHECK(objs[3].ops == repl_a, "replaced operations are replaced again");
+	CHECK(objs[3].ops->open(&objs[3]) == 11,
+		"replaced operation for already replaced operations");
+
+	// Operations are changed outside of the replacer.
+	objs[1].ops = &ops_b;
+	CHECK(operation_replacement_update(replacer, &objs[1].ops) == 0,
+		"cannot update replacement");
+	CHECK(objs[1].ops == objs[2].ops,
+		"updated replacement doesn't use cached operations");
+	objs[0].ops = &ops_a;
+	CHECK(operation_replacement_update(replacer, &objs[0].ops) == 0,
+		"cannot update replacement");
+	CHECK(objs[0].ops == repl_a,
+		"replacement is not restored by update");
+
+	for(i = 0; i < 4; i++)
+		CHECK(operation_restore(replacer, &objs[i].ops) == 0,
+			"cannot restore operations for object %d", i);
+	CHECK((objs[0].ops == &ops_a) && (objs[1].ops == &ops_b)
+		&& (objs[2].ops == &ops_b) && (objs[3].ops == &ops_a),
+		"operations are not restored");
+	CHECK(operation_restore(replacer, &objs[0].ops) == 1,
+		"operations are restored twice");
+}
+
+/////////////////////////// Benchmark ////////////////////////////////
+
+static struct test_object* objects;
+static unsigned long n_objects = 10000;
+static volatile int stop = 0;
+
+static void* reader_thread(void* arg)
+{
+	unsigned long* calls = arg;
+	unsigned long i = (unsigned long)arg * 7;
+	// Counters of the readers share cache line, update it only at the end.
+	unsigned long n = 0;
+
+	while(!stop)
+	{
+		int j;
+		for(j = 0; j < 1000; j++, i++)
+		{
+			struct test_object* object = &objects[i % n_objects];
+			object->ops->open(object);
+		}
+		n += 1000;
+	}
+	*calls = n;
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Doesn't change the object, which is shared by the readers.
+static int open_count(void* obj)
+{
+	return 0;
+}
+
+static const struct test_operations ops_count = { open_count, release_orig };
+
+static void run_benchmark(int n_readers, int seconds)
+{
+	pthread_t* readers = calloc(n_readers, sizeof(*readers));
+	unsigned long* calls = calloc(n_readers, sizeof(*calls));
+	unsigned long i, total = 0;
+	double start, time;
+
+	objects = calloc(n_objects, sizeof(*objects));
+	BUG_ON(objects == NULL);
+	for(i = 0; i < n_objects; i++)
+	{
+		objects[i].ops = &ops_count;
+		BUG_ON(operation_replace(replacer, &objects[i].ops));
+	}
+
+	start = now();
+	for(i = 0; i < n_readers; i++)
+		BUG_ON(pthread_create(&readers[i], NULL, reader_thread, &calls[i]));
+	sleep(seconds);
+	stop = 1;
+	time = now() - start;
+	for(i = 0; i < n_readers; i++)
+	{
+		pthread_join(readers[i], NULL);
+		total += calls[i];
+	}
+	printf("%d readers: %12.0f calls/s (%10.0f per reader)\n",
+		n_readers, total / time, total / time / n_readers);
+
+	for(i = 0; i < n_objects; i++)
+		BUG_ON(operation_restore(replacer, &objects[i].ops));
+	free(objects);
+	free(calls);
+	free(readers);
+}
+
+int main(int argc, char** argv)
+{
+	int n_readers = 4;
+	int seconds = 2;
+	int opt;
+
+	while((opt = getopt(argc, argv, "r:t:n:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'r':
+			n_readers = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'n':
+			n_objects = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-r readers] [-t seconds] [-n objects]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	replacer = operation_replacer_create(100, sizeof(struct test_operations));
+	BUG_ON(replacer == NULL);
+	BUG_ON(operation_payload_register(replacer, &payload));
+	operation_target_load_callback(replacer, NULL);
+
+	fprintf(stderr, "Errors below are expected:\n");
+	check_operations();
+	if(errors)
+	{
+		printf("%d checks failed.\n", errors);
+		return 1;
+	}
+	printf("All checks passed.\n");
+
+	run_benchmark(n_readers, seconds);
+
+	operation_target_unload_callback(replacer, NULL, undeleted_key);
+	BUG_ON(operation_payload_unregister(replacer, &payload));
+	operation_replacer_destroy(replacer);
+	return errors ? 1 : 0;
+}
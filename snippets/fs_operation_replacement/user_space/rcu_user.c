@@ -0,0 +1,109 @@
+/*
+ * User-space implementation of RCU for the model of the data map.
+ */
+
+#include <linux/kernel.h>
+#include <linux/rcupdate.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+__thread struct rcu_user_reader* rcu_user_self = NULL;
+
+// The readers are never removed, so synchronize_rcu() may walk the list
+// without a lock.
+static struct rcu_user_reader* rcu_user_readers = NULL;
+static pthread_mutex_t rcu_user_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct rcu_user_reader* rcu_user_register(void)
+{
+	struct rcu_user_reader* r = calloc(1, sizeof(*r));
+	BUG_ON(r == NULL);
+	
+	pthread_mutex_lock(&rcu_user_mutex);
+	r->next = rcu_user_readers;
+	__atomic_store_n(&rcu_user_readers, r, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&rcu_user_mutex);
+	
+	rcu_user_self = r;
+	return r;
+}
+
+void synchronize_rcu(void)
+{
+	struct rcu_user_reader* r;
+	
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for(r = __atomic_load_n(&rcu_user_readers, __ATOMIC_ACQUIRE);
+		r != NULL; r = r->next)
+	{
+		unsigned long ctr = __atomic_load_n(&r->ctr, __ATOMIC_SEQ_CST);
+		if((ctr & 1) == 0) continue;
+		while(__atomic_load_n(&r->ctr, __ATOMIC_SEQ_CST) == ctr)
+			sched_yield();
+	}
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/////////////////////////// Callbacks ////////////////////////////////
+
+static struct rcu_head* rcu_user_callbacks = NULL;
+static pthread_mutex_t rcu_user_callbacks_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Serialize processing of the callbacks by the thread and rcu_barrier()
+static pthread_mutex_t rcu_user_process_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t rcu_user_thread_once = PTHREAD_ONCE_INIT;
+
+// Execute callbacks, queued before the call, after the grace period.
+static void rcu_user_process(void)
+{
+	struct rcu_head* head;
+	
+	pthread_mutex_lock(&rcu_user_process_mutex);
+	pthread_mutex_lock(&rcu_user_callbacks_mutex);
+	head = rcu_user_callbacks;
+	rcu_user_callbacks = NULL;
+	pthread_mutex_unlock(&rcu_user_callbacks_mutex);
+	
+	if(head != NULL) synchronize_rcu();
+	while(head != NULL)
+	{
+		struct rcu_head* next = head->next;
+		head->func(head);
+		head = next;
+	}
+	pthread_mutex_unlock(&rcu_user_process_mutex);
+}
+
+static void* rcu_user_thread(void* arg)
+{
+	while(1)
+	{
+		usleep(100);
+		rcu_user_process();
+	}
+	return NULL;
+}
+
+static void rcu_user_thread_start(void)
+{
+	pthread_t thread;
+	BUG_ON(pthread_create(&thread, NULL, rcu_user_thread, NULL));
+	pthread_detach(thread);
+}
+
+void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head))
+{
+	pthread_once(&rcu_user_thread_once, rcu_user_thread_start);
+	
+	head->func = func;
+	pthread_mutex_lock(&rcu_user_callbacks_mutex);
+	head->next = rcu_user_callbacks;
+	rcu_user_callbacks = head;
+	pthread_mutex_unlock(&rcu_user_callbacks_mutex);
+}
+
+void rcu_barrier(void)
+{
+	rcu_user_process();
+}
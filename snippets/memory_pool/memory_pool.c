@@ -1,124 +1,127 @@
 #include "memory_pool.h"
 
-#include <linux/list.h> /* Use list of blocks*/
-#include <linux/spinlock.h> /* Use spinlock for protect list of blocks */
+#include <linux/kernel.h>
+#include <linux/list.h> /* lists of spans and chunks */
+#include <linux/spinlock.h> /* Use spinlock for protect spans */
+#include <linux/slab.h>
+#include <linux/vmalloc.h> /* memory for chunks */
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/hash.h> /* hash_long */
+#include <linux/bitops.h>
+#include <linux/workqueue.h> /* deferred TLB flush and growth of the pool */
+#include <linux/smp.h> /* on_each_cpu */
 
-//#include <linux/page-flags.h> /* Use 'error' flag for block page*/
+#include <asm/pgtable.h> /* lookup_address, flags of page table entries */
+#include <asm/tlbflush.h> /* __flush_tlb_all, __flush_tlb_one */
 
+#ifndef CONFIG_X86
+#error Page protection is implemented only for x86 architecture.
+#endif
 
-//#include <asm/cacheflush.h> /* set_page_*() */
-
-#include <linux/mm.h> /* for blocking page*/
-#include <linux/sched.h> /* current */
-
-//#include <linux/bootmem.h> /*max_low_pfn*/
-#include <asm/pgtable.h>
-#include <asm/pgtable_types.h>
-#include <linux/hardirq.h> /* in_irq in pte_offset_map*/
+/*
+ * Memory is divided into chunks of MEMPOOL_CHUNK_PAGES pages.
+ *
+ * Each chunk is divided into spans - sets of adjacent pages, which are
+ * free, contain allocated block or contain freed block in the quarantine.
+ * Block occupies all pages of its span except the last one, which is
+ * the guard page:
+ *
+ *   |...|padding|... for usage by the caller ...| page with no access |
+ *   |                                           |
+ *  first page of the span                   page boundary
+ *
+ * Only pages of the allocated blocks are accessible, all other pages
+ * of the chunks (guard pages, free spans, quarantine) are not.
+ */
 
-#include <asm/io.h> /*virt_to_phys*/
-static void dump_pagetable(unsigned long address)
-{
-    pgd_t *pgd;
-    pud_t *pud;
-    pmd_t* pmd;
-    pte_t pte, *ppte;
-
-    pgd_t* pgd_addr;
-#ifdef CONFIG_X86
-    pgd_addr = (pgd_t*)(__va(/*read_cr3()*/0x100000 & PHYSICAL_PAGE_MASK));
-#else
-#error Cannot determine adress of the global page table on non-x86 architecure.
-#endif
+#define MEMPOOL_CHUNK_ORDER 9
+#define MEMPOOL_CHUNK_PAGES (1 << MEMPOOL_CHUNK_ORDER)
+#define MEMPOOL_CHUNK_SHIFT (PAGE_SHIFT + MEMPOOL_CHUNK_ORDER)
+#define MEMPOOL_CHUNK_SIZE (PAGE_SIZE << MEMPOOL_CHUNK_ORDER)
 
-    ((int*)address)[0] = 0;
-    pr_info("PGD base(%p).", pgd_addr);
-    pgd = pgd_addr + pgd_index(address);
-    //pgd = pgd_offset(current->mm, address);
-    pr_info("PGD(%p) is 0x%lx.", pgd, pgd_val(*pgd));
-    if(pgd_bad(*pgd))
-    {
-        pr_info("PGD address is bad.");
-        return;
-    }
-    if(pgd_none(*pgd))
-    {
-        pr_info("PGD is not present.");
-        return;
-    }
+#define MEMPOOL_CHUNK_HASH_BITS 6
 
-    pud = pud_offset(pgd, address);
-    pr_info("PUD(%p) is 0x%lx.", pud, pud_val(*pud));
-    if(pud_bad(*pud))
-    {
-        pr_info("PUD address is bad.");
-        return;
-    }
-    if(pud_none(*pud))
-    {
-        pr_info("PUD is not present.");
-        return;
-    }
-    pmd = pmd_offset(pud, address);
-    pr_info("PMD(%p) is 0x%lx.", pmd, pmd_val(*pmd));
-    if(pmd_bad(*pmd))
-    {
-        pr_info("PMD address is bad.");
-        //return;
-    }
-    if(pmd_none(*pmd))
-    {
-        pr_info("PMD is not present.");
-        return;
-    }
+/*
+ * Free spans of less than (MEMPOOL_FREE_LISTS - 1) pages are kept in
+ * the list for each number of pages, larger ones - in the last list.
+ */
+#define MEMPOOL_FREE_LISTS 16
 
-    ppte = pte_offset_kernel(pmd, address);
-    pr_info("PTE(%p).", ppte);
-    if(!virt_addr_valid(ppte))
-    {
-        pr_info("PTE address is bad.");
-        return;
-    }
-    
-    pte = *ppte;
-    
-    pr_info("Virtual addr: %p, physical address: 0x%lx, last flags: %c%c%c.\n",
-            __va(pte_val(pte) & PAGE_MASK)/*address*/,
-            pte_val(pte) & PAGE_MASK,
-            pte_flags(pte) & _PAGE_USER ? 'U' : 'K',
-            pte_flags(pte) & _PAGE_RW ? 'W' : 'R',
-            pte_flags(pte) & _PAGE_PRESENT ? 'P' : '-');
-    pr_info("Real virtual address: %p, real physical address: 0x%lx.\n",
-            (void*)address,
-            (unsigned long)virt_to_phys((void*)address));
-}
+//Pattern for filling allocated memory
+#define MEMPOOL_GARBAGE 0x5a
 
+//Bits in 'work_flags' of the allocator
+#define MEMPOOL_WORK_FLUSH 0 // TLB should be flushed
+#define MEMPOOL_WORK_GROW 1 // new chunk should be allocated
 
-static int page_no_access(void* addr)
+enum mempool_span_state
 {
-    dump_pagetable((unsigned long)addr);
-    return 0;
-}
-static void page_restore_access(void* addr)
+    mempool_span_none = 0, // page is not the first page of a span
+    mempool_span_free,
+    mempool_span_allocated,
+    mempool_span_quarantined,
+};
+
+struct mempool_span
 {
-    dump_pagetable((unsigned long)addr);
+    //in the list of free spans or in the quarantine
+    struct list_head list;
+    enum mempool_span_state state;
+    //index of the first page of the span in the chunk
+    unsigned int first;
+    unsigned int npages;
+    //size of the block, as requested
+    size_t size;
 };
 
+struct mempool_chunk;
+
 /*
- * Allocated object structure:
- * 
- *
- *   |block_head  |padding|... for usage by the caller ...| page with no access | tail of allocated memory |
- *   |                                                    |
- *  address returned by allocator                     page_boundary
- * 
- * 
+ * Chunk is registered in the hash table for each MEMPOOL_CHUNK_SIZE-aligned
+ * slot of addresses it overlaps (at most 2 slots).
  */
+struct mempool_chunk_slot
+{
+    struct hlist_node node;
+    struct mempool_chunk* chunk;
+};
 
-struct mempool_block
+struct mempool_chunk
 {
-    size_t size;
     struct list_head list;
+    struct mempool_chunk_slot slots[2];
+    char* start;
+    //flags of page table entry, which are cleared for inaccessible pages
+    pteval_t access_flags;
+    //page table entries of the pages
+    pte_t* ptes[MEMPOOL_CHUNK_PAGES];
+    /*
+     * Index of the first page of the span for each page of allocated and
+     * quarantined spans, and for the first and the last pages of free
+     * spans. Other elements are not used.
+     */
+    unsigned short heads[MEMPOOL_CHUNK_PAGES];
+    //descriptors of the spans, indexed by the first page of the span
+    struct mempool_span spans[MEMPOOL_CHUNK_PAGES];
+};
+
+struct mempool_allocator
+{
+    spinlock_t lock;//protect everything below, except lookup of the chunk
+    struct list_head chunks;
+    unsigned int n_chunks;
+    unsigned int max_chunks;
+    //chunks never leave the hash table until allocator is destroyed
+    struct hlist_head chunk_hash[1 << MEMPOOL_CHUNK_HASH_BITS];
+    struct list_head free_lists[MEMPOOL_FREE_LISTS];
+    //freed blocks, oldest first
+    struct list_head quarantine;
+    size_t quarantine_bytes;
+    size_t quarantine_size;
+
+    unsigned long work_flags;
+    struct work_struct work;
 };
 
 //Return alignment for data of given size
@@ -138,89 +141,366 @@ mempool_get_alignment(size_t size)
  * |                                |
  * alignment 'align'            page boundary
  * |...........size_aligned.........|
- * 
+ *
  * (align <= PAGE_SIZE)
  */
 static size_t mempool_get_size_aligned(size_t size, size_t align)
 {
     size_t result = ((size - 1) & ~(align - 1)) + align;
-    //pr_debug("mempool_get_size_aligned: arguments: (0x%zx, 0x%zx), return 0x%zx.",
-    //    size, align, result);
     return result;
 }
 
-// Return address of the page, which contain given address
-static inline void* page_addr(void* addr)
+//Number of pages occupied by the block of given size(without guard page)
+static unsigned int
+mempool_block_pages(size_t size)
 {
-    void* result =
-        (void*)((ptrdiff_t)addr & PAGE_MASK);
-    //pr_debug("page_addr: argument: (%p), return %p.", addr, result);
-    return result;
+    size_t size_aligned = mempool_get_size_aligned(size,
+        mempool_get_alignment(size));
+    return (size_aligned + PAGE_SIZE - 1) >> PAGE_SHIFT;
 }
-//Return relative address on the page
-static inline ptrdiff_t page_addr_rel(void* addr)
+
+static struct mempool_chunk*
+mempool_span_chunk(struct mempool_span* span)
 {
-    ptrdiff_t result = (ptrdiff_t)addr & ~(ptrdiff_t)PAGE_MASK;
-    //pr_debug("page_addr_rel: argument: (%p), return 0x%tx.", addr, result);
-    return result;
+    return container_of(span - span->first, struct mempool_chunk, spans[0]);
 }
 
-// Adress, which will be returned to the caller by .._alloc().
+// Adress, which is returned to the caller by .._alloc().
 static void*
-mempool_block_get_address(struct mempool_block* block)
+mempool_span_block(struct mempool_span* span)
+{
+    char* guard_page = mempool_span_chunk(span)->start
+        + ((size_t)(span->first + span->npages - 1) << PAGE_SHIFT);
+    return guard_page - mempool_get_size_aligned(span->size,
+        mempool_get_alignment(span->size));
+}
+
+static struct mempool_chunk*
+mempool_find_chunk(struct mempool_allocator* allocator, const void* addr)
 {
-    //address of the allocated memory on the page
-    size_t obj_size = mempool_get_size_aligned(block->size,
-            mempool_get_alignment(block->size));
-    ptrdiff_t rel_addr = page_addr_rel((void*)(-obj_size));
-    //address of the first page of the allocated memory
-    void* first_page_addr = page_addr(block);
-    ptrdiff_t block_rel_addr = page_addr_rel(block);
-    if(block_rel_addr + sizeof(*block) >= rel_addr)
+    unsigned long slot = (unsigned long)addr >> MEMPOOL_CHUNK_SHIFT;
+    struct hlist_head* head =
+        &allocator->chunk_hash[hash_long(slot, MEMPOOL_CHUNK_HASH_BITS)];
+    struct mempool_chunk_slot* chunk_slot;
+    struct hlist_node* node;
+
+    hlist_for_each_entry_rcu(chunk_slot, node, head, node)
     {
-        //allocated memory starts on the next page
-        first_page_addr += PAGE_SIZE;
+        struct mempool_chunk* chunk = chunk_slot->chunk;
+        if(((const char*)addr >= chunk->start)
+            && ((const char*)addr < chunk->start + MEMPOOL_CHUNK_SIZE))
+            return chunk;
     }
-    return first_page_addr + rel_addr;
+    return NULL;
 }
-// Size of the allocated memory, which may be used by the caller.
-static int
-mempool_block_get_size(struct mempool_block* block)
+
+/*
+ * Return allocated or quarantined span, which contains the page
+ * with given index, or NULL if the page is free.
+ */
+static struct mempool_span*
+mempool_find_span(struct mempool_chunk* chunk, unsigned int page)
+{
+    unsigned int first = chunk->heads[page];
+    struct mempool_span* span = &chunk->spans[first];
+
+    if((span->state != mempool_span_allocated)
+        && (span->state != mempool_span_quarantined))
+        return NULL;
+    // Index may be left from the span which no longer exists
+    if((first > page) || (page >= first + span->npages))
+        return NULL;
+    return span;
+}
+
+static unsigned int
+mempool_page_index(struct mempool_chunk* chunk, const void* addr)
 {
-    return block->size;
+    return ((const char*)addr - chunk->start) >> PAGE_SHIFT;
 }
-// Page which is locked.
-static void*
-mempool_block_get_address_locked(struct mempool_block* block)
+
+/*
+ * Make pages accessible or not.
+ *
+ * TLB is not flushed: pages made accessible may be used immediately
+ * (x86 doesn't cache non-present entries), pages made inaccessible
+ * remain accessible until the flush (see mempool_flush_tlb_pages_local()).
+ */
+static void
+mempool_set_access(struct mempool_chunk* chunk,
+    unsigned int first, unsigned int n, int access)
 {
-    return page_addr(mempool_block_get_address(block)
-        + mempool_block_get_size(block) - 1) + PAGE_SIZE;
+    unsigned int i;
+    for(i = first; i < first + n; i++)
+    {
+        pte_t* ptep = chunk->ptes[i];
+        set_pte(ptep, access
+            ? pte_set_flags(*ptep, chunk->access_flags)
+            : pte_clear_flags(*ptep, chunk->access_flags));
+    }
 }
-// Address, which should be passed to the free() for freeing memory.
-static void*
-mempool_block_get_address_for_free(struct mempool_block* block)
+
+/*
+ * Flush TLB entries for the pages on the current CPU.
+ *
+ * Needs no IPI, so it may be called under lock with interrupts disabled.
+ * Other CPUs may keep stale entries until mempool_flush_tlb().
+ */
+static void
+mempool_flush_tlb_pages_local(struct mempool_chunk* chunk,
+    unsigned int first, unsigned int n)
 {
-    return (void*) block;
+    unsigned int i;
+    for(i = first; i < first + n; i++)
+        __flush_tlb_one((unsigned long)(chunk->start + ((size_t)i << PAGE_SHIFT)));
 }
 
+static void
+mempool_flush_tlb_local(void* info)
+{
+    __flush_tlb_all();
+}
 
-struct mempool_allocator
+//Should be called in process context.
+static void
+mempool_flush_tlb(void)
 {
-    struct mempool_allocator_ops* ops;
-    struct list_head blocks;
-    spinlock_t lock;//protect 'blocks' from concurrent reads and writes
-};
+    on_each_cpu(mempool_flush_tlb_local, NULL, 1);
+}
 
-// Wrapper for allocator function.
-static void*
-mempool_alloc_with_right_alignment(struct mempool_allocator_ops *ops,
-    size_t size, void* data)
+static unsigned int
+mempool_free_list_index(unsigned int npages)
 {
-    if(ops->alloc_with_right_alignment)
-        return ops->alloc_with_right_alignment(size, data);
-    else return ops->alloc(size + PAGE_SIZE - 1, data);
+    return npages < MEMPOOL_FREE_LISTS - 1 ? npages : MEMPOOL_FREE_LISTS - 1;
 }
 
+//Should be executed under lock.
+static void
+mempool_add_free_span(struct mempool_allocator* allocator,
+    struct mempool_chunk* chunk, unsigned int first, unsigned int npages)
+{
+    struct mempool_span* span = &chunk->spans[first];
+    span->state = mempool_span_free;
+    span->first = first;
+    span->npages = npages;
+    span->size = 0;
+    chunk->heads[first] = first;
+    chunk->heads[first + npages - 1] = first;
+    list_add(&span->list,
+        &allocator->free_lists[mempool_free_list_index(npages)]);
+}
+
+/*
+ * Take free span with 'npages' pages, splitting larger span if needed.
+ *
+ * Return NULL if there is no such span.
+ *
+ * Should be executed under lock.
+ */
+static struct mempool_span*
+mempool_take_span(struct mempool_allocator* allocator, unsigned int npages)
+{
+    unsigned int i;
+    struct mempool_span* span = NULL;
+    struct list_head* large_list =
+        &allocator->free_lists[MEMPOOL_FREE_LISTS - 1];
+
+    for(i = mempool_free_list_index(npages); i < MEMPOOL_FREE_LISTS - 1; i++)
+    {
+        if(!list_empty(&allocator->free_lists[i]))
+        {
+            span = list_first_entry(&allocator->free_lists[i],
+                struct mempool_span, list);
+            break;
+        }
+    }
+    if(span == NULL)
+    {
+        struct mempool_span* span_large;
+        list_for_each_entry(span_large, large_list, list)
+        {
+            if(span_large->npages >= npages)
+            {
+                span = span_large;
+                break;
+            }
+        }
+        if(span == NULL) return NULL;
+    }
+
+    list_del(&span->list);
+    if(span->npages > npages)
+    {
+        mempool_add_free_span(allocator, mempool_span_chunk(span),
+            span->first + npages, span->npages - npages);
+        span->npages = npages;
+    }
+    return span;
+}
+
+/*
+ * Return span into the free lists, merging it with adjacent free spans.
+ * Pages of the span should be inaccessible.
+ *
+ * Should be executed under lock.
+ */
+static void
+mempool_release_span(struct mempool_allocator* allocator,
+    struct mempool_span* span)
+{
+    struct mempool_chunk* chunk = mempool_span_chunk(span);
+    unsigned int first = span->first;
+    unsigned int npages = span->npages;
+    unsigned int next = first + npages;
+
+    span->state = mempool_span_none;
+
+    if((next < MEMPOOL_CHUNK_PAGES)
+        && (chunk->spans[next].state == mempool_span_free))
+    {
+        struct mempool_span* span_next = &chunk->spans[next];
+        list_del(&span_next->list);
+        span_next->state = mempool_span_none;
+        npages += span_next->npages;
+    }
+    if(first > 0)
+    {
+        unsigned int prev = chunk->heads[first - 1];
+        struct mempool_span* span_prev = &chunk->spans[prev];
+        if((span_prev->state == mempool_span_free)
+            && (prev + span_prev->npages == first))
+        {
+            list_del(&span_prev->list);
+            span_prev->state = mempool_span_none;
+            npages += span_prev->npages;
+            first = prev;
+        }
+    }
+    mempool_add_free_span(allocator, chunk, first, npages);
+}
+
+/*
+ * Evict the oldest blocks from the quarantine, until its size is not
+ * greater than 'size'.
+ *
+ * Should be executed under lock.
+ */
+static void
+mempool_quarantine_shrink(struct mempool_allocator* allocator, size_t size)
+{
+    while(allocator->quarantine_bytes > size)
+    {
+        struct mempool_span* span = list_first_entry(&allocator->quarantine,
+            struct mempool_span, list);
+        list_del(&span->list);
+        allocator->quarantine_bytes -= (size_t)(span->npages - 1) << PAGE_SHIFT;
+        mempool_release_span(allocator, span);
+    }
+}
+
+/*
+ * Allocate new chunk and add it to the allocator.
+ *
+ * Should be called in process context.
+ */
+static int
+mempool_add_chunk(struct mempool_allocator* allocator)
+{
+    unsigned long flags;
+    struct mempool_chunk* chunk;
+    unsigned long slot, slot_last;
+    unsigned int i;
+
+    // Reserve place for the chunk
+    spin_lock_irqsave(&allocator->lock, flags);
+    if(allocator->n_chunks >= allocator->max_chunks)
+    {
+        spin_unlock_irqrestore(&allocator->lock, flags);
+        return -ENOSPC;
+    }
+    allocator->n_chunks++;
+    spin_unlock_irqrestore(&allocator->lock, flags);
+
+    chunk = vmalloc(sizeof(*chunk));
+    if(chunk == NULL)
+    {
+        pr_err("Cannot allocate descriptor of the memory chunk.");
+        goto err;
+    }
+    memset(chunk, 0, sizeof(*chunk));
+
+    chunk->start = vmalloc(MEMPOOL_CHUNK_SIZE);
+    if(chunk->start == NULL)
+    {
+        pr_err("Cannot allocate memory chunk.");
+        goto err_start;
+    }
+
+    for(i = 0; i < MEMPOOL_CHUNK_PAGES; i++)
+    {
+        unsigned int level;
+        chunk->ptes[i] = lookup_address(
+            (unsigned long)(chunk->start + ((size_t)i << PAGE_SHIFT)), &level);
+        if((chunk->ptes[i] == NULL) || (level != PG_LEVEL_4K))
+        {
+            pr_err("Page at %p is not mapped with page table entry.",
+                chunk->start + ((size_t)i << PAGE_SHIFT));
+            goto err_ptes;
+        }
+    }
+    /*
+     * Kernel pages are usually global. Non-present page which is global
+     * is considered by the kernel as PROT_NONE one, so clear both flags.
+     */
+    chunk->access_flags = _PAGE_PRESENT
+        | (pte_flags(*chunk->ptes[0]) & _PAGE_GLOBAL);
+
+    // Pages are inaccessible until they are allocated
+    mempool_set_access(chunk, 0, MEMPOOL_CHUNK_PAGES, 0);
+    mempool_flush_tlb();
+
+    chunk->slots[0].chunk = chunk;
+    chunk->slots[1].chunk = chunk;
+    slot = (unsigned long)chunk->start >> MEMPOOL_CHUNK_SHIFT;
+    slot_last = (unsigned long)(chunk->start + MEMPOOL_CHUNK_SIZE - 1)
+        >> MEMPOOL_CHUNK_SHIFT;
+
+    spin_lock_irqsave(&allocator->lock, flags);
+    list_add_tail(&chunk->list, &allocator->chunks);
+    hlist_add_head_rcu(&chunk->slots[0].node,
+        &allocator->chunk_hash[hash_long(slot, MEMPOOL_CHUNK_HASH_BITS)]);
+    if(slot_last != slot)
+        hlist_add_head_rcu(&chunk->slots[1].node,
+            &allocator->chunk_hash[hash_long(slot_last, MEMPOOL_CHUNK_HASH_BITS)]);
+    mempool_add_free_span(allocator, chunk, 0, MEMPOOL_CHUNK_PAGES);
+    spin_unlock_irqrestore(&allocator->lock, flags);
+
+    pr_debug("Memory chunk at %p is added.", chunk->start);
+    return 0;
+
+err_ptes:
+    vfree(chunk->start);
+err_start:
+    vfree(chunk);
+err:
+    spin_lock_irqsave(&allocator->lock, flags);
+    allocator->n_chunks--;
+    spin_unlock_irqrestore(&allocator->lock, flags);
+    return -ENOMEM;
+}
+
+static void
+mempool_work_func(struct work_struct* work)
+{
+    struct mempool_allocator* allocator =
+        container_of(work, struct mempool_allocator, work);
+
+    if(test_and_clear_bit(MEMPOOL_WORK_GROW, &allocator->work_flags))
+        mempool_add_chunk(allocator);
+    // One flush for all pages made inaccessible since the previous one
+    if(test_and_clear_bit(MEMPOOL_WORK_FLUSH, &allocator->work_flags))
+        mempool_flush_tlb();
+}
 
 /*
  * Create memory pool allocator, which may be used for allocate memory
@@ -228,21 +508,38 @@ mempool_alloc_with_right_alignment(struct mempool_allocator_ops *ops,
  */
 
 mempool_allocator_t
-mempool_allocator_create(struct mempool_allocator_ops* ops)
+mempool_allocator_create(const struct mempool_allocator_params* params)
 {
+    unsigned int i;
     struct mempool_allocator* allocator =
         kmalloc(sizeof(*allocator), GFP_KERNEL);
-    
+
     if(allocator == NULL)
     {
         pr_err("Cannot allocate structure for memory pool.");
         return NULL;
     }
 
-    allocator->ops = ops;
-    INIT_LIST_HEAD(&allocator->blocks);
     spin_lock_init(&allocator->lock);
-    pr_debug("PAGE_SIZE is 0x%x.", (int)PAGE_SIZE);
+    INIT_LIST_HEAD(&allocator->chunks);
+    allocator->n_chunks = 0;
+    allocator->max_chunks = params->max_size / MEMPOOL_CHUNK_SIZE;
+    if(allocator->max_chunks == 0) allocator->max_chunks = 1;
+    for(i = 0; i < ARRAY_SIZE(allocator->chunk_hash); i++)
+        INIT_HLIST_HEAD(&allocator->chunk_hash[i]);
+    for(i = 0; i < MEMPOOL_FREE_LISTS; i++)
+        INIT_LIST_HEAD(&allocator->free_lists[i]);
+    INIT_LIST_HEAD(&allocator->quarantine);
+    allocator->quarantine_bytes = 0;
+    allocator->quarantine_size = params->quarantine_size;
+    allocator->work_flags = 0;
+    INIT_WORK(&allocator->work, mempool_work_func);
+
+    if(mempool_add_chunk(allocator))
+    {
+        kfree(allocator);
+        return NULL;
+    }
     return allocator;
 }
 
@@ -252,89 +549,208 @@ mempool_allocator_create(struct mempool_allocator_ops* ops)
 
 void mempool_allocator_destroy(mempool_allocator_t allocator)
 {
-    BUG_ON(!list_empty(&allocator->blocks));
+    unsigned int n_blocks = 0;
+
+    cancel_work_sync(&allocator->work);
+
+    while(!list_empty(&allocator->chunks))
+    {
+        unsigned int i;
+        struct mempool_chunk* chunk = list_first_entry(&allocator->chunks,
+            struct mempool_chunk, list);
+        list_del(&chunk->list);
+
+        for(i = 0; i < MEMPOOL_CHUNK_PAGES; i++)
+        {
+            if(chunk->spans[i].state == mempool_span_allocated)
+                n_blocks++;
+        }
+        // vfree() expects all pages to be present
+        mempool_set_access(chunk, 0, MEMPOOL_CHUNK_PAGES, 1);
+        vfree(chunk->start);
+        vfree(chunk);
+    }
+    if(n_blocks)
+        pr_warning("%u blocks were not freed before memory pool was destroyed.",
+            n_blocks);
     kfree(allocator);
 }
 
 /*
  * Allocate memory of size 'size'.
- * 
- * 'data' parameter will be passed to the corresponding 
- * allocator function, for which this allocator was created.
  */
 void* mempool_allocator_alloc(mempool_allocator_t allocator,
-    size_t size, void* data)
+    size_t size, gfp_t flags)
 {
-    unsigned long flags;
-    struct mempool_block* block;
-    size_t real_size = sizeof(struct mempool_block)
-        + mempool_get_size_aligned(size, mempool_get_alignment(size))
-        + PAGE_SIZE;
-    block = mempool_alloc_with_right_alignment(allocator->ops,
-        real_size, data);
-    if(block == NULL)
+    unsigned long irq_flags;
+    struct mempool_span* span;
+    struct mempool_chunk* chunk;
+    unsigned int i, npages;
+    void* addr;
+
+    if((size == 0) || (size >= MEMPOOL_CHUNK_SIZE)) return NULL;
+    npages = mempool_block_pages(size) + 1;
+    if(npages > MEMPOOL_CHUNK_PAGES) return NULL;
+
+    spin_lock_irqsave(&allocator->lock, irq_flags);
+    span = mempool_take_span(allocator, npages);
+    if((span == NULL) && (flags & __GFP_WAIT))
+    {
+        spin_unlock_irqrestore(&allocator->lock, irq_flags);
+        mempool_add_chunk(allocator);
+        spin_lock_irqsave(&allocator->lock, irq_flags);
+        span = mempool_take_span(allocator, npages);
+    }
+    else if(span == NULL)
+    {
+        // Chunk cannot be allocated in atomic context
+        set_bit(MEMPOOL_WORK_GROW, &allocator->work_flags);
+        schedule_work(&allocator->work);
+    }
+    // Last resort - reuse memory from the quarantine
+    while((span == NULL) && !list_empty(&allocator->quarantine))
+    {
+        struct mempool_span* span_old = list_first_entry(
+            &allocator->quarantine, struct mempool_span, list);
+        mempool_quarantine_shrink(allocator, allocator->quarantine_bytes
+            - ((size_t)(span_old->npages - 1) << PAGE_SHIFT));
+        span = mempool_take_span(allocator, npages);
+    }
+    if(span == NULL)
     {
-        pr_err("Cannot allocate memory for block.");
+        spin_unlock_irqrestore(&allocator->lock, irq_flags);
         return NULL;
     }
-    block->size = size;
-    page_no_access(mempool_block_get_address_locked(block));
-    pr_debug("Block address: %p.", block);
-    pr_debug("Returned memory address: %p, size: %zu.",
-        mempool_block_get_address(block),
-        mempool_block_get_size(block));
-    pr_debug("Address of the page blocked: %p.",
-        mempool_block_get_address_locked(block));
-    //((char*)mempool_block_get_address_locked(block))[0] = 'f';//should fail
-    spin_lock_irqsave(&allocator->lock, flags);
-    list_add(&block->list, &allocator->blocks);
-    spin_unlock_irqrestore(&allocator->lock, flags);
-    
-    return mempool_block_get_address(block);
+
+    chunk = mempool_span_chunk(span);
+    span->state = mempool_span_allocated;
+    span->size = size;
+    for(i = span->first; i < span->first + npages; i++)
+        chunk->heads[i] = span->first;
+    // All pages except the guard one
+    mempool_set_access(chunk, span->first, npages - 1, 1);
+    addr = mempool_span_block(span);
+    spin_unlock_irqrestore(&allocator->lock, irq_flags);
+
+    memset(addr, (flags & __GFP_ZERO) ? 0 : MEMPOOL_GARBAGE, size);
+    return addr;
 }
 
 int mempool_allocator_free(mempool_allocator_t allocator,
     void* addr)
 {
-    unsigned long flags;
-    struct mempool_block* block;
-    spin_lock_irqsave(&allocator->lock, flags);
-    list_for_each_entry(block, &allocator->blocks, list)
+    unsigned long irq_flags;
+    struct mempool_chunk* chunk;
+    struct mempool_span* span;
+    enum mempool_span_state state;
+    void* block;
+    size_t size;
+
+    spin_lock_irqsave(&allocator->lock, irq_flags);
+    chunk = mempool_find_chunk(allocator, addr);
+    if(chunk == NULL)
     {
-        if(mempool_block_get_address(block) == addr)
-        {
-            list_del(&block->list);
-            spin_unlock_irqrestore(&allocator->lock, flags);
-            page_restore_access(mempool_block_get_address_locked(block));
-            allocator->ops->free(
-                mempool_block_get_address_for_free(block));
-            return 0;
-        }
+        spin_unlock_irqrestore(&allocator->lock, irq_flags);
+        return 1;
     }
-    spin_unlock_irqrestore(&allocator->lock, flags);
-    return 1;
+    span = mempool_find_span(chunk, mempool_page_index(chunk, addr));
+    if((span == NULL) || (span->state != mempool_span_allocated)
+        || (mempool_span_block(span) != addr))
+    {
+        state = span ? span->state : mempool_span_free;
+        block = span ? mempool_span_block(span) : NULL;
+        size = span ? span->size : 0;
+        spin_unlock_irqrestore(&allocator->lock, irq_flags);
+
+        if(state == mempool_span_quarantined && block == addr)
+            pr_err("Double free of the block at %p, size %zu.", block, size);
+        else if(state == mempool_span_free)
+            pr_err("Attempt to free memory at %p, which is not allocated.", addr);
+        else
+            pr_err("Attempt to free memory at %p, which is inside the %s block at %p, size %zu.",
+                addr, state == mempool_span_allocated ? "allocated" : "freed",
+                block, size);
+        dump_stack();
+        return 0;
+    }
+
+    mempool_set_access(chunk, span->first, span->npages - 1, 0);
+    // Access after free on this CPU, the most common case, faults at once.
+    mempool_flush_tlb_pages_local(chunk, span->first, span->npages - 1);
+    if(allocator->quarantine_size)
+    {
+        span->state = mempool_span_quarantined;
+        list_add_tail(&span->list, &allocator->quarantine);
+        allocator->quarantine_bytes += (size_t)(span->npages - 1) << PAGE_SHIFT;
+        mempool_quarantine_shrink(allocator, allocator->quarantine_size);
+    }
+    else
+    {
+        mempool_release_span(allocator, span);
+    }
+    spin_unlock_irqrestore(&allocator->lock, irq_flags);
+
+    set_bit(MEMPOOL_WORK_FLUSH, &allocator->work_flags);
+    schedule_work(&allocator->work);
+    return 0;
 }
 
 /*
  * Return size of the allocated object.
- * 
+ *
  * If object was not allocated by this allocator, return 0.
  */
 size_t mempool_allocator_size(mempool_allocator_t allocator,
     void* addr)
 {
-    unsigned long flags;
-    struct mempool_block* block;
+    unsigned long irq_flags;
+    struct mempool_chunk* chunk;
+    struct mempool_span* span;
     size_t result = 0;
-    spin_lock_irqsave(&allocator->lock, flags);
-    list_for_each_entry(block, &allocator->blocks, list)
+
+    spin_lock_irqsave(&allocator->lock, irq_flags);
+    chunk = mempool_find_chunk(allocator, addr);
+    if(chunk != NULL)
     {
-        if(mempool_block_get_address(block) == addr)
-        {
-            result = mempool_block_get_size(block);
-            break;
-        }
+        span = mempool_find_span(chunk, mempool_page_index(chunk, addr));
+        if((span != NULL) && (span->state == mempool_span_allocated)
+            && (mempool_span_block(span) == addr))
+            result = span->size;
     }
-    spin_unlock_irqrestore(&allocator->lock, flags);
+    spin_unlock_irqrestore(&allocator->lock, irq_flags);
     return result;
 }
+
+int mempool_allocator_report_address(mempool_allocator_t allocator,
+    void* addr)
+{
+    struct mempool_chunk* chunk;
+    struct mempool_span* span;
+    char* block;
+    size_t size;
+
+    chunk = mempool_find_chunk(allocator, addr);
+    if(chunk == NULL) return 0;
+
+    span = mempool_find_span(chunk, mempool_page_index(chunk, addr));
+    if(span == NULL)
+    {
+        pr_err("Access to %p, which is in the free memory of the pool.", addr);
+        return 1;
+    }
+    block = mempool_span_block(span);
+    size = span->size;
+    if(span->state == mempool_span_quarantined)
+        pr_err("Access to %p, which is at offset %td in the freed block at %p, size %zu (use after free).",
+            addr, (char*)addr - block, block, size);
+    else if((char*)addr >= block + size)
+        pr_err("Access to %p, which is %td bytes after the end of the block at %p, size %zu (out of bounds).",
+            addr, (char*)addr - (block + size), block, size);
+    else if((char*)addr < block)
+        pr_err("Access to %p, which is %td bytes before the block at %p, size %zu (out of bounds).",
+            addr, block - (char*)addr, block, size);
+    else
+        pr_err("Access to %p, which is at offset %td in the block at %p, size %zu.",
+            addr, (char*)addr - block, block, size);
+    return 1;
+}
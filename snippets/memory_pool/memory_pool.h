@@ -1,95 +1,119 @@
 /*
- * Provide wrapper to allocator, 
+ * Provide debugging allocator,
  * which control in some extent access to allocated memory.
  *
  * Such control has features:
- * 
+ *
  * 1) Prevent access to the memory after the bound of allocated one.
- * 2) Prevent access to the recently freed memory
- *     (until some period of time, or some number of allocation 
- * 	   occures after free)
+ *    Block is aligned on its right end to the page boundary and the next
+ *    page (guard page) is made inaccessible.
+ * 2) Prevent access to the recently freed memory.
+ *    Freed block is made inaccessible and is kept in the quarantine
+ *    until the total size of the blocks freed after it exceeds
+ *    'quarantine_size'. Only after that the memory may be reused.
  * 3) Allocated memory is filled with some "garbage",
  * 	   so reading of uninitializing memory may lead to error.
+ *
+ * Invalid access leads to page fault, mempool_allocator_report_address()
+ * may be used to describe the faulting address.
+ *
+ * Memory is taken from chunks of virtual memory (vmalloc), which are
+ * allocated when needed, and is never returned to the system until the
+ * allocator is destroyed. Pages are made inaccessible by clearing
+ * 'present' bit in their page table entries. TLB is flushed once for
+ * a batch of such changes, from the workqueue.
+ *
+ * Only x86 is supported for now.
  */
 
-#include <linux/slab.h>
+#include <linux/types.h>
+#include <linux/gfp.h>
 
 typedef struct mempool_allocator* mempool_allocator_t;
 
-/*
- * Operations of allocator, for which wrapper is created.
- */
-struct mempool_allocator_ops
+struct mempool_allocator_params
 {
 	/*
-	 * Should allocate contiguous memory of size 'size'.
-	 * 
-	 * 'data' is same as given to the wrapper allocation function.
-	 */ 
-	void* (*alloc)(size_t size, void* data);
-	void (*free)(void* addr);
-	
-	/*
-	 * Optional functions.
-	 * 
-	 * If not NULL, them will be used by wrapper.
-	 * Otherwise them will be emulated.
+	 * Maximum total size of the memory chunks, in bytes.
+	 *
+	 * Each block occupies at least 2 pages: one for the data and
+	 * the guard page.
 	 */
-	
+	size_t max_size;
 	/*
-	 * Should allocate memory of size at least as 'size',
-	 * and with right boundary aligned on PAGE_SIZE.
-	 * 
-	 * Return value is interpreted as start of allocated memory, which
-	 * may be passed to free().
-	 * 
-	 * (<return value> + size - 1) is interpreted as pointer inside
-	 * the last page, which is FULLY covered by the allocated memory.
-	 * 
-	 * (That means, that caller may extend (<return value> + size) 
-	 * memory boundary to the page boundary.)
+	 * Maximum total size of the freed blocks kept in the quarantine,
+	 * in bytes (guard pages are not counted).
+	 *
+	 * 0 means that freed memory may be reused immediately.
 	 */
-	void* (*alloc_with_right_alignment)(size_t size, void* data);
+	size_t quarantine_size;
 };
 
 /*
  * Create memory pool allocator, which may be used for allocate memory
  * with definite controlling.
+ *
+ * Should be called in process context.
  */
 
 mempool_allocator_t
-mempool_allocator_create(struct mempool_allocator_ops* ops);
+mempool_allocator_create(const struct mempool_allocator_params* params);
 
 /*
- * Destroy memory pool allocator
+ * Destroy memory pool allocator.
+ *
+ * All memory of the allocator is freed, including the blocks which
+ * are not freed by the user (they are reported).
+ *
+ * Should be called in process context.
  */
 
 void mempool_allocator_destroy(mempool_allocator_t allocator);
 
 /*
  * Allocate memory of size 'size'.
- * 
- * 'data' parameter will be passed to the corresponding 
- * allocator function, for which this allocator was created.
+ *
+ * 'flags' are interpreted as for kmalloc(). If there is no free memory
+ * in the chunks and 'flags' permit sleeping, new chunk is allocated.
+ * Otherwise new chunk is allocated later, from the workqueue.
+ *
+ * Return NULL if memory cannot be allocated now, block is larger than
+ * a chunk or 'max_size' is reached. The caller may use another
+ * allocator in that case.
  */
 void* mempool_allocator_alloc(mempool_allocator_t allocator,
-	size_t size, void* data);
+	size_t size, gfp_t flags);
 
 /*
  * Free memory, allocated by the 'allocator'.
  *
  * Return 0.
- * 
+ *
  * If given memory wasn't allocated by this allocator,
  * do nothing and return not 0.
+ *
+ * Double free and free of the pointer inside the block are reported
+ * (0 is returned in these cases).
  */
 int mempool_allocator_free(mempool_allocator_t allocator,
 	void* addr);
 
 /*
  * Return size of the allocated object.
- * 
+ *
  * If object was not allocated by this allocator, return 0.
  */
 size_t mempool_allocator_size(mempool_allocator_t allocator,
 	void* addr);
+
+/*
+ * If 'addr' belongs to the memory of the allocator, print information
+ * about it (which block is overrun or is freed, etc.) and return not 0.
+ * Otherwise return 0.
+ *
+ * Doesn't take any locks, so it may be called from page fault or die
+ * notifier. Information may be inaccurate if the block is changed
+ * concurrently.
+ */
+int mempool_allocator_report_address(mempool_allocator_t allocator,
+	void* addr);
@@ -4,50 +4,77 @@
 #include "memory_pool.h"
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/kernel.h>
+#include <linux/kdebug.h> /* die notifier */
 
-static mempool_allocator_t allocator;
-
-static void* 
-ops_alloc(size_t size, void* data)
-{
-    return kmalloc(size, *((gfp_t*)data));
-}
+#include <asm/system.h> /* read_cr2 */
 
-static void
-ops_free(void* addr)
-{
-    kfree(addr);
-}
+static mempool_allocator_t allocator;
 
+/*
+ * Maximum total size of the memory pool, in bytes. Requests which cannot
+ * be satisfied from the pool are passed to the original allocator.
+ */
+static unsigned long pool_size = 64 * 1024 * 1024;
+module_param(pool_size, ulong, S_IRUGO);
 
-struct mempool_allocator_ops ops = 
-{
-    .alloc = ops_alloc,
-    .free = ops_free
-};
+/*
+ * Maximum total size of the freed blocks, which are kept inaccessible
+ * before their memory may be reused.
+ */
+static unsigned long quarantine_size = 4 * 1024 * 1024;
+module_param(quarantine_size, ulong, S_IRUGO);
+
+/*
+ * Whether __kmalloc() requests are allocated from the pool.
+ *
+ * Pool memory is not linearly mapped, so virt_to_page(), sg_set_buf()
+ * and dma_map_single() don't work for it. Drivers often pass kmalloc
+ * buffers to them, so this is disabled by default.
+ */
+static int pool_kmalloc = 0;
+module_param(pool_kmalloc, int, S_IRUGO);
 
 static void*
 repl___kmalloc(size_t size, gfp_t flags)
 {
-    return mempool_allocator_alloc(allocator, size, &flags);
+    void* addr = NULL;
+    if(pool_kmalloc && !(flags & GFP_DMA))
+        addr = mempool_allocator_alloc(allocator, size, flags);
+    return addr ? addr : __kmalloc(size, flags);
 }
 
-static void*
-repl_kmem_cache_alloc(struct kmem_cache* mc, gfp_t flags)
+/*
+ * Whether objects of the cache may be allocated from the pool.
+ *
+ * Pool doesn't call constructors and fills new blocks with garbage.
+ * Objects of SLAB_DESTROY_BY_RCU caches may be read after they are
+ * freed, until the grace period ends, but the pool makes freed blocks
+ * inaccessible at once. Such caches are left to the original allocator,
+ * as well as caches for DMA: pool memory is not linearly mapped.
+ */
+static int
+cache_uses_pool(struct kmem_cache* mc)
 {
-    return mempool_allocator_alloc(allocator,
-        kmem_cache_size(mc), &flags);
+#ifdef CONFIG_SLOB
+    // Cache structure is opaque.
+    return 0;
+#else
+    return (mc->ctor == NULL)
+        && !(mc->flags & (SLAB_DESTROY_BY_RCU | SLAB_CACHE_DMA));
+#endif
 }
 
-static unsigned long
-repl___get_free_pages(gfp_t flags, unsigned int order)
+static void*
+repl_kmem_cache_alloc(struct kmem_cache* mc, gfp_t flags)
 {
-    return (unsigned long)mempool_allocator_alloc(allocator,
-        PAGE_SIZE << order, &flags);
+    void* addr = NULL;
+    if(cache_uses_pool(mc))
+        addr = mempool_allocator_alloc(allocator, kmem_cache_size(mc), flags);
+    return addr ? addr : kmem_cache_alloc(mc, flags);
 }
 
-
 static void
 repl_kfree(void* addr)
 {
@@ -58,25 +85,34 @@ repl_kfree(void* addr)
 static void
 repl_kmem_cache_free(struct kmem_cache* mc, void* addr)
 {
-    if(mempool_allocator_free(allocator, addr))
+    if(!cache_uses_pool(mc) || mempool_allocator_free(allocator, addr))
         kmem_cache_free(mc, addr);
 }
 
-static void
-repl_free_pages(unsigned long addr, unsigned int order)
+/*
+ * Describe the address which cause the oops, if it belongs to the pool.
+ */
+static int
+die_notifier_call(struct notifier_block* nb, unsigned long val, void* data)
 {
-    if(mempool_allocator_free(allocator, (void*)addr))
-        free_pages(addr, order);
+    struct die_args* args = data;
+    // 14 - page fault
+    if((val == DIE_OOPS) && (args->trapnr == 14))
+        mempool_allocator_report_address(allocator, (void*)read_cr2());
+    return NOTIFY_DONE;
 }
 
+static struct notifier_block die_notifier =
+{
+    .notifier_call = die_notifier_call,
+};
+
 /* Names and addresses of the functions of interest */
 static void* orig_addrs[] = {
     (void*)&__kmalloc,
     (void*)&kfree,
     (void*)&kmem_cache_alloc,
-    (void*)&kmem_cache_free,
-    (void*)&__get_free_pages,
-    (void*)&free_pages
+    (void*)&kmem_cache_free
 };
 
 /* Addresses of the replacement functions - must go in the same order 
@@ -86,9 +122,7 @@ static void* repl_addrs[] = {
     (void*)&repl___kmalloc,
     (void*)&repl_kfree,
     (void*)&repl_kmem_cache_alloc,
-    (void*)&repl_kmem_cache_free,
-    (void*)&repl___get_free_pages,
-    (void*)&repl_free_pages
+    (void*)&repl_kmem_cache_free
 };
 
 static struct kedr_payload payload = {
@@ -104,16 +138,28 @@ static int __init
 this_module_init(void)
 {
     int result;
-    allocator = mempool_allocator_create(&ops);
+    struct mempool_allocator_params params = {
+        .max_size = pool_size,
+        .quarantine_size = quarantine_size
+    };
+    allocator = mempool_allocator_create(&params);
     if(allocator == 0)
     {
         pr_err("Cannot create allocator.");
         return -ENOMEM;
     }
+    result = register_die_notifier(&die_notifier);
+    if(result)
+    {
+        pr_err("Cannot register die notifier.");
+        mempool_allocator_destroy(allocator);
+        return result;
+    }
     result = kedr_payload_register(&payload);
     if(result)
     {
         pr_err("Cannot register payload.");
+        unregister_die_notifier(&die_notifier);
         mempool_allocator_destroy(allocator);
         return result;
     }
@@ -124,6 +170,7 @@ static void __exit
 this_module_exit(void)
 {
     kedr_payload_unregister(&payload);
+    unregister_die_notifier(&die_notifier);
     mempool_allocator_destroy(allocator);
 }
 
@@ -0,0 +1,48 @@
+/*
+ * Page table entries for user space.
+ *
+ * Each page has its own "entry", created on the first lookup_address().
+ * set_pte() changes protection of the page with mprotect(), so access
+ * to the page which is not present results in SIGSEGV.
+ */
+
+#ifndef MEMPOOL_USER_PGTABLE_H
+#define MEMPOOL_USER_PGTABLE_H
+
+#include <linux/mm.h>
+
+typedef unsigned long pteval_t;
+
+typedef struct
+{
+    pteval_t pte;
+    void* page;
+} pte_t;
+
+#define _PAGE_PRESENT 0x001UL
+#define _PAGE_RW 0x002UL
+#define _PAGE_GLOBAL 0x100UL
+
+enum { PG_LEVEL_NONE, PG_LEVEL_4K, PG_LEVEL_2M };
+
+pte_t* lookup_address(unsigned long address, unsigned int* level);
+void set_pte(pte_t* ptep, pte_t pte);
+
+static inline pteval_t pte_flags(pte_t pte)
+{
+    return pte.pte;
+}
+
+static inline pte_t pte_set_flags(pte_t pte, pteval_t set)
+{
+    pte.pte |= set;
+    return pte;
+}
+
+static inline pte_t pte_clear_flags(pte_t pte, pteval_t clear)
+{
+    pte.pte &= ~clear;
+    return pte;
+}
+
+#endif /* MEMPOOL_USER_PGTABLE_H */
@@ -0,0 +1,19 @@
+#ifndef MEMPOOL_USER_TLBFLUSH_H
+#define MEMPOOL_USER_TLBFLUSH_H
+
+// Only counted, so the program may check how often TLB is flushed.
+extern unsigned long user_tlb_flushes;
+// Flushes of single pages on the current CPU.
+extern unsigned long user_tlb_page_flushes;
+
+static inline void __flush_tlb_all(void)
+{
+    user_tlb_flushes++;
+}
+
+static inline void __flush_tlb_one(unsigned long addr)
+{
+    user_tlb_page_flushes++;
+}
+
+#endif /* MEMPOOL_USER_TLBFLUSH_H */
@@ -0,0 +1,15 @@
+#ifndef MEMPOOL_USER_BITOPS_H
+#define MEMPOOL_USER_BITOPS_H
+
+static inline void set_bit(int nr, unsigned long* addr)
+{
+    __atomic_fetch_or(addr, 1UL << nr, __ATOMIC_SEQ_CST);
+}
+
+static inline int test_and_clear_bit(int nr, unsigned long* addr)
+{
+    return (__atomic_fetch_and(addr, ~(1UL << nr), __ATOMIC_SEQ_CST)
+        >> nr) & 1;
+}
+
+#endif /* MEMPOOL_USER_BITOPS_H */
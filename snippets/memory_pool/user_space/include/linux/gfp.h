@@ -0,0 +1,16 @@
+/*
+ * Allocation flags used by the memory pool, for user space.
+ */
+
+#ifndef MEMPOOL_USER_GFP_H
+#define MEMPOOL_USER_GFP_H
+
+#include <linux/types.h>
+
+#define __GFP_WAIT 0x10u
+#define __GFP_ZERO 0x8000u
+
+#define GFP_ATOMIC 0u
+#define GFP_KERNEL __GFP_WAIT
+
+#endif /* MEMPOOL_USER_GFP_H */
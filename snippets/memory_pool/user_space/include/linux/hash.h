@@ -0,0 +1,15 @@
+/*
+ * hash_long() for user space, same as in the kernel (64-bit).
+ */
+
+#ifndef MEMPOOL_USER_HASH_H
+#define MEMPOOL_USER_HASH_H
+
+#define GOLDEN_RATIO_PRIME_64 0x9e37fffffffc0001UL
+
+static inline unsigned long hash_long(unsigned long val, unsigned int bits)
+{
+    return (val * GOLDEN_RATIO_PRIME_64) >> (64 - bits);
+}
+
+#endif /* MEMPOOL_USER_HASH_H */
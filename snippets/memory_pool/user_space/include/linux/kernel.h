@@ -0,0 +1,38 @@
+/*
+ * Minimal user-space replacement of <linux/kernel.h> for building
+ * the memory pool allocator as an ordinary program.
+ */
+
+#ifndef MEMPOOL_USER_KERNEL_H
+#define MEMPOOL_USER_KERNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+
+#define pr_err(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define pr_warning(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+// Debug output is disabled, as in the kernel without DEBUG defined
+#define pr_debug(fmt, ...) do {} while(0)
+
+#define dump_stack() fprintf(stderr, "(stack is dumped here)\n")
+
+#define BUG()                                                   \
+do {                                                            \
+    fprintf(stderr, "BUG at %s:%d\n", __FILE__, __LINE__);      \
+    abort();                                                    \
+} while(0)
+
+#define BUG_ON(cond)                                            \
+do {                                                            \
+    if(cond)                                                    \
+        BUG();                                                  \
+} while(0)
+
+#define container_of(ptr, type, member) \
+    ((type*)((char*)(ptr) - offsetof(type, member)))
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#endif /* MEMPOOL_USER_KERNEL_H */
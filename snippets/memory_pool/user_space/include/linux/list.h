@@ -0,0 +1,89 @@
+/*
+ * The part of <linux/list.h> used by the memory pool, for user space.
+ */
+
+#ifndef MEMPOOL_USER_LIST_H
+#define MEMPOOL_USER_LIST_H
+
+#include <linux/kernel.h>
+
+struct list_head
+{
+    struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head* list)
+{
+    list->next = list;
+    list->prev = list;
+}
+
+static inline void __list_add(struct list_head* item,
+    struct list_head* prev, struct list_head* next)
+{
+    next->prev = item;
+    item->next = next;
+    item->prev = prev;
+    prev->next = item;
+}
+
+static inline void list_add(struct list_head* item, struct list_head* head)
+{
+    __list_add(item, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head* item,
+    struct list_head* head)
+{
+    __list_add(item, head->prev, head);
+}
+
+static inline void list_del(struct list_head* item)
+{
+    item->prev->next = item->next;
+    item->next->prev = item->prev;
+    item->next = item->prev = NULL;
+}
+
+static inline int list_empty(const struct list_head* head)
+{
+    return head->next == head;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry(ptr, type, member) list_entry((ptr)->next, type, member)
+
+#define list_for_each_entry(pos, head, member)                          \
+    for(pos = list_entry((head)->next, __typeof__(*pos), member);       \
+        &pos->member != (head);                                         \
+        pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+struct hlist_head
+{
+    struct hlist_node* first;
+};
+
+struct hlist_node
+{
+    struct hlist_node *next, **pprev;
+};
+
+#define INIT_HLIST_HEAD(ptr) ((ptr)->first = NULL)
+
+static inline void hlist_add_head_rcu(struct hlist_node* n,
+    struct hlist_head* h)
+{
+    n->next = h->first;
+    n->pprev = &h->first;
+    if(h->first) h->first->pprev = &n->next;
+    __atomic_store_n(&h->first, n, __ATOMIC_RELEASE);
+}
+
+#define hlist_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define hlist_for_each_entry_rcu(tpos, pos, head, member)               \
+    for(pos = __atomic_load_n(&(head)->first, __ATOMIC_CONSUME);        \
+        pos && ((tpos = hlist_entry(pos, __typeof__(*tpos), member)), 1); \
+        pos = __atomic_load_n(&pos->next, __ATOMIC_CONSUME))
+
+#endif /* MEMPOOL_USER_LIST_H */
@@ -0,0 +1,9 @@
+#ifndef MEMPOOL_USER_MM_H
+#define MEMPOOL_USER_MM_H
+
+#include <linux/kernel.h>
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1UL << PAGE_SHIFT)
+
+#endif /* MEMPOOL_USER_MM_H */
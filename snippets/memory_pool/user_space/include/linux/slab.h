@@ -0,0 +1,10 @@
+#ifndef MEMPOOL_USER_SLAB_H
+#define MEMPOOL_USER_SLAB_H
+
+#include <linux/kernel.h>
+#include <linux/gfp.h>
+
+#define kmalloc(size, flags) malloc(size)
+#define kfree(addr) free(addr)
+
+#endif /* MEMPOOL_USER_SLAB_H */
@@ -0,0 +1,7 @@
+#ifndef MEMPOOL_USER_SMP_H
+#define MEMPOOL_USER_SMP_H
+
+// There is only one "CPU"
+#define on_each_cpu(func, info, wait) do { (func)(info); } while(0)
+
+#endif /* MEMPOOL_USER_SMP_H */
@@ -0,0 +1,12 @@
+/*
+ * Types from <linux/types.h> used by the memory pool, for user space.
+ */
+
+#ifndef MEMPOOL_USER_TYPES_H
+#define MEMPOOL_USER_TYPES_H
+
+#include <stddef.h>
+
+typedef unsigned int gfp_t;
+
+#endif /* MEMPOOL_USER_TYPES_H */
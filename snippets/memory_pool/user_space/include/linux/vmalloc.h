@@ -0,0 +1,20 @@
+/*
+ * vmalloc() for user space: memory is page-aligned, so protection of
+ * its pages may be changed.
+ */
+
+#ifndef MEMPOOL_USER_VMALLOC_H
+#define MEMPOOL_USER_VMALLOC_H
+
+#include <linux/mm.h>
+
+static inline void* vmalloc(unsigned long size)
+{
+    void* addr;
+    if(posix_memalign(&addr, PAGE_SIZE, size)) return NULL;
+    return addr;
+}
+
+#define vfree(addr) free(addr)
+
+#endif /* MEMPOOL_USER_VMALLOC_H */
@@ -0,0 +1,29 @@
+/*
+ * Workqueue for user space: scheduled works are executed only when
+ * the program calls user_run_works(), so the program controls when
+ * deferred operations happen.
+ */
+
+#ifndef MEMPOOL_USER_WORKQUEUE_H
+#define MEMPOOL_USER_WORKQUEUE_H
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct* work);
+
+struct work_struct
+{
+    work_func_t func;
+    int pending;
+    struct work_struct* next;
+};
+
+#define INIT_WORK(work, f) \
+    do { (work)->func = (f); (work)->pending = 0; (work)->next = NULL; } while(0)
+
+int schedule_work(struct work_struct* work);
+int cancel_work_sync(struct work_struct* work);
+
+// Execute all scheduled works, return number of works executed.
+int user_run_works(void);
+
+#endif /* MEMPOOL_USER_WORKQUEUE_H */
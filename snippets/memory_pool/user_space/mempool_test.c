@@ -0,0 +1,451 @@
+/*
+ * Test and benchmark of the memory pool allocator (memory_pool.c),
+ * built in user space.
+ *
+ * Page protection is emulated with mprotect(), so access to the guard
+ * page or to the freed block results in SIGSEGV. The signal handler
+ * describes the address with mempool_allocator_report_address(), as the
+ * die notifier of the payload does, and returns to the test.
+ *
+ * Checks:
+ * - layout and content of the allocated blocks, guard pages;
+ * - access after free, double free, free of a pointer inside the block;
+ * - FIFO order and the size limit of the quarantine;
+ * - one TLB flush for a batch of frees;
+ * - growth of the pool in atomic context (from the workqueue) and in
+ *   process context, 'max_size' limit, reuse of the quarantine when the
+ *   pool cannot grow, merging of the free spans.
+ *
+ * Then the number of alloc/free pairs and of the lookups of block size
+ * per second is output for the different numbers of live blocks.
+ *
+ * Usage: mempool_test [-n operations]
+ *   -n - number of operations for each benchmark (default: 1000000).
+ */
+
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/workqueue.h>
+#include <asm/tlbflush.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memory_pool.h"
+
+#define CHUNK_PAGES 512
+#define CHUNK_SIZE (CHUNK_PAGES * PAGE_SIZE)
+
+static int errors = 0;
+
+#define check(cond, fmt, ...)                                   \
+do {                                                            \
+    if(!(cond))                                                 \
+    {                                                           \
+        printf("FAIL (line %d): " fmt "\n", __LINE__, ##__VA_ARGS__); \
+        errors++;                                               \
+    }                                                           \
+} while(0)
+
+static unsigned long rnd_state = 1;
+
+static unsigned long rnd_next(void)
+{
+    rnd_state = rnd_state * 1103515245UL + 12345UL;
+    return (rnd_state >> 16) & 0x7fff;
+}
+
+static mempool_allocator_t create(size_t max_size, size_t quarantine_size)
+{
+    struct mempool_allocator_params params = {
+        .max_size = max_size,
+        .quarantine_size = quarantine_size
+    };
+    mempool_allocator_t allocator = mempool_allocator_create(&params);
+    if(allocator == NULL)
+    {
+        printf("FAIL: cannot create allocator\n");
+        exit(1);
+    }
+    return allocator;
+}
+
+/////////////////////////// Faults ///////////////////////////////////
+
+static mempool_allocator_t fault_allocator;
+static sigjmp_buf fault_env;
+static void* volatile fault_addr;
+static volatile int fault_reported;
+
+static void segv_handler(int sig, siginfo_t* info, void* context)
+{
+    fault_addr = info->si_addr;
+    fault_reported = mempool_allocator_report_address(fault_allocator,
+        info->si_addr);
+    siglongjmp(fault_env, 1);
+}
+
+/*
+ * Return not 0 if access to the byte results in fault, which is
+ * recognized by the allocator.
+ */
+static int access_faults(mempool_allocator_t allocator, char* addr)
+{
+    volatile char* p = addr;
+    fault_allocator = allocator;
+    fault_addr = NULL;
+    fault_reported = 0;
+    if(sigsetjmp(fault_env, 1))
+        return (fault_addr == addr) && fault_reported;
+    *p = *p + 1;
+    return 0;
+}
+
+static char* page_end(void* addr)
+{
+    return (char*)(((uintptr_t)addr + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+}
+
+/////////////////////////// Checks ///////////////////////////////////
+
+static void check_blocks(void)
+{
+    static const size_t sizes[] = {
+        1, 2, 3, 7, 8, 15, 16, 17, 100, PAGE_SIZE - 1, PAGE_SIZE,
+        PAGE_SIZE + 1, 10000
+    };
+    void* blocks[ARRAY_SIZE(sizes)];
+    mempool_allocator_t allocator = create(CHUNK_SIZE, 0);
+    size_t i, j;
+
+    for(i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        size_t size = sizes[i];
+        char* p = mempool_allocator_alloc(allocator, size, GFP_KERNEL);
+        blocks[i] = p;
+        check(p != NULL, "cannot allocate %zu bytes", size);
+        if(p == NULL) continue;
+
+        // Block ends near the page boundary, respecting alignment
+        check((size_t)(page_end(p + size) - (p + size)) < 16,
+            "block of %zu bytes at %p is not at the end of the page", size, p);
+        check(((uintptr_t)p & (size >= 16 ? 15 : 0)) == 0,
+            "block of %zu bytes at %p is not aligned", size, p);
+        check(mempool_allocator_size(allocator, p) == size,
+            "size of the block is %zu instead of %zu",
+            mempool_allocator_size(allocator, p), size);
+        for(j = 0; j < size; j++)
+        {
+            if(p[j] != 0x5a) break;
+        }
+        check(j == size, "block of %zu bytes is not filled with pattern", size);
+
+        memset(p, 0, size);
+        check(access_faults(allocator, page_end(p + size)),
+            "access after the end of block of %zu bytes is not detected", size);
+    }
+
+    for(i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        if(blocks[i] == NULL) continue;
+        check(mempool_allocator_free(allocator, blocks[i]) == 0,
+            "block is not freed");
+        check(access_faults(allocator, blocks[i]),
+            "access after free is not detected");
+        check(mempool_allocator_size(allocator, blocks[i]) == 0,
+            "freed block has non-zero size");
+    }
+
+    for(i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        char* p = mempool_allocator_alloc(allocator, sizes[i],
+            GFP_KERNEL | __GFP_ZERO);
+        check(p != NULL, "cannot allocate %zu bytes", sizes[i]);
+        if(p == NULL) continue;
+        for(j = 0; j < sizes[i]; j++)
+        {
+            if(p[j] != 0) break;
+        }
+        check(j == sizes[i], "block of %zu bytes is not zeroed", sizes[i]);
+        mempool_allocator_free(allocator, p);
+    }
+
+    check(mempool_allocator_alloc(allocator, 0, GFP_KERNEL) == NULL,
+        "block of 0 bytes is allocated");
+    check(mempool_allocator_alloc(allocator, CHUNK_SIZE, GFP_KERNEL) == NULL,
+        "block larger than a chunk is allocated");
+
+    mempool_allocator_destroy(allocator);
+}
+
+static void check_invalid_free(void)
+{
+    mempool_allocator_t allocator = create(CHUNK_SIZE, PAGE_SIZE * 16);
+    char* p = mempool_allocator_alloc(allocator, 100, GFP_KERNEL);
+    char* other = malloc(100);
+
+    check(mempool_allocator_free(allocator, other) != 0,
+        "foreign block is accepted");
+    check(mempool_allocator_report_address(allocator, other) == 0,
+        "foreign address is described");
+    free(other);
+
+    check(mempool_allocator_free(allocator, p + 1) == 0,
+        "pointer inside the block is not reported");
+    check(mempool_allocator_size(allocator, p) == 100,
+        "block is freed via pointer inside it");
+    check(mempool_allocator_free(allocator, p) == 0, "block is not freed");
+    check(mempool_allocator_free(allocator, p) == 0,
+        "double free is not reported");
+    check(mempool_allocator_free(allocator, page_end(p) + PAGE_SIZE) == 0,
+        "free of unallocated memory is not reported");
+
+    mempool_allocator_destroy(allocator);
+}
+
+static void check_quarantine(void)
+{
+    // Quarantine for 4 one-page blocks
+    mempool_allocator_t allocator = create(CHUNK_SIZE, 4 * PAGE_SIZE);
+    char* addrs[12];
+    size_t i, j;
+
+    for(i = 0; i < ARRAY_SIZE(addrs); i++)
+    {
+        addrs[i] = mempool_allocator_alloc(allocator, 64, GFP_KERNEL);
+        check(addrs[i] != NULL, "cannot allocate block");
+        mempool_allocator_free(allocator, addrs[i]);
+        check(access_faults(allocator, addrs[i]),
+            "access to the block in the quarantine is not detected");
+    }
+    // Block is reused only after 4 blocks freed after it
+    for(i = 0; i < ARRAY_SIZE(addrs); i++)
+    {
+        for(j = (i >= 4 ? i - 4 : 0); j < i; j++)
+            check(addrs[i] != addrs[j], "block %zu reuses block %zu", i, j);
+        if(i >= 5)
+            check(addrs[i] == addrs[i - 5],
+                "block %zu doesn't reuse the oldest evicted block", i);
+    }
+    mempool_allocator_destroy(allocator);
+
+    // Without quarantine memory is reused immediately
+    allocator = create(CHUNK_SIZE, 0);
+    addrs[0] = mempool_allocator_alloc(allocator, 64, GFP_KERNEL);
+    mempool_allocator_free(allocator, addrs[0]);
+    addrs[1] = mempool_allocator_alloc(allocator, 64, GFP_KERNEL);
+    check(addrs[0] == addrs[1], "memory is not reused without quarantine");
+    mempool_allocator_free(allocator, addrs[1]);
+    mempool_allocator_destroy(allocator);
+}
+
+static void check_flush(void)
+{
+    mempool_allocator_t allocator = create(CHUNK_SIZE, 64 * PAGE_SIZE);
+    void* addrs[100];
+    void* large;
+    unsigned long flushes;
+    unsigned long page_flushes;
+    size_t i;
+
+    for(i = 0; i < ARRAY_SIZE(addrs); i++)
+        addrs[i] = mempool_allocator_alloc(allocator, 10, GFP_KERNEL);
+    large = mempool_allocator_alloc(allocator, 3 * PAGE_SIZE, GFP_KERNEL);
+    user_run_works();
+    flushes = user_tlb_flushes;
+    page_flushes = user_tlb_page_flushes;
+    for(i = 0; i < ARRAY_SIZE(addrs); i++)
+        mempool_allocator_free(allocator, addrs[i]);
+    mempool_allocator_free(allocator, large);
+    check(user_tlb_flushes == flushes, "TLB is flushed in free");
+    // Freed pages are flushed on the current CPU at once
+    check(user_tlb_page_flushes == page_flushes + ARRAY_SIZE(addrs) + 3,
+        "%lu pages are flushed locally in free instead of %zu",
+        user_tlb_page_flushes - page_flushes, ARRAY_SIZE(addrs) + 3);
+    user_run_works();
+    check(user_tlb_flushes == flushes + 1,
+        "%lu TLB flushes for a batch of frees instead of 1",
+        user_tlb_flushes - flushes);
+
+    mempool_allocator_destroy(allocator);
+}
+
+// Allocate 1-byte blocks (2 pages each) until failure.
+static size_t alloc_all(mempool_allocator_t allocator, gfp_t flags,
+    void** addrs, size_t max)
+{
+    size_t n = 0;
+    while(n < max)
+    {
+        addrs[n] = mempool_allocator_alloc(allocator, 1, flags);
+        if(addrs[n] == NULL) break;
+        n++;
+    }
+    return n;
+}
+
+static void check_growth(void)
+{
+    static void* addrs[3 * CHUNK_PAGES];
+    mempool_allocator_t allocator = create(3 * CHUNK_SIZE, 0);
+    size_t n, i;
+    char* p;
+
+    n = alloc_all(allocator, GFP_ATOMIC, addrs, ARRAY_SIZE(addrs));
+    check(n == CHUNK_PAGES / 2, "%zu blocks in the first chunk", n);
+    // New chunk is allocated from the workqueue
+    user_run_works();
+    i = alloc_all(allocator, GFP_ATOMIC, addrs + n, ARRAY_SIZE(addrs) - n);
+    check(i == CHUNK_PAGES / 2, "%zu blocks in the second chunk", i);
+    n += i;
+    // And at once, when sleeping is allowed
+    i = alloc_all(allocator, GFP_KERNEL, addrs + n, ARRAY_SIZE(addrs) - n);
+    check(i == CHUNK_PAGES / 2, "%zu blocks in the third chunk", i);
+    n += i;
+    user_run_works();
+    check(mempool_allocator_alloc(allocator, 1, GFP_ATOMIC) == NULL,
+        "max_size is exceeded");
+
+    for(i = 0; i < n; i++)
+        mempool_allocator_free(allocator, addrs[i]);
+    // Free spans are merged back into the whole chunks
+    for(i = 0; i < 3; i++)
+    {
+        addrs[i] = mempool_allocator_alloc(allocator,
+            CHUNK_SIZE - PAGE_SIZE, GFP_KERNEL);
+        check(addrs[i] != NULL, "cannot allocate block of the chunk size");
+    }
+    p = addrs[0];
+    if(p != NULL)
+    {
+        p[0] = 1;
+        p[CHUNK_SIZE - PAGE_SIZE - 1] = 1;
+    }
+    // Block is not freed and should be reported
+    for(i = 1; i < 3; i++)
+        mempool_allocator_free(allocator, addrs[i]);
+    mempool_allocator_destroy(allocator);
+}
+
+static void check_pressure(void)
+{
+    static void* addrs[CHUNK_PAGES];
+    // Quarantine is larger than the pool
+    mempool_allocator_t allocator = create(CHUNK_SIZE, 2 * CHUNK_SIZE);
+    size_t n, i;
+
+    n = alloc_all(allocator, GFP_KERNEL, addrs, ARRAY_SIZE(addrs));
+    for(i = 0; i < n; i++)
+        mempool_allocator_free(allocator, addrs[i]);
+    i = alloc_all(allocator, GFP_KERNEL, addrs, ARRAY_SIZE(addrs));
+    check(i == n, "%zu blocks instead of %zu are allocated when the pool"
+        " cannot grow", i, n);
+    while(i > 0)
+        mempool_allocator_free(allocator, addrs[--i]);
+
+    mempool_allocator_destroy(allocator);
+}
+
+/////////////////////////// Benchmark ////////////////////////////////
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void benchmark(long n_ops)
+{
+    static const size_t n_lives[] = { 16, 1024, 16384 };
+    size_t i;
+
+    for(i = 0; i < ARRAY_SIZE(n_lives); i++)
+    {
+        size_t n_live = n_lives[i];
+        void** live = malloc(n_live * sizeof(*live));
+        mempool_allocator_t allocator = create(
+            (n_live + 64) * 2 * PAGE_SIZE + 2 * CHUNK_SIZE, 64 * PAGE_SIZE);
+        double start, time_alloc, time_size;
+        size_t j;
+        long k, found = 0;
+
+        for(j = 0; j < n_live; j++)
+            live[j] = mempool_allocator_alloc(allocator, 1 + rnd_next() % 512,
+                GFP_KERNEL);
+
+        // Replace random live block with a new one
+        start = now();
+        for(k = 0; k < n_ops; k++)
+        {
+            j = rnd_next() % n_live;
+            mempool_allocator_free(allocator, live[j]);
+            live[j] = mempool_allocator_alloc(allocator, 1 + rnd_next() % 512,
+                GFP_KERNEL);
+            if((k & 1023) == 0) user_run_works();
+        }
+        time_alloc = now() - start;
+
+        start = now();
+        for(k = 0; k < n_ops; k++)
+            found += mempool_allocator_size(allocator, live[k % n_live]) != 0;
+        time_size = now() - start;
+
+        check(found == n_ops, "%ld blocks of %ld are found", found, n_ops);
+
+        printf("%6zu live blocks: %10.0f alloc/free pairs/s, %10.0f lookups/s\n",
+            n_live, time_alloc > 0 ? n_ops / time_alloc : 0.0,
+            time_size > 0 ? n_ops / time_size : 0.0);
+
+        for(j = 0; j < n_live; j++)
+            mempool_allocator_free(allocator, live[j]);
+        mempool_allocator_destroy(allocator);
+        free(live);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    long n_ops = 1000000;
+    int opt;
+    struct sigaction sa;
+
+    while((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            n_ops = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n operations]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = segv_handler;
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &sa, NULL);
+
+    fprintf(stderr, "Errors below are expected:\n");
+    check_blocks();
+    check_invalid_free();
+    check_quarantine();
+    check_flush();
+    check_growth();
+    check_pressure();
+    if(errors)
+    {
+        printf("%d checks failed.\n", errors);
+        return 1;
+    }
+    printf("All checks passed.\n");
+
+    benchmark(n_ops);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * User-space implementation of the workqueue and of the page table
+ * for the model of the memory pool.
+ */
+
+#include <linux/kernel.h>
+#include <linux/workqueue.h>
+
+#include <asm/pgtable.h>
+#include <asm/tlbflush.h>
+
+#include <sys/mman.h>
+
+unsigned long user_tlb_flushes = 0;
+unsigned long user_tlb_page_flushes = 0;
+
+/////////////////////////// Workqueue ////////////////////////////////
+
+static struct work_struct* user_works = NULL;
+
+int schedule_work(struct work_struct* work)
+{
+    if(work->pending) return 0;
+    work->pending = 1;
+    work->next = user_works;
+    user_works = work;
+    return 1;
+}
+
+int cancel_work_sync(struct work_struct* work)
+{
+    struct work_struct** pwork;
+    if(!work->pending) return 0;
+    for(pwork = &user_works; *pwork != work; pwork = &(*pwork)->next);
+    *pwork = work->next;
+    work->pending = 0;
+    return 1;
+}
+
+int user_run_works(void)
+{
+    int n = 0;
+    while(user_works != NULL)
+    {
+        struct work_struct* work = user_works;
+        user_works = work->next;
+        work->pending = 0;
+        work->func(work);
+        n++;
+    }
+    return n;
+}
+
+/////////////////////////// Page table ///////////////////////////////
+
+#define PTE_HASH_SIZE 4096
+
+struct user_pte
+{
+    pte_t pte;
+    struct user_pte* next;
+};
+
+static struct user_pte* pte_hash[PTE_HASH_SIZE];
+
+pte_t* lookup_address(unsigned long address, unsigned int* level)
+{
+    unsigned long page = address & ~(PAGE_SIZE - 1);
+    struct user_pte** head = &pte_hash[(page >> PAGE_SHIFT) % PTE_HASH_SIZE];
+    struct user_pte* entry;
+
+    *level = PG_LEVEL_4K;
+    for(entry = *head; entry != NULL; entry = entry->next)
+    {
+        if(entry->pte.page == (void*)page) return &entry->pte;
+    }
+    entry = malloc(sizeof(*entry));
+    BUG_ON(entry == NULL);
+    // Memory from vmalloc() is global and writable
+    entry->pte.pte = _PAGE_PRESENT | _PAGE_RW | _PAGE_GLOBAL;
+    entry->pte.page = (void*)page;
+    entry->next = *head;
+    *head = entry;
+    return &entry->pte;
+}
+
+void set_pte(pte_t* ptep, pte_t pte)
+{
+    int prot = (pte.pte & _PAGE_PRESENT) ? PROT_READ | PROT_WRITE : PROT_NONE;
+    BUG_ON(pte.page != ptep->page);
+    // Kernel treats non-present global page as PROT_NONE one
+    BUG_ON(!(pte.pte & _PAGE_PRESENT) && (pte.pte & _PAGE_GLOBAL));
+    if(mprotect(pte.page, PAGE_SIZE, prot))
+    {
+        perror("mprotect");
+        abort();
+    }
+    ptep->pte = pte.pte;
+}
@@ -124,6 +124,30 @@ Mist::ParamSet& Mist::ParamSet::operator=(
     return *this;
 }
 
+bool Mist::ParamSet::operator==(const ParamSet& paramSet) const
+{
+    if(value != paramSet.value) return false;
+    if(subsets.size() != paramSet.subsets.size()) return false;
+    
+    map<string, vector<ParamSet*> >::const_iterator iter = subsets.begin(),
+        iter_end = subsets.end(),
+        iterOther = paramSet.subsets.begin();
+    for(;iter != iter_end; ++iter, ++iterOther)
+    {
+        if(iter->first != iterOther->first) return false;
+        
+        const vector<ParamSet*>& sets = iter->second;
+        const vector<ParamSet*>& setsOther = iterOther->second;
+        if(sets.size() != setsOther.size()) return false;
+        
+        int setsSize = (int)sets.size();
+        for(int i = 0; i < setsSize; i++)
+            if(*sets[i] != *setsOther[i]) return false;
+    }
+    
+    return true;
+}
+
 /******************* Parameters mask implementation *******************/
 class MistParamMask::Impl
 {
@@ -403,14 +403,6 @@ MistTemplateGroupBlock* MistTemplateRJoin::createGroup(
 }
 
 /************************** Index of iteration ************************/
-class MistIndexGroup0: public MistIndexGroup
-{
-public:
-    MistIndexGroup0(int depth ): MistIndexGroup(depth) {}
-    
-    ostream& printFormatted(int index, ostream& os) const {return os << index;}
-};
-
 MistTemplateGroupBlock* MistTemplateIndex0::createGroup(
     Mist::Template::Impl::Context& templateContext) const
 {
@@ -420,15 +412,6 @@ MistTemplateGroupBlock* MistTemplateIndex0::createGroup(
     return new MistIndexGroup0(depth);
 }
 
-class MistIndexGroup1: public MistIndexGroup
-{
-public:
-    MistIndexGroup1(int depth ): MistIndexGroup(depth) {}
-    
-    ostream& printFormatted(int index, ostream& os) const {return os << (index + 1);}
-};
-
-
 MistTemplateGroupBlock* MistTemplateIndex1::createGroup(
     Mist::Template::Impl::Context& templateContext) const
 {
@@ -14,6 +14,7 @@
 
 #include <vector>
 #include <list>
+#include <map>
 
 #include "mist_param_set_slice.hh"
 
@@ -49,6 +50,16 @@ public:
      * and check emptiness of resulted string.
      */
     virtual bool isEmpty(Context& groupContext) const;
+
+    /* Writer of the compiled template group. */
+    class Writer;
+    /* 
+     * Write block into compiled template group.
+     * 
+     * Implementation should write all subblocks first (via
+     * Writer::writeBlock()), and only then write block itself.
+     */
+    virtual void write(Writer& writer) const = 0;
 protected:
     /* Destructor shouldn't be used directly, use unref() instead */
     virtual ~MistTemplateGroupBlock() {}
@@ -135,6 +146,52 @@ private:
     std::list<JoinContext> joinContextStack;
 };
 
+/* 
+ * Writer of the compiled template group.
+ * 
+ * Every block is written only once, even if it is referenced from
+ * several places in the group. Such references are written as indices
+ * of already written blocks.
+ */
+class MistTemplateGroupBlock::Writer
+{
+public:
+    /* Types of blocks in the compiled template group */
+    enum BlockType
+    {
+        blockEmpty = 1,
+        blockSequence,
+        blockText,
+        blockParamRef,
+        blockIf,
+        blockJoin,
+        blockRJoin,
+        blockIndex0,
+        blockIndex1,
+        blockIndent
+    };
+
+    Writer(std::ostream& os);
+
+    /*
+     * Write block (if it is not written yet) and return its index.
+     */
+    int writeBlock(const MistTemplateGroupBlock& block);
+
+    /* Start writing of the block of given type. */
+    void beginBlock(BlockType type);
+    /* Write components of the block. */
+    void writeInt(int value);
+    void writeString(const std::string& str);
+    void writeParamName(const MistParamNameAbs& name);
+private:
+    std::ostream& os;
+    /* Indices of already written blocks. */
+    std::map<const MistTemplateGroupBlock*, int> blockIndices;
+    /* Index which will be assigned to the next block written. */
+    int nextIndex;
+};
+
 /* Implementation for the template group class. */
 class Mist::TemplateGroup::Impl
 {
@@ -158,6 +215,8 @@ class MistEmptyGroup: public MistTemplateGroupBlock
     {return true;}
 
     MistParamMask getParamMask() const {return MistParamMask();}
+
+    void write(Writer& writer) const;
 };
 
 /********************** Sequence **************************************/
@@ -173,6 +232,8 @@ public:
     bool isEmpty(Context& groupContext) const;
 
     MistParamMask getParamMask() const;
+
+    void write(Writer& writer) const;
 };
 
 /******************* Text *********************************************/
@@ -190,6 +251,8 @@ public:
     {return text.empty();}
 
     MistParamMask getParamMask() const {return MistParamMask();}
+
+    void write(Writer& writer) const;
 };
 
 /********************** Reference to parameter ************************/
@@ -217,6 +280,8 @@ public:
     }
 
     MistParamMask getParamMask() const {return MistParamMask(name);}
+
+    void write(Writer& writer) const;
 };
 
 /******************** "If" sentence ***********************************/
@@ -239,6 +304,8 @@ public:
     bool isEmpty(Context& groupContext) const;
 
     MistParamMask getParamMask() const;
+
+    void write(Writer& writer) const;
 };
 
 /********************* "Join" sentence ********************************/
@@ -260,6 +327,8 @@ public:
     bool isEmpty(Context& groupContext) const;
 
     MistParamMask getParamMask() const;
+
+    void write(Writer& writer) const;
 };
 
 /* Reverse join is very similar to normal join. */
@@ -272,11 +341,14 @@ public:
         MistJoinGroup(block, context, textBetween) {}
     /* The only method differs from one in join. */
     std::ostream& evaluate(Context& groupContext, std::ostream& os) const;
+
+    void write(Writer& writer) const;
 };
 
 /************************ Index of join iteration *********************/
 class MistIndexGroup: public MistTemplateGroupBlock
 {
+protected:
     int depth;
 public:
     MistIndexGroup(int depth) : depth(depth) {}
@@ -291,6 +363,30 @@ public:
     MistParamMask getParamMask() const {return MistParamMask();}
 };
 
+/* Index of iteration, counted from 0. */
+class MistIndexGroup0: public MistIndexGroup
+{
+public:
+    MistIndexGroup0(int depth ): MistIndexGroup(depth) {}
+    
+    std::ostream& printFormatted(int index, std::ostream& os) const
+    {return os << index;}
+
+    void write(Writer& writer) const;
+};
+
+/* Index of iteration, counted from 1. */
+class MistIndexGroup1: public MistIndexGroup
+{
+public:
+    MistIndexGroup1(int depth ): MistIndexGroup(depth) {}
+    
+    std::ostream& printFormatted(int index, std::ostream& os) const
+    {return os << (index + 1);}
+
+    void write(Writer& writer) const;
+};
+
 /********************* Indent functionality ***************************/
 class MistIndentGroup: public MistTemplateGroupBlock
 {
@@ -306,6 +402,8 @@ public:
     bool isEmpty(Context& groupContext) const;
 
     MistParamMask getParamMask() const;
+
+    void write(Writer& writer) const;
 };
 
 #endif /* MIST_TEMPLATE_GROUP_HH */
\ No newline at end of file
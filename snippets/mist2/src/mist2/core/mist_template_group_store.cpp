@@ -0,0 +1,368 @@
+/*
+ * Compiled form of the template group.
+ *
+ * Template group is stored as a sequence of its blocks, in order
+ * "subblocks first". Every block is stored once, references to it are
+ * stored as index of the block in the sequence.
+ *
+ * Such form may be loaded without parsing templates and without
+ * building group from them.
+ */
+
+#include <mist2/mist.hh>
+
+#include <iostream>
+#include <stdexcept>
+#include <cassert>
+#include <algorithm>
+
+#include "mist_template_group.hh"
+#include "mist_template_name.hh"
+
+using namespace std;
+using namespace Mist;
+
+/* Signature of the compiled template group. */
+static const char groupMagic[8] = {'M', 'I', 'S', 'T', '2', 'T', 'G', '\n'};
+/*
+ * Version of the compiled form.
+ *
+ * Should be incremented every time when format is changed.
+ */
+static const int groupFormatVersion = 1;
+/* Type which marks the end of blocks sequence. */
+static const int blockEnd = 0;
+
+/*********************** Writer ***************************************/
+MistTemplateGroupBlock::Writer::Writer(ostream& os): os(os), nextIndex(0)
+{
+}
+
+int MistTemplateGroupBlock::Writer::writeBlock(
+    const MistTemplateGroupBlock& block)
+{
+    map<const MistTemplateGroupBlock*, int>::const_iterator iter =
+        blockIndices.find(&block);
+    if(iter != blockIndices.end()) return iter->second;
+
+    block.write(*this);
+
+    int index = nextIndex++;
+    blockIndices.insert(make_pair(&block, index));
+
+    return index;
+}
+
+void MistTemplateGroupBlock::Writer::beginBlock(BlockType type)
+{
+    writeInt(type);
+}
+
+void MistTemplateGroupBlock::Writer::writeInt(int value)
+{
+    unsigned int v = (unsigned int)value;
+    char bytes[4];
+
+    /* Little-endian independently from the host */
+    for(int i = 0; i < 4; i++, v >>= 8) bytes[i] = (char)(v & 0xff);
+
+    os.write(bytes, 4);
+}
+
+void MistTemplateGroupBlock::Writer::writeString(const string& str)
+{
+    writeInt((int)str.size());
+    os.write(str.data(), str.size());
+}
+
+void MistTemplateGroupBlock::Writer::writeParamName(
+    const MistParamNameAbs& name)
+{
+    writeInt((int)name.components.size());
+    for(int i = 0; i < (int)name.components.size(); i++)
+        writeString(name.components[i]);
+}
+
+/******************* Writing concrete blocks **************************/
+void MistEmptyGroup::write(Writer& writer) const
+{
+    writer.beginBlock(Writer::blockEmpty);
+}
+
+void MistTemplateSequenceGroup::write(Writer& writer) const
+{
+    vector<int> indices;
+    for(int i = 0; i < (int)subtemplates.size(); i++)
+        indices.push_back(writer.writeBlock(*subtemplates[i]));
+
+    writer.beginBlock(Writer::blockSequence);
+    writer.writeInt((int)indices.size());
+    for(int i = 0; i < (int)indices.size(); i++)
+        writer.writeInt(indices[i]);
+}
+
+void MistTextGroup::write(Writer& writer) const
+{
+    writer.beginBlock(Writer::blockText);
+    writer.writeString(text);
+}
+
+void MistTemplateParamRefGroup::write(Writer& writer) const
+{
+    writer.beginBlock(Writer::blockParamRef);
+    writer.writeParamName(name);
+}
+
+void MistIfGroup::write(Writer& writer) const
+{
+    int conditionIndex = writer.writeBlock(*conditionBlock);
+    int ifIndex = writer.writeBlock(*ifBlock);
+    int elseIndex = writer.writeBlock(*elseBlock);
+
+    writer.beginBlock(Writer::blockIf);
+    writer.writeInt(conditionIndex);
+    writer.writeInt(ifIndex);
+    writer.writeInt(elseIndex);
+}
+
+void MistJoinGroup::write(Writer& writer) const
+{
+    int index = writer.writeBlock(*block);
+
+    writer.beginBlock(Writer::blockJoin);
+    writer.writeInt(index);
+    writer.writeParamName(context);
+    writer.writeString(textBetween);
+}
+
+void MistRJoinGroup::write(Writer& writer) const
+{
+    int index = writer.writeBlock(*block);
+
+    writer.beginBlock(Writer::blockRJoin);
+    writer.writeInt(index);
+    writer.writeParamName(context);
+    writer.writeString(textBetween);
+}
+
+void MistIndexGroup0::write(Writer& writer) const
+{
+    writer.beginBlock(Writer::blockIndex0);
+    writer.writeInt(depth);
+}
+
+void MistIndexGroup1::write(Writer& writer) const
+{
+    writer.beginBlock(Writer::blockIndex1);
+    writer.writeInt(depth);
+}
+
+void MistIndentGroup::write(Writer& writer) const
+{
+    int index = writer.writeBlock(*block);
+
+    writer.beginBlock(Writer::blockIndent);
+    writer.writeInt(index);
+    writer.writeString(indent);
+}
+
+/*********************** Reader ***************************************/
+/* Error about reading compiled template group. */
+#define read_error(what) \
+cerr << what << endl; \
+throw runtime_error("Incorrect compiled template group")
+
+/*
+ * Reader of the compiled template group.
+ *
+ * Create blocks in the same order as they were written.
+ */
+class MistTemplateGroupReader
+{
+public:
+    MistTemplateGroupReader(istream& is): is(is) {}
+
+    /* Read whole group and return its main block. */
+    MistTemplateGroupBlock* read(void);
+private:
+    istream& is;
+    /* Blocks already read. */
+    vector<MistTemplateGroupBlockRef> blocks;
+
+    int readInt(void);
+    string readString(void);
+    MistParamNameAbs readParamName(void);
+    /* Read index of the block and return new reference to it. */
+    MistTemplateGroupBlock* readBlockRef(void);
+
+    /* Read block of given type. */
+    MistTemplateGroupBlock* readBlock(int type);
+};
+
+int MistTemplateGroupReader::readInt(void)
+{
+    unsigned char bytes[4];
+
+    if(!is.read((char*)bytes, 4))
+    {
+        read_error("Unexpected end of compiled template group.");
+    }
+
+    unsigned int v = 0;
+    for(int i = 3; i >= 0; i--) v = (v << 8) | bytes[i];
+
+    return (int)v;
+}
+
+string MistTemplateGroupReader::readString(void)
+{
+    int size = readInt();
+    if(size < 0)
+    {
+        read_error("Negative string length in compiled template group.");
+    }
+
+    string str(size, '\0');
+    if(size && !is.read(&str[0], size))
+    {
+        read_error("Unexpected end of compiled template group.");
+    }
+
+    return str;
+}
+
+MistParamNameAbs MistTemplateGroupReader::readParamName(void)
+{
+    int size = readInt();
+    if(size < 0)
+    {
+        read_error("Negative name length in compiled template group.");
+    }
+
+    MistParamNameAbs name;
+    for(int i = 0; i < size; i++)
+        name.components.push_back(readString());
+
+    return name;
+}
+
+MistTemplateGroupBlock* MistTemplateGroupReader::readBlockRef(void)
+{
+    int index = readInt();
+    if((index < 0) || (index >= (int)blocks.size()))
+    {
+        read_error("Reference to unknown block in compiled template group.");
+    }
+
+    return blocks[index]->ref();
+}
+
+MistTemplateGroupBlock* MistTemplateGroupReader::readBlock(int type)
+{
+    typedef MistTemplateGroupBlock::Writer Writer;
+
+    switch(type)
+    {
+    case Writer::blockEmpty:
+        return new MistEmptyGroup();
+    case Writer::blockSequence:
+    {
+        int size = readInt();
+        MistTemplateSequenceGroup* sequenceGroup =
+            new MistTemplateSequenceGroup();
+        MistTemplateGroupBlockRef sequenceRef(sequenceGroup);
+
+        for(int i = 0; i < size; i++)
+            sequenceGroup->addTemplate(readBlockRef());
+
+        return sequenceGroup->ref();
+    }
+    case Writer::blockText:
+        return new MistTextGroup(readString());
+    case Writer::blockParamRef:
+        return new MistTemplateParamRefGroup(readParamName());
+    case Writer::blockIf:
+    {
+        MistTemplateGroupBlockRef conditionRef(readBlockRef());
+        MistTemplateGroupBlockRef ifRef(readBlockRef());
+        MistTemplateGroupBlockRef elseRef(readBlockRef());
+
+        return new MistIfGroup(conditionRef->ref(), ifRef->ref(),
+            elseRef->ref());
+    }
+    case Writer::blockJoin:
+    case Writer::blockRJoin:
+    {
+        MistTemplateGroupBlockRef blockRef(readBlockRef());
+        MistParamNameAbs context = readParamName();
+        string textBetween = readString();
+
+        MistTemplateGroupBlock* block = blockRef->ref();
+        if(type == Writer::blockJoin)
+            return new MistJoinGroup(block, context, textBetween);
+        else
+            return new MistRJoinGroup(block, context, textBetween);
+    }
+    case Writer::blockIndex0:
+        return new MistIndexGroup0(readInt());
+    case Writer::blockIndex1:
+        return new MistIndexGroup1(readInt());
+    case Writer::blockIndent:
+    {
+        MistTemplateGroupBlockRef blockRef(readBlockRef());
+        string indent = readString();
+
+        return new MistIndentGroup(blockRef->ref(), indent);
+    }
+    default:
+        read_error("Unknown block type " << type
+            << " in compiled template group.");
+    }
+}
+
+MistTemplateGroupBlock* MistTemplateGroupReader::read(void)
+{
+    char magic[sizeof(groupMagic)];
+    if(!is.read(magic, sizeof(magic))
+        || !equal(magic, magic + sizeof(magic), groupMagic))
+    {
+        read_error("Stream doesn't contain compiled template group.");
+    }
+
+    int version = readInt();
+    if(version != groupFormatVersion)
+    {
+        read_error("Unsupported version of compiled template group: "
+            << version << ".");
+    }
+
+    for(int type = readInt(); type != blockEnd; type = readInt())
+    {
+        blocks.push_back(MistTemplateGroupBlockRef(readBlock(type)));
+    }
+
+    return readBlockRef();
+}
+
+/****************** Template group methods ****************************/
+Mist::TemplateGroup::TemplateGroup(istream& is): impl(NULL)
+{
+    MistTemplateGroupReader reader(is);
+
+    MistTemplateGroupBlock* block = reader.read();
+
+    impl = new Impl(block);
+}
+
+void Mist::TemplateGroup::save(ostream& os) const
+{
+    MistTemplateGroupBlock::Writer writer(os);
+
+    os.write(groupMagic, sizeof(groupMagic));
+    writer.writeInt(groupFormatVersion);
+
+    int index = writer.writeBlock(*impl->templateGroupBlockRef);
+
+    writer.writeInt(blockEnd);
+    writer.writeInt(index);
+}
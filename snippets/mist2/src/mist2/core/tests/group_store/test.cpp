@@ -0,0 +1,88 @@
+/* Check that template group may be saved and loaded back. */
+
+#include <mist2/mist.hh>
+
+#include "mist_test_common.hh"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <cassert>
+using namespace std;
+
+class TestTemplateCollection: public Mist::TemplateCollection
+{
+public:
+    Mist::Template* findTemplate(const string& name)
+    {
+        if(name == "main")
+        {
+            istringstream ss("<$if enabled$><$subtemplate: join \"\\n\"$><$else$>none<$endif$>"
+                "|<$param.param1: rjoin \",\"$>");
+            return new Mist::Template(ss, "");
+        }
+        if(name == "subtemplate")
+        {
+            istringstream ss("<$param: i$>:\n<$param.param1: indent \"  \"$>");
+            return new Mist::Template(ss, "");
+        }
+
+        else return NULL;
+    }
+};
+
+int main(void)
+{
+    Mist::ParamSet paramSet;
+    paramSet.addParameter("enabled", "1");
+    
+    Mist::ParamSet* subset = paramSet.addSubset("param");
+    subset->addParameter("param1", "value11");
+    
+    subset = paramSet.addSubset("param");
+    subset->addParameter("param1", "value21\nvalue22");
+
+    TestTemplateCollection templateCollection;
+    
+    Mist::TemplateGroup templateGroup(templateCollection, "main");
+    
+    stringstream compiled;
+    templateGroup.save(compiled);
+    
+    Mist::TemplateGroup templateGroupLoaded(compiled);
+    
+    string expected = templateGroup.instantiate(paramSet);
+    string result = templateGroupLoaded.instantiate(paramSet);
+    
+    assert_instantiation(expected,
+        "1:\n  value11\n2:\n  value21\n  value22|value21\nvalue22,value11");
+    assert_instantiation(result, expected);
+    
+    /* Check 'else' branch too. */
+    Mist::ParamSet paramSetEmpty;
+    result = templateGroupLoaded.instantiate(paramSetEmpty);
+    assert_instantiation(result, templateGroup.instantiate(paramSetEmpty));
+    
+    /* Loaded group may be saved again with the same result. */
+    stringstream compiledAgain;
+    templateGroupLoaded.save(compiledAgain);
+    assert_instantiation(compiledAgain.str(), compiled.str());
+    
+    /* Truncated compiled group should be rejected. */
+    string truncated = compiled.str();
+    truncated.resize(truncated.size() - 1);
+    istringstream truncatedStream(truncated);
+    
+    bool rejected = false;
+    try
+    {
+        Mist::TemplateGroup templateGroupBad(truncatedStream);
+    }
+    catch(runtime_error&)
+    {
+        rejected = true;
+    }
+    assert(rejected);
+    
+    return 0;
+}
@@ -88,6 +88,16 @@ namespace Mist
 
         ParamSet(const ParamSet& paramSet);
         ParamSet& operator=(const ParamSet& paramSet);
+        
+        /* 
+         * Compare parameters sets.
+         * 
+         * Sets are equal if they have equal values and equal sequences
+         * of subsets for every name (recursively).
+         */
+        bool operator==(const ParamSet& paramSet) const;
+        bool operator!=(const ParamSet& paramSet) const
+            {return !(*this == paramSet);}
     private:
         std::string value;
         std::map<std::string, std::vector<ParamSet*> > subsets;
@@ -161,8 +171,23 @@ namespace Mist
          */
         TemplateGroup(TemplateCollection& templatesCollection,
             const std::string& mainTemplateName);
+        /*
+         * Load template group from its compiled form, previously
+         * written by save().
+         * 
+         * No template is parsed in that case.
+         */
+        TemplateGroup(std::istream& is);
         ~TemplateGroup();
         
+        /* 
+         * Write compiled form of the template group into stream.
+         * 
+         * Result may be used for create the same group later without
+         * access to the templates.
+         */
+        void save(std::ostream& os) const;
+        
         /* 
          * Isntantiate templates group, using given parameters set,
          * into stream.
@@ -1,16 +1,24 @@
 #include <mist2/mist.hh>
 
-#include <yaml-cpp/yaml.h>
+#include "yaml_param_set.hh"
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio> /* rename, remove */
+
+#include <cstdlib> /* atoi */
+
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h> /* getpid, sysconf */
+#include <pthread.h>
 
 using namespace Mist;
 using namespace std;
-using namespace YAML;
 
-/* Add content of the document into parameters set. */
-static void addDocument(ParamSet* paramSet, const Node& doc);
 
 /* Collection of templates in given directory */
 class DirectoryTemplateCollection: public TemplateCollection
@@ -34,33 +42,111 @@ private:
     string ext;
 };
 
+/*
+ * Return template group for templates in given directory.
+ * 
+ * If 'cacheDir' is not NULL, compiled template group is searched in
+ * that directory first. If it is absent, group is built from the
+ * templates and its compiled form is stored into the cache directory.
+ * 
+ * Compiled group in the cache is identified by hash of the names and
+ * contents of all templates in the directory, so any change in
+ * templates causes the group to be rebuilt.
+ */
+static TemplateGroup* loadTemplateGroup(const string& templatesDir,
+    const char* cacheDir);
+
+/*
+ * Instantiate template group for every (data file, output file) pair
+ * listed in the manifest file.
+ * 
+ * Data files are loaded and instantiated concurrently using 'nJobs'
+ * threads. Output file is rewritten only when its content changes.
+ * 
+ * Return 0 on success and 1 if some pairs failed.
+ */
+static int processBatch(const TemplateGroup& templateGroup,
+    const string& manifest, int nJobs);
+
+static void usage(const char* program)
+{
+    cerr << "Usage: " << program
+        << " [--cache-dir <dir>] <templates-dir> <data-file>" << endl;
+    cerr << "       " << program
+        << " [--cache-dir <dir>] [--jobs <n>] --batch <templates-dir> <manifest-file>"
+        << endl;
+}
+
 int main(int argc, char** argv)
 {
-    if(argc < 3)
+    const char* cacheDir = NULL;
+    bool batch = false;
+    int nJobs = 0;
+    int argIndex = 1;
+    
+    for(; (argIndex < argc) && (string(argv[argIndex]).compare(0, 2, "--") == 0);
+        argIndex++)
+    {
+        string option(argv[argIndex]);
+        if(option == "--batch")
+        {
+            batch = true;
+        }
+        else if((option == "--cache-dir") && (argIndex + 1 < argc))
+        {
+            cacheDir = argv[++argIndex];
+        }
+        else if((option == "--jobs") && (argIndex + 1 < argc))
+        {
+            nJobs = atoi(argv[++argIndex]);
+            if(nJobs <= 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if(argc - argIndex != 2)
     {
-        cerr << "Usage: " << argv[0] << " <templates-dir> <data-file>" << endl;
+        usage(argv[0]);
         return 1;
     }
     
-    const char* templatesDir = argv[1];
-    const char* filename = argv[2];
+    const char* templatesDir = argv[argIndex];
+    const char* filename = argv[argIndex + 1];
     
-    vector<Node> documents = LoadAllFromFile(filename);
-
-    ParamSet paramSet;
-
-    for(vector<Node>::const_iterator iter = documents.begin();
-        iter != documents.end();
-        ++iter)
+    if(batch)
     {
-        addDocument(&paramSet, *iter);
+        if(nJobs == 0)
+        {
+            long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+            nJobs = nCpus > 0 ? (int)nCpus : 1;
+        }
+        
+        TemplateGroup* templateGroup = loadTemplateGroup(templatesDir, cacheDir);
+        
+        int result = processBatch(*templateGroup, filename, nJobs);
+        
+        delete templateGroup;
+        
+        return result;
     }
     
-    DirectoryTemplateCollection templateCollection(templatesDir, ".tpl");
+    ParamSet paramSet;
+    
+    loadParamSet(&paramSet, filename);
     
-    TemplateGroup templateGroup(templateCollection, "document");
+    TemplateGroup* templateGroup = loadTemplateGroup(templatesDir, cacheDir);
     
-    templateGroup.instantiate(cout, paramSet);
+    templateGroup->instantiate(cout, paramSet);
+    
+    delete templateGroup;
     
     return 0;
 }
@@ -86,102 +172,325 @@ Template* DirectoryTemplateCollection::findTemplate(const string& name)
     }
 }
 
-/*
- * Add node as value for subset with given name. */
-static void addMapValue(ParamSet* paramSet, const Node& value,
-    const string& name);
+/* Name of the main template. */
+static const char mainTemplateName[] = "document";
+/* Extension of the template files. */
+static const char templateExt[] = ".tpl";
 
 /* 
- * Add sequence of values to given parameter set, using given subset
- * name.
- */
-static void addSequence(ParamSet* paramSet, const Node& sequence,
-    const string& name);
-
-/*
- * Add map to the given parameter set.
+ * Hash of the templates in the directory (64-bit FNV-1a).
+ * 
+ * Return empty string if directory cannot be read.
  */
-static void addMap(ParamSet* paramSet, const Node& map);
-
-/* Error about converting YAML representation into parameters set. */
-#define convert_error(what) \
-cerr << what << endl; \
-throw runtime_error("Incorrect YAML data")
-
-void addDocument(ParamSet* paramSet, const Node& doc)
+static string templatesHash(const string& templatesDir)
 {
-    assert(doc.IsDefined());
+    DIR* dir = opendir(templatesDir.c_str());
+    if(dir == NULL) return "";
     
-    if(doc.IsNull())
-    {
-        convert_error("Null at the top of the document is forbidden.");
-    }
-    else if(doc.IsScalar())
+    /* Collect names first, so hash doesn't depend on directory order. */
+    vector<string> names;
+    const string ext(templateExt);
+    for(struct dirent* entry = readdir(dir); entry; entry = readdir(dir))
     {
-        convert_error("Scalar at the top of the document is forbidden.");
+        string name(entry->d_name);
+        if((name.size() > ext.size())
+            && (name.compare(name.size() - ext.size(), ext.size(), ext) == 0))
+        {
+            names.push_back(name);
+        }
     }
-    else if(doc.IsSequence())
+    closedir(dir);
+    
+    sort(names.begin(), names.end());
+    
+    unsigned long long hash = 14695981039346656037ULL;
+    
+    string data(mainTemplateName);
+    data += '\0';
+    for(int i = 0; i < (int)names.size(); i++)
     {
-        convert_error("Sequence at the top of the document is forbidden.");
+        string filename = templatesDir + '/' + names[i];
+        ifstream ifs(filename.c_str(), ios::in | ios::binary);
+        if(!ifs) return "";
+        
+        ostringstream content;
+        content << ifs.rdbuf();
+        
+        ostringstream header;
+        header << names[i] << '\0' << content.str().size() << '\0';
+        
+        data += header.str();
+        data += content.str();
     }
-    else if(doc.IsMap())
+    
+    for(string::const_iterator iter = data.begin(); iter != data.end(); ++iter)
     {
-        addMap(paramSet, doc);
+        hash ^= (unsigned char)*iter;
+        hash *= 1099511628211ULL;
     }
+    
+    ostringstream result;
+    result << hex;
+    result.width(16);
+    result.fill('0');
+    result << hash;
+    
+    return result.str();
 }
 
-void addMap(ParamSet* paramSet, const Node& map)
+TemplateGroup* loadTemplateGroup(const string& templatesDir,
+    const char* cacheDir)
 {
-    assert(map.IsMap());
+    string cacheFile;
+    if(cacheDir)
+    {
+        string hash = templatesHash(templatesDir);
+        if(!hash.empty())
+            cacheFile = string(cacheDir) + '/' + hash + ".mistg";
+    }
+    
+    if(!cacheFile.empty())
+    {
+        ifstream ifs(cacheFile.c_str(), ios::in | ios::binary);
+        if(ifs)
+        {
+            try
+            {
+                return new TemplateGroup(ifs);
+            }
+            catch(runtime_error&)
+            {
+                /* Broken cache file. Rebuild group and rewrite it. */
+                cerr << "Ignore broken cache file " << cacheFile << "." << endl;
+            }
+        }
+    }
+    
+    DirectoryTemplateCollection templateCollection(templatesDir, templateExt);
+    
+    TemplateGroup* templateGroup = new TemplateGroup(templateCollection,
+        mainTemplateName);
     
-    YAML::const_iterator iter = map.begin(), iterEnd = map.end();
-    for(; iter != iterEnd; ++iter)
+    if(!cacheFile.empty())
     {
-        const Node& key = iter->first;
-        if(key.IsSequence() || key.IsMap())
+        /* 
+         * Write into temporary file first, so concurrent runs never
+         * see partially written cache.
+         */
+        ostringstream tmpFile;
+        tmpFile << cacheFile << ".tmp." << getpid();
+        
+        ofstream ofs(tmpFile.str().c_str(), ios::out | ios::binary);
+        if(ofs)
         {
-            convert_error("Complex keys are forbidden.");
+            templateGroup->save(ofs);
+            ofs.close();
         }
-        else if(key.IsNull())
+        
+        if(!ofs || (rename(tmpFile.str().c_str(), cacheFile.c_str()) != 0))
         {
-            convert_error("Null key is forbidden.");
+            /* Cache is only optimization, do not fail because of it. */
+            cerr << "Failed to write cache file " << cacheFile << "." << endl;
+            remove(tmpFile.str().c_str());
         }
-        /* key is scalar */
-        addMapValue(paramSet, iter->second, key.Scalar());
     }
+    
+    return templateGroup;
 }
 
-void addMapValue(ParamSet* paramSet, const Node& value,
-    const string& name)
+/******************************* Batch mode ***************************/
+/* One job of the batch: data file and output file for it. */
+struct BatchJob
 {
-    assert(value.IsDefined());
+    string dataFile;
+    string outputFile;
+    
+    BatchJob(const string& dataFile, const string& outputFile):
+        dataFile(dataFile), outputFile(outputFile) {}
+};
+
+/* State of the batch, shared between worker threads. */
+struct BatchState
+{
+    const vector<BatchJob>& jobs;
+    /* 
+     * Compiled form of the template group.
+     * 
+     * Template group object cannot be shared between threads because
+     * of non-atomic reference counters inside. So every worker loads
+     * its own group from this compiled form, which is cheap.
+     */
+    const string& compiledGroup;
+    
+    pthread_mutex_t mutex;
+    /* Index of the next job to take. Protected by 'mutex'. */
+    size_t nextJob;
+    /* Number of failed jobs. Protected by 'mutex'. */
+    int nFailed;
+    
+    BatchState(const vector<BatchJob>& jobs, const string& compiledGroup):
+        jobs(jobs), compiledGroup(compiledGroup), nextJob(0), nFailed(0)
+    {
+        pthread_mutex_init(&mutex, NULL);
+    }
+    ~BatchState()
+    {
+        pthread_mutex_destroy(&mutex);
+    }
+};
 
-    if(value.IsSequence())
+/* 
+ * Write content into the file, if it differs from the current one.
+ * 
+ * Return false on error.
+ */
+static bool updateFile(const string& filename, const string& content)
+{
+    ifstream ifs(filename.c_str(), ios::in | ios::binary);
+    if(ifs)
+    {
+        ostringstream current;
+        current << ifs.rdbuf();
+        if(current.str() == content) return true;
+        ifs.close();
+    }
+    
+    /* Replace file atomically, so readers never see partial content. */
+    ostringstream tmpFile;
+    tmpFile << filename << ".tmp." << getpid() << "." << pthread_self();
+    
+    ofstream ofs(tmpFile.str().c_str(), ios::out | ios::binary);
+    if(ofs)
     {
-        addSequence(paramSet, value, name);
+        ofs.write(content.data(), content.size());
+        ofs.close();
     }
-    else if(value.IsMap())
+    
+    if(!ofs || (rename(tmpFile.str().c_str(), filename.c_str()) != 0))
+    {
+        remove(tmpFile.str().c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+static void* batchWorker(void* arg)
+{
+    BatchState* state = (BatchState*)arg;
+    
+    istringstream compiled(state->compiledGroup);
+    TemplateGroup templateGroup(compiled);
+    
+    while(true)
     {
-        addMap(paramSet->addSubset(name), value);
+        pthread_mutex_lock(&state->mutex);
+        size_t jobIndex = state->nextJob++;
+        pthread_mutex_unlock(&state->mutex);
+        
+        if(jobIndex >= state->jobs.size()) break;
+        
+        const BatchJob& job = state->jobs[jobIndex];
+        
+        bool ok = true;
+        try
+        {
+            ParamSet paramSet;
+            loadParamSet(&paramSet, job.dataFile);
+            
+            ok = updateFile(job.outputFile, templateGroup.instantiate(paramSet));
+            if(!ok)
+            {
+                cerr << "Failed to write " << job.outputFile << "." << endl;
+            }
+        }
+        catch(exception& e)
+        {
+            cerr << job.dataFile << ": " << e.what() << endl;
+            ok = false;
+        }
+        
+        if(!ok)
+        {
+            pthread_mutex_lock(&state->mutex);
+            state->nFailed++;
+            pthread_mutex_unlock(&state->mutex);
+        }
     }
-    else if(value.IsScalar())
+    
+    return NULL;
+}
+
+/* 
+ * Read manifest file.
+ * 
+ * Every non-empty line, which doesn't start with '#', contains
+ * name of the data file and name of the output file, separated by
+ * whitespaces.
+ */
+static bool readManifest(const string& manifest, vector<BatchJob>& jobs)
+{
+    ifstream ifs(manifest.c_str());
+    if(!ifs)
     {
-        paramSet->addParameter(name, value.Scalar());
+        cerr << "Failed to open manifest file " << manifest << "." << endl;
+        return false;
     }
-    else if(value.IsNull())
+    
+    string line;
+    for(int lineNumber = 1; getline(ifs, line); lineNumber++)
     {
-        paramSet->addParameter(name);
+        istringstream ls(line);
+        string dataFile, outputFile, rest;
+        
+        if(!(ls >> dataFile) || (dataFile[0] == '#')) continue;
+        
+        if(!(ls >> outputFile) || (ls >> rest))
+        {
+            cerr << manifest << ":" << lineNumber
+                << ": expected '<data-file> <output-file>'." << endl;
+            return false;
+        }
+        
+        jobs.push_back(BatchJob(dataFile, outputFile));
     }
+    
+    return true;
 }
 
-void addSequence(ParamSet* paramSet, const Node& sequence,
-    const string& name)
+int processBatch(const TemplateGroup& templateGroup,
+    const string& manifest, int nJobs)
 {
-    assert(sequence.IsSequence());
+    vector<BatchJob> jobs;
+    if(!readManifest(manifest, jobs)) return 1;
+    
+    ostringstream compiled;
+    templateGroup.save(compiled);
+    string compiledGroup = compiled.str();
     
-    YAML::const_iterator iter = sequence.begin(), iterEnd = sequence.end();
-    for(; iter != iterEnd; ++iter)
+    BatchState state(jobs, compiledGroup);
+    
+    if(nJobs > (int)jobs.size()) nJobs = (int)jobs.size();
+    
+    vector<pthread_t> threads;
+    for(int i = 0; i < nJobs; i++)
     {
-        addMapValue(paramSet, *iter, name);
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, batchWorker, &state) != 0)
+        {
+            if(threads.empty())
+            {
+                cerr << "Failed to create worker thread." << endl;
+                return 1;
+            }
+            /* Process with threads already created. */
+            break;
+        }
+        threads.push_back(thread);
     }
-}
\ No newline at end of file
+    
+    for(int i = 0; i < (int)threads.size(); i++)
+        pthread_join(threads[i], NULL);
+    
+    return state.nFailed ? 1 : 0;
+}
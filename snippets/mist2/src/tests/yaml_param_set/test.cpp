@@ -0,0 +1,325 @@
+/* 
+ * Check that parameters set built from the parser events is the same
+ * as one built via YAML::Node tree.
+ */
+
+#include "yaml_param_set.hh"
+
+#include <yaml-cpp/yaml.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+using namespace Mist;
+using namespace std;
+using namespace YAML;
+
+/* Error about converting YAML representation into parameters set. */
+#define convert_error(what) \
+cerr << what << endl; \
+throw runtime_error("Incorrect YAML data")
+
+/*************** Reference loader via YAML::Node tree *****************/
+/*
+ * Add content of all YAML documents from the stream into parameters set,
+ * using intermediate YAML::Node tree.
+ *
+ * Result is the same as for loadParamSet(), except order of parameters
+ * which correspond to duplicated keys in a map: here it depends on the
+ * YAML::Node internals.
+ */
+/* Add content of the document into parameters set. */
+static void addDocument(ParamSet* paramSet, const Node& doc);
+
+static void loadParamSetTree(ParamSet* paramSet, istream& is)
+{
+    vector<Node> documents = LoadAll(is);
+
+    for(vector<Node>::const_iterator iter = documents.begin();
+        iter != documents.end();
+        ++iter)
+    {
+        addDocument(paramSet, *iter);
+    }
+}
+
+/*
+ * Add node as value for subset with given name. */
+static void addMapValue(ParamSet* paramSet, const Node& value,
+    const string& name);
+
+/* 
+ * Add sequence of values to given parameter set, using given subset
+ * name.
+ */
+static void addSequence(ParamSet* paramSet, const Node& sequence,
+    const string& name);
+
+/*
+ * Add map to the given parameter set.
+ */
+static void addMap(ParamSet* paramSet, const Node& map);
+
+void addDocument(ParamSet* paramSet, const Node& doc)
+{
+    if(!doc.IsDefined())
+    {
+        convert_error("Undefined document.");
+    }
+    
+    if(doc.IsNull())
+    {
+        convert_error("Null at the top of the document is forbidden.");
+    }
+    else if(doc.IsScalar())
+    {
+        convert_error("Scalar at the top of the document is forbidden.");
+    }
+    else if(doc.IsSequence())
+    {
+        convert_error("Sequence at the top of the document is forbidden.");
+    }
+    else if(doc.IsMap())
+    {
+        addMap(paramSet, doc);
+    }
+}
+
+void addMap(ParamSet* paramSet, const Node& map)
+{
+    if(!map.IsMap())
+    {
+        convert_error("Map is expected.");
+    }
+    
+    YAML::const_iterator iter = map.begin(), iterEnd = map.end();
+    for(; iter != iterEnd; ++iter)
+    {
+        const Node key = iter->first;
+        if(key.IsSequence() || key.IsMap())
+        {
+            convert_error("Complex keys are forbidden.");
+        }
+        else if(key.IsNull())
+        {
+            convert_error("Null key is forbidden.");
+        }
+        /* key is scalar */
+        addMapValue(paramSet, iter->second, key.Scalar());
+    }
+}
+
+void addMapValue(ParamSet* paramSet, const Node& value,
+    const string& name)
+{
+    if(!value.IsDefined())
+    {
+        convert_error("Undefined value.");
+    }
+
+    if(value.IsSequence())
+    {
+        addSequence(paramSet, value, name);
+    }
+    else if(value.IsMap())
+    {
+        addMap(paramSet->addSubset(name), value);
+    }
+    else if(value.IsScalar())
+    {
+        paramSet->addParameter(name, value.Scalar());
+    }
+    else if(value.IsNull())
+    {
+        paramSet->addParameter(name);
+    }
+}
+
+void addSequence(ParamSet* paramSet, const Node& sequence,
+    const string& name)
+{
+    if(!sequence.IsSequence())
+    {
+        convert_error("Sequence is expected.");
+    }
+    
+    YAML::const_iterator iter = sequence.begin(), iterEnd = sequence.end();
+    for(; iter != iterEnd; ++iter)
+    {
+        addMapValue(paramSet, *iter, name);
+    }
+}
+
+/************************** Checks ************************************/
+/* Load parameters set from the string using both ways and compare. */
+static void assert_same(const string& yaml)
+{
+    Mist::ParamSet paramSet;
+    istringstream is(yaml);
+    loadParamSet(&paramSet, is);
+    
+    Mist::ParamSet paramSetTree;
+    istringstream isTree(yaml);
+    loadParamSetTree(&paramSetTree, isTree);
+    
+    if(paramSet != paramSetTree)
+    {
+        cout << "Parameters sets differ for YAML:" << endl;
+        cout << yaml << endl;
+        throw logic_error("Parameters sets differ");
+    }
+}
+
+/* Check that both ways reject given YAML. */
+static void assert_rejected(const string& yaml)
+{
+    int nRejected = 0;
+    
+    try
+    {
+        Mist::ParamSet paramSet;
+        istringstream is(yaml);
+        loadParamSet(&paramSet, is);
+    }
+    catch(runtime_error&)
+    {
+        nRejected++;
+    }
+
+    try
+    {
+        Mist::ParamSet paramSet;
+        istringstream is(yaml);
+        loadParamSetTree(&paramSet, is);
+    }
+    catch(runtime_error&)
+    {
+        nRejected++;
+    }
+    
+    if(nRejected != 2)
+    {
+        cout << "YAML should be rejected by both loaders:" << endl;
+        cout << yaml << endl;
+        throw logic_error("Incorrect YAML is accepted");
+    }
+}
+
+/* 
+ * Check that duplicated keys in the data file produce the same
+ * parameters, maybe in another order.
+ * 
+ * Compare count of parameters and their values for top-level names.
+ */
+static void assert_same_file(const string& filename)
+{
+    Mist::ParamSet paramSet;
+    loadParamSet(&paramSet, filename);
+    
+    Mist::ParamSet paramSetTree;
+    ifstream ifs(filename.c_str());
+    loadParamSetTree(&paramSetTree, ifs);
+    
+    const char* names[] = {"module", "header", "function", "global", "code"};
+    for(int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        const vector<Mist::ParamSet*>& sets = paramSet.getSubsets(names[i]);
+        const vector<Mist::ParamSet*>& setsTree = paramSetTree.getSubsets(names[i]);
+        
+        if(sets.size() != setsTree.size())
+        {
+            cout << filename << ": different number of '" << names[i]
+                << "' parameters." << endl;
+            throw logic_error("Parameters sets differ");
+        }
+        
+        for(int j = 0; j < (int)sets.size(); j++)
+        {
+            int k;
+            for(k = 0; k < (int)setsTree.size(); k++)
+                if(*sets[j] == *setsTree[k]) break;
+            
+            if(k == (int)setsTree.size())
+            {
+                cout << filename << ": '" << names[i] << "' parameter #"
+                    << j << " has no pair." << endl;
+                throw logic_error("Parameters sets differ");
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    /* Plain values and nested maps */
+    assert_same("name1: value1\nname2: value2\n");
+    assert_same("name:\n  subname1: value1\n  subname2: value2\n");
+    assert_same("name: {subname1: value1, subname2: {a: b}}\n");
+    
+    /* Null values */
+    assert_same("name1:\nname2: ~\nname3: null\nname4: ''\n");
+    
+    /* Sequences, including nested and with nulls */
+    assert_same("name: [a, b, c]\n");
+    assert_same("name:\n  - subname: a\n    subname1: b\n  - subname: c\n");
+    assert_same("name: [a, [b, c], [], {x: y}, ~]\n");
+    assert_same("name: []\nname1: {}\n");
+    
+    /* Block scalars */
+    assert_same("name: |\n  line1\n  line2\nname1: >\n  folded\n  text\n");
+    
+    /* Anchors and aliases */
+    assert_same("a: &x value\nb: *x\n");
+    assert_same("a: &x {s: 1, t: [2, 3]}\nb: *x\nc: [*x, *x]\n");
+    assert_same("a: &x [1, &y {s: 2}]\nb: *y\nc: *x\n");
+    
+    /* Several documents */
+    assert_same("---\na: 1\n---\na: 2\nb: 3\n");
+    assert_same("");
+    
+    /* Forbidden constructions */
+    assert_rejected("scalar\n");
+    assert_rejected("- a\n- b\n");
+    assert_rejected("---\na: 1\n--- ~\n");
+    assert_rejected("? [a, b]\n: c\n");
+    assert_rejected("? {a: 1}\n: c\n");
+    assert_rejected(": c\n");
+    
+    /* Duplicated keys are added in the document order. */
+    Mist::ParamSet paramSet;
+    istringstream is("name: value1\nother: x\nname: value2\nname: [value3]\n");
+    loadParamSet(&paramSet, is);
+    const vector<Mist::ParamSet*>& sets = paramSet.getSubsets("name");
+    if((sets.size() != 3) || (sets[0]->getValue() != "value1")
+        || (sets[1]->getValue() != "value2")
+        || (sets[2]->getValue() != "value3"))
+    {
+        cout << "Duplicated keys are not added in the document order." << endl;
+        return 1;
+    }
+    
+    /* Missing data file */
+    bool missingRejected = false;
+    try
+    {
+        Mist::ParamSet paramSetMissing;
+        loadParamSet(&paramSetMissing, "/nonexistent/data.yaml");
+    }
+    catch(runtime_error&)
+    {
+        missingRejected = true;
+    }
+    if(!missingRejected)
+    {
+        cout << "Missing data file is loaded as empty one." << endl;
+        return 1;
+    }
+    
+    /* Real data files */
+    for(int i = 1; i < argc; i++)
+        assert_same_file(argv[i]);
+    
+    return 0;
+}
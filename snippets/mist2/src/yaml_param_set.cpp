@@ -0,0 +1,376 @@
+/*
+ * Conversion of YAML documents into parameters set.
+ */
+
+#include "yaml_param_set.hh"
+
+#include <yaml-cpp/yaml.h>
+#include <yaml-cpp/eventhandler.h>
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <map>
+#include <cassert>
+
+using namespace Mist;
+using namespace std;
+using namespace YAML;
+
+/* Error about converting YAML representation into parameters set. */
+#define convert_error(what) \
+cerr << what << endl; \
+throw runtime_error("Incorrect YAML data")
+
+/*************** Conversion from the parser events ********************/
+/*
+ * Handler of the YAML parser events, which adds parameters into the set.
+ *
+ * Keeps only the stack of currently opened collections, so memory usage
+ * doesn't depend on the size of the document (except anchored nodes,
+ * see below).
+ */
+class ParamSetBuilder: public EventHandler
+{
+public:
+    ParamSetBuilder(ParamSet* paramSet): paramSet(paramSet) {}
+
+    void OnDocumentStart(const Mark& mark);
+    void OnDocumentEnd();
+
+    void OnNull(const Mark& mark, anchor_t anchor);
+    void OnAlias(const Mark& mark, anchor_t anchor);
+    void OnScalar(const Mark& mark, const string& tag, anchor_t anchor,
+        const string& value);
+    void OnSequenceStart(const Mark& mark, const string& tag,
+        anchor_t anchor);
+    void OnSequenceEnd();
+    void OnMapStart(const Mark& mark, const string& tag, anchor_t anchor);
+    void OnMapEnd();
+private:
+    ParamSet* paramSet;
+
+    /* Collection currently opened. */
+    struct Frame
+    {
+        enum Type
+        {
+            /* Top of the document, expect single map. */
+            frameDocument,
+            /* Map, values are added as subsets of 'set' under key name. */
+            frameMap,
+            /* Sequence, values are added as subsets of 'set' with 'name'. */
+            frameSequence
+        } type;
+
+        ParamSet* set;
+        /* Key for the next value in map or name for sequence values. */
+        string name;
+        /* For map: whether key is expected as the next node. */
+        bool expectKey;
+
+        Frame(Type type, ParamSet* set, const string& name = string()):
+            type(type), set(set), name(name), expectKey(true) {}
+    };
+    vector<Frame> frames;
+
+    /* Kind of the node in the event stream. */
+    enum NodeKind
+    {
+        nodeNull,
+        nodeScalar,
+        nodeSequence,
+        nodeMap
+    };
+
+    /* Process start of the node (or whole node for null and scalar). */
+    void onNode(NodeKind kind, const string& value = string());
+    /* Process end of the collection node. */
+    void onCollectionEnd(void);
+
+    /*
+     * Anchored nodes.
+     *
+     * Because parameters set has no notion of shared subtree, alias
+     * is processed by replaying events of the anchored node. So events
+     * are recorded while anchored node is being parsed.
+     */
+    struct Event
+    {
+        enum Type
+        {
+            eventNull,
+            eventScalar,
+            eventSequenceStart,
+            eventSequenceEnd,
+            eventMapStart,
+            eventMapEnd
+        } type;
+        string value;
+
+        Event(Type type, const string& value = string()):
+            type(type), value(value) {}
+    };
+    /* Events for every anchor in the current document. */
+    map<anchor_t, vector<Event> > anchors;
+    /* Anchored collections which are currently being recorded. */
+    struct Recording
+    {
+        vector<Event>* events;
+        /* Depth of collections inside the anchored node. */
+        int depth;
+
+        Recording(vector<Event>* events): events(events), depth(0) {}
+    };
+    vector<Recording> recordings;
+    /* Line of the last event with mark, for error reporting. */
+    int line;
+
+    void setMark(const Mark& mark) {line = mark.line + 1;}
+    /* Start recording of the anchored node, if anchor is set. */
+    void beginAnchor(anchor_t anchor);
+    /* Record event for all active recordings. */
+    void record(const Event& event);
+    /* Process event, recorded previously. */
+    void replay(const Event& event);
+};
+
+/* Error about converting YAML into parameters set at the given line. */
+#define convert_error_line(what) convert_error("line " << line << ": " << what)
+
+void ParamSetBuilder::OnDocumentStart(const Mark& mark)
+{
+    setMark(mark);
+
+    assert(frames.empty());
+    frames.push_back(Frame(Frame::frameDocument, paramSet));
+    anchors.clear();
+}
+
+void ParamSetBuilder::OnDocumentEnd()
+{
+    assert(frames.size() == 1);
+    frames.clear();
+    anchors.clear();
+    assert(recordings.empty());
+}
+
+void ParamSetBuilder::OnNull(const Mark& mark, anchor_t anchor)
+{
+    setMark(mark);
+
+    beginAnchor(anchor);
+    record(Event(Event::eventNull));
+    onNode(nodeNull);
+}
+
+void ParamSetBuilder::OnAlias(const Mark& mark, anchor_t anchor)
+{
+    setMark(mark);
+
+    map<anchor_t, vector<Event> >::const_iterator iter = anchors.find(anchor);
+    if(iter == anchors.end())
+    {
+        convert_error_line("Alias to the node which is not finished yet.");
+    }
+
+    /* Copy events, as replaying may record into other anchors. */
+    vector<Event> events(iter->second);
+    for(int i = 0; i < (int)events.size(); i++)
+        replay(events[i]);
+}
+
+void ParamSetBuilder::OnScalar(const Mark& mark, const string&,
+    anchor_t anchor, const string& value)
+{
+    setMark(mark);
+
+    beginAnchor(anchor);
+    record(Event(Event::eventScalar, value));
+    onNode(nodeScalar, value);
+}
+
+void ParamSetBuilder::OnSequenceStart(const Mark& mark, const string&,
+    anchor_t anchor)
+{
+    setMark(mark);
+
+    beginAnchor(anchor);
+    record(Event(Event::eventSequenceStart));
+    onNode(nodeSequence);
+}
+
+void ParamSetBuilder::OnSequenceEnd()
+{
+    record(Event(Event::eventSequenceEnd));
+    onCollectionEnd();
+}
+
+void ParamSetBuilder::OnMapStart(const Mark& mark, const string&,
+    anchor_t anchor)
+{
+    setMark(mark);
+
+    beginAnchor(anchor);
+    record(Event(Event::eventMapStart));
+    onNode(nodeMap);
+}
+
+void ParamSetBuilder::OnMapEnd()
+{
+    record(Event(Event::eventMapEnd));
+    onCollectionEnd();
+}
+
+void ParamSetBuilder::onNode(NodeKind kind, const string& value)
+{
+    assert(!frames.empty());
+    Frame& frame = frames.back();
+
+    switch(frame.type)
+    {
+    case Frame::frameDocument:
+        switch(kind)
+        {
+        case nodeNull:
+            convert_error_line("Null at the top of the document is forbidden.");
+        case nodeScalar:
+            convert_error_line("Scalar at the top of the document is forbidden.");
+        case nodeSequence:
+            convert_error_line("Sequence at the top of the document is forbidden.");
+        case nodeMap:
+            frames.push_back(Frame(Frame::frameMap, frame.set));
+            return;
+        }
+        break;
+    case Frame::frameMap:
+        if(frame.expectKey)
+        {
+            switch(kind)
+            {
+            case nodeNull:
+                convert_error_line("Null key is forbidden.");
+            case nodeSequence:
+            case nodeMap:
+                convert_error_line("Complex keys are forbidden.");
+            case nodeScalar:
+                frame.name = value;
+                frame.expectKey = false;
+                return;
+            }
+        }
+        frame.expectKey = true;
+        break;
+    case Frame::frameSequence:
+        break;
+    }
+
+    /* Value for the map or sequence element. */
+    ParamSet* set = frame.set;
+    string name = frame.name;
+
+    switch(kind)
+    {
+    case nodeNull:
+        set->addParameter(name);
+        break;
+    case nodeScalar:
+        set->addParameter(name, value);
+        break;
+    case nodeSequence:
+        /* Elements of the sequence are added with the same name. */
+        frames.push_back(Frame(Frame::frameSequence, set, name));
+        break;
+    case nodeMap:
+        frames.push_back(Frame(Frame::frameMap, set->addSubset(name)));
+        break;
+    }
+}
+
+void ParamSetBuilder::onCollectionEnd(void)
+{
+    assert(frames.size() > 1);
+    frames.pop_back();
+}
+
+void ParamSetBuilder::beginAnchor(anchor_t anchor)
+{
+    if(anchor == NullAnchor) return;
+
+    vector<Event>& events = anchors[anchor];
+    events.clear();
+    recordings.push_back(Recording(&events));
+}
+
+void ParamSetBuilder::record(const Event& event)
+{
+    vector<Recording>::iterator iter = recordings.begin();
+    while(iter != recordings.end())
+    {
+        iter->events->push_back(event);
+
+        switch(event.type)
+        {
+        case Event::eventSequenceStart:
+        case Event::eventMapStart:
+            iter->depth++;
+            break;
+        case Event::eventSequenceEnd:
+        case Event::eventMapEnd:
+            iter->depth--;
+            break;
+        default:
+            break;
+        }
+        /* Anchored node is finished when its depth returns to 0. */
+        if(iter->depth == 0)
+            iter = recordings.erase(iter);
+        else
+            ++iter;
+    }
+}
+
+void ParamSetBuilder::replay(const Event& event)
+{
+    record(event);
+
+    switch(event.type)
+    {
+    case Event::eventNull:
+        onNode(nodeNull);
+        break;
+    case Event::eventScalar:
+        onNode(nodeScalar, event.value);
+        break;
+    case Event::eventSequenceStart:
+        onNode(nodeSequence);
+        break;
+    case Event::eventMapStart:
+        onNode(nodeMap);
+        break;
+    case Event::eventSequenceEnd:
+    case Event::eventMapEnd:
+        onCollectionEnd();
+        break;
+    }
+}
+
+void loadParamSet(ParamSet* paramSet, istream& is)
+{
+    Parser parser(is);
+    ParamSetBuilder builder(paramSet);
+
+    while(parser.HandleNextDocument(builder));
+}
+
+void loadParamSet(ParamSet* paramSet, const string& filename)
+{
+    ifstream ifs(filename.c_str());
+    if(!ifs)
+        throw runtime_error("Cannot open data file '" + filename + "'");
+
+    loadParamSet(paramSet, ifs);
+    if(ifs.bad())
+        throw runtime_error("Failed to read data file '" + filename + "'");
+}
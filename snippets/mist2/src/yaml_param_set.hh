@@ -0,0 +1,33 @@
+/*
+ * Conversion of YAML documents into parameters set.
+ *
+ * Conversion rules are described in README.
+ */
+
+#ifndef YAML_PARAM_SET_HH
+#define YAML_PARAM_SET_HH
+
+#include <mist2/mist.hh>
+
+#include <iostream>
+#include <string>
+
+/*
+ * Add content of all YAML documents from the stream into parameters set.
+ *
+ * Parameters set is built directly from the parser events, without
+ * intermediate YAML::Node tree. Parameters which correspond to the
+ * same key in a map are added in the document order.
+ *
+ * On incorrect data std::runtime_error is thrown.
+ */
+void loadParamSet(Mist::ParamSet* paramSet, std::istream& is);
+
+/*
+ * Same, but load documents from the file.
+ *
+ * If the file cannot be opened or read, std::runtime_error is thrown.
+ */
+void loadParamSet(Mist::ParamSet* paramSet, const std::string& filename);
+
+#endif /* YAML_PARAM_SET_HH */
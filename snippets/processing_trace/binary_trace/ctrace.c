@@ -0,0 +1,1052 @@
+/* Reading and writing of the binary trace(see ctrace.h). */
+
+#define _GNU_SOURCE
+
+#include "ctrace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define ENTRY_ALIGNED(size) \
+	(((size) + CTRACE_ENTRY_ALIGN - 1) & ~(size_t)(CTRACE_ENTRY_ALIGN - 1))
+
+/* Initial size of the buffers for reading and writing */
+#define BUFFER_SIZE (1 << 20)
+
+/* Maximum size of the entry, protects from corrupted files */
+#define ENTRY_SIZE_MAX (64 << 20)
+
+/* Maximum length of the layout of the prefix */
+#define LAYOUT_MAX 128
+
+static const uint64_t powers10[] =
+{
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL
+};
+
+/************************ Text formatting *********************/
+
+/* Output buffer with snprintf() semantic */
+struct text_out
+{
+	char* buf;
+	size_t size;
+	size_t len;
+};
+
+static void out_chars(struct text_out* out, const char* s, size_t n)
+{
+	if(out->len < out->size)
+	{
+		size_t avail = out->size - out->len;
+		memcpy(out->buf + out->len, s, n < avail ? n : avail);
+	}
+	out->len += n;
+}
+
+static void out_string(struct text_out* out, const char* s)
+{
+	out_chars(out, s, strlen(s));
+}
+
+static void out_number(struct text_out* out, uint64_t value,
+	unsigned base, unsigned width)
+{
+	char digits[24];
+	size_t pos = sizeof(digits);
+
+	do
+	{
+		digits[--pos] = "0123456789abcdef"[value % base];
+		value /= base;
+	}while(value);
+	while(sizeof(digits) - pos < width && pos > 0)
+		digits[--pos] = '0';
+	out_chars(out, digits + pos, sizeof(digits) - pos);
+}
+
+static void out_value(struct text_out* out, const struct ctrace_value* value)
+{
+	switch(value->kind)
+	{
+	case CTRACE_VALUE_NULL:
+		out_chars(out, "(null)", 6);
+		break;
+	case CTRACE_VALUE_HEX:
+		out_number(out, value->value, 16, 0);
+		break;
+	case CTRACE_VALUE_DEC:
+		if((int64_t)value->value < 0)
+		{
+			out_chars(out, "-", 1);
+			out_number(out, -value->value, 10, 0);
+		}
+		else
+			out_number(out, value->value, 10, 0);
+		break;
+	case CTRACE_VALUE_STRING:
+		out_string(out, value->string);
+		break;
+	}
+}
+
+/* Return 0 on success, -1 if layout is incorrect. */
+static int out_prefix(struct text_out* out, const char* layout,
+	const struct ctrace_record* record)
+{
+	const char* p = layout;
+	unsigned digits;
+
+	for(;;)
+	{
+		const char* field = strchr(p, CTRACE_LAYOUT_FIELD);
+		if(field == NULL)
+		{
+			out_string(out, p);
+			return 0;
+		}
+		out_chars(out, p, field - p);
+		p = field + 1;
+		switch(*p++)
+		{
+		case 't':
+			out_string(out, record->task);
+			break;
+		case 'p':
+			out_number(out, record->pid, 10, 0);
+			break;
+		case 'c':
+			if(*p < '1' || *p > '9') return -1;
+			out_number(out, record->cpu, 10, *p++ - '0');
+			break;
+		case 's':
+			out_number(out, record->timestamp / powers10[9], 10, 0);
+			break;
+		case 'f':
+			if(*p < '1' || *p > '9') return -1;
+			digits = *p++ - '0';
+			out_number(out, record->timestamp % powers10[9]
+				/ powers10[9 - digits], 10, digits);
+			break;
+		default:
+			return -1;
+		}
+	}
+}
+
+static int format_record(const char* layout, const struct ctrace_record* record,
+	char* buf, size_t size)
+{
+	struct text_out out = {buf, size, 0};
+	int i;
+
+	if(record->type == CTRACE_RECORD_RAW)
+	{
+		out_chars(&out, record->raw, record->raw_len);
+	}
+	else
+	{
+		if(out_prefix(&out, layout, record)) return -1;
+		out_chars(&out, ": called_", 9);
+		out_string(&out, record->function);
+		out_chars(&out, ": arguments: (", 14);
+		for(i = 0; i < record->n_args; i++)
+		{
+			if(i) out_chars(&out, ", ", 2);
+			out_value(&out, &record->args[i]);
+		}
+		out_chars(&out, ")", 1);
+		if(record->has_result)
+		{
+			out_chars(&out, ", result: ", 10);
+			out_value(&out, &record->result);
+		}
+	}
+	if(size)
+		buf[out.len < size ? out.len : size - 1] = '\0';
+	return (int)out.len;
+}
+
+int ctrace_is_binary(const void* start, size_t size)
+{
+	return size >= 8 && memcmp(start, CTRACE_MAGIC, 8) == 0;
+}
+
+uint64_t ctrace_value_hex(const struct ctrace_value* value)
+{
+	uint64_t result = 0, decimal = value->value;
+	unsigned shift;
+
+	switch(value->kind)
+	{
+	case CTRACE_VALUE_HEX:
+		return value->value;
+	case CTRACE_VALUE_DEC:
+		if((int64_t)decimal < 0) return decimal;
+		/* Decimal digits are the hexadecimal ones */
+		for(shift = 0; decimal && shift < 64; shift += 4, decimal /= 10)
+			result |= (decimal % 10) << shift;
+		return result;
+	default:
+		return 0;
+	}
+}
+
+/*************************** Reading ***************************/
+
+struct ctrace_reader
+{
+	int fd;
+	/* Data read from the file, buf[0] is at 'offset' in the file */
+	char* buf;
+	size_t capacity;
+	size_t pos;
+	size_t end;
+	uint64_t offset;
+	int eof;
+	/* CTRACE_ENTRY_NO_NEWLINE has been read */
+	int no_newline;
+
+	char** strings;
+	uint32_t n_strings;
+	uint32_t strings_capacity;
+
+	/* Buffer for ctrace_read_at() */
+	char* at_buf;
+	size_t at_size;
+};
+
+/*
+ * Make at least 'n' bytes available from the current position.
+ *
+ * Return 1 on success, 0 if there is no data at all(end of the trace)
+ * and -1 on error or if the trace is truncated.
+ */
+static int reader_ensure(struct ctrace_reader* reader, size_t n)
+{
+	while(reader->end - reader->pos < n)
+	{
+		ssize_t result;
+		if(reader->eof)
+		{
+			if(reader->end == reader->pos) return 0;
+			errno = EINVAL;
+			return -1;
+		}
+		if(reader->pos)
+		{
+			memmove(reader->buf, reader->buf + reader->pos,
+				reader->end - reader->pos);
+			reader->offset += reader->pos;
+			reader->end -= reader->pos;
+			reader->pos = 0;
+		}
+		if(n > reader->capacity)
+		{
+			char* buf = realloc(reader->buf, n);
+			if(buf == NULL) return -1;
+			reader->buf = buf;
+			reader->capacity = n;
+		}
+		result = read(reader->fd, reader->buf + reader->end,
+			reader->capacity - reader->end);
+		if(result == -1)
+		{
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		if(result == 0) reader->eof = 1;
+		reader->end += result;
+	}
+	return 1;
+}
+
+static int reader_add_string(struct ctrace_reader* reader,
+	const struct ctrace_entry_header* header)
+{
+	uint32_t id;
+	size_t len;
+	char* string;
+
+	if(header->size < sizeof(*header) + sizeof(id)) goto invalid;
+	memcpy(&id, header + 1, sizeof(id));
+	/* Strings are defined in order of ids */
+	if(id != reader->n_strings) goto invalid;
+	len = header->size - sizeof(*header) - sizeof(id);
+
+	if(reader->n_strings == reader->strings_capacity)
+	{
+		uint32_t capacity = reader->strings_capacity
+			? reader->strings_capacity * 2 : 256;
+		char** strings = realloc(reader->strings, capacity * sizeof(*strings));
+		if(strings == NULL) return -1;
+		reader->strings = strings;
+		reader->strings_capacity = capacity;
+	}
+	string = malloc(len + 1);
+	if(string == NULL) return -1;
+	memcpy(string, (const char*)(header + 1) + sizeof(id), len);
+	string[len] = '\0';
+	reader->strings[reader->n_strings++] = string;
+	return 0;
+
+invalid:
+	errno = EINVAL;
+	return -1;
+}
+
+static int reader_decode_value(const struct ctrace_reader* reader,
+	uint32_t kind, uint64_t data, struct ctrace_value* value)
+{
+	value->kind = (enum ctrace_value_kind)kind;
+	value->value = data;
+	value->string = NULL;
+	if(kind == CTRACE_VALUE_STRING)
+	{
+		if(data >= reader->n_strings) return -1;
+		value->string = reader->strings[data];
+	}
+	return 0;
+}
+
+static int reader_decode(const struct ctrace_reader* reader,
+	const struct ctrace_entry_header* header, uint64_t offset,
+	struct ctrace_record* record)
+{
+	const struct ctrace_call_entry* call;
+	int i;
+
+	record->offset = offset;
+	if(header->type == CTRACE_ENTRY_RAW)
+	{
+		record->type = CTRACE_RECORD_RAW;
+		record->raw = (const char*)(header + 1);
+		record->raw_len = header->size - sizeof(*header);
+		return 0;
+	}
+	if(header->type != CTRACE_ENTRY_CALL) goto invalid;
+
+	call = (const struct ctrace_call_entry*)header;
+	if(header->n_args > CTRACE_ARGS_MAX
+		|| header->size != sizeof(*call) + header->n_args * sizeof(uint64_t)
+		|| call->function >= reader->n_strings
+		|| call->task >= reader->n_strings
+		|| call->layout >= reader->n_strings)
+		goto invalid;
+
+	record->type = CTRACE_RECORD_CALL;
+	record->raw = NULL;
+	record->raw_len = 0;
+	record->function_id = call->function;
+	record->function = reader->strings[call->function];
+	record->task_id = call->task;
+	record->task = reader->strings[call->task];
+	record->layout = call->layout;
+	record->pid = call->pid;
+	record->cpu = call->cpu;
+	record->timestamp = call->timestamp;
+	record->has_result = (call->flags & CTRACE_HAS_RESULT) != 0;
+	if(reader_decode_value(reader, call->kinds & 3, call->result,
+		&record->result))
+		goto invalid;
+	record->n_args = header->n_args;
+	for(i = 0; i < record->n_args; i++)
+	{
+		if(reader_decode_value(reader, (call->kinds >> (2 * (i + 1))) & 3,
+			call->args[i], &record->args[i]))
+			goto invalid;
+	}
+	return 0;
+
+invalid:
+	errno = EINVAL;
+	return -1;
+}
+
+struct ctrace_reader* ctrace_reader_create(int fd)
+{
+	struct ctrace_reader* reader = calloc(1, sizeof(*reader));
+	const struct ctrace_file_header* header;
+	int result;
+
+	if(reader == NULL) return NULL;
+	reader->fd = fd;
+	reader->capacity = BUFFER_SIZE;
+	reader->buf = malloc(reader->capacity);
+	if(reader->buf == NULL) goto err;
+
+	result = reader_ensure(reader, sizeof(*header));
+	if(result <= 0)
+	{
+		if(result == 0) errno = EINVAL;
+		goto err;
+	}
+	header = (const struct ctrace_file_header*)reader->buf;
+	if(!ctrace_is_binary(header, sizeof(*header))
+		|| header->version != CTRACE_VERSION)
+	{
+		errno = EINVAL;
+		goto err;
+	}
+	reader->pos = sizeof(*header);
+	return reader;
+
+err:
+	free(reader->buf);
+	free(reader);
+	return NULL;
+}
+
+void ctrace_reader_destroy(struct ctrace_reader* reader)
+{
+	uint32_t i;
+
+	for(i = 0; i < reader->n_strings; i++)
+		free(reader->strings[i]);
+	free(reader->strings);
+	free(reader->at_buf);
+	free(reader->buf);
+	free(reader);
+}
+
+int ctrace_next(struct ctrace_reader* reader, struct ctrace_record* record)
+{
+	for(;;)
+	{
+		const struct ctrace_entry_header* header;
+		size_t size;
+		uint64_t offset;
+		int result = reader_ensure(reader, sizeof(*header));
+		if(result <= 0) return result;
+
+		header = (const struct ctrace_entry_header*)(reader->buf + reader->pos);
+		if(header->size < sizeof(*header) || header->size > ENTRY_SIZE_MAX)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		size = ENTRY_ALIGNED(header->size);
+		result = reader_ensure(reader, size);
+		if(result <= 0)
+		{
+			if(result == 0) errno = EINVAL;
+			return -1;
+		}
+		/* Buffer may be moved */
+		header = (const struct ctrace_entry_header*)(reader->buf + reader->pos);
+		offset = reader->offset + reader->pos;
+		reader->pos += size;
+
+		if(header->type == CTRACE_ENTRY_STRING)
+		{
+			if(reader_add_string(reader, header)) return -1;
+			continue;
+		}
+		if(header->type == CTRACE_ENTRY_NO_NEWLINE)
+		{
+			/* Nothing may follow it */
+			result = reader_ensure(reader, 1);
+			if(result != 0)
+			{
+				if(result > 0) errno = EINVAL;
+				return -1;
+			}
+			reader->no_newline = 1;
+			return 0;
+		}
+		return reader_decode(reader, header, offset, record) ? -1 : 1;
+	}
+}
+
+static int pread_all(int fd, void* buf, size_t size, uint64_t offset)
+{
+	size_t done = 0;
+
+	while(done < size)
+	{
+		ssize_t result = pread(fd, (char*)buf + done, size - done,
+			(off_t)(offset + done));
+		if(result == -1)
+		{
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		if(result == 0)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		done += result;
+	}
+	return 0;
+}
+
+int ctrace_read_at(struct ctrace_reader* reader, uint64_t offset,
+	struct ctrace_record* record)
+{
+	struct ctrace_entry_header header;
+
+	if(pread_all(reader->fd, &header, sizeof(header), offset)) return -1;
+	if(header.size < sizeof(header) || header.size > ENTRY_SIZE_MAX)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(header.size > reader->at_size)
+	{
+		char* buf = realloc(reader->at_buf, header.size);
+		if(buf == NULL) return -1;
+		reader->at_buf = buf;
+		reader->at_size = header.size;
+	}
+	if(pread_all(reader->fd, reader->at_buf, header.size, offset)) return -1;
+	return reader_decode(reader, (const struct ctrace_entry_header*)reader->at_buf,
+		offset, record);
+}
+
+int ctrace_final_newline(const struct ctrace_reader* reader)
+{
+	return !reader->no_newline;
+}
+
+const char* ctrace_string(const struct ctrace_reader* reader, uint32_t id)
+{
+	return id < reader->n_strings ? reader->strings[id] : NULL;
+}
+
+int ctrace_format(const struct ctrace_reader* reader,
+	const struct ctrace_record* record, char* buf, size_t size)
+{
+	const char* layout = NULL;
+
+	if(record->type == CTRACE_RECORD_CALL)
+	{
+		layout = ctrace_string(reader, record->layout);
+		if(layout == NULL) return -1;
+	}
+	return format_record(layout, record, buf, size);
+}
+
+/*************************** Writing ***************************/
+
+struct ctrace_writer
+{
+	int fd;
+	char* buf;
+	size_t capacity;
+	size_t len;
+	int error;
+
+	/* String table; strings from 'n_written' are not written yet */
+	char** strings;
+	uint32_t* lengths;
+	uint32_t n_strings;
+	uint32_t strings_capacity;
+	uint32_t n_written;
+	/* Hash table of the strings: id + 1 or 0 for empty cell */
+	uint32_t* hash;
+	size_t hash_size;
+
+	/* Line formatted from the record, for verification */
+	char* check_buf;
+	size_t check_size;
+
+	unsigned long n_calls;
+	unsigned long n_raw;
+};
+
+static int writer_flush(struct ctrace_writer* writer)
+{
+	size_t done = 0;
+
+	while(done < writer->len)
+	{
+		ssize_t result = write(writer->fd, writer->buf + done,
+			writer->len - done);
+		if(result == -1)
+		{
+			if(errno == EINTR) continue;
+			writer->error = 1;
+			return -1;
+		}
+		done += result;
+	}
+	writer->len = 0;
+	return 0;
+}
+
+/* Reserve space for the entry, return NULL on error. */
+static void* writer_reserve(struct ctrace_writer* writer, size_t size)
+{
+	void* entry;
+	size_t aligned = ENTRY_ALIGNED(size);
+
+	if(writer->len + aligned > writer->capacity)
+	{
+		if(writer_flush(writer)) return NULL;
+		if(aligned > writer->capacity)
+		{
+			char* buf = realloc(writer->buf, aligned);
+			if(buf == NULL)
+			{
+				writer->error = 1;
+				return NULL;
+			}
+			writer->buf = buf;
+			writer->capacity = aligned;
+		}
+	}
+	entry = writer->buf + writer->len;
+	memset((char*)entry + size, 0, aligned - size);
+	writer->len += aligned;
+	return entry;
+}
+
+static inline uint32_t string_hash(const char* s, size_t len)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261U;
+	size_t i;
+
+	for(i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char)s[i]) * 16777619U;
+	return hash;
+}
+
+static int writer_rehash(struct ctrace_writer* writer, size_t size)
+{
+	uint32_t* hash = calloc(size, sizeof(*hash));
+	uint32_t id;
+
+	if(hash == NULL) return -1;
+	for(id = 0; id < writer->n_strings; id++)
+	{
+		size_t i = string_hash(writer->strings[id], writer->lengths[id])
+			& (size - 1);
+		while(hash[i]) i = (i + 1) & (size - 1);
+		hash[i] = id + 1;
+	}
+	free(writer->hash);
+	writer->hash = hash;
+	writer->hash_size = size;
+	return 0;
+}
+
+/* Return id of the string, adding it to the table if needed; -1 on error. */
+static int64_t writer_intern(struct ctrace_writer* writer, const char* s,
+	size_t len)
+{
+	size_t i = string_hash(s, len) & (writer->hash_size - 1);
+	char* string;
+	uint32_t id;
+
+	for(; writer->hash[i]; i = (i + 1) & (writer->hash_size - 1))
+	{
+		id = writer->hash[i] - 1;
+		if(writer->lengths[id] == len && memcmp(writer->strings[id], s, len) == 0)
+			return id;
+	}
+
+	if(writer->n_strings == writer->strings_capacity)
+	{
+		uint32_t capacity = writer->strings_capacity * 2;
+		char** strings = realloc(writer->strings, capacity * sizeof(*strings));
+		uint32_t* lengths;
+		if(strings == NULL) return -1;
+		writer->strings = strings;
+		lengths = realloc(writer->lengths, capacity * sizeof(*lengths));
+		if(lengths == NULL) return -1;
+		writer->lengths = lengths;
+		writer->strings_capacity = capacity;
+	}
+	string = malloc(len + 1);
+	if(string == NULL) return -1;
+	memcpy(string, s, len);
+	string[len] = '\0';
+	id = writer->n_strings++;
+	writer->strings[id] = string;
+	writer->lengths[id] = (uint32_t)len;
+	writer->hash[i] = id + 1;
+
+	/* Load factor is kept below 1/2 */
+	if(writer->n_strings * 2 > writer->hash_size
+		&& writer_rehash(writer, writer->hash_size * 2))
+		return -1;
+	return id;
+}
+
+struct ctrace_writer* ctrace_writer_create(int fd)
+{
+	struct ctrace_writer* writer = calloc(1, sizeof(*writer));
+	struct ctrace_file_header* header;
+
+	if(writer == NULL) return NULL;
+	writer->fd = fd;
+	writer->capacity = BUFFER_SIZE;
+	writer->strings_capacity = 256;
+	writer->hash_size = 1024;
+	writer->buf = malloc(writer->capacity);
+	writer->strings = malloc(writer->strings_capacity * sizeof(*writer->strings));
+	writer->lengths = malloc(writer->strings_capacity * sizeof(*writer->lengths));
+	writer->hash = calloc(writer->hash_size, sizeof(*writer->hash));
+	if(!writer->buf || !writer->strings || !writer->lengths || !writer->hash)
+	{
+		free(writer->buf);
+		free(writer->strings);
+		free(writer->lengths);
+		free(writer->hash);
+		free(writer);
+		return NULL;
+	}
+
+	header = (struct ctrace_file_header*)writer->buf;
+	memcpy(header->magic, CTRACE_MAGIC, sizeof(header->magic));
+	header->version = CTRACE_VERSION;
+	header->reserved = 0;
+	writer->len = sizeof(*header);
+	return writer;
+}
+
+int ctrace_writer_destroy(struct ctrace_writer* writer)
+{
+	int result = writer->error ? -1 : writer_flush(writer);
+	uint32_t id;
+
+	for(id = 0; id < writer->n_strings; id++)
+		free(writer->strings[id]);
+	free(writer->strings);
+	free(writer->lengths);
+	free(writer->hash);
+	free(writer->check_buf);
+	free(writer->buf);
+	free(writer);
+	return result;
+}
+
+void ctrace_writer_stat(const struct ctrace_writer* writer,
+	unsigned long* n_calls, unsigned long* n_raw)
+{
+	*n_calls = writer->n_calls;
+	*n_raw = writer->n_raw;
+}
+
+static inline int is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/* Parse unsigned decimal number of at most 'max_digits' digits. */
+static int parse_decimal(const char* s, size_t len, size_t max_digits,
+	uint64_t* value)
+{
+	size_t i;
+
+	if(len == 0 || len > max_digits) return -1;
+	*value = 0;
+	for(i = 0; i < len; i++)
+	{
+		if(!is_digit(s[i])) return -1;
+		*value = *value * 10 + (s[i] - '0');
+	}
+	return 0;
+}
+
+/*
+ * Parse prefix of the line("task-pid [cpu] seconds.fraction") from the
+ * end to the beginning, since task may contain any symbols.
+ */
+static int parse_prefix(struct ctrace_writer* writer, const char* line,
+	const char* end, struct ctrace_record* record)
+{
+	char layout[LAYOUT_MAX];
+	size_t layout_len = 0;
+	const char *p = end, *fraction, *seconds, *spaces2, *cpu, *spaces1, *pid;
+	const char* task;
+	uint64_t value, frac;
+	int64_t id;
+
+	while(p > line && is_digit(p[-1])) p--;
+	fraction = p;
+	if(parse_decimal(fraction, end - fraction, 9, &frac)) return -1;
+	if(p == line || *--p != '.') return -1;
+	while(p > line && is_digit(p[-1])) p--;
+	seconds = p;
+	if(parse_decimal(seconds, fraction - 1 - seconds, 10, &value)) return -1;
+	record->timestamp = value * powers10[9]
+		+ frac * powers10[9 - (end - fraction)];
+
+	while(p > line && p[-1] == ' ') p--;
+	spaces2 = p;
+	if(p == line || *--p != ']') return -1;
+	while(p > line && is_digit(p[-1])) p--;
+	cpu = p;
+	if(parse_decimal(cpu, spaces2 - 1 - cpu, 9, &value)) return -1;
+	record->cpu = (uint32_t)value;
+	if(p == line || *--p != '[') return -1;
+
+	while(p > line && p[-1] == ' ') p--;
+	spaces1 = p;
+	while(p > line && is_digit(p[-1])) p--;
+	pid = p;
+	if(parse_decimal(pid, spaces1 - pid, 9, &value)) return -1;
+	record->pid = (uint32_t)value;
+	if(p == line || *--p != '-') return -1;
+
+	for(task = line; task < p && *task == ' '; task++);
+	if(task == p) return -1;
+	id = writer_intern(writer, task, p - task);
+	if(id < 0) return -1;
+	record->task_id = (uint32_t)id;
+	record->task = writer->strings[id];
+
+	/* Leading spaces, "-" and spaces around "[cpu]" are kept in layout */
+	if((size_t)((task - line) + (cpu - 1 - spaces1) + (seconds - spaces2))
+		+ 32 > sizeof(layout))
+		return -1;
+#define LAYOUT_ADD(s, n) \
+	do { memcpy(layout + layout_len, s, n); layout_len += n; } while(0)
+	LAYOUT_ADD(line, (size_t)(task - line));
+	LAYOUT_ADD("\x01t-\x01p", 5);
+	LAYOUT_ADD(spaces1, (size_t)(cpu - 1 - spaces1));
+	LAYOUT_ADD("[\x01", 2);
+	layout[layout_len++] = 'c';
+	layout[layout_len++] = (char)('0' + (spaces2 - 1 - cpu));
+	LAYOUT_ADD("]", 1);
+	LAYOUT_ADD(spaces2, (size_t)(seconds - spaces2));
+	LAYOUT_ADD("\x01s.\x01", 4);
+	layout[layout_len++] = 'f';
+	layout[layout_len++] = (char)('0' + (end - fraction));
+#undef LAYOUT_ADD
+	id = writer_intern(writer, layout, layout_len);
+	if(id < 0) return -1;
+	record->layout = (uint32_t)id;
+	return 0;
+}
+
+static int parse_value(struct ctrace_writer* writer, const char* s,
+	size_t len, struct ctrace_value* value)
+{
+	const char* digits = s;
+	size_t i;
+	int64_t id;
+
+	if(len == 0) return -1;
+	value->string = NULL;
+	if(len == 6 && memcmp(s, "(null)", 6) == 0)
+	{
+		value->kind = CTRACE_VALUE_NULL;
+		value->value = 0;
+		return 0;
+	}
+	if(*s == '-' && len > 1) digits++;
+	/* Leading zeroes would be lost */
+	if((digits[0] != '0' || (size_t)(digits - s) + 1 == len)
+		&& parse_decimal(digits, len - (digits - s), 18, &value->value) == 0
+		&& !(digits != s && value->value == 0))
+	{
+		value->kind = CTRACE_VALUE_DEC;
+		if(digits != s) value->value = -value->value;
+		return 0;
+	}
+	if(len <= 16 && s[0] != '0')
+	{
+		value->value = 0;
+		for(i = 0; i < len; i++)
+		{
+			char c = s[i];
+			if(is_digit(c))
+				value->value = (value->value << 4) | (c - '0');
+			else if(c >= 'a' && c <= 'f')
+				value->value = (value->value << 4) | (c - 'a' + 10);
+			else
+				break;
+		}
+		if(i == len)
+		{
+			value->kind = CTRACE_VALUE_HEX;
+			return 0;
+		}
+	}
+	id = writer_intern(writer, s, len);
+	if(id < 0) return -1;
+	value->kind = CTRACE_VALUE_STRING;
+	value->value = (uint64_t)id;
+	value->string = writer->strings[id];
+	return 0;
+}
+
+int ctrace_parse_line(struct ctrace_writer* writer, const char* line,
+	size_t len, struct ctrace_record* record)
+{
+	const char* end = line + len;
+	const char *called, *function, *function_end, *p, *args_end, *result;
+	int64_t id;
+
+	record->type = CTRACE_RECORD_RAW;
+	record->offset = 0;
+	record->raw = line;
+	record->raw_len = len;
+
+	called = memmem(line, len, ": called_", 9);
+	if(called == NULL || parse_prefix(writer, line, called, record))
+		return 0;
+
+	function = called + 9;
+	function_end = memchr(function, ':', end - function);
+	if(function_end == NULL || function_end == function) return 0;
+	p = function_end;
+	if(end - p < 14 || memcmp(p, ": arguments: (", 14)) return 0;
+	p += 14;
+
+	result = memmem(p, end - p, "), result: ", 11);
+	if(result)
+	{
+		args_end = result;
+		result += 11;
+		if(parse_value(writer, result, end - result, &record->result))
+			return 0;
+		record->has_result = 1;
+	}
+	else
+	{
+		if(end[-1] != ')') return 0;
+		args_end = end - 1;
+		record->has_result = 0;
+		record->result.kind = CTRACE_VALUE_NULL;
+		record->result.value = 0;
+		record->result.string = NULL;
+	}
+
+	record->n_args = 0;
+	while(p < args_end)
+	{
+		const char* arg_end = memmem(p, args_end - p, ", ", 2);
+		if(arg_end == NULL) arg_end = args_end;
+		if(record->n_args == CTRACE_ARGS_MAX
+			|| parse_value(writer, p, arg_end - p, &record->args[record->n_args]))
+			return 0;
+		record->n_args++;
+		p = arg_end == args_end ? args_end : arg_end + 2;
+	}
+
+	id = writer_intern(writer, function, function_end - function);
+	if(id < 0) return 0;
+	record->function_id = (uint32_t)id;
+	record->function = writer->strings[id];
+	record->type = CTRACE_RECORD_CALL;
+	return 1;
+}
+
+/* Whether record is formatted into exactly the same line. */
+static int writer_check(struct ctrace_writer* writer,
+	const struct ctrace_record* record, const char* line, size_t len)
+{
+	int result;
+
+	if(len + 1 > writer->check_size)
+	{
+		char* buf = realloc(writer->check_buf, len + 1);
+		if(buf == NULL) return 0;
+		writer->check_buf = buf;
+		writer->check_size = len + 1;
+	}
+	result = format_record(writer->strings[record->layout], record,
+		writer->check_buf, writer->check_size);
+	return result >= 0 && (size_t)result == len
+		&& memcmp(writer->check_buf, line, len) == 0;
+}
+
+static int writer_write_strings(struct ctrace_writer* writer)
+{
+	for(; writer->n_written < writer->n_strings; writer->n_written++)
+	{
+		uint32_t id = writer->n_written;
+		size_t size = sizeof(struct ctrace_entry_header) + sizeof(id)
+			+ writer->lengths[id];
+		struct ctrace_entry_header* header = writer_reserve(writer, size);
+		if(header == NULL) return -1;
+		header->size = (uint32_t)size;
+		header->type = CTRACE_ENTRY_STRING;
+		header->n_args = 0;
+		memcpy(header + 1, &id, sizeof(id));
+		memcpy((char*)(header + 1) + sizeof(id), writer->strings[id],
+			writer->lengths[id]);
+	}
+	return 0;
+}
+
+int ctrace_write_line(struct ctrace_writer* writer, const char* line,
+	size_t len)
+{
+	struct ctrace_record record;
+	struct ctrace_entry_header* header;
+	size_t size;
+
+	if(writer->error) return -1;
+
+	if(ctrace_parse_line(writer, line, len, &record)
+		&& writer_check(writer, &record, line, len))
+	{
+		struct ctrace_call_entry* call;
+		uint32_t kinds = record.result.kind;
+		int i;
+
+		if(writer_write_strings(writer)) return -1;
+		size = sizeof(*call) + record.n_args * sizeof(uint64_t);
+		call = writer_reserve(writer, size);
+		if(call == NULL) return -1;
+		call->header.size = (uint32_t)size;
+		call->header.type = CTRACE_ENTRY_CALL;
+		call->header.n_args = (uint16_t)record.n_args;
+		call->function = record.function_id;
+		call->task = record.task_id;
+		call->layout = record.layout;
+		call->pid = record.pid;
+		call->cpu = record.cpu;
+		call->timestamp = record.timestamp;
+		call->result = record.result.value;
+		call->flags = record.has_result ? CTRACE_HAS_RESULT : 0;
+		call->reserved = 0;
+		for(i = 0; i < record.n_args; i++)
+		{
+			kinds |= (uint32_t)record.args[i].kind << (2 * (i + 1));
+			call->args[i] = record.args[i].value;
+		}
+		call->kinds = kinds;
+		writer->n_calls++;
+		return 0;
+	}
+
+	if(writer_write_strings(writer)) return -1;
+	size = sizeof(*header) + len;
+	if(size > ENTRY_SIZE_MAX)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	header = writer_reserve(writer, size);
+	if(header == NULL) return -1;
+	header->size = (uint32_t)size;
+	header->type = CTRACE_ENTRY_RAW;
+	header->n_args = 0;
+	memcpy(header + 1, line, len);
+	writer->n_raw++;
+	return 0;
+}
+
+int ctrace_write_no_newline(struct ctrace_writer* writer)
+{
+	struct ctrace_entry_header* header;
+
+	if(writer->error) return -1;
+
+	header = writer_reserve(writer, sizeof(*header));
+	if(header == NULL) return -1;
+	header->size = sizeof(*header);
+	header->type = CTRACE_ENTRY_NO_NEWLINE;
+	header->n_args = 0;
+	return 0;
+}
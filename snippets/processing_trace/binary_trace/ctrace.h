@@ -0,0 +1,290 @@
+/*
+ * Binary format of the trace from call monitoring.
+ *
+ * Text line like
+ *
+ *   insmod-3170  [001]   362.781744: called___kmalloc: arguments: (1024, d0), result: ffff88003d2c1000
+ *
+ * is stored as record with numeric fields: timestamp, cpu, pid, ids of
+ * the task and the function in the string table, result and arguments.
+ * Consumers of the trace iterate records instead of parsing text.
+ *
+ * Conversion is lossless: record may be formatted back into exactly the
+ * same line. Lines, which cannot be represented so(e.g. comments), are
+ * stored as raw text entries. Absence of the new-line symbol after the
+ * last line is stored too.
+ *
+ * File format(all numbers are in native byte order):
+ *
+ * struct ctrace_file_header, then entries one after another. Every
+ * entry starts with struct ctrace_entry_header and is aligned on 8 bytes.
+ * String is defined by CTRACE_ENTRY_STRING entry before its first use,
+ * so file may be written and read as a stream.
+ */
+
+#ifndef CTRACE_H
+#define CTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CTRACE_MAGIC "CTRACE\0\1"
+#define CTRACE_VERSION 1
+
+struct ctrace_file_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+enum ctrace_entry_type
+{
+	/* uint32_t id, then characters of the string */
+	CTRACE_ENTRY_STRING = 1,
+	/* struct ctrace_call_entry */
+	CTRACE_ENTRY_CALL,
+	/* Characters of the line */
+	CTRACE_ENTRY_RAW,
+	/*
+	 * No data. The last line has no new-line symbol after it.
+	 * May only be the last entry of the file.
+	 */
+	CTRACE_ENTRY_NO_NEWLINE,
+};
+
+struct ctrace_entry_header
+{
+	/* Size of the entry with header, without alignment */
+	uint32_t size;
+	uint16_t type;
+	/* For CTRACE_ENTRY_CALL - number of arguments */
+	uint16_t n_args;
+};
+
+#define CTRACE_ENTRY_ALIGN 8
+
+/* Kinds of the values(result and arguments) */
+enum ctrace_value_kind
+{
+	/* "(null)" */
+	CTRACE_VALUE_NULL = 0,
+	/* Lowercase hexadecimal number */
+	CTRACE_VALUE_HEX,
+	/* Signed decimal number */
+	CTRACE_VALUE_DEC,
+	/* Other word; value is id of the string */
+	CTRACE_VALUE_STRING,
+};
+
+/* Maximum number of arguments, kinds of all values fit into 32 bits */
+#define CTRACE_ARGS_MAX 15
+
+struct ctrace_call_entry
+{
+	struct ctrace_entry_header header;
+	uint32_t function;
+	uint32_t task;
+	/* Id of the layout of the line prefix(see below) */
+	uint32_t layout;
+	uint32_t pid;
+	uint32_t cpu;
+	/*
+	 * Kinds of the values, 2 bits per value: result is the lowest,
+	 * then arguments.
+	 */
+	uint32_t kinds;
+	/* Time in nanoseconds */
+	uint64_t timestamp;
+	uint64_t result;
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t args[];
+};
+
+/* Flags of the call entry */
+#define CTRACE_HAS_RESULT 1
+
+/*
+ * Layout of the line prefix("task-pid [cpu] seconds.fraction") is the
+ * string from the string table: the text between fields is stored as
+ * is, fields are denoted by CTRACE_LAYOUT_FIELD followed by
+ *
+ * 't' - task,
+ * 'p' - pid,
+ * 'c' and digit - cpu, padded with zeroes to the given width,
+ * 's' - seconds of the timestamp,
+ * 'f' and digit - fraction of the timestamp with given number of digits.
+ *
+ * The prefix is followed by ": called_<function>: arguments: (<args>)"
+ * and optional ", result: <result>".
+ */
+#define CTRACE_LAYOUT_FIELD '\x01'
+
+/*
+ * Value of the result or of the argument.
+ */
+struct ctrace_value
+{
+	enum ctrace_value_kind kind;
+	uint64_t value;
+	/* For CTRACE_VALUE_STRING */
+	const char* string;
+};
+
+enum ctrace_record_type
+{
+	CTRACE_RECORD_CALL,
+	CTRACE_RECORD_RAW,
+};
+
+/*
+ * Record of the trace, returned by the iterator.
+ *
+ * Valid until the next call to ctrace_next().
+ */
+struct ctrace_record
+{
+	enum ctrace_record_type type;
+	/* Offset of the entry in the file, may be used for ctrace_read_at() */
+	uint64_t offset;
+
+	/* Fields for CTRACE_RECORD_CALL */
+	uint32_t function_id;
+	const char* function;
+	uint32_t task_id;
+	const char* task;
+	uint32_t pid;
+	uint32_t cpu;
+	uint64_t timestamp;
+	int has_result;
+	struct ctrace_value result;
+	int n_args;
+	struct ctrace_value args[CTRACE_ARGS_MAX];
+
+	/* Fields for CTRACE_RECORD_RAW(not null-terminated) */
+	const char* raw;
+	size_t raw_len;
+
+	/* Internal */
+	uint32_t layout;
+};
+
+/************************* Reading ****************************/
+
+struct ctrace_reader;
+
+/*
+ * Create reader for the binary trace from the file descriptor(which is
+ * not closed by the reader).
+ *
+ * Return NULL on error(errno is set, EINVAL for incorrect format).
+ */
+struct ctrace_reader* ctrace_reader_create(int fd);
+
+void ctrace_reader_destroy(struct ctrace_reader* reader);
+
+/*
+ * Read next record.
+ *
+ * Return 1 on success, 0 at the end of the trace and -1 on error.
+ */
+int ctrace_next(struct ctrace_reader* reader, struct ctrace_record* record);
+
+/*
+ * Read record at given offset, which was returned before(file should be
+ * seekable). Strings used by the record should be already read.
+ *
+ * Record is valid until the next call to ctrace_read_at() or
+ * ctrace_next().
+ */
+int ctrace_read_at(struct ctrace_reader* reader, uint64_t offset,
+	struct ctrace_record* record);
+
+/*
+ * Whether the last line of the text trace has new-line symbol after it.
+ *
+ * Valid after ctrace_next() has returned 0.
+ */
+int ctrace_final_newline(const struct ctrace_reader* reader);
+
+/* Return string with given id, NULL if it is not defined yet. */
+const char* ctrace_string(const struct ctrace_reader* reader, uint32_t id);
+
+/*
+ * Format record as the line of the text trace(without new-line symbol).
+ *
+ * Return length of the line(as snprintf() does).
+ */
+int ctrace_format(const struct ctrace_reader* reader,
+	const struct ctrace_record* record, char* buf, size_t size);
+
+/* Whether file starts as the binary trace. */
+int ctrace_is_binary(const void* start, size_t size);
+
+/*
+ * Value interpreted as hexadecimal number.
+ *
+ * Text trace doesn't mark the base of the numbers, so hexadecimal value
+ * without letters(e.g. flags "246") is stored as decimal one. Consumers
+ * which know that the value is printed in hex(addresses, flags) should
+ * use this function.
+ */
+uint64_t ctrace_value_hex(const struct ctrace_value* value);
+
+/************************* Writing ****************************/
+
+struct ctrace_writer;
+
+/* Create writer into the file descriptor(not closed by the writer). */
+struct ctrace_writer* ctrace_writer_create(int fd);
+
+/*
+ * Flush remaining data and destroy the writer.
+ *
+ * Return 0 on success, -1 if some data cannot be written.
+ */
+int ctrace_writer_destroy(struct ctrace_writer* writer);
+
+/*
+ * Convert line of the text trace(without new-line symbol) into record
+ * and write it.
+ *
+ * Return 0 on success, -1 on error.
+ */
+int ctrace_write_line(struct ctrace_writer* writer, const char* line,
+	size_t len);
+
+/*
+ * Record that the last line written has no new-line symbol after it.
+ * Should be called after the last ctrace_write_line().
+ *
+ * Return 0 on success, -1 on error.
+ */
+int ctrace_write_no_newline(struct ctrace_writer* writer);
+
+/*
+ * Parse line of the text trace into record without writing.
+ *
+ * Strings in the record point into internal buffers of the writer or
+ * into the line. Return 1 if line is a call, 0 if it is raw text.
+ *
+ * Used by ctrace_write_line(), exported for comparison of text and
+ * binary parsing.
+ */
+int ctrace_parse_line(struct ctrace_writer* writer, const char* line,
+	size_t len, struct ctrace_record* record);
+
+/* Number of lines written as calls and as raw text. */
+void ctrace_writer_stat(const struct ctrace_writer* writer,
+	unsigned long* n_calls, unsigned long* n_raw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CTRACE_H */
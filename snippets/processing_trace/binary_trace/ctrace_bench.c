@@ -0,0 +1,177 @@
+/*
+ * ctrace_bench - compare speed of parsing the text trace and of reading
+ * the same trace in the binary format.
+ *
+ * Usage: ctrace_bench <text-trace> <binary-trace> [repeats]
+ *
+ * Both passes extract the same fields of every call and fold them into
+ * a checksum, which should be equal for both formats. Every pass is
+ * repeated several times, the best one is reported. Files are expected
+ * to be in the page cache after the first pass.
+ */
+
+#include "ctrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#define BLOCK_SIZE (1 << 20)
+
+struct pass_result
+{
+	unsigned long n_records;
+	uint64_t checksum;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void account_record(const struct ctrace_record* record,
+	struct pass_result* result)
+{
+	int i;
+
+	result->n_records++;
+	if(record->type != CTRACE_RECORD_CALL) return;
+	result->checksum += record->timestamp + record->cpu + record->n_args
+		+ strlen(record->function) + ctrace_value_hex(&record->result);
+	for(i = 0; i < record->n_args; i++)
+		result->checksum += ctrace_value_hex(&record->args[i]);
+}
+
+/* Read text trace by blocks and parse every line. */
+static int text_pass(const char* path, struct pass_result* result)
+{
+	struct ctrace_writer* writer = ctrace_writer_create(-1);
+	struct ctrace_record record;
+	char* buf = malloc(BLOCK_SIZE);
+	size_t capacity = BLOCK_SIZE, len = 0;
+	int fd = open(path, O_RDONLY), ret = -1;
+
+	if(fd == -1 || writer == NULL || buf == NULL) goto out;
+	for(;;)
+	{
+		char *line, *newline;
+		ssize_t n;
+
+		if(len == capacity)
+		{
+			char* new_buf = realloc(buf, capacity * 2);
+			if(new_buf == NULL) goto out;
+			buf = new_buf;
+			capacity *= 2;
+		}
+		n = read(fd, buf + len, capacity - len);
+		if(n == -1) goto out;
+		len += n;
+		if(n == 0 && len)
+		{
+			/* Last line without new-line symbol */
+			buf[len++] = '\n';
+		}
+
+		line = buf;
+		while((newline = memchr(line, '\n', buf + len - line)) != NULL)
+		{
+			ctrace_parse_line(writer, line, newline - line, &record);
+			account_record(&record, result);
+			line = newline + 1;
+		}
+		len = buf + len - line;
+		memmove(buf, line, len);
+		if(n == 0) break;
+	}
+	ret = 0;
+
+out:
+	if(ret) perror(path);
+	if(fd != -1) close(fd);
+	free(buf);
+	/* Nothing is written, so result of the flush is not interesting */
+	if(writer) ctrace_writer_destroy(writer);
+	return ret;
+}
+
+static int binary_pass(const char* path, struct pass_result* result)
+{
+	struct ctrace_reader* reader;
+	struct ctrace_record record;
+	int fd = open(path, O_RDONLY), ret = -1;
+
+	if(fd == -1)
+	{
+		perror(path);
+		return -1;
+	}
+	reader = ctrace_reader_create(fd);
+	if(reader == NULL)
+	{
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	while((ret = ctrace_next(reader, &record)) == 1)
+		account_record(&record, result);
+	if(ret) perror(path);
+	ctrace_reader_destroy(reader);
+	close(fd);
+	return ret;
+}
+
+static int run_pass(const char* name, int (*pass)(const char*, struct pass_result*),
+	const char* path, int repeats, struct pass_result* result)
+{
+	double best = 0;
+	int i;
+
+	for(i = 0; i < repeats; i++)
+	{
+		double start, time;
+		memset(result, 0, sizeof(*result));
+		start = now();
+		if(pass(path, result)) return -1;
+		time = now() - start;
+		if(i == 0 || time < best) best = time;
+	}
+	printf("%-7s %10lu records %8.3f s %12.0f records/s\n", name,
+		result->n_records, best, best > 0 ? result->n_records / best : 0.0);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	struct pass_result text_result, binary_result;
+	int repeats = 3;
+
+	if(argc < 3 || argc > 4)
+	{
+		fprintf(stderr, "Usage: %s <text-trace> <binary-trace> [repeats]\n",
+			argv[0]);
+		return 2;
+	}
+	if(argc == 4) repeats = atoi(argv[3]);
+	if(repeats <= 0) repeats = 1;
+
+	if(run_pass("text", text_pass, argv[1], repeats, &text_result)
+		|| run_pass("binary", binary_pass, argv[2], repeats, &binary_result))
+		return 1;
+
+	if(text_result.n_records != binary_result.n_records
+		|| text_result.checksum != binary_result.checksum)
+	{
+		fprintf(stderr, "Traces differ: checksums are %llx and %llx.\n",
+			(unsigned long long)text_result.checksum,
+			(unsigned long long)binary_result.checksum);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * ctrace_convert - convert the text trace from call monitoring into the
+ * binary format(see ctrace.h) and back.
+ */
+
+#define _GNU_SOURCE
+
+#include "ctrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static void usage(const char* program_name)
+{
+	fprintf(stderr, "Usage: %s [-d] [input-file [output-file]]\n\n"
+		"Convert text trace from call monitoring into binary format.\n"
+		"With '-d', convert binary trace back into text.\n"
+		"By default, input is read from stdin and output is written to stdout.\n",
+		program_name);
+}
+
+static int text_to_binary(FILE* input, int output_fd)
+{
+	struct ctrace_writer* writer = ctrace_writer_create(output_fd);
+	char* line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	unsigned long n_calls, n_raw;
+	int newline = 1;
+	int result = 0;
+
+	if(writer == NULL)
+	{
+		perror("Cannot create writer");
+		return -1;
+	}
+	while((len = getline(&line, &size, input)) != -1)
+	{
+		newline = (len && line[len - 1] == '\n');
+		if(newline) len--;
+		if(ctrace_write_line(writer, line, len))
+		{
+			perror("Cannot write record");
+			result = -1;
+			break;
+		}
+	}
+	if(ferror(input))
+	{
+		perror("Cannot read text trace");
+		result = -1;
+	}
+	free(line);
+	if(!result && !newline && ctrace_write_no_newline(writer))
+	{
+		perror("Cannot write record");
+		result = -1;
+	}
+
+	ctrace_writer_stat(writer, &n_calls, &n_raw);
+	if(ctrace_writer_destroy(writer) && !result)
+	{
+		perror("Cannot write binary trace");
+		result = -1;
+	}
+	if(!result)
+		fprintf(stderr, "%lu calls, %lu lines stored as text.\n", n_calls, n_raw);
+	return result;
+}
+
+static int binary_to_text(int input_fd, FILE* output)
+{
+	struct ctrace_reader* reader = ctrace_reader_create(input_fd);
+	struct ctrace_record record;
+	char* line;
+	size_t size = 4096;
+	/* New-line symbol is written before the next line or at the end */
+	int newline = 0;
+	int result;
+
+	if(reader == NULL)
+	{
+		perror("Cannot read binary trace");
+		return -1;
+	}
+	line = malloc(size);
+	if(line == NULL)
+	{
+		ctrace_reader_destroy(reader);
+		return -1;
+	}
+	while((result = ctrace_next(reader, &record)) == 1)
+	{
+		int len = ctrace_format(reader, &record, line, size);
+		if(len >= 0 && (size_t)len >= size)
+		{
+			char* new_line = realloc(line, len + 1);
+			if(new_line == NULL)
+			{
+				result = -1;
+				break;
+			}
+			line = new_line;
+			size = len + 1;
+			len = ctrace_format(reader, &record, line, size);
+		}
+		if(len < 0)
+		{
+			errno = EINVAL;
+			result = -1;
+			break;
+		}
+		if(newline) fputc('\n', output);
+		fwrite(line, 1, len, output);
+		newline = 1;
+	}
+	if(newline && result == 0 && ctrace_final_newline(reader))
+		fputc('\n', output);
+	if(result)
+		perror("Cannot read binary trace");
+	free(line);
+	ctrace_reader_destroy(reader);
+	if(fflush(output) || ferror(output))
+	{
+		perror("Cannot write text trace");
+		result = -1;
+	}
+	return result ? -1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	int decode = 0, opt, input_fd = 0, output_fd = 1, result;
+	FILE *input = stdin, *output = stdout;
+
+	while((opt = getopt(argc, argv, "dh")) != -1)
+	{
+		switch(opt)
+		{
+		case 'd':
+			decode = 1;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if(optind + 2 < argc)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+	if(optind < argc)
+	{
+		input_fd = open(argv[optind], O_RDONLY);
+		if(input_fd == -1)
+		{
+			fprintf(stderr, "Cannot open '%s': %s\n", argv[optind],
+				strerror(errno));
+			return 2;
+		}
+	}
+	if(optind + 1 < argc)
+	{
+		output_fd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(output_fd == -1)
+		{
+			fprintf(stderr, "Cannot open '%s': %s\n", argv[optind + 1],
+				strerror(errno));
+			return 2;
+		}
+	}
+
+	if(decode)
+	{
+		output = fdopen(output_fd, "w");
+		if(output == NULL)
+		{
+			perror("fdopen");
+			return 2;
+		}
+		result = binary_to_text(input_fd, output);
+		if(fclose(output) && !result)
+		{
+			perror("Cannot write text trace");
+			result = -1;
+		}
+	}
+	else
+	{
+		input = fdopen(input_fd, "r");
+		if(input == NULL)
+		{
+			perror("fdopen");
+			return 2;
+		}
+		result = text_to_binary(input, output_fd);
+		fclose(input);
+		if(output_fd != 1) close(output_fd);
+	}
+	if(decode && input_fd) close(input_fd);
+	return result ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Compact hash table keyed by address.
+ *
+ * Open addressing with linear probing: entries are stored in one array,
+ * without per-entry allocations. Removed entries do not leave
+ * tombstones, instead following entries of the cluster are shifted
+ * back, so table does not degrade when addresses are allocated and
+ * freed many times.
+ *
+ * Address 0 is used as mark of the empty slot and cannot be stored.
+ */
+
+#ifndef ADDRESS_TABLE_HH_INCLUDED
+#define ADDRESS_TABLE_HH_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+template<class Value>
+class AddressTable
+{
+public:
+	AddressTable() : slots(NULL), bits(0), count(0) { resize(10); }
+	~AddressTable() { free(slots); }
+
+	/*
+	 * Insert value for the address.
+	 *
+	 * If address is already in the table, replace value and return
+	 * true, storing previous value in 'old'.
+	 */
+	bool insert(uint64_t address, const Value& value, Value& old)
+	{
+		size_t i = find(address);
+		if(slots[i].address)
+		{
+			old = slots[i].value;
+			slots[i].value = value;
+			return true;
+		}
+		slots[i].address = address;
+		slots[i].value = value;
+		/* Load factor is kept not more than 1/2 */
+		if(++count * 2 > capacity()) resize(bits + 1);
+		return false;
+	}
+
+	/* Remove address from the table. Return false if it is not found. */
+	bool erase(uint64_t address)
+	{
+		size_t mask = capacity() - 1;
+		size_t i = find(address);
+		size_t j;
+		if(!slots[i].address) return false;
+
+		/* Shift back entries, which cannot be found after removing */
+		for(j = (i + 1) & mask; slots[j].address; j = (j + 1) & mask)
+		{
+			size_t home = hash(slots[j].address);
+			/* Whether 'home' is cyclically in (i, j] */
+			if(((j - home) & mask) < ((j - i) & mask)) continue;
+			slots[i] = slots[j];
+			i = j;
+		}
+		slots[i].address = 0;
+		count--;
+		return true;
+	}
+
+	/* Return value for the address, NULL if it is not found. */
+	const Value* lookup(uint64_t address) const
+	{
+		size_t i = find(address);
+		return slots[i].address ? &slots[i].value : NULL;
+	}
+
+	size_t size() const { return count; }
+
+	/* Append all values to 'values' (in unspecified order). */
+	void values(std::vector<Value>& values) const
+	{
+		for(size_t i = 0; i < capacity(); i++)
+			if(slots[i].address) values.push_back(slots[i].value);
+	}
+
+private:
+	AddressTable(const AddressTable&);
+	AddressTable& operator=(const AddressTable&);
+
+	struct Slot
+	{
+		uint64_t address;
+		Value value;
+	};
+
+	Slot* slots;
+	unsigned bits;
+	size_t count;
+
+	size_t capacity() const { return (size_t)1 << bits; }
+
+	/*
+	 * Fibonacci hashing: addresses are aligned, so their low bits are
+	 * not used directly.
+	 */
+	size_t hash(uint64_t address) const
+	{
+		return (size_t)((address * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+	}
+
+	/* Return slot with given address or empty slot where it should be. */
+	size_t find(uint64_t address) const
+	{
+		size_t mask = capacity() - 1;
+		size_t i;
+		for(i = hash(address); slots[i].address; i = (i + 1) & mask)
+			if(slots[i].address == address) break;
+		return i;
+	}
+
+	void resize(unsigned newBits)
+	{
+		Slot* oldSlots = slots;
+		size_t oldCapacity = oldSlots ? capacity() : 0;
+
+		slots = (Slot*)calloc((size_t)1 << newBits, sizeof(Slot));
+		if(slots == NULL) throw std::bad_alloc();
+		bits = newBits;
+
+		for(size_t i = 0; i < oldCapacity; i++)
+		{
+			if(!oldSlots[i].address) continue;
+			slots[find(oldSlots[i].address)] = oldSlots[i];
+		}
+		free(oldSlots);
+	}
+};
+
+#endif /* ADDRESS_TABLE_HH_INCLUDED */
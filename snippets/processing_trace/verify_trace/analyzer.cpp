@@ -0,0 +1,226 @@
+/* Implementation of the parallel analysis(see analyzer.hh). */
+
+#include "analyzer.hh"
+
+#include <string.h>
+#include <stdexcept>
+
+using namespace std;
+
+/* Size of the piece of the block for one worker */
+#define PIECE_SIZE (2 << 20)
+
+/*
+ * Shard for the address.
+ *
+ * Multiplier differs from the one used by AddressTable, so tables of
+ * the shards are filled uniformly.
+ */
+static inline unsigned shardOf(uint64_t address, unsigned nShards)
+{
+	return (unsigned)(((address * 0xff51afd7ed558ccdULL) >> 32) % nShards);
+}
+
+TraceAnalyzer::TraceAnalyzer(int fd, unsigned nThreads,
+	const VerifyOptions& options) : options(options), nThreads(nThreads),
+	reader(fd, (size_t)nThreads * PIECE_SIZE), workers(nThreads),
+	finished(false), failToParse("fail_to_parse.txt"), hasError(false)
+{
+	for(unsigned i = 0; i < nThreads; i++)
+	{
+		workers[i].analyzer = this;
+		workers[i].index = i;
+		workers[i].records.resize(nThreads);
+	}
+	/* Main thread reads the trace and waits at start and end */
+	pthread_barrier_init(&startBarrier, NULL, nThreads + 1);
+	pthread_barrier_init(&parsedBarrier, NULL, nThreads);
+	pthread_barrier_init(&endBarrier, NULL, nThreads + 1);
+	pthread_mutex_init(&errorMutex, NULL);
+}
+
+TraceAnalyzer::~TraceAnalyzer()
+{
+	pthread_barrier_destroy(&startBarrier);
+	pthread_barrier_destroy(&parsedBarrier);
+	pthread_barrier_destroy(&endBarrier);
+	pthread_mutex_destroy(&errorMutex);
+}
+
+void TraceAnalyzer::setError(const char* what)
+{
+	pthread_mutex_lock(&errorMutex);
+	if(!hasError)
+	{
+		error = what;
+		hasError = true;
+	}
+	pthread_mutex_unlock(&errorMutex);
+}
+
+void TraceAnalyzer::splitBlock(const TraceBlock& block)
+{
+	size_t start = 0;
+	for(unsigned i = 0; i < nThreads; i++)
+	{
+		size_t end = block.size * (i + 1) / nThreads;
+		if(end < start) end = start;
+		/* Pieces contain only whole lines */
+		if(end < block.size)
+		{
+			const char* newline = (const char*)memchr(block.data + end, '\n',
+				block.size - end);
+			end = newline ? (size_t)(newline + 1 - block.data) : block.size;
+		}
+		workers[i].piece.data = block.data + start;
+		workers[i].piece.size = end - start;
+		workers[i].piece.offset = block.offset + start;
+		start = end;
+	}
+}
+
+void TraceAnalyzer::parsePiece(Worker& worker)
+{
+	vector<Record> lineRecords;
+	TraceLine line;
+	size_t pos = 0;
+
+	while(worker.piece.nextLine(pos, line))
+	{
+		Token function = line.function();
+		lineRecords.clear();
+		if(function.empty()
+			|| !parseRecords(line, function, options, lineRecords))
+		{
+			worker.failed.push_back(line);
+			continue;
+		}
+		for(size_t i = 0; i < lineRecords.size(); i++)
+		{
+			worker.records[shardOf(lineRecords[i].address, nThreads)]
+				.push_back(lineRecords[i]);
+		}
+	}
+}
+
+void TraceAnalyzer::processShard(Worker& worker)
+{
+	/* Pieces are in order of the trace */
+	for(unsigned i = 0; i < nThreads; i++)
+	{
+		vector<Record>& records = workers[i].records[worker.index];
+		for(size_t j = 0; j < records.size(); j++)
+			worker.shard.apply(records[j]);
+		records.clear();
+	}
+	if(worker.index == 0)
+	{
+		for(unsigned i = 0; i < nThreads; i++)
+		{
+			vector<TraceLine>& failed = workers[i].failed;
+			for(size_t j = 0; j < failed.size(); j++)
+				failToParse.log(failed[j]);
+			failed.clear();
+		}
+	}
+}
+
+void* TraceAnalyzer::workerFunc(void* data)
+{
+	Worker& worker = *(Worker*)data;
+	TraceAnalyzer* analyzer = worker.analyzer;
+
+	for(;;)
+	{
+		pthread_barrier_wait(&analyzer->startBarrier);
+		if(analyzer->finished) break;
+
+		/* After error remaining blocks are skipped */
+		try
+		{
+			if(!analyzer->hasError) analyzer->parsePiece(worker);
+		}
+		catch(const exception& e)
+		{
+			analyzer->setError(e.what());
+		}
+		pthread_barrier_wait(&analyzer->parsedBarrier);
+		try
+		{
+			if(!analyzer->hasError) analyzer->processShard(worker);
+		}
+		catch(const exception& e)
+		{
+			analyzer->setError(e.what());
+		}
+		pthread_barrier_wait(&analyzer->endBarrier);
+	}
+	return NULL;
+}
+
+bool TraceAnalyzer::run()
+{
+	TraceBlock block;
+	bool hasBlock;
+	unsigned nStarted;
+	vector<ShardVerifier*> shards;
+
+	for(nStarted = 0; nStarted < nThreads; nStarted++)
+	{
+		if(pthread_create(&workers[nStarted].thread, NULL, workerFunc,
+			&workers[nStarted]))
+		{
+			setError("Cannot create worker thread.");
+			break;
+		}
+	}
+	if(nStarted < nThreads)
+	{
+		/* Barriers cannot be used, started workers are cancelled */
+		for(unsigned i = 0; i < nStarted; i++)
+		{
+			pthread_cancel(workers[i].thread);
+			pthread_join(workers[i].thread, NULL);
+		}
+		throw runtime_error(error);
+	}
+
+	try
+	{
+		hasBlock = reader.read(block);
+	}
+	catch(const exception& e)
+	{
+		setError(e.what());
+		hasBlock = false;
+	}
+	while(hasBlock)
+	{
+		splitBlock(block);
+		pthread_barrier_wait(&startBarrier);
+		/* Next block is read while workers process current one */
+		try
+		{
+			hasBlock = !hasError && reader.read(block);
+		}
+		catch(const exception& e)
+		{
+			setError(e.what());
+			hasBlock = false;
+		}
+		pthread_barrier_wait(&endBarrier);
+	}
+	finished = true;
+	pthread_barrier_wait(&startBarrier);
+	for(unsigned i = 0; i < nThreads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	if(hasError) throw runtime_error(error);
+
+	for(unsigned i = 0; i < nThreads; i++)
+	{
+		workers[i].shard.finish();
+		shards.push_back(&workers[i].shard);
+	}
+	return reportFindings(shards, LineStore(reader), options);
+}
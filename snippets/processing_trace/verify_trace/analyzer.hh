@@ -0,0 +1,89 @@
+/*
+ * Parallel analysis of the trace.
+ *
+ * The trace is read by blocks; every block is split into pieces, one
+ * per worker thread. Processing of the block has two phases:
+ *
+ * 1) Every worker parses its piece into records(see verifiers.hh) and
+ * routes them into buckets by hash of the address.
+ *
+ * 2) Every worker applies records of its own bucket from all pieces,
+ * in order of the pieces, to its ShardVerifier. So all records for
+ * one address are processed by one worker in order of the trace.
+ *
+ * While workers process the block, the next one is read. At the end
+ * findings of all shards are merged into one report.
+ */
+
+#ifndef ANALYZER_HH_INCLUDED
+#define ANALYZER_HH_INCLUDED
+
+#include "trace_reader.hh"
+#include "verifiers.hh"
+
+#include <pthread.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+class TraceAnalyzer
+{
+public:
+	/* Analyze trace from 'fd' with given number of threads. */
+	TraceAnalyzer(int fd, unsigned nThreads, const VerifyOptions& options);
+	~TraceAnalyzer();
+
+	/*
+	 * Process the trace and report inconsistencies.
+	 *
+	 * Return true if the trace is consistent.
+	 */
+	bool run();
+
+private:
+	TraceAnalyzer(const TraceAnalyzer&);
+	TraceAnalyzer& operator=(const TraceAnalyzer&);
+
+	struct Worker
+	{
+		TraceAnalyzer* analyzer;
+		unsigned index;
+		pthread_t thread;
+		/* Piece of the current block */
+		TraceBlock piece;
+		/* Records of the piece for every shard */
+		std::vector<std::vector<Record> > records;
+		/* Lines of the piece which failed to parse */
+		std::vector<TraceLine> failed;
+		ShardVerifier shard;
+	};
+
+	static void* workerFunc(void* data);
+	void parsePiece(Worker& worker);
+	void processShard(Worker& worker);
+	void splitBlock(const TraceBlock& block);
+	/* Record error from any thread; only first one is reported */
+	void setError(const char* what);
+
+	VerifyOptions options;
+	unsigned nThreads;
+	TraceReader reader;
+	std::vector<Worker> workers;
+
+	/* Workers start processing of the block or exit */
+	pthread_barrier_t startBarrier;
+	/* All pieces are parsed */
+	pthread_barrier_t parsedBarrier;
+	/* Block is processed */
+	pthread_barrier_t endBarrier;
+	bool finished;
+
+	LogFile failToParse;
+
+	pthread_mutex_t errorMutex;
+	std::string error;
+	/* Whether 'error' is set, may be checked without lock */
+	std::atomic<bool> hasError;
+};
+
+#endif /* ANALYZER_HH_INCLUDED */
@@ -0,0 +1,110 @@
+/*
+ * verify_trace - verify consistency of allocations and locks in the
+ * trace from call monitoring.
+ *
+ * Replacement for scripts/verify_allocations.pl and scripts/verify_locks.pl:
+ * same trace format and same output files, but the trace is processed in
+ * one pass with constant memory per live allocation or lock.
+ *
+ * Parsing and verification are performed by several threads in parallel
+ * (see analyzer.hh).
+ */
+
+#include "analyzer.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+static void usage(const char* programName)
+{
+	cerr << "Usage: " << programName << " [--allocations] [--locks] "
+		<< "[--jobs <n>] [trace-file]" << endl << endl
+		<< "Verify consistency of the trace from call monitoring." << endl
+		<< "Without options, both allocations and locks are verified." << endl
+		<< "Trace is processed by 'n' threads, by default by one per CPU." << endl
+		<< "If 'trace-file' is not given, trace is read from stdin." << endl;
+}
+
+int main(int argc, char** argv)
+{
+	static const struct option longOptions[] =
+	{
+		{"allocations", no_argument, NULL, 'a'},
+		{"locks", no_argument, NULL, 'l'},
+		{"jobs", required_argument, NULL, 'j'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	VerifyOptions options = {false, false};
+	long nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt, fd = 0, result;
+
+	while((opt = getopt_long(argc, argv, "alj:h", longOptions, NULL)) != -1)
+	{
+		switch(opt)
+		{
+		case 'a':
+			options.allocations = true;
+			break;
+		case 'l':
+			options.locks = true;
+			break;
+		case 'j':
+			nThreads = atol(optarg);
+			if(nThreads <= 0 || nThreads > 1024)
+			{
+				cerr << "Number of threads should be from 1 to 1024." << endl;
+				return 2;
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if(!options.allocations && !options.locks)
+		options.allocations = options.locks = true;
+	if(nThreads <= 0) nThreads = 1;
+
+	if(optind + 1 < argc)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+	if(optind < argc)
+	{
+		fd = open(argv[optind], O_RDONLY);
+		if(fd == -1)
+		{
+			cerr << "Cannot open trace file '" << argv[optind] << "': "
+				<< strerror(errno) << endl;
+			return 2;
+		}
+	}
+
+	try
+	{
+		TraceAnalyzer analyzer(fd, nThreads, options);
+		result = analyzer.run() ? 0 : 1;
+	}
+	catch(const exception& e)
+	{
+		cerr << e.what() << endl;
+		result = 2;
+	}
+	if(fd) close(fd);
+	return result;
+}
@@ -0,0 +1,127 @@
+/* Parsing of the trace lines(see trace_line.hh). */
+
+#include "trace_line.hh"
+
+#include <string.h>
+
+/* Character which may be part of the word(\w in regular expressions) */
+static inline bool isWordChar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+		|| (c >= '0' && c <= '9') || (c == '_');
+}
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static const char nullToken[] = "(null)";
+
+bool Token::operator==(const char* str) const
+{
+	return (strlen(str) == len) && (memcmp(start, str, len) == 0);
+}
+
+/*
+ * Search 'pattern' in [start, end). Return pointer after the pattern,
+ * or NULL if not found.
+ */
+static const char* findAfter(const char* start, const char* end,
+	const char* pattern, size_t patternLen)
+{
+	const char* found = (const char*)memmem(start, end - start,
+		pattern, patternLen);
+	return found ? found + patternLen : NULL;
+}
+
+/* Read word or "(null)" starting at 'pos'. */
+static Token readValue(const char* pos, const char* end)
+{
+	const char* start = pos;
+	if((size_t)(end - pos) >= sizeof(nullToken) - 1
+		&& memcmp(pos, nullToken, sizeof(nullToken) - 1) == 0)
+		return Token(pos, sizeof(nullToken) - 1);
+
+	while(pos < end && isWordChar(*pos)) pos++;
+	return Token(start, pos - start);
+}
+
+static const char* skipSpaces(const char* pos, const char* end)
+{
+	while(pos < end && isSpace(*pos)) pos++;
+	return pos;
+}
+
+Token TraceLine::function() const
+{
+	static const char pattern[] = "called_";
+	const char* end = text + len;
+	const char* start = findAfter(text, end, pattern, sizeof(pattern) - 1);
+	const char* pos;
+
+	if(start == NULL) return Token();
+	for(pos = start; pos < end && isWordChar(*pos); pos++);
+	return Token(start, pos - start);
+}
+
+Token TraceLine::argument(int index) const
+{
+	static const char pattern[] = "arguments:";
+	const char* end = text + len;
+	const char* pos = findAfter(text, end, pattern, sizeof(pattern) - 1);
+	Token value;
+
+	if(pos == NULL) return Token();
+	pos = skipSpaces(pos, end);
+	if(pos == end || *pos != '(') return Token();
+	pos++;
+
+	for(;;)
+	{
+		value = readValue(pos, end);
+		if(value.empty() || index-- == 0) break;
+		pos = value.start + value.len;
+		if(pos == end || *pos != ',') return Token();
+		pos = skipSpaces(pos + 1, end);
+	}
+	return value;
+}
+
+Token TraceLine::result() const
+{
+	static const char pattern[] = "result:";
+	const char* end = text + len;
+	const char* pos = findAfter(text, end, pattern, sizeof(pattern) - 1);
+
+	if(pos == NULL) return Token();
+	return readValue(skipSpaces(pos, end), end);
+}
+
+bool parseAddress(const Token& token, uint64_t& address)
+{
+	const char* pos = token.start;
+	const char* end = token.start + token.len;
+
+	if(token == nullToken)
+	{
+		address = 0;
+		return true;
+	}
+	if(end - pos > 2 && pos[0] == '0' && (pos[1] == 'x' || pos[1] == 'X'))
+		pos += 2;
+	if(pos == end || end - pos > 16) return false;
+
+	address = 0;
+	for(; pos < end; pos++)
+	{
+		char c = *pos;
+		unsigned digit;
+		if(c >= '0' && c <= '9') digit = c - '0';
+		else if(c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+		else if(c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+		else return false;
+		address = (address << 4) | digit;
+	}
+	return true;
+}
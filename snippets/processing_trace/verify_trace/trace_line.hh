@@ -0,0 +1,58 @@
+/* Lines of the trace from call monitoring and their parsing. */
+
+#ifndef TRACE_LINE_HH_INCLUDED
+#define TRACE_LINE_HH_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/* Part of the line(not null-terminated). */
+struct Token
+{
+	const char* start;
+	size_t len;
+
+	Token() : start(NULL), len(0) {}
+	Token(const char* start, size_t len) : start(start), len(len) {}
+
+	bool empty() const { return len == 0; }
+	bool operator==(const char* str) const;
+	std::string str() const { return std::string(start, len); }
+};
+
+/*
+ * Line of the trace, without new-line symbol.
+ *
+ * Line looks like
+ *
+ * <task>-<pid> [<cpu>] <time>: called_<function>: arguments: (<arg>, ...), result: <result>
+ */
+struct TraceLine
+{
+	const char* text;
+	size_t len;
+	/* Offset of the line in the trace */
+	uint64_t offset;
+
+	/* Name of the function after 'called_', empty if there is none. */
+	Token function() const;
+	/*
+	 * Argument with given index(from 0): word or "(null)".
+	 *
+	 * Return empty token if there is no such argument.
+	 */
+	Token argument(int index) const;
+	/* Result of the function: word or "(null)", empty if there is none. */
+	Token result() const;
+};
+
+/*
+ * Parse address in the trace: hexadecimal number or "(null)", which
+ * is returned as 0.
+ *
+ * Return false if token is not an address.
+ */
+bool parseAddress(const Token& token, uint64_t& address);
+
+#endif /* TRACE_LINE_HH_INCLUDED */
@@ -0,0 +1,136 @@
+/* Implementation of TraceReader and LineStore(see trace_reader.hh). */
+
+#include "trace_reader.hh"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <stdexcept>
+#include <new>
+
+using namespace std;
+
+TraceReader::TraceReader(int fd, size_t blockSize) : traceFd(fd),
+	spool(NULL), current(0), tail(0), tailEnd(0), offset(0), eof(false)
+{
+	struct stat st;
+	bool seekable = (fstat(fd, &st) == 0) && S_ISREG(st.st_mode)
+		&& (lseek(fd, 0, SEEK_CUR) == 0);
+
+	bufs[0] = bufs[1] = NULL;
+	for(int i = 0; i < 2; i++)
+	{
+		bufs[i] = (char*)malloc(blockSize);
+		bufSizes[i] = blockSize;
+		if(bufs[i] == NULL)
+		{
+			free(bufs[0]);
+			throw bad_alloc();
+		}
+	}
+	if(!seekable)
+	{
+		spool = tmpfile();
+		if(spool == NULL)
+		{
+			free(bufs[0]);
+			free(bufs[1]);
+			throw runtime_error("Cannot create temporary file for the trace.");
+		}
+	}
+}
+
+TraceReader::~TraceReader()
+{
+	free(bufs[0]);
+	free(bufs[1]);
+	if(spool) fclose(spool);
+}
+
+bool TraceReader::read(TraceBlock& block)
+{
+	char* buf = bufs[current];
+	char* prev = bufs[current ^ 1];
+	size_t end = tailEnd - tail;
+	/* End of the last whole line in the buffer, 0 if none */
+	size_t linesEnd = 0;
+
+	/* Incomplete line from the previous block */
+	if(end >= bufSizes[current])
+	{
+		free(buf);
+		bufs[current] = buf = (char*)malloc(bufSizes[current ^ 1]);
+		if(buf == NULL) throw bad_alloc();
+		bufSizes[current] = bufSizes[current ^ 1];
+	}
+	memcpy(buf, prev + tail, end);
+
+	while(!eof)
+	{
+		ssize_t size;
+		const char* newline;
+		if(end == bufSizes[current])
+		{
+			/* Line is longer than the buffer */
+			char* newBuf = (char*)realloc(buf, bufSizes[current] * 2);
+			if(newBuf == NULL) throw bad_alloc();
+			bufs[current] = buf = newBuf;
+			bufSizes[current] *= 2;
+		}
+
+		size = ::read(traceFd, buf + end, bufSizes[current] - end);
+		if(size == -1)
+		{
+			if(errno == EINTR) continue;
+			throw runtime_error(string("Failed to read trace: ")
+				+ strerror(errno));
+		}
+		if(size == 0)
+		{
+			eof = true;
+			break;
+		}
+		newline = (const char*)memrchr(buf + end, '\n', size);
+		if(newline) linesEnd = newline + 1 - buf;
+		end += size;
+		/* Fill the buffer, but only whole lines are needed */
+		if(linesEnd && end == bufSizes[current]) break;
+	}
+
+	block.data = buf;
+	/* Last line of the trace may have no new-line symbol */
+	block.size = eof ? end : linesEnd;
+	block.offset = offset;
+	tail = block.size;
+	tailEnd = end;
+	offset += block.size;
+	current ^= 1;
+
+	if(spool && block.size
+		&& fwrite(block.data, 1, block.size, spool) != block.size)
+		throw runtime_error("Cannot write trace to the temporary file.");
+	if(spool && eof && fflush(spool))
+		throw runtime_error("Cannot write trace to the temporary file.");
+
+	return block.size != 0;
+}
+
+string LineStore::get(const LineRef& ref) const
+{
+	string line(ref.len, '\0');
+	size_t done = 0;
+
+	while(done < ref.len)
+	{
+		ssize_t size = pread(fd, &line[done], ref.len - done,
+			ref.offset + done);
+		if(size == -1 && errno == EINTR) continue;
+		if(size <= 0)
+			throw runtime_error("Cannot reread line of the trace.");
+		done += size;
+	}
+	return line;
+}
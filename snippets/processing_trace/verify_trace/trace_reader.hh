@@ -0,0 +1,108 @@
+/* Reading of the trace by large blocks and rereading of the lines. */
+
+#ifndef TRACE_READER_HH_INCLUDED
+#define TRACE_READER_HH_INCLUDED
+
+#include "trace_line.hh"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/* Part of the trace, which contains only whole lines. */
+struct TraceBlock
+{
+	const char* data;
+	size_t size;
+	/* Offset of the block in the trace */
+	uint64_t offset;
+
+	/*
+	 * Extract line, which starts at 'pos', and move 'pos' to the next
+	 * line. Return false if there are no more lines.
+	 */
+	bool nextLine(size_t& pos, TraceLine& line) const
+	{
+		const char* newline;
+		if(pos >= size) return false;
+
+		newline = (const char*)memchr(data + pos, '\n', size - pos);
+		line.text = data + pos;
+		line.len = (newline ? newline - data : size) - pos;
+		line.offset = offset + pos;
+		pos += line.len + 1;
+		return true;
+	}
+};
+
+/*
+ * Read trace by blocks with whole lines, without copying lines.
+ *
+ * Reader uses two buffers in turn, so block returned stays valid while
+ * the next block is read: one thread may read the trace while others
+ * process previous block.
+ *
+ * If the trace cannot be reread(e.g., it comes from the pipe), it is
+ * copied into temporary file while read.
+ */
+class TraceReader
+{
+public:
+	/* Read trace from the file descriptor(not closed by the reader). */
+	TraceReader(int fd, size_t blockSize);
+	~TraceReader();
+
+	/*
+	 * Read next block. Block returned at the previous call remains valid.
+	 *
+	 * Return false at the end of the trace.
+	 */
+	bool read(TraceBlock& block);
+
+	/* Descriptor from which lines may be reread using their offsets. */
+	int linesFd() const { return spool ? fileno(spool) : traceFd; }
+
+private:
+	TraceReader(const TraceReader&);
+	TraceReader& operator=(const TraceReader&);
+
+	int traceFd;
+	FILE* spool;
+
+	char* bufs[2];
+	size_t bufSizes[2];
+	/* Buffer for the next block */
+	int current;
+	/* Incomplete line at the end of the last block is [tail, tailEnd) */
+	size_t tail;
+	size_t tailEnd;
+	/* Offset in the trace of the next block */
+	uint64_t offset;
+	bool eof;
+};
+
+/* Reference to the line of the trace. */
+struct LineRef
+{
+	uint64_t offset;
+	uint32_t len;
+};
+
+/*
+ * Rereading of the lines, which should be reported at the end.
+ *
+ * Only reference to the line is kept in memory while the trace is read.
+ * Lines are thread-safe to reread.
+ */
+class LineStore
+{
+public:
+	explicit LineStore(const TraceReader& reader) : fd(reader.linesFd()) {}
+
+	std::string get(const LineRef& ref) const;
+
+private:
+	int fd;
+};
+
+#endif /* TRACE_READER_HH_INCLUDED */
@@ -0,0 +1,302 @@
+/* Implementation of the verifications(see verifiers.hh). */
+
+#include "verifiers.hh"
+
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+/* Functions are searched in small tables by their names. */
+struct FunctionInfo
+{
+	const char* name;
+	int kind;
+};
+
+static int functionKind(const FunctionInfo* functions, const Token& function)
+{
+	for(; functions->name; functions++)
+		if(function == functions->name) return functions->kind;
+	return 0;
+}
+
+enum
+{
+	/* Address of allocated memory is the result */
+	ALLOC_RESULT = 1,
+	/* Address of freed memory is the first argument */
+	FREE_ARG0 = 2,
+	/* Address of freed memory is the second argument */
+	FREE_ARG1 = 4,
+};
+
+static const FunctionInfo allocationFunctions[] =
+{
+	{"__kmalloc", ALLOC_RESULT},
+	{"krealloc", FREE_ARG0 | ALLOC_RESULT},
+	{"kmem_cache_alloc", ALLOC_RESULT},
+	{"kmem_cache_alloc_notrace", ALLOC_RESULT},
+	{"__get_free_pages", ALLOC_RESULT},
+	{"kstrdup", ALLOC_RESULT},
+	{"kfree", FREE_ARG0},
+	{"kmem_cache_free", FREE_ARG1},
+	{"free_pages", FREE_ARG0},
+	{NULL, 0}
+};
+
+enum
+{
+	SPIN_LOCK_IRQSAVE = 1,
+	SPIN_UNLOCK_IRQRESTORE,
+	MUTEX_LOCK,
+	MUTEX_TRYLOCK,
+	MUTEX_UNLOCK,
+};
+
+static const FunctionInfo lockFunctions[] =
+{
+	{"_spin_lock_irqsave", SPIN_LOCK_IRQSAVE},
+	{"_raw_spin_lock_irqsave", SPIN_LOCK_IRQSAVE},
+	{"_spin_unlock_irqrestore", SPIN_UNLOCK_IRQRESTORE},
+	{"_raw_spin_unlock_irqrestore", SPIN_UNLOCK_IRQRESTORE},
+	{"mutex_lock", MUTEX_LOCK},
+	{"mutex_lock_interruptible", MUTEX_LOCK},
+	{"mutex_trylock", MUTEX_TRYLOCK},
+	{"mutex_try_lock", MUTEX_TRYLOCK},
+	{"mutex_unlock", MUTEX_UNLOCK},
+	{NULL, 0}
+};
+
+static void addRecord(const TraceLine& line, uint64_t address,
+	RecordType type, vector<Record>& records)
+{
+	Record record;
+	record.address = address;
+	record.line.offset = line.offset;
+	record.line.len = line.len;
+	record.type = type;
+	records.push_back(record);
+}
+
+static bool parseAllocationRecords(const TraceLine& line, int kind,
+	vector<Record>& records)
+{
+	uint64_t address;
+
+	/* For krealloc() free goes before allocation */
+	if(kind & (FREE_ARG0 | FREE_ARG1))
+	{
+		if(!parseAddress(line.argument((kind & FREE_ARG0) ? 0 : 1), address))
+			return false;
+		if(address) addRecord(line, address, RECORD_FREE, records);
+	}
+	if(kind & ALLOC_RESULT)
+	{
+		if(!parseAddress(line.result(), address))
+			return false;
+		if(address) addRecord(line, address, RECORD_ALLOC, records);
+	}
+	return true;
+}
+
+static bool parseLockRecords(const TraceLine& line, int kind,
+	vector<Record>& records)
+{
+	uint64_t address;
+	Token result;
+
+	if(!parseAddress(line.argument(0), address) || !address)
+		return false;
+
+	switch(kind)
+	{
+	case SPIN_LOCK_IRQSAVE:
+		addRecord(line, address, RECORD_SPIN_LOCK, records);
+		break;
+	case SPIN_UNLOCK_IRQRESTORE:
+		addRecord(line, address, RECORD_SPIN_UNLOCK, records);
+		break;
+	case MUTEX_TRYLOCK:
+		result = line.result();
+		if(result.empty()) return false;
+		/* Mutex is not locked */
+		if(result == "0") break;
+		addRecord(line, address, RECORD_MUTEX_LOCK, records);
+		break;
+	case MUTEX_LOCK:
+		addRecord(line, address, RECORD_MUTEX_LOCK, records);
+		break;
+	case MUTEX_UNLOCK:
+		addRecord(line, address, RECORD_MUTEX_UNLOCK, records);
+		break;
+	}
+	return true;
+}
+
+bool parseRecords(const TraceLine& line, const Token& function,
+	const VerifyOptions& options, vector<Record>& records)
+{
+	int kind;
+
+	if(options.allocations
+		&& (kind = functionKind(allocationFunctions, function)))
+		return parseAllocationRecords(line, kind, records);
+	if(options.locks && (kind = functionKind(lockFunctions, function)))
+		return parseLockRecords(line, kind, records);
+	return true;
+}
+
+/********************* ShardVerifier methods ****************************/
+
+static void addFinding(vector<Finding>& findings, uint64_t order,
+	const LineRef& line)
+{
+	Finding finding;
+	finding.order = order;
+	finding.line = line;
+	findings.push_back(finding);
+}
+
+void ShardVerifier::lock(AddressTable<LineRef>& locked, const Record& record,
+	FindingType type)
+{
+	LineRef old;
+	if(locked.insert(record.address, record.line, old))
+		addFinding(findings[type], record.line.offset, old);
+}
+
+void ShardVerifier::unlock(AddressTable<LineRef>& locked, const Record& record,
+	FindingType type)
+{
+	if(!locked.erase(record.address))
+		addFinding(findings[type], record.line.offset, record.line);
+}
+
+void ShardVerifier::apply(const Record& record)
+{
+	/* Allocation and free are verified as lock and unlock */
+	switch(record.type)
+	{
+	case RECORD_ALLOC:
+		lock(allocated, record, UNFREED_ALLOCATION);
+		break;
+	case RECORD_FREE:
+		unlock(allocated, record, UNALLOCATED_FREE);
+		break;
+	case RECORD_SPIN_LOCK:
+		lock(spinLocked, record, INCONSISTENT_LOCK);
+		break;
+	case RECORD_SPIN_UNLOCK:
+		unlock(spinLocked, record, INCONSISTENT_UNLOCK);
+		break;
+	case RECORD_MUTEX_LOCK:
+		lock(mutexLocked, record, INCONSISTENT_LOCK);
+		break;
+	case RECORD_MUTEX_UNLOCK:
+		unlock(mutexLocked, record, INCONSISTENT_UNLOCK);
+		break;
+	}
+}
+
+static void addRemained(const AddressTable<LineRef>& table,
+	vector<Finding>& findings)
+{
+	vector<LineRef> refs;
+	table.values(refs);
+	for(size_t i = 0; i < refs.size(); i++)
+		addFinding(findings, FINDING_AT_END | refs[i].offset, refs[i]);
+}
+
+void ShardVerifier::finish()
+{
+	addRemained(allocated, findings[UNFREED_ALLOCATION]);
+	addRemained(spinLocked, findings[INCONSISTENT_LOCK]);
+	addRemained(mutexLocked, findings[INCONSISTENT_LOCK]);
+}
+
+/********************* LogFile methods ****************************/
+LogFile::~LogFile()
+{
+	if(f) fclose(f);
+}
+
+void LogFile::log(const char* text, size_t len)
+{
+	/* Lazy initialization */
+	if(f == NULL)
+	{
+		f = fopen(filename, "w");
+		if(f == NULL)
+			throw runtime_error(string("Cannot open file '") + filename + "'.");
+	}
+	fwrite(text, 1, len, f);
+	fputc('\n', f);
+}
+
+/********************* Report ****************************/
+
+static bool findingLess(const Finding& a, const Finding& b)
+{
+	return a.order < b.order;
+}
+
+/*
+ * Log findings of given type from all shards in order.
+ *
+ * Return number of findings.
+ */
+static size_t logFindings(const vector<ShardVerifier*>& shards,
+	FindingType type, const LineStore& store, LogFile& log)
+{
+	vector<Finding> findings;
+	for(size_t i = 0; i < shards.size(); i++)
+		findings.insert(findings.end(), shards[i]->findings[type].begin(),
+			shards[i]->findings[type].end());
+	sort(findings.begin(), findings.end(), findingLess);
+
+	for(size_t i = 0; i < findings.size(); i++)
+		log.log(store.get(findings[i].line));
+	return findings.size();
+}
+
+bool reportFindings(const vector<ShardVerifier*>& shards,
+	const LineStore& store, const VerifyOptions& options)
+{
+	bool consistent = true;
+
+	if(options.allocations)
+	{
+		LogFile unfreedLog("unfreed_allocations.txt");
+		LogFile unallocatedLog("unallocated_frees.txt");
+		size_t n = logFindings(shards, UNFREED_ALLOCATION, store, unfreedLog)
+			+ logFindings(shards, UNALLOCATED_FREE, store, unallocatedLog);
+		if(n)
+		{
+			printf("Trace is inconsistent.\n");
+			printf("Files \"%s\" and \"%s\" contains lists of inconsitent calls.\n",
+				unfreedLog.name(), unallocatedLog.name());
+			consistent = false;
+		}
+		else
+			printf("Trace is consistent.\n");
+	}
+	if(options.locks)
+	{
+		LogFile locksLog("inconsistent_locks.txt");
+		LogFile unlocksLog("inconsistent_unlocks.txt");
+		size_t n = logFindings(shards, INCONSISTENT_LOCK, store, locksLog)
+			+ logFindings(shards, INCONSISTENT_UNLOCK, store, unlocksLog);
+		if(n)
+		{
+			printf("Locks are inconsistent.\n");
+			printf("Files \"%s\" and \"%s\" contains lists of inconsitent calls.\n",
+				locksLog.name(), unlocksLog.name());
+			consistent = false;
+		}
+		else
+			printf("Trace is consistent.\n");
+	}
+	return consistent;
+}
@@ -0,0 +1,144 @@
+/*
+ * Verifications of the trace.
+ *
+ * Same as ones performed by scripts/verify_allocations.pl and
+ * scripts/verify_locks.pl, and with same output files.
+ *
+ * Every verification concerns only calls with the same address(of the
+ * memory block or of the lock), so lines of the trace are converted into
+ * records with address, and records may be processed independently by
+ * several ShardVerifier objects, each for its own subset of addresses.
+ * Inconsistencies found by them are then merged by the report.
+ */
+
+#ifndef VERIFIERS_HH_INCLUDED
+#define VERIFIERS_HH_INCLUDED
+
+#include "trace_line.hh"
+#include "trace_reader.hh"
+#include "address_table.hh"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/* Which verifications are performed */
+struct VerifyOptions
+{
+	bool allocations;
+	bool locks;
+};
+
+enum RecordType
+{
+	RECORD_ALLOC,
+	RECORD_FREE,
+	RECORD_SPIN_LOCK,
+	RECORD_SPIN_UNLOCK,
+	RECORD_MUTEX_LOCK,
+	RECORD_MUTEX_UNLOCK,
+};
+
+/* Operation with the address, extracted from the line of the trace. */
+struct Record
+{
+	uint64_t address;
+	/* The line, from which record is extracted */
+	LineRef line;
+	RecordType type;
+};
+
+/*
+ * Extract records from the line with given function name.
+ *
+ * Return false if line cannot be parsed.
+ */
+bool parseRecords(const TraceLine& line, const Token& function,
+	const VerifyOptions& options, std::vector<Record>& records);
+
+enum FindingType
+{
+	UNFREED_ALLOCATION,
+	UNALLOCATED_FREE,
+	INCONSISTENT_LOCK,
+	INCONSISTENT_UNLOCK,
+	FINDING_TYPES
+};
+
+/* Inconsistent call. */
+struct Finding
+{
+	/*
+	 * Findings are reported in increasing order of this field: offset
+	 * of the line where inconsistency is detected, or, for calls
+	 * remained unpaired at the end of the trace, FINDING_AT_END plus
+	 * offset of the call itself.
+	 */
+	uint64_t order;
+	/* Line which is reported */
+	LineRef line;
+};
+
+#define FINDING_AT_END (1ULL << 63)
+
+/*
+ * Verifications for the part of addresses.
+ *
+ * Records for every address should be applied in order of the trace.
+ */
+class ShardVerifier
+{
+public:
+	void apply(const Record& record);
+	/* Record calls remained unpaired at the end of the trace. */
+	void finish();
+
+	std::vector<Finding> findings[FINDING_TYPES];
+
+private:
+	/* Address -> line with allocation */
+	AddressTable<LineRef> allocated;
+	/* Address of the lock -> line where it is locked */
+	AddressTable<LineRef> spinLocked;
+	AddressTable<LineRef> mutexLocked;
+
+	void lock(AddressTable<LineRef>& locked, const Record& record,
+		FindingType type);
+	void unlock(AddressTable<LineRef>& locked, const Record& record,
+		FindingType type);
+};
+
+/*
+ * File for logging lines. As with log_to_file() of the scripts, file is
+ * created(or truncated) at the first write.
+ */
+class LogFile
+{
+public:
+	explicit LogFile(const char* filename) : filename(filename), f(NULL) {}
+	~LogFile();
+
+	void log(const char* text, size_t len);
+	void log(const std::string& line) { log(line.data(), line.size()); }
+	void log(const TraceLine& line) { log(line.text, line.len); }
+
+	const char* name() const { return filename; }
+
+private:
+	LogFile(const LogFile&);
+	LogFile& operator=(const LogFile&);
+
+	const char* filename;
+	FILE* f;
+};
+
+/*
+ * Merge findings of all shards, write them into output files and print
+ * result of every verification.
+ *
+ * Return true if the trace is consistent.
+ */
+bool reportFindings(const std::vector<ShardVerifier*>& shards,
+	const LineStore& store, const VerifyOptions& options);
+
+#endif /* VERIFIERS_HH_INCLUDED */
@@ -0,0 +1,133 @@
+/*
+ * Read trace by whole pages from 'trace_raw' directory and
+ * output merged messages or statistic about them.
+ *
+ * Usage: rb_consume [-n] [-s] <dir>
+ *
+ * -n - do not wait for new messages, exit when the trace is empty;
+ * -s - instead of messages, output statistic about them at exit.
+ *
+ * Messages are output as strings, as written by rb_test module.
+ * Reading may be interrupted by Ctrl+C.
+ */
+#include "trace_consumer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static volatile sig_atomic_t is_interrupted = 0;
+
+static void interrupt_handler(int sig)
+{
+    (void)sig;
+    is_interrupted = 1;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-n] [-s] <dir>\n", name);
+}
+
+static double current_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char** argv)
+{
+    int opt;
+    int should_wait = 1;
+    int only_statistic = 0;
+    struct trace_consumer* consumer;
+    struct trace_consumer_message message;
+    struct sigaction sa;
+    int result = 0;
+
+    unsigned long long messages = 0, bytes = 0;
+    unsigned long long unordered = 0;
+    uint64_t last_ts = 0;
+    double start;
+
+    while((opt = getopt(argc, argv, "ns")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            should_wait = 0;
+            break;
+        case 's':
+            only_statistic = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    consumer = trace_consumer_create(argv[optind]);
+    if(consumer == NULL)
+    {
+        fprintf(stderr, "Cannot open trace in '%s': %s\n",
+            argv[optind], strerror(errno));
+        return 1;
+    }
+
+    // Interrupt waiting in poll(), do not restart it
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = interrupt_handler;
+    sigaction(SIGINT, &sa, NULL);
+
+    start = current_time();
+    while(!is_interrupted)
+    {
+        result = trace_consumer_read_message(consumer, &message, should_wait);
+        if(result <= 0)
+            break;
+
+        messages++;
+        bytes += message.size;
+        if(message.ts < last_ts)
+            unordered++;
+        last_ts = message.ts;
+
+        if(!only_statistic)
+        {
+            unsigned long sec = (unsigned long)(message.ts / 1000000000);
+            unsigned usec = (unsigned)(message.ts % 1000000000 / 1000);
+
+            printf("[%.03d]\t%.6lu.%.06u:\t%.*s\n", message.cpu, sec, usec,
+                (int)strnlen(message.msg, message.size),
+                (const char*)message.msg);
+        }
+    }
+    if((result < 0) && (result != -EINTR))
+        fprintf(stderr, "Error while reading the trace: %s\n",
+            strerror(-result));
+
+    if(only_statistic)
+    {
+        double elapsed = current_time() - start;
+        printf("messages: %llu\n", messages);
+        printf("bytes: %llu\n", bytes);
+        printf("pages: %lu\n", trace_consumer_pages_read(consumer));
+        printf("unordered messages: %llu\n", unordered);
+        printf("time: %.3f s\n", elapsed);
+        if(elapsed > 0)
+            printf("rate: %.0f messages/s\n", messages / elapsed);
+    }
+
+    trace_consumer_destroy(consumer);
+    return ((result < 0) && (result != -EINTR)) ? 1 : 0;
+}
@@ -0,0 +1,451 @@
+/*
+ * Implementation of the 'trace_consumer' API.
+ */
+#include "trace_consumer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+
+/*
+ * Format of the page of the kernel ring buffer.
+ *
+ * Page starts with header:
+ *
+ * u64 time_stamp - timestamp of the page,
+ * long commit - size of the data after the header.
+ *
+ * Header is followed by the events, aligned on 4 bytes. Every event
+ * starts with 32-bit word, lower 5 bits of which is 'type_len' and
+ * others 27 bits is 'time_delta' (delta from the timestamp of the
+ * previous event).
+ */
+#define PAGE_HEADER_SIZE (sizeof(uint64_t) + sizeof(long))
+// Upper bits of the 'commit' field may be used by kernel for flags
+#define PAGE_COMMIT_MASK ((1UL << 27) - 1)
+
+#define EVENT_ALIGNMENT 4
+#define EVENT_TS_SHIFT 27
+
+// Values of 'type_len' with special meaning
+#define EVENT_TYPE_DATA_TYPE_LEN_MAX 28
+#define EVENT_TYPE_PADDING 29
+#define EVENT_TYPE_TIME_EXTEND 30
+#define EVENT_TYPE_TIME_STAMP 31
+
+// Size of the TIME_STAMP event
+#define EVENT_TIME_STAMP_SIZE 16
+
+/*
+ * Number of pages, which is requested from per-cpu file at once.
+ */
+#define PAGES_PER_READ 16
+
+/*
+ * Per-cpu stream of messages.
+ */
+struct trace_stream
+{
+    int cpu;
+    int fd;
+    // Pages which are read, but not consumed yet.
+    char* buf;
+    size_t buf_size;// size of data read into 'buf'
+    size_t page_offset;// offset of the current page in 'buf'
+    size_t pos;// offset of the next event in the current page
+    size_t page_end;// end of the data in the current page
+    uint64_t page_ts;// timestamp of the last event processed
+    // Current message of the stream, if 'has_message' is not 0
+    int has_message;
+    struct trace_consumer_message message;
+    /*
+     * Round, at which the stream was read last time.
+     *
+     * When stream has no messages, every message which will appear
+     * in it has been written after that round. So message from
+     * other stream, which has been read at the earlier round,
+     * may be returned without reading this stream again.
+     */
+    unsigned long long round;
+    // Whether end of file is reached
+    int is_finished;
+};
+
+struct trace_consumer
+{
+    struct trace_stream* streams;
+    int n_streams;
+    size_t page_size;
+    // Counter of read attempts, used for ordering messages.
+    unsigned long long round;
+    unsigned long pages_read;
+    // Stream, message from which was returned last time
+    struct trace_stream* last;
+};
+
+/*
+ * Move to the next page in the buffer of the stream.
+ *
+ * Return 0 if there are no more pages.
+ */
+static int trace_stream_next_page(struct trace_stream* stream,
+    size_t page_size)
+{
+    const char* page = stream->buf + stream->page_offset;
+    uint64_t time_stamp;
+    unsigned long commit;
+
+    if(stream->page_offset + page_size > stream->buf_size)
+        return 0;
+
+    memcpy(&time_stamp, page, sizeof(time_stamp));
+    memcpy(&commit, page + sizeof(time_stamp), sizeof(commit));
+    commit &= PAGE_COMMIT_MASK;
+    if(commit > page_size - PAGE_HEADER_SIZE)
+        commit = page_size - PAGE_HEADER_SIZE;
+
+    stream->page_ts = time_stamp;
+    stream->pos = PAGE_HEADER_SIZE;
+    stream->page_end = PAGE_HEADER_SIZE + commit;
+    return 1;
+}
+
+/*
+ * Extract next message from the pages already read.
+ *
+ * Return 0 if there are no more messages.
+ */
+static int trace_stream_next_message(struct trace_stream* stream,
+    size_t page_size)
+{
+    stream->has_message = 0;
+    if(stream->buf_size == 0)
+        return 0;
+
+    while(1)
+    {
+        const char* page = stream->buf + stream->page_offset;
+        uint32_t header, array0;
+        unsigned type_len;
+        uint32_t time_delta;
+        size_t length;
+
+        if(stream->pos + sizeof(header) > stream->page_end)
+        {
+            // Current page is over
+            stream->page_offset += page_size;
+            if(!trace_stream_next_page(stream, page_size))
+            {
+                stream->buf_size = 0;
+                return 0;
+            }
+            continue;
+        }
+
+        memcpy(&header, page + stream->pos, sizeof(header));
+        type_len = header & ((1 << 5) - 1);
+        time_delta = header >> 5;
+        if(stream->pos + sizeof(header) + sizeof(array0) <= stream->page_end)
+            memcpy(&array0, page + stream->pos + sizeof(header), sizeof(array0));
+        else
+            array0 = 0;
+
+        switch(type_len)
+        {
+        case EVENT_TYPE_PADDING:
+            if(time_delta == 0)
+            {
+                // Rest of the page is unused
+                stream->pos = stream->page_end;
+                continue;
+            }
+            // Discarded event
+            stream->pos += sizeof(header) + array0;
+            continue;
+        case EVENT_TYPE_TIME_EXTEND:
+            stream->page_ts += ((uint64_t)array0 << EVENT_TS_SHIFT) + time_delta;
+            stream->pos += sizeof(header) + sizeof(array0);
+            continue;
+        case EVENT_TYPE_TIME_STAMP:
+            // Not used by the kernel ring buffer
+            stream->pos += EVENT_TIME_STAMP_SIZE;
+            continue;
+        case 0:
+            // Length is stored in the first word of the data
+            length = array0 - sizeof(array0);
+            stream->message.msg = page + stream->pos + sizeof(header)
+                + sizeof(array0);
+            stream->pos += sizeof(header) + array0;
+            break;
+        default:
+            length = type_len * EVENT_ALIGNMENT;
+            stream->message.msg = page + stream->pos + sizeof(header);
+            stream->pos += sizeof(header) + length;
+            break;
+        }
+        if(stream->pos > stream->page_end)
+        {
+            // Incorrect event, ignore rest of the page
+            stream->pos = stream->page_end;
+            continue;
+        }
+        stream->page_ts += time_delta;
+
+        stream->message.size = length;
+        stream->message.cpu = stream->cpu;
+        stream->message.ts = stream->page_ts;
+        stream->has_message = 1;
+        return 1;
+    }
+}
+
+/*
+ * Read next pages for the stream, which has no messages.
+ *
+ * Return 1 if stream has messages after that, 0 otherwise.
+ * On error return negative error code.
+ */
+static int trace_stream_read(struct trace_consumer* consumer,
+    struct trace_stream* stream)
+{
+    ssize_t size;
+
+    if(stream->is_finished)
+        return 0;
+
+    stream->round = ++consumer->round;
+
+    size = read(stream->fd, stream->buf, consumer->page_size * PAGES_PER_READ);
+    if(size < 0)
+    {
+        if(errno == EAGAIN)
+            return 0;
+        return -errno;
+    }
+    if(size == 0)
+    {
+        stream->is_finished = 1;
+        return 0;
+    }
+
+    stream->buf_size = size;
+    stream->page_offset = 0;
+    consumer->pages_read += size / consumer->page_size;
+    if(!trace_stream_next_page(stream, consumer->page_size))
+    {
+        // Partial page may be only at the end of the file
+        stream->buf_size = 0;
+        stream->is_finished = 1;
+        return 0;
+    }
+
+    return trace_stream_next_message(stream, consumer->page_size);
+}
+
+/*
+ * Wait until some stream may be read.
+ *
+ * Return negative error code on error.
+ */
+static int trace_consumer_wait(struct trace_consumer* consumer)
+{
+    struct pollfd* fds;
+    int i, n = 0;
+    int result = 0;
+
+    fds = malloc(sizeof(*fds) * consumer->n_streams);
+    if(fds == NULL)
+        return -ENOMEM;
+
+    for(i = 0; i < consumer->n_streams; i++)
+    {
+        if(consumer->streams[i].is_finished)
+            continue;
+        fds[n].fd = consumer->streams[i].fd;
+        fds[n].events = POLLIN;
+        fds[n].revents = 0;
+        n++;
+    }
+
+    if(n && (poll(fds, n, -1) < 0))
+        result = -errno;
+
+    free(fds);
+    return result;
+}
+
+static int trace_stream_cpu_compare(const void* a, const void* b)
+{
+    return ((const struct trace_stream*)a)->cpu
+        - ((const struct trace_stream*)b)->cpu;
+}
+
+struct trace_consumer* trace_consumer_create(const char* dir)
+{
+    struct trace_consumer* consumer;
+    DIR* d;
+    struct dirent* entry;
+    int error = 0;
+
+    consumer = calloc(1, sizeof(*consumer));
+    if(consumer == NULL)
+        return NULL;
+
+    consumer->page_size = sysconf(_SC_PAGESIZE);
+
+    d = opendir(dir);
+    if(d == NULL)
+    {
+        free(consumer);
+        return NULL;
+    }
+
+    while((entry = readdir(d)) != NULL)
+    {
+        int cpu;
+        char end;
+        char* path;
+        struct trace_stream* stream;
+
+        if(sscanf(entry->d_name, "cpu%d%c", &cpu, &end) != 1)
+            continue;
+
+        stream = realloc(consumer->streams,
+            sizeof(*stream) * (consumer->n_streams + 1));
+        if(stream == NULL)
+        {
+            error = ENOMEM;
+            break;
+        }
+        consumer->streams = stream;
+        stream += consumer->n_streams;
+        memset(stream, 0, sizeof(*stream));
+        stream->cpu = cpu;
+        stream->fd = -1;
+        consumer->n_streams++;
+
+        stream->buf = malloc(consumer->page_size * PAGES_PER_READ);
+        path = malloc(strlen(dir) + strlen(entry->d_name) + 2);
+        if((stream->buf == NULL) || (path == NULL))
+        {
+            free(path);
+            error = ENOMEM;
+            break;
+        }
+        sprintf(path, "%s/%s", dir, entry->d_name);
+        stream->fd = open(path, O_RDONLY | O_NONBLOCK);
+        free(path);
+        if(stream->fd == -1)
+        {
+            error = errno;
+            break;
+        }
+    }
+    closedir(d);
+
+    if(!error && (consumer->n_streams == 0))
+        error = ENOENT;
+    if(error)
+    {
+        trace_consumer_destroy(consumer);
+        errno = error;
+        return NULL;
+    }
+
+    qsort(consumer->streams, consumer->n_streams, sizeof(*consumer->streams),
+        trace_stream_cpu_compare);
+
+    return consumer;
+}
+
+void trace_consumer_destroy(struct trace_consumer* consumer)
+{
+    int i;
+    for(i = 0; i < consumer->n_streams; i++)
+    {
+        if(consumer->streams[i].fd != -1)
+            close(consumer->streams[i].fd);
+        free(consumer->streams[i].buf);
+    }
+    free(consumer->streams);
+    free(consumer);
+}
+
+int trace_consumer_read_message(struct trace_consumer* consumer,
+    struct trace_consumer_message* message, int should_wait)
+{
+    struct trace_stream* oldest;
+    int i;
+    int result;
+
+    /*
+     * Message which was returned last time is consumed.
+     * If its stream become empty, it will be read again below.
+     */
+    if(consumer->last)
+    {
+        trace_stream_next_message(consumer->last, consumer->page_size);
+        consumer->last = NULL;
+    }
+
+    while(1)
+    {
+        int is_updated = 0;
+
+        oldest = NULL;
+        for(i = 0; i < consumer->n_streams; i++)
+        {
+            struct trace_stream* stream = &consumer->streams[i];
+            if(stream->has_message &&
+                ((oldest == NULL) || (stream->message.ts < oldest->message.ts)))
+                oldest = stream;
+        }
+
+        /*
+         * Streams without messages should be read again, if they
+         * were read before the oldest message was.
+         */
+        for(i = 0; i < consumer->n_streams; i++)
+        {
+            struct trace_stream* stream = &consumer->streams[i];
+            if(stream->has_message || stream->is_finished)
+                continue;
+            if(oldest && (stream->round > oldest->round))
+                continue;
+            result = trace_stream_read(consumer, stream);
+            if(result < 0)
+                return result;
+            if(result)
+                is_updated = 1;
+        }
+        if(is_updated)
+            continue;
+
+        if(oldest)
+            break;
+        // No messages
+        for(i = 0; i < consumer->n_streams; i++)
+            if(!consumer->streams[i].is_finished)
+                break;
+        if(!should_wait || (i == consumer->n_streams))
+            return 0;
+        result = trace_consumer_wait(consumer);
+        if(result < 0)
+            return result;
+    }
+
+    consumer->last = oldest;
+    *message = oldest->message;
+    return 1;
+}
+
+unsigned long trace_consumer_pages_read(struct trace_consumer* consumer)
+{
+    return consumer->pages_read;
+}
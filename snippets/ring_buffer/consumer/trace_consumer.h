@@ -0,0 +1,70 @@
+#ifndef TRACE_CONSUMER_H
+#define TRACE_CONSUMER_H
+
+/*
+ * User-space consumer of the trace, which is read by whole pages
+ * from per-cpu files 'trace_raw/cpu<N>' (see trace_file.h).
+ *
+ * Messages from all cpus are merged by their timestamps.
+ *
+ * Files with pages, previously saved from these per-cpu files
+ * (e.g., with 'cat' or splice()), may be consumed in the same way.
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+struct trace_consumer;
+
+/*
+ * Message extracted from the trace.
+ */
+struct trace_consumer_message
+{
+    /*
+     * Message data. Valid until the next reading from the consumer.
+     *
+     * Note: size of the message is rounded up to 4 bytes by the ring
+     * buffer, so message content should determine its real size.
+     */
+    const void* msg;
+    size_t size;
+    // Cpu on which message was written
+    int cpu;
+    // Timestamp of the message
+    uint64_t ts;
+};
+
+/*
+ * Create consumer for all 'cpu<N>' files in the directory 'dir'.
+ *
+ * Return NULL on error (errno is set).
+ */
+struct trace_consumer* trace_consumer_create(const char* dir);
+
+/*
+ * Close all files, free all resources used by consumer.
+ */
+void trace_consumer_destroy(struct trace_consumer* consumer);
+
+/*
+ * Extract the oldest message from the trace.
+ *
+ * Return 1 on success and fill 'message'.
+ *
+ * If there are no messages, and should_wait is 0,
+ * return 0; otherwise wait until message will be available.
+ * Also return 0 when all files are read to the end
+ * (this is never the case for debugfs files).
+ *
+ * If error occures, return negative error code.
+ */
+int trace_consumer_read_message(struct trace_consumer* consumer,
+    struct trace_consumer_message* message, int should_wait);
+
+/*
+ * Return number of pages read by the consumer.
+ */
+unsigned long trace_consumer_pages_read(struct trace_consumer* consumer);
+
+#endif /* TRACE_CONSUMER_H */
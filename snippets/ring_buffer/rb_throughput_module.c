@@ -0,0 +1,383 @@
+/*
+ * Throughput test for the trace buffer.
+ *
+ * Writing number N into 'start' file makes every online cpu write
+ * N messages into the trace. Messages may be read concurrently
+ * from the 'trace' file or(faster) from 'trace_raw/cpu<N>' files
+ * (see 'consumer/rb_consume').
+ *
+ * 'result' file contains number of messages written, time spent
+ * for writting and number of messages lost.
+ */
+#include <trace_file.h>
+
+#include <linux/module.h>
+#include <linux/init.h>
+
+#include <linux/mutex.h>
+
+#include <linux/debugfs.h>
+
+#include <linux/uaccess.h>
+
+#include <linux/moduleparam.h>
+
+#include <linux/slab.h> /*kmalloc and others*/
+
+#include <linux/kthread.h> /* kthread_create and others */
+#include <linux/completion.h>
+#include <linux/ktime.h>
+
+#define BUFFER_SIZE_DEFAULT 1000000
+#define MESSAGE_SIZE_DEFAULT 32
+
+//Initial buffer size
+unsigned long buffer_size = BUFFER_SIZE_DEFAULT;
+module_param(buffer_size, ulong, S_IRUGO);
+
+//Size of every message written, not less than size of the header.
+unsigned int message_size = MESSAGE_SIZE_DEFAULT;
+module_param(message_size, uint, S_IRUGO);
+
+// Names of files
+static const char* work_dir_name = "rb_throughput";
+
+static const char* start_file_name = "start";
+static const char* result_file_name = "result";
+
+//
+static struct dentry* work_dir;
+static struct dentry* start_file;
+static struct dentry* result_file;
+
+// Global trace_file object.
+static struct trace_file* trace_file;
+
+/*
+ * Header of every message in the trace.
+ *
+ * Rest of the message(up to 'message_size') is filled with zeroes.
+ */
+struct rb_throughput_message
+{
+    // Number of the message written on this cpu, starting from 0.
+    u32 seq;
+    u32 cpu;
+};
+
+/*
+ * Interpretator of the trace content.
+ */
+int trace_print_message(char* str, size_t size,
+    const void* msg, size_t msg_size, int cpu, u64 ts, void* user_data);
+
+// Protect from concurrent tests
+static DEFINE_MUTEX(test_mutex);
+
+// Result of the last test
+static unsigned long result_messages;
+static u64 result_time_ns;
+
+/*
+ * Write 'count' messages on all online cpus and wait until
+ * all writers finish.
+ */
+static int rb_throughput_run(unsigned long count);
+
+static int start_file_open(struct inode *inode, struct file *filp);
+// Run the test
+static ssize_t start_file_write(struct file *filp,
+    const char __user *buf, size_t count, loff_t * f_pos);
+
+static struct file_operations start_file_ops =
+{
+    .owner = THIS_MODULE,
+    .open = start_file_open,
+    .write = start_file_write,
+};
+
+// Result file operations
+static int
+result_file_open(struct inode *inode, struct file *filp);
+static int
+result_file_release(struct inode *inode, struct file *filp);
+static ssize_t
+result_file_read(struct file *filp,
+    char __user* buf, size_t count, loff_t *f_pos);
+
+static struct file_operations result_file_ops =
+{
+    .owner = THIS_MODULE,
+    .open = result_file_open,
+    .release = result_file_release,
+    .read = result_file_read,
+};
+
+static int __init
+rb_throughput_init(void)
+{
+    if(message_size < sizeof(struct rb_throughput_message))
+    {
+        pr_err("Message size should be at least %u.",
+            (unsigned)sizeof(struct rb_throughput_message));
+        return -EINVAL;
+    }
+
+    work_dir = debugfs_create_dir(work_dir_name, NULL);
+    if(work_dir == NULL)
+    {
+        pr_err("Cannot create work directory in debugfs.");
+        return -EINVAL;
+    }
+
+    // Writers shouldn't wait for the reader, so use overwrite mode.
+    trace_file = trace_file_create(buffer_size, 1,
+        work_dir, THIS_MODULE,
+        trace_print_message, NULL);
+
+    if(trace_file == NULL)
+    {
+        debugfs_remove(work_dir);
+        return -EINVAL;
+    }
+
+    start_file = debugfs_create_file(start_file_name,
+        S_IWUSR | S_IWGRP,
+        work_dir,
+        trace_file,
+        &start_file_ops);
+    if(start_file == NULL)
+    {
+        pr_err("Cannot create start file.");
+        trace_file_destroy(trace_file);
+        debugfs_remove(work_dir);
+        return -EINVAL;
+    }
+
+    result_file = debugfs_create_file(result_file_name,
+        S_IRUGO,
+        work_dir,
+        trace_file,
+        &result_file_ops);
+    if(result_file == NULL)
+    {
+        pr_err("Cannot create result file.");
+        debugfs_remove(start_file);
+        trace_file_destroy(trace_file);
+        debugfs_remove(work_dir);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+void __exit
+rb_throughput_exit(void)
+{
+    debugfs_remove(result_file);
+    debugfs_remove(start_file);
+    trace_file_destroy(trace_file);
+    debugfs_remove(work_dir);
+}
+
+module_init(rb_throughput_init);
+module_exit(rb_throughput_exit);
+
+MODULE_AUTHOR("Andrey Tsyvarev");
+MODULE_DESCRIPTION("Throughput test for the trace buffer");
+MODULE_LICENSE("GPL");
+////////////////////////////////////
+
+/*
+ * Test run, shared by all writers.
+ */
+struct rb_throughput_test
+{
+    unsigned long count;
+    // Number of writers which are not finished yet.
+    atomic_t writers_running;
+    struct completion writers_done;
+};
+
+static int rb_throughput_writer(void* data)
+{
+    struct rb_throughput_test* test = data;
+    struct rb_throughput_message* msg;
+    unsigned long i;
+
+    msg = kzalloc(message_size, GFP_KERNEL);
+    if(msg != NULL)
+    {
+        msg->cpu = raw_smp_processor_id();
+        for(i = 0; i < test->count; i++)
+        {
+            msg->seq = (u32)i;
+            trace_file_write_message(trace_file, msg, message_size);
+            if((i & 1023) == 1023)
+                cond_resched();
+        }
+        kfree(msg);
+    }
+    else
+    {
+        pr_err("rb_throughput_writer: Cannot allocate message.");
+    }
+
+    if(atomic_dec_and_test(&test->writers_running))
+        complete(&test->writers_done);
+    return 0;
+}
+
+int rb_throughput_run(unsigned long count)
+{
+    struct rb_throughput_test test;
+    unsigned long writers = 0;
+    ktime_t start;
+    int cpu;
+
+    test.count = count;
+    // Extra reference prevents completion while writers are created
+    atomic_set(&test.writers_running, 1);
+    init_completion(&test.writers_done);
+
+    get_online_cpus();
+    start = ktime_get();
+    for_each_online_cpu(cpu)
+    {
+        struct task_struct* writer = kthread_create(rb_throughput_writer,
+            &test, "rb_writer/%d", cpu);
+        if(IS_ERR(writer))
+        {
+            pr_err("Cannot create writer for cpu %d.", cpu);
+            continue;
+        }
+        kthread_bind(writer, cpu);
+        atomic_inc(&test.writers_running);
+        wake_up_process(writer);
+        writers++;
+    }
+    put_online_cpus();
+
+    if(!atomic_dec_and_test(&test.writers_running))
+        wait_for_completion(&test.writers_done);
+
+    result_time_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+    result_messages = writers * count;
+
+    return writers ? 0 : -EINVAL;
+}
+
+// Start file operations implementation.
+int start_file_open(struct inode *inode, struct file *filp)
+{
+    return nonseekable_open(inode, filp);
+}
+
+ssize_t start_file_write(struct file *filp,
+    const char __user *buf, size_t count, loff_t * f_pos)
+{
+    int error;
+    unsigned long messages;
+
+    if(count == 0) return -EINVAL;
+    {
+        char* str = kmalloc(count + 1, GFP_KERNEL);
+        if(str == NULL)
+        {
+            return -ENOMEM;
+        }
+        if(copy_from_user(str, buf, count))
+        {
+            kfree(str);
+            return -EFAULT;
+        }
+        str[count] = '\0';
+        error = strict_strtoul(str, 0, &messages);
+        kfree(str);
+        if(error) return error;
+    }
+
+    if(mutex_lock_interruptible(&test_mutex))
+        return -ERESTARTSYS;
+    error = rb_throughput_run(messages);
+    mutex_unlock(&test_mutex);
+
+    return error ? error : count;
+}
+
+// Result file operations implementation
+int
+result_file_open(struct inode *inode, struct file *filp)
+{
+    int result;
+    size_t len;
+    char* str;
+    unsigned long messages;
+    u64 time_ns;
+
+    struct trace_file* trace_file =
+        (struct trace_file*)inode->i_private;
+
+    unsigned long lost_messages =
+        trace_file_lost_messages(trace_file);
+
+    if(mutex_lock_interruptible(&test_mutex))
+        return -ERESTARTSYS;
+    messages = result_messages;
+    time_ns = result_time_ns;
+    mutex_unlock(&test_mutex);
+
+#define print_result(buffer, size) snprintf(buffer, size, \
+    "messages: %lu\ntime_ns: %llu\nlost_messages: %lu\n", \
+    messages, (unsigned long long)time_ns, lost_messages)
+
+    len = print_result(NULL, 0);
+    str = kmalloc(len + 1, GFP_KERNEL);
+    if(str == NULL)
+    {
+        pr_err("result_file_open: Cannot allocate string.");
+        return -ENOMEM;
+    }
+    print_result(str, len + 1);
+#undef print_result
+    filp->private_data = str;
+    result = nonseekable_open(inode, filp);
+    if(result)
+    {
+        kfree(str);
+    }
+    return result;
+}
+int
+result_file_release(struct inode *inode, struct file *filp)
+{
+    char* str = filp->private_data;
+    kfree(str);
+    return 0;
+}
+ssize_t
+result_file_read(struct file *filp,
+    char __user* buf, size_t count, loff_t *f_pos)
+{
+    const char* str = filp->private_data;
+    size_t len = strlen(str);
+
+    return simple_read_from_buffer(buf, count, f_pos, str, len);
+}
+
+///////////////////////
+int trace_print_message(char* str, size_t size,
+    const void* msg, size_t msg_size, int cpu, u64 ts, void* user_data)
+{
+    const struct rb_throughput_message* message = msg;
+    // ts is time in nanoseconds since system starts
+    u32 sec, ms;
+
+    sec = div_u64_rem(ts, 1000000000, &ms);
+    ms /= 1000;
+
+    (void)user_data;
+
+    return snprintf(str, size, "[%.03d]\t%.6lu.%.06u:\t%u\n",
+        cpu, (unsigned long)sec, (unsigned)ms, (unsigned)message->seq);
+}
@@ -0,0 +1,215 @@
+#ifndef KERNEL_SHIM_H
+#define KERNEL_SHIM_H
+
+/*
+ * Minimal user-space replacement of the kernel API used by
+ * trace_buffer.c, so it may be compiled and tested in user space.
+ *
+ * Only single-threaded non-blocking use is supported: locks are
+ * no-op, waiting is never needed.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <assert.h>
+
+typedef uint64_t u64;
+typedef uint32_t u32;
+
+#define ERESTARTSYS 512
+
+#define PAGE_SIZE 4096UL
+#define HZ 1000
+
+#define pr_err(...) fprintf(stderr, __VA_ARGS__)
+#define pr_info(...) fprintf(stderr, __VA_ARGS__)
+#define BUG_ON(cond) assert(!(cond))
+
+#define container_of(ptr, type, member) \
+    ((type*)((char*)(ptr) - offsetof(type, member)))
+
+/* Memory allocation */
+typedef int gfp_t;
+#define GFP_KERNEL 0
+
+static inline void* kmalloc(size_t size, gfp_t flags)
+{
+    (void)flags;
+    return malloc(size);
+}
+static inline void* kzalloc(size_t size, gfp_t flags)
+{
+    (void)flags;
+    return calloc(1, size);
+}
+static inline void* krealloc(const void* p, size_t size, gfp_t flags)
+{
+    (void)flags;
+    return realloc((void*)p, size);
+}
+static inline void kfree(const void* p)
+{
+    free((void*)p);
+}
+
+/* CPUs */
+#define NR_CPUS 4096
+
+typedef struct cpumask
+{
+    unsigned long bits[NR_CPUS / (8 * sizeof(unsigned long))];
+} cpumask_t;
+
+#define CPUMASK_BITS_PER_WORD (8 * sizeof(unsigned long))
+
+/* Set by the user of the shim before trace buffer is allocated */
+extern int nr_cpu_ids;
+extern cpumask_t cpu_online_map;
+#define cpu_online_mask (&cpu_online_map)
+
+static inline void cpumask_clear(cpumask_t* mask)
+{
+    memset(mask, 0, sizeof(*mask));
+}
+static inline void cpumask_set_cpu(int cpu, cpumask_t* mask)
+{
+    mask->bits[cpu / CPUMASK_BITS_PER_WORD] |=
+        1UL << (cpu % CPUMASK_BITS_PER_WORD);
+}
+static inline void cpumask_clear_cpu(int cpu, cpumask_t* mask)
+{
+    mask->bits[cpu / CPUMASK_BITS_PER_WORD] &=
+        ~(1UL << (cpu % CPUMASK_BITS_PER_WORD));
+}
+static inline int cpumask_test_cpu(int cpu, const cpumask_t* mask)
+{
+    return (mask->bits[cpu / CPUMASK_BITS_PER_WORD]
+        >> (cpu % CPUMASK_BITS_PER_WORD)) & 1;
+}
+static inline void cpumask_copy(cpumask_t* dst, const cpumask_t* src)
+{
+    memcpy(dst, src, sizeof(*dst));
+}
+static inline int cpumask_equal(const cpumask_t* a, const cpumask_t* b)
+{
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+#define cpu_possible(cpu) ((cpu) >= 0 && (cpu) < nr_cpu_ids)
+#define cpu_online(cpu) cpumask_test_cpu(cpu, cpu_online_mask)
+#define for_each_possible_cpu(cpu) for((cpu) = 0; (cpu) < nr_cpu_ids; (cpu)++)
+#define for_each_online_cpu(cpu) \
+    for_each_possible_cpu(cpu) if(cpu_online(cpu))
+
+static inline void get_online_cpus(void) {}
+static inline void put_online_cpus(void) {}
+
+/* Locks: single-threaded use only */
+struct mutex
+{
+    int locked;
+};
+
+static inline void mutex_init(struct mutex* m)
+{
+    m->locked = 0;
+}
+static inline void mutex_destroy(struct mutex* m)
+{
+    BUG_ON(m->locked);
+}
+static inline void mutex_lock(struct mutex* m)
+{
+    BUG_ON(m->locked);
+    m->locked = 1;
+}
+static inline int mutex_lock_killable(struct mutex* m)
+{
+    mutex_lock(m);
+    return 0;
+}
+static inline int mutex_lock_interruptible(struct mutex* m)
+{
+    mutex_lock(m);
+    return 0;
+}
+static inline void mutex_unlock(struct mutex* m)
+{
+    BUG_ON(!m->locked);
+    m->locked = 0;
+}
+
+/* Waiting: never really performed */
+typedef struct
+{
+    int dummy;
+} wait_queue_head_t;
+
+typedef struct
+{
+    int dummy;
+} wait_queue_t;
+
+#define TASK_RUNNING 0
+#define TASK_KILLABLE 1
+
+#define current NULL
+#define fatal_signal_pending(task) 0
+#define set_current_state(state) do {} while(0)
+
+static inline void init_waitqueue_head(wait_queue_head_t* q) { (void)q; }
+static inline void init_wait(wait_queue_t* w) { (void)w; }
+static inline void add_wait_queue(wait_queue_head_t* q, wait_queue_t* w)
+{
+    (void)q; (void)w;
+}
+static inline void finish_wait(wait_queue_head_t* q, wait_queue_t* w)
+{
+    (void)q; (void)w;
+}
+static inline void wake_up_all(wait_queue_head_t* q) { (void)q; }
+
+static inline void schedule(void)
+{
+    BUG_ON(1);
+}
+
+static inline unsigned long msleep_interruptible(unsigned int ms)
+{
+    (void)ms;
+    BUG_ON(1);
+    return 0;
+}
+
+/* Deferred works: never executed */
+struct work_struct
+{
+    void (*func)(struct work_struct* work);
+};
+
+struct delayed_work
+{
+    struct work_struct work;
+};
+
+#define to_delayed_work(w) container_of(w, struct delayed_work, work)
+#define INIT_DELAYED_WORK(dw, f) ((dw)->work.func = (f))
+
+static inline int schedule_delayed_work(struct delayed_work* dw,
+    unsigned long delay)
+{
+    (void)dw; (void)delay;
+    return 1;
+}
+static inline int cancel_delayed_work_sync(struct delayed_work* dw)
+{
+    (void)dw;
+    return 0;
+}
+
+#endif /* KERNEL_SHIM_H */
@@ -0,0 +1,56 @@
+#ifndef RING_BUFFER_REPLAY_H
+#define RING_BUFFER_REPLAY_H
+
+/*
+ * User-space ring buffer, which replays recorded per-cpu streams
+ * of messages (see ring_buffer_replay.c).
+ */
+
+#include "../kernel_shim.h"
+
+struct ring_buffer;
+struct ring_buffer_event;
+
+#define RB_FL_OVERWRITE 1
+
+struct ring_buffer* ring_buffer_alloc(unsigned long size, unsigned flags);
+void ring_buffer_free(struct ring_buffer* buffer);
+
+int ring_buffer_write(struct ring_buffer* buffer, unsigned long length,
+    void* data);
+struct ring_buffer_event* ring_buffer_consume(struct ring_buffer* buffer,
+    int cpu, u64* ts);
+
+unsigned ring_buffer_event_length(struct ring_buffer_event* event);
+void* ring_buffer_event_data(struct ring_buffer_event* event);
+
+u64 ring_buffer_time_stamp(struct ring_buffer* buffer, int cpu);
+int ring_buffer_empty_cpu(struct ring_buffer* buffer, int cpu);
+unsigned long ring_buffer_overruns(struct ring_buffer* buffer);
+void ring_buffer_reset(struct ring_buffer* buffer);
+unsigned long ring_buffer_size(struct ring_buffer* buffer);
+int ring_buffer_resize(struct ring_buffer* buffer, unsigned long size);
+
+/* Page-level reading is not supported by the replay buffer. */
+void* ring_buffer_alloc_read_page(struct ring_buffer* buffer);
+void ring_buffer_free_read_page(struct ring_buffer* buffer, void* page);
+int ring_buffer_read_page(struct ring_buffer* buffer, void** data_page,
+    size_t len, int cpu, int full);
+size_t ring_buffer_page_len(void* page);
+
+/*
+ * Replay-specific functions.
+ */
+
+/* Add message with given timestamp to the stream of the cpu. */
+int ring_buffer_replay_add(struct ring_buffer* buffer, int cpu, u64 ts,
+    const void* data, size_t size);
+/*
+ * Set current time of the buffer.
+ *
+ * Only messages with timestamps not greater than current time
+ * may be consumed.
+ */
+void ring_buffer_replay_set_time(struct ring_buffer* buffer, u64 now);
+
+#endif /* RING_BUFFER_REPLAY_H */
@@ -0,0 +1,332 @@
+/*
+ * Replay recorded per-cpu streams of messages through trace_buffer
+ * in user space, verify ordering of the messages extracted and
+ * measure speed of the extraction.
+ *
+ * Usage: rb_replay [-b batch] [-s step] <trace-file>
+ *        rb_replay [-b batch] [-s step] -g <cpus>:<messages>
+ *
+ * <trace-file> is a trace, read from 'trace' file of rb_test module.
+ * It is splitted into per-cpu streams, which are replayed.
+ * With '-g', streams are generated: every cpu writes <messages>
+ * messages with random timestamps.
+ *
+ * 'batch' is the number of messages extracted at once
+ * (1 means trace_buffer_read_message(), default is 128).
+ * If 'step' is not 0, messages become available by portions:
+ * time of the buffer is advanced by 'step' nanoseconds, and all
+ * available messages are extracted after every advance.
+ * Otherwise all messages are available from the start.
+ */
+
+/* trace_buffer.c is included for access to its ring buffer. */
+#include "trace_buffer.c"
+
+#include <sys/time.h>
+#include <unistd.h>
+
+/*
+ * Header of every message in the stream.
+ */
+struct replay_message
+{
+    u32 cpu;
+    u32 seq;// number of the message on this cpu
+    char text[];
+};
+
+struct replay_state
+{
+    // Next expected sequence number for every cpu
+    u32* seq;
+    u64 last_ts;
+    unsigned long messages;
+    unsigned long errors;
+};
+
+static int replay_process(const void* msg, size_t size, int cpu,
+    u64 ts, bool* consume, void* user_data)
+{
+    struct replay_state* state = user_data;
+    const struct replay_message* message = msg;
+
+    (void)size;
+    if(ts < state->last_ts)
+    {
+        if(state->errors++ < 10)
+            fprintf(stderr, "Message from cpu %d has timestamp %llu, "
+                "less than previous one %llu.\n", cpu,
+                (unsigned long long)ts, (unsigned long long)state->last_ts);
+    }
+    if((message->cpu != (u32)cpu) || (message->seq != state->seq[cpu]))
+    {
+        if(state->errors++ < 10)
+            fprintf(stderr, "Message %u from cpu %u is extracted as "
+                "message %u from cpu %d.\n", (unsigned)message->seq,
+                (unsigned)message->cpu, (unsigned)state->seq[cpu], cpu);
+    }
+    state->seq[cpu] = message->seq + 1;
+    state->last_ts = ts;
+    state->messages++;
+
+    *consume = 1;
+    return 1;
+}
+
+static int replay_add(struct ring_buffer* buffer, u32* seq, int cpu, u64 ts,
+    const char* text)
+{
+    size_t size = sizeof(struct replay_message) + strlen(text) + 1;
+    struct replay_message* message = malloc(size);
+    int result;
+
+    if(message == NULL) return -ENOMEM;
+    message->cpu = cpu;
+    message->seq = seq[cpu]++;
+    strcpy(message->text, text);
+    result = ring_buffer_replay_add(buffer, cpu, ts, message, size);
+    free(message);
+    return result;
+}
+
+/*
+ * Split trace, read from the 'trace' file, into per-cpu streams.
+ */
+static int load_trace(struct trace_buffer* trace_buffer, u32* seq,
+    const char* filename, u64* max_ts)
+{
+    FILE* f = fopen(filename, "r");
+    char line[1024];
+
+    if(f == NULL)
+    {
+        perror(filename);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f))
+    {
+        int cpu, pos = 0;
+        unsigned long sec;
+        unsigned usec;
+        u64 ts;
+
+        if((sscanf(line, "[%d]\t%lu.%u:\t%n", &cpu, &sec, &usec, &pos) < 3)
+            || (pos == 0) || !cpu_possible(cpu))
+        {
+            fprintf(stderr, "Incorrect line in the trace: %s", line);
+            fclose(f);
+            return -1;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        ts = (u64)sec * 1000000000 + (u64)usec * 1000;
+        if(ts > *max_ts) *max_ts = ts;
+        if(replay_add(trace_buffer->buffer, seq, cpu, ts, line + pos))
+        {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Determine number of cpus in the trace file. */
+static int trace_cpus(const char* filename)
+{
+    FILE* f = fopen(filename, "r");
+    char line[1024];
+    int cpus = 0;
+
+    if(f == NULL)
+    {
+        perror(filename);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f))
+    {
+        int cpu;
+        if((sscanf(line, "[%d]", &cpu) == 1) && (cpu >= cpus) && (cpu < NR_CPUS))
+            cpus = cpu + 1;
+    }
+    fclose(f);
+    return cpus;
+}
+
+static int generate_streams(struct trace_buffer* trace_buffer, u32* seq,
+    int cpus, unsigned long messages, u64* max_ts)
+{
+    int cpu;
+    srand(1);
+    for(cpu = 0; cpu < cpus; cpu++)
+    {
+        u64 ts = 0;
+        unsigned long i;
+        for(i = 0; i < messages; i++)
+        {
+            ts += 1 + rand() % (100 * cpus);
+            if(replay_add(trace_buffer->buffer, seq, cpu, ts, "Message"))
+                return -1;
+        }
+        if(ts > *max_ts) *max_ts = ts;
+    }
+    return 0;
+}
+
+static double current_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Extract all messages, which are currently available.
+ *
+ * Return 0 on success.
+ */
+static int replay_drain(struct trace_buffer* trace_buffer, int batch,
+    struct replay_state* state)
+{
+    int result;
+    do
+    {
+        if(batch == 1)
+            result = trace_buffer_read_message(trace_buffer, replay_process,
+                0, state);
+        else
+            result = trace_buffer_read_messages(trace_buffer, replay_process,
+                batch, 0, state);
+    } while(result > 0);
+    return (result == -EAGAIN) ? 0 : result;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-b batch] [-s step] <trace-file>\n"
+        "       %s [-b batch] [-s step] -g <cpus>:<messages>\n",
+        name, name);
+}
+
+int main(int argc, char** argv)
+{
+    int opt;
+    int batch = 128;
+    u64 step = 0;
+    const char* generate = NULL;
+    int cpus;
+    unsigned long messages = 0;
+    unsigned long expected = 0;
+    u32* seq_written;
+    struct replay_state state;
+    struct trace_buffer* trace_buffer;
+    u64 max_ts = 0, now;
+    double start, elapsed;
+    int cpu, result;
+
+    while((opt = getopt(argc, argv, "b:s:g:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'b':
+            batch = atoi(optarg);
+            break;
+        case 's':
+            step = strtoull(optarg, NULL, 0);
+            break;
+        case 'g':
+            generate = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if((batch <= 0) || (generate ? optind != argc : optind != argc - 1))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(generate)
+    {
+        if((sscanf(generate, "%d:%lu", &cpus, &messages) != 2)
+            || (cpus <= 0) || (cpus > NR_CPUS))
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    else
+    {
+        cpus = trace_cpus(argv[optind]);
+        if(cpus <= 0)
+        {
+            fprintf(stderr, "Trace is empty.\n");
+            return 1;
+        }
+    }
+
+    nr_cpu_ids = cpus;
+    for(cpu = 0; cpu < cpus; cpu++)
+        cpumask_set_cpu(cpu, &cpu_online_map);
+
+    trace_buffer = trace_buffer_alloc(1000000, 1);
+    seq_written = calloc(cpus, sizeof(*seq_written));
+    state.seq = calloc(cpus, sizeof(*state.seq));
+    if((trace_buffer == NULL) || (seq_written == NULL) || (state.seq == NULL))
+    {
+        fprintf(stderr, "Cannot allocate trace buffer.\n");
+        return 1;
+    }
+    state.last_ts = 0;
+    state.messages = 0;
+    state.errors = 0;
+
+    result = generate
+        ? generate_streams(trace_buffer, seq_written, cpus, messages, &max_ts)
+        : load_trace(trace_buffer, seq_written, argv[optind], &max_ts);
+    if(result)
+        return 1;
+    for(cpu = 0; cpu < cpus; cpu++)
+        expected += seq_written[cpu];
+
+    start = current_time();
+    for(now = step ? 0 : max_ts; ; now += step)
+    {
+        if(now > max_ts) now = max_ts;
+        ring_buffer_replay_set_time(trace_buffer->buffer, now);
+        result = replay_drain(trace_buffer, batch, &state);
+        if(result || (now == max_ts)) break;
+    }
+    elapsed = current_time() - start;
+
+    if(result)
+    {
+        fprintf(stderr, "Error while extracting messages: %d\n", result);
+        state.errors++;
+    }
+    if(state.messages != expected)
+    {
+        fprintf(stderr, "%lu messages are written, but %lu are extracted.\n",
+            expected, state.messages);
+        state.errors++;
+    }
+
+    printf("cpus: %d, messages: %lu, batch: %d\n", cpus, state.messages, batch);
+    printf("time: %.3f s", elapsed);
+    if(elapsed > 0)
+        printf(", rate: %.0f messages/s", state.messages / elapsed);
+    printf("\n");
+
+    trace_buffer_destroy(trace_buffer);
+    free(seq_written);
+    free(state.seq);
+
+    if(state.errors)
+    {
+        printf("FAILED: %lu errors\n", state.errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
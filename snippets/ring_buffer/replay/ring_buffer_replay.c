@@ -0,0 +1,183 @@
+/*
+ * User-space ring buffer, which replays recorded per-cpu streams.
+ *
+ * Every per-cpu stream is an array of messages with non-decreasing
+ * timestamps. Message is visible for consumer when its timestamp
+ * doesn't exceed current time of the buffer.
+ */
+#include <linux/ring_buffer.h>
+
+int nr_cpu_ids = 1;
+cpumask_t cpu_online_map;
+
+struct ring_buffer_event
+{
+    u64 ts;
+    size_t size;
+    void* data;
+};
+
+struct replay_stream
+{
+    struct ring_buffer_event* events;
+    size_t n_events;
+    size_t capacity;
+    size_t next;// first event not consumed
+};
+
+struct ring_buffer
+{
+    struct replay_stream* streams;
+    unsigned long size;
+    u64 now;
+};
+
+struct ring_buffer* ring_buffer_alloc(unsigned long size, unsigned flags)
+{
+    struct ring_buffer* buffer = calloc(1, sizeof(*buffer));
+    (void)flags;
+    if(buffer == NULL) return NULL;
+    buffer->streams = calloc(nr_cpu_ids, sizeof(*buffer->streams));
+    if(buffer->streams == NULL)
+    {
+        free(buffer);
+        return NULL;
+    }
+    buffer->size = size;
+    return buffer;
+}
+
+void ring_buffer_free(struct ring_buffer* buffer)
+{
+    ring_buffer_reset(buffer);
+    free(buffer->streams);
+    free(buffer);
+}
+
+int ring_buffer_replay_add(struct ring_buffer* buffer, int cpu, u64 ts,
+    const void* data, size_t size)
+{
+    struct replay_stream* stream = &buffer->streams[cpu];
+    struct ring_buffer_event* event;
+
+    if(stream->n_events == stream->capacity)
+    {
+        size_t capacity = stream->capacity ? stream->capacity * 2 : 64;
+        event = realloc(stream->events, capacity * sizeof(*event));
+        if(event == NULL) return -ENOMEM;
+        stream->events = event;
+        stream->capacity = capacity;
+    }
+    event = &stream->events[stream->n_events];
+    event->data = malloc(size);
+    if(event->data == NULL) return -ENOMEM;
+    memcpy(event->data, data, size);
+    event->size = size;
+    event->ts = ts;
+    stream->n_events++;
+    return 0;
+}
+
+void ring_buffer_replay_set_time(struct ring_buffer* buffer, u64 now)
+{
+    buffer->now = now;
+}
+
+int ring_buffer_write(struct ring_buffer* buffer, unsigned long length,
+    void* data)
+{
+    return ring_buffer_replay_add(buffer, 0, buffer->now, data, length);
+}
+
+struct ring_buffer_event* ring_buffer_consume(struct ring_buffer* buffer,
+    int cpu, u64* ts)
+{
+    struct replay_stream* stream = &buffer->streams[cpu];
+    struct ring_buffer_event* event;
+
+    if(stream->next == stream->n_events) return NULL;
+    event = &stream->events[stream->next];
+    if(event->ts > buffer->now) return NULL;
+
+    stream->next++;
+    if(ts) *ts = event->ts;
+    return event;
+}
+
+unsigned ring_buffer_event_length(struct ring_buffer_event* event)
+{
+    return event->size;
+}
+
+void* ring_buffer_event_data(struct ring_buffer_event* event)
+{
+    return event->data;
+}
+
+u64 ring_buffer_time_stamp(struct ring_buffer* buffer, int cpu)
+{
+    (void)cpu;
+    return buffer->now;
+}
+
+int ring_buffer_empty_cpu(struct ring_buffer* buffer, int cpu)
+{
+    struct replay_stream* stream = &buffer->streams[cpu];
+    return stream->next == stream->n_events;
+}
+
+unsigned long ring_buffer_overruns(struct ring_buffer* buffer)
+{
+    (void)buffer;
+    return 0;
+}
+
+void ring_buffer_reset(struct ring_buffer* buffer)
+{
+    int cpu;
+    for(cpu = 0; cpu < nr_cpu_ids; cpu++)
+    {
+        struct replay_stream* stream = &buffer->streams[cpu];
+        size_t i;
+        for(i = 0; i < stream->n_events; i++)
+            free(stream->events[i].data);
+        free(stream->events);
+        memset(stream, 0, sizeof(*stream));
+    }
+}
+
+unsigned long ring_buffer_size(struct ring_buffer* buffer)
+{
+    return buffer->size;
+}
+
+int ring_buffer_resize(struct ring_buffer* buffer, unsigned long size)
+{
+    buffer->size = size;
+    return size;
+}
+
+void* ring_buffer_alloc_read_page(struct ring_buffer* buffer)
+{
+    (void)buffer;
+    return malloc(PAGE_SIZE);
+}
+
+void ring_buffer_free_read_page(struct ring_buffer* buffer, void* page)
+{
+    (void)buffer;
+    free(page);
+}
+
+int ring_buffer_read_page(struct ring_buffer* buffer, void** data_page,
+    size_t len, int cpu, int full)
+{
+    (void)buffer; (void)data_page; (void)len; (void)cpu; (void)full;
+    return -1;
+}
+
+size_t ring_buffer_page_len(void* page)
+{
+    (void)page;
+    return 0;
+}
@@ -7,7 +7,7 @@
 #include <linux/delay.h> /* msleep_interruptible definition */
 
 #include <linux/cpumask.h> /* definition of 'struct cpumask'(cpumask_t)*/
-#include <linux/threads.h> /*definition of NR_CPUS macro*/
+#include <linux/cpu.h> /* get_online_cpus() */
 
 #include <linux/mutex.h> /* mutexes */
 
@@ -83,7 +83,7 @@ struct last_message
     void *msg;
     size_t size;
     
-    struct list_head list;//ordered array of 'struct last_message'
+    int heap_index;//position in the heap of messages, -1 if not in the heap
 };
 
 static int last_message_init(struct last_message* message, int cpu, u64 ts)
@@ -94,6 +94,7 @@ static int last_message_init(struct last_message* message, int cpu, u64 ts)
     
     message->msg = NULL;
     message->size = 0;
+    message->heap_index = -1;
     return 0;
 }
 static void
@@ -152,11 +153,20 @@ struct trace_buffer
     struct ring_buffer* buffer;
 
     /*
-     * Array of last messages from all possible CPUs
+     * Array of last messages from all possible CPUs(nr_cpu_ids elements)
      */
-    struct last_message last_messages[NR_CPUS];
-    
-    struct list_head last_messages_ordered;// from the oldest timestamp to the newest one
+    struct last_message* last_messages;
+    /*
+     * Min-heap of last messages, ordered by timestamp.
+     *
+     * Contains messages only for online CPUs and for CPUs which
+     * may still have messages(so, offline cpu is removed from the heap
+     * after its buffer is drained).
+     */
+    struct last_message** heap;
+    int heap_size;
+    // Online CPUs at the moment of the heap building
+    cpumask_t heap_cpus_online;
     //number of per-cpu buffers, from which messages was readed into 'struct last_message'
     int non_empty_buffers;
     
@@ -184,6 +194,105 @@ static void wake_up_reader(struct work_struct *work)
     wake_up_all(&trace_buffer->rq);//unconditionally wakeup
 }
 
+/*
+ * Operations with the heap of last messages.
+ *
+ * Every operation is O(log(number of CPUs)).
+ */
+
+/*
+ * Order of last messages in the heap.
+ *
+ * For equal timestamps existent message goes first: it may be read
+ * without updating the empty per-cpu buffer.
+ */
+static bool heap_less(struct last_message* a, struct last_message* b)
+{
+    return (a->ts < b->ts) || ((a->ts == b->ts) && a->is_exist && !b->is_exist);
+}
+
+static void heap_set(struct trace_buffer* trace_buffer, int index,
+    struct last_message* message)
+{
+    trace_buffer->heap[index] = message;
+    message->heap_index = index;
+}
+
+static void heap_sift_up(struct trace_buffer* trace_buffer, int index)
+{
+    struct last_message* message = trace_buffer->heap[index];
+    while(index > 0)
+    {
+        int parent = (index - 1) / 2;
+        if(!heap_less(message, trace_buffer->heap[parent])) break;
+        heap_set(trace_buffer, index, trace_buffer->heap[parent]);
+        index = parent;
+    }
+    heap_set(trace_buffer, index, message);
+}
+
+static void heap_sift_down(struct trace_buffer* trace_buffer, int index)
+{
+    struct last_message* message = trace_buffer->heap[index];
+    while(1)
+    {
+        int child = 2 * index + 1;
+        if(child >= trace_buffer->heap_size) break;
+        if((child + 1 < trace_buffer->heap_size)
+            && heap_less(trace_buffer->heap[child + 1], trace_buffer->heap[child]))
+            child++;
+        if(!heap_less(trace_buffer->heap[child], message)) break;
+        heap_set(trace_buffer, index, trace_buffer->heap[child]);
+        index = child;
+    }
+    heap_set(trace_buffer, index, message);
+}
+
+static void heap_push(struct trace_buffer* trace_buffer,
+    struct last_message* message)
+{
+    heap_set(trace_buffer, trace_buffer->heap_size++, message);
+    heap_sift_up(trace_buffer, message->heap_index);
+}
+
+static void heap_remove_top(struct trace_buffer* trace_buffer)
+{
+    struct last_message* top = trace_buffer->heap[0];
+    top->heap_index = -1;
+    if(--trace_buffer->heap_size == 0) return;
+    heap_set(trace_buffer, 0, trace_buffer->heap[trace_buffer->heap_size]);
+    heap_sift_down(trace_buffer, 0);
+}
+
+/*
+ * Fill heap with last messages for online CPUs and for CPUs,
+ * which may have messages.
+ *
+ * Should be executed with lock taken.
+ */
+static void trace_buffer_heap_build(struct trace_buffer* trace_buffer)
+{
+    int cpu;
+
+    get_online_cpus();
+    cpumask_copy(&trace_buffer->heap_cpus_online, cpu_online_mask);
+    put_online_cpus();
+
+    trace_buffer->heap_size = 0;
+    for_each_possible_cpu(cpu)
+    {
+        struct last_message* last_message =
+            &trace_buffer->last_messages[cpu];
+        last_message->heap_index = -1;
+        if(cpumask_test_cpu(cpu, &trace_buffer->heap_cpus_online)
+            || last_message->is_exist
+            || !ring_buffer_empty_cpu(trace_buffer->buffer, cpu))
+        {
+            heap_push(trace_buffer, last_message);
+        }
+    }
+}
+
 /*
  * Clear all messages in the buffer.
  *
@@ -194,27 +303,21 @@ static void trace_buffer_clear_internal(struct trace_buffer* trace_buffer)
 {
     int cpu;
     //Clear last messages
-    INIT_LIST_HEAD(&trace_buffer->last_messages_ordered);
     trace_buffer->non_empty_buffers = 0;
 
     for_each_possible_cpu(cpu)
     {
-        struct list_head* insert_point;
         struct last_message* last_message =
             &trace_buffer->last_messages[cpu];
         u64 ts = ring_buffer_time_stamp(trace_buffer->buffer, cpu);
         last_message_clear(last_message);
         last_message_set_timestamp(last_message, ts);
-        //look for position for insert entry into the list
-        list_for_each_prev(insert_point, &trace_buffer->last_messages_ordered)
-        {
-            if(list_entry(insert_point, struct last_message, list)->ts <= ts) break;
-        }
-        list_add(&last_message->list, insert_point);
     }
 
     trace_buffer->messages_lost_internal = 0;
     ring_buffer_reset(trace_buffer->buffer);
+
+    trace_buffer_heap_build(trace_buffer);
 }
 
 /*
@@ -239,34 +342,42 @@ struct trace_buffer* trace_buffer_alloc(
         pr_err("trace_buffer_alloc: Cannot allocate trace_buffer structure.");
         return NULL;
     }
+
+    trace_buffer->last_messages = kmalloc(
+        sizeof(*trace_buffer->last_messages) * nr_cpu_ids, GFP_KERNEL);
+    trace_buffer->heap = kmalloc(
+        sizeof(*trace_buffer->heap) * nr_cpu_ids, GFP_KERNEL);
+    if((trace_buffer->last_messages == NULL) || (trace_buffer->heap == NULL))
+    {
+        pr_err("trace_buffer_alloc: Cannot allocate array of last messages.");
+        kfree(trace_buffer->heap);
+        kfree(trace_buffer->last_messages);
+        kfree(trace_buffer);
+        return NULL;
+    }
     
     trace_buffer->buffer = ring_buffer_alloc(size,
         mode_overwrite? RB_FL_OVERWRITE : 0);
     if(trace_buffer->buffer == NULL)
     {
         pr_err("trace_buffer_alloc: Cannot allocate ring buffer.");
+        kfree(trace_buffer->heap);
+        kfree(trace_buffer->last_messages);
         kfree(trace_buffer);
         return NULL;
     }
 
     //Initialize array of the oldest messages from per-cpu buffers
-    INIT_LIST_HEAD(&trace_buffer->last_messages_ordered);
     trace_buffer->non_empty_buffers = 0;
     for_each_possible_cpu(cpu)
     {
-        struct list_head* insert_point;
         struct last_message* last_message =
             &trace_buffer->last_messages[cpu];
         u64 ts = ring_buffer_time_stamp(trace_buffer->buffer, cpu);
         //now last_message_init return only 0(success)
         last_message_init(last_message, cpu, ts);
-        //look for position for insert entry into the list
-        list_for_each_prev(insert_point, &trace_buffer->last_messages_ordered)
-        {
-            if(list_entry(insert_point, struct last_message, list)->ts <= ts) break;
-        }
-        list_add(&last_message->list, insert_point);
     }
+    trace_buffer_heap_build(trace_buffer);
     
     
     mutex_init(&trace_buffer->read_mutex);
@@ -300,6 +411,8 @@ void trace_buffer_destroy(struct trace_buffer* trace_buffer)
         last_message_destroy(last_message);
     }
     ring_buffer_free(trace_buffer->buffer);
+    kfree(trace_buffer->heap);
+    kfree(trace_buffer->last_messages);
     kfree(trace_buffer);
 }
 
@@ -324,13 +437,13 @@ void trace_buffer_write_message(struct trace_buffer* trace_buffer,
 static int trace_buffer_read_internal(struct trace_buffer* trace_buffer,
     int (*process_data)(const void* msg, size_t size, int cpu,
         u64 ts, bool *consume, void* user_data),
-    void* user_data)
+    void* user_data, bool* consume)
 {
-    bool consume = 0;//do not consume message by default
     int result;
     // Determine oldest message
-    struct last_message* oldest_message = 
-        list_first_entry(&trace_buffer->last_messages_ordered, struct last_message, list);
+    struct last_message* oldest_message = trace_buffer->heap[0];
+
+    *consume = 0;//do not consume message by default
     if(!oldest_message->is_exist)
     {
         return -EAGAIN;
@@ -340,10 +453,10 @@ static int trace_buffer_read_internal(struct trace_buffer* trace_buffer,
         oldest_message->size,
         oldest_message->cpu,
         oldest_message->ts,
-        &consume,
+        consume,
         user_data);
     //Remove oldest message if it is consumed
-    if(consume)
+    if(*consume)
     {
         last_message_clear(oldest_message);
         trace_buffer->non_empty_buffers--;
@@ -375,18 +488,21 @@ static int trace_buffer_update_internal(struct trace_buffer* trace_buffer,
 
     if(wait_function)
         wait_function(&trace_buffer->rq, data);
+
+    // CPU may become online since the heap was built
+    if(!cpumask_equal(&trace_buffer->heap_cpus_online, cpu_online_mask))
+        trace_buffer_heap_build(trace_buffer);
     
     cpumask_clear(&subbuffers_updated);
     // Try to determine oldest message in the buffer(from all cpu's)
-    for(oldest_message = list_first_entry(&trace_buffer->last_messages_ordered, struct last_message, list);
+    for(oldest_message = trace_buffer->heap[0];
         !oldest_message->is_exist;
-        oldest_message = list_first_entry(&trace_buffer->last_messages_ordered, struct last_message, list))
+        oldest_message = trace_buffer->heap[0])
     {
         // Cannot determine latest message - need to update timestamp
         int cpu = oldest_message->cpu;
         u64 ts;
         struct ring_buffer_event* event;
-        struct list_head* insert_point;
         
         if(cpumask_test_cpu(cpu, &subbuffers_updated))
         {
@@ -401,26 +517,29 @@ static int trace_buffer_update_internal(struct trace_buffer* trace_buffer,
         ts = ring_buffer_time_stamp(trace_buffer->buffer, cpu);
         event = ring_buffer_consume(trace_buffer->buffer, cpu, &ts);
         last_message_set_timestamp(oldest_message, ts);
-        //rearrange 'oldest_message'
-        list_del(&oldest_message->list);
-        list_for_each_prev(insert_point, &trace_buffer->last_messages_ordered)
-        {
-            if(list_entry(insert_point, struct last_message, list)->ts <= ts) break;
-        }
-        list_add(&oldest_message->list, insert_point);
         //mark cpu as 'updated'
         cpumask_set_cpu(cpu, &subbuffers_updated);
-        
+
         if(event)
         {
             if(last_message_set(oldest_message, event))
             {
                 pr_err("Cannot allocate new message.");
                 trace_buffer->messages_lost_internal++;
+                heap_sift_down(trace_buffer, 0);
                 return -ENOMEM;
             }
             trace_buffer->non_empty_buffers++;
         }
+        else if(!cpumask_test_cpu(cpu, &trace_buffer->heap_cpus_online)
+            && (trace_buffer->heap_size > 1))
+        {
+            //buffer of offline cpu is drained
+            heap_remove_top(trace_buffer);
+            continue;
+        }
+        //rearrange 'oldest_message'
+        heap_sift_down(trace_buffer, 0);
     }
    
     return 0;
@@ -462,31 +581,15 @@ read_wait_function(wait_queue_head_t* q, void* data)
 }
 
 /*
- * Read the oldest message from the buffer, and consume it.
- * 
- * For message consumed call 'process_data':
- * 'msg' is set to the pointer to the message data.
- * 'size' is set to the size of the message,
- * 'cpu' is set to the cpu, on which message was written,
- * 'ts' is set to the timestamp of the message,
- * 'user_data' is set to the 'user_data' parameter of the function.
- * 
- * Return value, which is returned by 'process_data'.
- * 
- * If buffer is empty, and should_wait is 0,
- * return 0; otherwise wait until message will be available
- * 
- * If error occures, return negative error code.
- * 
- * Shouldn't be called in atomic context.
+ * Take the lock and update oldest message.
+ * If 'should_wait' is not 0, wait until message will be available.
+ *
+ * Return 0 on success, lock remains taken in that case.
+ * Otherwise return negative error code(-EAGAIN if buffer is empty and
+ * should_wait is 0), lock is released in that case.
  */
-
-int
-trace_buffer_read_message(struct trace_buffer* trace_buffer,
-    int (*process_data)(const void* msg, size_t size, int cpu,
-        u64 ts, bool *consume, void* user_data),
-    int should_wait,
-    void* user_data)
+static int trace_buffer_lock_update(struct trace_buffer* trace_buffer,
+    int should_wait)
 {
     int result;
     if(mutex_lock_killable(&trace_buffer->read_mutex))
@@ -519,8 +622,8 @@ trace_buffer_read_message(struct trace_buffer* trace_buffer,
             //and reaquire it
             if(mutex_lock_killable(&trace_buffer->read_mutex))
             {
-                result = -ERESTARTSYS;
-                break;
+                read_wait_finish(&table);
+                return -ERESTARTSYS;
             }
             read_wait_finish(&table);
         }
@@ -528,14 +631,102 @@ trace_buffer_read_message(struct trace_buffer* trace_buffer,
         if(result != -EAGAIN) break;
     }
     if(result)
-        goto out;
+        mutex_unlock(&trace_buffer->read_mutex);
+    return result;
+}
+
+/*
+ * Read the oldest message from the buffer, and consume it.
+ * 
+ * For message consumed call 'process_data':
+ * 'msg' is set to the pointer to the message data.
+ * 'size' is set to the size of the message,
+ * 'cpu' is set to the cpu, on which message was written,
+ * 'ts' is set to the timestamp of the message,
+ * 'user_data' is set to the 'user_data' parameter of the function.
+ * 
+ * Return value, which is returned by 'process_data'.
+ * 
+ * If buffer is empty, and should_wait is 0,
+ * return 0; otherwise wait until message will be available
+ * 
+ * If error occures, return negative error code.
+ * 
+ * Shouldn't be called in atomic context.
+ */
+int
+trace_buffer_read_message(struct trace_buffer* trace_buffer,
+    int (*process_data)(const void* msg, size_t size, int cpu,
+        u64 ts, bool *consume, void* user_data),
+    int should_wait,
+    void* user_data)
+{
+    int result;
+    bool consume;
+
+    result = trace_buffer_lock_update(trace_buffer, should_wait);
+    if(result)
+        return result;
     //pr_info("Reading message");
-    result = trace_buffer_read_internal(trace_buffer, process_data, user_data);
-out:
+    result = trace_buffer_read_internal(trace_buffer, process_data, user_data,
+        &consume);
     mutex_unlock(&trace_buffer->read_mutex);
     return result;
 }
 
+/*
+ * Read up to 'count' oldest messages from the buffer, in order.
+ *
+ * 'process_data' is called for every message, as for
+ * trace_buffer_read_message(). Reading stops when 'process_data' doesn't
+ * consume message or return negative error code, or when next message
+ * cannot be read without waiting.
+ *
+ * Lock is taken only once for all messages.
+ *
+ * Return number of messages consumed.
+ *
+ * If buffer is empty, and should_wait is 0,
+ * return -EAGAIN; otherwise wait until message will be available.
+ *
+ * If error occures before any message is consumed,
+ * return negative error code.
+ *
+ * Shouldn't be called in atomic context.
+ */
+int
+trace_buffer_read_messages(struct trace_buffer* trace_buffer,
+    int (*process_data)(const void* msg, size_t size, int cpu,
+        u64 ts, bool *consume, void* user_data),
+    int count,
+    int should_wait,
+    void* user_data)
+{
+    int result;
+    int consumed = 0;
+
+    result = trace_buffer_lock_update(trace_buffer, should_wait);
+    if(result)
+        return result;
+
+    while(consumed < count)
+    {
+        bool consume;
+        result = trace_buffer_read_internal(trace_buffer, process_data,
+            user_data, &consume);
+        if(!consume)
+            break;
+        consumed++;
+        if(result < 0)
+            break;
+        if((consumed < count)
+            && trace_buffer_update_internal(trace_buffer, NULL, NULL))
+            break;
+    }
+    mutex_unlock(&trace_buffer->read_mutex);
+    return consumed ? consumed : (result < 0 ? result : 0);
+}
+
 /*
  * Polling read status of trace_buffer.
  *
@@ -623,3 +814,98 @@ int trace_buffer_resize(struct trace_buffer* trace_buffer,
     mutex_unlock(&trace_buffer->read_mutex);
     return result;
 }
+
+/*
+ * Allocate page for page-level reading.
+ *
+ * Return NULL on error.
+ */
+void*
+trace_buffer_alloc_page(struct trace_buffer* trace_buffer)
+{
+    return ring_buffer_alloc_read_page(trace_buffer->buffer);
+}
+
+/*
+ * Free page, allocated with trace_buffer_alloc_page() or returned by
+ * trace_buffer_read_page().
+ */
+void
+trace_buffer_free_page(struct trace_buffer* trace_buffer, void* page)
+{
+    ring_buffer_free_read_page(trace_buffer->buffer, page);
+}
+
+/*
+ * Read messages written on the given cpu into the page.
+ *
+ * '*page' should be allocated with trace_buffer_alloc_page().
+ * On success, it may be replaced with another page, which
+ * should be freed in the same way.
+ *
+ * If 'full' is not 0, only page which is not written anymore
+ * may be read (this is the case, when the page is always swapped).
+ *
+ * Return size of the page content (header included) on success.
+ *
+ * If there is nothing to read, and should_wait is 0,
+ * return 0; otherwise wait until messages will be available.
+ *
+ * If error occures, return negative error code.
+ *
+ * Shouldn't be called in atomic context.
+ */
+int
+trace_buffer_read_page(struct trace_buffer* trace_buffer,
+    void** page, int cpu, int full, int should_wait)
+{
+    if(!cpu_possible(cpu))
+        return -EINVAL;
+
+    if(mutex_lock_killable(&trace_buffer->read_mutex))
+        return -ERESTARTSYS;
+    // Reader of the ring buffer swaps the page, if it is possible,
+    // or copies messages from it otherwise.
+    while(ring_buffer_read_page(trace_buffer->buffer, page, PAGE_SIZE,
+        cpu, full) < 0)
+    {
+        mutex_unlock(&trace_buffer->read_mutex);
+        if(!should_wait)
+            return 0;
+        // Writers do not wake up readers, so simply wait for some time.
+        if(msleep_interruptible(TIME_WAIT_BUFFER))
+            return -ERESTARTSYS;
+        if(mutex_lock_killable(&trace_buffer->read_mutex))
+            return -ERESTARTSYS;
+    }
+    mutex_unlock(&trace_buffer->read_mutex);
+
+    return ring_buffer_page_len(*page);
+}
+
+/*
+ * Polling page-level read status of the given cpu.
+ *
+ * wait_function should have semantic similar to poll_wait().
+ *
+ * Return 1 if there are messages for read on this cpu, 0 otherwise.
+ */
+int
+trace_buffer_poll_read_page(struct trace_buffer* trace_buffer, int cpu,
+    void (*wait_function)(wait_queue_head_t* wq, void* data),
+    void* data)
+{
+    if(!cpu_possible(cpu))
+        return -EINVAL;
+
+    if(wait_function)
+        wait_function(&trace_buffer->rq, data);
+
+    if(!ring_buffer_empty_cpu(trace_buffer->buffer, cpu))
+        return 1;
+
+    if(wait_function)
+        schedule_delayed_work(&trace_buffer->work_wakeup_reader,
+            TIME_WAIT_BUFFER * HZ / 1000/*jiffies in ms*/);
+    return 0;
+}
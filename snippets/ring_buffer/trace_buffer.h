@@ -66,6 +66,33 @@ trace_buffer_read_message(struct trace_buffer* trace_buffer,
     int should_wait,
     void* user_data);
 
+/*
+ * Read up to 'count' oldest messages from the buffer, in order.
+ *
+ * 'process_data' is called for every message, as for
+ * trace_buffer_read_message(). Reading stops when 'process_data' doesn't
+ * consume message or return negative error code, or when next message
+ * cannot be read without waiting.
+ *
+ * Lock is taken only once for all messages.
+ *
+ * Return number of messages consumed.
+ *
+ * If buffer is empty, and should_wait is 0,
+ * return -EAGAIN; otherwise wait until message will be available.
+ *
+ * If error occures before any message is consumed,
+ * return negative error code.
+ *
+ * Shouldn't be called in atomic context.
+ */
+int
+trace_buffer_read_messages(struct trace_buffer* trace_buffer,
+    int (*process_data)(const void* msg, size_t size, int cpu,
+        u64 ts, bool *consume, void* user_data),
+    int count,
+    int should_wait,
+    void* user_data);
 
 /*
  * Polling read status of trace_buffer.
@@ -113,4 +140,70 @@ int
 trace_buffer_resize(struct trace_buffer* trace_buffer,
     unsigned long size);
 
+/*
+ * Page-level reading of the buffer.
+ *
+ * Instead of extracting messages one by one, whole page of the per-cpu
+ * buffer is extracted at once. When possible, the page is swapped with
+ * the page given by the reader, so messages are not copied at all.
+ *
+ * Page contains messages written on one cpu, in the format of the
+ * kernel ring buffer (see 'consumer/trace_consumer.c' for its parser).
+ * Ordering messages from different cpus is up to the reader.
+ *
+ * Page-level reading shouldn't be mixed with trace_buffer_read_message()
+ * for the same buffer: message, which has already been extracted by
+ * the latter one, is never returned in the page.
+ */
+
+/*
+ * Allocate page for page-level reading.
+ *
+ * Return NULL on error.
+ */
+void*
+trace_buffer_alloc_page(struct trace_buffer* trace_buffer);
+
+/*
+ * Free page, allocated with trace_buffer_alloc_page() or returned by
+ * trace_buffer_read_page().
+ */
+void
+trace_buffer_free_page(struct trace_buffer* trace_buffer, void* page);
+
+/*
+ * Read messages written on the given cpu into the page.
+ *
+ * '*page' should be allocated with trace_buffer_alloc_page().
+ * On success, it may be replaced with another page, which
+ * should be freed in the same way.
+ *
+ * If 'full' is not 0, only page which is not written anymore
+ * may be read (this is the case, when the page is always swapped).
+ *
+ * Return size of the page content (header included) on success.
+ *
+ * If there is nothing to read, and should_wait is 0,
+ * return 0; otherwise wait until messages will be available.
+ *
+ * If error occures, return negative error code.
+ *
+ * Shouldn't be called in atomic context.
+ */
+int
+trace_buffer_read_page(struct trace_buffer* trace_buffer,
+    void** page, int cpu, int full, int should_wait);
+
+/*
+ * Polling page-level read status of the given cpu.
+ *
+ * wait_function should have semantic similar to poll_wait().
+ *
+ * Return 1 if there are messages for read on this cpu, 0 otherwise.
+ */
+int
+trace_buffer_poll_read_page(struct trace_buffer* trace_buffer, int cpu,
+    void (*wait_function)(wait_queue_head_t* wq, void* data),
+    void* data);
+
 #endif
\ No newline at end of file
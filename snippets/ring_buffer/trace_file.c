@@ -12,8 +12,31 @@
 
 #include <linux/poll.h>
 
+#include <linux/splice.h> /* splice_to_pipe() and others */
+#include <linux/pipe_fs_i.h> /* pipe buffer operations */
+
 // Name of trace file
 static const char* trace_file_name = "trace";
+/*
+ * Maximum number of messages, extracted from the trace buffer at once.
+ */
+#define TRACE_FILE_BATCH_MESSAGES 128
+/*
+ * Extraction of messages stops when their plain form exceeds this size.
+ */
+#define TRACE_FILE_BATCH_SIZE PAGE_SIZE
+// Name of directory with per-cpu files for page-level reading
+static const char* trace_raw_dir_name = "trace_raw";
+
+/*
+ * Per-cpu file for page-level(binary) reading of the trace.
+ */
+struct trace_raw_file
+{
+    struct trace_file* trace_file;
+    int cpu;
+    struct dentry* file;
+};
 
 /*
  * Struct, which implements trace_file.
@@ -22,10 +45,11 @@ struct trace_file
 {
     //buffer with 'archived' messages
     struct trace_buffer* trace_buffer;
-    //last message in 'plain' form
+    //last messages in 'plain' form
     char* start;//allocated memory
-    char* end;//pointer after the end of the buffer
+    char* end;//pointer after the end of the messages
     char* current_pos;//pointer to the first unread symbol
+    char* limit;//pointer after the end of allocated memory
     //protect the message in 'plain' form from concurrent access.
     struct mutex m;
     //Trace file
@@ -35,19 +59,23 @@ struct trace_file
     // Trace buffer interpretator
     snprintf_message print_message;
     void* user_data;
+    // Directory with files for page-level reading
+    struct dentry* raw_dir;
+    // Per-cpu files for page-level reading(nr_cpu_ids elements)
+    struct trace_raw_file* raw_files;
+    // Copy of file operations for page-level reading with module set.
+    struct file_operations trace_raw_file_ops;
 };
 
 
 /*
- * Updater for last message in plain form.
- * 
- * If plain form of last message is empty, it should set it
- * according to the last message in the trace buffer.
+ * Updater for last messages in plain form.
  * 
- * Return 1 if plain message become non-empty, negative error code otherwise.
+ * Append plain form of the message from the trace buffer
+ * to the messages in plain form, unless there are enough of them.
  * 
- * NOTE: Do not return 0 for do not confuse with buffer emptiness
- * in non-block reading(see trace_buffer_read_message()).
+ * Return 1 if message is appended, 0 if there is no need to append it,
+ * negative error code otherwise.
  */
 static int trace_process_data(const void* msg,
     size_t size, int cpu, u64 ts, bool* consume, void* user_data);
@@ -69,6 +97,34 @@ static struct file_operations trace_file_ops =
     .poll = trace_file_poll,
 };
 
+// Per-cpu file operations for page-level reading
+static int trace_raw_file_open(struct inode *inode, struct file *filp);
+static int trace_raw_file_release(struct inode *inode, struct file *filp);
+// Read whole pages of the trace.
+static ssize_t trace_raw_file_read(struct file *filp,
+    char __user* buf, size_t count, loff_t *f_pos);
+// Move whole pages of the trace into the pipe, without copying.
+static ssize_t trace_raw_file_splice_read(struct file *filp,
+    loff_t *ppos, struct pipe_inode_info *pipe, size_t len,
+    unsigned int flags);
+// Wait until messages will be available on the cpu.
+static unsigned int trace_raw_file_poll(struct file *filp, poll_table *wait);
+
+static struct file_operations trace_raw_file_ops =
+{
+    .owner = NULL, //placeholder for module
+    .open = trace_raw_file_open,
+    .release = trace_raw_file_release,
+    .read = trace_raw_file_read,
+    .splice_read = trace_raw_file_splice_read,
+    .poll = trace_raw_file_poll,
+};
+
+// Create directory with per-cpu files for page-level reading.
+static int trace_raw_files_create(struct trace_file* trace_file,
+    struct dentry* work_dir, struct module* m);
+static void trace_raw_files_destroy(struct trace_file* trace_file);
+
 
 //Implementation of trace file operations
 static int trace_file_open(struct inode *inode, struct file *filp)
@@ -90,18 +146,17 @@ ssize_t trace_file_read(struct file *filp,
     {
         ssize_t error;
         mutex_unlock(&trace_file->m);
-        error = trace_buffer_read_message(trace_file->trace_buffer,
+        error = trace_buffer_read_messages(trace_file->trace_buffer,
             trace_process_data,
+            TRACE_FILE_BATCH_MESSAGES,
             !(filp->f_flags & O_NONBLOCK),
             trace_file);
         if(error < 0)
             return error;
-        if(error == 0)
-            return -EAGAIN;
         if(mutex_lock_interruptible(&trace_file->m))
             return -ERESTARTSYS;
-        //need to verify that plain message is not empty again,
-        //because someone may read it while we reaquire lock
+        //need to verify that plain messages are not empty again,
+        //because someone may read them while we reaquire lock
     }
     if(count > (trace_file->end - trace_file->current_pos))
         count = trace_file->end - trace_file->current_pos;
@@ -151,6 +206,321 @@ static unsigned int trace_file_poll(struct file *filp, poll_table *wait)
     return (can_read < 0) ? POLLERR : (can_read ? (POLLIN | POLLRDNORM) : 0);
 }
 
+//***********Implementation of the page-level reading***********
+/*
+ * State of the opened per-cpu file.
+ *
+ * 'page' is a spare page, which is exchanged with the page of
+ * the trace buffer while reading.
+ *
+ * 'page_mutex' protects 'page' from the concurrent readers of the same
+ * file while it is swapped and copied to the user.
+ */
+struct trace_raw_reader
+{
+    struct trace_buffer* trace_buffer;
+    int cpu;
+    void* page;
+    struct mutex page_mutex;
+};
+
+static int trace_raw_file_open(struct inode *inode, struct file *filp)
+{
+    struct trace_raw_file* raw_file = inode->i_private;
+    struct trace_raw_reader* reader;
+    int result;
+
+    reader = kmalloc(sizeof(*reader), GFP_KERNEL);
+    if(reader == NULL)
+    {
+        pr_err("trace_raw_file_open: Cannot allocate reader.");
+        return -ENOMEM;
+    }
+    reader->trace_buffer = raw_file->trace_file->trace_buffer;
+    reader->cpu = raw_file->cpu;
+    reader->page = trace_buffer_alloc_page(reader->trace_buffer);
+    if(reader->page == NULL)
+    {
+        kfree(reader);
+        return -ENOMEM;
+    }
+    mutex_init(&reader->page_mutex);
+    filp->private_data = reader;
+    result = nonseekable_open(inode, filp);
+    if(result)
+    {
+        mutex_destroy(&reader->page_mutex);
+        trace_buffer_free_page(reader->trace_buffer, reader->page);
+        kfree(reader);
+    }
+    return result;
+}
+
+static int trace_raw_file_release(struct inode *inode, struct file *filp)
+{
+    struct trace_raw_reader* reader = filp->private_data;
+
+    mutex_destroy(&reader->page_mutex);
+    trace_buffer_free_page(reader->trace_buffer, reader->page);
+    kfree(reader);
+    return 0;
+}
+
+/*
+ * Read as many whole pages as 'count' allows.
+ *
+ * Every page is copied to the user once, instead of copying
+ * every message separately. Page may be not filled, rest of it is zeroed.
+ *
+ * The spare page of the reader is used from the swap until the copy
+ * is finished, so concurrent reads of the same file are serialized.
+ */
+ssize_t trace_raw_file_read(struct file *filp,
+    char __user* buf, size_t count, loff_t *f_pos)
+{
+    struct trace_raw_reader* reader = filp->private_data;
+    ssize_t read_size = 0;
+
+    if(count < PAGE_SIZE)
+        return -EINVAL;
+
+    if(mutex_lock_killable(&reader->page_mutex))
+        return -ERESTARTSYS;
+
+    for(; count >= PAGE_SIZE; count -= PAGE_SIZE, buf += PAGE_SIZE)
+    {
+        // Only the first page may be waited for
+        int size = trace_buffer_read_page(reader->trace_buffer,
+            &reader->page, reader->cpu, 0,
+            (read_size == 0) && !(filp->f_flags & O_NONBLOCK));
+        if(size < 0)
+        {
+            if(read_size == 0) read_size = size;
+            break;
+        }
+        if(size == 0)
+            break;
+        if(size < PAGE_SIZE)
+            memset(reader->page + size, 0, PAGE_SIZE - size);
+        if(copy_to_user(buf, reader->page, PAGE_SIZE) != 0)
+        {
+            if(read_size == 0) read_size = -EFAULT;
+            break;
+        }
+        read_size += PAGE_SIZE;
+    }
+    mutex_unlock(&reader->page_mutex);
+
+    return read_size ? read_size : -EAGAIN;
+}
+
+/*
+ * Reference to the page, moved into pipe.
+ *
+ * Page is returned to the trace buffer when the last reference to it
+ * is dropped.
+ */
+struct trace_raw_page_ref
+{
+    struct trace_buffer* trace_buffer;
+    void* page;
+    int ref;
+};
+
+static void trace_raw_page_ref_put(struct trace_raw_page_ref* ref)
+{
+    if(--ref->ref) return;
+    trace_buffer_free_page(ref->trace_buffer, ref->page);
+    kfree(ref);
+}
+
+static void trace_raw_pipe_buf_release(struct pipe_inode_info *pipe,
+    struct pipe_buffer *buf)
+{
+    trace_raw_page_ref_put((struct trace_raw_page_ref*)buf->private);
+    buf->private = 0;
+}
+
+static void trace_raw_pipe_buf_get(struct pipe_inode_info *pipe,
+    struct pipe_buffer *buf)
+{
+    ((struct trace_raw_page_ref*)buf->private)->ref++;
+}
+
+// Page of the trace buffer shouldn't be stolen.
+static int trace_raw_pipe_buf_steal(struct pipe_inode_info *pipe,
+    struct pipe_buffer *buf)
+{
+    return 1;
+}
+
+static const struct pipe_buf_operations trace_raw_pipe_buf_ops =
+{
+    .can_merge = 0,
+    .map = generic_pipe_buf_map,
+    .unmap = generic_pipe_buf_unmap,
+    .confirm = generic_pipe_buf_confirm,
+    .release = trace_raw_pipe_buf_release,
+    .steal = trace_raw_pipe_buf_steal,
+    .get = trace_raw_pipe_buf_get,
+};
+
+// Called for pages, which are not moved into pipe.
+static void trace_raw_spd_release(struct splice_pipe_desc *spd,
+    unsigned int i)
+{
+    trace_raw_page_ref_put((struct trace_raw_page_ref*)spd->partial[i].private);
+    spd->partial[i].private = 0;
+}
+
+/*
+ * Move as many filled pages as 'len' allows into the pipe.
+ *
+ * Only pages which are not written anymore are moved, so every page
+ * is swapped with the spare one and messages are not copied at all.
+ */
+ssize_t trace_raw_file_splice_read(struct file *filp,
+    loff_t *ppos, struct pipe_inode_info *pipe, size_t len,
+    unsigned int flags)
+{
+    struct trace_raw_reader* reader = filp->private_data;
+    struct partial_page partial[PIPE_BUFFERS];
+    struct page *pages[PIPE_BUFFERS];
+    struct splice_pipe_desc spd =
+    {
+        .pages = pages,
+        .partial = partial,
+        .flags = flags,
+        .ops = &trace_raw_pipe_buf_ops,
+        .spd_release = trace_raw_spd_release,
+    };
+    int should_wait = !(flags & SPLICE_F_NONBLOCK)
+        && !(filp->f_flags & O_NONBLOCK);
+    int i;
+
+    if(len < PAGE_SIZE)
+        return -EINVAL;
+
+    for(i = 0; (i < PIPE_BUFFERS) && (len >= PAGE_SIZE); i++, len -= PAGE_SIZE)
+    {
+        int size;
+        struct trace_raw_page_ref* ref = kmalloc(sizeof(*ref), GFP_KERNEL);
+        if(ref == NULL)
+            break;
+        ref->trace_buffer = reader->trace_buffer;
+        ref->ref = 1;
+        ref->page = trace_buffer_alloc_page(reader->trace_buffer);
+        if(ref->page == NULL)
+        {
+            kfree(ref);
+            break;
+        }
+        // Only the first page may be waited for
+        size = trace_buffer_read_page(reader->trace_buffer,
+            &ref->page, reader->cpu, 1, (i == 0) && should_wait);
+        if(size <= 0)
+        {
+            trace_raw_page_ref_put(ref);
+            if((i == 0) && (size < 0))
+                return size;
+            break;
+        }
+        // Rest of the page goes to the user, so clear it.
+        if(size < PAGE_SIZE)
+            memset(ref->page + size, 0, PAGE_SIZE - size);
+
+        spd.pages[i] = virt_to_page(ref->page);
+        spd.partial[i].len = PAGE_SIZE;
+        spd.partial[i].offset = 0;
+        spd.partial[i].private = (unsigned long)ref;
+    }
+    spd.nr_pages = i;
+
+    if(spd.nr_pages == 0)
+        return should_wait ? 0 : -EAGAIN;
+
+    return splice_to_pipe(pipe, &spd);
+}
+
+static unsigned int trace_raw_file_poll(struct file *filp, poll_table *wait)
+{
+    struct trace_raw_reader* reader = filp->private_data;
+    struct trace_file_poll_table table;
+    int can_read;
+
+    table.filp = filp;
+    table.wait = wait;
+    can_read = trace_buffer_poll_read_page(reader->trace_buffer,
+        reader->cpu, trace_file_wait_function, &table);
+
+    return (can_read < 0) ? POLLERR : (can_read ? (POLLIN | POLLRDNORM) : 0);
+}
+
+int trace_raw_files_create(struct trace_file* trace_file,
+    struct dentry* work_dir, struct module* m)
+{
+    int cpu;
+
+    memcpy(&trace_file->trace_raw_file_ops, &trace_raw_file_ops,
+        sizeof(trace_raw_file_ops));
+    trace_file->trace_raw_file_ops.owner = m;
+
+    trace_file->raw_files = kzalloc(
+        sizeof(*trace_file->raw_files) * nr_cpu_ids, GFP_KERNEL);
+    if(trace_file->raw_files == NULL)
+    {
+        pr_err("Cannot allocate array of files for page-level reading.");
+        return -ENOMEM;
+    }
+
+    trace_file->raw_dir = debugfs_create_dir(trace_raw_dir_name, work_dir);
+    if(trace_file->raw_dir == NULL)
+    {
+        pr_err("Cannot create directory for page-level reading.");
+        kfree(trace_file->raw_files);
+        trace_file->raw_files = NULL;
+        return -EINVAL;
+    }
+
+    for_each_possible_cpu(cpu)
+    {
+        char file_name[20];
+        struct trace_raw_file* raw_file = &trace_file->raw_files[cpu];
+
+        raw_file->trace_file = trace_file;
+        raw_file->cpu = cpu;
+
+        snprintf(file_name, sizeof(file_name), "cpu%d", cpu);
+        raw_file->file = debugfs_create_file(file_name,
+            S_IRUGO,
+            trace_file->raw_dir,
+            raw_file,
+            &trace_file->trace_raw_file_ops);
+        if(raw_file->file == NULL)
+        {
+            pr_err("Cannot create file for page-level reading.");
+            trace_raw_files_destroy(trace_file);
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+void trace_raw_files_destroy(struct trace_file* trace_file)
+{
+    int cpu;
+    for_each_possible_cpu(cpu)
+    {
+        // debugfs_remove() ignores NULL
+        debugfs_remove(trace_file->raw_files[cpu].file);
+        trace_file->raw_files[cpu].file = NULL;
+    }
+    debugfs_remove(trace_file->raw_dir);
+    trace_file->raw_dir = NULL;
+    kfree(trace_file->raw_files);
+    trace_file->raw_files = NULL;
+}
+
 //****************Implementation of the interface***************
 /*
  * Write message to the trace.
@@ -169,6 +539,9 @@ void trace_file_write_message(struct trace_file* trace_file,
  *
  * Create file in the given directory in debugfs, using which one can
  * read the trace.
+ * Also create subdirectory 'trace_raw' with per-cpu files 'cpu<N>',
+ * using which one can read the trace by whole pages, in binary form
+ * (read() copies pages, splice() moves them without copying).
  * Module 'm' is prevented from unload while trace file is opened.
  * 
  * 'print_message' is interpretator of trace buffer, 'user_data'
@@ -217,6 +590,14 @@ struct trace_file* trace_file_create(
         kfree(trace_file);
         return NULL;
     }
+
+    if(trace_raw_files_create(trace_file, work_dir, m))
+    {
+        debugfs_remove(trace_file->file);
+        trace_buffer_destroy(trace_file->trace_buffer);
+        kfree(trace_file);
+        return NULL;
+    }
     
     return trace_file;
 }
@@ -227,6 +608,7 @@ struct trace_file* trace_file_create(
  */
 void trace_file_destroy(struct trace_file* trace_file)
 {
+    trace_raw_files_destroy(trace_file);
     debugfs_remove(trace_file->file);
     mutex_destroy(&trace_file->m);
     trace_buffer_destroy(trace_file->trace_buffer);
@@ -245,6 +627,7 @@ void trace_file_reset(struct trace_file* trace_file)
     trace_file->start = NULL;
     trace_file->end = NULL;
     trace_file->current_pos = NULL;
+    trace_file->limit = NULL;
     
     trace_buffer_reset(trace_file->trace_buffer);
     mutex_unlock(&trace_file->m);
@@ -277,6 +660,7 @@ int trace_file_size_set(struct trace_file* trace_file, unsigned long size)
     trace_file->start = NULL;
     trace_file->end = NULL;
     trace_file->current_pos = NULL;
+    trace_file->limit = NULL;
     
     error = trace_buffer_resize(trace_file->trace_buffer, size);
     
@@ -312,41 +696,63 @@ static int trace_process_data(const void* msg,
             msg, msg_size, cpu, ts, trace_file->user_data)
 
     size_t read_size;
+    size_t unread_size;
    
 
     if(mutex_lock_interruptible(&trace_file->m))
     {
         return -ERESTARTSYS;
     }
-    if(trace_file->current_pos != trace_file->end)
+    unread_size = trace_file->end - trace_file->current_pos;
+    if(unread_size >= TRACE_FILE_BATCH_SIZE)
     {
         /*
-         * Someone already update plain message, while we reaquiring lock.
+         * There are enough plain messages(may be, someone already
+         * update them, while we reaquiring lock).
          * So, silently ignore updating.
          */
         mutex_unlock(&trace_file->m);
-        return 1;
+        return 0;
     }
     
     read_size = print_msg(NULL, 0);//determine size of the message
     //Need to allocate buffer for message + '\0' byte, because
     //snprintf appends '\0' in any case, even if it does not need.
-    trace_file->start = krealloc(trace_file->start, read_size + 1,
-        GFP_KERNEL);
-    if(trace_file->start)
+    if(trace_file->end + read_size + 1 > trace_file->limit)
     {
-        // Real printing
-        // read_size + 1 means size of message + '\0' byte
-        print_msg(trace_file->start, read_size + 1);
-        // We don't want to read '\0' byte, so silently ignore it
-        // (read_size without "+1")
-        trace_file->end = trace_file->start + read_size;
-        trace_file->current_pos = trace_file->start;
-        mutex_unlock(&trace_file->m);
-        *consume = 1;//message is processed
-        return 1;
+        // Move unread messages to the start of the buffer,
+        // and enlarge it if needed.
+        size_t size = unread_size + read_size + 1;
+        char* start;
+        if(size < TRACE_FILE_BATCH_SIZE)
+            size = TRACE_FILE_BATCH_SIZE;
+        if(size > trace_file->limit - trace_file->start)
+            start = kmalloc(size, GFP_KERNEL);
+        else
+            start = trace_file->start;
+        if(start == NULL)
+        {
+            mutex_unlock(&trace_file->m);
+            return -ENOMEM;
+        }
+        memmove(start, trace_file->current_pos, unread_size);
+        if(start != trace_file->start)
+        {
+            kfree(trace_file->start);
+            trace_file->start = start;
+            trace_file->limit = start + size;
+        }
+        trace_file->current_pos = start;
+        trace_file->end = start + unread_size;
     }
+    // Real printing
+    // read_size + 1 means size of message + '\0' byte
+    print_msg(trace_file->end, read_size + 1);
+    // We don't want to read '\0' byte, so silently ignore it
+    // (read_size without "+1")
+    trace_file->end += read_size;
     mutex_unlock(&trace_file->m);
-    return -ENOMEM;
+    *consume = 1;//message is processed
+    return 1;
 #undef print_msg
 }
\ No newline at end of file
@@ -46,6 +46,9 @@ typedef int (*snprintf_message)(char* str, size_t size,
  *
  * Create file in the given directory in debugfs, using which one can
  * read the trace.
+ * Also create subdirectory 'trace_raw' with per-cpu files 'cpu<N>',
+ * using which one can read the trace by whole pages, in binary form
+ * (read() copies pages, splice() moves them without copying).
  * Module 'm' is prevented from unload while trace file is opened.
  * 
  * 'print_message' is interpretator of trace buffer, 'user_data'
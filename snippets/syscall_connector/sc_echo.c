@@ -0,0 +1,38 @@
+/*
+ * Echo service over syscall connector(see sc_echo.h).
+ * 
+ * Used as the kernel side for the benchmark 'user_part/sc_bench'.
+ */
+
+#include "syscall_connector.h"
+#include "sc_echo.h"
+
+#include <linux/module.h>
+#include <linux/init.h>
+
+static void sc_echo_cb(sc_interaction* interaction,
+	const void* buf, size_t len, void* data)
+{
+	/* Reply gets id of the request from the interaction */
+	sc_send(interaction, buf, len);
+}
+
+static __init int sc_echo_init(void)
+{
+	if(sc_register_callback_for_type(SC_ECHO_IN_TYPE, sc_echo_cb, NULL))
+	{
+		printk(KERN_INFO "Cannot register callback for echo messages.\n");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static __exit void sc_echo_exit(void)
+{
+	sc_unregister_callback_for_type(SC_ECHO_IN_TYPE);
+}
+
+MODULE_LICENSE("GPL");
+
+module_init(sc_echo_init);
+module_exit(sc_echo_exit);
@@ -0,0 +1,12 @@
+/*
+ * Echo service over syscall connector, used for benchmarks.
+ * 
+ * Every message of type SC_ECHO_IN_TYPE is sent back to the sender.
+ */
+
+#ifndef SC_ECHO_H
+#define SC_ECHO_H
+
+#define SC_ECHO_IN_TYPE 0x4543
+
+#endif /* SC_ECHO_H */
@@ -0,0 +1,222 @@
+/*
+ * Shared-memory transport for syscall connector.
+ *
+ * User space maps memory area of the ring device, which contains two
+ * queues of messages: submission queue(SQ), written by user space and
+ * read by the kernel, and completion queue(CQ), written by the kernel
+ * and read by user space. Messages are copied into the queues directly,
+ * without creating skbs.
+ *
+ * Layout of the area:
+ *
+ * | struct sc_ring_header | ... | SQ data | CQ data |
+ *                  SC_RING_SQ_OFFSET  SC_RING_CQ_OFFSET
+ *
+ * Every queue is a byte ring of SC_RING_QUEUE_SIZE with one producer
+ * and one consumer. 'tail' is the position where producer writes next
+ * entry, 'head' is the position of the first entry which is not
+ * consumed yet. Positions grow continuously, offset in the queue is
+ * position modulo SC_RING_QUEUE_SIZE. Entry is never splitted at the end
+ * of the queue: instead, padding entry is written and entry itself is
+ * placed at the beginning.
+ *
+ * Messages from SQ are processed by the kernel when user space calls
+ * ioctl SC_RING_IOC_ENTER, so this call works as "doorbell" for any
+ * number of requests. Argument of the ioctl, if not 0, requests to wait
+ * until CQ is not empty.
+ *
+ * NOTE: Kernel should never trust content of the area: positions and
+ * entries are verified before use.
+ */
+
+#ifndef SC_RING_H
+#define SC_RING_H
+
+#include "syscall_connector.h" /* interaction_id */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h> /* memcpy */
+#include <linux/ioctl.h>
+#include <linux/compiler.h> /* ACCESS_ONCE */
+#include <asm/system.h> /* smp_mb */
+#else
+#include <linux/types.h>
+#include <string.h> /* memcpy */
+#include <sys/ioctl.h>
+#endif
+
+/* Name of the device, which provides rings */
+#define SC_RING_DEVICE_NAME "sc_ring"
+
+/* Size of every queue, in bytes. Should be power of 2. */
+#define SC_RING_QUEUE_SIZE 65536
+
+#define SC_RING_SQ_OFFSET 4096
+#define SC_RING_CQ_OFFSET (SC_RING_SQ_OFFSET + SC_RING_QUEUE_SIZE)
+/* Size of the area to be mapped */
+#define SC_RING_AREA_SIZE (SC_RING_CQ_OFFSET + SC_RING_QUEUE_SIZE)
+
+/* Process all submitted messages, and wait for completion if arg != 0 */
+#define SC_RING_IOC_ENTER _IO('S', 1)
+
+/* Positions of the queue, every on its own cache line */
+struct sc_ring_positions
+{
+	__u32 head;
+	char pad1[60];
+	__u32 tail;
+	char pad2[60];
+};
+
+struct sc_ring_header
+{
+	struct sc_ring_positions sq;
+	struct sc_ring_positions cq;
+};
+
+/* Header of the message in the queue, followed by the payload */
+struct sc_ring_entry
+{
+	/* Length of the payload, or SC_RING_ENTRY_PADDING */
+	__u32 len;
+	/* Id of the request, same as nlmsg_seq for netlink transport */
+	__u32 seq;
+	interaction_id in_type;
+	__u32 reserved;
+	char payload[0];
+};
+
+/* Rest of the queue up to its end is not used */
+#define SC_RING_ENTRY_PADDING 0xffffffff
+
+#define SC_RING_ENTRY_ALIGN 8
+/* Space occupied by the entry with payload of given length */
+#define SC_RING_ENTRY_SPACE(len) ((sizeof(struct sc_ring_entry) + (len) \
+	+ SC_RING_ENTRY_ALIGN - 1) & ~(SC_RING_ENTRY_ALIGN - 1))
+
+/* Maximum length of payload, which may be put into the queue */
+#define SC_RING_PAYLOAD_MAX (SC_RING_QUEUE_SIZE / 2 \
+	- sizeof(struct sc_ring_entry))
+
+#ifdef __KERNEL__
+/* Read position, which is written by other side */
+#define sc_ring_load_acquire(p) ({ __u32 __v = ACCESS_ONCE(*(p)); smp_mb(); __v; })
+/* Write position, which is read by other side */
+#define sc_ring_store_release(p, v) do { smp_mb(); ACCESS_ONCE(*(p)) = (v); } while(0)
+/* Read field, which may be changed by other side concurrently */
+#define sc_ring_read_once(x) ACCESS_ONCE(x)
+#else
+#define sc_ring_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define sc_ring_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define sc_ring_read_once(x) (*(volatile __typeof__(x)*)&(x))
+#endif
+
+/* One side of the queue */
+struct sc_ring_queue
+{
+	struct sc_ring_positions* pos;
+	char* data;
+};
+
+static inline void sc_ring_queue_init(struct sc_ring_queue* queue,
+	void* area, int is_cq)
+{
+	struct sc_ring_header* header = area;
+	queue->pos = is_cq ? &header->cq : &header->sq;
+	queue->data = (char*)area + (is_cq ? SC_RING_CQ_OFFSET : SC_RING_SQ_OFFSET);
+}
+
+/*
+ * Put message into the queue(producer side).
+ *
+ * Return 0 on success, 1 if there is no space in the queue,
+ * -1 if positions in the queue are incorrect.
+ */
+static inline int sc_ring_queue_put(struct sc_ring_queue* queue,
+	interaction_id in_type, __u32 seq, const void* payload, size_t len)
+{
+	__u32 tail = queue->pos->tail;
+	__u32 head = sc_ring_load_acquire(&queue->pos->head);
+	__u32 offset = tail & (SC_RING_QUEUE_SIZE - 1);
+	__u32 space = SC_RING_ENTRY_SPACE(len);
+	__u32 padding = 0;
+	struct sc_ring_entry* entry;
+
+	if(((__u32)(tail - head) > SC_RING_QUEUE_SIZE)
+		|| (tail & (SC_RING_ENTRY_ALIGN - 1)))
+		return -1;
+	if(offset + space > SC_RING_QUEUE_SIZE)
+		padding = SC_RING_QUEUE_SIZE - offset;
+	if((__u32)(tail - head) + padding + space > SC_RING_QUEUE_SIZE) return 1;
+
+	if(padding)
+	{
+		entry = (struct sc_ring_entry*)(queue->data + offset);
+		entry->len = SC_RING_ENTRY_PADDING;
+		offset = 0;
+	}
+	entry = (struct sc_ring_entry*)(queue->data + offset);
+	entry->len = len;
+	entry->seq = seq;
+	entry->in_type = in_type;
+	entry->reserved = 0;
+	memcpy(entry->payload, payload, len);
+
+	sc_ring_store_release(&queue->pos->tail, tail + padding + space);
+	return 0;
+}
+
+/*
+ * Get first message in the queue(consumer side) and length of its
+ * payload.
+ *
+ * Return 1 on success, 0 if queue is empty, -1 if content of the queue
+ * is incorrect.
+ *
+ * Message should be released with sc_ring_queue_consume() after use.
+ */
+static inline int sc_ring_queue_peek(struct sc_ring_queue* queue,
+	struct sc_ring_entry** entry, __u32* len)
+{
+	__u32 head = queue->pos->head;
+	__u32 tail = sc_ring_load_acquire(&queue->pos->tail);
+	__u32 offset;
+
+	if(head == tail) return 0;
+	if(((__u32)(tail - head) > SC_RING_QUEUE_SIZE)
+		|| (head & (SC_RING_ENTRY_ALIGN - 1)))
+		return -1;
+
+	offset = head & (SC_RING_QUEUE_SIZE - 1);
+	*entry = (struct sc_ring_entry*)(queue->data + offset);
+	*len = sc_ring_read_once((*entry)->len);
+	if(*len == SC_RING_ENTRY_PADDING)
+	{
+		/* Message is at the beginning of the queue */
+		head += SC_RING_QUEUE_SIZE - offset;
+		if(head == tail) return -1;
+		sc_ring_store_release(&queue->pos->head, head);
+		*entry = (struct sc_ring_entry*)queue->data;
+		*len = sc_ring_read_once((*entry)->len);
+		offset = 0;
+	}
+	/* Length is used only after this check, never reread */
+	if((*len > SC_RING_PAYLOAD_MAX)
+		|| (SC_RING_ENTRY_SPACE(*len) > (__u32)(tail - head))
+		|| (offset + SC_RING_ENTRY_SPACE(*len) > SC_RING_QUEUE_SIZE))
+		return -1;
+	return 1;
+}
+
+/*
+ * Release message returned by sc_ring_queue_peek().
+ */
+static inline void sc_ring_queue_consume(struct sc_ring_queue* queue,
+	__u32 len)
+{
+	sc_ring_store_release(&queue->pos->head,
+		queue->pos->head + SC_RING_ENTRY_SPACE(len));
+}
+
+#endif /* SC_RING_H */
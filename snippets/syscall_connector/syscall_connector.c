@@ -9,12 +9,52 @@
 
 #include "syscall_connector.h"
 #include "syscall_connector_internal.h"
+#include "sc_ring.h"
 
 #include <net/sock.h>
 #include <net/netlink.h>
 
 #include <linux/list.h>
 
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+/*
+ * Shared-memory transport(see sc_ring.h).
+ *
+ * Ring is created when device is opened, and exists while it is opened
+ * or some callback is registered for its interaction.
+ */
+
+struct sc_ring
+{
+	struct kref kref;
+	/* Area shared with user space */
+	void* area;
+	struct sc_ring_queue sq;
+	struct sc_ring_queue cq;
+	/* Protects processing of SQ */
+	struct mutex sq_mutex;
+	/* Protects CQ from concurrent replies */
+	spinlock_t cq_lock;
+	/* Waiters for replies */
+	wait_queue_head_t cq_wait;
+	/*
+	 * Messages are copied from SQ here before processing, so user space
+	 * cannot change them while callback works.
+	 */
+	char* msg_buf;
+	/* Used as pid of the interactions via this ring */
+	__u32 id;
+};
+
 
 /*
  * Interaction structure.
@@ -25,6 +65,15 @@ struct _sc_interaction
 {
 	__u32 pid;
 	interaction_id in_type;
+	/*
+	 * Sequence number of the message being processed.
+	 * 
+	 * Reply sent from the callback gets this number, so user space
+	 * may match replies with requests.
+	 */
+	__u32 seq;
+	/* Ring, via which interaction is performed, or NULL for netlink */
+	struct sc_ring* ring;
 };
 
 /*
@@ -81,6 +130,11 @@ static struct callback_info*
 callback_lookup(sc_interaction* interaction);
 // Callback function for the socket
 static void nl_data_ready(struct sk_buff* skb);
+static void sc_dispatch(sc_interaction* interaction,
+	const void* buf, size_t len);
+static int sc_ring_send(sc_interaction* interaction,
+	const void* buf, size_t len);
+static void sc_ring_put(struct sc_ring* ring);
 
 /*
  * Create interaction "channel" with user space.
@@ -96,6 +150,8 @@ sc_interaction* sc_interaction_create(__u32 pid, interaction_id type)
 	}
 	interaction->in_type = type;
 	interaction->pid = pid;
+	interaction->seq = 0;
+	interaction->ring = NULL;
 	return interaction;
 }
 EXPORT_SYMBOL(sc_interaction_create);
@@ -132,8 +188,12 @@ int sc_send(sc_interaction* interaction, const void* buf, size_t len)
 		.payload_length = len
 	};
 	
-	size_t payload_len = sc_msg_len(&msg);
-	
+	size_t payload_len;
+
+	if(interaction->ring)
+		return sc_ring_send(interaction, buf, len);
+
+	payload_len = sc_msg_len(&msg);
 	skb = nlmsg_new(payload_len, GFP_KERNEL);
 	if(!skb)
 	{
@@ -141,7 +201,7 @@ int sc_send(sc_interaction* interaction, const void* buf, size_t len)
 		return -1;
 	}
 	nlh = NLMSG_NEW(skb, interaction->pid,
-		0/*seq*/, 0, payload_len, 0);
+		interaction->seq, 0, payload_len, 0);
 	
 	sc_msg_put(&msg, nlmsg_data(nlh));
 	
@@ -216,6 +276,10 @@ int sc_register_callback(sc_interaction* interaction,
 	}
 	new_cbi->interaction.in_type = interaction->in_type;
 	new_cbi->interaction.pid = interaction->pid;
+	new_cbi->interaction.seq = 0;
+	/* Ring should exist while callback may send replies via it */
+	new_cbi->interaction.ring = interaction->ring;
+	if(interaction->ring) kref_get(&interaction->ring->kref);
 	new_cbi->cb = cb;
 	new_cbi->data = cb_data;
 	
@@ -232,15 +296,18 @@ int sc_unregister_callback(sc_interaction* interaction)
 	if(!cbi) return 1;
 	
 	list_del(&cbi->list);
+	if(cbi->interaction.ring) sc_ring_put(cbi->interaction.ring);
 	kfree(cbi);
 
 	return 0;
 }
 
 ////////////////////////////////////////////////////////////////
-static void nl_data_ready(struct sk_buff* skb)
+/*
+ * Process one message from the user space.
+ */
+static void nl_process_msg(struct sk_buff* skb, struct nlmsghdr* nlh)
 {
-	struct nlmsghdr	*nlh = nlmsg_hdr(skb);
 	struct sc_msg msg;
 	sc_interaction interaction;
 	if(sc_msg_get(&msg, nlmsg_data(nlh), nlmsg_len(nlh)))
@@ -250,30 +317,61 @@ static void nl_data_ready(struct sk_buff* skb)
 	}
 	interaction.in_type = msg.in_type;
 	interaction.pid = NETLINK_CB(skb).pid;
+	interaction.seq = nlh->nlmsg_seq;
+	interaction.ring = NULL;
+	sc_dispatch(&interaction, msg.payload, msg.payload_length);
+}
+
+/*
+ * Call callback for the message, recieved via any transport.
+ */
+static void sc_dispatch(sc_interaction* interaction,
+	const void* buf, size_t len)
+{
 	{
-		struct callback_info* cbi = callback_lookup(&interaction);
+		struct callback_info* cbi = callback_lookup(interaction);
 		if(cbi != NULL)
 		{
 			
-			cbi->cb(&interaction, msg.payload, msg.payload_length,
-				cbi->data);
-			wake_up_interruptible(skb->sk->sk_sleep);
+			cbi->cb(interaction, buf, len, cbi->data);
 			return;
 		}
 	}
 	{
 		struct type_callback_info* cbi = 
-			type_callback_lookup(msg.in_type);
+			type_callback_lookup(interaction->in_type);
 		if(cbi != NULL)
 		{
-			cbi->cb(&interaction, msg.payload, msg.payload_length,
-				cbi->data);
-			wake_up_interruptible(skb->sk->sk_sleep);
+			cbi->cb(interaction, buf, len, cbi->data);
 			return;
 		}
 
 	}
 	printk("Unknown type of message.\n");
+}
+
+static void nl_data_ready(struct sk_buff* skb)
+{
+	/* 
+	 * User space may send many messages at once(see sc_submitv()),
+	 * process all of them.
+	 */
+	while(skb->len >= NLMSG_HDRLEN)
+	{
+		struct nlmsghdr	*nlh = nlmsg_hdr(skb);
+		unsigned int msg_len;
+		
+		if((nlh->nlmsg_len < NLMSG_HDRLEN) || (skb->len < nlh->nlmsg_len))
+		{
+			printk(KERN_INFO "Incorrect format of the message.\n");
+			break;
+		}
+		nl_process_msg(skb, nlh);
+		
+		msg_len = NLMSG_ALIGN(nlh->nlmsg_len);
+		if(msg_len > skb->len) msg_len = skb->len;
+		skb_pull(skb, msg_len);
+	}
 	wake_up_interruptible(skb->sk->sk_sleep);
 }
 
@@ -292,15 +390,184 @@ static struct callback_info*
 callback_lookup(sc_interaction *interaction)
 {
 	struct callback_info* cbi;
-	list_for_each_entry(cbi, &type_callbacks, list)
+	list_for_each_entry(cbi, &callbacks, list)
 	{
 		if(cbi->interaction.pid == interaction->pid
-			&& cbi->interaction.in_type == interaction->in_type)
+			&& cbi->interaction.in_type == interaction->in_type
+			&& cbi->interaction.ring == interaction->ring)
 			return cbi;
 	}
 	return NULL;
 }
 
+/////////////////////// Shared-memory transport ///////////////////////
+
+/* Source of ids for rings */
+static atomic_t sc_ring_last_id = ATOMIC_INIT(0);
+
+static void sc_ring_release(struct kref* kref)
+{
+	struct sc_ring* ring = container_of(kref, struct sc_ring, kref);
+	vfree(ring->area);
+	kfree(ring->msg_buf);
+	kfree(ring);
+}
+
+static void sc_ring_put(struct sc_ring* ring)
+{
+	kref_put(&ring->kref, sc_ring_release);
+}
+
+/*
+ * Put reply into CQ of the ring.
+ *
+ * Like netlink_unicast() with MSG_DONTWAIT, do not wait when there is
+ * no space for reply.
+ */
+static int sc_ring_send(sc_interaction* interaction,
+	const void* buf, size_t len)
+{
+	struct sc_ring* ring = interaction->ring;
+	int result;
+
+	if(len > SC_RING_PAYLOAD_MAX)
+	{
+		printk(KERN_INFO "Reply is too long for the ring.\n");
+		return -1;
+	}
+	spin_lock(&ring->cq_lock);
+	result = sc_ring_queue_put(&ring->cq, interaction->in_type,
+		interaction->seq, buf, len);
+	spin_unlock(&ring->cq_lock);
+	if(result)
+	{
+		printk(KERN_INFO "Cannot put reply into the ring: %s.\n",
+			result > 0 ? "queue is full" : "queue is corrupted");
+		return -1;
+	}
+	wake_up_interruptible(&ring->cq_wait);
+	return 0;
+}
+
+/*
+ * Process all messages in SQ of the ring.
+ */
+static int sc_ring_process(struct sc_ring* ring)
+{
+	struct sc_ring_entry* entry;
+	__u32 len;
+	int result;
+
+	while((result = sc_ring_queue_peek(&ring->sq, &entry, &len)) > 0)
+	{
+		sc_interaction interaction = {
+			.pid = ring->id,
+			.in_type = sc_ring_read_once(entry->in_type),
+			.seq = sc_ring_read_once(entry->seq),
+			.ring = ring
+		};
+		memcpy(ring->msg_buf, entry->payload, len);
+		sc_ring_queue_consume(&ring->sq, len);
+
+		sc_dispatch(&interaction, ring->msg_buf, len);
+	}
+	if(result < 0)
+	{
+		printk(KERN_INFO "Submission queue of the ring is corrupted.\n");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int sc_ring_cq_ready(struct sc_ring* ring)
+{
+	return sc_ring_read_once(ring->cq.pos->head)
+		!= sc_ring_read_once(ring->cq.pos->tail);
+}
+
+static int sc_ring_open(struct inode* inode, struct file* filp)
+{
+	struct sc_ring* ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if(ring == NULL) return -ENOMEM;
+
+	ring->area = vmalloc_user(SC_RING_AREA_SIZE);
+	ring->msg_buf = kmalloc(SC_RING_PAYLOAD_MAX, GFP_KERNEL);
+	if((ring->area == NULL) || (ring->msg_buf == NULL))
+	{
+		vfree(ring->area);
+		kfree(ring->msg_buf);
+		kfree(ring);
+		return -ENOMEM;
+	}
+	kref_init(&ring->kref);
+	sc_ring_queue_init(&ring->sq, ring->area, 0);
+	sc_ring_queue_init(&ring->cq, ring->area, 1);
+	mutex_init(&ring->sq_mutex);
+	spin_lock_init(&ring->cq_lock);
+	init_waitqueue_head(&ring->cq_wait);
+	ring->id = (__u32)atomic_inc_return(&sc_ring_last_id);
+
+	filp->private_data = ring;
+	return nonseekable_open(inode, filp);
+}
+
+static int sc_ring_file_release(struct inode* inode, struct file* filp)
+{
+	sc_ring_put(filp->private_data);
+	return 0;
+}
+
+static int sc_ring_mmap(struct file* filp, struct vm_area_struct* vma)
+{
+	struct sc_ring* ring = filp->private_data;
+
+	if((vma->vm_pgoff != 0)
+		|| (vma->vm_end - vma->vm_start > PAGE_ALIGN(SC_RING_AREA_SIZE)))
+		return -EINVAL;
+	return remap_vmalloc_range(vma, ring->area, 0);
+}
+
+static long sc_ring_ioctl(struct file* filp, unsigned int cmd,
+	unsigned long arg)
+{
+	struct sc_ring* ring = filp->private_data;
+	int result;
+
+	if(cmd != SC_RING_IOC_ENTER) return -ENOTTY;
+
+	mutex_lock(&ring->sq_mutex);
+	result = sc_ring_process(ring);
+	mutex_unlock(&ring->sq_mutex);
+
+	if(result || !arg) return result;
+	return wait_event_interruptible(ring->cq_wait, sc_ring_cq_ready(ring));
+}
+
+static unsigned int sc_ring_poll(struct file* filp, poll_table* wait)
+{
+	struct sc_ring* ring = filp->private_data;
+
+	poll_wait(filp, &ring->cq_wait, wait);
+	return sc_ring_cq_ready(ring) ? (POLLIN | POLLRDNORM) : 0;
+}
+
+static const struct file_operations sc_ring_fops = {
+	.owner = THIS_MODULE,
+	.open = sc_ring_open,
+	.release = sc_ring_file_release,
+	.mmap = sc_ring_mmap,
+	.unlocked_ioctl = sc_ring_ioctl,
+	.poll = sc_ring_poll,
+	.llseek = no_llseek,
+};
+
+static struct miscdevice sc_ring_device = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = SC_RING_DEVICE_NAME,
+	.fops = &sc_ring_fops,
+};
+static int sc_ring_registered;
+
 static __init int signal_connector_init(void)
 {
 	nl_sk = netlink_kernel_create(&init_net,
@@ -314,6 +581,11 @@ static __init int signal_connector_init(void)
 		printk(KERN_INFO "netlink_kernel_create returns NULL.\n");
 		return -1;
 	}
+	/* Shared-memory transport is optional */
+	sc_ring_registered = !misc_register(&sc_ring_device);
+	if(!sc_ring_registered)
+		printk(KERN_INFO "Cannot register device for rings, "
+			"only netlink transport will be available.\n");
 	return 0;
 }
 
@@ -321,6 +593,7 @@ static __exit void signal_connector_exit(void)
 {
 	BUG_ON(!list_empty(&callbacks));
 	BUG_ON(!list_empty(&type_callbacks));
+	if(sc_ring_registered) misc_deregister(&sc_ring_device);
 	netlink_kernel_release(nl_sk);
 }
 
@@ -79,6 +79,8 @@ int sc_unregister_callback(sc_interaction* interaction);
 
 #else /* __KERNEL__ */
 #include <linux/types.h> /* __u32 */
+#include <sys/types.h> /* ssize_t */
+#include <sys/uio.h> /* struct iovec */
 
 typedef struct _sc_interaction sc_interaction;
 
@@ -90,6 +92,34 @@ sc_interaction* sc_interaction_create(__u32 pid, interaction_id in_type);
 
 void sc_interaction_destroy(sc_interaction* interaction);
 
+/*
+ * Return interaction "channel" of given type for the calling thread.
+ * 
+ * Channel is created at the first call in the thread and then reused
+ * by all next calls, so socket is not created for every syscall-like
+ * function. Unique pid for the channel is choosen automatically.
+ * 
+ * Channel is owned by the library and is destroyed when thread exits,
+ * so it shouldn't be passed to sc_interaction_destroy().
+ */
+
+sc_interaction* sc_interaction_get(interaction_id in_type);
+
+/*
+ * Create interaction "channel" with kernel, which uses shared-memory
+ * ring instead of netlink socket(see sc_ring.h).
+ * 
+ * Messages are copied into memory shared with the kernel, and one
+ * system call both delivers all submitted requests and waits for
+ * replies. Replies, sent from the callbacks synchronously, are
+ * recieved without system call at all.
+ * 
+ * If rings are not supported by the kernel, netlink channel is
+ * created instead. Channel should be used by one thread at a time.
+ */
+
+sc_interaction* sc_interaction_create_ring(interaction_id in_type);
+
 /*
  * Send message to the kernel with content of 'buffer' via 'interaction'.
  */
@@ -101,6 +131,44 @@ ssize_t sc_send(sc_interaction* interaction, const void* buf, size_t len);
  */
 
 ssize_t sc_recv(sc_interaction* interaction, void* buf, size_t len);
+
+/*
+ * Asynchronous interface.
+ * 
+ * Many requests may be sent via one interaction without waiting for
+ * replies. Every request is assigned an id, reply sent by the kernel
+ * from the callback for this request has the same id.
+ */
+
+/*
+ * Send request to the kernel and store its id in 'request_id'.
+ * 
+ * Return 0 on success, -1 on error.
+ */
+
+int sc_submit(sc_interaction* interaction, const void* buf, size_t len,
+	__u32* request_id);
+
+/*
+ * Send 'n' requests with one system call.
+ * 
+ * Request 'requests[i]' is assigned id '*request_id + i'.
+ * 
+ * Return 0 on success, -1 on error.
+ */
+
+int sc_submitv(sc_interaction* interaction, const struct iovec* requests,
+	int n, __u32* request_id);
+
+/*
+ * Recieve reply for one of the requests sent.
+ * 
+ * Store id of the request in 'request_id' and return length of the reply.
+ * On error return -1.
+ */
+
+ssize_t sc_complete(sc_interaction* interaction, void* buf, size_t len,
+	__u32* request_id);
 #endif /* __KERNEL__ */
 
 #endif /* SYSCALL_CONNECTOR_H */
@@ -0,0 +1,354 @@
+/*
+ * Benchmark for syscall connector.
+ *
+ * Requires 'sc_echo' module to be loaded, which sends every message
+ * back(see sc_echo.h).
+ *
+ * Modes:
+ *
+ * create - interaction is created and destroyed for every call
+ *   (simple pattern described in README),
+ * cached - per-thread interaction from sc_interaction_get() is used,
+ * async - 'depth' requests are submitted one by one, then all
+ *   replies are recieved,
+ * vector - 'depth' requests are submitted with one sc_submitv() call,
+ *   then all replies are recieved.
+ *
+ * With '-r' option, interactions use shared-memory ring instead of
+ * netlink(see sc_interaction_create_ring()); in 'cached' and async modes
+ * every thread creates one such interaction.
+ *
+ * Calls per second and average latency of the call(for async modes -
+ * of the batch of 'depth' calls) are reported.
+ *
+ * When built with SC_RING_SIMULATION('sc_bench_sim'), kernel side of the
+ * rings is simulated in user space and echo is performed by the callback
+ * registered in the simulation, so no modules are needed. Only ring
+ * transport is available in that case.
+ */
+
+#include "../syscall_connector.h"
+#include "../sc_echo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef SC_RING_SIMULATION
+#include "sc_ring_sim.h"
+#endif
+
+enum bench_mode
+{
+	bench_mode_create,
+	bench_mode_cached,
+	bench_mode_async,
+	bench_mode_vector,
+};
+
+static const char* mode_names[] = {"create", "cached", "async", "vector"};
+
+struct bench_params
+{
+	enum bench_mode mode;
+	unsigned long calls;
+	size_t size;
+	int depth;
+	int use_ring;
+};
+
+struct bench_thread
+{
+	pthread_t thread;
+	const struct bench_params* params;
+	int index;
+	int result;
+};
+
+static double current_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char* program_name)
+{
+	printf("Usage: %s [-m create|cached|async|vector] [-n calls] "
+		"[-s size] [-d depth] [-t threads] [-r]\n", program_name);
+}
+
+/* Check reply and its id */
+static int check_reply(ssize_t len, const char* request, const char* reply,
+	size_t size, __u32 request_id, __u32 expected_id)
+{
+	if(len != (ssize_t)size || memcmp(request, reply, size))
+	{
+		printf("Incorrect reply.\n");
+		return -1;
+	}
+	if(request_id != expected_id)
+	{
+		printf("Reply for request %u is recieved instead of %u.\n",
+			(unsigned)request_id, (unsigned)expected_id);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Return interaction for the calls in the thread('cached' and async modes).
+ *
+ * Interaction should be released with bench_interaction_put().
+ */
+static sc_interaction* bench_interaction_get(const struct bench_params* params)
+{
+	if(params->use_ring)
+		return sc_interaction_create_ring(SC_ECHO_IN_TYPE);
+	return sc_interaction_get(SC_ECHO_IN_TYPE);
+}
+
+static void bench_interaction_put(const struct bench_params* params,
+	sc_interaction* interaction)
+{
+	/* Interactions from sc_interaction_get() are owned by the library */
+	if(params->use_ring)
+		sc_interaction_destroy(interaction);
+}
+
+static int bench_sync(const struct bench_params* params, int index,
+	sc_interaction* cached, char* request, char* reply)
+{
+	unsigned long i;
+	/* Unique pid for create mode, as README suggests */
+	__u32 pid = ((__u32)index << 16) | (__u32)getpid();
+
+	for(i = 0; i < params->calls; i++)
+	{
+		ssize_t len;
+		sc_interaction* interaction;
+
+		if(params->mode != bench_mode_create)
+			interaction = cached;
+		else if(params->use_ring)
+			interaction = sc_interaction_create_ring(SC_ECHO_IN_TYPE);
+		else
+			interaction = sc_interaction_create(pid, SC_ECHO_IN_TYPE);
+		if(interaction == NULL) return -1;
+
+		*(unsigned long*)request = i;
+		if(sc_send(interaction, request, params->size) == -1) return -1;
+		len = sc_recv(interaction, reply, params->size);
+		if(params->mode == bench_mode_create)
+			sc_interaction_destroy(interaction);
+
+		if(check_reply(len, request, reply, params->size, 0, 0)) return -1;
+	}
+	return 0;
+}
+
+static int bench_async(const struct bench_params* params,
+	sc_interaction* interaction, char* requests, char* reply)
+{
+	unsigned long i;
+	int j;
+	struct iovec* iov;
+
+	iov = malloc(params->depth * sizeof(*iov));
+	if(iov == NULL)
+	{
+		printf("Cannot allocate requests.\n");
+		return -1;
+	}
+	for(j = 0; j < params->depth; j++)
+	{
+		iov[j].iov_base = requests + j * params->size;
+		iov[j].iov_len = params->size;
+	}
+
+	for(i = 0; i < params->calls; i += params->depth)
+	{
+		__u32 first_id, request_id;
+		int n = params->depth;
+		if(params->calls - i < (unsigned long)n) n = params->calls - i;
+
+		for(j = 0; j < n; j++)
+			*(unsigned long*)iov[j].iov_base = i + j;
+
+		if(params->mode == bench_mode_vector)
+		{
+			if(sc_submitv(interaction, iov, n, &first_id)) goto err;
+		}
+		else
+		{
+			for(j = 0; j < n; j++)
+			{
+				if(sc_submit(interaction, iov[j].iov_base, iov[j].iov_len,
+					&request_id)) goto err;
+				if(j == 0) first_id = request_id;
+			}
+		}
+		/* Replies come in order of requests */
+		for(j = 0; j < n; j++)
+		{
+			ssize_t len = sc_complete(interaction, reply, params->size,
+				&request_id);
+			if(check_reply(len, iov[j].iov_base, reply, params->size,
+				request_id, first_id + j)) goto err;
+		}
+	}
+	free(iov);
+	return 0;
+err:
+	free(iov);
+	return -1;
+}
+
+static void* bench_thread_func(void* data)
+{
+	struct bench_thread* thread = data;
+	const struct bench_params* params = thread->params;
+	char* requests = calloc(params->depth, params->size);
+	char* reply = malloc(params->size);
+	sc_interaction* interaction = NULL;
+
+	if((requests == NULL) || (reply == NULL))
+	{
+		printf("Cannot allocate buffers.\n");
+		thread->result = -1;
+	}
+	else if(params->mode == bench_mode_create)
+		thread->result = bench_sync(params, thread->index, NULL,
+			requests, reply);
+	else if((interaction = bench_interaction_get(params)) == NULL)
+		thread->result = -1;
+	else if(params->mode == bench_mode_cached)
+		thread->result = bench_sync(params, thread->index, interaction,
+			requests, reply);
+	else
+		thread->result = bench_async(params, interaction, requests, reply);
+
+	if(interaction) bench_interaction_put(params, interaction);
+	free(requests);
+	free(reply);
+	return NULL;
+}
+
+#ifdef SC_RING_SIMULATION
+/* Same as callback in sc_echo module */
+static void sim_echo_cb(sc_sim_interaction* interaction,
+	const void* buf, size_t len, void* data)
+{
+	(void)data;
+	sc_sim_send(interaction, buf, len);
+}
+#endif
+
+int main(int argc, char** argv)
+{
+	struct bench_params params = {
+		.mode = bench_mode_cached,
+		.calls = 100000,
+		.size = 64,
+		.depth = 16,
+	};
+	int n_threads = 1;
+	int opt, i;
+	int result = 0;
+	struct bench_thread* threads;
+	double start, time;
+
+	while((opt = getopt(argc, argv, "m:n:s:d:t:r")) != -1)
+	{
+		switch(opt)
+		{
+		case 'm':
+			for(i = 0; i < (int)(sizeof(mode_names) / sizeof(mode_names[0])); i++)
+				if(strcmp(optarg, mode_names[i]) == 0) break;
+			if(i == (int)(sizeof(mode_names) / sizeof(mode_names[0])))
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			params.mode = i;
+			break;
+		case 'n':
+			params.calls = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			params.size = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			params.depth = atoi(optarg);
+			break;
+		case 't':
+			n_threads = atoi(optarg);
+			break;
+		case 'r':
+			params.use_ring = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if((params.calls == 0) || (params.size < sizeof(unsigned long))
+		|| (params.depth <= 0) || (n_threads <= 0))
+	{
+		printf("Number of calls, depth and number of threads should be "
+			"positive, size should be at least %d.\n",
+			(int)sizeof(unsigned long));
+		return 1;
+	}
+
+#ifdef SC_RING_SIMULATION
+	params.use_ring = 1;
+	sc_sim_register_callback_for_type(SC_ECHO_IN_TYPE, sim_echo_cb, NULL);
+#endif
+
+	threads = calloc(n_threads, sizeof(*threads));
+	if(threads == NULL)
+	{
+		printf("Cannot allocate threads.\n");
+		return 1;
+	}
+
+	start = current_time();
+	for(i = 0; i < n_threads; i++)
+	{
+		threads[i].params = &params;
+		threads[i].index = i;
+		if(pthread_create(&threads[i].thread, NULL, bench_thread_func,
+			&threads[i]))
+		{
+			printf("Cannot create thread.\n");
+			n_threads = i;
+			result = 1;
+			break;
+		}
+	}
+	for(i = 0; i < n_threads; i++)
+	{
+		pthread_join(threads[i].thread, NULL);
+		if(threads[i].result) result = 1;
+	}
+	time = current_time() - start;
+	free(threads);
+
+	if(result) return result;
+
+	printf("mode %s%s, %d threads, %lu calls per thread, size %zu",
+		mode_names[params.mode], params.use_ring ? " (ring)" : "", n_threads, params.calls, params.size);
+	if(params.mode == bench_mode_async || params.mode == bench_mode_vector)
+		printf(", depth %d", params.depth);
+	printf("\n%.0f calls/s, average latency %.2f us\n",
+		params.calls * n_threads / time,
+		time * 1e6 / params.calls
+			* ((params.mode == bench_mode_async
+				|| params.mode == bench_mode_vector) ? params.depth : 1));
+
+	return 0;
+}
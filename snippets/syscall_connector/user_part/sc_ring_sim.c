@@ -0,0 +1,202 @@
+/*
+ * User-space simulation of the kernel side of the rings(see sc_ring_sim.h).
+ *
+ * Follows ring part of the kernel ../syscall_connector.c: mutex instead of
+ * sq_mutex, mutex and condition variable instead of cq_lock and cq_wait.
+ */
+
+#include "sc_ring_sim.h"
+#include "../sc_ring.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+/* Simulated rings, descriptor of the ring is index in the array */
+#define SC_SIM_RINGS_MAX 64
+
+struct sc_sim_ring
+{
+	/* NULL if ring is not opened */
+	void* area;
+	struct sc_ring_queue sq;
+	struct sc_ring_queue cq;
+	pthread_mutex_t sq_mutex;
+	pthread_mutex_t cq_lock;
+	pthread_cond_t cq_wait;
+	/* Messages are copied here before processing, as in the kernel */
+	char msg_buf[SC_RING_PAYLOAD_MAX];
+};
+
+static struct sc_sim_ring* rings[SC_SIM_RINGS_MAX];
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define SC_SIM_CALLBACKS_MAX 16
+
+struct sc_sim_callback_info
+{
+	interaction_id in_type;
+	sc_sim_callback_type cb;
+	void* data;
+};
+
+static struct sc_sim_callback_info callbacks[SC_SIM_CALLBACKS_MAX];
+static int n_callbacks;
+
+static struct sc_sim_callback_info* callback_lookup(interaction_id in_type)
+{
+	int i;
+	for(i = 0; i < n_callbacks; i++)
+		if(callbacks[i].in_type == in_type) return &callbacks[i];
+	return NULL;
+}
+
+int sc_sim_register_callback_for_type(interaction_id type,
+	sc_sim_callback_type cb, void* data)
+{
+	if(callback_lookup(type)) return 1;//already exist
+	if(n_callbacks == SC_SIM_CALLBACKS_MAX) return -1;
+
+	callbacks[n_callbacks].in_type = type;
+	callbacks[n_callbacks].cb = cb;
+	callbacks[n_callbacks].data = data;
+	n_callbacks++;
+	return 0;
+}
+
+int sc_sim_unregister_callback_for_type(interaction_id type)
+{
+	struct sc_sim_callback_info* cbi = callback_lookup(type);
+	if(!cbi) return 1;
+
+	*cbi = callbacks[--n_callbacks];
+	return 0;
+}
+
+int sc_ring_open(void** area)
+{
+	int fd;
+	struct sc_sim_ring* ring = malloc(sizeof(*ring));
+	if(ring == NULL) return -1;
+
+	if(posix_memalign(&ring->area, 4096, SC_RING_AREA_SIZE))
+	{
+		free(ring);
+		return -1;
+	}
+	memset(ring->area, 0, SC_RING_AREA_SIZE);
+	sc_ring_queue_init(&ring->sq, ring->area, 0);
+	sc_ring_queue_init(&ring->cq, ring->area, 1);
+	pthread_mutex_init(&ring->sq_mutex, NULL);
+	pthread_mutex_init(&ring->cq_lock, NULL);
+	pthread_cond_init(&ring->cq_wait, NULL);
+
+	pthread_mutex_lock(&rings_mutex);
+	for(fd = 0; fd < SC_SIM_RINGS_MAX; fd++)
+		if(rings[fd] == NULL) break;
+	if(fd < SC_SIM_RINGS_MAX)
+		rings[fd] = ring;
+	pthread_mutex_unlock(&rings_mutex);
+
+	if(fd == SC_SIM_RINGS_MAX)
+	{
+		free(ring->area);
+		free(ring);
+		return -1;
+	}
+	*area = ring->area;
+	return fd;
+}
+
+void sc_ring_close(int fd, void* area)
+{
+	struct sc_sim_ring* ring = rings[fd];
+	(void)area;
+
+	pthread_mutex_lock(&rings_mutex);
+	rings[fd] = NULL;
+	pthread_mutex_unlock(&rings_mutex);
+
+	pthread_mutex_destroy(&ring->sq_mutex);
+	pthread_mutex_destroy(&ring->cq_lock);
+	pthread_cond_destroy(&ring->cq_wait);
+	free(ring->area);
+	free(ring);
+}
+
+int sc_sim_send(sc_sim_interaction* interaction, const void* buf, size_t len)
+{
+	struct sc_sim_ring* ring = rings[interaction->ring];
+	int result;
+
+	if(len > SC_RING_PAYLOAD_MAX)
+	{
+		printf("Reply is too long for the ring.\n");
+		return -1;
+	}
+	pthread_mutex_lock(&ring->cq_lock);
+	result = sc_ring_queue_put(&ring->cq, interaction->in_type,
+		interaction->seq, buf, len);
+	if(!result) pthread_cond_broadcast(&ring->cq_wait);
+	pthread_mutex_unlock(&ring->cq_lock);
+
+	return result ? -1 : 0;
+}
+
+static int sc_sim_ring_process(int fd)
+{
+	struct sc_sim_ring* ring = rings[fd];
+	struct sc_ring_entry* entry;
+	__u32 len;
+	int result;
+
+	while((result = sc_ring_queue_peek(&ring->sq, &entry, &len)) > 0)
+	{
+		struct sc_sim_callback_info* cbi;
+		sc_sim_interaction interaction = {
+			.ring = fd,
+			.in_type = sc_ring_read_once(entry->in_type),
+			.seq = sc_ring_read_once(entry->seq)
+		};
+		memcpy(ring->msg_buf, entry->payload, len);
+		sc_ring_queue_consume(&ring->sq, len);
+
+		cbi = callback_lookup(interaction.in_type);
+		if(cbi != NULL)
+			cbi->cb(&interaction, ring->msg_buf, len, cbi->data);
+		else
+			printf("Unknown type of message.\n");
+	}
+	return result;
+}
+
+static int sc_sim_ring_cq_ready(struct sc_sim_ring* ring)
+{
+	return sc_ring_read_once(ring->cq.pos->head)
+		!= sc_ring_read_once(ring->cq.pos->tail);
+}
+
+int sc_ring_enter(int fd, int wait)
+{
+	struct sc_sim_ring* ring = rings[fd];
+	int result;
+
+	pthread_mutex_lock(&ring->sq_mutex);
+	result = sc_sim_ring_process(fd);
+	pthread_mutex_unlock(&ring->sq_mutex);
+
+	if(result < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(!wait) return 0;
+
+	pthread_mutex_lock(&ring->cq_lock);
+	while(!sc_sim_ring_cq_ready(ring))
+		pthread_cond_wait(&ring->cq_wait, &ring->cq_lock);
+	pthread_mutex_unlock(&ring->cq_lock);
+	return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * User-space simulation of the kernel side of the rings(see ../sc_ring.h).
+ *
+ * Library built with SC_RING_SIMULATION uses functions below instead of
+ * the ring device, so ring transport may be tested and measured without
+ * kernel modules.
+ *
+ * As in the kernel, messages from SQ are dispatched to the callbacks in
+ * the context of sc_ring_enter(), reply may be sent from the callback or
+ * later from any thread.
+ */
+
+#ifndef SC_RING_SIM_H
+#define SC_RING_SIM_H
+
+#include "../syscall_connector.h"
+
+/* Replacements for the device operations */
+int sc_ring_open(void** area);
+int sc_ring_enter(int fd, int wait);
+void sc_ring_close(int fd, void* area);
+
+/*
+ * Kernel-side interaction. May be copied by the callback for send
+ * reply later.
+ */
+typedef struct
+{
+	int ring;
+	interaction_id in_type;
+	__u32 seq;
+} sc_sim_interaction;
+
+typedef void (*sc_sim_callback_type)(sc_sim_interaction* interaction,
+	const void* buf, size_t len, void* data);
+
+/*
+ * Analogues of sc_register_callback_for_type() and
+ * sc_unregister_callback_for_type() of the kernel part.
+ *
+ * Should not be called while messages are dispatched.
+ */
+int sc_sim_register_callback_for_type(interaction_id type,
+	sc_sim_callback_type cb, void* data);
+int sc_sim_unregister_callback_for_type(interaction_id type);
+
+/*
+ * Analogue of sc_send() of the kernel part.
+ *
+ * Return 0 on success, -1 if reply cannot be put into the ring.
+ */
+int sc_sim_send(sc_sim_interaction* interaction, const void* buf, size_t len);
+
+#endif /* SC_RING_SIM_H */
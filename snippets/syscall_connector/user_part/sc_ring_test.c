@@ -0,0 +1,263 @@
+/*
+ * Tests for shared-memory transport(see ../sc_ring.h).
+ *
+ * Built with the library in SC_RING_SIMULATION mode, so kernel side of
+ * the rings is simulated in user space(see sc_ring_sim.h).
+ *
+ * Return 0 if all tests pass.
+ */
+
+#include "../syscall_connector.h"
+#include "../sc_ring.h"
+#include "sc_ring_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define ECHO_TYPE 1
+/* Reply is sent from other thread after delay */
+#define DEFERRED_TYPE 2
+/* Reply is sent without checking result, which is counted instead */
+#define COUNTED_TYPE 3
+
+static int n_failed;
+
+#define CHECK(cond) do { if(!(cond)) { \
+	printf("%s:%d: check '%s' failed.\n", __FILE__, __LINE__, #cond); \
+	n_failed++; return; } } while(0)
+
+static void echo_cb(sc_sim_interaction* interaction,
+	const void* buf, size_t len, void* data)
+{
+	(void)data;
+	sc_sim_send(interaction, buf, len);
+}
+
+static void* deferred_reply(void* data)
+{
+	sc_sim_interaction* interaction = data;
+	usleep(100000);
+	sc_sim_send(interaction, "deferred", 8);
+	free(interaction);
+	return NULL;
+}
+
+static void deferred_cb(sc_sim_interaction* interaction,
+	const void* buf, size_t len, void* data)
+{
+	pthread_t thread;
+	sc_sim_interaction* copy = malloc(sizeof(*copy));
+	(void)buf;
+	(void)len;
+	(void)data;
+
+	*copy = *interaction;
+	pthread_create(&thread, NULL, deferred_reply, copy);
+	pthread_detach(thread);
+}
+
+static int n_dropped;
+
+static void counted_cb(sc_sim_interaction* interaction,
+	const void* buf, size_t len, void* data)
+{
+	(void)data;
+	if(sc_sim_send(interaction, buf, len)) n_dropped++;
+}
+
+/* Operations on the queue itself, without transport */
+static void test_queue(void)
+{
+	static char area[SC_RING_AREA_SIZE] __attribute__((aligned(4096)));
+	struct sc_ring_queue producer, consumer;
+	struct sc_ring_entry* entry;
+	char payload[1000];
+	__u32 len, seq_put = 0, seq_get = 0;
+	int i;
+
+	memset(area, 0, sizeof(area));
+	sc_ring_queue_init(&producer, area, 0);
+	sc_ring_queue_init(&consumer, area, 0);
+
+	CHECK(sc_ring_queue_peek(&consumer, &entry, &len) == 0);
+
+	/* Fill the queue */
+	while(sc_ring_queue_put(&producer, 5, seq_put, payload, 100) == 0)
+		seq_put++;
+	CHECK(seq_put == SC_RING_QUEUE_SIZE / SC_RING_ENTRY_SPACE(100));
+
+	/* Sizes differ, so messages wrap at different offsets */
+	for(i = 0; i < 100000; i++)
+	{
+		size_t size = (i * 7919) % sizeof(payload);
+
+		CHECK(sc_ring_queue_peek(&consumer, &entry, &len) == 1);
+		CHECK(entry->seq == seq_get && entry->in_type == 5);
+		if(len != 100 && len != 0)
+			CHECK(entry->payload[0] == (char)entry->seq);
+		sc_ring_queue_consume(&consumer, len);
+		seq_get++;
+
+		payload[0] = (char)seq_put;
+		while(sc_ring_queue_put(&producer, 5, seq_put, payload, size) == 0)
+		{
+			seq_put++;
+			payload[0] = (char)seq_put;
+		}
+	}
+	while(sc_ring_queue_peek(&consumer, &entry, &len) == 1)
+	{
+		CHECK(entry->seq == seq_get);
+		sc_ring_queue_consume(&consumer, len);
+		seq_get++;
+	}
+	CHECK(seq_get == seq_put);
+
+	/* Incorrect positions and entries are rejected */
+	producer.pos->tail += SC_RING_QUEUE_SIZE + SC_RING_ENTRY_ALIGN;
+	CHECK(sc_ring_queue_put(&producer, 5, 0, payload, 10) == -1);
+	CHECK(sc_ring_queue_peek(&consumer, &entry, &len) == -1);
+
+	producer.pos->tail = producer.pos->head + 3;
+	CHECK(sc_ring_queue_put(&producer, 5, 0, payload, 10) == -1);
+
+	producer.pos->tail = producer.pos->head;
+	CHECK(sc_ring_queue_put(&producer, 5, 0, payload, 10) == 0);
+	entry = (struct sc_ring_entry*)(producer.data
+		+ (producer.pos->head & (SC_RING_QUEUE_SIZE - 1)));
+	entry->len = 100;
+	CHECK(sc_ring_queue_peek(&consumer, &entry, &len) == -1);
+}
+
+/* Synchronous calls with various sizes */
+static void test_sync(void)
+{
+	char request[3000], reply[3000];
+	sc_interaction* interaction = sc_interaction_create_ring(ECHO_TYPE);
+	int i;
+
+	CHECK(interaction != NULL);
+	for(i = 0; i < 20000; i++)
+	{
+		size_t size = (i * 104729) % sizeof(request);
+		memset(request, i, size);
+		CHECK(sc_send(interaction, request, size) == (ssize_t)size);
+		CHECK(sc_recv(interaction, reply, sizeof(reply)) == (ssize_t)size);
+		CHECK(memcmp(request, reply, size) == 0);
+	}
+	/* Reply longer than buffer */
+	CHECK(sc_send(interaction, request, 100) == 100);
+	CHECK(sc_recv(interaction, reply, 10) == -1);
+	/* Request longer than queue allows */
+	CHECK(sc_send(interaction, request, SC_RING_PAYLOAD_MAX + 1) == -1);
+
+	sc_interaction_destroy(interaction);
+}
+
+/* Many requests in flight, ids of replies */
+static void test_async(void)
+{
+	char requests[64][200], reply[200];
+	struct iovec iov[64];
+	sc_interaction* interaction = sc_interaction_create_ring(ECHO_TYPE);
+	__u32 first_id, request_id;
+	int i, j;
+
+	CHECK(interaction != NULL);
+	for(i = 0; i < 64; i++)
+	{
+		iov[i].iov_base = requests[i];
+		iov[i].iov_len = sizeof(requests[i]);
+	}
+	for(i = 0; i < 1000; i++)
+	{
+		for(j = 0; j < 64; j++)
+			memset(requests[j], i + j, sizeof(requests[j]));
+		if(i % 2)
+		{
+			CHECK(sc_submitv(interaction, iov, 64, &first_id) == 0);
+		}
+		else
+		{
+			for(j = 0; j < 64; j++)
+			{
+				CHECK(sc_submit(interaction, requests[j], sizeof(requests[j]),
+					&request_id) == 0);
+				if(j == 0) first_id = request_id;
+				CHECK(request_id == first_id + j);
+			}
+		}
+		for(j = 0; j < 64; j++)
+		{
+			CHECK(sc_complete(interaction, reply, sizeof(reply), &request_id)
+				== sizeof(reply));
+			CHECK(request_id == first_id + j);
+			CHECK(memcmp(reply, requests[j], sizeof(reply)) == 0);
+		}
+	}
+	sc_interaction_destroy(interaction);
+}
+
+/* Waiting for reply, which is not sent from the callback */
+static void test_deferred(void)
+{
+	char reply[100];
+	sc_interaction* interaction = sc_interaction_create_ring(DEFERRED_TYPE);
+
+	CHECK(interaction != NULL);
+	CHECK(sc_send(interaction, "request", 7) == 7);
+	CHECK(sc_recv(interaction, reply, sizeof(reply)) == 8);
+	CHECK(memcmp(reply, "deferred", 8) == 0);
+
+	sc_interaction_destroy(interaction);
+}
+
+/* Replies which do not fit into CQ are dropped, others are in order */
+static void test_overflow(void)
+{
+	char request[1000], reply[1000];
+	sc_interaction* interaction = sc_interaction_create_ring(COUNTED_TYPE);
+	__u32 first_id, request_id;
+	int i, n = 3 * SC_RING_QUEUE_SIZE / sizeof(request);
+	int n_replies = SC_RING_QUEUE_SIZE / SC_RING_ENTRY_SPACE(sizeof(request));
+
+	CHECK(interaction != NULL);
+	for(i = 0; i < n; i++)
+	{
+		CHECK(sc_submit(interaction, request, sizeof(request),
+			&request_id) == 0);
+		if(i == 0) first_id = request_id;
+	}
+	CHECK(n_dropped == n - n_replies);
+	for(i = 0; i < n_replies; i++)
+	{
+		CHECK(sc_complete(interaction, reply, sizeof(reply), &request_id)
+			== sizeof(reply));
+		CHECK(request_id == first_id + i);
+	}
+	sc_interaction_destroy(interaction);
+}
+
+int main(void)
+{
+	sc_sim_register_callback_for_type(ECHO_TYPE, echo_cb, NULL);
+	sc_sim_register_callback_for_type(DEFERRED_TYPE, deferred_cb, NULL);
+	sc_sim_register_callback_for_type(COUNTED_TYPE, counted_cb, NULL);
+
+	test_queue();
+	test_sync();
+	test_async();
+	test_deferred();
+	test_overflow();
+
+	if(n_failed)
+	{
+		printf("%d tests failed.\n", n_failed);
+		return 1;
+	}
+	printf("All tests passed.\n");
+	return 0;
+}
@@ -18,6 +18,10 @@
 #include <sys/socket.h>
 #include <linux/netlink.h>
 #include <unistd.h> /* close() and getpid()*/
+#include <fcntl.h> /* open() */
+#include <sys/mman.h> /* mmap() */
+
+#include <pthread.h> /* for destroy cached interactions */
 
 #include <errno.h>
 
@@ -25,119 +29,495 @@
 
 #include "../syscall_connector_internal.h"
 
+#include "../sc_ring.h"
+
 struct _sc_interaction
 {
+	/* Netlink socket or descriptor of the ring */
 	int sock_fd;
 	__u32 pid;
 	interaction_id in_type;
-	//may be other fields(e.g, sequence)
+	/* Id of the next request */
+	__u32 seq;
+	/* Buffer for recieve messages, grows when needed */
+	struct nlmsghdr* recv_buf;
+	size_t recv_buf_size;
+	/* Buffer for headers of requests sent at once, grows when needed */
+	void* send_buf;
+	size_t send_buf_size;
+	/* Area of the ring, NULL for netlink transport */
+	void* ring_area;
+	struct sc_ring_queue sq;
+	struct sc_ring_queue cq;
+	/* Next interaction in the per-thread cache */
+	struct _sc_interaction* next_cached;
 };
 
 /*
- * Create interaction "process" with kernel (on the user side).
+ * Header of the request, which precedes payload:
+ *
+ * | nlmsghdr | interaction_id | payload_length |
+ *
+ * (see struct sc_msg).
  */
+#define SC_REQUEST_HEADER_LEN \
+	(NLMSG_HDRLEN + sizeof(interaction_id) + sizeof(size_t))
 
-HELPER_DLL_EXPORT sc_interaction*
-sc_interaction_create(__u32 pid, interaction_id in_type)
+/* Padding after payload of the request is taken from here */
+static const char sc_padding[NLMSG_ALIGNTO];
+
+/*
+ * Create socket and bind it to the given pid.
+ *
+ * If pid is 0, it is choosen by the kernel and is returned in 'pid'.
+ */
+static int sc_socket_create(__u32* pid)
 {
 	struct sockaddr_nl src_addr;
-	sc_interaction* interaction;
+	socklen_t addr_len = sizeof(src_addr);
 	int sock_fd = socket(PF_NETLINK, SOCK_RAW, SC_NETLINK_PROTO);
-	if(!sock_fd)
+	if(sock_fd == -1)
 	{
 		printf("Cannot create socket.\n");
-		return NULL;
+		return -1;
 	}
 	memset(&src_addr, 0, sizeof(src_addr));
 	src_addr.nl_family = AF_NETLINK;
-	src_addr.nl_pid = pid;  /* self pid */
+	src_addr.nl_pid = *pid;  /* self pid */
 	src_addr.nl_groups = 0;  /* not in mcast groups */
 	if(bind(sock_fd, (struct sockaddr*)&src_addr,
 	  sizeof(src_addr)) == -1)
 	{
 		printf("Cannot bind socket.\n");
 		close(sock_fd);
-		return NULL;
+		return -1;
 	}
-	interaction = malloc(sizeof(*interaction));
+	if(*pid == 0)
+	{
+		if(getsockname(sock_fd, (struct sockaddr*)&src_addr, &addr_len) == -1)
+		{
+			printf("Cannot get address of the socket.\n");
+			close(sock_fd);
+			return -1;
+		}
+		*pid = src_addr.nl_pid;
+	}
+	return sock_fd;
+}
+
+#ifdef SC_RING_SIMULATION
+/* Kernel side of the rings is simulated in user space(for tests) */
+#include "sc_ring_sim.h"
+#else
+/*
+ * Open ring and map its area.
+ *
+ * Return descriptor of the ring, -1 if rings are not available.
+ */
+static int sc_ring_open(void** area)
+{
+	int fd = open("/dev/" SC_RING_DEVICE_NAME, O_RDWR);
+	if(fd == -1) return -1;
+
+	*area = mmap(NULL, SC_RING_AREA_SIZE, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	if(*area == MAP_FAILED)
+	{
+		printf("Cannot map ring: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int sc_ring_enter(int fd, int wait)
+{
+	return ioctl(fd, SC_RING_IOC_ENTER, wait);
+}
+
+static void sc_ring_close(int fd, void* area)
+{
+	munmap(area, SC_RING_AREA_SIZE);
+	close(fd);
+}
+#endif /* SC_RING_SIMULATION */
+
+static sc_interaction* sc_interaction_alloc(int sock_fd, __u32 pid,
+	interaction_id in_type)
+{
+	sc_interaction* interaction = malloc(sizeof(*interaction));
 	if(!interaction)
 	{
 		printf("Cannot allocate memory for interaction structure.\n");
-		close(sock_fd);
 		return NULL;
 	}
 	interaction->sock_fd = sock_fd;
 	interaction->pid = pid;
 	interaction->in_type = in_type;
-	
+	interaction->seq = 1;
+	interaction->recv_buf = NULL;
+	interaction->recv_buf_size = 0;
+	interaction->send_buf = NULL;
+	interaction->send_buf_size = 0;
+	interaction->ring_area = NULL;
+	interaction->next_cached = NULL;
+
+	return interaction;
+}
+
+/*
+ * Create interaction "process" with kernel (on the user side).
+ */
+
+HELPER_DLL_EXPORT sc_interaction*
+sc_interaction_create(__u32 pid, interaction_id in_type)
+{
+	sc_interaction* interaction;
+	int sock_fd = sc_socket_create(&pid);
+	if(sock_fd == -1) return NULL;
+
+	interaction = sc_interaction_alloc(sock_fd, pid, in_type);
+	if(!interaction) close(sock_fd);
+	return interaction;
+}
+
+HELPER_DLL_EXPORT sc_interaction*
+sc_interaction_create_ring(interaction_id in_type)
+{
+	sc_interaction* interaction;
+	void* area;
+	int fd = sc_ring_open(&area);
+	if(fd == -1) return sc_interaction_create(0, in_type);
+
+	/* pid of the ring is known only to the kernel */
+	interaction = sc_interaction_alloc(fd, 0, in_type);
+	if(!interaction)
+	{
+		sc_ring_close(fd, area);
+		return NULL;
+	}
+	interaction->ring_area = area;
+	sc_ring_queue_init(&interaction->sq, area, 0);
+	sc_ring_queue_init(&interaction->cq, area, 1);
+
 	return interaction;
 }
 
 HELPER_DLL_EXPORT void
 sc_interaction_destroy(sc_interaction* interaction)
 {
-	close(interaction->sock_fd);
+	if(interaction->ring_area)
+		sc_ring_close(interaction->sock_fd, interaction->ring_area);
+	else
+		close(interaction->sock_fd);
+	free(interaction->recv_buf);
+	free(interaction->send_buf);
 	free(interaction);
 }
 
 /*
- * Send message to the kernel with content of 'buffer' via 'interaction'.
+ * Per-thread cache of interactions.
+ *
+ * Interactions are searched via thread-local pointer; key is used only
+ * for destroy interactions when thread exits.
  */
+static __thread sc_interaction* cached_interactions;
 
-HELPER_DLL_EXPORT ssize_t
-sc_send(sc_interaction* interaction, const void* buf, size_t len)
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+static void cache_destroy(void* data)
 {
-	ssize_t result;
+	sc_interaction* interaction = data;
+	while(interaction)
+	{
+		sc_interaction* next = interaction->next_cached;
+		sc_interaction_destroy(interaction);
+		interaction = next;
+	}
+}
+
+static void cache_key_create(void)
+{
+	if(pthread_key_create(&cache_key, cache_destroy))
+		printf("Cannot create key for cache of interactions.\n");
+}
+
+HELPER_DLL_EXPORT sc_interaction*
+sc_interaction_get(interaction_id in_type)
+{
+	sc_interaction* interaction;
+	for(interaction = cached_interactions;
+		interaction != NULL;
+		interaction = interaction->next_cached)
+	{
+		if(interaction->in_type == in_type) return interaction;
+	}
+
+	pthread_once(&cache_key_once, cache_key_create);
+
+	interaction = sc_interaction_create(0, in_type);
+	if(interaction == NULL) return NULL;
+
+	interaction->next_cached = cached_interactions;
+	if(pthread_setspecific(cache_key, interaction))
+	{
+		printf("Cannot register interaction for destroy at thread exit.\n");
+		sc_interaction_destroy(interaction);
+		return NULL;
+	}
+	cached_interactions = interaction;
+
+	return interaction;
+}
+
+/*
+ * Fill header of the request with given payload length and id.
+ *
+ * Return size of the padding after payload.
+ */
+static size_t sc_request_header_fill(sc_interaction* interaction,
+	void* header, size_t len, __u32 seq)
+{
+	struct nlmsghdr* nlh = header;
 	struct sc_msg sc_message = {
 		.in_type = interaction->in_type,
-		.payload = buf,
+		.payload = NULL,
 		.payload_length = len
 	};
-		
+	void* buffer = NLMSG_DATA(nlh);
 	size_t len_real = sc_msg_len(&sc_message);
+
+	/* Fill the netlink message header */
+	nlh->nlmsg_len = NLMSG_SPACE(len_real);
+	nlh->nlmsg_pid = interaction->pid;	/* sender pid */
+	nlh->nlmsg_type = 0; 	/* type - none special */
+	nlh->nlmsg_seq = seq; 	/* id of the request */
+	nlh->nlmsg_flags = 0; 	/* no special flags */
+
+	/* Payload itself is sent from the user buffer */
+	SC_MESSAGE_WRITE(buffer, sc_message.in_type, interaction_id);
+	SC_MESSAGE_WRITE(buffer, sc_message.payload_length, size_t);
+
+	return NLMSG_SPACE(len_real) - NLMSG_LENGTH(len_real);
+}
+
+/*
+ * Send requests, described by 'iov' array, to the kernel.
+ */
+static ssize_t sc_sendmsg(sc_interaction* interaction,
+	struct iovec* iov, size_t iovlen)
+{
+	ssize_t result;
 	struct sockaddr_nl dest_addr = {
 		.nl_family = AF_NETLINK,
 		.nl_pid = 0,   /* For Linux Kernel */
 		.nl_groups = 0 /* unicast */
 	};
-
-	struct iovec iov;
 	struct msghdr msg = {
 		.msg_name = (void *)&dest_addr,
 		.msg_namelen = sizeof(dest_addr),
-		.msg_iov = &iov,
-		.msg_iovlen = 1
+		.msg_iov = iov,
+		.msg_iovlen = iovlen
 	};
-	
-	struct nlmsghdr *nlh = (struct nlmsghdr *)malloc(
-				 NLMSG_SPACE(len_real));
-	/* Fill the netlink message header */
-	nlh->nlmsg_len = NLMSG_SPACE(len_real);
-	nlh->nlmsg_pid = interaction->pid;	/* sender pid */
-	nlh->nlmsg_type = 0; 	/* type - none special */
-	nlh->nlmsg_seq = 1; 	/* arbitrary sequence number */
-	nlh->nlmsg_flags = 0; 	/* no special flags */
-	
-	/* Fill in the netlink message payload */
-	sc_msg_put(&sc_message, NLMSG_DATA(nlh));
-	
-	iov.iov_base = (void *)nlh;
-	iov.iov_len = nlh->nlmsg_len;
 
 	if((result = sendmsg(interaction->sock_fd, &msg, 0)) == -1)
 	{
 		printf("send returns error: %s\n", strerror(errno));
 	}
-	free(nlh);
 	return result;
 }
 
+/*
+ * Let the kernel to process requests in SQ of the ring and, if 'wait'
+ * is not 0, wait for replies.
+ */
+static int sc_ring_notify(sc_interaction* interaction, int wait)
+{
+	if(sc_ring_enter(interaction->sock_fd, wait) == -1)
+	{
+		printf("Cannot enter the ring: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Put request into SQ of the ring. Kernel will process it only after
+ * sc_ring_notify().
+ */
+static int sc_ring_submit(sc_interaction* interaction,
+	const void* buf, size_t len, __u32 seq)
+{
+	int result;
+
+	if(len > SC_RING_PAYLOAD_MAX)
+	{
+		printf("Message is too long for the ring.\n");
+		return -1;
+	}
+	while((result = sc_ring_queue_put(&interaction->sq, interaction->in_type,
+		seq, buf, len)) > 0)
+	{
+		/* Queue is full, kernel will free it */
+		if(sc_ring_notify(interaction, 0)) return -1;
+	}
+	if(result < 0)
+		printf("Submission queue of the ring is corrupted.\n");
+	return result;
+}
+
+/*
+ * Get reply from CQ of the ring, waiting for it if needed.
+ */
+static ssize_t sc_ring_complete(sc_interaction* interaction,
+	void* buf, size_t len, __u32* request_id)
+{
+	struct sc_ring_entry* entry;
+	__u32 entry_len;
+	ssize_t result;
+	int found;
+
+	/* Replies sent from the callbacks synchronously are already here */
+	while((found = sc_ring_queue_peek(&interaction->cq, &entry,
+		&entry_len)) == 0)
+	{
+		if(sc_ring_notify(interaction, 1)) return -1;
+	}
+	if(found < 0)
+	{
+		printf("Completion queue of the ring is corrupted.\n");
+		return -1;
+	}
+
+	*request_id = entry->seq;
+	if(interaction->in_type != entry->in_type)
+	{
+		printf("Message of unexpected type is recieved.\n");
+		result = 0;
+	}
+	else if(entry_len > len)
+	{
+		printf("Message recieved is too long for the buffer.\n");
+		result = -1;
+	}
+	else
+	{
+		memcpy(buf, entry->payload, entry_len);
+		result = entry_len;
+	}
+	sc_ring_queue_consume(&interaction->cq, entry_len);
+	return result;
+}
+
+/*
+ * Send message to the kernel with content of 'buffer' via 'interaction'.
+ */
+
+HELPER_DLL_EXPORT ssize_t
+sc_send(sc_interaction* interaction, const void* buf, size_t len)
+{
+	__u32 request_id;
+	return sc_submit(interaction, buf, len, &request_id) ? -1 : (ssize_t)len;
+}
+
+HELPER_DLL_EXPORT int
+sc_submit(sc_interaction* interaction, const void* buf, size_t len,
+	__u32* request_id)
+{
+	char header[SC_REQUEST_HEADER_LEN] __attribute__((aligned(NLMSG_ALIGNTO)));
+	struct iovec iov[3];
+
+	*request_id = interaction->seq++;
+
+	if(interaction->ring_area)
+	{
+		if(sc_ring_submit(interaction, buf, len, *request_id)) return -1;
+		return sc_ring_notify(interaction, 0);
+	}
+
+	/* Payload is not copied, it is sent directly from 'buf' */
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = (void*)buf;
+	iov[1].iov_len = len;
+	iov[2].iov_base = (void*)sc_padding;
+	iov[2].iov_len = sc_request_header_fill(interaction, header, len,
+		*request_id);
+
+	return sc_sendmsg(interaction, iov, 3) == -1 ? -1 : 0;
+}
+
+HELPER_DLL_EXPORT int
+sc_submitv(sc_interaction* interaction, const struct iovec* requests,
+	int n, __u32* request_id)
+{
+	int i;
+	char* headers;
+	struct iovec* iov;
+	size_t size = n * (SC_REQUEST_HEADER_LEN + 3 * sizeof(*iov));
+
+	if(n <= 0) return -1;
+
+	if(interaction->ring_area)
+	{
+		*request_id = interaction->seq;
+		for(i = 0; i < n; i++)
+		{
+			if(sc_ring_submit(interaction, requests[i].iov_base,
+				requests[i].iov_len, interaction->seq++)) return -1;
+		}
+		/* One system call for all requests */
+		return sc_ring_notify(interaction, 0);
+	}
+
+	if(size > interaction->send_buf_size)
+	{
+		void* send_buf = realloc(interaction->send_buf, size);
+		if(send_buf == NULL)
+		{
+			printf("Cannot allocate memory for requests.\n");
+			return -1;
+		}
+		interaction->send_buf = send_buf;
+		interaction->send_buf_size = size;
+	}
+	iov = interaction->send_buf;
+	headers = (char*)(iov + 3 * n);
+
+	*request_id = interaction->seq;
+	interaction->seq += n;
+
+	/* All requests are placed into one netlink datagram */
+	for(i = 0; i < n; i++)
+	{
+		char* header = headers + i * SC_REQUEST_HEADER_LEN;
+
+		iov[3 * i].iov_base = header;
+		iov[3 * i].iov_len = SC_REQUEST_HEADER_LEN;
+		iov[3 * i + 1] = requests[i];
+		iov[3 * i + 2].iov_base = (void*)sc_padding;
+		iov[3 * i + 2].iov_len = sc_request_header_fill(interaction, header,
+			requests[i].iov_len, *request_id + i);
+	}
+
+	return sc_sendmsg(interaction, iov, 3 * n) == -1 ? -1 : 0;
+}
+
 /*
  * Recieve message from the kernel with content of 'buffer' via 'interaction'.
  */
 
 HELPER_DLL_EXPORT ssize_t
 sc_recv(sc_interaction* interaction, void* buf, size_t len)
+{
+	__u32 request_id;
+	return sc_complete(interaction, buf, len, &request_id);
+}
+
+HELPER_DLL_EXPORT ssize_t
+sc_complete(sc_interaction* interaction, void* buf, size_t len,
+	__u32* request_id)
 {
 	//fill this struct only for calculate length of full message
 	struct sc_msg sc_message = {
@@ -150,35 +530,51 @@ sc_recv(sc_interaction* interaction, void* buf, size_t len)
 		.msg_iov = &iov,
 		.msg_iovlen = 1
 	};
-	struct nlmsghdr *nlh = (struct nlmsghdr *)malloc(
-				 NLMSG_SPACE(sc_msg_len(&sc_message)));
-	
+	struct nlmsghdr *nlh;
+	size_t size = NLMSG_SPACE(sc_msg_len(&sc_message));
+	ssize_t result;
+
+	if(interaction->ring_area)
+		return sc_ring_complete(interaction, buf, len, request_id);
+
+	if(size > interaction->recv_buf_size)
+	{
+		nlh = realloc(interaction->recv_buf, size);
+		if(nlh == NULL)
+		{
+			printf("Cannot allocate memory for recieve message.\n");
+			return -1;
+		}
+		interaction->recv_buf = nlh;
+		interaction->recv_buf_size = size;
+	}
+	nlh = interaction->recv_buf;
+
 	iov.iov_base = (void *)nlh;
-	iov.iov_len = NLMSG_SPACE(sc_msg_len(&sc_message));
-	
-	if(recvmsg(interaction->sock_fd, &msg, 0) == -1)
+	iov.iov_len = size;
+
+	result = recvmsg(interaction->sock_fd, &msg, 0);
+	if(result == -1)
 	{
 		printf("recieve returns error: %s", strerror(errno));
 		return -1;
 	}
-	if(sc_msg_get(&sc_message, NLMSG_DATA(nlh), NLMSG_PAYLOAD(nlh, 0)))
+	if(!NLMSG_OK(nlh, (size_t)result)
+		|| sc_msg_get(&sc_message, NLMSG_DATA(nlh), NLMSG_PAYLOAD(nlh, 0)))
 	{
 		printf("Incorrect format of the message recieved.\n");
-		free(nlh);
 		return -1;
 	}
+	*request_id = nlh->nlmsg_seq;
 	if(interaction->in_type != sc_message.in_type)
 	{
 		printf("Message of unexpected type is recieved.\n");
-		free(nlh);
 		return 0;
 		//peek message back to the message queue
 		//will be implemented in the future
 		//(using MSG_PEEK flag in recvmsg)
 	}
 	memcpy(buf, sc_message.payload, sc_message.payload_length);
-	
-	free(nlh);
-	
+
 	return sc_message.payload_length;
-}
\ No newline at end of file
+}
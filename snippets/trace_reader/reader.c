@@ -16,6 +16,12 @@
 
 #include <string.h> /*memset, strdup*/
 
+#include <sys/wait.h> /*waitpid*/
+#include <sys/epoll.h> /*epoll_create1() and others*/
+#include <sys/mman.h> /*mmap*/
+#include <sys/uio.h> /*struct iovec, writev*/
+#include <limits.h> /*IOV_MAX*/
+
 #define TRACEFILE "/sys/kernel/debug/rb_test/trace"
 /*
  * Column number in trace line, which represent type of the line.
@@ -41,6 +47,20 @@
 #define READ_BUFFER_SIZE_MIN 10
 #define READ_BUFFER_SIZE_MAX 20
 
+/*
+ * Parameters of the fan-out mode.
+ *
+ * In that mode trace is read by blocks of FANOUT_BLOCK_SIZE bytes.
+ * Lines from the block are not copied: every child process has
+ * a queue of the parts of blocks, which should be written to it.
+ * Block is freed when it is delivered to all children.
+ *
+ * While some child has more than FANOUT_BACKLOG_MAX bytes queued,
+ * trace is not read.
+ */
+#define FANOUT_BLOCK_SIZE (256 * 1024)
+#define FANOUT_BACKLOG_MAX (16 * 1024 * 1024)
+
 /*
  * Callback function for filter lines in trace.
  * 
@@ -78,6 +98,49 @@ static int
 filter_line_type_until_read(const char* str, size_t size,
     int* should_stop, void* unused);
 
+/*
+ * Block of the trace, which is read at once(fan-out mode).
+ *
+ * Block is shared between children, it is freed when
+ * the last reference to it is dropped.
+ */
+struct trace_block
+{
+    /*
+     * Memory is mapped, not allocated: it may be referenced
+     * by pipes after vmsplice() even after the block is freed.
+     */
+    char* data;
+    //number of bytes read into the block
+    size_t len;
+    int refs;
+};
+
+/*
+ * Part of the block, which should be written to the child.
+ */
+struct child_chunk
+{
+    struct trace_block* block;
+    size_t offset;
+    size_t len;
+};
+
+/*
+ * Statistic about delivering trace to the child(fan-out mode).
+ */
+struct child_stat
+{
+    unsigned long long lines;
+    unsigned long long bytes;
+    // Number of system calls used for write
+    unsigned long writes;
+    // Number of times, when pipe with child was full
+    unsigned long blocked;
+    // Maximum number of bytes queued for the child
+    size_t max_backlog;
+};
+
 struct child_process
 {
     /*
@@ -90,6 +153,26 @@ struct child_process
      * Pid of the process.
      */
     pid_t pid;
+    /*
+     * Command line of the process.
+     */
+    char* command;
+    /*
+     * Queue of chunks, which should be written to the child(fan-out mode).
+     *
+     * Chunks from 'first_chunk' to 'n_chunks' are not written yet.
+     */
+    struct child_chunk* chunks;
+    int first_chunk;
+    int n_chunks;
+    int chunks_capacity;
+    // Number of bytes queued
+    size_t backlog;
+    // Whether vmsplice() may be used for write
+    int use_vmsplice;
+    // Whether child is waited for write in epoll
+    int is_polled;
+    struct child_stat stat;
     /*
      * Types(NULL-terminated array of strings) of trace lines,
      * which should be passed to the STDIN.
@@ -302,6 +385,35 @@ static int poll_read(int fd);
 static int poll_write(int fd);
 
 
+/*
+ * Read the trace in the fan-out mode.
+ *
+ * Trace is read by large blocks, lines are splitted in bulk, and
+ * parts of blocks are queued for children without copying. Writting
+ * to the children and reading the trace is performed in a single
+ * epoll loop, so slow child doesn't stop delivering trace to others.
+ *
+ * End of the trace file(for regular file) is treated as end of trace.
+ *
+ * Return 0 on success, -1 on error.
+ */
+static int fanout_process_trace(int fd_trace, struct children* children);
+
+/*
+ * Print statistic about delivering trace to the every child.
+ */
+static void children_print_stat(struct children* children);
+
+static void usage(const char* program_name)
+{
+    printf("Usage: %s [-F [-s]] [-t <trace-file>] <program(s)> ...\n",
+        program_name);
+    printf("    -F - read trace by blocks and deliver it to programs "
+        "without copying\n");
+    printf("    -s - print statistic about delivering trace to programs\n");
+    printf("    -t - read trace from given file instead of %s\n", TRACEFILE);
+}
+
 /*
  * Main.
  */
@@ -310,18 +422,42 @@ int main(int argc, char* const argv[], char* const envp[])
 {
     int fd_trace;
     int result = 0;
+    int opt;
+    int fanout = 0;
+    int print_stat = 0;
+    const char* trace_file = TRACEFILE;
     
     struct children children;
     children_init(&children,
         filter_line_type_until_read, NULL);
+
+    // '+' - stop on the first program
+    while((opt = getopt(argc, argv, "+Fst:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'F':
+            fanout = 1;
+            break;
+        case 's':
+            print_stat = 1;
+            break;
+        case 't':
+            trace_file = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
     
-    if(argc < 2)
+    if(optind >= argc)
     {
-        printf("Usage: %s <program(s)> ...\n", argv[0]);
+        usage(argv[0]);
         return 1;
     }
 
-    fd_trace = open(TRACEFILE, O_RDONLY);
+    fd_trace = open(trace_file, O_RDONLY);
     if(fd_trace == -1)
     {
         perror("Cannot open trace file for read:");
@@ -341,7 +477,7 @@ int main(int argc, char* const argv[], char* const envp[])
         return -1;
     }
     int i;
-    for(i = 1; i < argc; i++)
+    for(i = optind; i < argc; i++)
     {
         // Create another process which piped with current
         struct child_process* child = create_child_process(argv[i], NULL);
@@ -362,8 +498,16 @@ int main(int argc, char* const argv[], char* const envp[])
         return -1;
     }
     
+    if(fanout)
+    {
+        result = fanout_process_trace(fd_trace, &children);
+        if(result == -1)
+            printf("Error occures while processing trace. Stop.\n");
+        else if(print_stat)
+            children_print_stat(&children);
+    }
     //while(poll_read(fd_trace) == 0)
-    do
+    else do
     {
         int result;
         //if(test_sigint()) break;
@@ -539,6 +683,22 @@ create_child_process(const char* command_line,
      */
     child->fd_write = -1;
     child->types = NULL;
+    child->chunks = NULL;
+    child->first_chunk = 0;
+    child->n_chunks = 0;
+    child->chunks_capacity = 0;
+    child->backlog = 0;
+    child->use_vmsplice = 1;
+    child->is_polled = 0;
+    memset(&child->stat, 0, sizeof(child->stat));
+
+    child->command = strdup(command_line);
+    if(child->command == NULL)
+    {
+        printf("Cannot allocate command line for child process.\n");
+        child_process_free(child);
+        return NULL;
+    }
     
     if(types != NULL)
     {
@@ -631,11 +791,20 @@ create_child_process(const char* command_line,
     return child;
 }
 
+/*
+ * Drop reference to the block of the trace.
+ */
+static void trace_block_put(struct trace_block* block);
+
 void child_process_free(struct child_process* child)
 {
     int n_types;
     if(child == NULL) return;
     child_process_stop_write(child);
+    for(; child->first_chunk < child->n_chunks; child->first_chunk++)
+        trace_block_put(child->chunks[child->first_chunk].block);
+    free(child->chunks);
+    free(child->command);
     if(child->types != NULL)
     {
         for(n_types = 0; child->types[n_types] != NULL; n_types++)
@@ -1072,4 +1241,485 @@ filter_line_type_until_read(const char* str, size_t size,
         *should_stop = 1;
     //printf("'should_stop' is %d.\n", *should_stop);
     return 1;
-}
\ No newline at end of file
+}
+
+/*
+ * Implementation of the fan-out mode.
+ */
+
+static struct trace_block* trace_block_alloc(void)
+{
+    struct trace_block* block = malloc(sizeof(*block));
+    if(block == NULL)
+    {
+        printf("Cannot allocate block structure.\n");
+        return NULL;
+    }
+    block->data = mmap(NULL, FANOUT_BLOCK_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(block->data == MAP_FAILED)
+    {
+        perror("Cannot allocate memory for block of the trace");
+        free(block);
+        return NULL;
+    }
+    block->len = 0;
+    block->refs = 1;
+    return block;
+}
+
+void trace_block_put(struct trace_block* block)
+{
+    if(--block->refs) return;
+    munmap(block->data, FANOUT_BLOCK_SIZE);
+    free(block);
+}
+
+/*
+ * Queue part of the block for writting to the child.
+ *
+ * Return 0 on success, -1 on error.
+ */
+static int child_queue_chunk(struct child_process* child,
+    struct trace_block* block, size_t offset, size_t len)
+{
+    struct child_chunk* chunk;
+
+    child->backlog += len;
+    if(child->backlog > child->stat.max_backlog)
+        child->stat.max_backlog = child->backlog;
+    // Continuation of the previous chunk?
+    if(child->first_chunk < child->n_chunks)
+    {
+        chunk = &child->chunks[child->n_chunks - 1];
+        if((chunk->block == block) && (chunk->offset + chunk->len == offset))
+        {
+            chunk->len += len;
+            return 0;
+        }
+    }
+
+    if(child->n_chunks == child->chunks_capacity)
+    {
+        if(child->first_chunk > 0)
+        {
+            // Reuse space of written chunks
+            memmove(child->chunks, child->chunks + child->first_chunk,
+                sizeof(*chunk) * (child->n_chunks - child->first_chunk));
+            child->n_chunks -= child->first_chunk;
+            child->first_chunk = 0;
+        }
+        else
+        {
+            int capacity = child->chunks_capacity ? child->chunks_capacity * 2 : 16;
+            chunk = realloc(child->chunks, sizeof(*chunk) * capacity);
+            if(chunk == NULL)
+            {
+                printf("Cannot allocate queue for child process.\n");
+                child->backlog -= len;
+                return -1;
+            }
+            child->chunks = chunk;
+            child->chunks_capacity = capacity;
+        }
+    }
+    chunk = &child->chunks[child->n_chunks++];
+    chunk->block = block;
+    chunk->offset = offset;
+    chunk->len = len;
+    block->refs++;
+    return 0;
+}
+
+/*
+ * Whether child accepts lines of the given type.
+ */
+static int child_accept_type(struct child_process* child,
+    const char* type, size_t type_size)
+{
+    return (child->types == NULL)
+        || (filter_line_type(type, type_size, (const char**)child->types) == 0);
+}
+
+/*
+ * Wait(or not) for the child to become writable in the epoll.
+ */
+static void child_set_polled(struct child_process* child, int epoll_fd,
+    int is_polled)
+{
+    struct epoll_event event;
+    if(child->is_polled == is_polled) return;
+
+    event.events = is_polled ? EPOLLOUT : 0;
+    event.data.ptr = child;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, child->fd_write, &event) == -1)
+        perror("Cannot change waiting for the child process");
+    child->is_polled = is_polled;
+}
+
+/*
+ * Stop writting to the child, drop all chunks queued.
+ */
+static void child_stop_fanout(struct child_process* child, int epoll_fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, child->fd_write, NULL);
+    child->is_polled = 0;
+    child_process_stop_write(child);
+    for(; child->first_chunk < child->n_chunks; child->first_chunk++)
+        trace_block_put(child->chunks[child->first_chunk].block);
+    child->first_chunk = child->n_chunks = 0;
+    child->backlog = 0;
+}
+
+/*
+ * Write as many queued chunks to the child, as pipe allows.
+ *
+ * Pages of the blocks are passed to the pipe via vmsplice(), so they
+ * are not copied. If vmsplice() is not supported, writev() is used.
+ */
+static void child_flush(struct child_process* child, int epoll_fd)
+{
+    while(child->first_chunk < child->n_chunks)
+    {
+        struct iovec iov[IOV_MAX];
+        int n_iov;
+        ssize_t result;
+
+        for(n_iov = 0; (n_iov < IOV_MAX)
+            && (child->first_chunk + n_iov < child->n_chunks); n_iov++)
+        {
+            struct child_chunk* chunk = &child->chunks[child->first_chunk + n_iov];
+            iov[n_iov].iov_base = chunk->block->data + chunk->offset;
+            iov[n_iov].iov_len = chunk->len;
+        }
+
+        if(child->use_vmsplice)
+            result = vmsplice(child->fd_write, iov, n_iov, SPLICE_F_NONBLOCK);
+        else
+            result = writev(child->fd_write, iov, n_iov);
+        if(result == -1)
+        {
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN)
+            {
+                child->stat.blocked++;
+                child_set_polled(child, epoll_fd, 1);
+                return;
+            }
+            if(child->use_vmsplice && ((errno == EINVAL) || (errno == ENOSYS)))
+            {
+                child->use_vmsplice = 0;
+                continue;
+            }
+            if(errno == EPIPE)
+            {
+                printf("Child process has closed its STDIN.\n");
+            }
+            else
+            {
+                perror("Error occure while writting to the pipe with child process");
+                printf("Writing to this process will stop.\n");
+            }
+            child_stop_fanout(child, epoll_fd);
+            return;
+        }
+        child->stat.writes++;
+        child->stat.bytes += result;
+        child->backlog -= result;
+        // Remove written chunks from the queue
+        while(result > 0)
+        {
+            struct child_chunk* chunk = &child->chunks[child->first_chunk];
+            if((size_t)result < chunk->len)
+            {
+                chunk->offset += result;
+                chunk->len -= result;
+                break;
+            }
+            result -= chunk->len;
+            trace_block_put(chunk->block);
+            child->first_chunk++;
+        }
+    }
+    child->first_chunk = child->n_chunks = 0;
+    child_set_polled(child, epoll_fd, 0);
+}
+
+/*
+ * Queue lines from the block for the children.
+ *
+ * 'len' is the size of the block part with whole lines.
+ *
+ * Set 'should_stop' if reading of the trace should be stopped.
+ *
+ * Return 0 on success, -1 on error.
+ */
+static int children_queue_lines(struct children* children,
+    struct trace_block* block, size_t len, int* should_stop)
+{
+    size_t pos, next;
+    struct child_process* child;
+
+    for(pos = 0; (pos < len) && !*should_stop; pos = next)
+    {
+        const char* str = block->data + pos;
+        const char* type;
+        size_t type_size;
+        size_t line_len;
+        int trace_used = 0;
+
+        next = (const char*)memchr(str, '\n', len - pos) - block->data + 1;
+        line_len = next - pos;
+
+        if((children->filter != NULL)
+            && (children->filter(str, line_len, should_stop,
+                children->filter_data) == 0))
+            continue;
+
+#define UNKNOWN_TYPE "unknown type"
+        if(get_line_type(str, line_len, &type, &type_size))
+        {
+            type = UNKNOWN_TYPE;
+            type_size = strlen(type);
+        }
+#undef UNKNOWN_TYPE
+
+        children_for_each_child(children, child)
+        {
+            if(!child_process_is_writeable(child)) continue;
+            trace_used++;
+            if(!child_accept_type(child, type, type_size)) continue;
+            if(child_queue_chunk(child, block, pos, line_len)) return -1;
+            child->stat.lines++;
+        }
+        if(trace_used == 0)
+        {
+            printf("Trace is not used at all. Stop.\n");
+            *should_stop = 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Read next block of the trace and queue its lines for the children.
+ *
+ * Partial line at the end of the previous block is moved
+ * to the start of the new block.
+ *
+ * Set 'is_eof' if end of the trace file is encountered.
+ *
+ * Return 0 on success, -1 on error.
+ * If the trace ends with a partial line, report it and return 1;
+ * lines before it are queued.
+ */
+static int fanout_read_block(int fd_trace, struct children* children,
+    struct trace_block** partial, size_t* partial_len,
+    int* should_stop, int* is_eof)
+{
+    struct trace_block* block;
+    char* line_end;
+    size_t lines_len;
+    int result;
+
+    block = trace_block_alloc();
+    if(block == NULL) return -1;
+
+    if(*partial)
+    {
+        memcpy(block->data, (*partial)->data + (*partial)->len - *partial_len,
+            *partial_len);
+        block->len = *partial_len;
+        trace_block_put(*partial);
+        *partial = NULL;
+        *partial_len = 0;
+    }
+    // Fill the block as much as possible
+    while(block->len < FANOUT_BLOCK_SIZE)
+    {
+        ssize_t size = read_until_error(fd_trace, block->data + block->len,
+            FANOUT_BLOCK_SIZE - block->len);
+        if(size == -1)
+        {
+            if(errno == EAGAIN) break;
+            perror("Error occures when reading from file");
+            trace_block_put(block);
+            return -1;
+        }
+        if(size == 0)
+        {
+            *is_eof = 1;
+            break;
+        }
+        block->len += size;
+    }
+
+    line_end = memrchr(block->data, '\n', block->len);
+    lines_len = line_end ? (size_t)(line_end - block->data + 1) : 0;
+    if((lines_len == 0) && (block->len == FANOUT_BLOCK_SIZE))
+    {
+        printf("Line in the trace is too long.\n");
+        trace_block_put(block);
+        return -1;
+    }
+
+    result = children_queue_lines(children, block, lines_len, should_stop);
+    if((result == 0) && *is_eof && (lines_len < block->len))
+    {
+        printf("Line was partially read from file,"
+            "and next read encounter EOF.\n");
+        printf("Perhaps, there is another reader from file,"
+            "or file access is not aligned on lines.\n");
+        printf("Please, fix this.\n");
+        trace_block_put(block);
+        return 1;
+    }
+    if(lines_len < block->len)
+    {
+        // Keep the block for the partial line
+        *partial = block;
+        *partial_len = block->len - lines_len;
+    }
+    else
+        trace_block_put(block);
+
+    return result;
+}
+
+int fanout_process_trace(int fd_trace, struct children* children)
+{
+    int epoll_fd;
+    struct epoll_event event;
+    struct epoll_event events[16];
+    struct child_process* child;
+    // Regular file cannot be polled, it is always readable.
+    int is_trace_regular = 0;
+    int is_trace_polled = 0;
+    int should_stop = 0;
+    int is_eof = 0;
+    int result = 0;
+    struct trace_block* partial = NULL;
+    size_t partial_len = 0;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd == -1)
+    {
+        perror("Cannot create epoll file descriptor");
+        return -1;
+    }
+
+    event.events = 0;
+    event.data.ptr = NULL;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd_trace, &event) == -1)
+    {
+        if(errno != EPERM)
+        {
+            perror("Cannot wait for the trace file");
+            close(epoll_fd);
+            return -1;
+        }
+        is_trace_regular = 1;
+    }
+    // Signal is identified by its file descriptor, which is not a child
+    event.events = EPOLLIN;
+    event.data.ptr = &epoll_fd;
+    if((get_signal_fd() != -1)
+        && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, get_signal_fd(), &event) == -1))
+    {
+        perror("Cannot wait for the signal");
+        close(epoll_fd);
+        return -1;
+    }
+    children_for_each_child(children, child)
+    {
+        event.events = 0;
+        event.data.ptr = child;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, child->fd_write, &event) == -1)
+        {
+            perror("Cannot wait for the child process");
+            close(epoll_fd);
+            return -1;
+        }
+    }
+
+    while(1)
+    {
+        int n_events, i;
+        int is_readable = 0;
+        int should_read = !should_stop && !is_eof && !test_sigint();
+        size_t backlog = 0;
+
+        children_for_each_child(children, child)
+        {
+            if(child->backlog > backlog) backlog = child->backlog;
+        }
+        if(!should_read && (backlog == 0)) break;
+        // Backpressure: do not read trace while some child is late
+        if(backlog > FANOUT_BACKLOG_MAX) should_read = 0;
+
+        if(!is_trace_regular && (is_trace_polled != should_read))
+        {
+            event.events = should_read ? EPOLLIN : 0;
+            event.data.ptr = NULL;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd_trace, &event);
+            is_trace_polled = should_read;
+        }
+
+        n_events = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]),
+            (should_read && is_trace_regular) ? 0 : -1);
+        if(n_events == -1)
+        {
+            if(errno == EINTR) continue;
+            perror("epoll_wait() fail");
+            result = -1;
+            break;
+        }
+        for(i = 0; i < n_events; i++)
+        {
+            if(events[i].data.ptr == NULL)
+                is_readable = 1;
+            else if(events[i].data.ptr == &epoll_fd)
+            {
+                // SIGINT has arrived, it will be processed by test_sigint()
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, get_signal_fd(), NULL);
+            }
+            else
+                child_flush(events[i].data.ptr, epoll_fd);
+        }
+
+        if(should_read && (is_readable || is_trace_regular))
+        {
+            int read_result = fanout_read_block(fd_trace, children,
+                &partial, &partial_len, &should_stop, &is_eof);
+            if(read_result == -1)
+            {
+                result = -1;
+                break;
+            }
+            // Partial line at EOF, but the lines queued should be written
+            if(read_result == 1) result = -1;
+            // Most of the time pipes are not full, so write immediately
+            children_for_each_child(children, child)
+            {
+                if(child_process_is_writeable(child) && !child->is_polled)
+                    child_flush(child, epoll_fd);
+            }
+        }
+    }
+
+    if(partial) trace_block_put(partial);
+    close(epoll_fd);
+    return result;
+}
+
+void children_print_stat(struct children* children)
+{
+    struct child_process* child;
+    children_for_each_child(children, child)
+    {
+        printf("'%s': lines %llu, bytes %llu, writes %lu, pipe was full %lu times, "
+            "max backlog %lu bytes.\n", child->command,
+            child->stat.lines, child->stat.bytes, child->stat.writes,
+            child->stat.blocked, (unsigned long)child->stat.max_backlog);
+    }
+}
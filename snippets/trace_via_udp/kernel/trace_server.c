@@ -17,8 +17,12 @@
 
 #include <linux/debugfs.h>
 
+#include <linux/percpu.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h> /* roundup_pow_of_two */
+
 /*
- * Interval between sending trace packets in ms.
+ * Interval between sending bursts of trace packets in ms.
  * 
  * NOTE: messages with trace marks ignore this interval.
  */
@@ -39,132 +43,253 @@
 unsigned short server_port = TRACE_SERVER_PORT;
 module_param(server_port, ushort, S_IRUGO);
 
-/* Internal representation of the trace event on the server */
-struct server_trace_event
+/*
+ * Size of the per-cpu buffer for trace events(in bytes).
+ * 
+ * Rounded up to power of 2.
+ */
+unsigned long buffer_size = 65536;
+module_param(buffer_size, ulong, S_IRUGO);
+
+/* Maximum number of packets sent at once */
+unsigned int packets_burst = 16;
+module_param(packets_burst, uint, S_IRUGO);
+
+/*
+ * Header of the trace event in the per-cpu buffer.
+ * 
+ * Header is followed by the event content.
+ */
+struct server_trace_event_header
 {
-	/* FIFO organization of the events */
-	struct server_trace_event* next;
-	/* Allocated array of bytes as event content */
-	char* content;
-	/* Size of the event content */
-	int content_size;
 	/* When event was generated*/
 	u64 timestamp;
+	/* Size of the event content */
+	u32 content_size;
+};
+
+/*
+ * Per-cpu buffer of events.
+ * 
+ * Buffer is written only on its cpu(with interrupts disabled) and read
+ * only by the events sender, so no locks are needed. Events are stored
+ * one after another, possibly wrapping at the end of the buffer.
+ */
+struct server_trace_buffer
+{
+	char* data;
+	/* Mask for get offset in 'data' from position */
+	unsigned long mask;
+	/* Position where next event will be written. Changed by writer. */
+	unsigned long head;
+	/* Position of the first unread event. Changed by reader. */
+	unsigned long tail;
+	/* Number of events which are dropped because buffer is full */
+	unsigned long lost;
 };
 
 struct server_trace_events
 {
-	/* Pointer to the first event */
-	struct server_trace_event* first;
-	/* Pointer to the 'next' field of last event */
-	struct server_trace_event** last_p;
-	
-	/* 
-	 * Counter of the current event in the trace.
-	 * 
-	 * It is used to form seq number of udp packet.
-	 */
-	int32_t counter;
-	/* Protect FIFO of events */	
-	spinlock_t lock;
+	struct server_trace_buffer __percpu* buffers;
+	/* Number of dropped events already reported to the client */
+	unsigned long lost_reported;
 };
 
 static int server_trace_events_init(struct server_trace_events* events)
 {
-	events->first = NULL;
-	events->last_p = NULL;
-	spin_lock_init(&events->lock);
+	int cpu;
+	unsigned long size = roundup_pow_of_two(buffer_size);
+
+	events->buffers = alloc_percpu(struct server_trace_buffer);
+	if(events->buffers == NULL)
+	{
+		pr_err("Failed to allocate per-cpu buffers for trace events.");
+		return -ENOMEM;
+	}
+	events->lost_reported = 0;
+	
+	for_each_possible_cpu(cpu)
+	{
+		struct server_trace_buffer* buffer = per_cpu_ptr(events->buffers, cpu);
+		
+		buffer->data = vmalloc(size);
+		if(buffer->data == NULL)
+		{
+			pr_err("Failed to allocate buffer for trace events.");
+			for_each_possible_cpu(cpu)
+				vfree(per_cpu_ptr(events->buffers, cpu)->data);
+			free_percpu(events->buffers);
+			return -ENOMEM;
+		}
+		buffer->mask = size - 1;
+		buffer->head = 0;
+		buffer->tail = 0;
+		buffer->lost = 0;
+	}
 	
 	return 0;
 }
 
 static void server_trace_events_destroy(struct server_trace_events* events)
 {
-	while(events->first)
-	{
-		struct server_trace_event* event = events->first;
-		events->first = event->next;
-		
-		kfree(event->content);
-		kfree(event);
-	}
+	int cpu;
+	for_each_possible_cpu(cpu)
+		vfree(per_cpu_ptr(events->buffers, cpu)->data);
+	free_percpu(events->buffers);
 }
 
 //************** Helpers for write and extract events ****************//
+/* Copy data into the buffer, taking wrapping into account */
+static void server_trace_buffer_write(struct server_trace_buffer* buffer,
+	unsigned long pos, const void* data, size_t size)
+{
+	unsigned long offset = pos & buffer->mask;
+	size_t part = min_t(size_t, size, buffer->mask + 1 - offset);
+	
+	memcpy(buffer->data + offset, data, part);
+	memcpy(buffer->data, (const char*)data + part, size - part);
+}
+
+/* Copy data from the buffer, taking wrapping into account */
+static void server_trace_buffer_read(struct server_trace_buffer* buffer,
+	unsigned long pos, void* data, size_t size)
+{
+	unsigned long offset = pos & buffer->mask;
+	size_t part = min_t(size_t, size, buffer->mask + 1 - offset);
+	
+	memcpy(data, buffer->data + offset, part);
+	memcpy((char*)data + part, buffer->data, size - part);
+}
+
  /*
- * Add event with given parameters into queue.
+ * Add event with given content into buffer of the current cpu.
+ * 
+ * May be called in any context.
  * 
- * 'content' should be allocated using kmalloc and after function call
- * it belongs to the events queue.
+ * If buffer is full, event is dropped(and accounted as lost).
  */
 static int server_trace_add_event(struct server_trace_events* events,
-	char* content, int content_size)
+	const void* content, int content_size)
 {
 	unsigned long flags;
+	struct server_trace_buffer* buffer;
+	struct server_trace_event_header header;
+	unsigned long head, size;
+	int result = 0;
 	
-	struct server_trace_event* event = kmalloc(sizeof(*event), GFP_KERNEL);
-	if(event == NULL)
-	{
-		pr_err("Failed to allocate trace event.");
-		return -ENOMEM;
-	}
-	event->content = content;
-	event->content_size = content_size;
-	event->next = NULL;
+	if(content_size > TRACE_EVENT_CONTEXT_SIZE_MAX)
+		return -EINVAL;
 	
-	spin_lock_irqsave(&events->lock, flags);
+	size = sizeof(header) + content_size;
 	
-	if(events->last_p)
-	{
-		*events->last_p = event;
-	}
-	else
+	local_irq_save(flags);
+	buffer = this_cpu_ptr(events->buffers);
+	head = buffer->head;
+	
+	if(head - ACCESS_ONCE(buffer->tail) + size > buffer->mask + 1)
 	{
-		events->first = event;
+		buffer->lost++;
+		result = -ENOSPC;
+		goto out;
 	}
-	events->last_p = &event->next;
-
-	event->timestamp = ktime_to_ns(ktime_get());
+	/* Do not overwrite data until reader has finished with it */
+	smp_mb();
+	
+	header.timestamp = ktime_to_ns(ktime_get());
+	header.content_size = content_size;
+	server_trace_buffer_write(buffer, head, &header, sizeof(header));
+	server_trace_buffer_write(buffer, head + sizeof(header),
+		content, content_size);
+	/* Publish event only after its data */
+	smp_wmb();
+	buffer->head = head + size;
+out:
+	local_irq_restore(flags);
 	
-	spin_unlock_irqrestore(&events->lock, flags);
+	return result;
+}
+
+/*
+ * Return header of the first unread event in the buffer.
+ * 
+ * Return 1 if buffer is empty.
+ */
+static int server_trace_buffer_peek(struct server_trace_buffer* buffer,
+	struct server_trace_event_header* header)
+{
+	if(ACCESS_ONCE(buffer->head) == buffer->tail) return 1;
+	/* Read data only after head */
+	smp_rmb();
 	
+	server_trace_buffer_read(buffer, buffer->tail, header, sizeof(*header));
 	return 0;
 }
+
 /*
- * Deque first event in the queue and return its parameters.
+ * Fill message with events, the oldest first.
  * 
- * After processing, 'content' should be freed.
- * 
- * Return 1 if queue is empty.
+ * Return number of bytes written. If no events, return 0.
  */
-static int server_trace_deque_event(struct server_trace_events* events,
-	char** content, int* content_size, u64* ts)
+static size_t server_trace_fill_packet(struct server_trace_events* events,
+	struct trace_server_msg_packet* msg_packet, size_t size_max)
 {
-	struct server_trace_event* event;
-	unsigned long flags;
-	
-	spin_lock_irqsave(&events->lock, flags);
-	
-	event = events->first;
-	if(event == NULL) goto queue_empty;
+	size_t size = offsetof(struct trace_server_msg_packet, events);
+	int n_events = 0;
+	unsigned long lost = 0;
+	int cpu;
 	
-	events->first = event->next;
-	if(event->next == NULL) events->last_p = NULL;
+	while(1)
+	{
+		struct server_trace_buffer* oldest = NULL;
+		struct server_trace_event_header oldest_header;
+		struct trace_event* event;
+		
+		/* 
+		 * Merge per-cpu buffers by timestamps. Number of cpus is
+		 * usually small, so simple search is sufficient.
+		 */
+		for_each_possible_cpu(cpu)
+		{
+			struct server_trace_buffer* buffer =
+				per_cpu_ptr(events->buffers, cpu);
+			struct server_trace_event_header header;
+			
+			if(server_trace_buffer_peek(buffer, &header)) continue;
+			if(oldest && (oldest_header.timestamp <= header.timestamp))
+				continue;
+			oldest = buffer;
+			oldest_header = header;
+		}
+		if(oldest == NULL) break;
+		if(size + TRACE_EVENT_SIZE(oldest_header.content_size) > size_max)
+			break;
+		
+		event = (struct trace_event*)((char*)msg_packet + size);
+		timestamp_nt_set(&event->timestamp, oldest_header.timestamp);
+		event->context_size = htons(oldest_header.content_size);
+		server_trace_buffer_read(oldest, oldest->tail + sizeof(oldest_header),
+			event->context, oldest_header.content_size);
+		/* Free space in the buffer only after data have been read */
+		smp_mb();
+		oldest->tail += sizeof(oldest_header) + oldest_header.content_size;
+		
+		size += TRACE_EVENT_SIZE(oldest_header.content_size);
+		n_events++;
+	}
+	if(n_events == 0) return 0;
 	
-	spin_unlock_irqrestore(&events->lock, flags);
+	/* Counters of lost events are only increased, so may be read racy */
+	for_each_possible_cpu(cpu)
+		lost += ACCESS_ONCE(per_cpu_ptr(events->buffers, cpu)->lost);
+	lost -= events->lost_reported;
+	if(lost > 0xffff) lost = 0xffff;
+	events->lost_reported += lost;
 	
-	*content = event->content;
-	*content_size = event->content_size;
-	*ts = event->timestamp;
-
-	kfree(event);
-
-	return 0;
-
-queue_empty:
-	spin_unlock_irqrestore(&events->lock, flags);
+	msg_packet->base.type = TRACE_SERVER_MSG_TYPE_PACKET;
+	msg_packet->n_events = htons(n_events);
+	msg_packet->lost_events = htons(lost);
 	
-	return 1;
+	return size;
 }
 
 //****************** Events generator ********************************//
@@ -211,13 +336,9 @@ static ssize_t event_file_write(struct file* filp,
 	}
 	
 	result = server_trace_add_event(generator->events, content, count);
-	if(result)
-	{
-		kfree(content);
-		return result;
-	}
+	kfree(content);
 	
-	return count;
+	return result ? result : count;
 }
 
 static int events_generator_init(struct events_generator* generator,
@@ -312,6 +433,9 @@ struct events_sender
 	 * do not require any sync.
 	 */
 	int32_t seq;
+	/* Buffer for packets sent at once('packets_burst' of them) */
+	char* packets;
+	struct kvec* vecs;
 
 	/* Is used for send messages */
 	struct socket* clientsocket;
@@ -360,55 +484,41 @@ static int events_sender_send_msg(struct events_sender* sender,
 }
 
 /* 
- * Dequeue and send trace packet.
+ * Fill trace packets with events and send them.
+ * 
+ * Up to 'packets_burst' packets are sent at once.
  * 
  * If trace is empty, return 1.
  */
-static int events_sender_send_trace_packet(struct events_sender* sender,
+static int events_sender_send_trace_packets(struct events_sender* sender,
 	struct events_sender_state* state)
 {
-	int result;
-	int32_t seq;
+	int result = 0;
+	int n_packets, i;
 	
-	struct trace_server_msg_packet msg_packet;
-	struct kvec vec[2] =
+	/* Fill all packets first, so they are sent without interruptions */
+	for(n_packets = 0; n_packets < packets_burst; n_packets++)
 	{
-		{
-			.iov_base = &msg_packet,
-			.iov_len = offsetof(struct trace_server_msg_packet, event.context)
-		}
-	};
-	
-	char* event_content;
-	int event_size;
-	u64 ts;
+		struct trace_server_msg_packet* msg_packet = (void*)
+			(sender->packets + n_packets * TRACE_SERVER_MSG_LEN_MAX);
+		size_t size = server_trace_fill_packet(sender->events,
+			msg_packet, TRACE_SERVER_MSG_LEN_MAX);
+		
+		if(size == 0) break;
+		msg_packet->base.seq = htonl(sender->seq++);
+		
+		sender->vecs[n_packets].iov_base = msg_packet;
+		sender->vecs[n_packets].iov_len = size;
+	}
+	if(n_packets == 0) return 1;//nothing to send
 	
-	result = server_trace_deque_event(sender->events,
-		&event_content, &event_size, &ts);
-	if(result > 0) return 1;//nothing to send
-	if(result < 0)
+	for(i = 0; i < n_packets; i++)
 	{
-		pr_err("Error occures while dequeue event.");
-		return result;
+		/* If packet become lost, continue to send others */
+		result = events_sender_send_msg(sender, state, &sender->vecs[i], 1,
+			sender->vecs[i].iov_len);
 	}
 	
-	seq = sender->seq++;
-	msg_packet.base.seq = htons(seq);
-	msg_packet.base.type = TRACE_SERVER_MSG_TYPE_PACKET;
-	
-	msg_packet.event.context_size = htons(event_size);
-	timestamp_nt_set(&msg_packet.event.timestamp, ts);
-	
-	vec[1].iov_base = event_content;
-	vec[1].iov_len = event_size;
-	
-	result = events_sender_send_msg(sender, state, vec, ARRAY_SIZE(vec),
-		offsetof(struct trace_server_msg_packet, event.context) + event_size);
-	
-	//pr_info("Message %.*s has been sent.", (int)event_size, event_content);
-	
-	kfree(event_content);
-
 	return result;
 }
 
@@ -486,7 +596,7 @@ static void events_sender_work(struct work_struct *data)
 	switch(state.type)
 	{
 	case events_sender_state_send:
-		result = events_sender_send_trace_packet(sender, &state);
+		result = events_sender_send_trace_packets(sender, &state);
 		if(result > 0)
 		{
 			if(state.is_terminated)
@@ -528,7 +638,7 @@ static void events_sender_work(struct work_struct *data)
 		{
 			sender->is_first_event = 0;
 			/*
-			 * Wait a moment when we may send new packet.
+			 * Wait a moment when we may send new packets.
 			 */
 			queue_delayed_work(sender->wq, &sender->work,
 				PACKETS_INTERVAL_JIFFIES);
@@ -569,11 +679,29 @@ static int events_sender_init(struct events_sender* sender,
 {
 	int result;
 	
+	if(packets_burst == 0)
+	{
+		pr_err("At least one packet should be sent at once.");
+		return -EINVAL;
+	}
+	
+	sender->packets = vmalloc(packets_burst * TRACE_SERVER_MSG_LEN_MAX);
+	sender->vecs = kmalloc(packets_burst * sizeof(*sender->vecs), GFP_KERNEL);
+	if((sender->packets == NULL) || (sender->vecs == NULL))
+	{
+		pr_err("Failed to allocate buffer for trace packets.");
+		kfree(sender->vecs);
+		vfree(sender->packets);
+		return -ENOMEM;
+	}
+	
 	result = sock_create(PF_INET, SOCK_DGRAM, IPPROTO_UDP,
 		&sender->clientsocket);
 	if(result)
 	{
 		pr_err("Failed to create client socket.");
+		kfree(sender->vecs);
+		vfree(sender->packets);
 		return result;
 	}
 
@@ -581,6 +709,8 @@ static int events_sender_init(struct events_sender* sender,
 	if (!sender->wq){
 		pr_err("Failed to create workqueue for sending trace.");
 		sock_release(sender->clientsocket);
+		kfree(sender->vecs);
+		vfree(sender->packets);
 		return -ENOMEM;
 	}
 
@@ -619,6 +749,9 @@ static void events_sender_destroy(struct events_sender* sender)
 	
 	sock_release(sender->clientsocket);
 	
+	kfree(sender->vecs);
+	vfree(sender->packets);
+	
 	sender->state.type = events_sender_state_invalid;
 }
 
@@ -48,8 +48,11 @@
  * Linux kernel before 2.6.36 doesnt't contain 64bit type which suitable
  * for use in network message(see notes above).
  * So we define our one for timestamps.
+ *
+ * NOTE: Alignment is 32 bits, so events may be packed into the message
+ * without holes.
  */
-typedef struct {__be32 high, low;} __attribute__((aligned(32))) timestamp_nt;
+typedef struct {__be32 high, low;} __attribute__((aligned(4))) timestamp_nt;
 /* Helpers for write timestamps to messages and extract them */
 static inline void timestamp_nt_set(timestamp_nt *ts_nt, uint64_t ts)
 {
@@ -91,15 +94,40 @@ struct trace_event
     __u8 context[0];
 };
 
+/* 
+ * Events are packed into the message one after another, every event
+ * is aligned on this value.
+ */
+#define TRACE_EVENT_ALIGN 4
+
+/* Size of the event in the message, including alignment */
+#define TRACE_EVENT_SIZE(context_size) \
+    ((offsetof(struct trace_event, context) + (context_size) \
+        + TRACE_EVENT_ALIGN - 1) & ~(TRACE_EVENT_ALIGN - 1))
+
 /* Message of type packet */
 struct trace_server_msg_packet
 {
     struct trace_server_msg base;
-    
-    /* In the simple implementation packet contains only one event */
-    struct trace_event event;
+    /* Number of events in the packet */
+    __be16 n_events;
+    /* 
+     * Number of events, which have been dropped by the server
+     * (because of buffer overflow) since the previous packet.
+     */
+    __be16 lost_events;
+    /* 
+     * Events, as many as fit into TRACE_SERVER_MSG_LEN_MAX
+     * (see TRACE_EVENT_SIZE).
+     */
+    char events[0];
 };
 
+/* Maximum size of the context of one event */
+#define TRACE_EVENT_CONTEXT_SIZE_MAX \
+    (TRACE_SERVER_MSG_LEN_MAX - offsetof(struct trace_server_msg_packet, events) \
+        - offsetof(struct trace_event, context))
+
 /* 
  * Event marks.
  * 
@@ -0,0 +1,53 @@
+#!/bin/sh
+
+############################################################################
+# Usage:
+#		bench.sh [server-option ...]
+#
+# Run user-space trace server with given options(see
+# 'trace_server_user -h') and receive the trace from it with
+# 'trace_reader' over loopback. Statistic of both sides is printed:
+# events per second, packet utilization and losses.
+#
+# Ports may be changed via SERVER_PORT and CLIENT_PORT variables.
+# Options for 'trace_reader' may be given in READER_OPTIONS.
+############################################################################
+
+SERVER_PORT=${SERVER_PORT:-5556}
+CLIENT_PORT=${CLIENT_PORT:-9999}
+READER_OPTIONS=${READER_OPTIONS:-"--receive-buffer 4194304"}
+
+BIN_DIR=`dirname "$0"`
+SERVER_OUT=`mktemp`
+CLIENT_OUT=`mktemp`
+
+"$BIN_DIR/trace_server_user" --server-port "$SERVER_PORT" "$@" > "$SERVER_OUT" &
+SERVER_PID=$!
+
+# Wait until server is ready
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	if grep -q "listening" "$SERVER_OUT" ; then
+		break
+	fi
+	sleep 0.1
+done
+
+printf "Server options: %s\n" "$*"
+printf "Client:\n"
+"$BIN_DIR/trace_reader" --quiet --timeout 5 \
+	--server-port "$SERVER_PORT" --client-port "$CLIENT_PORT" \
+	$READER_OPTIONS > "$CLIENT_OUT"
+RESULT=$?
+grep -v "^Receive\|^Trace" "$CLIENT_OUT"
+rm -f "$CLIENT_OUT"
+
+wait $SERVER_PID
+SERVER_RESULT=$?
+printf "Server:\n"
+grep -v "listening" "$SERVER_OUT"
+rm -f "$SERVER_OUT"
+
+if test $SERVER_RESULT -ne 0 ; then
+	exit $SERVER_RESULT
+fi
+exit $RESULT
@@ -4,6 +4,10 @@
 #include <string.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include <assert.h>
 
@@ -19,6 +23,11 @@
 #define SERVER_ADDRESS "127.0.0.1"
 #endif
 
+/* Default number of messages in the reorder window */
+#ifndef REORDER_WINDOW
+#define REORDER_WINDOW 64
+#endif
+
 /* Usefull macros for type convertion */
 #define offsetof(TYPE, MEMBER) ((size_t) &((TYPE *)0)->MEMBER)
 #define container_of(ptr, type, member) ({                      \
@@ -55,6 +64,27 @@ void print_usage(const char* command)
 	fprintf(stderr, "    If this option is not supplied or n is non-positive,\n "
 		"    client do not send STOP command to the server in any case.\n\n");
 
+	fprintf(stderr, "  --reorder-window <n>\n");
+	fprintf(stderr, "      Number of messages which may arrive ahead of "
+		"their turn.\n    If message is still missing when it goes out "
+		"of the window, it is counted as lost.\n");
+	fprintf(stderr, "    If this option is not supplied, "
+		"window size assumed to be %d.\n\n", (int)REORDER_WINDOW);
+
+	fprintf(stderr, "  --receive-buffer <bytes>\n");
+	fprintf(stderr, "      Size of the socket receive buffer(SO_RCVBUF).\n");
+	fprintf(stderr, "    If this option is not supplied, "
+		"system default is used.\n\n");
+
+	fprintf(stderr, "  --timeout <sec>\n");
+	fprintf(stderr, "      Fail if no message is received during "
+		"given time.\n");
+	fprintf(stderr, "    If this option is not supplied or is 0, "
+		"wait forever.\n\n");
+
+	fprintf(stderr, "  -q, --quiet\n");
+	fprintf(stderr, "      Do not print events, only statistic.\n\n");
+
 	fprintf(stderr, "  -h, --help\n");
 	fprintf(stderr, "      Print this help.\n\n");
 }
@@ -62,20 +92,29 @@ void print_usage(const char* command)
 int parse_arguments(int argc, char** argv,
 	const char** server_address, unsigned short* server_port,
 	unsigned short* client_port,
-	int* events_limit)
+	int* events_limit, int* window_size,
+	int* receive_buffer, int* timeout, int* is_quiet)
 {
 #define SERVER_ADDRESS_OPT 	1
 #define SERVER_PORT_OPT		2
 #define CLIENT_PORT_OPT		3
 #define EVENTS_LIMIT_OPT	4
+#define REORDER_WINDOW_OPT	5
+#define RECEIVE_BUFFER_OPT	6
+#define TIMEOUT_OPT			7
+#define QUIET_OPT			'q'
 #define HELP_OPT			'h'
 	// Available program's options
-	static const char short_options[] = "h";
+	static const char short_options[] = "hq";
 	static struct option long_options[] = {
 		{"server-address", 1, 0, SERVER_ADDRESS_OPT},
 		{"server-port", 1, 0, SERVER_PORT_OPT},
 		{"client-port", 1, 0, CLIENT_PORT_OPT},
 		{"events-limit", 1, 0, EVENTS_LIMIT_OPT},
+		{"reorder-window", 1, 0, REORDER_WINDOW_OPT},
+		{"receive-buffer", 1, 0, RECEIVE_BUFFER_OPT},
+		{"timeout", 1, 0, TIMEOUT_OPT},
+		{"quiet", 0, 0, QUIET_OPT},
 		{"help", 1, 0, HELP_OPT},
 		{0, 0, 0, 0}
 	};
@@ -86,6 +125,10 @@ int parse_arguments(int argc, char** argv,
 	*server_port = TRACE_SERVER_PORT;
 	*client_port = CLIENT_PORT;
 	*events_limit = 0;
+	*window_size = REORDER_WINDOW;
+	*receive_buffer = 0;
+	*timeout = 0;
+	*is_quiet = 0;
 
 	for(opt = getopt_long(argc, argv, short_options, long_options, NULL);
 		opt != -1;
@@ -135,6 +178,39 @@ int parse_arguments(int argc, char** argv,
             }
             *events_limit = (value > 0) ? (int)value : 0;
             break;
+        case REORDER_WINDOW_OPT:
+            endptr = optarg + strlen(optarg);
+            value = strtol(optarg, &endptr, 0);
+            if((*endptr != '\0') || (value <= 0) || (value > 0xffff))
+            {
+				fprintf(stderr, "Incorrect size of reorder window: %s", optarg);
+				return -1;
+            }
+            *window_size = (int)value;
+            break;
+        case RECEIVE_BUFFER_OPT:
+            endptr = optarg + strlen(optarg);
+            value = strtol(optarg, &endptr, 0);
+            if((*endptr != '\0') || (value <= 0))
+            {
+				fprintf(stderr, "Incorrect size of receive buffer: %s", optarg);
+				return -1;
+            }
+            *receive_buffer = (int)value;
+            break;
+        case TIMEOUT_OPT:
+            endptr = optarg + strlen(optarg);
+            value = strtol(optarg, &endptr, 0);
+            if((*endptr != '\0') || (value < 0))
+            {
+				fprintf(stderr, "Incorrect timeout: %s", optarg);
+				return -1;
+            }
+            *timeout = (int)value;
+            break;
+        case QUIET_OPT:
+            *is_quiet = 1;
+            break;
         case HELP_OPT:
             print_usage(argv[0]);
             return 1;
@@ -162,7 +238,7 @@ struct trace_client
 };
 
 static int trace_client_init(struct trace_client* client,
-    unsigned short client_port)
+    unsigned short client_port, int receive_buffer, int timeout)
 {
     struct sockaddr_in receivesocket;
     
@@ -185,9 +261,29 @@ static int trace_client_init(struct trace_client* client,
     if(result < 0)
     {
         perror("Failed to bind client socket");
+        close(client->sock);
+        return -1;
+    }
+
+    if(receive_buffer && setsockopt(client->sock, SOL_SOCKET, SO_RCVBUF,
+        &receive_buffer, sizeof(receive_buffer)))
+    {
+        perror("Failed to set size of receive buffer");
+        close(client->sock);
         return -1;
     }
 
+    if(timeout)
+    {
+        struct timeval tv = {.tv_sec = timeout, .tv_usec = 0};
+        if(setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+        {
+            perror("Failed to set receive timeout");
+            close(client->sock);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -262,7 +358,10 @@ static int trace_client_receive_msg(struct trace_client* client,
         TRACE_SERVER_MSG_LEN_MAX, 0, NULL, NULL);*/
     if(result < 0)
     {
-        perror("Failed to receive message");
+        if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            fprintf(stderr, "Timeout while waiting for message.\n");
+        else
+            perror("Failed to receive message");
         goto err;
     }
     if(result > TRACE_SERVER_MSG_LEN_MAX)
@@ -312,32 +411,25 @@ static int is_mark(struct trace_server_msg* server_msg,
 }
 
 /*
- * If given message contains trace packet, extracts its parameters into
- * 'event_context', 'event_context_size', 'timestamp' and return
- * non-zero value. Otherwise return 0.
+ * If given message contains trace packet, set 'n_events' and
+ * 'lost_events' to the packet parameters and return non-zero value.
+ * Otherwise return 0.
+ *
+ * Events may be iterated with trace_packet_next_event().
  */
 static int is_trace_packet(struct trace_server_msg* server_msg,
-	size_t server_msg_len, char** event_context,
-	__u16* event_context_size, __u64* timestamp)
+	size_t server_msg_len, int* n_events, int* lost_events)
 {
 	if(server_msg->type == TRACE_SERVER_MSG_TYPE_PACKET)
 	{
 		struct trace_server_msg_packet* msg_packet = 
 			(struct trace_server_msg_packet*)server_msg;
 
-		assert(server_msg_len >=
-			offsetof(struct trace_server_msg_packet, event.context));
-
-		__u16 __event_context_size = ntohs(msg_packet->event.context_size);
-		
-		assert(server_msg_len >=
-			offsetof(struct trace_server_msg_packet, event.context)
-				+ __event_context_size);
-		
-		*event_context = msg_packet->event.context;
-		
-		*event_context_size = __event_context_size;
-		*timestamp = timestamp_nt_get(&msg_packet->event.timestamp);
+		if(server_msg_len < offsetof(struct trace_server_msg_packet, events))
+			return 0;
+
+		*n_events = ntohs(msg_packet->n_events);
+		*lost_events = ntohs(msg_packet->lost_events);
 		return 1;
 	}
 	else
@@ -346,6 +438,321 @@ static int is_trace_packet(struct trace_server_msg* server_msg,
 	}
 }
 
+/*
+ * Extract parameters of the event at offset '*pos' in the trace packet
+ * into 'event_context', 'event_context_size', 'timestamp' and move
+ * '*pos' to the next event.
+ * 
+ * Return 0 on success, -1 if packet is malformed.
+ */
+static int trace_packet_next_event(struct trace_server_msg* server_msg,
+	size_t server_msg_len, size_t* pos, char** event_context,
+	__u16* event_context_size, __u64* timestamp)
+{
+	struct trace_event* event;
+	__u16 __event_context_size;
+
+	if(*pos + offsetof(struct trace_event, context) > server_msg_len)
+		return -1;
+
+	event = (struct trace_event*)((char*)server_msg + *pos);
+	__event_context_size = ntohs(event->context_size);
+	if(*pos + offsetof(struct trace_event, context) + __event_context_size
+		> server_msg_len)
+		return -1;
+
+	*event_context = (char*)event->context;
+	*event_context_size = __event_context_size;
+	*timestamp = timestamp_nt_get(&event->timestamp);
+
+	*pos += TRACE_EVENT_SIZE(__event_context_size);
+	return 0;
+}
+
+/* 
+ * Statistic about receiving trace.
+ */
+struct trace_client_stat
+{
+	/* Messages received(including duplicates) */
+	unsigned long messages;
+	/* Messages, which have not arrived at the moment they are needed */
+	unsigned long messages_lost;
+	/* Messages arrived after some message with greater 'seq' */
+	unsigned long messages_reordered;
+	/* Messages arrived after they have been counted as lost, duplicates */
+	unsigned long messages_late;
+	/* Trace packets processed */
+	unsigned long packets;
+	/* Bytes in the trace packets processed */
+	unsigned long long packets_bytes;
+	/* Events processed */
+	unsigned long events;
+	/* Events which have been dropped by the server */
+	unsigned long events_lost;
+	/* Duration of the session in seconds */
+	double time;
+};
+
+/*
+ * Window for restore order of the messages.
+ * 
+ * Messages are processed in order of their 'seq'. Message which arrives
+ * ahead of its time waits in the window until all previous messages
+ * will be processed. When there is no space in the window for new message,
+ * messages which are still missing are counted as lost.
+ */
+struct reorder_window
+{
+	/* Message with 'seq' is stored at index 'seq % size' */
+	struct trace_server_msg** msgs;
+	size_t* msgs_len;
+	int size;
+	/* Seq of the next message to be processed */
+	uint32_t next_seq;
+	/* Maximum seq among received messages */
+	uint32_t max_seq;
+};
+
+/* 
+ * Function which process message in order.
+ * 
+ * Should return 0 for continue processing, 1 if session is ended,
+ * or -1 on error.
+ */
+typedef int (*process_msg_t)(struct trace_server_msg* server_msg,
+	size_t server_msg_len, void* data);
+
+static int reorder_window_init(struct reorder_window* window, int size,
+	uint32_t first_seq)
+{
+	window->msgs = calloc(size, sizeof(*window->msgs));
+	window->msgs_len = calloc(size, sizeof(*window->msgs_len));
+	if((window->msgs == NULL) || (window->msgs_len == NULL))
+	{
+		fprintf(stderr, "Failed to allocate window for reorder messages.\n");
+		free(window->msgs);
+		free(window->msgs_len);
+		return -1;
+	}
+	window->size = size;
+	window->next_seq = first_seq;
+	window->max_seq = first_seq - 1;
+	return 0;
+}
+
+static void reorder_window_destroy(struct reorder_window* window)
+{
+	int i;
+	for(i = 0; i < window->size; i++)
+		free(window->msgs[i]);
+	free(window->msgs);
+	free(window->msgs_len);
+}
+
+/*
+ * Process message with 'next_seq'(if it has arrived) and move window.
+ */
+static int reorder_window_advance(struct reorder_window* window,
+	process_msg_t process, void* data, struct trace_client_stat* stat)
+{
+	int result = 0;
+	int index = window->next_seq % window->size;
+	struct trace_server_msg* server_msg = window->msgs[index];
+
+	if(server_msg)
+	{
+		window->msgs[index] = NULL;
+		result = process(server_msg, window->msgs_len[index], data);
+		free(server_msg);
+	}
+	else
+	{
+		stat->messages_lost++;
+	}
+	window->next_seq++;
+	return result;
+}
+
+/*
+ * Add message into the window and process all messages which may be
+ * processed after that.
+ * 
+ * Message becomes owned by the window.
+ * 
+ * Return last non-zero result of 'process' or 0.
+ */
+static int reorder_window_add(struct reorder_window* window,
+	struct trace_server_msg* server_msg, size_t server_msg_len,
+	process_msg_t process, void* data, struct trace_client_stat* stat)
+{
+	int result = 0;
+	unsigned char mark;
+	uint32_t seq = ntohl(server_msg->seq);
+	int32_t distance = (int32_t)(seq - window->next_seq);
+	int index;
+
+	stat->messages++;
+	if((distance < 0) || ((distance < window->size)
+		&& window->msgs[seq % window->size]))
+	{
+		stat->messages_late++;
+		free(server_msg);
+		return 0;
+	}
+	if((int32_t)(seq - window->max_seq) > 0)
+		window->max_seq = seq;
+	else
+		stat->messages_reordered++;
+
+	/* Make a room for the message */
+	while((distance >= window->size) && (result == 0))
+	{
+		result = reorder_window_advance(window, process, data, stat);
+		distance--;
+	}
+	if(result)
+	{
+		free(server_msg);
+		return result;
+	}
+
+	index = seq % window->size;
+	window->msgs[index] = server_msg;
+	window->msgs_len[index] = server_msg_len;
+
+	/* 
+	 * Nothing will be sent after the end of the session, so
+	 * do not wait for missing messages.
+	 */
+	if(is_mark(server_msg, server_msg_len, &mark)
+		&& (mark == TRACE_SERVER_MSG_MARK_SESSION_END))
+		distance = (int32_t)(seq - window->next_seq);
+	else
+		distance = -1;
+
+	while(result == 0)
+	{
+		if(distance >= 0)
+			distance--;
+		else if(window->msgs[window->next_seq % window->size] == NULL)
+			break;
+		result = reorder_window_advance(window, process, data, stat);
+	}
+
+	return result;
+}
+
+/* State of the receiving session */
+struct trace_session
+{
+	struct trace_client* client;
+	int events_limit;
+	int events_count;
+	int is_quiet;
+	/* Last mark processed */
+	unsigned char mark;
+	struct trace_client_stat stat;
+};
+
+static int trace_session_process_msg(struct trace_server_msg* server_msg,
+	size_t server_msg_len, void* data)
+{
+	struct trace_session* session = data;
+	int n_events, lost_events;
+	int i;
+
+	if(is_trace_packet(server_msg, server_msg_len, &n_events, &lost_events))
+	{
+		size_t pos = offsetof(struct trace_server_msg_packet, events);
+
+		session->stat.packets++;
+		session->stat.packets_bytes += server_msg_len;
+		session->stat.events_lost += lost_events;
+		if(lost_events && !session->is_quiet)
+		{
+			printf("Server has dropped %d events.\n", lost_events);
+		}
+
+		for(i = 0; i < n_events; i++)
+		{
+			char* event_context;
+			__u16 event_context_size;
+			__u64 timestamp;
+
+			if(trace_packet_next_event(server_msg, server_msg_len, &pos,
+				&event_context, &event_context_size, &timestamp))
+			{
+				printf("Incorrect message format.\n");
+				return -1;
+			}
+
+			if(!session->is_quiet)
+			{
+				int ts_sec = (timestamp / 1000000000L);
+				int ts_msec = (timestamp % 1000000000L) / 1000;
+
+				printf("(%d.%d): size=%d, content=%.*s\n", ts_sec, ts_msec,
+					(int)event_context_size, (int)event_context_size,
+					event_context);
+			}
+
+			session->stat.events++;
+			session->events_count++;
+			if(session->events_limit
+				&& (session->events_count == session->events_limit))
+			{
+				if(trace_client_send_command(session->client,
+					TRACE_CLIENT_MSG_TYPE_STOP))
+					return -1;
+				printf("Send STOP command to the server.\n");
+			}
+		}
+	}
+	else if(is_mark(server_msg, server_msg_len, &session->mark))
+	{
+		if(session->mark == TRACE_SERVER_MSG_MARK_TRACE_BEGIN)
+		{
+			printf("Trace begins.\n");
+		}
+		else if(session->mark == TRACE_SERVER_MSG_MARK_TRACE_END)
+		{
+			printf("Trace ends.\n");
+		}
+		else return 1;
+	}
+	else
+	{
+		printf("Incorrect message format.\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void trace_client_stat_print(struct trace_client_stat* stat)
+{
+	unsigned long events_total = stat->events + stat->events_lost;
+	unsigned long messages_total = stat->messages - stat->messages_late
+		+ stat->messages_lost;
+
+	printf("Messages: received %lu, lost %lu(%.2f%%), "
+		"reordered %lu, late or duplicated %lu.\n",
+		stat->messages, stat->messages_lost,
+		messages_total ? stat->messages_lost * 100.0 / messages_total : 0.0,
+		stat->messages_reordered, stat->messages_late);
+	printf("Packets: %lu, %.1f events per packet, "
+		"%.1f%% of maximum packet size used.\n",
+		stat->packets,
+		stat->packets ? (double)stat->events / stat->packets : 0.0,
+		stat->packets ? stat->packets_bytes * 100.0
+			/ ((double)stat->packets * TRACE_SERVER_MSG_LEN_MAX) : 0.0);
+	printf("Events: received %lu, dropped by server %lu(%.2f%%).\n",
+		stat->events, stat->events_lost,
+		events_total ? stat->events_lost * 100.0 / events_total : 0.0);
+	printf("Time: %.3f s, %.0f events per second.\n", stat->time,
+		stat->time > 0 ? stat->events / stat->time : 0.0);
+}
+
 
 int main(int argc, char **argv)
 {
@@ -353,14 +760,21 @@ int main(int argc, char **argv)
     struct trace_client client;
 
     int events_limit;
+    int window_size;
+    int receive_buffer;
+    int timeout;
+    int is_quiet;
+    struct timespec start_time, end_time;
     const char* server_address;
     unsigned short server_port;
     unsigned short client_port;
-    
-    int events_count = 0;
+
+    struct trace_session session;
+    struct reorder_window window;
 
     result = parse_arguments(argc, argv, &server_address,
-		&server_port, &client_port, &events_limit);
+		&server_port, &client_port, &events_limit, &window_size,
+		&receive_buffer, &timeout, &is_quiet);
 	if(result) return result;
 	
 	if(events_limit)
@@ -369,7 +783,7 @@ int main(int argc, char **argv)
 			events_limit);
 	}
     
-    result = trace_client_init(&client, client_port);
+    result = trace_client_init(&client, client_port, receive_buffer, timeout);
     if(result) return result;
     
     result = trace_client_connect(&client, server_address,
@@ -402,63 +816,42 @@ int main(int argc, char **argv)
         goto err;
 	}
 	printf("Receive session begins.\n");
+
+	memset(&session, 0, sizeof(session));
+	session.client = &client;
+	session.events_limit = events_limit;
+	session.is_quiet = is_quiet;
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+	result = reorder_window_init(&window, window_size,
+		ntohl(server_msg->seq) + 1);
 	free(server_msg);
+	if(result) goto err;
     
-	/* Read futher trace events in cycle */
+	/* Read futher messages in cycle, process them in order */
     for(result = trace_client_receive_msg(&client, &server_msg, &server_msg_len);
 		result == 0;
 		result = trace_client_receive_msg(&client, &server_msg, &server_msg_len)
 	)
     {
-        char* event_context;
-        __u16 event_context_size;
-        __u64 timestamp;
-        
-        if(is_trace_packet(server_msg, server_msg_len,
-			&event_context, &event_context_size, &timestamp))
-		{
-			int ts_sec = (timestamp / 1000000000L);
-			int ts_msec = (timestamp % 1000000000L) / 1000;
-        
-			printf("(%d.%d): size=%d, content=%.*s\n", ts_sec, ts_msec,
-				(int)event_context_size, (int)event_context_size, event_context);
-			free(server_msg);
-			
-			events_count++;
-			if(events_limit && (events_count == events_limit))
-			{
-				result = trace_client_send_command(&client, TRACE_CLIENT_MSG_TYPE_STOP);
-				if(result) goto err;
-				printf("Send STOP command to the server.\n");
-			}
-		}
-        else if(is_mark(server_msg, server_msg_len, &mark))
-        {
-			free(server_msg);
-			if(mark == TRACE_SERVER_MSG_MARK_TRACE_BEGIN)
-			{
-				printf("Trace begins.\n");
-			}
-			else if(mark == TRACE_SERVER_MSG_MARK_TRACE_END)
-			{
-				printf("Trace ends.\n");
-			}
-			else break;
-        }
-        else
-        {
-			printf("Incorrect message format.\n");
-			free(server_msg);
-			goto err;
-        }
+        result = reorder_window_add(&window, server_msg, server_msg_len,
+			trace_session_process_msg, &session, &session.stat);
+		if(result) break;
     }
-    if(result) goto err;
+    reorder_window_destroy(&window);
+    if(result < 0) goto err;
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    session.stat.time = (end_time.tv_sec - start_time.tv_sec)
+        + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+
+    trace_client_stat_print(&session.stat);
 
     /* SESSION_END */
-	if(mark != TRACE_SERVER_MSG_MARK_SESSION_END)
+	if(session.mark != TRACE_SERVER_MSG_MARK_SESSION_END)
 	{
    		fprintf(stderr, "Unexpected mark while receiving trace: %d\n",
-			(int)mark);
+			(int)session.mark);
         goto err;
 	}
     
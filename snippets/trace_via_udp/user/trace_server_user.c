@@ -0,0 +1,712 @@
+/*
+ * User-space implementation of the trace server.
+ *
+ * Implements the same protocol as the kernel module(see README and
+ * trace_server.h), so the client may be tested and benchmarked without
+ * loading the module.
+ *
+ * Trace events are produced by the load generator thread with given
+ * sizes and rate, and are stored in the buffer in the same way as
+ * the kernel module does with per-cpu buffers. After all events are
+ * generated and sent, the server sends TRACE_END mark and exits.
+ */
+
+/* sendmmsg() */
+#define _GNU_SOURCE
+
+#include "trace_server.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+
+#include <getopt.h>
+
+#define offsetof(TYPE, MEMBER) ((size_t) &((TYPE *)0)->MEMBER)
+
+/* Default size of the events buffer(in bytes) */
+#define BUFFER_SIZE 65536
+/* Default number of packets sent at once */
+#define PACKETS_BURST 16
+/* Default number of events generated */
+#define EVENTS_NUMBER 100000
+/* Default size of events generated */
+#define EVENT_SIZE 32
+
+/* Interval(in us) for poll events buffer when it is empty */
+#define POLL_INTERVAL 100
+
+struct server_options
+{
+	unsigned short port;
+	unsigned long buffer_size;
+	unsigned int packets_burst;
+	unsigned long events_number;
+	int event_size_min;
+	int event_size_max;
+	/* Events per second, 0 means unlimited */
+	unsigned long rate;
+};
+
+static void print_usage(const char* command)
+{
+	fprintf(stderr, "Usage:\n\n");
+	fprintf(stderr, "  %s [option ...]\n\n", command);
+	fprintf(stderr, "Where option may be:\n\n");
+
+	fprintf(stderr, "  --server-port <port>\n");
+	fprintf(stderr, "      Port for listen commands, default is %d.\n\n",
+		(int)TRACE_SERVER_PORT);
+	fprintf(stderr, "  --buffer-size <bytes>\n");
+	fprintf(stderr, "      Size of the events buffer, default is %d.\n\n",
+		BUFFER_SIZE);
+	fprintf(stderr, "  --packets-burst <n>\n");
+	fprintf(stderr, "      Maximum number of packets sent at once, "
+		"default is %d.\n\n", PACKETS_BURST);
+	fprintf(stderr, "  --events <n>\n");
+	fprintf(stderr, "      Number of events generated, default is %d.\n\n",
+		EVENTS_NUMBER);
+	fprintf(stderr, "  --event-size <size>[:<max-size>]\n");
+	fprintf(stderr, "      Size of the event content. If maximum size is given,\n"
+		"    size of every event is choosen randomly from the range.\n"
+		"    Default is %d.\n\n", EVENT_SIZE);
+	fprintf(stderr, "  --rate <n>\n");
+	fprintf(stderr, "      Generate <n> events per second. By default, "
+		"events are generated\n    as fast as possible.\n\n");
+	fprintf(stderr, "  -h, --help\n");
+	fprintf(stderr, "      Print this help.\n\n");
+}
+
+static int parse_number(const char* str, unsigned long* value)
+{
+	char* endptr;
+
+	errno = 0;
+	*value = strtoul(str, &endptr, 0);
+	if((*str == '\0') || (*endptr != '\0') || errno)
+	{
+		fprintf(stderr, "Incorrect number: %s\n", str);
+		return -1;
+	}
+	return 0;
+}
+
+static int parse_arguments(int argc, char** argv,
+	struct server_options* options)
+{
+#define SERVER_PORT_OPT		1
+#define BUFFER_SIZE_OPT		2
+#define PACKETS_BURST_OPT	3
+#define EVENTS_OPT			4
+#define EVENT_SIZE_OPT		5
+#define RATE_OPT			6
+#define HELP_OPT			'h'
+	static const char short_options[] = "h";
+	static struct option long_options[] = {
+		{"server-port", 1, 0, SERVER_PORT_OPT},
+		{"buffer-size", 1, 0, BUFFER_SIZE_OPT},
+		{"packets-burst", 1, 0, PACKETS_BURST_OPT},
+		{"events", 1, 0, EVENTS_OPT},
+		{"event-size", 1, 0, EVENT_SIZE_OPT},
+		{"rate", 1, 0, RATE_OPT},
+		{"help", 0, 0, HELP_OPT},
+		{0, 0, 0, 0}
+	};
+	int opt;
+
+	options->port = TRACE_SERVER_PORT;
+	options->buffer_size = BUFFER_SIZE;
+	options->packets_burst = PACKETS_BURST;
+	options->events_number = EVENTS_NUMBER;
+	options->event_size_min = options->event_size_max = EVENT_SIZE;
+	options->rate = 0;
+
+	while((opt = getopt_long(argc, argv, short_options, long_options, NULL)) != -1)
+	{
+		unsigned long value, value_max;
+		char* sep;
+
+		switch(opt)
+		{
+		case SERVER_PORT_OPT:
+			if(parse_number(optarg, &value)) return -1;
+			if((value == 0) || (value > 0xffff))
+			{
+				fprintf(stderr, "Incorrect port number: %s\n", optarg);
+				return -1;
+			}
+			options->port = (unsigned short)value;
+			break;
+		case BUFFER_SIZE_OPT:
+			if(parse_number(optarg, &options->buffer_size)) return -1;
+			break;
+		case PACKETS_BURST_OPT:
+			if(parse_number(optarg, &value)) return -1;
+			if(value == 0)
+			{
+				fprintf(stderr, "At least one packet should be sent at once.\n");
+				return -1;
+			}
+			options->packets_burst = (unsigned int)value;
+			break;
+		case EVENTS_OPT:
+			if(parse_number(optarg, &options->events_number)) return -1;
+			break;
+		case EVENT_SIZE_OPT:
+			sep = strchr(optarg, ':');
+			if(sep) *sep = '\0';
+			if(parse_number(optarg, &value)) return -1;
+			value_max = value;
+			if(sep && parse_number(sep + 1, &value_max)) return -1;
+			if((value == 0) || (value > value_max)
+				|| (value_max > TRACE_EVENT_CONTEXT_SIZE_MAX))
+			{
+				fprintf(stderr, "Size of events should be in range 1..%d.\n",
+					(int)TRACE_EVENT_CONTEXT_SIZE_MAX);
+				return -1;
+			}
+			options->event_size_min = (int)value;
+			options->event_size_max = (int)value_max;
+			break;
+		case RATE_OPT:
+			if(parse_number(optarg, &options->rate)) return -1;
+			break;
+		case HELP_OPT:
+			print_usage(argv[0]);
+			return 1;
+		default:
+			fprintf(stderr, "Execute '%s -h' to see the description "
+				"of program's parameters.\n", argv[0]);
+			return -1;
+		}
+	}
+	if(optind < argc)
+	{
+		fprintf(stderr, "Unexpected argument: %s\n", argv[optind]);
+		return -1;
+	}
+	return 0;
+}
+
+static uint64_t current_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//************************ Events buffer *****************************//
+/*
+ * Same as per-cpu buffer in the kernel module: one writer(generator)
+ * and one reader(sender), no locks.
+ */
+struct server_trace_event_header
+{
+	uint64_t timestamp;
+	uint32_t content_size;
+};
+
+struct server_trace_buffer
+{
+	char* data;
+	unsigned long mask;
+	/* Position where next event will be written. Changed by writer. */
+	unsigned long head;
+	/* Position of the first unread event. Changed by reader. */
+	unsigned long tail;
+	/* Number of events which are dropped because buffer is full */
+	unsigned long lost;
+	/* Number of dropped events already reported to the client */
+	unsigned long lost_reported;
+};
+
+static int server_trace_buffer_init(struct server_trace_buffer* buffer,
+	unsigned long size)
+{
+	unsigned long real_size = 1;
+	while(real_size < size) real_size <<= 1;
+
+	buffer->data = malloc(real_size);
+	if(buffer->data == NULL)
+	{
+		fprintf(stderr, "Failed to allocate buffer for trace events.\n");
+		return -1;
+	}
+	buffer->mask = real_size - 1;
+	buffer->head = buffer->tail = 0;
+	buffer->lost = buffer->lost_reported = 0;
+	return 0;
+}
+
+static void server_trace_buffer_destroy(struct server_trace_buffer* buffer)
+{
+	free(buffer->data);
+}
+
+static void server_trace_buffer_write(struct server_trace_buffer* buffer,
+	unsigned long pos, const void* data, size_t size)
+{
+	unsigned long offset = pos & buffer->mask;
+	size_t part = buffer->mask + 1 - offset;
+	if(part > size) part = size;
+
+	memcpy(buffer->data + offset, data, part);
+	memcpy(buffer->data, (const char*)data + part, size - part);
+}
+
+static void server_trace_buffer_read(struct server_trace_buffer* buffer,
+	unsigned long pos, void* data, size_t size)
+{
+	unsigned long offset = pos & buffer->mask;
+	size_t part = buffer->mask + 1 - offset;
+	if(part > size) part = size;
+
+	memcpy(data, buffer->data + offset, part);
+	memcpy((char*)data + part, buffer->data, size - part);
+}
+
+/* Return 0 on success, -1 if event is dropped. */
+static int server_trace_add_event(struct server_trace_buffer* buffer,
+	const void* content, int content_size)
+{
+	struct server_trace_event_header header;
+	unsigned long head = buffer->head;
+	unsigned long size = sizeof(header) + content_size;
+
+	if(head - __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE) + size
+		> buffer->mask + 1)
+	{
+		__atomic_store_n(&buffer->lost, buffer->lost + 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	header.timestamp = current_time_ns();
+	header.content_size = content_size;
+	server_trace_buffer_write(buffer, head, &header, sizeof(header));
+	server_trace_buffer_write(buffer, head + sizeof(header),
+		content, content_size);
+	__atomic_store_n(&buffer->head, head + size, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * Fill message with events.
+ *
+ * Return number of bytes written. If no events, return 0.
+ */
+static size_t server_trace_fill_packet(struct server_trace_buffer* buffer,
+	struct trace_server_msg_packet* msg_packet, size_t size_max)
+{
+	size_t size = offsetof(struct trace_server_msg_packet, events);
+	int n_events = 0;
+	unsigned long head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+	unsigned long tail = buffer->tail;
+	unsigned long lost;
+
+	while(tail != head)
+	{
+		struct server_trace_event_header header;
+		struct trace_event* event;
+
+		server_trace_buffer_read(buffer, tail, &header, sizeof(header));
+		if(size + TRACE_EVENT_SIZE(header.content_size) > size_max)
+			break;
+
+		event = (struct trace_event*)((char*)msg_packet + size);
+		timestamp_nt_set(&event->timestamp, header.timestamp);
+		event->context_size = htons(header.content_size);
+		server_trace_buffer_read(buffer, tail + sizeof(header),
+			event->context, header.content_size);
+
+		tail += sizeof(header) + header.content_size;
+		size += TRACE_EVENT_SIZE(header.content_size);
+		n_events++;
+	}
+	if(n_events == 0) return 0;
+	/* Free space in the buffer only after data have been read */
+	__atomic_store_n(&buffer->tail, tail, __ATOMIC_RELEASE);
+
+	lost = __atomic_load_n(&buffer->lost, __ATOMIC_RELAXED)
+		- buffer->lost_reported;
+	if(lost > 0xffff) lost = 0xffff;
+	buffer->lost_reported += lost;
+
+	msg_packet->base.type = TRACE_SERVER_MSG_TYPE_PACKET;
+	msg_packet->n_events = htons(n_events);
+	msg_packet->lost_events = htons(lost);
+
+	return size;
+}
+
+//************************ Load generator ****************************//
+struct load_generator
+{
+	struct server_trace_buffer* buffer;
+	const struct server_options* options;
+	/* Set when all events are generated */
+	int is_finished;
+	pthread_t thread;
+};
+
+static void* load_generator_thread(void* data)
+{
+	struct load_generator* generator = data;
+	const struct server_options* options = generator->options;
+	char content[TRACE_EVENT_CONTEXT_SIZE_MAX];
+	unsigned long i;
+	uint64_t start = current_time_ns();
+	unsigned int seed = 1;
+
+	memset(content, '.', sizeof(content));
+
+	for(i = 0; i < options->events_number; i++)
+	{
+		int size = options->event_size_min;
+		char label[32];
+		int label_len;
+
+		if(options->event_size_max > size)
+			size += rand_r(&seed) % (options->event_size_max - size + 1);
+
+		label_len = snprintf(label, sizeof(label), "event %lu", i);
+		memcpy(content, label, (label_len < size) ? label_len : size);
+
+		server_trace_add_event(generator->buffer, content, size);
+
+		if(options->rate && ((i & 15) == 15))
+		{
+			/* Check rate only sometimes, sleep is too coarse */
+			uint64_t expected = start + (i + 1) * 1000000000ULL / options->rate;
+			uint64_t now = current_time_ns();
+			if(expected > now)
+			{
+				struct timespec ts = {
+					.tv_sec = (expected - now) / 1000000000,
+					.tv_nsec = (expected - now) % 1000000000
+				};
+				nanosleep(&ts, NULL);
+			}
+		}
+	}
+
+	__atomic_store_n(&generator->is_finished, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static int load_generator_start(struct load_generator* generator,
+	struct server_trace_buffer* buffer, const struct server_options* options)
+{
+	int result;
+
+	generator->buffer = buffer;
+	generator->options = options;
+	generator->is_finished = 0;
+
+	result = pthread_create(&generator->thread, NULL,
+		load_generator_thread, generator);
+	if(result)
+	{
+		fprintf(stderr, "Failed to create thread for load generator: %s\n",
+			strerror(result));
+		return -1;
+	}
+	return 0;
+}
+
+static void load_generator_wait(struct load_generator* generator)
+{
+	pthread_join(generator->thread, NULL);
+}
+
+static int load_generator_is_finished(struct load_generator* generator)
+{
+	return __atomic_load_n(&generator->is_finished, __ATOMIC_ACQUIRE);
+}
+
+//************************ Events sender *****************************//
+struct events_sender
+{
+	int sock;
+	struct sockaddr_in client;
+	uint32_t seq;
+
+	unsigned int packets_burst;
+	char* packets;
+	struct iovec* iovecs;
+	struct mmsghdr* msgs;
+
+	/* Statistic */
+	unsigned long packets_sent;
+	unsigned long send_calls;
+	unsigned long long bytes_sent;
+};
+
+static int events_sender_init(struct events_sender* sender,
+	unsigned short port, unsigned int packets_burst)
+{
+	struct sockaddr_in server;
+
+	sender->packets = malloc(packets_burst * TRACE_SERVER_MSG_LEN_MAX);
+	sender->iovecs = malloc(packets_burst * sizeof(*sender->iovecs));
+	sender->msgs = malloc(packets_burst * sizeof(*sender->msgs));
+	if((sender->packets == NULL) || (sender->iovecs == NULL)
+		|| (sender->msgs == NULL))
+	{
+		fprintf(stderr, "Failed to allocate buffer for trace packets.\n");
+		goto err;
+	}
+	sender->packets_burst = packets_burst;
+	sender->seq = 0;
+	sender->packets_sent = sender->send_calls = 0;
+	sender->bytes_sent = 0;
+
+	sender->sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(sender->sock == -1)
+	{
+		perror("Failed to create server socket");
+		goto err;
+	}
+
+	memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_addr.s_addr = htonl(INADDR_ANY);
+	server.sin_port = htons(port);
+	if(bind(sender->sock, (struct sockaddr*)&server, sizeof(server)) == -1)
+	{
+		perror("Failed to bind server socket");
+		close(sender->sock);
+		goto err;
+	}
+
+	return 0;
+
+err:
+	free(sender->msgs);
+	free(sender->iovecs);
+	free(sender->packets);
+	return -1;
+}
+
+static void events_sender_destroy(struct events_sender* sender)
+{
+	close(sender->sock);
+	free(sender->msgs);
+	free(sender->iovecs);
+	free(sender->packets);
+}
+
+/*
+ * Receive command from the client.
+ *
+ * Return type of the command, 0 if no command(non-blocking mode),
+ * -1 on error.
+ */
+static int events_sender_receive_command(struct events_sender* sender,
+	int should_wait)
+{
+	struct trace_client_msg msg;
+	struct sockaddr_in from;
+	socklen_t from_len = sizeof(from);
+	ssize_t result;
+
+	result = recvfrom(sender->sock, &msg, sizeof(msg),
+		should_wait ? 0 : MSG_DONTWAIT, (struct sockaddr*)&from, &from_len);
+	if(result == -1)
+	{
+		if(errno == EAGAIN || errno == EINTR) return 0;
+		perror("Failed to receive command");
+		return -1;
+	}
+	if(result < (ssize_t)sizeof(msg))
+	{
+		fprintf(stderr, "Ignore incorrect request.\n");
+		return 0;
+	}
+	if(msg.type == TRACE_CLIENT_MSG_TYPE_START)
+		sender->client = from;
+
+	return msg.type;
+}
+
+static int events_sender_send_trace_mark(struct events_sender* sender,
+	char mark)
+{
+	struct trace_server_msg_mark msg_mark;
+	size_t size = offsetof(struct trace_server_msg_mark, end_struct);
+
+	memset(&msg_mark, 0, sizeof(msg_mark));
+	msg_mark.base.seq = htonl(sender->seq++);
+	msg_mark.base.type = TRACE_SERVER_MSG_TYPE_MARK;
+	msg_mark.mark = mark;
+
+	if(sendto(sender->sock, &msg_mark, size, 0,
+		(struct sockaddr*)&sender->client, sizeof(sender->client)) == -1)
+	{
+		perror("Failed to send mark");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Fill up to 'packets_burst' packets and send them with one call.
+ *
+ * Return number of packets sent, -1 on error.
+ */
+static int events_sender_send_trace_packets(struct events_sender* sender,
+	struct server_trace_buffer* buffer)
+{
+	unsigned int n_packets;
+	int sent = 0;
+
+	for(n_packets = 0; n_packets < sender->packets_burst; n_packets++)
+	{
+		struct trace_server_msg_packet* msg_packet = (void*)
+			(sender->packets + n_packets * TRACE_SERVER_MSG_LEN_MAX);
+		size_t size = server_trace_fill_packet(buffer,
+			msg_packet, TRACE_SERVER_MSG_LEN_MAX);
+
+		if(size == 0) break;
+		msg_packet->base.seq = htonl(sender->seq++);
+
+		sender->iovecs[n_packets].iov_base = msg_packet;
+		sender->iovecs[n_packets].iov_len = size;
+		memset(&sender->msgs[n_packets], 0, sizeof(sender->msgs[n_packets]));
+		sender->msgs[n_packets].msg_hdr.msg_name = &sender->client;
+		sender->msgs[n_packets].msg_hdr.msg_namelen = sizeof(sender->client);
+		sender->msgs[n_packets].msg_hdr.msg_iov = &sender->iovecs[n_packets];
+		sender->msgs[n_packets].msg_hdr.msg_iovlen = 1;
+		sender->bytes_sent += size;
+	}
+
+	while(sent < (int)n_packets)
+	{
+		int result = sendmmsg(sender->sock, sender->msgs + sent,
+			n_packets - sent, 0);
+		if(result == -1)
+		{
+			if(errno == EINTR) continue;
+			perror("Failed to send trace packets");
+			return -1;
+		}
+		sender->send_calls++;
+		sent += result;
+	}
+	sender->packets_sent += n_packets;
+
+	return n_packets;
+}
+
+int main(int argc, char** argv)
+{
+	int result;
+	struct server_options options;
+	struct server_trace_buffer buffer;
+	struct load_generator generator;
+	struct events_sender sender;
+	int is_generator_started = 0;
+	int is_first_session = 1;
+	int command;
+	uint64_t start_time = 0;
+
+	result = parse_arguments(argc, argv, &options);
+	if(result) return result < 0 ? 1 : 0;
+
+	if(server_trace_buffer_init(&buffer, options.buffer_size)) return 1;
+	if(events_sender_init(&sender, options.port, options.packets_burst))
+	{
+		server_trace_buffer_destroy(&buffer);
+		return 1;
+	}
+	printf("Server is listening on port %d.\n", (int)options.port);
+	fflush(stdout);
+
+	while(1)
+	{
+		int is_trace_ended = 0;
+
+		/* Wait for the client */
+		command = events_sender_receive_command(&sender, 1);
+		if(command < 0) goto err;
+		if(command != TRACE_CLIENT_MSG_TYPE_START) continue;
+
+		if(events_sender_send_trace_mark(&sender,
+			TRACE_SERVER_MSG_MARK_SESSION_BEGIN)) goto err;
+		if(is_first_session)
+		{
+			if(events_sender_send_trace_mark(&sender,
+				TRACE_SERVER_MSG_MARK_TRACE_BEGIN)) goto err;
+			is_first_session = 0;
+		}
+		/* Events are generated when the first client comes */
+		if(!is_generator_started)
+		{
+			if(load_generator_start(&generator, &buffer, &options)) goto err;
+			is_generator_started = 1;
+			start_time = current_time_ns();
+		}
+
+		/* Send trace until STOP command or end of trace */
+		while(1)
+		{
+			int is_finished = load_generator_is_finished(&generator);
+
+			command = events_sender_receive_command(&sender, 0);
+			if(command < 0) goto err;
+			if(command == TRACE_CLIENT_MSG_TYPE_STOP) break;
+
+			result = events_sender_send_trace_packets(&sender, &buffer);
+			if(result < 0) goto err;
+			if(result > 0) continue;
+
+			if(is_finished)
+			{
+				is_trace_ended = 1;
+				break;
+			}
+			usleep(POLL_INTERVAL);
+		}
+
+		if(is_trace_ended)
+		{
+			events_sender_send_trace_mark(&sender,
+				TRACE_SERVER_MSG_MARK_TRACE_END);
+		}
+		events_sender_send_trace_mark(&sender,
+			TRACE_SERVER_MSG_MARK_SESSION_END);
+
+		if(is_trace_ended) break;
+	}
+
+	load_generator_wait(&generator);
+	{
+		double time = (current_time_ns() - start_time) / 1e9;
+
+		printf("Events: generated %lu, dropped %lu.\n",
+			options.events_number, buffer.lost);
+		printf("Packets: sent %lu in %lu calls, %.1f%% of maximum packet "
+			"size used.\n", sender.packets_sent, sender.send_calls,
+			sender.packets_sent ? sender.bytes_sent * 100.0
+				/ ((double)sender.packets_sent * TRACE_SERVER_MSG_LEN_MAX) : 0.0);
+		printf("Time: %.3f s, %.0f events per second.\n", time,
+			(options.events_number - buffer.lost) / time);
+	}
+
+	events_sender_destroy(&sender);
+	server_trace_buffer_destroy(&buffer);
+	return 0;
+
+err:
+	if(is_generator_started) load_generator_wait(&generator);
+	events_sender_destroy(&sender);
+	server_trace_buffer_destroy(&buffer);
+	return 1;
+}